@@ -0,0 +1,604 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#define _SCL_SECURE_NO_WARNINGS
+
+#include "DependencyDatabase.h"
+#include "AssetUtils.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Streams/PathUtils.h"
+#include "../Utility/Streams/FileSystemMonitor.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <algorithm>
+
+namespace Assets { namespace IntermediateResources
+{
+        //  File layout:
+        //      DepDBHeader
+        //      DepDBRecord[_recordCount]           (sorted by _nameHash)
+        //      DepDBDependency[_dependencyCount]
+        //      char stringTable[_stringTableSize]  (null terminated strings)
+        //
+        //  All of the structures are 8 byte aligned, so the file can be used in
+        //  place after it has been mapped.
+    static const uint32 DepDBMagic = uint32('X') | (uint32('D') << 8) | (uint32('E') << 16) | (uint32('P') << 24);
+    static const uint32 DepDBVersion = 0;
+
+        //  Pending records are merged into the file once this many have accumulated
+        //  (so we don't lose too much if the process doesn't shut down cleanly)
+    static const unsigned FlushThreshold = 64;
+
+    class DepDBHeader
+    {
+    public:
+        uint32  _magic;
+        uint32  _version;
+        uint32  _recordCount;
+        uint32  _dependencyCount;
+        uint32  _stringTableSize;
+        uint32  _padding;
+    };
+
+    class DepDBRecord
+    {
+    public:
+        uint64  _nameHash;
+        uint32  _nameOffset;
+        uint32  _basePathOffset;
+        uint32  _firstDependency;
+        uint32  _dependencyCount;
+    };
+
+    class DepDBDependency
+    {
+    public:
+        uint64  _timeMarker;
+        uint64  _contentHash;       // 0 when not recorded
+        uint32  _nameOffset;
+        uint32  _padding;
+    };
+
+    class PendingDependency
+    {
+    public:
+        std::basic_string<ResChar>  _name;
+        uint64                      _timeMarker;
+        uint64                      _contentHash;
+    };
+
+    class PendingRecord
+    {
+    public:
+        std::basic_string<ResChar>      _name;
+        std::basic_string<ResChar>      _basePath;
+        std::vector<PendingDependency>  _dependencies;
+    };
+
+        //  Cached state of a single source file. The file system monitor tells us
+        //  when we need to query it again.
+    class FileState : public Utility::OnChangeCallback
+    {
+    public:
+        uint64              _modificationTime;
+        uint64              _contentHash;       // 0 until calculated
+        Interlocked::Value  _changed;
+
+        void OnChange() { Interlocked::Exchange(&_changed, 1); }
+        FileState() : _modificationTime(0), _contentHash(0), _changed(1) {}
+    };
+
+    class CompareRecordHash
+    {
+    public:
+        bool operator()(const DepDBRecord& lhs, uint64 rhs) const { return lhs._nameHash < rhs; }
+        bool operator()(uint64 lhs, const DepDBRecord& rhs) const { return lhs < rhs._nameHash; }
+        bool operator()(const DepDBRecord& lhs, const DepDBRecord& rhs) const { return lhs._nameHash < rhs._nameHash; }
+    };
+
+    class DependencyDatabase::Pimpl
+    {
+    public:
+        std::basic_string<ResChar>          _filename;
+        std::unique_ptr<MemoryMappedFile>   _mappedFile;
+        const DepDBRecord*      _records;
+        const DepDBDependency*  _dependencies;
+        const ResChar*          _strings;
+        unsigned                _recordCount;
+        unsigned                _dependencyCount;
+        unsigned                _stringTableSize;
+
+        std::vector<std::pair<uint64, PendingRecord>>               _pendingRecords;
+        std::vector<std::pair<uint64, std::shared_ptr<FileState>>>  _fileStates;
+
+        Threading::Mutex    _lock;
+        bool                _recordContentHashes;
+        Metrics             _metrics;
+
+        void                LoadFile();
+        void                ReleaseFile();
+        void                FlushAlreadyLocked();
+
+        const ResChar*      GetString(uint32 offset) const;
+        const DepDBRecord*  FindRecord(uint64 hash, const ResChar name[]) const;
+        PendingRecord*      FindPendingRecord(uint64 hash, const ResChar name[]);
+        void                SetPendingRecord(uint64 hash, PendingRecord&& record);
+
+        FileState&          GetFileState(const ResChar fullPath[]);
+        uint64              GetContentHash(FileState& state, const ResChar fullPath[]);
+
+        typedef std::vector<std::pair<std::basic_string<ResChar>, uint64>> ChangedTimes;
+        template<typename DependencyIterator, typename GetDependency>
+            Status::Enum ValidateDependencies(
+                const ResChar intermediateName[], const ResChar basePath[],
+                DependencyIterator begin, DependencyIterator end, GetDependency getDependency,
+                ChangedTimes& changedTimes);
+
+        Pimpl();
+    };
+
+    DependencyDatabase::Pimpl::Pimpl()
+    : _records(nullptr), _dependencies(nullptr), _strings(nullptr)
+    , _recordCount(0), _dependencyCount(0), _stringTableSize(0)
+    , _recordContentHashes(true)
+    {}
+
+    void DependencyDatabase::Pimpl::LoadFile()
+    {
+        ReleaseFile();
+
+        auto fileSize = GetFileSize(_filename.c_str());
+        if (fileSize < sizeof(DepDBHeader)) return;
+
+        auto mappedFile = std::make_unique<MemoryMappedFile>(_filename.c_str(), fileSize, MemoryMappedFile::Access::Read);
+        if (!mappedFile->IsValid()) return;
+
+        const void* data = mappedFile->GetData();
+        const auto& hdr = *(const DepDBHeader*)data;
+        uint64 expectedSize = sizeof(DepDBHeader)
+            + uint64(hdr._recordCount) * sizeof(DepDBRecord)
+            + uint64(hdr._dependencyCount) * sizeof(DepDBDependency)
+            + hdr._stringTableSize;
+        if (hdr._magic != DepDBMagic || hdr._version != DepDBVersion || expectedSize > fileSize) {
+            LogWarning << "Ignoring bad or out of date dependency database (" << _filename << ")";
+            return;
+        }
+
+        _records = (const DepDBRecord*)PtrAdd(data, sizeof(DepDBHeader));
+        _dependencies = (const DepDBDependency*)PtrAdd(_records, hdr._recordCount * sizeof(DepDBRecord));
+        _strings = (const ResChar*)PtrAdd(_dependencies, hdr._dependencyCount * sizeof(DepDBDependency));
+        _recordCount = hdr._recordCount;
+        _dependencyCount = hdr._dependencyCount;
+        _stringTableSize = hdr._stringTableSize;
+        if (_stringTableSize && _strings[_stringTableSize-1] != '\0') {
+            _stringTableSize = 0;       // (string table isn't terminated; the file is corrupt)
+            _recordCount = 0;
+        }
+        _mappedFile = std::move(mappedFile);
+    }
+
+    void DependencyDatabase::Pimpl::ReleaseFile()
+    {
+        _mappedFile.reset();
+        _records = nullptr;
+        _dependencies = nullptr;
+        _strings = nullptr;
+        _recordCount = _dependencyCount = _stringTableSize = 0;
+    }
+
+    const ResChar* DependencyDatabase::Pimpl::GetString(uint32 offset) const
+    {
+        if (offset >= _stringTableSize) return "";
+        return &_strings[offset];
+    }
+
+    const DepDBRecord* DependencyDatabase::Pimpl::FindRecord(uint64 hash, const ResChar name[]) const
+    {
+        auto range = std::equal_range(_records, &_records[_recordCount], hash, CompareRecordHash());
+        for (auto i=range.first; i!=range.second; ++i)
+            if (!XlCompareString(GetString(i->_nameOffset), name))
+                return i;
+        return nullptr;
+    }
+
+    PendingRecord* DependencyDatabase::Pimpl::FindPendingRecord(uint64 hash, const ResChar name[])
+    {
+        auto range = std::equal_range(
+            _pendingRecords.begin(), _pendingRecords.end(), hash,
+            CompareFirst<uint64, PendingRecord>());
+        for (auto i=range.first; i!=range.second; ++i)
+            if (i->second._name == name)
+                return &i->second;
+        return nullptr;
+    }
+
+    void DependencyDatabase::Pimpl::SetPendingRecord(uint64 hash, PendingRecord&& record)
+    {
+        auto* existing = FindPendingRecord(hash, record._name.c_str());
+        if (existing) {
+            *existing = std::move(record);
+        } else {
+            auto i = std::upper_bound(
+                _pendingRecords.begin(), _pendingRecords.end(), hash,
+                CompareFirst<uint64, PendingRecord>());
+            _pendingRecords.insert(i, std::make_pair(hash, std::move(record)));
+        }
+    }
+
+    FileState& DependencyDatabase::Pimpl::GetFileState(const ResChar fullPath[])
+    {
+        ResChar normalized[MaxPath];
+        XlNormalizePath(normalized, dimof(normalized), fullPath);
+        auto hash = Hash64(normalized);
+
+        auto i = LowerBound(_fileStates, hash);
+        if (i == _fileStates.end() || i->first != hash) {
+            auto state = std::make_shared<FileState>();
+            i = _fileStates.insert(i, std::make_pair(hash, state));
+
+                //  (same split as RegisterFileDependency, which only accepts DependencyValidation objects)
+            ResChar directoryName[MaxPath], baseName[MaxPath];
+            XlDirname(directoryName, dimof(directoryName), normalized);
+            auto len = XlStringLen(directoryName);
+            if (len > 0) { directoryName[len-1] = '\0'; }
+            XlBasename(baseName, dimof(baseName), normalized);
+            if (!directoryName[0]) XlCopyString(directoryName, "./");
+            Utility::AttachFileSystemMonitor(directoryName, baseName, state);
+        }
+
+        auto& state = *i->second;
+        if (Interlocked::Exchange(&state._changed, 0)) {
+            state._modificationTime = GetFileModificationTime(fullPath);
+            state._contentHash = 0;
+            ++_metrics._fileStateQueries;
+        }
+        return state;
+    }
+
+    uint64 DependencyDatabase::Pimpl::GetContentHash(FileState& state, const ResChar fullPath[])
+    {
+        if (!state._contentHash && state._modificationTime) {
+            size_t size = 0;
+            auto block = LoadFileAsMemoryBlock(fullPath, &size);
+            if (block) {
+                state._contentHash = Hash64(block.get(), PtrAdd(block.get(), size));
+                if (!state._contentHash) state._contentHash = 1;    // (0 is reserved for "no hash")
+            }
+            ++_metrics._contentHashes;
+        }
+        return state._contentHash;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename DependencyIterator, typename GetDependency>
+        auto DependencyDatabase::Pimpl::ValidateDependencies(
+            const ResChar intermediateName[], const ResChar basePath[],
+            DependencyIterator begin, DependencyIterator end, GetDependency getDependency,
+            ChangedTimes& changedTimes) -> Status::Enum
+        {
+            ResChar buffer[MaxPath];
+            for (auto i=begin; i!=end; ++i) {
+                const ResChar* depName; uint64 timeMarker, contentHash;
+                getDependency(*i, depName, timeMarker, contentHash);
+
+                const ResChar* fullPath = depName;
+                if (basePath && basePath[0]) {
+                    XlConcatPath(buffer, dimof(buffer), basePath, depName);
+                    fullPath = buffer;
+                }
+
+                auto& state = GetFileState(fullPath);
+                if (!state._modificationTime) {
+                    LogInfo << "Asset (" << intermediateName << ") is invalidated because of missing dependency (" << depName << ")";
+                    return Status::Invalid;
+                }
+
+                if (state._modificationTime != timeMarker) {
+                    if (!contentHash || GetContentHash(state, fullPath) != contentHash) {
+                        LogInfo << "Asset (" << intermediateName << ") is invalidated because of file data on dependency (" << depName << ")";
+                        return Status::Invalid;
+                    }
+
+                        //  The file was touched, but the contents are the same. Record the new
+                        //  time so we don't have to hash it again next time.
+                    changedTimes.push_back(std::make_pair(std::basic_string<ResChar>(depName), state._modificationTime));
+                }
+            }
+
+            return Status::Valid;
+        }
+
+    static void RegisterDependencies(
+        const std::shared_ptr<DependencyValidation>& validation,
+        const ResChar basePath[], const ResChar depName[])
+    {
+        if (basePath && basePath[0]) {
+            ResChar buffer[MaxPath];
+            XlConcatPath(buffer, dimof(buffer), basePath, depName);
+            RegisterFileDependency(validation, buffer);
+        } else {
+            RegisterFileDependency(validation, depName);
+        }
+    }
+
+    auto DependencyDatabase::Validate(
+        const ResChar intermediateName[],
+        const std::shared_ptr<DependencyValidation>& validation) -> Status::Enum
+    {
+        auto& pimpl = *_pimpl;
+        ScopedLock(pimpl._lock);
+
+        auto hash = Hash64(intermediateName);
+        Pimpl::ChangedTimes changedTimes;
+
+        auto* pending = pimpl.FindPendingRecord(hash, intermediateName);
+        if (pending) {
+            auto result = pimpl.ValidateDependencies(
+                intermediateName, pending->_basePath.c_str(),
+                pending->_dependencies.begin(), pending->_dependencies.end(),
+                [](const PendingDependency& d, const ResChar*& name, uint64& timeMarker, uint64& contentHash)
+                    { name = d._name.c_str(); timeMarker = d._timeMarker; contentHash = d._contentHash; },
+                changedTimes);
+            if (result != Status::Valid) return result;
+
+            for (auto& d:pending->_dependencies) {
+                for (const auto& c:changedTimes)
+                    if (c.first == d._name) d._timeMarker = c.second;
+                RegisterDependencies(validation, pending->_basePath.c_str(), d._name.c_str());
+            }
+            return Status::Valid;
+        }
+
+        auto* record = pimpl.FindRecord(hash, intermediateName);
+        if (!record) return Status::NoRecord;
+        if (record->_firstDependency + record->_dependencyCount > pimpl._dependencyCount)
+            return Status::Invalid;
+
+        auto* depBegin = &pimpl._dependencies[record->_firstDependency];
+        auto* depEnd = depBegin + record->_dependencyCount;
+        auto* basePath = pimpl.GetString(record->_basePathOffset);
+        auto result = pimpl.ValidateDependencies(
+            intermediateName, basePath, depBegin, depEnd,
+            [&pimpl](const DepDBDependency& d, const ResChar*& name, uint64& timeMarker, uint64& contentHash)
+                { name = pimpl.GetString(d._nameOffset); timeMarker = d._timeMarker; contentHash = d._contentHash; },
+            changedTimes);
+        if (result != Status::Valid) return result;
+
+        for (auto d=depBegin; d!=depEnd; ++d)
+            RegisterDependencies(validation, basePath, pimpl.GetString(d->_nameOffset));
+
+        if (!changedTimes.empty()) {
+                //  Write a new version of this record, with the updated modification times
+            PendingRecord newRecord;
+            newRecord._name = intermediateName;
+            newRecord._basePath = basePath;
+            for (auto d=depBegin; d!=depEnd; ++d) {
+                PendingDependency dep;
+                dep._name = pimpl.GetString(d->_nameOffset);
+                dep._timeMarker = d->_timeMarker;
+                dep._contentHash = d->_contentHash;
+                for (const auto& c:changedTimes)
+                    if (c.first == dep._name) dep._timeMarker = c.second;
+                newRecord._dependencies.push_back(std::move(dep));
+            }
+            pimpl.SetPendingRecord(hash, std::move(newRecord));
+        }
+
+        return Status::Valid;
+    }
+
+    void DependencyDatabase::Write(
+        const ResChar intermediateName[], const ResChar baseDir[],
+        const std::vector<FileAndTime>& dependencies)
+    {
+        auto& pimpl = *_pimpl;
+        ScopedLock(pimpl._lock);
+
+        PendingRecord record;
+        record._name = intermediateName;
+        record._basePath = baseDir ? baseDir : "";
+        record._dependencies.reserve(dependencies.size());
+
+        ResChar buffer[MaxPath];
+        for (const auto& d:dependencies) {
+            PendingDependency dep;
+            dep._name = d._filename;
+            dep._timeMarker = d._timeMarker;
+            dep._contentHash = 0;
+
+            if (pimpl._recordContentHashes) {
+                const ResChar* fullPath = d._filename.c_str();
+                if (baseDir && baseDir[0]) {
+                    XlConcatPath(buffer, dimof(buffer), baseDir, d._filename.c_str());
+                    fullPath = buffer;
+                }
+
+                    //  Only record the hash if the file hasn't changed since the compiler
+                    //  read it. Otherwise we could record the hash of some newer version.
+                auto& state = pimpl.GetFileState(fullPath);
+                if (state._modificationTime == d._timeMarker)
+                    dep._contentHash = pimpl.GetContentHash(state, fullPath);
+            }
+
+            record._dependencies.push_back(std::move(dep));
+        }
+
+        pimpl.SetPendingRecord(Hash64(intermediateName), std::move(record));
+        if (pimpl._pendingRecords.size() >= FlushThreshold)
+            pimpl.FlushAlreadyLocked();
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class StringTableBuilder
+    {
+    public:
+        uint32 Add(const ResChar str[])
+        {
+            auto hash = Hash64(str);
+            auto range = std::equal_range(_lookup.begin(), _lookup.end(), hash, CompareFirst<uint64, uint32>());
+            for (auto i=range.first; i!=range.second; ++i)
+                if (!XlCompareString(&_strings[i->second], str))
+                    return i->second;
+
+            auto offset = uint32(_strings.size());
+            _strings.insert(_strings.end(), str, &str[XlStringLen(str)+1]);
+            _lookup.insert(range.second, std::make_pair(hash, offset));
+            return offset;
+        }
+
+        std::vector<ResChar> _strings;
+        std::vector<std::pair<uint64, uint32>> _lookup;
+    };
+
+    void DependencyDatabase::Pimpl::FlushAlreadyLocked()
+    {
+        if (_pendingRecords.empty()) return;
+
+            //  Merge the records in the file with the pending records. Pending records
+            //  replace file records with the same name. Both lists are already sorted by
+            //  hash, so we can do this in a single pass.
+        std::vector<DepDBRecord> records;
+        std::vector<DepDBDependency> dependencies;
+        StringTableBuilder strings;
+        records.reserve(_recordCount + _pendingRecords.size());
+        dependencies.reserve(_dependencyCount);
+
+        auto addPending = [&](const std::pair<uint64, PendingRecord>& p)
+        {
+            DepDBRecord r;
+            r._nameHash = p.first;
+            r._nameOffset = strings.Add(p.second._name.c_str());
+            r._basePathOffset = strings.Add(p.second._basePath.c_str());
+            r._firstDependency = uint32(dependencies.size());
+            r._dependencyCount = uint32(p.second._dependencies.size());
+            for (const auto& d:p.second._dependencies) {
+                DepDBDependency dep;
+                dep._timeMarker = d._timeMarker;
+                dep._contentHash = d._contentHash;
+                dep._nameOffset = strings.Add(d._name.c_str());
+                dep._padding = 0;
+                dependencies.push_back(dep);
+            }
+            records.push_back(r);
+        };
+
+        auto addExisting = [&](const DepDBRecord& e)
+        {
+            if (e._firstDependency + e._dependencyCount > _dependencyCount) return;
+            DepDBRecord r;
+            r._nameHash = e._nameHash;
+            r._nameOffset = strings.Add(GetString(e._nameOffset));
+            r._basePathOffset = strings.Add(GetString(e._basePathOffset));
+            r._firstDependency = uint32(dependencies.size());
+            r._dependencyCount = e._dependencyCount;
+            for (unsigned c=0; c<e._dependencyCount; ++c) {
+                auto dep = _dependencies[e._firstDependency + c];
+                dep._nameOffset = strings.Add(GetString(dep._nameOffset));
+                dependencies.push_back(dep);
+            }
+            records.push_back(r);
+        };
+
+        auto p = _pendingRecords.cbegin();
+        for (unsigned c=0; c<_recordCount; ++c) {
+            const auto& e = _records[c];
+            while (p != _pendingRecords.cend() && p->first < e._nameHash) { addPending(*p); ++p; }
+
+            bool replaced = false;
+            for (auto p2 = p; p2 != _pendingRecords.cend() && p2->first == e._nameHash; ++p2)
+                if (!XlCompareString(p2->second._name.c_str(), GetString(e._nameOffset))) { replaced = true; break; }
+            if (!replaced) addExisting(e);
+        }
+        for (; p != _pendingRecords.cend(); ++p) addPending(*p);
+
+            //  pad the string table so the file size stays a multiple of 8
+        while (strings._strings.size() % 8) strings._strings.push_back('\0');
+
+        DepDBHeader hdr;
+        hdr._magic = DepDBMagic;
+        hdr._version = DepDBVersion;
+        hdr._recordCount = uint32(records.size());
+        hdr._dependencyCount = uint32(dependencies.size());
+        hdr._stringTableSize = uint32(strings._strings.size() * sizeof(ResChar));
+        hdr._padding = 0;
+
+            //  Write the new version to a temporary file first, and then replace the
+            //  original. If we fail part way through (or the process is killed) the
+            //  existing database is left intact.
+        auto tempFilename = _filename + ".tmp";
+        bool writeSucceeded = false;
+        TRY {
+            BasicFile file(tempFilename.c_str(), "wb");
+            file.Write(&hdr, sizeof(hdr), 1);
+            if (!records.empty()) file.Write(AsPointer(records.cbegin()), sizeof(DepDBRecord), records.size());
+            if (!dependencies.empty()) file.Write(AsPointer(dependencies.cbegin()), sizeof(DepDBDependency), dependencies.size());
+            if (!strings._strings.empty()) file.Write(AsPointer(strings._strings.cbegin()), sizeof(ResChar), strings._strings.size());
+            writeSucceeded = true;
+        } CATCH (const std::exception& e) {
+            LogWarning << "Failed while writing dependency database (" << tempFilename << "): " << e.what();
+        } CATCH_END
+
+        if (!writeSucceeded) {
+                //  (the pending records are kept, so we will try again in the next flush)
+            if (DoesFileExist(tempFilename.c_str()))
+                XlDeleteFile((const utf8*)tempFilename.c_str());
+            return;
+        }
+
+            //  We must release the mapping before we can replace the file
+        ReleaseFile();
+        if (XlMoveFile((const utf8*)tempFilename.c_str(), (const utf8*)_filename.c_str())) {
+            _pendingRecords.clear();
+        } else {
+            LogWarning << "Failed while replacing dependency database (" << _filename << ")";
+            XlDeleteFile((const utf8*)tempFilename.c_str());
+        }
+        LoadFile();
+    }
+
+    void DependencyDatabase::Flush()
+    {
+        ScopedLock(_pimpl->_lock);
+        _pimpl->FlushAlreadyLocked();
+    }
+
+    auto DependencyDatabase::GetMetrics() const -> Metrics
+    {
+        ScopedLock(_pimpl->_lock);
+        auto result = _pimpl->_metrics;
+        result._recordCount = _pimpl->_recordCount;
+        result._pendingRecordCount = unsigned(_pimpl->_pendingRecords.size());
+        return result;
+    }
+
+    DependencyDatabase::Metrics::Metrics()
+    : _recordCount(0), _pendingRecordCount(0), _fileStateQueries(0), _contentHashes(0) {}
+
+    DependencyDatabase::DependencyDatabase(const ResChar filename[], bool recordContentHashes)
+    {
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_filename = filename;
+        _pimpl->_recordContentHashes = recordContentHashes;
+        _pimpl->LoadFile();
+    }
+
+    DependencyDatabase::~DependencyDatabase()
+    {
+        TRY {
+            Flush();
+        } CATCH (...) {
+        } CATCH_END
+    }
+}}
+
@@ -0,0 +1,72 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Assets.h"
+#include "../Utility/Mixins.h"
+#include <memory>
+#include <vector>
+
+namespace Assets { class DependencyValidation; class FileAndTime; }
+
+namespace Assets { namespace IntermediateResources
+{
+    /// <summary>Records the dependencies of all of the intermediate files in a store</summary>
+    /// Previously, each intermediate file had a small text file in a ".deps" directory
+    /// listing its dependencies. Validating a warm cache meant opening and parsing
+    /// thousands of those files, and querying the modification time of the same
+    /// source files over and over again.
+    ///
+    /// This database keeps all of the records in a single binary file that is
+    /// memory mapped and searched in place. The state of each source file is only queried
+    /// once, and then cached until the file system monitor reports a change to
+    /// that file.
+    ///
+    /// Each dependency can also record a hash of the contents of the file. When the
+    /// modification time doesn't match, but the contents do (eg, after a version control
+    /// operation touches files without changing them), the dependency is still
+    /// considered valid and the new modification time is recorded.
+    ///
+    /// New records are kept in memory and merged into the file by Flush(). Flush() is
+    /// also called periodically from Write(), and from the destructor.
+    class DependencyDatabase : noncopyable
+    {
+    public:
+        struct Status { enum Enum { Valid, Invalid, NoRecord }; };
+
+            /// <summary>Checks the dependencies for the given intermediate file</summary>
+            /// When the record is valid, file dependencies are registered with "validation".
+        Status::Enum    Validate(
+            const ResChar intermediateName[],
+            const std::shared_ptr<DependencyValidation>& validation);
+
+        void            Write(
+            const ResChar intermediateName[], const ResChar baseDir[],
+            const std::vector<FileAndTime>& dependencies);
+
+        void            Flush();
+
+        class Metrics
+        {
+        public:
+            unsigned    _recordCount;
+            unsigned    _pendingRecordCount;
+            unsigned    _fileStateQueries;      ///< number of times we've had to query the file system
+            unsigned    _contentHashes;         ///< number of times we've had to hash the contents of a file
+            Metrics();
+        };
+        Metrics         GetMetrics() const;
+
+        DependencyDatabase(const ResChar filename[], bool recordContentHashes = true);
+        ~DependencyDatabase();
+
+    protected:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+}}
+
@@ -9,6 +9,7 @@
 #include "IntermediateResources.h"
 
 #include "CompileAndAsyncManager.h"     // for ~PendingCompileMarker -- remove
+#include "DependencyDatabase.h"
 
 #include "../ConsoleRig/Log.h"
 #include "../Assets/AssetUtils.h"
@@ -56,15 +57,42 @@ namespace Assets { namespace IntermediateResources
             _snprintf_s(destination, DestCount, _TRUNCATE, "%s/.deps/%s", baseDirectory, f);
         }
 
+    template <int DestCount>
+        static void MakeDependencyRecordName(ResChar (&destination)[DestCount], const ResChar baseDirectory[], const ResChar intermediateFileName[])
+        {
+                //  Same as MakeDepFileName, except that the result is relative to the
+                //  base directory, and it's in the normalized form used as the key
+                //  for the dependency database
+            const ResChar* f = intermediateFileName, *b = baseDirectory;
+            while (ConvChar(*f) == ConvChar(*b) && *f != '\0') { ++f; ++b; }
+            while (ConvChar(*f) == '/') { ++f; }
+            unsigned c = 0;
+            for (; *f && c < (DestCount-1); ++f, ++c) destination[c] = ConvChar(*f);
+            destination[c] = '\0';
+        }
+
     std::shared_ptr<DependencyValidation> Store::MakeDependencyValidation(const ResChar intermediateFileName[]) const
     {
-            //  When we process a file, we write a little text file to the
-            //  ".deps" directory. This contains a list of dependency files, and
-            //  the state of those files when this file was compiled.
-            //  If the current files don't match the state that's recorded in
-            //  the .deps file, then we can assume that it is out of date and
-            //  must be recompiled.
+            //  When we process a file, we record the list of dependency files, and
+            //  the state of those files when this file was compiled, in the dependency
+            //  database. If the current files don't match the recorded state, then
+            //  we can assume that it is out of date and must be recompiled.
+        ResChar buffer[MaxPath];
+        MakeDependencyRecordName(buffer, _baseDirectory.c_str(), intermediateFileName);
+
+        auto validation = std::make_shared<DependencyValidation>();
+        auto status = _dependencyDatabase->Validate(buffer, validation);
+        if (status == DependencyDatabase::Status::Valid) return validation;
+        if (status == DependencyDatabase::Status::Invalid) return nullptr;
+
+            //  Older versions wrote a little text file to the ".deps" directory
+            //  for each intermediate file, instead of using the database. We can
+            //  still use those.
+        return LoadLegacyDependencies(intermediateFileName);
+    }
 
+    std::shared_ptr<DependencyValidation> Store::LoadLegacyDependencies(const ResChar intermediateFileName[]) const
+    {
         ResChar buffer[MaxPath];
         MakeDepFileName(buffer, _baseDirectory.c_str(), intermediateFileName);
         TRY {
@@ -119,24 +147,12 @@ namespace Assets { namespace IntermediateResources
 
     std::shared_ptr<DependencyValidation> Store::WriteDependencies(const ResChar intermediateFileName[], const ResChar baseDir[], const std::vector<FileAndTime>& dependencies) const
     {
-        Data data;
-
         auto result = std::make_shared<DependencyValidation>();
 
-            //  we have to write the base directory to the dependencies file as well
+            //  we have to write the base directory to the dependencies record as well
             //  to keep it short, most filenames should be expressed as relative files
         char buffer[MaxPath];
-        data.SetAttribute("BasePath", baseDir);
-
-        auto dependenciesBlock = std::make_unique<Data>("Dependencies");
         for (auto s=dependencies.cbegin(); s!=dependencies.cend(); ++s) {
-            auto c = std::make_unique<Data>();
-            c->SetAttribute("Name", s->_filename.c_str());
-
-            c->SetAttribute("ModTimeHigh", (int)(s->_timeMarker>>32ull));
-            c->SetAttribute("ModTimeLow", (int)(s->_timeMarker));
-            dependenciesBlock->Add(c.release());
-
             if (baseDir[0]) {
                 XlConcatPath(buffer, dimof(buffer), baseDir, s->_filename.c_str());
                 RegisterFileDependency(result, buffer);
@@ -144,17 +160,9 @@ namespace Assets { namespace IntermediateResources
                 RegisterFileDependency(result, s->_filename.c_str());
             }
         }
-        data.Add(dependenciesBlock.release());
 
-        MakeDepFileName(buffer, _baseDirectory.c_str(), intermediateFileName);
-
-            // first, create the directory if we need to
-        char dirName[MaxPath];
-        XlDirname(dirName, dimof(dirName), buffer);
-        CreateDirectoryRecursive(dirName);
-
-            // now, write -- 
-        data.Save(buffer);
+        MakeDependencyRecordName(buffer, _baseDirectory.c_str(), intermediateFileName);
+        _dependencyDatabase->Write(buffer, baseDir, dependencies);
 
         return result;
     }
@@ -237,6 +245,9 @@ namespace Assets { namespace IntermediateResources
         }
 
         _baseDirectory = goodBranchDir;
+
+        _snprintf_s(buffer, _TRUNCATE, "%s/.depdb", _baseDirectory.c_str());
+        _dependencyDatabase = std::make_unique<DependencyDatabase>(buffer);
     }
 
     Store::~Store() {}
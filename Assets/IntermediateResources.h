@@ -57,6 +57,7 @@ namespace Assets
 namespace Assets { namespace IntermediateResources
 {
     class IResourceCompiler;
+    class DependencyDatabase;
 
     class Store
     {
@@ -71,7 +72,10 @@ namespace Assets { namespace IntermediateResources
         Store(const ResChar baseDirectory[], const ResChar versionString[]);
         ~Store();
     protected:
+        std::shared_ptr<DependencyValidation>    LoadLegacyDependencies(const ResChar intermediateFileName[]) const;
+
         std::string _baseDirectory;
+        std::unique_ptr<DependencyDatabase> _dependencyDatabase;
     };
 
     class IResourceCompiler
@@ -26,6 +26,7 @@ namespace BufferUploads
         _batchedCopyBytes = _batchedCopyCount = 0;
         _wakeCount = 0;
         _frameId = 0;
+        _cancelledSteps = 0;
         _retirementCount = 0;
     }
 
@@ -56,6 +57,7 @@ namespace BufferUploads
         _framePriorityStallTime = cloneFrom._framePriorityStallTime;
         _batchedCopyBytes = cloneFrom._batchedCopyBytes; _batchedCopyCount = cloneFrom._batchedCopyCount;
         _wakeCount = cloneFrom._wakeCount; _frameId = cloneFrom._frameId;
+        _cancelledSteps = cloneFrom._cancelledSteps;
         return *this;
     }
 
@@ -9,6 +9,8 @@
 #include "PlatformInterface.h"
 #include "ResourceSource.h"
 #include "DataPacket.h"
+#include "TransactionTrace.h"
+#include "StepSchedule.h"
 #include "../RenderCore/IDevice.h"
 #include "../RenderCore/IThreadContext.h"
 #include "../ConsoleRig/Log.h"
@@ -16,6 +18,7 @@
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/BitUtils.h"
+#include "../Utility/TimeUtils.h"
 #include <assert.h>
 #include <utility>
 #include <algorithm>
@@ -43,111 +46,33 @@ namespace BufferUploads
 
         ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-    template<typename T>
-    struct DeleteAligned
+    static bool IsDataReady(RawDataPacket* packet)
     {
-        void operator()(T* ptr) { XlMemAlignFree(ptr); }
-    };
-
-    class FileDataSource : public RawDataPacket
-    {
-    public:
-        virtual void*                           GetData             (unsigned mipIndex, unsigned arrayIndex);
-        virtual size_t                          GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const;
-        virtual std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const;
-
-        FileDataSource(const void* fileHandle, size_t offset, size_t dataSize);
-        virtual ~FileDataSource();
-
-    protected:
-        std::unique_ptr<byte[], DeleteAligned<byte>>        _pkt;
-        HANDLE      _fileHandle;
-        OVERLAPPED  _overlappedStatus;
-        size_t      _dataSize;
-    };
-
-    void*                     FileDataSource::GetData             (unsigned mipIndex, unsigned arrayIndex)
-    {
-        if (mipIndex == 0) {
-            while (!HasOverlappedIoCompleted(&_overlappedStatus)) {
-                ::Threading::YieldTimeSlice();
-            }
-
-            return _pkt.get();
-        }
-        return nullptr;
-    }
-
-    size_t                          FileDataSource::GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const
-    {
-        return _dataSize;
+            //  Steps with data that is still loading (eg, an asynchronous file read) are
+            //  left in the queue. The read completion callback wakes the assembly line,
+            //  and we'll try them again then.
+        return !packet || packet->IsDataReady() || packet->HasFailed();
     }
 
-    std::pair<unsigned,unsigned>    FileDataSource::GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const
+    static RawDataPacket* ValidData(RawDataPacket* packet)
     {
-            // hack -- hard coded values for terrain upload
-        if (_dataSize == 8192) {
-            int pixelWidth = 128;
-            return std::make_pair(pixelWidth * 64 / 8 / 4, unsigned(_dataSize));
-        } else if (_dataSize == 2312) { 
-            return std::make_pair(34*2, unsigned(_dataSize));
-        } else if (_dataSize == 4356) { 
-            return std::make_pair(33*4, unsigned(_dataSize));
-        } else {
-            return std::make_pair(33*2, unsigned(_dataSize));
+            //  Packets that failed to load (eg, a read error) are treated as if there
+            //  was no data at all. The resource is still created, but left uninitialised.
+        if (packet && packet->HasFailed()) {
+            LogWarning << "Buffer uploads initialisation data failed to load. Resource will be left uninitialised.";
+            return nullptr;
         }
+        return packet;
     }
 
-    FileDataSource::FileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
-    {
-        assert(dataSize);
-        assert(fileHandle != INVALID_HANDLE_VALUE);
-
-            //  duplicate the file handle so we get our own reference count on this
-            //  file object.
-        HANDLE duplicatedFileHandle;
-        ::DuplicateHandle(
-            GetCurrentProcess(), (HANDLE)fileHandle, GetCurrentProcess(),
-            &duplicatedFileHandle, 0, FALSE, DUPLICATE_SAME_ACCESS);
-
-            // start the read operation immediately (it will happen asynchronously)
-            //
-            //      Simple asynchronous io to start with... Just start the io here (from the
-            //      queuing thread), and add a stall when we attempt to read the data.
-            //      
-            //      We'll be reading into a temporary buffer, and then copying that into
-            //      the staging texture. That's a little bit redundant. Ideally we'd allocate
-            //      the staging texture first, and then copy into that from here.
-        std::unique_ptr<byte[], DeleteAligned<byte>> pkt((byte*)XlMemAlign(dataSize, 16));
-        XlSetMemory(&_overlappedStatus, 0, sizeof(_overlappedStatus));
-        _overlappedStatus.Offset = (DWORD)offset;
-        _overlappedStatus.OffsetHigh = (DWORD)(uint64(offset)>>32);
-        // SetFilePointer(duplicatedFileHandle, offset, 0, FILE_BEGIN);
-        auto result = ReadFile(
-            duplicatedFileHandle, pkt.get(), (DWORD)dataSize, 
-            nullptr, &_overlappedStatus);
-        auto lastError = GetLastError();
-        (void)result; (void)lastError;
-
-        _pkt = std::move(pkt);
-        _fileHandle = duplicatedFileHandle;
-        _dataSize = dataSize;
-    }
-
-    FileDataSource::~FileDataSource()
+    static void StallOnData(RawDataPacket* packet)
     {
-        if (_fileHandle && _fileHandle!=INVALID_HANDLE_VALUE) {
-            CloseHandle(_fileHandle);
+            //  GetData() blocks until the data is ready (or the load has failed)
+        if (packet && !IsDataReady(packet)) {
+            packet->GetData(0, 0);
         }
     }
 
-    intrusive_ptr<RawDataPacket> CreateFileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
-    {
-        return make_intrusive<FileDataSource>(fileHandle, offset, dataSize);
-    }
-    
-        ///////////////////////////////////////////////////////////////////////////////////////////////////
-
     static BufferDesc AsStagingDesc(const BufferDesc& desc)
     {
         BufferDesc result = desc;
@@ -182,6 +107,9 @@ namespace BufferUploads
 #define DEQUE_BASED_TRANSACTIONS
 #define OPTIMISED_ALLOCATE_TRANSACTION
     
+    using Internal::ScheduleKey;
+    using Internal::ScheduledStep;
+
     class AssemblyLine
     {
     public:
@@ -201,6 +129,7 @@ namespace BufferUploads
         void                Transaction_End(TransactionID id);
         void                Transaction_AddRef(TransactionID id);
         void                Transaction_Validate(TransactionID id);
+        void                Transaction_SetPriority(TransactionID id, unsigned requiredByFrame, unsigned priority);
 
         intrusive_ptr<ResourceLocator>     Transaction_Immediate(  
             const BufferDesc& desc, RawDataPacket* initialisationData, 
@@ -223,6 +152,10 @@ namespace BufferUploads
         unsigned            FlipWritingQueueSet();
         void                OnLostDevice();
 
+        void                SetFrameBudget(const FrameBudget& budget);
+        void                SuspendFrameBudget();
+        void                ResumeFrameBudget();
+
         IManager::EventListID TickResourceSource(unsigned stepMask, ThreadContext& context, bool isLoading);
 
         AssemblyLine(RenderCore::IDevice* device);
@@ -247,6 +180,8 @@ namespace BufferUploads
                 unsigned _heapIndex;
             #endif
             int _creationFrameID;
+            unsigned _requiredByFrame, _priority;
+            bool _externalResource;
 
             Transaction(unsigned idTopPart, unsigned heapIndex, const BufferDesc& desc);
             Transaction();
@@ -281,6 +216,7 @@ namespace BufferUploads
         Interlocked::Value      _currentQueuedBytes[UploadDataType::Max];
         unsigned                _nextTransactionIdTopPart, _queuedPeakCreates, _queuedPeakUploads, _queuedPeakStagingCreates;
         bool                    _queuedWorkFlag;
+        bool                    _waitingOnPendingData;
         int64                   _waitTime;
 
         #if defined(XL_DEBUG)
@@ -345,6 +281,49 @@ namespace BufferUploads
             CommandListBudget(bool isLoading);
         };
 
+            //
+            //      Steps from the main queue set are moved into the schedule by the thread
+            //      that processes them (and only that thread touches the schedule). Each list
+            //      is kept sorted by the deadline and priority of the transactions, with the
+            //      most urgent step at the back (see StepSchedule.h).
+            //
+        class Schedule
+        {
+        public:
+            std::vector<ScheduledStep<ResourceCreateStep>>  _createSteps;
+            std::vector<ScheduledStep<ResourceCreateStep>>  _stagingBufferCreateSteps;
+            std::vector<ScheduledStep<DataUploadStep>>      _uploadSteps;
+            unsigned            _nextSequence;
+            Interlocked::Value  _lastPriorityChangeCount, _lastCancelCount;
+            unsigned            _budgetFrame, _bytesThisFrame;
+            TimeMarker          _timeThisFrame;
+            Schedule();
+        };
+        Schedule _schedule;
+
+        Interlocked::Value  _priorityChangeCount, _cancelCount, _frameBudgetSuspendCount;
+        unsigned            _frameBudget_Bytes;
+        TimeMarker          _frameBudget_Time;
+        bool                _waitingOnFrameBudget;
+
+        static bool     IsCancelled(const Transaction& transaction);
+        bool            WithinFrameBudget() const;
+
+        std::pair<bool,bool>    ProcessSchedule(unsigned stepMask, ThreadContext& context, const CommandListBudget& budgetUnderConstruction);
+        void                    UpdateSchedule(unsigned stepMask, ThreadContext& context);
+
+        template<typename StepType, typename QueueType>
+            void    ScheduleSteps(QueueType& queue, std::vector<ScheduledStep<StepType>>& steps, ThreadContext& context);
+        template<typename StepType>
+            void    RefreshSchedule(std::vector<ScheduledStep<StepType>>& steps);
+        template<typename StepType>
+            void    DropCancelledSteps(std::vector<ScheduledStep<StepType>>& steps, ThreadContext& context);
+        template<typename StepType>
+            bool    ProcessScheduledSteps(
+                        std::vector<ScheduledStep<StepType>>& steps, 
+                        bool (AssemblyLine::*processFn)(const StepType&, unsigned, ThreadContext&, const CommandListBudget&),
+                        unsigned stepMask, ThreadContext& context, const CommandListBudget& budgetUnderConstruction);
+
         void            ResolveBatchOperation(BatchPreparation& batchOperation, ThreadContext& context, unsigned stepMask);
         void            ReleaseTransaction(Transaction* transaction, ThreadContext& context);
         void            ClientReleaseTransaction(Transaction* transaction);
@@ -560,6 +539,7 @@ namespace BufferUploads
         transaction->_creationOptions = flags;
         transaction->_finalResource = locator;
         assert(transaction->_finalResource.get());
+        transaction->_externalResource = true;
         transaction->_creationQueued = true;
         transaction->_creationFrameID = PlatformInterface::GetFrameID();
         return result;
@@ -629,6 +609,10 @@ namespace BufferUploads
     {
         Interlocked::Value newRefCount = Interlocked::Add(&transaction->_referenceCount, -0x01000000) - 0x01000000;
         assert(newRefCount>=0);
+        if (!(newRefCount & 0xff000000) && newRefCount > 0) {
+                //  Steps are still queued for this transaction. Let the scheduler know it can drop them
+            Interlocked::Increment(&_cancelCount);
+        }
         if (newRefCount<=0) {
             transaction->_finalResource.reset();
 
@@ -747,6 +731,17 @@ namespace BufferUploads
         #endif
     }
 
+    void AssemblyLine::Transaction_SetPriority(TransactionID id, unsigned requiredByFrame, unsigned priority)
+    {
+        Transaction* transaction = GetTransaction(id);
+        assert(transaction);
+        if (transaction) {
+            transaction->_requiredByFrame = requiredByFrame;
+            transaction->_priority = priority;
+            Interlocked::Increment(&_priorityChangeCount);
+        }
+    }
+
     void AssemblyLine::Transaction_AddRef(TransactionID id)
     {
         Transaction* transaction = GetTransaction(id);
@@ -792,6 +787,9 @@ namespace BufferUploads
         _completionCommandList = ~unsigned(0x0);
         _creationOptions = 0;
         _creationFrameID = 0;
+        _requiredByFrame = ~unsigned(0x0);
+        _priority = 0;
+        _externalResource = false;
         #if defined(OPTIMISED_ALLOCATE_TRANSACTION)
             _heapIndex = heapIndex;
         #endif
@@ -807,6 +805,9 @@ namespace BufferUploads
         _completionCommandList = ~unsigned(0x0);
         _creationOptions = 0;
         _creationFrameID = 0;
+        _requiredByFrame = ~unsigned(0x0);
+        _priority = 0;
+        _externalResource = false;
         #if defined(OPTIMISED_ALLOCATE_TRANSACTION)
             _heapIndex = ~unsigned(0x0);
         #endif
@@ -828,6 +829,9 @@ namespace BufferUploads
         _completionCommandList = cloneFrom._completionCommandList;
         _creationOptions = cloneFrom._creationOptions;
         _creationFrameID = cloneFrom._creationFrameID;
+        _requiredByFrame = cloneFrom._requiredByFrame;
+        _priority = cloneFrom._priority;
+        _externalResource = cloneFrom._externalResource;
         #if defined(OPTIMISED_ALLOCATE_TRANSACTION)
             _heapIndex = cloneFrom._heapIndex;
         #endif
@@ -862,9 +866,14 @@ namespace BufferUploads
         _queuedPeakCreates = _queuedPeakUploads =_queuedPeakStagingCreates = 0;
         _allocatedTransactionCount = 0;
         _queuedWorkFlag = false;
+        _waitingOnPendingData = false;
         XlZeroMemory(_currentQueuedBytes);
         _transactions_resolvedEventID = _transactions_postPublishResolvedEventID = 0;
         _framePriority_WritingQueueSet = 0;
+        _priorityChangeCount = _cancelCount = _frameBudgetSuspendCount = 0;
+        _frameBudget_Bytes = 0;
+        _frameBudget_Time = 0;
+        _waitingOnFrameBudget = false;
     }
 
     AssemblyLine::~AssemblyLine()
@@ -1413,38 +1422,48 @@ namespace BufferUploads
             Transaction* transaction = GetTransaction(resourceCreateStep._id);
             assert(transaction && !transaction->_finalResource);
 
-            if (!(transaction->_referenceCount & 0xff000000)) {
+            if (IsCancelled(*transaction)) {
                     //  If there are no client references, we can consider this cancelled...
                 ReleaseTransaction(transaction, context);
+                ++metricsUnderConstruction._cancelledSteps;
                 return true;
             }
 
-            unsigned uploadRequestSize = 0;
+            if (!IsDataReady(resourceCreateStep._initialisationData.get())) {
+                _waitingOnPendingData = true;
+                return false;
+            }
+            RawDataPacket* initialisationData = ValidData(resourceCreateStep._initialisationData.get());
+
+            unsigned uploadRequestSize = 0, queuedRequestSize = 0;
             const unsigned objectSize = PlatformInterface::ByteCount(transaction->_desc);
             const UploadDataType::Enum uploadDataType = AsUploadDataType(transaction->_desc);
-            if (resourceCreateStep._initialisationData) {
+            if (initialisationData) {
                 uploadRequestSize = objectSize;
             }
+            if (resourceCreateStep._initialisationData) {
+                queuedRequestSize = objectSize;     // (queued in Transaction_Begin, even if the data then fails to load)
+            }
 
             if (((metricsUnderConstruction._bytesUploadTotal+uploadRequestSize) <= budgetUnderConstruction._limit_BytesUploaded || !metricsUnderConstruction._bytesUploadTotal)) {
                 bool completed = false;
                 auto construction = _resourceSource.Create(
-                    transaction->_desc, resourceCreateStep._initialisationData.get(), 
+                    transaction->_desc, initialisationData, 
                     ((metricsUnderConstruction._deviceCreateOperations+1) <= budgetUnderConstruction._limit_DeviceCreates)?ResourceSource::CreationOptions::AllowDeviceCreation:0);
 
                 if (!(construction._flags & ResourceSource::ResourceConstruction::Flags::DelayForBatching)) {
                     transaction->_finalResource = std::move(construction._identifier);
                     if (transaction->_finalResource) {
-                        if (resourceCreateStep._initialisationData && !(construction._flags & ResourceSource::ResourceConstruction::Flags::InitialisationSuccessful)) {
+                        if (initialisationData && !(construction._flags & ResourceSource::ResourceConstruction::Flags::InitialisationSuccessful)) {
                             context.GetDeviceContext().PushToResource(
                                 *transaction->_finalResource->GetUnderlying(), transaction->_desc, transaction->_finalResource->Offset(),
-                                resourceCreateStep._initialisationData->GetData(0,0), resourceCreateStep._initialisationData->GetDataSize(0,0),
-                                resourceCreateStep._initialisationData->GetRowAndSlicePitch(0,0), Box2D(), 0, 0);
+                                initialisationData->GetData(0,0), initialisationData->GetDataSize(0,0),
+                                initialisationData->GetRowAndSlicePitch(0,0), Box2D(), 0, 0);
                             ++metricsUnderConstruction._contextOperations;
                         }
 
-                        if (uploadRequestSize) {
-                            Interlocked::Add(&_currentQueuedBytes[uploadDataType], -Interlocked::Value(uploadRequestSize));
+                        if (queuedRequestSize) {
+                            Interlocked::Add(&_currentQueuedBytes[uploadDataType], -Interlocked::Value(queuedRequestSize));
                         }
                         ReleaseTransaction(transaction, context);
                         completed = true;
@@ -1492,15 +1511,21 @@ namespace BufferUploads
         Transaction* transaction = GetTransaction(resourceCreateStep._id);
         assert(transaction && !transaction->_stagingResource);
 
-        if (!(transaction->_referenceCount & 0xff000000) && !transaction->_finalResource.get()) {
+        if (IsCancelled(*transaction)) {
             ReleaseTransaction(transaction, context);
+            ++metricsUnderConstruction._cancelledSteps;
             return true;
         }
 
+        if (!IsDataReady(resourceCreateStep._initialisationData.get())) {
+            _waitingOnPendingData = true;
+            return false;
+        }
+
         if (transaction->_actualisedStagingLODOffset != transaction->_requestedStagingLODOffset) {
             unsigned lodOffset = transaction->_requestedStagingLODOffset;
             BufferDesc stagingBufferDesc = ApplyLODOffset(AsStagingDesc(transaction->_desc), lodOffset);
-            auto construction = _resourceSource.Create(stagingBufferDesc, resourceCreateStep._initialisationData.get(), ResourceSource::CreationOptions::AllowDeviceCreation);
+            auto construction = _resourceSource.Create(stagingBufferDesc, ValidData(resourceCreateStep._initialisationData.get()), ResourceSource::CreationOptions::AllowDeviceCreation);
             assert(construction._identifier && !construction._identifier->IsEmpty());
             if (!construction._identifier || construction._identifier->IsEmpty()) {
                 return false;                   // failed to allocate the resource. Return false and We'll try again later...
@@ -1528,7 +1553,25 @@ namespace BufferUploads
             Transaction* transaction = GetTransaction(uploadStep._id);
             assert(transaction);
 
-            if (!(transaction->_referenceCount & 0xff000000) && (!transaction->_finalResource.get() || transaction->_finalResource->IsEmpty())) {
+            if (IsCancelled(*transaction)) {
+                ReleaseTransaction(transaction, context);
+                ++metricsUnderConstruction._cancelledSteps;
+                return true;
+            }
+
+            if (!IsDataReady(uploadStep._rawData.get())) {
+                _waitingOnPendingData = true;
+                return false;
+            }
+
+            if (uploadStep._rawData && !ValidData(uploadStep._rawData.get())) {
+                    //  The data failed to load; so there's nothing to upload. The step is
+                    //  finished, and the resource keeps whatever it had before.
+                unsigned queuedSize = 0;
+                for (unsigned l=uploadStep._lodLevelMin; l<=uploadStep._lodLevelMax; ++l) {
+                    queuedSize += (unsigned)uploadStep._rawData->GetDataSize(l, uploadStep._arrayIndex);
+                }
+                Interlocked::Add(&_currentQueuedBytes[AsUploadDataType(transaction->_desc)], -Interlocked::Value(queuedSize));
                 ReleaseTransaction(transaction, context);
                 return true;
             }
@@ -1634,17 +1677,28 @@ namespace BufferUploads
 
     bool        AssemblyLine::DrainPriorityQueueSet(QueueSet& queueSet, unsigned stepMask, ThreadContext& context)
     {
+            //
+            //      Everything in this queue set must be finished in this command list (the main
+            //      thread is waiting for it). So we stall on any data that is still loading,
+            //      rather than deferring it. Steps that still can't be completed (eg, an
+            //      allocation failure) stay frame priority; they're moved to the queue set
+            //      currently being written to, and will be drained at the next barrier. They
+            //      are never demoted to the main queue set.
+            //
         bool didSomething = false;
         CommandListBudget budgetUnderConstruction(true);
+        std::vector<ResourceCreateStep> deferredCreates, deferredStagingCreates;
+        std::vector<DataUploadStep> deferredUploads;
 
             /////////////// ~~~~ /////////////// ~~~~ ///////////////
         if (stepMask & Step_CreateResource) {
             ResourceCreateStep* resourceCreateStep = 0;
             while (queueSet._resourceCreateSteps.try_front(resourceCreateStep)) {
+                StallOnData(resourceCreateStep->_initialisationData.get());
                 if (Process(*resourceCreateStep, stepMask, context, budgetUnderConstruction)) {
                     didSomething = true;
                 } else {
-                    _queueSet_Main._resourceCreateSteps.push_overflow(*resourceCreateStep);
+                    deferredCreates.push_back(*resourceCreateStep);
                 }
                 queueSet._resourceCreateSteps.pop();
             }
@@ -1654,10 +1708,11 @@ namespace BufferUploads
         if (stepMask & Step_CreateStagingBuffer) {
             ResourceCreateStep* resourceCreateStep = 0;
             while (queueSet._stagingBufferCreateSteps.try_front(resourceCreateStep)) {
+                StallOnData(resourceCreateStep->_initialisationData.get());
                 if (Process_StagingBuffer(*resourceCreateStep, stepMask, context, budgetUnderConstruction)) {
                     didSomething = true;
                 } else {
-                    _queueSet_Main._stagingBufferCreateSteps.push_overflow(*resourceCreateStep);
+                    deferredStagingCreates.push_back(*resourceCreateStep);
                 }
                 queueSet._stagingBufferCreateSteps.pop();
             }
@@ -1667,18 +1722,216 @@ namespace BufferUploads
         if (stepMask & Step_UploadData) {
             DataUploadStep* uploadStep = 0;
             while (queueSet._uploadSteps.try_front(uploadStep)) {
+                StallOnData(uploadStep->_rawData.get());
                 if (Process(*uploadStep, stepMask, context, budgetUnderConstruction)) {
                     didSomething = true;
                 } else {
-                    _queueSet_Main._uploadSteps.push_overflow(*uploadStep);
+                    deferredUploads.push_back(*uploadStep);
                 }
                 queueSet._uploadSteps.pop();
             }
         }
 
+            //  (pushed after draining, because the writing queue set can be the one we're draining)
+        if (!deferredCreates.empty() || !deferredStagingCreates.empty() || !deferredUploads.empty()) {
+            LogWarning << "Frame priority steps could not be completed by the barrier (" 
+                << deferredCreates.size() + deferredStagingCreates.size() + deferredUploads.size() << "). Deferring to the next barrier.";
+            auto& nextQueueSet = _queueSet_FramePriority[_framePriority_WritingQueueSet];
+            for (auto i=deferredCreates.cbegin(); i!=deferredCreates.cend(); ++i)                 { nextQueueSet._resourceCreateSteps.push_overflow(*i); }
+            for (auto i=deferredStagingCreates.cbegin(); i!=deferredStagingCreates.cend(); ++i)   { nextQueueSet._stagingBufferCreateSteps.push_overflow(*i); }
+            for (auto i=deferredUploads.cbegin(); i!=deferredUploads.cend(); ++i)                 { nextQueueSet._uploadSteps.push_overflow(*i); }
+        }
+
         return didSomething;
     }
 
+    AssemblyLine::Schedule::Schedule()
+    {
+        _nextSequence = 0;
+        _lastPriorityChangeCount = _lastCancelCount = 0;
+        _budgetFrame = _bytesThisFrame = 0;
+        _timeThisFrame = 0;
+    }
+
+    bool AssemblyLine::IsCancelled(const Transaction& transaction)
+    {
+            //
+            //      When there are no client references, nothing can get the result of the transaction.
+            //      The exception is when the client gave us the final resource in Transaction_Begin.
+            //      Clients can end those transactions straight away, and still expect the upload to happen.
+            //
+        return  !(transaction._referenceCount & 0xff000000)
+            &&  (!transaction._finalResource.get() || transaction._finalResource->IsEmpty() || !transaction._externalResource);
+    }
+
+    bool AssemblyLine::WithinFrameBudget() const
+    {
+        if (_frameBudgetSuspendCount) {
+            return true;
+        }
+        return  (!_frameBudget_Bytes || _schedule._bytesThisFrame < _frameBudget_Bytes)
+            &&  (!_frameBudget_Time || _schedule._timeThisFrame < _frameBudget_Time);
+    }
+
+    void AssemblyLine::SetFrameBudget(const FrameBudget& budget)
+    {
+        _frameBudget_Bytes = budget._bytesPerFrame;
+        _frameBudget_Time = TimeMarker(uint64(budget._microsecondsPerFrame) * GetPerformanceCounterFrequency() / 1000000ull);
+    }
+
+    void AssemblyLine::SuspendFrameBudget()     { Interlocked::Increment(&_frameBudgetSuspendCount); }
+    void AssemblyLine::ResumeFrameBudget()      { Interlocked::Decrement(&_frameBudgetSuspendCount); }
+
+    template<typename StepType, typename QueueType>
+        void AssemblyLine::ScheduleSteps(QueueType& queue, std::vector<ScheduledStep<StepType>>& steps, ThreadContext& context)
+    {
+        const size_t oldSize = steps.size();
+        StepType* step = 0;
+        while (queue.try_front(step)) {
+            Transaction* transaction = GetTransaction(step->_id);
+            assert(transaction);
+            if (IsCancelled(*transaction)) {
+                ReleaseTransaction(transaction, context);
+                ++context.GetMetricsUnderConstruction()._cancelledSteps;
+            } else {
+                ScheduledStep<StepType> scheduledStep;
+                scheduledStep._key._requiredByFrame = transaction->_requiredByFrame;
+                scheduledStep._key._priority = transaction->_priority;
+                scheduledStep._key._sequence = _schedule._nextSequence++;
+                scheduledStep._step = *step;
+                steps.push_back(scheduledStep);
+            }
+            queue.pop();
+        }
+
+        Internal::MergeScheduledSteps(steps, oldSize);
+    }
+
+    template<typename StepType>
+        void AssemblyLine::RefreshSchedule(std::vector<ScheduledStep<StepType>>& steps)
+    {
+        bool keyChanged = false;
+        for (auto i=steps.begin(); i!=steps.end(); ++i) {
+            Transaction* transaction = GetTransaction(i->_step._id);
+            assert(transaction);
+            if (    transaction->_requiredByFrame != i->_key._requiredByFrame
+                ||  transaction->_priority != i->_key._priority) {
+                i->_key._requiredByFrame = transaction->_requiredByFrame;
+                i->_key._priority = transaction->_priority;
+                keyChanged = true;
+            }
+        }
+        if (keyChanged) {
+            std::sort(steps.begin(), steps.end());
+        }
+    }
+
+    template<typename StepType>
+        void AssemblyLine::DropCancelledSteps(std::vector<ScheduledStep<StepType>>& steps, ThreadContext& context)
+    {
+            //  Releasing the step also releases its data packet (which cancels any file read still in flight)
+        CommandListMetrics& metricsUnderConstruction = context.GetMetricsUnderConstruction();
+        auto dst = steps.begin();
+        for (auto i=steps.begin(); i!=steps.end(); ++i) {
+            Transaction* transaction = GetTransaction(i->_step._id);
+            assert(transaction);
+            if (IsCancelled(*transaction)) {
+                ReleaseTransaction(transaction, context);
+                ++metricsUnderConstruction._cancelledSteps;
+            } else {
+                if (dst != i) {
+                    *dst = *i;
+                }
+                ++dst;
+            }
+        }
+        steps.erase(dst, steps.end());
+    }
+
+    void AssemblyLine::UpdateSchedule(unsigned stepMask, ThreadContext& context)
+    {
+        Interlocked::Value priorityChangeCount = _priorityChangeCount;
+        if (priorityChangeCount != _schedule._lastPriorityChangeCount) {
+            _schedule._lastPriorityChangeCount = priorityChangeCount;
+            RefreshSchedule(_schedule._createSteps);
+            RefreshSchedule(_schedule._stagingBufferCreateSteps);
+            RefreshSchedule(_schedule._uploadSteps);
+        }
+
+        Interlocked::Value cancelCount = _cancelCount;
+        if (cancelCount != _schedule._lastCancelCount) {
+            _schedule._lastCancelCount = cancelCount;
+            DropCancelledSteps(_schedule._createSteps, context);
+            DropCancelledSteps(_schedule._stagingBufferCreateSteps, context);
+            DropCancelledSteps(_schedule._uploadSteps, context);
+        }
+
+        if (stepMask & Step_CreateResource)         { ScheduleSteps(_queueSet_Main._resourceCreateSteps, _schedule._createSteps, context); }
+        if (stepMask & Step_CreateStagingBuffer)    { ScheduleSteps(_queueSet_Main._stagingBufferCreateSteps, _schedule._stagingBufferCreateSteps, context); }
+        if (stepMask & Step_UploadData)             { ScheduleSteps(_queueSet_Main._uploadSteps, _schedule._uploadSteps, context); }
+    }
+
+    template<typename StepType>
+        bool AssemblyLine::ProcessScheduledSteps(
+            std::vector<ScheduledStep<StepType>>& steps,
+            bool (AssemblyLine::*processFn)(const StepType&, unsigned, ThreadContext&, const CommandListBudget&),
+            unsigned stepMask, ThreadContext& context, const CommandListBudget& budgetUnderConstruction)
+    {
+        CommandListMetrics& metricsUnderConstruction = context.GetMetricsUnderConstruction();
+        auto result = Internal::ProcessMostUrgentStep(
+            steps, context.CommitCount_Current(),
+            [&](const StepType& step) -> bool
+            {
+                const TimeMarker startTime = PlatformInterface::QueryPerformanceCounter();
+                const unsigned startBytes = metricsUnderConstruction._bytesUploadTotal;
+                const bool completed = (this->*processFn)(step, stepMask, context, budgetUnderConstruction);
+                _schedule._timeThisFrame += PlatformInterface::QueryPerformanceCounter() - startTime;
+                _schedule._bytesThisFrame += metricsUnderConstruction._bytesUploadTotal - startBytes;
+                return completed;
+            },
+            [this]() { return WithinFrameBudget(); });
+
+        if (result == Internal::ScheduleResult::OverBudget) {
+            _waitingOnFrameBudget = true;
+        }
+        return result == Internal::ScheduleResult::Processed;
+    }
+
+    std::pair<bool,bool> AssemblyLine::ProcessSchedule(unsigned stepMask, ThreadContext& context, const CommandListBudget& budgetUnderConstruction)
+    {
+        UpdateSchedule(stepMask, context);
+
+        const unsigned currentFrame = context.CommitCount_Current();
+        if (currentFrame != _schedule._budgetFrame) {
+            _schedule._budgetFrame = currentFrame;
+            _schedule._bytesThisFrame = 0;
+            _schedule._timeThisFrame = 0;
+        }
+
+        bool nothingFoundInQueues = true;
+        bool atLeastOneRealAction = false;
+
+            /////////////// ~~~~ /////////////// ~~~~ ///////////////
+        if ((stepMask & Step_CreateResource) && !_schedule._createSteps.empty()) {
+            nothingFoundInQueues = false;
+            atLeastOneRealAction |= ProcessScheduledSteps(_schedule._createSteps, &AssemblyLine::Process, stepMask, context, budgetUnderConstruction);
+        }
+
+            /////////////// ~~~~ /////////////// ~~~~ ///////////////
+        if ((stepMask & Step_CreateStagingBuffer) && !_schedule._stagingBufferCreateSteps.empty()) {
+            nothingFoundInQueues = false;
+            atLeastOneRealAction |= ProcessScheduledSteps(_schedule._stagingBufferCreateSteps, &AssemblyLine::Process_StagingBuffer, stepMask, context, budgetUnderConstruction);
+        }
+
+            /////////////// ~~~~ /////////////// ~~~~ ///////////////
+        if ((stepMask & Step_UploadData) && !_schedule._uploadSteps.empty()) {
+            nothingFoundInQueues = false;
+            atLeastOneRealAction |= ProcessScheduledSteps(_schedule._uploadSteps, &AssemblyLine::Process, stepMask, context, budgetUnderConstruction);
+        }
+
+        return std::make_pair(nothingFoundInQueues, atLeastOneRealAction);
+    }
+
     std::pair<bool,bool> AssemblyLine::ProcessQueueSet(QueueSet& queueSet, unsigned stepMask, ThreadContext& context, const CommandListBudget& budgetUnderConstruction)
     {
         bool nothingFoundInQueues = true;
@@ -1732,6 +1985,8 @@ namespace BufferUploads
         _queuedWorkFlag = true;
         for (;;) {
             bool nothingFoundInQueues = true, atLeastOneRealAction = false;
+            _waitingOnPendingData = false;
+            _waitingOnFrameBudget = false;
 
                 /////////////// ~~~~ /////////////// ~~~~ ///////////////
             IManager::EventListID publishableEventList = TickResourceSource(stepMask, context, isLoading);
@@ -1767,12 +2022,12 @@ namespace BufferUploads
                 }
 
                 if (nothingFoundInQueues) {
-                    std::pair<bool,bool> t = ProcessQueueSet(_queueSet_Main, stepMask, context, budgetUnderConstruction);
+                    std::pair<bool,bool> t = ProcessSchedule(stepMask, context, budgetUnderConstruction);
                     nothingFoundInQueues  &= t.first;
                     atLeastOneRealAction  |= t.second;
                 }
 
-                if (!nothingFoundInQueues && !atLeastOneRealAction) {
+                if (!nothingFoundInQueues && !atLeastOneRealAction && !_waitingOnPendingData && !_waitingOnFrameBudget) {
                     LogAlwaysWarningF("Warning -- suspected allocation failure; sleeping");
                     Sleep(5);
                 }
@@ -1782,6 +2037,7 @@ namespace BufferUploads
 
                 /////////////// ~~~~ /////////////// ~~~~ ///////////////
             const bool somethingToResolve    = (metricsUnderConstruction._contextOperations!=0) || (metricsUnderConstruction._nonContextOperations!=0)
+                                             ||  metricsUnderConstruction._cancelledSteps
                                              ||  _batchPreparation_Main._batchedAllocationSize  || !context.GetCommitStepUnderConstruction().IsEmpty()
                                              || publishableEventList > context.EventList_GetPublishedID();
             const unsigned commitCountCurrent = context.CommitCount_Current();
@@ -1871,6 +2127,9 @@ namespace BufferUploads
         result._queuedCreates        = (unsigned)_queueSet_Main._resourceCreateSteps.size();
         result._queuedStagingCreates = (unsigned)_queueSet_Main._stagingBufferCreateSteps.size();
         result._queuedUploads        = (unsigned)_queueSet_Main._uploadSteps.size();
+        result._queuedCreates       += (unsigned)_schedule._createSteps.size();
+        result._queuedStagingCreates+= (unsigned)_schedule._stagingBufferCreateSteps.size();
+        result._queuedUploads       += (unsigned)_schedule._uploadSteps.size();
         for (unsigned c=0; c<dimof(_queueSet_FramePriority); ++c) {
             result._queuedCreates           += (unsigned)_queueSet_FramePriority[c]._resourceCreateSteps.size();
             result._queuedStagingCreates    += (unsigned)_queueSet_FramePriority[c]._stagingBufferCreateSteps.size();
@@ -2104,12 +2363,15 @@ namespace BufferUploads
 
     void                    Manager::UpdateData(TransactionID id, RawDataPacket* rawData, const PartialResource& part)
     {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnUpdateData(id, rawData, part); }
         _assemblyLine->UpdateData(id, rawData, part);
     }
 
     TransactionID           Manager::Transaction_Begin(const BufferDesc& desc, RawDataPacket* initialisationData, TransactionOptions::BitField flags)
     {
-        return _assemblyLine->Transaction_Begin(desc, initialisationData, flags);
+        auto result = _assemblyLine->Transaction_Begin(desc, initialisationData, flags);
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnBegin(result, desc, initialisationData, flags); }
+        return result;
     }
 
     TransactionID           Manager::Transaction_Begin(intrusive_ptr<ResourceLocator>& locator, TransactionOptions::BitField flags)
@@ -2203,6 +2465,7 @@ namespace BufferUploads
 
     void                    Manager::Transaction_End(TransactionID id)
     {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnEnd(id); }
         _assemblyLine->Transaction_End(id);
     }
 
@@ -2211,13 +2474,28 @@ namespace BufferUploads
         _assemblyLine->Transaction_Validate(id);
     }
 
+    void                    Manager::Transaction_SetPriority(TransactionID id, unsigned framesUntilRequired, unsigned priority)
+    {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnSetPriority(id, framesUntilRequired, priority); }
+
+            //  Deadlines are counted in commits of the context that processes the main queue set
+            //  (which happen once per Update())
+        unsigned requiredByFrame = ~unsigned(0x0);
+        if (framesUntilRequired != ~unsigned(0x0)) {
+            requiredByFrame = MainContext()->CommitCount_Current() + framesUntilRequired;
+        }
+        _assemblyLine->Transaction_SetPriority(id, requiredByFrame, priority);
+    }
+
     intrusive_ptr<ResourceLocator>         Manager::Transaction_Immediate(const BufferDesc& desc, RawDataPacket* initialisationData, const PartialResource& part)
     {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnImmediate(desc, initialisationData, part); }
         return _assemblyLine->Transaction_Immediate(desc, initialisationData, part);
     }
 
     void                    Manager::AddRef(TransactionID id)
     {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnAddRef(id); }
         _assemblyLine->Transaction_AddRef(id);
     }
 
@@ -2286,6 +2564,8 @@ namespace BufferUploads
             return;
         }
 
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnUpdate(); }
+
         if (_foregroundStepMask & ~unsigned(AssemblyLine::Step_BatchingUpload)) {
             _assemblyLine->Process(_foregroundStepMask, *_foregroundContext.get());
         }
@@ -2298,10 +2578,18 @@ namespace BufferUploads
 
     void                    Manager::Flush()
     {
+        _assemblyLine->SuspendFrameBudget();
+        XlSetEvent(_assemblyLineWakeUpEvent);
         while (_assemblyLine->QueuedWork()) {
             // Update();
             Threading::YieldTimeSlice();
         }
+        _assemblyLine->ResumeFrameBudget();
+    }
+
+    void                    Manager::SetFrameBudget(const FrameBudget& budget)
+    {
+        _assemblyLine->SetFrameBudget(budget);
     }
 
     void                    Manager::OnLostDevice()
@@ -2332,6 +2620,7 @@ namespace BufferUploads
 
     void Manager::FramePriority_Barrier()
     {
+        if (_traceRecorder->IsActive()) { _traceRecorder->OnFramePriorityBarrier(); }
         unsigned oldQueueSetId = _assemblyLine->FlipWritingQueueSet();
         if (_backgroundStepMask) {
             MainContext()->FramePriority_Barrier(oldQueueSetId);
@@ -2384,6 +2673,7 @@ namespace BufferUploads
         _assemblyLineWakeUpEvent = XlCreateEvent(false);
         _handlingLostDevice = false;
         _waitingForDeviceResetEvent = XlHandle_Invalid;
+        _traceRecorder = std::make_unique<TransactionTraceRecorder>();
 
         bool multithreadingOk = true; // CRenderer::CV_r_BufferUpload_Enable!=2;
         bool doBatchingUploadInForeground = !PlatformInterface::CanDoNooverwriteMapInBackground;
@@ -2438,11 +2728,18 @@ namespace BufferUploads
         }
         if (_backgroundStepMask) {
             _backgroundThread = std::make_unique<Threading::Thread>(&BackgroundThreadFunction, this);
+
+                //  wake the background thread when file data sources finish loading
+            auto wakeUpEvent = _assemblyLineWakeUpEvent;
+            SetFileDataSourceCompletionCallback([wakeUpEvent]() { XlSetEvent(wakeUpEvent); });
         }
     }
 
     Manager::~Manager()
     {
+        if (_backgroundStepMask) {
+            SetFileDataSourceCompletionCallback(nullptr);
+        }
         _shutdownBackgroundThread = true;       // this will cause the background thread to terminate at it's next opportunity
         XlSetEvent(_assemblyLineWakeUpEvent);
         if (_backgroundThread) {
@@ -2452,6 +2749,26 @@ namespace BufferUploads
         XlCloseSyncObject(_waitingForDeviceResetEvent);
     }
 
+    void                    Manager::BeginTrace()
+    {
+        _traceRecorder->Start();
+    }
+
+    TransactionTrace        Manager::EndTrace()
+    {
+        return _traceRecorder->Stop();
+    }
+
+    void                BeginTransactionTrace(IManager& manager)
+    {
+        checked_cast<Manager*>(&manager)->BeginTrace();
+    }
+
+    TransactionTrace    EndTransactionTrace(IManager& manager)
+    {
+        return checked_cast<Manager*>(&manager)->EndTrace();
+    }
+
     std::unique_ptr<IManager>       CreateManager(RenderCore::IDevice* renderDevice)
     {
         return std::make_unique<Manager>(renderDevice);
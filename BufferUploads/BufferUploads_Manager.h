@@ -20,6 +20,8 @@ namespace BufferUploads
 
     class AssemblyLine;
     class ThreadContext;
+    class TransactionTraceRecorder;
+    class TransactionTrace;
     namespace PlatformInterface { class GPUEventStack; }
 
     class Manager : public Base_Manager
@@ -31,6 +33,7 @@ namespace BufferUploads
         TransactionID           Transaction_Begin(intrusive_ptr<ResourceLocator>& locator, TransactionOptions::BitField flags=0);
         void                    Transaction_End(TransactionID id);
         void                    Transaction_Validate(TransactionID id);
+        void                    Transaction_SetPriority(TransactionID id, unsigned framesUntilRequired, unsigned priority = 0);
 
         intrusive_ptr<ResourceLocator>         Transaction_Immediate(
                                         const BufferDesc& desc, RawDataPacket* initialisationData, 
@@ -49,6 +52,7 @@ namespace BufferUploads
         void                    Update(RenderCore::IThreadContext&);
         void                    Flush();
         void                    FramePriority_Barrier();
+        void                    SetFrameBudget(const FrameBudget& budget);
 
         EventListID             EventList_GetLatestID();
         void                    EventList_Get(EventListID id, Event_ResourceReposition*&begin, Event_ResourceReposition*&end);
@@ -57,6 +61,9 @@ namespace BufferUploads
         void                    OnLostDevice();
         void                    OnResetDevice();
 
+        void                    BeginTrace();
+        TransactionTrace        EndTrace();
+
         Manager(RenderCore::IDevice* renderDevice);
         ~Manager();
 
@@ -68,6 +75,7 @@ namespace BufferUploads
         std::unique_ptr<ThreadContext> _backgroundContext;
         std::unique_ptr<ThreadContext> _foregroundContext;
         std::unique_ptr<PlatformInterface::GPUEventStack> _gpuEventStack;
+        std::unique_ptr<TransactionTraceRecorder> _traceRecorder;
 
         bool _shutdownBackgroundThread;
         XlHandle _assemblyLineWakeUpEvent, _waitingForDeviceResetEvent;
@@ -6,6 +6,7 @@
 
 #include "DataPacket.h"
 #include "PlatformInterface.h"
+#include "../Utility/Threading/Mutex.h"
 
 namespace BufferUploads
 {
@@ -101,5 +102,42 @@ namespace BufferUploads
         return nullptr;
     }
 
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static Threading::Mutex         FileDataSourceCallbackLock;
+    static std::function<void()>    FileDataSourceCallback;
+
+    void SetFileDataSourceCompletionCallback(std::function<void()>&& callback)
+    {
+        ScopedLock(FileDataSourceCallbackLock);
+        FileDataSourceCallback = std::move(callback);
+    }
+
+    namespace Internal
+    {
+        void FileDataSource_OnReadCompleted()
+        {
+            ScopedLock(FileDataSourceCallbackLock);
+            if (FileDataSourceCallback) {
+                FileDataSourceCallback();
+            }
+        }
+
+        std::pair<unsigned,unsigned> FileDataSource_GetRowAndSlicePitch(size_t dataSize)
+        {
+                // hack -- hard coded values for terrain upload
+            if (dataSize == 8192) {
+                int pixelWidth = 128;
+                return std::make_pair(pixelWidth * 64 / 8 / 4, unsigned(dataSize));
+            } else if (dataSize == 2312) { 
+                return std::make_pair(34*2, unsigned(dataSize));
+            } else if (dataSize == 4356) { 
+                return std::make_pair(33*4, unsigned(dataSize));
+            } else {
+                return std::make_pair(33*2, unsigned(dataSize));
+            }
+        }
+    }
+
 }
 
@@ -8,6 +8,7 @@
 
 #include "IBufferUploads.h"
 #include "../Utility/MemoryUtils.h"
+#include <functional>
 
 namespace BufferUploads
 {
@@ -36,7 +37,24 @@ namespace BufferUploads
     buffer_upload_dll_export intrusive_ptr<BasicRawDataPacket> CreateEmptyPacket(
         const BufferDesc& desc);
 
+        /// <summary>Creates a packet that is filled by an asynchronous file read</summary>
+        /// The read begins immediately. On Windows, "fileHandle" is a HANDLE opened with
+        /// FILE_FLAG_OVERLAPPED. On Linux, it's a file descriptor (cast to a pointer).
+        /// The packet takes its own reference to the file, so the client can close theirs.
+        ///
+        /// Reads of adjacent ranges of the same file may be merged into a single read.
     buffer_upload_dll_export intrusive_ptr<RawDataPacket> CreateFileDataSource(
         const void* fileHandle, size_t offset, size_t dataSize);
 
+        /// <summary>Sets a function to call when an asynchronous file read completes</summary>
+        /// This is called from an IO thread. The manager uses it to wake the
+        /// assembly line, so steps waiting on file data don't have to be polled.
+    buffer_upload_dll_export void SetFileDataSourceCompletionCallback(std::function<void()>&& callback);
+
+    namespace Internal
+    {
+        void                            FileDataSource_OnReadCompleted();
+        std::pair<unsigned,unsigned>    FileDataSource_GetRowAndSlicePitch(size_t dataSize);
+    }
+
 }
\ No newline at end of file
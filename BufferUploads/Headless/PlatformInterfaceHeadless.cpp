@@ -0,0 +1,313 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Core/Prefix.h"
+#include "../../RenderCore/Metal/Metal.h"
+
+#if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+
+    #include "../PlatformInterface.h"
+    #include "../../RenderCore/Metal/Format.h"
+    #include "../../Utility/HeapUtils.h"
+    #include "../../Utility/MemoryUtils.h"
+    #include "../../Utility/PtrUtils.h"
+    #include <algorithm>
+
+    namespace BufferUploads { namespace PlatformInterface
+    {
+        static bool IsDXTCompressed(unsigned format) { return GetCompressionType(NativeFormat::Enum(format)) == FormatCompressionType::BlockCompression; }
+
+            //
+            //  The headless resource keeps a copy of the BufferDesc it was created
+            //  with, so we can implement ExtractDesc()
+            //
+        class HeadlessResource : public Underlying::Resource
+        {
+        public:
+            BufferDesc _desc;
+
+            HeadlessResource(std::shared_ptr<SimulatedGPU> gpu, std::vector<SubResource>&& subResources, const BufferDesc& desc)
+            : Underlying::Resource(std::move(gpu), std::move(subResources)), _desc(desc) {}
+        };
+
+        static unsigned SubResourceIndex(const Underlying::Resource& resource, unsigned lodLevel, unsigned arrayIndex)
+        {
+            auto& desc = static_cast<const HeadlessResource&>(resource)._desc;
+            if (desc._type != BufferDesc::Type::Texture) return 0;
+            auto result = lodLevel + arrayIndex * std::max(unsigned(desc._textureDesc._mipCount), 1u);
+            assert(result < resource.GetSubResourceCount());
+            return result;
+        }
+
+        static std::vector<Underlying::Resource::SubResource> BuildSubResources(const BufferDesc& desc)
+        {
+            std::vector<Underlying::Resource::SubResource> result;
+            if (desc._type == BufferDesc::Type::LinearBuffer) {
+                Underlying::Resource::SubResource sub;
+                sub._offset = 0;
+                sub._size = desc._linearBufferDesc._sizeInBytes;
+                sub._rowPitch = sub._slicePitch = desc._linearBufferDesc._sizeInBytes;
+                result.push_back(sub);
+                return result;
+            }
+
+                //  Textures are laid out in the same order as D3D subresources (all
+                //  of the mip levels for array layer 0, then all of the mip levels for
+                //  layer 1, etc). Each subresource starts on a 16 byte boundary.
+            auto& tDesc = desc._textureDesc;
+            auto format = NativeFormat::Enum(tDesc._nativePixelFormat);
+            const bool dxt = IsDXTCompressed(format);
+            const unsigned mipCount = std::max(unsigned(tDesc._mipCount), 1u);
+            const unsigned arrayCount = std::max(unsigned(tDesc._arrayCount), 1u);
+            size_t offset = 0;
+            for (unsigned a=0; a<arrayCount; ++a) {
+                for (unsigned m=0; m<mipCount; ++m) {
+                    auto mipDesc = CalculateMipMapDesc(tDesc, m);
+                    unsigned depth = 1;
+                    if (tDesc._dimensionality == TextureDesc::Dimensionality::T3D) {
+                        depth = std::max(tDesc._depth >> m, 1u);
+                    }
+
+                    Underlying::Resource::SubResource sub;
+                    sub._offset = offset;
+                    sub._rowPitch = TextureDataSize(mipDesc._width, dxt?4:1, 1, 1, format);
+                    sub._slicePitch = TextureDataSize(mipDesc._width, mipDesc._height, 1, 1, format);
+                    sub._size = size_t(sub._slicePitch) * depth;
+                    result.push_back(sub);
+
+                    offset = (offset + sub._size + 15) & ~size_t(15);
+                }
+            }
+            return result;
+        }
+
+        intrusive_ptr<Underlying::Resource> CreateResource(ObjectFactory& device, const BufferDesc& desc, RawDataPacket* initialisationData)
+        {
+            if (desc._type != BufferDesc::Type::LinearBuffer && desc._type != BufferDesc::Type::Texture) {
+                assert(0);
+                return intrusive_ptr<Underlying::Resource>();
+            }
+
+            device.GetGPU().SimulateCPUTime(device.GetGPU().GetDesc()._createResourceTime);
+
+            auto result = make_intrusive<HeadlessResource>(device.GetGPUPtr(), BuildSubResources(desc), desc);
+            if (initialisationData) {
+                    //  Like D3D, initialisation data is copied into the resource during
+                    //  creation. There's no GPU work involved, so there's no fence.
+                if (desc._type == BufferDesc::Type::Texture) {
+                    const unsigned mipCount = std::max(unsigned(desc._textureDesc._mipCount), 1u);
+                    const unsigned arrayCount = std::max(unsigned(desc._textureDesc._arrayCount), 1u);
+                    for (unsigned a=0; a<arrayCount; ++a) {
+                        for (unsigned m=0; m<mipCount; ++m) {
+                            auto srcData = initialisationData->GetData(m, a);
+                            if (!srcData) continue;
+                            auto& sub = result->GetSubResource(m + a*mipCount);
+                            CopyMipLevel(
+                                result->GetData(m + a*mipCount), sub._size,
+                                srcData, initialisationData->GetDataSize(m, a),
+                                CalculateMipMapDesc(desc._textureDesc, m), sub._rowPitch);
+                        }
+                    }
+                } else {
+                    auto srcData = initialisationData->GetData(0, 0);
+                    if (srcData) {
+                        XlCopyMemory(
+                            result->GetData(0), srcData,
+                            std::min(initialisationData->GetDataSize(0, 0), result->GetDataSize()));
+                    }
+                }
+            }
+
+            return intrusive_ptr<Underlying::Resource>(std::move(result));
+        }
+
+        BufferDesc ExtractDesc(const Underlying::Resource& resource)
+        {
+            return static_cast<const HeadlessResource&>(resource)._desc;
+        }
+
+            //////////////////////////////////////////////////////////////////////////////////////////////
+
+        void UnderlyingDeviceContext::PushToResource(   const Underlying::Resource& resource, const BufferDesc& desc,
+                                                        unsigned resourceOffsetValue, const void* data, size_t dataSize,
+                                                        std::pair<unsigned,unsigned> rowAndSlicePitch,
+                                                        const Box2D& box, unsigned lodLevel, unsigned arrayIndex)
+        {
+            switch (desc._type) {
+            case BufferDesc::Type::Texture:
+                {
+                    auto subResource = SubResourceIndex(resource, lodLevel, arrayIndex);
+                    auto& sub = resource.GetSubResource(subResource);
+                    if (box == Box2D()) {
+                        CopyMipLevel(
+                            resource.GetData(subResource), sub._size, data, dataSize,
+                            CalculateMipMapDesc(desc._textureDesc, lodLevel), sub._rowPitch);
+                        _devContext->RecordCopy(resource, dataSize);
+                    } else {
+                            //  Copy the rows in the box. For block compressed formats, the
+                            //  box is in pixels, but we copy whole rows of blocks.
+                        auto format = NativeFormat::Enum(desc._textureDesc._nativePixelFormat);
+                        const bool dxt = IsDXTCompressed(format);
+                        const unsigned blockDim = dxt ? 4 : 1;
+                        const unsigned left = box._left / blockDim, right = (box._right + blockDim - 1) / blockDim;
+                        const unsigned top = box._top / blockDim, bottom = (box._bottom + blockDim - 1) / blockDim;
+                        const unsigned bytesPerBlock = dxt ? (BitsPerPixel(format) * 16 / 8) : (BitsPerPixel(format) / 8);
+                        const unsigned rowBytes = (right - left) * bytesPerBlock;
+
+                        size_t copied = 0;
+                        for (unsigned y=top; y<bottom; ++y) {
+                            auto dstOffset = size_t(y) * sub._rowPitch + size_t(left) * bytesPerBlock;
+                            auto srcOffset = size_t(y - top) * rowAndSlicePitch.first;
+                            if (dstOffset + rowBytes > sub._size || srcOffset + rowBytes > dataSize) break;
+                            XlCopyMemory(PtrAdd(resource.GetData(subResource), dstOffset), PtrAdd(data, srcOffset), rowBytes);
+                            copied += rowBytes;
+                        }
+                        _devContext->RecordCopy(resource, copied);
+                    }
+                }
+                break;
+
+            case BufferDesc::Type::LinearBuffer:
+                {
+                    assert(box == Box2D());
+                    assert(resourceOffsetValue + dataSize <= resource.GetDataSize());
+                    XlCopyMemory(PtrAdd(resource.GetData(0), resourceOffsetValue), data, dataSize);
+                    _devContext->RecordCopy(resource, dataSize);
+                }
+                break;
+            }
+        }
+
+        void UnderlyingDeviceContext::PushToStagingResource(    const Underlying::Resource& resource, const BufferDesc&desc,
+                                                                unsigned resourceOffsetValue, const void* data, size_t dataSize,
+                                                                std::pair<unsigned,unsigned> rowAndSlicePitch,
+                                                                const Box2D& box, unsigned lodLevel, unsigned arrayIndex)
+        {
+            assert(box == Box2D());
+            switch (desc._type) {
+            case BufferDesc::Type::Texture:
+                {
+                    auto mappedBuffer = Map(resource, MapType::Write, lodLevel, arrayIndex);
+                    if (mappedBuffer.GetData()) {
+                        auto& sub = resource.GetSubResource(SubResourceIndex(resource, lodLevel, arrayIndex));
+                        CopyMipLevel(
+                            mappedBuffer.GetData(), sub._size, data, dataSize,
+                            CalculateMipMapDesc(desc._textureDesc, lodLevel), mappedBuffer.GetRowPitch());
+                    }
+                }
+                break;
+            }
+        }
+
+        void UnderlyingDeviceContext::UpdateFinalResourceFromStaging(const Underlying::Resource& finalResource, const Underlying::Resource& staging, const BufferDesc& destinationDesc, unsigned lodLevelMin, unsigned lodLevelMax, unsigned stagingLODOffset)
+        {
+            if ((lodLevelMin == ~unsigned(0x0) || lodLevelMax == ~unsigned(0x0)) && destinationDesc._type == BufferDesc::Type::Texture && !stagingLODOffset) {
+                ResourceCopy(finalResource, staging);
+            } else {
+                size_t copied = 0;
+                for (unsigned a=0; a<std::max(unsigned(destinationDesc._textureDesc._arrayCount), 1u); ++a) {
+                    for (unsigned c=lodLevelMin; c<=lodLevelMax; ++c) {
+                        auto dst = SubResourceIndex(finalResource, c, a);
+                        auto src = SubResourceIndex(staging, c-stagingLODOffset, a);
+                        auto size = std::min(finalResource.GetSubResource(dst)._size, staging.GetSubResource(src)._size);
+                        XlCopyMemory(finalResource.GetData(dst), staging.GetData(src), size);
+                        copied += size;
+                    }
+                }
+                _devContext->RecordCopy(finalResource, copied);
+            }
+        }
+
+        void UnderlyingDeviceContext::ResourceCopy_DefragSteps(const Underlying::Resource& destination, const Underlying::Resource& source, const std::vector<DefragStep>& steps)
+        {
+            size_t copied = 0;
+            for (std::vector<DefragStep>::const_iterator i=steps.begin(); i!=steps.end(); ++i) {
+                assert(i->_sourceEnd > i->_sourceStart);
+                assert(i->_sourceEnd <= source.GetDataSize());
+                assert(i->_destination + (i->_sourceEnd - i->_sourceStart) <= destination.GetDataSize());
+                XlMoveMemory(
+                    PtrAdd(destination.GetData(0), i->_destination),
+                    PtrAdd(source.GetData(0), i->_sourceStart),
+                    i->_sourceEnd - i->_sourceStart);
+                copied += i->_sourceEnd - i->_sourceStart;
+            }
+            _devContext->RecordCopy(destination, copied);
+        }
+
+        void UnderlyingDeviceContext::ResourceCopy(const Underlying::Resource& destination, const Underlying::Resource& source)
+        {
+            auto size = std::min(destination.GetDataSize(), source.GetDataSize());
+            XlCopyMemory(destination.GetData(0), source.GetData(0), size);
+            _devContext->RecordCopy(destination, size);
+        }
+
+        intrusive_ptr<RenderCore::Metal::CommandList> UnderlyingDeviceContext::ResolveCommandList()
+        {
+            return _devContext->ResolveCommandList();
+        }
+
+        void                        UnderlyingDeviceContext::BeginCommandList()
+        {
+            _devContext->BeginCommandList();
+        }
+
+        UnderlyingDeviceContext::MappedBuffer UnderlyingDeviceContext::Map(const Underlying::Resource& resource, MapType::Enum mapType, unsigned lodLevel, unsigned arrayIndex)
+        {
+            auto& gpu = *_devContext->GetUnderlying();
+            gpu.SimulateCPUTime(gpu.GetDesc()._mapTime);
+
+                //  Discard and NoOverwrite maps never wait for the GPU. Other maps
+                //  stall until GPU work that writes to this resource has finished
+            if (mapType == MapType::ReadOnly || mapType == MapType::Write) {
+                gpu.WaitForFence(resource.GetGPUFence());
+            }
+
+            auto subResource = SubResourceIndex(resource, lodLevel, arrayIndex);
+            auto& sub = resource.GetSubResource(subResource);
+            return MappedBuffer(*this, resource, subResource, resource.GetData(subResource), sub._rowPitch, sub._slicePitch);
+        }
+
+        UnderlyingDeviceContext::MappedBuffer UnderlyingDeviceContext::MapPartial(const Underlying::Resource& resource, MapType::Enum mapType, unsigned offset, unsigned size, unsigned lodLevel, unsigned arrayIndex)
+        {
+            auto result = Map(resource, mapType, lodLevel, arrayIndex);
+            assert(offset + size <= resource.GetSubResource(result._subResourceIndex)._size);
+            result._data = PtrAdd(result._data, offset);
+            return std::move(result);
+        }
+
+        void UnderlyingDeviceContext::Unmap(const Underlying::Resource& resource, unsigned subResourceIndex)
+        {
+                //  Writes through a map go directly into the resource memory, so there's
+                //  nothing to do here
+        }
+
+        UnderlyingDeviceContext::UnderlyingDeviceContext(RenderCore::IThreadContext& renderCoreContext)
+        : _renderCoreContext(&renderCoreContext)
+        {
+            _devContext = DeviceContext::Get(*_renderCoreContext);
+        }
+
+            //////////////////////////////////////////////////////////////////////////////////////////////
+
+        void    Query_End(SimulatedGPU* context, RenderCore::Metal::Query* query)
+        {
+                //  the query is triggered when all work submitted so far is finished
+            query->_fence = context->GetSubmittedFence();
+        }
+
+        bool    Query_IsEventTriggered(SimulatedGPU* context, RenderCore::Metal::Query* query)
+        {
+            return context->GetCompletedFence() >= query->_fence;
+        }
+
+        UnderlyingQuery Query_CreateEvent(ObjectFactory& objFactory)
+        {
+            return make_intrusive<RenderCore::Metal::Query>();
+        }
+
+    }}
+
+#endif
@@ -244,6 +244,19 @@ namespace BufferUploads
         virtual void*                           GetData             (unsigned mipIndex=0, unsigned arrayIndex=0) = 0;
         virtual size_t                          GetDataSize         (unsigned mipIndex=0, unsigned arrayIndex=0) const = 0;
         virtual std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex=0, unsigned arrayIndex=0) const = 0;
+
+            //
+            //      Packets that are filled asynchronously (eg, from a file read)
+            //      return false until the data is available. GetData() will
+            //      block until then. The assembly line defers steps with packets
+            //      that aren't ready yet, instead of stalling on them.
+            //
+            //      If filling the packet fails (eg, a read error), IsDataReady()
+            //      never returns true. HasFailed() returns true instead, and the
+            //      assembly line completes the transaction without the data.
+            //
+        virtual bool                            IsDataReady         () const { return true; }
+        virtual bool                            HasFailed           () const { return false; }
     };
 
         /////////////////////////////////////////////////
@@ -293,6 +306,7 @@ namespace BufferUploads
         TimeMarker _framePriorityStallTime;
         unsigned _batchedCopyBytes, _batchedCopyCount;
         unsigned _wakeCount, _frameId;
+        unsigned _cancelledSteps;
 
         buffer_upload_dll_export CommandListMetrics();
         buffer_upload_dll_export CommandListMetrics(const CommandListMetrics& cloneFrom);
@@ -438,6 +452,22 @@ namespace BufferUploads
 
         /////////////////////////////////////////////////
 
+        /// <summary>Limits on the upload work done each frame</summary>
+        /// The budget applies to steps that aren't yet due (see IManager::Transaction_SetPriority).
+        /// Due steps are always processed, even when the budget for the frame has been used up.
+        /// Zero means no limit.
+    class FrameBudget
+    {
+    public:
+        unsigned _bytesPerFrame;
+        unsigned _microsecondsPerFrame;
+
+        FrameBudget(unsigned bytesPerFrame = 0, unsigned microsecondsPerFrame = 0)
+        : _bytesPerFrame(bytesPerFrame), _microsecondsPerFrame(microsecondsPerFrame) {}
+    };
+
+        /////////////////////////////////////////////////
+
 #define FLEX_INTERFACE Manager
 /*-----------------*/ #include "../RenderCore/FlexBegin.h" /*-----------------*/
 
@@ -499,6 +529,15 @@ namespace BufferUploads
             /// This is a tool for debugging. Checks a transaction for common problems.
             /// Only implemented in _DEBUG builds. Errors will invoke an assert.
         IMETHOD void            Transaction_Validate (TransactionID id) IPURE;
+
+            /// <summary>Sets the scheduling priority of a transaction</summary>
+            /// "framesUntilRequired" is the number of calls to Update() before the client needs
+            /// the transaction to be complete (~0u for no deadline). Queued steps are processed in
+            /// order of deadline, and then by "priority" (highest first). Transactions without a
+            /// priority are processed in the order they were queued, after any with a deadline.
+            /// Can be called again while the transaction is queued, to change its priority.
+            /// Has no effect on steps in the frame priority queues.
+        IMETHOD void            Transaction_SetPriority(TransactionID id, unsigned framesUntilRequired, unsigned priority = 0) IPURE;
             /// @}
 
             /// \name Immediate creation
@@ -593,6 +632,9 @@ namespace BufferUploads
             /// frame priority operations. This will normally be called from the same
             /// thread that begins most upload operations.
         IMETHOD void                    FramePriority_Barrier   () IPURE;
+            /// <summary>Limits the work done each frame for steps that aren't due yet</summary>
+            /// By default, there is no limit. Flush() ignores the budget.
+        IMETHOD void                    SetFrameBudget          (const FrameBudget& budget) IPURE;
             /// @}
 
         IDESTRUCTOR
@@ -0,0 +1,639 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Core/Prefix.h"
+#include "../DataPacket.h"
+
+#if PLATFORMOS_TARGET == PLATFORMOS_LINUX
+
+#include "../../ConsoleRig/Log.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <assert.h>
+
+#if defined(__has_include)
+    #if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+        #include <linux/io_uring.h>
+        #define FILEDATASOURCE_IO_URING
+    #endif
+#endif
+
+namespace BufferUploads
+{
+        //
+        //  Asynchronous reads for FileDataSource on Linux.
+        //
+        //  Reads are queued on a single reader object. Where io_uring is available (and
+        //  not blocked by the sandbox), one IO thread submits the reads to the ring, and
+        //  sleeps until either a completion arrives or a new read is queued (signalled
+        //  through an eventfd that the ring also polls). Otherwise, we fall back to a small
+        //  pool of threads doing blocking preadv() calls.
+        //
+        //  Before submitting, reads of adjacent ranges in the same file are merged into
+        //  a single vectored read (terrain and model streaming tend to queue runs of
+        //  neighbouring chunks together). Each merged read scatters directly into the
+        //  packets' own buffers, so there is no extra copy.
+        //
+        //  When a read completes, the packet is marked ready and the completion callback
+        //  (see SetFileDataSourceCompletionCallback) wakes the assembly line.
+        //
+    static const unsigned   MaxCoalescedReads = 16;
+    static const size_t     MaxCoalescedBytes = 1024*1024;
+    static const unsigned   ThreadPoolSize = 4;
+    static const unsigned   RingEntries = 64;
+
+    class ReadRequest
+    {
+    public:
+        int         _file;
+        uint64      _fileDevice, _fileInode;
+        uint64      _offset;
+        size_t      _size;
+        uint64      _sequence;
+        std::unique_ptr<uint8, PODAlignedDeletor>   _buffer;
+        std::atomic<bool>   _complete;
+        bool                _failed;        // (written before _complete is set)
+
+        ReadRequest(int file, uint64 offset, size_t size);
+        ~ReadRequest();
+    private:
+        ReadRequest(const ReadRequest&);
+        ReadRequest& operator=(const ReadRequest&);
+    };
+
+    ReadRequest::ReadRequest(int file, uint64 offset, size_t size)
+    : _file(file), _offset(offset), _size(size), _sequence(0), _complete(false), _failed(false)
+    {
+            //  We find reads from the same file by comparing the device and inode,
+            //  since different descriptors can refer to the same file
+        struct stat fileStats;
+        if (fstat(file, &fileStats) == 0) {
+            _fileDevice = uint64(fileStats.st_dev);
+            _fileInode = uint64(fileStats.st_ino);
+        } else {
+            _fileDevice = ~uint64(0);
+            _fileInode = uint64(file);
+        }
+        _buffer.reset((uint8*)XlMemAlign(size, 16));
+    }
+
+    ReadRequest::~ReadRequest()
+    {
+        if (_file >= 0) close(_file);
+    }
+
+    static bool SortReads(const std::shared_ptr<ReadRequest>& lhs, const std::shared_ptr<ReadRequest>& rhs)
+    {
+        if (lhs->_fileDevice != rhs->_fileDevice) return lhs->_fileDevice < rhs->_fileDevice;
+        if (lhs->_fileInode != rhs->_fileInode) return lhs->_fileInode < rhs->_fileInode;
+        return lhs->_offset < rhs->_offset;
+    }
+
+    static bool IsAdjacent(const ReadRequest& first, const ReadRequest& second)
+    {
+        return first._fileDevice == second._fileDevice
+            && first._fileInode == second._fileInode
+            && (first._offset + first._size) == second._offset;
+    }
+
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ReadGroup
+    {
+    public:
+        std::vector<std::shared_ptr<ReadRequest>>   _requests;
+        std::vector<struct iovec>                   _iovecs;
+        uint64      _offset;
+        size_t      _size;
+
+        int         GetFile() const { return _requests[0]->_file; }
+
+        ReadGroup() : _offset(0), _size(0) {}
+        ReadGroup(ReadGroup&& moveFrom);
+        ReadGroup& operator=(ReadGroup&& moveFrom);
+    };
+
+    ReadGroup::ReadGroup(ReadGroup&& moveFrom)
+    : _requests(std::move(moveFrom._requests)), _iovecs(std::move(moveFrom._iovecs))
+    , _offset(moveFrom._offset), _size(moveFrom._size)
+    {}
+
+    ReadGroup& ReadGroup::operator=(ReadGroup&& moveFrom)
+    {
+        _requests = std::move(moveFrom._requests);
+        _iovecs = std::move(moveFrom._iovecs);
+        _offset = moveFrom._offset;
+        _size = moveFrom._size;
+        return *this;
+    }
+
+        //  Take the oldest pending read, along with any pending reads that
+        //  continue on from it (or lead up to it) in the same file.
+        //  "pending" is sorted by file and offset.
+    static ReadGroup TakeReadGroup(std::vector<std::shared_ptr<ReadRequest>>& pending)
+    {
+        assert(!pending.empty());
+        auto oldest = std::min_element(pending.begin(), pending.end(),
+            [](const std::shared_ptr<ReadRequest>& lhs, const std::shared_ptr<ReadRequest>& rhs)
+            { return lhs->_sequence < rhs->_sequence; });
+
+        auto begin = oldest, end = oldest+1;
+        size_t size = (*oldest)->_size;
+        while (     end != pending.end() && unsigned(end-begin) < MaxCoalescedReads
+                &&  (size + (*end)->_size) <= MaxCoalescedBytes && IsAdjacent(**(end-1), **end)) {
+            size += (*end)->_size;
+            ++end;
+        }
+        while (     begin != pending.begin() && unsigned(end-begin) < MaxCoalescedReads
+                &&  (size + (*(begin-1))->_size) <= MaxCoalescedBytes && IsAdjacent(**(begin-1), **begin)) {
+            --begin;
+            size += (*begin)->_size;
+        }
+
+        ReadGroup result;
+        result._requests.assign(begin, end);
+        result._offset = (*begin)->_offset;
+        result._size = size;
+        result._iovecs.reserve(result._requests.size());
+        for (auto i=result._requests.cbegin(); i!=result._requests.cend(); ++i) {
+            struct iovec v;
+            v.iov_base = (*i)->_buffer.get();
+            v.iov_len = (*i)->_size;
+            result._iovecs.push_back(v);
+        }
+        pending.erase(begin, end);
+        return std::move(result);
+    }
+
+        //  Blocking read of the rest of a group, starting "alreadyRead" bytes in.
+        //  Returns the total number of bytes read (which will be less than the
+        //  size of the group on errors or at the end of the file)
+    static size_t FinishRead(const ReadGroup& group, size_t alreadyRead)
+    {
+        std::vector<struct iovec> iovecs = group._iovecs;
+        size_t done = alreadyRead;
+        while (done < group._size) {
+                // skip past the parts that have already been read
+            unsigned first = 0;
+            size_t skip = done;
+            while (skip >= group._iovecs[first].iov_len) { skip -= group._iovecs[first].iov_len; ++first; }
+            struct iovec partial = group._iovecs[first];
+            partial.iov_base = PtrAdd(partial.iov_base, skip);
+            partial.iov_len -= skip;
+            iovecs[first] = partial;
+
+            auto result = preadv(
+                group.GetFile(), &iovecs[first], int(iovecs.size() - first),
+                off_t(group._offset + done));
+            if (result < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (result == 0) break;
+            done += size_t(result);
+        }
+        return done;
+    }
+
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class AsyncFileReader
+    {
+    public:
+        void    Queue(std::shared_ptr<ReadRequest> request);
+        void    Wait(const ReadRequest& request);
+
+        AsyncFileReader();
+        ~AsyncFileReader();
+
+        #if defined(FILEDATASOURCE_IO_URING)
+            class Ring;
+        #endif
+    private:
+        std::mutex                                  _lock;
+        std::condition_variable                     _pendingCondition;
+        std::condition_variable                     _completionCondition;
+        std::vector<std::shared_ptr<ReadRequest>>   _pending;
+        uint64                                      _nextSequence;
+        bool                                        _quit;
+        std::vector<std::unique_ptr<std::thread>>   _threads;
+
+        void    Complete(ReadGroup& group, size_t bytesRead);
+        void    ThreadPoolEntryPoint();
+
+        #if defined(FILEDATASOURCE_IO_URING)
+            std::unique_ptr<Ring>   _ring;
+            int                     _wakeEvent;
+            void    RingEntryPoint();
+        #endif
+    };
+
+    void    AsyncFileReader::Complete(ReadGroup& group, size_t bytesRead)
+    {
+        if (bytesRead < group._size) {
+                //  Every request that didn't get all of its data has failed (the
+                //  ones before the short read in the same group are still fine)
+            LogWarning << "Short read in FileDataSource (" << bytesRead << " of " << group._size << " bytes at offset " << group._offset << ")";
+            size_t offset = 0;
+            for (auto i=group._requests.cbegin(); i!=group._requests.cend(); ++i) {
+                offset += (*i)->_size;
+                if (offset > bytesRead) (*i)->_failed = true;
+            }
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            for (auto i=group._requests.cbegin(); i!=group._requests.cend(); ++i) {
+                (*i)->_complete.store(true, std::memory_order_release);
+            }
+        }
+        _completionCondition.notify_all();
+        Internal::FileDataSource_OnReadCompleted();
+    }
+
+    void    AsyncFileReader::Queue(std::shared_ptr<ReadRequest> request)
+    {
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            request->_sequence = _nextSequence++;
+            auto i = std::lower_bound(_pending.begin(), _pending.end(), request, SortReads);
+            _pending.insert(i, std::move(request));
+        }
+
+        #if defined(FILEDATASOURCE_IO_URING)
+            if (_ring) {
+                uint64 one = 1;
+                auto ignored = write(_wakeEvent, &one, sizeof(one)); (void)ignored;
+                return;
+            }
+        #endif
+        _pendingCondition.notify_one();
+    }
+
+    void    AsyncFileReader::Wait(const ReadRequest& request)
+    {
+        if (request._complete.load(std::memory_order_acquire)) return;
+        std::unique_lock<std::mutex> lock(_lock);
+        _completionCondition.wait(lock, [&request]() { return request._complete.load(std::memory_order_acquire); });
+    }
+
+    void    AsyncFileReader::ThreadPoolEntryPoint()
+    {
+        for (;;) {
+            ReadGroup group;
+            {
+                std::unique_lock<std::mutex> lock(_lock);
+                _pendingCondition.wait(lock, [this]() { return _quit || !_pending.empty(); });
+                if (_pending.empty()) return;   // (quitting)
+                group = TakeReadGroup(_pending);
+            }
+
+            auto bytesRead = FinishRead(group, 0);
+            Complete(group, bytesRead);
+        }
+    }
+
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    #if defined(FILEDATASOURCE_IO_URING)
+
+        class AsyncFileReader::Ring
+        {
+        public:
+            struct io_uring_sqe*    GetSQE();
+            void                    Submit(unsigned& toSubmit);
+            bool                    Enter(unsigned toSubmit, unsigned minComplete);
+            bool                    PeekCQE(struct io_uring_cqe& result);
+
+            int     _ringFile;
+            std::vector<std::unique_ptr<ReadGroup>> _inFlight;  // (indexed by user data)
+            std::vector<unsigned>                   _freeSlots;
+
+            Ring(int ringFile, const struct io_uring_params& params);
+            ~Ring();
+        private:
+            void*       _sqRing;        size_t _sqRingSize;
+            void*       _cqRing;        size_t _cqRingSize;
+            struct io_uring_sqe* _sqes; size_t _sqesSize;
+
+            unsigned    *_sqHead, *_sqTail, *_sqMask, *_sqArray;
+            unsigned    *_cqHead, *_cqTail, *_cqMask;
+            struct io_uring_cqe* _cqes;
+            unsigned    _sqEntries;
+            unsigned    _localTail;
+        };
+
+        AsyncFileReader::Ring::Ring(int ringFile, const struct io_uring_params& params)
+        : _ringFile(ringFile), _sqRing(MAP_FAILED), _cqRing(MAP_FAILED), _sqes((struct io_uring_sqe*)MAP_FAILED)
+        {
+            _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            _sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+            bool singleMap = !!(params.features & IORING_FEAT_SINGLE_MMAP);
+            if (singleMap) {
+                _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+            }
+
+            _sqRing = mmap(nullptr, _sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ringFile, IORING_OFF_SQ_RING);
+            if (_sqRing == MAP_FAILED) return;
+            if (singleMap) {
+                _cqRing = _sqRing;
+            } else {
+                _cqRing = mmap(nullptr, _cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ringFile, IORING_OFF_CQ_RING);
+                if (_cqRing == MAP_FAILED) return;
+            }
+            _sqes = (struct io_uring_sqe*)mmap(nullptr, _sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ringFile, IORING_OFF_SQES);
+            if (_sqes == MAP_FAILED) return;
+
+            _sqHead     = (unsigned*)PtrAdd(_sqRing, params.sq_off.head);
+            _sqTail     = (unsigned*)PtrAdd(_sqRing, params.sq_off.tail);
+            _sqMask     = (unsigned*)PtrAdd(_sqRing, params.sq_off.ring_mask);
+            _sqArray    = (unsigned*)PtrAdd(_sqRing, params.sq_off.array);
+            _cqHead     = (unsigned*)PtrAdd(_cqRing, params.cq_off.head);
+            _cqTail     = (unsigned*)PtrAdd(_cqRing, params.cq_off.tail);
+            _cqMask     = (unsigned*)PtrAdd(_cqRing, params.cq_off.ring_mask);
+            _cqes       = (struct io_uring_cqe*)PtrAdd(_cqRing, params.cq_off.cqes);
+            _sqEntries  = params.sq_entries;
+            _localTail  = *_sqTail;
+
+            _inFlight.resize(_sqEntries);
+            for (unsigned c=0; c<_sqEntries; ++c) _freeSlots.push_back(_sqEntries-1-c);
+        }
+
+        AsyncFileReader::Ring::~Ring()
+        {
+            if (_sqes != MAP_FAILED) munmap(_sqes, _sqesSize);
+            if (_cqRing != MAP_FAILED && _cqRing != _sqRing) munmap(_cqRing, _cqRingSize);
+            if (_sqRing != MAP_FAILED) munmap(_sqRing, _sqRingSize);
+            close(_ringFile);
+        }
+
+        struct io_uring_sqe*    AsyncFileReader::Ring::GetSQE()
+        {
+                // (we're the only thread writing to the submission queue)
+            auto head = __atomic_load_n(_sqHead, __ATOMIC_ACQUIRE);
+            if ((_localTail - head) >= _sqEntries) return nullptr;
+            auto index = _localTail & *_sqMask;
+            auto* sqe = &_sqes[index];
+            XlSetMemory(sqe, 0, sizeof(*sqe));
+            _sqArray[index] = index;
+            ++_localTail;
+            return sqe;
+        }
+
+        void    AsyncFileReader::Ring::Submit(unsigned& toSubmit)
+        {
+            toSubmit += _localTail - *_sqTail;
+            __atomic_store_n(_sqTail, _localTail, __ATOMIC_RELEASE);
+        }
+
+        bool    AsyncFileReader::Ring::Enter(unsigned toSubmit, unsigned minComplete)
+        {
+            auto result = syscall(__NR_io_uring_enter, _ringFile, toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            return result >= 0 || errno == EINTR;
+        }
+
+        bool    AsyncFileReader::Ring::PeekCQE(struct io_uring_cqe& result)
+        {
+            auto head = *_cqHead;
+            if (head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) return false;
+            result = _cqes[head & *_cqMask];
+            __atomic_store_n(_cqHead, head+1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        static std::unique_ptr<AsyncFileReader::Ring> CreateRing()
+        {
+            struct io_uring_params params;
+            XlSetMemory(&params, 0, sizeof(params));
+            int ringFile = int(syscall(__NR_io_uring_setup, RingEntries, &params));
+            if (ringFile < 0) return nullptr;      // (kernel too old, or io_uring disabled)
+
+            auto ring = std::make_unique<AsyncFileReader::Ring>(ringFile, params);
+            if (ring->_inFlight.empty()) return nullptr;      // (mapping the ring failed)
+            return std::move(ring);
+        }
+
+        void    AsyncFileReader::RingEntryPoint()
+        {
+            static const uint64 WakeUserData = ~uint64(0);
+            bool wakePollArmed = false;
+            unsigned inFlightCount = 0;
+
+            for (;;) {
+                unsigned toSubmit = 0;
+
+                    //  Keep a poll on the wake event in the ring, so that queuing a
+                    //  new read interrupts the wait below
+                if (!wakePollArmed) {
+                    auto* sqe = _ring->GetSQE();
+                    if (sqe) {
+                        sqe->opcode = IORING_OP_POLL_ADD;
+                        sqe->fd = _wakeEvent;
+                        sqe->poll_events = POLLIN;
+                        sqe->user_data = WakeUserData;
+                        wakePollArmed = true;
+                    }
+                }
+
+                {
+                    std::unique_lock<std::mutex> lock(_lock);
+                    if (_quit && !inFlightCount) break;
+                    while (!_pending.empty() && !_ring->_freeSlots.empty()) {
+                        auto* sqe = _ring->GetSQE();
+                        if (!sqe) break;
+
+                        auto slot = _ring->_freeSlots.back();
+                        _ring->_freeSlots.pop_back();
+                        auto group = std::make_unique<ReadGroup>(TakeReadGroup(_pending));
+                        sqe->opcode = IORING_OP_READV;
+                        sqe->fd = group->GetFile();
+                        sqe->addr = uint64(size_t(AsPointer(group->_iovecs.begin())));
+                        sqe->len = unsigned(group->_iovecs.size());
+                        sqe->off = group->_offset;
+                        sqe->user_data = slot;
+                        _ring->_inFlight[slot] = std::move(group);
+                        ++inFlightCount;
+                    }
+                }
+
+                _ring->Submit(toSubmit);
+                if (!_ring->Enter(toSubmit, 1)) {
+                    LogWarning << "io_uring_enter failed in FileDataSource (errno " << errno << ")";
+                }
+
+                struct io_uring_cqe cqe;
+                while (_ring->PeekCQE(cqe)) {
+                    if (cqe.user_data == WakeUserData) {
+                        uint64 count;
+                        auto ignored = read(_wakeEvent, &count, sizeof(count)); (void)ignored;
+                        wakePollArmed = false;
+                        continue;
+                    }
+
+                    auto slot = unsigned(cqe.user_data);
+                    auto group = std::move(_ring->_inFlight[slot]);
+                    {
+                        std::unique_lock<std::mutex> lock(_lock);
+                        _ring->_freeSlots.push_back(slot);
+                    }
+                    --inFlightCount;
+
+                        //  Finish short reads (and retry failures) with a blocking read.
+                        //  This should be very rare.
+                    size_t bytesRead = (cqe.res >= 0) ? size_t(cqe.res) : 0;
+                    if (bytesRead < group->_size && cqe.res != 0) {
+                        bytesRead = FinishRead(*group, bytesRead);
+                    }
+                    Complete(*group, bytesRead);
+                }
+            }
+        }
+
+    #endif
+
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    AsyncFileReader::AsyncFileReader()
+    : _nextSequence(0), _quit(false)
+    {
+        #if defined(FILEDATASOURCE_IO_URING)
+            _wakeEvent = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+            if (_wakeEvent >= 0) {
+                _ring = CreateRing();
+            }
+            if (_ring) {
+                _threads.push_back(std::make_unique<std::thread>(&AsyncFileReader::RingEntryPoint, this));
+                return;
+            }
+            if (_wakeEvent >= 0) { close(_wakeEvent); _wakeEvent = -1; }
+        #endif
+
+        for (unsigned c=0; c<ThreadPoolSize; ++c) {
+            _threads.push_back(std::make_unique<std::thread>(&AsyncFileReader::ThreadPoolEntryPoint, this));
+        }
+    }
+
+    AsyncFileReader::~AsyncFileReader()
+    {
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _quit = true;
+            _pending.clear();
+        }
+        _pendingCondition.notify_all();
+        #if defined(FILEDATASOURCE_IO_URING)
+            if (_wakeEvent >= 0) {
+                uint64 one = 1;
+                auto ignored = write(_wakeEvent, &one, sizeof(one)); (void)ignored;
+            }
+        #endif
+
+        for (auto i=_threads.begin(); i!=_threads.end(); ++i) {
+            (*i)->join();
+        }
+
+        #if defined(FILEDATASOURCE_IO_URING)
+            _ring.reset();
+            if (_wakeEvent >= 0) close(_wakeEvent);
+        #endif
+    }
+
+    static AsyncFileReader& GetAsyncFileReader()
+    {
+        static AsyncFileReader reader;
+        return reader;
+    }
+
+        ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class FileDataSource : public RawDataPacket
+    {
+    public:
+        virtual void*                           GetData             (unsigned mipIndex, unsigned arrayIndex);
+        virtual size_t                          GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const;
+        virtual std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const;
+        virtual bool                            IsDataReady         () const;
+        virtual bool                            HasFailed           () const;
+
+        FileDataSource(const void* fileHandle, size_t offset, size_t dataSize);
+        virtual ~FileDataSource();
+
+    protected:
+            //  (the request owns the buffer, and is shared with the reader -- so if
+            //  we're destroyed before the read finishes, the buffer stays valid)
+        std::shared_ptr<ReadRequest> _request;
+    };
+
+    void*                           FileDataSource::GetData             (unsigned mipIndex, unsigned arrayIndex)
+    {
+        if (mipIndex == 0) {
+            GetAsyncFileReader().Wait(*_request);
+            return _request->_failed ? nullptr : _request->_buffer.get();
+        }
+        return nullptr;
+    }
+
+    size_t                          FileDataSource::GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return _request->_size;
+    }
+
+    std::pair<unsigned,unsigned>    FileDataSource::GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return Internal::FileDataSource_GetRowAndSlicePitch(_request->_size);
+    }
+
+    bool                            FileDataSource::IsDataReady         () const
+    {
+        return _request->_complete.load(std::memory_order_acquire) && !_request->_failed;
+    }
+
+    bool                            FileDataSource::HasFailed           () const
+    {
+        return _request->_complete.load(std::memory_order_acquire) && _request->_failed;
+    }
+
+    FileDataSource::FileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
+    {
+        assert(dataSize);
+
+            //  duplicate the descriptor so we get our own reference on this file
+        int file = fcntl(int(intptr_t(fileHandle)), F_DUPFD_CLOEXEC, 0);
+        assert(file >= 0);
+
+        _request = std::make_shared<ReadRequest>(file, uint64(offset), dataSize);
+        GetAsyncFileReader().Queue(_request);
+    }
+
+    FileDataSource::~FileDataSource()
+    {}
+
+    intrusive_ptr<RawDataPacket> CreateFileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
+    {
+        return make_intrusive<FileDataSource>(fileHandle, offset, dataSize);
+    }
+}
+
+#endif
@@ -6,7 +6,7 @@
 
 #include "PlatformInterface.h"
 #include "../RenderCore/Metal/Format.h"
-#include "../Utility/StringFormat.h"
+#include "../Utility/StringFormatTyped.h"
 #include "../Utility/TimeUtils.h"
 #include <assert.h>
 
@@ -108,7 +108,7 @@ namespace BufferUploads { namespace PlatformInterface
                 // Copy data to/from video texture
             int nPitch = TextureDataSize(mipMapDesc._width, 1, 1, 1, (NativeFormat::Enum)mipMapDesc._nativePixelFormat);
             assert(sourceDataSize % nPitch == 0); (void)nPitch;
-            assert(size_t(destination) + sourceDataSize <= destinationDataSize);
+            assert(sourceDataSize <= destinationDataSize);
             XlCopyMemoryAlign16((uint8*)destination, sourceData, sourceDataSize);
         }
     }
@@ -237,6 +237,10 @@ namespace BufferUploads { namespace PlatformInterface
         intrusive_ptr<ID3D::Query> Query_CreateEvent(ObjectFactory& factory);
         bool    Query_IsEventTriggered(ID3D::DeviceContext* context, ID3D::Query* query);
         void    Query_End(ID3D::DeviceContext* context, ID3D::Query* query);
+    #elif GFXAPI_ACTIVE == GFXAPI_HEADLESS
+        UnderlyingQuery Query_CreateEvent(ObjectFactory& factory);
+        bool    Query_IsEventTriggered(SimulatedGPU* context, RenderCore::Metal::Query* query);
+        void    Query_End(SimulatedGPU* context, RenderCore::Metal::Query* query);
     #endif
 
     static const GPUEventStack::EventID EventID_Temporary    = ~GPUEventStack::EventID(0x1);
@@ -375,19 +379,19 @@ namespace BufferUploads { namespace PlatformInterface
         char buffer[2048];
         if (desc._type == BufferDesc::Type::Texture) {
             const TextureDesc& tDesc = desc._textureDesc;
-            xl_snprintf(buffer, dimof(buffer), "[%s] Tex(%4s) (%4ix%4i) mips:(%2i)", 
+            XlFormat(buffer, "[%s] Tex(%4s) (%4ix%4i) mips:(%2i)", 
                 desc._name, (tDesc._dimensionality==TextureDesc::Dimensionality::T2D)?"  2D":"Cube",
                 tDesc._width, tDesc._height, tDesc._mipCount);
         } else if (desc._type == BufferDesc::Type::LinearBuffer) {
             if (desc._bindFlags & BindFlag::VertexBuffer) {
-                xl_snprintf(buffer, dimof(buffer), "[%s] VB (%6.1fkb)", 
+                XlFormat(buffer, "[%s] VB (%6.1fkb)", 
                     desc._name, desc._linearBufferDesc._sizeInBytes/1024.f);
             } else if (desc._bindFlags & BindFlag::IndexBuffer) {
-                xl_snprintf(buffer, dimof(buffer), "[%s] IB (%6.1fkb)", 
+                XlFormat(buffer, "[%s] IB (%6.1fkb)", 
                     desc._name, desc._linearBufferDesc._sizeInBytes/1024.f);
             }
         } else {
-            xl_snprintf(buffer, dimof(buffer), "Unknown");
+            XlFormat(buffer, "Unknown");
         }
         return std::string(buffer);
     }
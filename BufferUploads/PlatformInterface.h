@@ -184,6 +184,16 @@ namespace BufferUploads { namespace PlatformInterface
         static const bool ContextBasedMultithreading = true;
         static const bool CanDoPartialMaps = false;
         static const bool NonVolatileResourcesTakeSystemMemory = false;
+    #elif GFXAPI_ACTIVE == GFXAPI_HEADLESS
+            // (same as DX11, so benchmarks exercise the same code paths)
+        static const bool SupportsResourceInitialisation = true;
+        static const bool RequiresStagingTextureUpload = false;
+        static const bool RequiresStagingResourceReadBack = true;
+        static const bool CanDoNooverwriteMapInBackground = false;
+        static const bool UseMapBasedDefrag = false;
+        static const bool ContextBasedMultithreading = true;
+        static const bool CanDoPartialMaps = false;
+        static const bool NonVolatileResourcesTakeSystemMemory = false;
     #else
         #error Unsupported platform!
     #endif
@@ -492,6 +492,7 @@ namespace BufferUploads
         if (heap) {
             if (heap->Deref(offset, size)) {
                 assert(!_activeDefrag.get() || heap != _activeDefrag->GetHeap());
+                ScopedLock(_activeDefrag_Lock);     // (other threads can be returning to the pool at the same time; we only have a read lock on _lock)
                 if (_activeDefragHeap == heap) {
                     _activeDefrag->QueueOperation(
                         ActiveDefrag::Operation::Deallocate, offset, offset+size);
@@ -0,0 +1,96 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+
+namespace BufferUploads { namespace Internal
+{
+        //
+        //      Ordering and selection of the steps in the assembly line's schedule.
+        //      Each list of steps is kept sorted with the most urgent step at the back.
+        //      These don't touch the assembly line itself, so they can be tested alone.
+        //
+
+    struct ScheduleKey
+    {
+        unsigned _requiredByFrame, _priority, _sequence;
+    };
+
+        /// <summary>Earliest deadline first, then highest priority, then the order the steps were queued in</summary>
+    inline bool IsLessUrgent(const ScheduleKey& lhs, const ScheduleKey& rhs)
+    {
+        if (lhs._requiredByFrame != rhs._requiredByFrame)   { return lhs._requiredByFrame > rhs._requiredByFrame; }
+        if (lhs._priority != rhs._priority)                 { return lhs._priority < rhs._priority; }
+        return lhs._sequence > rhs._sequence;
+    }
+
+        /// <summary>Steps become due on the frame before their deadline (so they are committed in time)</summary>
+    inline bool IsDue(unsigned requiredByFrame, unsigned currentFrame)
+    {
+        return (requiredByFrame != ~unsigned(0x0)) && (requiredByFrame <= currentFrame+1);
+    }
+
+    template<typename StepType>
+        struct ScheduledStep
+        {
+            ScheduleKey _key;
+            StepType _step;
+            bool operator<(const ScheduledStep& other) const { return IsLessUrgent(_key, other._key); }
+        };
+
+        /// <summary>Sorts the steps added after "oldSize" into the (already sorted) list</summary>
+    template<typename StepType>
+        void MergeScheduledSteps(std::vector<ScheduledStep<StepType>>& steps, size_t oldSize)
+        {
+            if (steps.size() != oldSize) {
+                std::sort(steps.begin()+oldSize, steps.end());
+                std::inplace_merge(steps.begin(), steps.begin()+oldSize, steps.end());
+            }
+        }
+
+    static const unsigned ScheduleMaxAttempts = 8;
+
+    struct ScheduleResult { enum Enum { Processed, NotReady, OverBudget }; };
+
+        ///
+        /// <summary>Processes the most urgent step that can be processed</summary>
+        ///
+        /// Tries the most urgent step first. If it can't be processed yet (eg, its data is
+        /// still loading), tries a few more (up to ScheduleMaxAttempts), so that one slow step
+        /// doesn't hold up everything queued after it.
+        ///
+        /// Due steps ignore the frame budget. Since the list is sorted by deadline, once we
+        /// find a step that isn't due, nothing after it is due either. So we stop at the first
+        /// step that isn't due when "withinBudget()" returns false.
+        ///
+        /// "processFn(step)" returns true when the step is complete. Completed steps are removed
+        /// from the list.
+        ///
+    template<typename StepType, typename ProcessFn, typename BudgetFn>
+        ScheduleResult::Enum ProcessMostUrgentStep(
+            std::vector<ScheduledStep<StepType>>& steps, unsigned currentFrame,
+            ProcessFn processFn, BudgetFn withinBudget)
+        {
+            size_t i = steps.size();
+            for (unsigned attempt=0; i>0 && attempt<ScheduleMaxAttempts; ++attempt) {
+                --i;
+                if (!IsDue(steps[i]._key._requiredByFrame, currentFrame) && !withinBudget()) {
+                    return ScheduleResult::OverBudget;
+                }
+
+                if (processFn(steps[i]._step)) {
+                    steps.erase(steps.begin()+i);
+                    return ScheduleResult::Processed;
+                }
+            }
+            return ScheduleResult::NotReady;
+        }
+
+}}
+
@@ -146,7 +146,7 @@ namespace BufferUploads
             }
         }
 
-        ++_commitCountCurrent;
+        Interlocked::Increment(&_commitCountCurrent);
         gpuEventStack.Update(immContext.get());
         _commandListIDCompletedByGPU = gpuEventStack.GetLastCompletedEvent();
         XlSetEvent(_wakeupEvent);   // wake up the background thread -- it might be time for a resolve
@@ -126,7 +126,8 @@ namespace BufferUploads
         CommandListMetrics&     GetMetricsUnderConstruction()                   { return _commandListUnderConstruction; }
         CommitStep&             GetCommitStepUnderConstruction()                { return _commitStepUnderConstruction; }
 
-        unsigned                CommitCount_Current()                           { return _commitCountCurrent; }
+            //  (the commit count is read from other threads; see Manager::Transaction_SetPriority)
+        unsigned                CommitCount_Current()                           { return unsigned(Interlocked::Load(&_commitCountCurrent)); }
         unsigned&               CommitCount_LastResolve()                       { return _commitCountLastResolve; }
 
         XlHandle                GetWakeupEvent()                                { return _wakeupEvent; }
@@ -150,7 +151,8 @@ namespace BufferUploads
 
         TimeMarker  _lastResolve;
         TimeMarker  _tickFrequency;
-        unsigned    _commitCountCurrent, _commitCountLastResolve;
+        Interlocked::Value  _commitCountCurrent;
+        unsigned    _commitCountLastResolve;
         bool        _requiresResolves;
 
         XlHandle    _wakeupEvent;
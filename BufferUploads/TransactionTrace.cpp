@@ -0,0 +1,636 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TransactionTrace.h"
+#include "PlatformInterface.h"
+#include "../RenderCore/Metal/Format.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Core/Exceptions.h"
+#include <sstream>
+#include <algorithm>
+#include <assert.h>
+
+namespace BufferUploads
+{
+    using namespace RenderCore::Metal;
+
+    static const char TraceHeader[] = "BufferUploadsTrace";
+    static const unsigned TraceVersion = 1;
+
+        ///////////////////   S E R I A L I Z A T I O N   ///////////////////
+
+        //  Pixel formats are written by name, because the values of NativeFormat::Enum
+        //  are different for different graphics APIs
+    static const char* AsString(NativeFormat::Enum format)
+    {
+        switch (format) {
+        #undef _EXP
+        #define _EXP(X, Y, Z, U)    case NativeFormat::X##_##Y: return #X "_" #Y;
+            #include "../RenderCore/Metal/Detail/DXGICompatibleFormats.h"
+        #undef _EXP
+        default: return "Unknown";
+        }
+    }
+
+    static NativeFormat::Enum AsNativeFormat(const std::string& name)
+    {
+        static const std::pair<const char*, NativeFormat::Enum> formats[] = {
+            #undef _EXP
+            #define _EXP(X, Y, Z, U)    std::make_pair(#X "_" #Y, NativeFormat::X##_##Y),
+                #include "../RenderCore/Metal/Detail/DXGICompatibleFormats.h"
+            #undef _EXP
+        };
+        for (unsigned c=0; c<dimof(formats); ++c) {
+            if (name == formats[c].first) return formats[c].second;
+        }
+        return NativeFormat::Unknown;
+    }
+
+    static void WriteDesc(std::ostream& stream, const BufferDesc& desc)
+    {
+        stream << unsigned(desc._type) << " " << desc._bindFlags << " " << desc._cpuAccess << " " << desc._gpuAccess << " " << desc._allocationRules;
+        if (desc._type == BufferDesc::Type::LinearBuffer) {
+            stream << " " << desc._linearBufferDesc._sizeInBytes << " " << desc._linearBufferDesc._structureByteSize;
+        } else if (desc._type == BufferDesc::Type::Texture) {
+            auto& t = desc._textureDesc;
+            stream  << " " << unsigned(t._dimensionality) << " " << t._width << " " << t._height << " " << t._depth
+                    << " " << AsString(NativeFormat::Enum(t._nativePixelFormat))
+                    << " " << unsigned(t._mipCount) << " " << unsigned(t._arrayCount)
+                    << " " << unsigned(t._samples._sampleCount) << " " << unsigned(t._samples._samplingQuality);
+        }
+
+            //  name goes last, with spaces replaced (so it's always a single token)
+        std::string name = desc._name;
+        std::replace(name.begin(), name.end(), ' ', '_');
+        stream << " " << (name.empty() ? std::string("-") : name);
+    }
+
+    static BufferDesc ReadDesc(std::istream& stream)
+    {
+        BufferDesc desc;
+        XlZeroMemory(desc);
+        unsigned type = 0;
+        stream >> type >> desc._bindFlags >> desc._cpuAccess >> desc._gpuAccess >> desc._allocationRules;
+        desc._type = BufferDesc::Type::Enum(std::min(type, unsigned(BufferDesc::Type::Unknown)));
+        if (desc._type == BufferDesc::Type::LinearBuffer) {
+            stream >> desc._linearBufferDesc._sizeInBytes >> desc._linearBufferDesc._structureByteSize;
+        } else if (desc._type == BufferDesc::Type::Texture) {
+            unsigned dimensionality = 0, mipCount = 0, arrayCount = 0, sampleCount = 0, samplingQuality = 0;
+            std::string format;
+            auto& t = desc._textureDesc;
+            stream >> dimensionality >> t._width >> t._height >> t._depth >> format >> mipCount >> arrayCount >> sampleCount >> samplingQuality;
+            t._dimensionality = TextureDesc::Dimensionality::Enum(dimensionality);
+            t._nativePixelFormat = AsNativeFormat(format);
+            t._mipCount = uint8(mipCount);
+            t._arrayCount = uint8(arrayCount);
+            t._samples = TextureSamples::Create(uint8(sampleCount), uint8(samplingQuality));
+        }
+
+        std::string name;
+        stream >> name;
+        XlCopyString(desc._name, dimof(desc._name), (name == "-") ? "" : name.c_str());
+        return desc;
+    }
+
+    static void WritePart(std::ostream& stream, const PartialResource& part)
+    {
+        stream  << part._box._left << " " << part._box._top << " " << part._box._right << " " << part._box._bottom
+                << " " << part._lodLevelMin << " " << part._lodLevelMax << " " << part._arrayIndex;
+    }
+
+    static PartialResource ReadPart(std::istream& stream)
+    {
+        PartialResource part;
+        stream  >> part._box._left >> part._box._top >> part._box._right >> part._box._bottom
+                >> part._lodLevelMin >> part._lodLevelMax >> part._arrayIndex;
+        return part;
+    }
+
+    std::string TransactionTrace::Serialize() const
+    {
+        std::stringstream stream;
+        stream << TraceHeader << " " << TraceVersion << std::endl;
+        for (auto i=_events.cbegin(); i!=_events.cend(); ++i) {
+            switch (i->_type) {
+            case TransactionTraceEvent::Type::Begin:
+                stream << "B " << i->_time << " " << i->_id << " " << i->_flags << " " << i->_dataSize << " ";
+                WriteDesc(stream, i->_desc);
+                break;
+            case TransactionTraceEvent::Type::UpdateData:
+                stream << "U " << i->_time << " " << i->_id << " " << i->_dataSize << " ";
+                WritePart(stream, i->_part);
+                break;
+            case TransactionTraceEvent::Type::End:              stream << "E " << i->_time << " " << i->_id; break;
+            case TransactionTraceEvent::Type::AddRef:           stream << "A " << i->_time << " " << i->_id; break;
+            case TransactionTraceEvent::Type::Immediate:
+                stream << "I " << i->_time << " " << i->_dataSize << " ";
+                WritePart(stream, i->_part);
+                stream << " ";
+                WriteDesc(stream, i->_desc);
+                break;
+            case TransactionTraceEvent::Type::Update:           stream << "F " << i->_time; break;
+            case TransactionTraceEvent::Type::FramePriorityBarrier: stream << "P " << i->_time; break;
+            case TransactionTraceEvent::Type::SetPriority:
+                stream << "R " << i->_time << " " << i->_id << " " << i->_framesUntilRequired << " " << i->_priority;
+                break;
+            }
+            stream << std::endl;
+        }
+        return stream.str();
+    }
+
+    void TransactionTrace::Write(const char filename[]) const
+    {
+        auto str = Serialize();
+        BasicFile file(filename, "wb");
+        if (file.Write(str.data(), 1, str.size()) != str.size()) {
+            ThrowException(::Exceptions::BasicLabel("Failed while writing transaction trace (%s)", filename));
+        }
+    }
+
+    TransactionTrace TransactionTrace::Parse(const char* begin, const char* end)
+    {
+        std::stringstream stream(std::string(begin, end));
+        std::string header;
+        unsigned version = 0;
+        stream >> header >> version;
+        if (header != TraceHeader || version != TraceVersion) {
+            ThrowException(::Exceptions::BasicLabel("Unrecognised transaction trace format"));
+        }
+
+        TransactionTrace result;
+        std::string line;
+        unsigned lineIndex = 1;
+        while (std::getline(stream, line)) {
+            ++lineIndex;
+            if (line.empty() || line[0] == '\r') continue;
+
+            std::stringstream lineStream(line);
+            char type = 0;
+            TransactionTraceEvent evnt;
+            lineStream >> type >> evnt._time;
+            switch (type) {
+            case 'B':
+                evnt._type = TransactionTraceEvent::Type::Begin;
+                lineStream >> evnt._id >> evnt._flags >> evnt._dataSize;
+                evnt._desc = ReadDesc(lineStream);
+                break;
+            case 'U':
+                evnt._type = TransactionTraceEvent::Type::UpdateData;
+                lineStream >> evnt._id >> evnt._dataSize;
+                evnt._part = ReadPart(lineStream);
+                break;
+            case 'E':   evnt._type = TransactionTraceEvent::Type::End; lineStream >> evnt._id; break;
+            case 'A':   evnt._type = TransactionTraceEvent::Type::AddRef; lineStream >> evnt._id; break;
+            case 'I':
+                evnt._type = TransactionTraceEvent::Type::Immediate;
+                lineStream >> evnt._dataSize;
+                evnt._part = ReadPart(lineStream);
+                evnt._desc = ReadDesc(lineStream);
+                break;
+            case 'F':   evnt._type = TransactionTraceEvent::Type::Update; break;
+            case 'P':   evnt._type = TransactionTraceEvent::Type::FramePriorityBarrier; break;
+            case 'R':
+                evnt._type = TransactionTraceEvent::Type::SetPriority;
+                lineStream >> evnt._id >> evnt._framesUntilRequired >> evnt._priority;
+                break;
+            default:
+                ThrowException(::Exceptions::BasicLabel("Unknown event type in transaction trace at line (%i)", lineIndex));
+            }
+
+            if (lineStream.fail()) {
+                ThrowException(::Exceptions::BasicLabel("Malformed transaction trace at line (%i)", lineIndex));
+            }
+            result._events.push_back(evnt);
+        }
+        return result;
+    }
+
+    TransactionTrace TransactionTrace::Load(const char filename[])
+    {
+        size_t fileSize = 0;
+        auto block = LoadFileAsMemoryBlock(filename, &fileSize);
+        if (!block) {
+            ThrowException(::Exceptions::BasicLabel("Could not load transaction trace (%s)", filename));
+        }
+        return Parse((const char*)block.get(), (const char*)PtrAdd(block.get(), fileSize));
+    }
+
+    TransactionTraceEvent::TransactionTraceEvent()
+    : _type(Type::Update), _time(0), _id(0), _flags(0), _dataSize(0), _framesUntilRequired(~unsigned(0x0)), _priority(0)
+    {
+        XlZeroMemory(_desc);
+    }
+
+        ///////////////////   R E C O R D I N G   ///////////////////
+
+    void TransactionTraceRecorder::Push(TransactionTraceEvent&& evnt)
+    {
+        ScopedLock(_lock);
+        if (!_active) return;       // (could have stopped since the caller checked)
+        evnt._time = Microsecond_Now() - _startTime;
+        _trace._events.push_back(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnBegin(TransactionID id, const BufferDesc& desc, RawDataPacket* data, TransactionOptions::BitField flags)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::Begin;
+        evnt._id = id;
+        evnt._flags = flags;
+        evnt._desc = desc;
+        evnt._dataSize = data ? PlatformInterface::ByteCount(desc) : 0;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnUpdateData(TransactionID id, RawDataPacket* data, const PartialResource& part)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::UpdateData;
+        evnt._id = id;
+        evnt._part = part;
+        evnt._dataSize = data ? data->GetDataSize() : 0;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnEnd(TransactionID id)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::End;
+        evnt._id = id;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnAddRef(TransactionID id)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::AddRef;
+        evnt._id = id;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnImmediate(const BufferDesc& desc, RawDataPacket* data, const PartialResource& part)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::Immediate;
+        evnt._desc = desc;
+        evnt._part = part;
+        evnt._dataSize = data ? PlatformInterface::ByteCount(desc) : 0;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnUpdate()
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::Update;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnFramePriorityBarrier()
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::FramePriorityBarrier;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::OnSetPriority(TransactionID id, unsigned framesUntilRequired, unsigned priority)
+    {
+        TransactionTraceEvent evnt;
+        evnt._type = TransactionTraceEvent::Type::SetPriority;
+        evnt._id = id;
+        evnt._framesUntilRequired = framesUntilRequired;
+        evnt._priority = priority;
+        Push(std::move(evnt));
+    }
+
+    void TransactionTraceRecorder::Start()
+    {
+        ScopedLock(_lock);
+        _trace = TransactionTrace();
+        _startTime = Microsecond_Now();
+        _active = true;
+    }
+
+    TransactionTrace TransactionTraceRecorder::Stop()
+    {
+        ScopedLock(_lock);
+        _active = false;
+        return std::move(_trace);
+    }
+
+    TransactionTraceRecorder::TransactionTraceRecorder() : _active(false), _startTime(0) {}
+    TransactionTraceRecorder::~TransactionTraceRecorder() {}
+
+        ///////////////////   R E P L A Y   ///////////////////
+
+        //
+        //  Packet with uninitialised data for every subresource of a desc. We don't
+        //  record the contents of packets in the trace, so this stands in for the
+        //  original data during replay.
+        //
+    class SyntheticDataPacket : public RawDataPacket
+    {
+    public:
+        void*                           GetData             (unsigned mipIndex, unsigned arrayIndex);
+        size_t                          GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const;
+        std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const;
+
+        SyntheticDataPacket(const BufferDesc& desc);
+        ~SyntheticDataPacket();
+    private:
+        class SubResource { public: size_t _offset, _size; unsigned _rowPitch, _slicePitch; };
+        std::vector<SubResource>                    _subResources;
+        std::unique_ptr<uint8, PODAlignedDeletor>   _data;
+        unsigned                                    _mipCount;
+
+        const SubResource* Find(unsigned mipIndex, unsigned arrayIndex) const
+        {
+            auto index = arrayIndex * _mipCount + mipIndex;
+            return (index < _subResources.size()) ? &_subResources[index] : nullptr;
+        }
+    };
+
+    void* SyntheticDataPacket::GetData(unsigned mipIndex, unsigned arrayIndex)
+    {
+        auto sub = Find(mipIndex, arrayIndex);
+        return sub ? PtrAdd(_data.get(), sub->_offset) : nullptr;
+    }
+
+    size_t SyntheticDataPacket::GetDataSize(unsigned mipIndex, unsigned arrayIndex) const
+    {
+        auto sub = Find(mipIndex, arrayIndex);
+        return sub ? sub->_size : 0;
+    }
+
+    std::pair<unsigned,unsigned> SyntheticDataPacket::GetRowAndSlicePitch(unsigned mipIndex, unsigned arrayIndex) const
+    {
+        auto sub = Find(mipIndex, arrayIndex);
+        return sub ? std::make_pair(sub->_rowPitch, sub->_slicePitch) : std::make_pair(0u, 0u);
+    }
+
+    SyntheticDataPacket::SyntheticDataPacket(const BufferDesc& desc)
+    {
+        size_t offset = 0;
+        if (desc._type == BufferDesc::Type::Texture) {
+            auto& t = desc._textureDesc;
+            auto format = NativeFormat::Enum(t._nativePixelFormat);
+            const bool compressed = GetCompressionType(format) == FormatCompressionType::BlockCompression;
+            _mipCount = std::max(unsigned(t._mipCount), 1u);
+            const unsigned arrayCount = std::max(unsigned(t._arrayCount), 1u);
+            for (unsigned a=0; a<arrayCount; ++a) {
+                for (unsigned m=0; m<_mipCount; ++m) {
+                    auto mipDesc = PlatformInterface::CalculateMipMapDesc(t, m);
+                    SubResource sub;
+                    sub._offset = offset;
+                    sub._rowPitch = PlatformInterface::TextureDataSize(mipDesc._width, compressed?4:1, 1, 1, format);
+                    sub._slicePitch = PlatformInterface::TextureDataSize(mipDesc._width, mipDesc._height, 1, 1, format);
+                    sub._size = PlatformInterface::TextureDataSize(mipDesc._width, mipDesc._height, std::max(mipDesc._depth, 1u), 1, format);
+                    _subResources.push_back(sub);
+                    offset = (offset + sub._size + 15) & ~size_t(15);
+                }
+            }
+        } else {
+            _mipCount = 1;
+            SubResource sub;
+            sub._offset = 0;
+            sub._size = PlatformInterface::ByteCount(desc);
+            sub._rowPitch = sub._slicePitch = unsigned(sub._size);
+            _subResources.push_back(sub);
+            offset = sub._size;
+        }
+
+        if (offset) {
+            _data.reset((uint8*)XlMemAlign(offset, 16));
+        }
+    }
+
+    SyntheticDataPacket::~SyntheticDataPacket() {}
+
+    static void WaitUntil(Microsecond time)
+    {
+        for (;;) {
+            auto now = Microsecond_Now();
+            if (now >= time) break;
+            if ((time - now) > 2000) {
+                Threading::Sleep(uint32((time - now) / 1000) - 1);
+            } else {
+                Threading::YieldTimeSlice();
+            }
+        }
+    }
+
+    TraceReplayResults  ReplayTransactionTrace(
+        IManager& manager, RenderCore::IThreadContext& immediateContext,
+        const TransactionTrace& trace, const TraceReplaySettings& settings)
+    {
+        class LiveTransaction
+        {
+        public:
+            TransactionID   _id;
+            BufferDesc      _desc;
+            unsigned        _refCount;
+            Microsecond     _pendingSince;      // (0 when not waiting for completion)
+        };
+
+            //  sorted by the id in the trace
+        std::vector<std::pair<TransactionID, LiveTransaction>> live;
+        std::vector<Microsecond> latencies;
+        TraceReplayResults result;
+
+        auto checkCompletion = [&](LiveTransaction& t, Microsecond now) {
+            if (t._pendingSince && manager.IsCompleted(t._id)) {
+                latencies.push_back(now - t._pendingSince);
+                t._pendingSince = 0;
+            }
+        };
+
+            //  Release every reference we still hold to a transaction
+        auto retire = [&](LiveTransaction& t) {
+            checkCompletion(t, Microsecond_Now());
+            if (t._pendingSince) {
+                ++result._incompleteCount;
+                t._pendingSince = 0;
+            }
+            for (; t._refCount; --t._refCount) {
+                manager.Transaction_End(t._id);
+            }
+        };
+
+        auto popMetrics = [&]() {
+            for (;;) {
+                auto metrics = manager.PopMetrics();
+                if (!metrics._commitTime) break;
+                ++result._commandListCount;
+                result._bytesUploaded += metrics._bytesUploadTotal;
+                result._cancelledSteps += metrics._cancelledSteps;
+                result._framePriorityStallTime += metrics._framePriorityStallTime;
+            }
+        };
+
+        auto update = [&]() {
+            manager.Update(immediateContext);
+            ++result._frameCount;
+            auto now = Microsecond_Now();
+            for (auto i=live.begin(); i!=live.end(); ++i) {
+                checkCompletion(i->second, now);
+            }
+            popMetrics();
+        };
+
+        const auto replayStart = Microsecond_Now();
+        for (auto e=trace._events.cbegin(); e!=trace._events.cend(); ++e) {
+            if (settings._realTime) {
+                WaitUntil(replayStart + e->_time);
+            }
+
+            switch (e->_type) {
+            case TransactionTraceEvent::Type::Begin:
+                {
+                    intrusive_ptr<RawDataPacket> data;
+                    if (e->_dataSize) {
+                        data = make_intrusive<SyntheticDataPacket>(e->_desc);
+                    }
+                    LiveTransaction t;
+                    t._desc = e->_desc;
+                    t._refCount = 1;
+                    t._pendingSince = Microsecond_Now();
+                    t._id = manager.Transaction_Begin(e->_desc, data.get(), e->_flags);
+
+                    auto i = LowerBound(live, e->_id);
+                    if (i != live.end() && i->first == e->_id) {
+                            //  The trace reused an id we still hold references to (the
+                            //  trace must have missed the end events). Release the old
+                            //  transaction first, or it would never be ended.
+                        retire(i->second);
+                        i->second = t;
+                    } else {
+                        live.insert(i, std::make_pair(e->_id, t));
+                    }
+                    ++result._transactionCount;
+                    result._bytesRequested += e->_dataSize;
+                }
+                break;
+
+            case TransactionTraceEvent::Type::UpdateData:
+                {
+                    auto i = LowerBound(live, e->_id);
+                    if (i == live.end() || i->first != e->_id) break;
+                    intrusive_ptr<RawDataPacket> data;
+                    if (e->_dataSize) {
+                        data = make_intrusive<SyntheticDataPacket>(i->second._desc);
+                    }
+                    manager.UpdateData(i->second._id, data.get(), e->_part);
+                    if (!i->second._pendingSince) {
+                        i->second._pendingSince = Microsecond_Now();
+                    }
+                    ++result._updateDataCount;
+                    result._bytesRequested += e->_dataSize;
+                }
+                break;
+
+            case TransactionTraceEvent::Type::End:
+                {
+                    auto i = LowerBound(live, e->_id);
+                    if (i == live.end() || i->first != e->_id) break;
+                    checkCompletion(i->second, Microsecond_Now());
+                    if (i->second._pendingSince) {
+                        ++result._incompleteCount;
+                        i->second._pendingSince = 0;
+                    }
+                    manager.Transaction_End(i->second._id);
+                    if (!--i->second._refCount) {
+                        live.erase(i);
+                    }
+                }
+                break;
+
+            case TransactionTraceEvent::Type::AddRef:
+                {
+                    auto i = LowerBound(live, e->_id);
+                    if (i == live.end() || i->first != e->_id) break;
+                    manager.AddRef(i->second._id);
+                    ++i->second._refCount;
+                }
+                break;
+
+            case TransactionTraceEvent::Type::Immediate:
+                {
+                    intrusive_ptr<RawDataPacket> data;
+                    if (e->_dataSize) {
+                        data = make_intrusive<SyntheticDataPacket>(e->_desc);
+                    }
+                    manager.Transaction_Immediate(e->_desc, data.get(), e->_part);
+                    ++result._immediateCount;
+                    result._bytesRequested += e->_dataSize;
+                }
+                break;
+
+            case TransactionTraceEvent::Type::Update:
+                update();
+                break;
+
+            case TransactionTraceEvent::Type::FramePriorityBarrier:
+                manager.FramePriority_Barrier();
+                break;
+
+            case TransactionTraceEvent::Type::SetPriority:
+                {
+                    auto i = LowerBound(live, e->_id);
+                    if (i == live.end() || i->first != e->_id) break;
+                    manager.Transaction_SetPriority(i->second._id, e->_framesUntilRequired, e->_priority);
+                }
+                break;
+            }
+        }
+
+            //  Keep updating until the transactions still referenced by the trace
+            //  are complete (or we time out)
+        const auto drainStart = Microsecond_Now();
+        for (;;) {
+            bool anyPending = false;
+            for (auto i=live.cbegin(); i!=live.cend(); ++i) {
+                anyPending |= i->second._pendingSince != 0;
+            }
+            if (!anyPending || (Microsecond_Now() - drainStart) > settings._drainTimeout) break;
+            update();
+            Threading::Sleep(1);
+        }
+        result._wallTime = Microsecond_Now() - replayStart;
+
+        for (auto i=live.begin(); i!=live.end(); ++i) {
+            retire(i->second);
+        }
+        manager.Flush();
+        popMetrics();
+
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            result._latencyMin = latencies.front();
+            result._latencyMax = latencies.back();
+            result._latencyMedian = latencies[latencies.size()/2];
+            result._latency95th = latencies[std::min(latencies.size()-1, latencies.size()*95/100)];
+        }
+        return result;
+    }
+
+    TraceReplayResults::TraceReplayResults()
+    {
+        _transactionCount = _immediateCount = _updateDataCount = _frameCount = _incompleteCount = 0;
+        _bytesRequested = 0;
+        _wallTime = 0;
+        _latencyMin = _latencyMedian = _latency95th = _latencyMax = 0;
+        _commandListCount = 0;
+        _bytesUploaded = 0;
+        _framePriorityStallTime = 0;
+        _cancelledSteps = 0;
+    }
+}
+
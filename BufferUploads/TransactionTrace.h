@@ -0,0 +1,141 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "IBufferUploads.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/TimeUtils.h"
+#include <vector>
+#include <string>
+
+namespace BufferUploads
+{
+        /////////////////////////////////////////////////
+
+        /// <summary>A single call into IManager, recorded in a TransactionTrace</summary>
+    class TransactionTraceEvent
+    {
+    public:
+        struct Type { enum Enum { Begin, UpdateData, End, AddRef, Immediate, Update, FramePriorityBarrier, SetPriority }; };
+        Type::Enum      _type;
+        Microsecond     _time;          ///< time since the start of the trace
+        TransactionID   _id;            ///< (Begin, UpdateData, End, AddRef & SetPriority only)
+        TransactionOptions::BitField _flags;
+        BufferDesc      _desc;          ///< (Begin & Immediate only)
+        size_t          _dataSize;      ///< bytes of data provided (0 for no data)
+        PartialResource _part;          ///< (UpdateData & Immediate only)
+        unsigned        _framesUntilRequired, _priority;    ///< (SetPriority only)
+
+        TransactionTraceEvent();
+    };
+
+        ///
+        /// <summary>A recording of the transactions made through an IManager</summary>
+        ///
+        /// Traces record the sequence and timing of calls, and the descs and sizes
+        /// of the data packets. They don't record the contents of the packets. So replaying
+        /// a trace reproduces the upload workload of a session, without needing the
+        /// original assets.
+        ///
+        /// Traces are saved as text, one event per line.
+        ///
+    class TransactionTrace
+    {
+    public:
+        std::vector<TransactionTraceEvent> _events;
+
+        std::string     Serialize() const;
+        void            Write(const char filename[]) const;
+
+        static TransactionTrace     Parse(const char* begin, const char* end);
+        static TransactionTrace     Load(const char filename[]);
+    };
+
+        /// <summary>Start recording transactions made through a manager</summary>
+        /// Only one trace can be recorded at a time for each manager.
+        /// Transaction_Begin() with a ResourceLocator isn't recorded, because
+        /// the locator can't be reproduced during replay.
+    buffer_upload_dll_export void               BeginTransactionTrace(IManager& manager);
+    buffer_upload_dll_export TransactionTrace   EndTransactionTrace(IManager& manager);
+
+        /////////////////////////////////////////////////
+
+    class TraceReplaySettings
+    {
+    public:
+        bool        _realTime;          ///< wait between events to match the timing in the trace
+        Microsecond _drainTimeout;      ///< how long to wait for outstanding transactions at the end
+
+        TraceReplaySettings() : _realTime(true), _drainTimeout(10 * 1000 * 1000) {}
+    };
+
+    class TraceReplayResults
+    {
+    public:
+        unsigned    _transactionCount;
+        unsigned    _immediateCount;
+        unsigned    _updateDataCount;
+        unsigned    _frameCount;
+        unsigned    _incompleteCount;       ///< transactions that never completed (or were ended before completing)
+        uint64      _bytesRequested;
+        Microsecond _wallTime;
+
+            //  latency from Transaction_Begin (or UpdateData) to IsCompleted() first returning true.
+            //  Completion is checked after each frame update, like a normal client would.
+        Microsecond _latencyMin, _latencyMedian, _latency95th, _latencyMax;
+
+            //  totals from IManager::PopMetrics()
+        unsigned    _commandListCount;
+        uint64      _bytesUploaded;
+        TimeMarker  _framePriorityStallTime;
+        unsigned    _cancelledSteps;            ///< steps dropped because the transaction ended before they were processed
+
+        TraceReplayResults();
+    };
+
+        /// <summary>Replays a trace through a manager</summary>
+        /// Makes the same calls to the manager as recorded in the trace, with synthesized
+        /// data packets of the same size. Each recorded "Update" event calls IManager::Update
+        /// with the given immediate context.
+    TraceReplayResults  ReplayTransactionTrace(
+        IManager& manager, RenderCore::IThreadContext& immediateContext,
+        const TransactionTrace& trace, const TraceReplaySettings& settings = TraceReplaySettings());
+
+        /////////////////////////////////////////////////
+
+        //
+        //  Used by the Manager to record calls while a trace is active
+        //
+    class TransactionTraceRecorder
+    {
+    public:
+        bool    IsActive() const { return _active; }
+
+        void    OnBegin(TransactionID id, const BufferDesc& desc, RawDataPacket* data, TransactionOptions::BitField flags);
+        void    OnUpdateData(TransactionID id, RawDataPacket* data, const PartialResource& part);
+        void    OnEnd(TransactionID id);
+        void    OnAddRef(TransactionID id);
+        void    OnImmediate(const BufferDesc& desc, RawDataPacket* data, const PartialResource& part);
+        void    OnUpdate();
+        void    OnFramePriorityBarrier();
+        void    OnSetPriority(TransactionID id, unsigned framesUntilRequired, unsigned priority);
+
+        void                Start();
+        TransactionTrace    Stop();
+
+        TransactionTraceRecorder();
+        ~TransactionTraceRecorder();
+    private:
+        Threading::Mutex    _lock;
+        volatile bool       _active;
+        Microsecond         _startTime;
+        TransactionTrace    _trace;
+
+        void    Push(TransactionTraceEvent&& evnt);
+    };
+}
+
@@ -0,0 +1,186 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../Core/Prefix.h"
+#include "../DataPacket.h"
+
+#if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+
+#include "../../ConsoleRig/Log.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Core/WinAPI/IncludeWindows.h"
+#include <assert.h>
+
+namespace BufferUploads
+{
+    class FileDataSource : public RawDataPacket
+    {
+    public:
+        virtual void*                           GetData             (unsigned mipIndex, unsigned arrayIndex);
+        virtual size_t                          GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const;
+        virtual std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const;
+        virtual bool                            IsDataReady         () const;
+        virtual bool                            HasFailed           () const;
+
+        FileDataSource(const void* fileHandle, size_t offset, size_t dataSize);
+        virtual ~FileDataSource();
+
+    protected:
+        std::unique_ptr<uint8, PODAlignedDeletor>   _pkt;
+        HANDLE      _fileHandle;
+        HANDLE      _waitHandle;
+        OVERLAPPED  _overlappedStatus;
+        size_t      _dataSize;
+        bool        _readPending;
+        mutable bool _readFailed;
+
+        bool        CheckReadResult(bool wait) const;
+
+        static void CALLBACK OnReadCompleted(void* parameter, BOOLEAN timedOut);
+    };
+
+    void*                           FileDataSource::GetData             (unsigned mipIndex, unsigned arrayIndex)
+    {
+        if (mipIndex == 0) {
+                //  block until the read is finished (normally the assembly line
+                //  will wait for IsDataReady() before getting here)
+            if (_readFailed || !CheckReadResult(true)) {
+                return nullptr;
+            }
+            return _pkt.get();
+        }
+        return nullptr;
+    }
+
+    size_t                          FileDataSource::GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return _dataSize;
+    }
+
+    std::pair<unsigned,unsigned>    FileDataSource::GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return Internal::FileDataSource_GetRowAndSlicePitch(_dataSize);
+    }
+
+    bool                            FileDataSource::IsDataReady         () const
+    {
+        if (_readFailed) return false;
+        if (_readPending && !HasOverlappedIoCompleted(&_overlappedStatus)) return false;
+        return CheckReadResult(false);
+    }
+
+    bool                            FileDataSource::HasFailed           () const
+    {
+        if (!_readFailed && _readPending && HasOverlappedIoCompleted(&_overlappedStatus)) {
+            CheckReadResult(false);
+        }
+        return _readFailed;
+    }
+
+    bool                            FileDataSource::CheckReadResult     (bool wait) const
+    {
+            //  A completed read can still have failed, or returned less than we asked
+            //  for (eg, reading past the end of the file). Record it as a failure, so
+            //  the packet is never reported as ready with garbage in it.
+        if (_readPending) {
+            DWORD bytesRead = 0;
+            auto result = GetOverlappedResult(_fileHandle, const_cast<OVERLAPPED*>(&_overlappedStatus), &bytesRead, wait ? TRUE : FALSE);
+            auto error = result ? DWORD(ERROR_SUCCESS) : GetLastError();
+            if (error == ERROR_IO_INCOMPLETE) {
+                return false;
+            }
+            if (!result || size_t(bytesRead) != _dataSize) {
+                LogWarning << "Read failed in FileDataSource (" << bytesRead << " of " << _dataSize << " bytes at offset " << _overlappedStatus.Offset << ", error " << error << ")";
+                _readFailed = true;
+            }
+        }
+        return !_readFailed;
+    }
+
+    void CALLBACK FileDataSource::OnReadCompleted(void*, BOOLEAN)
+    {
+        Internal::FileDataSource_OnReadCompleted();
+    }
+
+    FileDataSource::FileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
+    {
+        assert(dataSize);
+        assert(fileHandle != INVALID_HANDLE_VALUE);
+
+            //  duplicate the file handle so we get our own reference count on this
+            //  file object.
+        HANDLE duplicatedFileHandle;
+        ::DuplicateHandle(
+            GetCurrentProcess(), (HANDLE)fileHandle, GetCurrentProcess(),
+            &duplicatedFileHandle, 0, FALSE, DUPLICATE_SAME_ACCESS);
+
+            // start the read operation immediately (it will happen asynchronously)
+            //
+            //      We'll be reading into a temporary buffer, and then copying that into
+            //      the staging texture. That's a little bit redundant. Ideally we'd allocate
+            //      the staging texture first, and then copy into that from here.
+            //
+            //      The event in the OVERLAPPED structure is signalled when the read finishes.
+            //      We register a wait on it, so the assembly line is woken by a callback
+            //      (rather than polling HasOverlappedIoCompleted).
+        _pkt.reset((uint8*)XlMemAlign(dataSize, 16));
+        _fileHandle = duplicatedFileHandle;
+        _waitHandle = INVALID_HANDLE_VALUE;
+        _dataSize = dataSize;
+        _readPending = false;
+        _readFailed = false;
+
+        XlSetMemory(&_overlappedStatus, 0, sizeof(_overlappedStatus));
+        _overlappedStatus.Offset = (DWORD)offset;
+        _overlappedStatus.OffsetHigh = (DWORD)(uint64(offset)>>32);
+        _overlappedStatus.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+
+        auto result = ReadFile(
+            duplicatedFileHandle, _pkt.get(), (DWORD)dataSize,
+            nullptr, &_overlappedStatus);
+        auto error = result ? DWORD(ERROR_SUCCESS) : GetLastError();
+        if (result || error == ERROR_IO_PENDING) {
+            _readPending = true;
+            if (_overlappedStatus.hEvent) {
+                RegisterWaitForSingleObject(
+                    &_waitHandle, _overlappedStatus.hEvent, &OnReadCompleted, nullptr,
+                    INFINITE, WT_EXECUTEONLYONCE|WT_EXECUTEINWAITTHREAD);
+            }
+        } else {
+                //  The read didn't start at all (and no completion callback will come).
+                //  Nothing is waiting on this packet yet, so we just record the failure.
+            LogWarning << "ReadFile failed in FileDataSource (error " << error << ")";
+            _readFailed = true;
+        }
+    }
+
+    FileDataSource::~FileDataSource()
+    {
+        if (_readPending && !HasOverlappedIoCompleted(&_overlappedStatus)) {
+                //  we can't release the buffer while the read is still writing to it
+            CancelIoEx(_fileHandle, &_overlappedStatus);
+            DWORD bytesRead = 0;
+            GetOverlappedResult(_fileHandle, &_overlappedStatus, &bytesRead, TRUE);
+        }
+        if (_waitHandle != INVALID_HANDLE_VALUE) {
+            UnregisterWaitEx(_waitHandle, INVALID_HANDLE_VALUE);
+        }
+        if (_overlappedStatus.hEvent) {
+            CloseHandle(_overlappedStatus.hEvent);
+        }
+        if (_fileHandle && _fileHandle!=INVALID_HANDLE_VALUE) {
+            CloseHandle(_fileHandle);
+        }
+    }
+
+    intrusive_ptr<RawDataPacket> CreateFileDataSource(const void* fileHandle, size_t offset, size_t dataSize)
+    {
+        return make_intrusive<FileDataSource>(fileHandle, offset, dataSize);
+    }
+}
+
+#endif
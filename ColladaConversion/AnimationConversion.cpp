@@ -26,22 +26,20 @@ namespace RenderCore { namespace ColladaConversion
 {
     using ::Assets::Exceptions::FormatError;
 
-    static std::unique_ptr<float[]>         AsFloats(const COLLADAFW::FloatOrDoubleArray& input)
+    static std::vector<float>               AsFloatVector(const COLLADAFW::FloatOrDoubleArray& input)
     {
         size_t count = input.getValuesCount();
         if (input.getType() == COLLADAFW::FloatOrDoubleArray::DATA_TYPE_DOUBLE) {
-            std::unique_ptr<float[]> result = std::make_unique<float[]>(count);
+            std::vector<float> result(count);
             for (unsigned c=0; c<count; ++c) 
                 result[c] = float((*input.getDoubleValues())[c]);
             return result;
         } else if (input.getType() == COLLADAFW::FloatOrDoubleArray::DATA_TYPE_FLOAT) {
-            std::unique_ptr<float[]> result = std::make_unique<float[]>(count);
-            for (unsigned c=0; c<count; ++c) 
-                result[c] = (*input.getFloatValues())[c];
-            return result;
+            auto* values = input.getFloatValues();
+            return std::vector<float>(values->getData(), values->getData() + count);
         }
 
-        return nullptr;
+        return std::vector<float>();
     }
 
     /*static Float4x4 AsFloat4x4(const double* inputValues)
@@ -85,7 +83,17 @@ namespace RenderCore { namespace ColladaConversion
         return nullptr;
     }*/
 
-    Assets::RawAnimationCurve      Convert(const COLLADAFW::Animation& animation)
+    class AnimationCurveSource::Pimpl
+    {
+    public:
+        Assets::RawAnimationCurve::InterpolationType    _interpolationType;
+        size_t                                          _keyCount;
+        size_t                                          _outDimension;
+        std::vector<float>  _inputValues, _outputValues;
+        std::vector<float>  _inTangentValues, _outTangentValues;
+    };
+
+    AnimationCurveSource::AnimationCurveSource(const COLLADAFW::Animation& animation)
     {
         using namespace COLLADAFW;
         if (animation.getAnimationType() != Animation::ANIMATION_CURVE) {
@@ -97,38 +105,58 @@ namespace RenderCore { namespace ColladaConversion
             ThrowException(FormatError("Input physical dimension for animation is not \"time\" in animation (%s). Only time animations are supported.", animation.getName().c_str()));
         }
 
-        Assets::RawAnimationCurve::InterpolationType interpolationType = Assets::RawAnimationCurve::Linear;
+        auto pimpl = std::make_unique<Pimpl>();
         switch (curve->getInterpolationType()) {
-        case AnimationCurve::INTERPOLATION_LINEAR:      interpolationType = Assets::RawAnimationCurve::Linear;  break;
-        case AnimationCurve::INTERPOLATION_BEZIER:      interpolationType = Assets::RawAnimationCurve::Bezier;  break;
-        case AnimationCurve::INTERPOLATION_HERMITE:     interpolationType = Assets::RawAnimationCurve::Hermite; break;
+        case AnimationCurve::INTERPOLATION_LINEAR:      pimpl->_interpolationType = Assets::RawAnimationCurve::Linear;  break;
+        case AnimationCurve::INTERPOLATION_BEZIER:      pimpl->_interpolationType = Assets::RawAnimationCurve::Bezier;  break;
+        case AnimationCurve::INTERPOLATION_HERMITE:     pimpl->_interpolationType = Assets::RawAnimationCurve::Hermite; break;
         default: ThrowException(FormatError("Interpolation type for animation (%s) is not linear, bezier or hermite. Only these interpolation types are currently supported.", animation.getName().c_str()));
         }
 
-        size_t keyCount = curve->getKeyCount();
-        if (!keyCount) {
+        pimpl->_keyCount = curve->getKeyCount();
+        if (!pimpl->_keyCount) {
             ThrowException(FormatError("Zero key count in animation (%s). Invalid input data.", animation.getName().c_str()));
         }
 
+        pimpl->_outDimension = curve->getOutDimension();
+        if (pimpl->_outDimension != 1 && pimpl->_outDimension != 3 && pimpl->_outDimension != 4 && pimpl->_outDimension != 16) {
+            ThrowException(FormatError("Out dimension is animation (%s) is invalid (%i). Expected 1, 3, 4 or 16.", animation.getName().c_str(), pimpl->_outDimension));
+        }
+
+        assert(curve->getInputValues().getValuesCount() == pimpl->_keyCount);
+        pimpl->_inputValues         = AsFloatVector(curve->getInputValues());
+        pimpl->_outputValues        = AsFloatVector(curve->getOutputValues());
+        pimpl->_inTangentValues     = AsFloatVector(curve->getInTangentValues());
+        pimpl->_outTangentValues    = AsFloatVector(curve->getOutTangentValues());
+
+        _pimpl = std::move(pimpl);
+    }
+
+    AnimationCurveSource::~AnimationCurveSource() {}
+
+    Assets::RawAnimationCurve      Convert(const AnimationCurveSource& source)
+    {
+        const auto& src = *source._pimpl;
+
         using namespace Metal;
         NativeFormat::Enum positionFormat    = NativeFormat::Unknown;
         NativeFormat::Enum inTangentFormat   = NativeFormat::Unknown;
         NativeFormat::Enum outTangentFormat  = NativeFormat::Unknown;
             
-        size_t outDimension = curve->getOutDimension();
+        size_t keyCount = src._keyCount;
+        size_t outDimension = src._outDimension;
         switch (outDimension) {
         case 1:     positionFormat = NativeFormat::R32_FLOAT; break;
         case 3:     positionFormat = NativeFormat::R32G32B32_FLOAT; break;
         case 4:     positionFormat = NativeFormat::R32G32B32A32_FLOAT; break;
         case 16:    positionFormat = NativeFormat::Matrix4x4; break;
-        default:    ThrowException(FormatError("Out dimension is animation (%s) is invalid (%i). Expected 1, 3, 4 or 16.", animation.getName().c_str(), outDimension));
         }
 
-        if (!curve->getInTangentValues().empty()) {
+        if (!src._inTangentValues.empty()) {
             inTangentFormat = positionFormat;
         }
 
-        if (!curve->getOutTangentValues().empty()) {
+        if (!src._outTangentValues.empty()) {
             outTangentFormat = positionFormat;
         }
 
@@ -138,8 +166,8 @@ namespace RenderCore { namespace ColladaConversion
 
             //
             //      We want the position and tangent values to be stored interleaved in the same buffer
-            //      So let's build that buffer. Note that we will always use floats here... (so it may
-            //      require conversion if the input collada data is not in floats)
+            //      So let's build that buffer. Note that we will always use floats here... (the
+            //      input was converted to floats when we copied it from the collada data)
             //
             //      Note that if we need to transpose the matrix input, then it must be done here!
             //
@@ -149,63 +177,40 @@ namespace RenderCore { namespace ColladaConversion
         for (unsigned c=0; c<keyCount; ++c) {
             uint8* destination = PtrAdd(interleavedData.get(), c*elementSize);
 
-            if (curve->getOutputValues().getType() == FloatOrDoubleArray::DATA_TYPE_FLOAT) {
+            if (!src._outputValues.empty()) {
                 std::copy(
-                    &(*curve->getOutputValues().getFloatValues())[c*outDimension],
-                    &(*curve->getOutputValues().getFloatValues())[(c+1)*outDimension],
-                    (float*)destination);
-            } else if (curve->getOutputValues().getType() == FloatOrDoubleArray::DATA_TYPE_DOUBLE) {
-                std::copy(
-                    &(*curve->getOutputValues().getDoubleValues())[c*outDimension],
-                    &(*curve->getOutputValues().getDoubleValues())[(c+1)*outDimension],
+                    &src._outputValues[c*outDimension], &src._outputValues[c*outDimension] + outDimension,
                     (float*)destination);
             }
 
             if (inTangentFormat != NativeFormat::Unknown) {
                 uint8* inTangentDestination = PtrAdd(destination, positionSize);
-
-                if (curve->getInTangentValues().getType() == FloatOrDoubleArray::DATA_TYPE_FLOAT) {
-                    std::copy(
-                        &(*curve->getInTangentValues().getFloatValues())[c*outDimension],
-                        &(*curve->getInTangentValues().getFloatValues())[(c+1)*outDimension],
-                        (float*)inTangentDestination);
-                } else if (curve->getInTangentValues().getType() == FloatOrDoubleArray::DATA_TYPE_DOUBLE) {
-                    std::copy(
-                        &(*curve->getInTangentValues().getDoubleValues())[c*outDimension],
-                        &(*curve->getInTangentValues().getDoubleValues())[(c+1)*outDimension],
-                        (float*)inTangentDestination);
-                }
+                std::copy(
+                    &src._inTangentValues[c*outDimension], &src._inTangentValues[c*outDimension] + outDimension,
+                    (float*)inTangentDestination);
             }
 
             if (outTangentFormat != NativeFormat::Unknown) {
                 uint8* outTangentDestination = PtrAdd(destination, positionSize + inTangentSize);
-
-                if (curve->getOutTangentValues().getType() == FloatOrDoubleArray::DATA_TYPE_FLOAT) {
-                    std::copy(
-                        &(*curve->getOutTangentValues().getFloatValues())[c*outDimension],
-                        &(*curve->getOutTangentValues().getFloatValues())[(c+1)*outDimension],
-                        (float*)outTangentDestination);
-                } else if (curve->getOutTangentValues().getType() == FloatOrDoubleArray::DATA_TYPE_DOUBLE) {
-                    std::copy(
-                        &(*curve->getOutTangentValues().getDoubleValues())[c*outDimension],
-                        &(*curve->getOutTangentValues().getDoubleValues())[(c+1)*outDimension],
-                        (float*)outTangentDestination);
-                }
+                std::copy(
+                    &src._outTangentValues[c*outDimension], &src._outTangentValues[c*outDimension] + outDimension,
+                    (float*)outTangentDestination);
             }
         }
 
             //      Record all of the time markers and position values (for each key in the input)
 
-        assert(curve->getInputValues().getValuesCount() == keyCount);
         std::unique_ptr<float[], Serialization::BlockSerializerDeleter<float[]>> timeMarkers;
-        timeMarkers.reset(AsFloats(curve->getInputValues()).release());
+        if (!src._inputValues.empty()) {
+            timeMarkers.reset(new float[src._inputValues.size()]);
+            std::copy(src._inputValues.cbegin(), src._inputValues.cend(), timeMarkers.get());
+        }
 
         return Assets::RawAnimationCurve(
             keyCount, std::move(timeMarkers), std::move(interleavedData), 
-            elementSize, interpolationType,
+            elementSize, src._interpolationType,
             positionFormat, inTangentFormat, outTangentFormat);
     }
 
-
 }}
 
@@ -21,6 +21,7 @@
 namespace RenderCore { namespace ColladaConversion
 {
     bool ImportCameras = true;
+    unsigned ConversionThreadCount = 0;
 
     HashedColladaUniqueId AsHashedColladaUniqueId(const COLLADAFW::UniqueId& uniqueId)
     {
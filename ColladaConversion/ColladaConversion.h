@@ -12,6 +12,7 @@
 #include "../Math/Vector.h"
 #include "../Utility/Mixins.h"
 #include "../RenderCore/Metal/InputLayout.h"
+#include <memory>
 
 namespace COLLADAFW
 {
@@ -54,6 +55,11 @@ namespace RenderCore { namespace ColladaConversion
 
     extern bool ImportCameras;
 
+        /// Number of threads used when converting geometry, animation curves and skin controllers
+        /// (0 means one per hardware thread).
+        /// The output doesn't depend on this; it's mostly useful for testing and profiling.
+    extern unsigned ConversionThreadCount;
+
     void AddToBoundingBox(  std::pair<Float3, Float3>& boundingBox,
                             const Float3& localPosition, const Float4x4& localToWorld);
     void AddToBoundingBox(  std::pair<Float3, Float3>& boundingBox,
@@ -64,7 +70,23 @@ namespace RenderCore { namespace ColladaConversion
 
     Metal::InputElementDesc         FindPositionElement(const Metal::InputElementDesc elements[], size_t elementCount);
 
-    Assets::RawAnimationCurve      Convert(const COLLADAFW::Animation& animation);
+        /// <summary>Copy of the key data in a COLLADAFW::Animation</summary>
+        /// Like GeometrySource, this lets the conversion happen after the loader
+        /// callback has returned (and the framework object has been destroyed).
+    class AnimationCurveSource : noncopyable
+    {
+    public:
+        AnimationCurveSource(const COLLADAFW::Animation& animation);
+        ~AnimationCurveSource();
+
+        class Pimpl;
+    private:
+        std::unique_ptr<Pimpl> _pimpl;
+
+        friend Assets::RawAnimationCurve Convert(const AnimationCurveSource& source);
+    };
+
+    Assets::RawAnimationCurve      Convert(const AnimationCurveSource& source);
 
 }}
 
@@ -14,6 +14,8 @@
 #include "../RenderCore/Metal/InputLayout.h"
 #include "../Assets/BlockSerializer.h"
 #include "../ConsoleRig/OutputStream.h"
+#include "../Utility/Threading/ParallelFor.h"
+#include <exception>
 
 #pragma warning(push)
 #pragma warning(disable:4201)       // nonstandard extension used : nameless struct/union
@@ -712,7 +714,25 @@ namespace RenderCore { namespace ColladaConversion
         return ~unsigned(0x0);
     }
 
-    void NascentModelCommandStream::InstantiateControllers(const COLLADAFW::Node& node, const TableOfObjects& accessableObjects, TableOfObjects& destinationForNewObjects)
+    class NascentModelCommandStream::SkinBindingJob
+    {
+    public:
+        const COLLADAFW::Node*                              _node;
+        const COLLADAFW::InstanceController*                _instance;
+        const UnboundSkinControllerAndAttachedSkeleton*     _controllerAndSkeleton;
+        const UnboundSkinController*                        _controller;    // (null if the controller is missing)
+        const NascentRawGeometry*                           _source;        // (null if the source isn't a geometry)
+
+        SkinBindingJob( const COLLADAFW::Node& node, const COLLADAFW::InstanceController& instance,
+                        const UnboundSkinControllerAndAttachedSkeleton& controllerAndSkeleton,
+                        const UnboundSkinController* controller, const NascentRawGeometry* source)
+        :   _node(&node), _instance(&instance), _controllerAndSkeleton(&controllerAndSkeleton)
+        ,   _controller(controller), _source(source) {}
+    };
+
+    void NascentModelCommandStream::InstantiateControllers(
+        const COLLADAFW::Node* const rootNodes[], size_t rootNodeCount,
+        const TableOfObjects& accessableObjects, TableOfObjects& destinationForNewObjects)
     {
             //
             //      This is usually a second pass through the node hierarchy (after PushNode)
@@ -723,16 +743,82 @@ namespace RenderCore { namespace ColladaConversion
             //      joint nodes from the skeleton (which we can't be sure has happened until after PushNode
             //      has gone through the entire tree.
             //
-        using namespace COLLADAFW;
+            //      Binding a skin controller only reads from the table of objects, and can be expensive
+            //      for large meshes. So we find all of the instanced controllers first, bind them in
+            //      parallel, and then add the results to the table in node order. The output is the 
+            //      same as binding them one at a time (including the object ids, warnings and errors).
+            //
+        std::vector<SkinBindingJob> jobs;
+        for (size_t c=0; c<rootNodeCount; ++c) {
+            CollectSkinBindingJobs(*rootNodes[c], accessableObjects, jobs);
+        }
 
-        std::vector<std::string> elementsToBeSkinned;
-        elementsToBeSkinned.push_back("POSITION");
-        if (SkinNormals) {
-            elementsToBeSkinned.push_back("NORMAL");
+        auto jobCount = unsigned(jobs.size());
+        std::vector<std::unique_ptr<NascentBoundSkinnedGeometry>> results(jobCount);
+        std::vector<std::exception_ptr> errors(jobCount);
+        std::vector<uint8> expandedWeightStride(jobCount, 0);  // (not vector<bool>, because jobs write to it concurrently)
+
+        Threading::ParallelFor(
+            ConversionThreadCount, jobCount,
+            [&](unsigned j) {
+                if (!jobs[j]._controller || !jobs[j]._source) return;
+                bool expanded = false;
+                TRY {
+                    results[j] = std::make_unique<NascentBoundSkinnedGeometry>(BindSkinController(jobs[j], expanded));
+                } CATCH (...) {
+                    errors[j] = std::current_exception();
+                } CATCH_END
+                expandedWeightStride[j] = expanded;
+            });
+
+            //  Merge in the original order. The first error stops the merge, just as it
+            //  would have stopped the node traversal.
+        for (unsigned j=0; j<jobCount; ++j) {
+            const auto& job = jobs[j];
+            if (!job._controller) {
+                Warning("Warning -- skin controller with attached skeleton points to invalid skin controller in node (%s)\n", GetNodeStringID(*job._node).c_str());
+                continue;
+            }
+
+            if (!job._source) {
+                Warning("Warning -- skin controller attached to bad source object in node (%s). Note that skin controllers must be attached directly to geometry. We don't support cascading controllers.\n", GetNodeStringID(*job._node).c_str());
+                continue;
+            }
+
+            if (expandedWeightStride[j]) {
+                Warning("Warning -- vertex buffer had to be expanded for vertex alignment restrictions in node (%s). This will leave some wasted space in the vertex buffer. This can be caused when using skinning when only 1 weight is really required.\n", GetNodeStringID(*job._node).c_str());
+            }
+
+            if (errors[j]) {
+                std::rethrow_exception(errors[j]);
+            }
+
+            std::tuple<std::string, std::string, COLLADAFW::UniqueId> desc = 
+                accessableObjects.GetDesc<UnboundSkinController>(job._controllerAndSkeleton->_unboundControllerId);
+            ObjectId finalObjectTableId = destinationForNewObjects.Add(
+                std::get<0>(desc), std::get<1>(desc), std::get<2>(desc),
+                std::move(*results[j]));
+                                
+                //
+                //  Have to build the material bindings, as well..
+                //
+            auto materials = BuildMaterialTable(
+                job._instance->getMaterialBindings(), job._source->_materials, accessableObjects);
+
+            SkinControllerInstance newInstance(finalObjectTableId, FindTransformationMachineOutput(AsHashedColladaUniqueId(job._node->getUniqueId())), std::move(materials), 0);
+            _skinControllerInstances.push_back(newInstance);
         }
+    }
+
+    void NascentModelCommandStream::CollectSkinBindingJobs(
+        const COLLADAFW::Node& node, const TableOfObjects& accessableObjects,
+        std::vector<SkinBindingJob>& jobs)
+    {
+        using namespace COLLADAFW;
 
         for (size_t instanceController=0; instanceController<node.getInstanceControllers().getCount(); ++instanceController) {
-            const UniqueId& id = node.getInstanceControllers()[instanceController]->getInstanciatedObjectId();
+            const InstanceController* instance = node.getInstanceControllers()[instanceController];
+            const UniqueId& id = instance->getInstanciatedObjectId();
             const UnboundSkinControllerAndAttachedSkeleton* controllerAndSkeleton = nullptr;
 
             ObjectId tableId = accessableObjects.GetObjectId<UnboundSkinControllerAndAttachedSkeleton>(id);
@@ -744,6 +830,7 @@ namespace RenderCore { namespace ColladaConversion
                 const UnboundSkinController* controller = 
                     accessableObjects.GetFromObjectId<UnboundSkinController>(
                         controllerAndSkeleton->_unboundControllerId);
+                const NascentRawGeometry* source = nullptr;
                 if (controller) {
 
                         //
@@ -753,7 +840,6 @@ namespace RenderCore { namespace ColladaConversion
                         //      combining skinning and morph targets on the same geometry.
                         //
 
-                    const NascentRawGeometry* source = nullptr;
                     ObjectId sourceTableId = accessableObjects.GetObjectId<NascentRawGeometry>(
                         controllerAndSkeleton->_source.AsColladaId());
                     if (sourceTableId != ObjectId_Invalid) {
@@ -772,376 +858,380 @@ namespace RenderCore { namespace ColladaConversion
                             }
                         }
                     }
-                    if (source) {
-
-                            //
-                            //      Our instantiation of this geometry needs to be slightly different
-                            //      (but still similar) to the basic raw geometry case.
-                            //
-                            //      Basic geometry:
-                            //          vertex buffer
-                            //          index buffer
-                            //          input assembly setup
-                            //          draw calls
-                            //
-                            //      Skinned Geometry:
-                            //              (this part is mostly the same, except we've reordered the
-                            //              vertex buffers, and removed the part of the vertex buffer 
-                            //              that will be animated)
-                            //          unanimated vertex buffer
-                            //          index buffer
-                            //          input assembly setup (final draw calls)
-                            //          draw calls (final draw calls)
-                            //
-                            //              (this part is new)
-                            //          animated vertex buffer
-                            //          input assembly setup (skinning calculation pass)
-                            //          draw calls (skinning calculation pass)
-                            //
-                            //      Note that we need to massage the vertex buffers slightly. So the
-                            //      raw geometry input must be in a format that allows us to read from
-                            //      the vertex and index buffers.
-                            //
-                            
-                        size_t unifiedVertexCount = source->_unifiedVertexIndexToPositionIndex.size();
+                }
 
-                        std::vector<std::pair<uint16,uint32>> unifiedVertexIndexToBucketIndex;
-                        unifiedVertexIndexToBucketIndex.reserve(unifiedVertexCount);
+                jobs.push_back(SkinBindingJob(node, *instance, *controllerAndSkeleton, controller, source));
+            }
+        }
+            
+        const NodePointerArray& childNodes = node.getChildNodes();
+        for (size_t c=0; c<childNodes.getCount(); ++c) {
+            CollectSkinBindingJobs(*childNodes[c], accessableObjects, jobs);
+        }
+    }
 
-                        for (uint16 c=0; c<unifiedVertexCount; ++c) {
-                            uint32 positionIndex = source->_unifiedVertexIndexToPositionIndex[c];
-                            uint32 bucketIndex   = controller->_positionIndexToBucketIndex[positionIndex];
-                            unifiedVertexIndexToBucketIndex.push_back(std::make_pair(c, bucketIndex));
-                        }
+    NascentBoundSkinnedGeometry NascentModelCommandStream::BindSkinController(
+        const SkinBindingJob& job, bool& expandedWeightStride) const
+    {
+        const auto* controllerAndSkeleton = job._controllerAndSkeleton;
+        const auto* controller = job._controller;
+        const auto* source = job._source;
 
-                            //
-                            //      Resort by bucket index...
-                            //
+        std::vector<std::string> elementsToBeSkinned;
+        elementsToBeSkinned.push_back("POSITION");
+        if (SkinNormals) {
+            elementsToBeSkinned.push_back("NORMAL");
+        }
 
-                        std::sort(unifiedVertexIndexToBucketIndex.begin(), unifiedVertexIndexToBucketIndex.end(), CompareSecond<uint16, uint32>());
 
-                        std::vector<uint16> unifiedVertexReordering;       // unifiedVertexReordering[oldIndex] = newIndex;
-                        std::vector<uint16> newUnifiedVertexIndexToPositionIndex;
-                        unifiedVertexReordering.resize(unifiedVertexCount, (uint16)~uint16(0x0));
-                        newUnifiedVertexIndexToPositionIndex.resize(unifiedVertexCount, (uint16)~uint16(0x0));
+            //
+            //      Our instantiation of this geometry needs to be slightly different
+            //      (but still similar) to the basic raw geometry case.
+            //
+            //      Basic geometry:
+            //          vertex buffer
+            //          index buffer
+            //          input assembly setup
+            //          draw calls
+            //
+            //      Skinned Geometry:
+            //              (this part is mostly the same, except we've reordered the
+            //              vertex buffers, and removed the part of the vertex buffer 
+            //              that will be animated)
+            //          unanimated vertex buffer
+            //          index buffer
+            //          input assembly setup (final draw calls)
+            //          draw calls (final draw calls)
+            //
+            //              (this part is new)
+            //          animated vertex buffer
+            //          input assembly setup (skinning calculation pass)
+            //          draw calls (skinning calculation pass)
+            //
+            //      Note that we need to massage the vertex buffers slightly. So the
+            //      raw geometry input must be in a format that allows us to read from
+            //      the vertex and index buffers.
+            //
 
-                            //
-                            //      \todo --    it would better if we tried to maintain the vertex ordering within
-                            //                  the bucket. That is, the relative positions of vertices within the
-                            //                  bucket should be the same as the relative positions of those vertices
-                            //                  as they were in the original
-                            //
+        size_t unifiedVertexCount = source->_unifiedVertexIndexToPositionIndex.size();
 
-                        uint16 indexAccumulator = 0;
-                        const size_t bucketCount = dimof(((UnboundSkinController*)nullptr)->_bucket);
-                        uint16 bucketStart  [bucketCount];
-                        uint16 bucketEnd    [bucketCount];
-                        uint16 currentBucket = 0; bucketStart[0] = 0;
-                        for (auto i=unifiedVertexIndexToBucketIndex.cbegin(); i!=unifiedVertexIndexToBucketIndex.cend(); ++i) {
-                            if ((i->second >> 16)!=currentBucket) {
-                                bucketEnd[currentBucket] = indexAccumulator;
-                                bucketStart[++currentBucket] = indexAccumulator;
-                            }
-                            uint16 newIndex = indexAccumulator++;
-                            uint16 oldIndex = i->first;
-                            unifiedVertexReordering[oldIndex] = newIndex;
-                            newUnifiedVertexIndexToPositionIndex[newIndex] = (uint16)source->_unifiedVertexIndexToPositionIndex[oldIndex];
-                        }
-                        bucketEnd[currentBucket] = indexAccumulator;
-                        for (unsigned b=currentBucket+1; b<bucketCount; ++b) {
-                            bucketStart[b] = bucketEnd[b] = indexAccumulator;
-                        }
-                        if (indexAccumulator != unifiedVertexCount) {
-                            ThrowException(FormatError("Vertex count mismatch in node (%s)", GetNodeStringID(node).c_str()));
-                        }
+        std::vector<std::pair<uint16,uint32>> unifiedVertexIndexToBucketIndex;
+        unifiedVertexIndexToBucketIndex.reserve(unifiedVertexCount);
 
-                            //
-                            //      Move vertex data for vertex elements that will be skinned into a separate vertex buffer
-                            //      Note that we don't really know which elements will be skinned. We can assume that at
-                            //      least "POSITION" will be skinned. But actually this is defined by the particular
-                            //      shader. We could wait until binding with the material to make this decision...?
-                            //
-                        std::vector<Metal::InputElementDesc> unanimatedVertexLayout = source->_mainDrawInputAssembly._vertexInputLayout;
-                        std::vector<Metal::InputElementDesc> animatedVertexLayout;
-
-                        for (auto i=unanimatedVertexLayout.begin(); i!=unanimatedVertexLayout.end();) {
-                            const bool mustBeSkinned = 
-                                std::find_if(   elementsToBeSkinned.begin(), elementsToBeSkinned.end(), 
-                                                [&](const std::string& s){ return !XlCompareStringI(i->_semanticName.c_str(), s.c_str()); }) 
-                                        != elementsToBeSkinned.end();
-                            if (mustBeSkinned) {
-                                animatedVertexLayout.push_back(*i);
-                                i=unanimatedVertexLayout.erase(i);
-                            } else ++i;
-                        }
+        for (uint16 c=0; c<unifiedVertexCount; ++c) {
+            uint32 positionIndex = source->_unifiedVertexIndexToPositionIndex[c];
+            uint32 bucketIndex   = controller->_positionIndexToBucketIndex[positionIndex];
+            unifiedVertexIndexToBucketIndex.push_back(std::make_pair(c, bucketIndex));
+        }
 
-                        {
-                            unsigned elementOffset = 0;     // reset the _alignedByteOffset members in the vertex layout
-                            for (auto i=unanimatedVertexLayout.begin(); i!=unanimatedVertexLayout.end();++i) {
-                                i->_alignedByteOffset = elementOffset;
-                                elementOffset += Metal::BitsPerPixel(i->_nativeFormat)/8;
-                            }
-                        }
+            //
+            //      Resort by bucket index...
+            //
 
-                        unsigned unanimatedVertexStride  = CalculateVertexSize(AsPointer(unanimatedVertexLayout.begin()), AsPointer(unanimatedVertexLayout.end()));
-                        unsigned animatedVertexStride    = CalculateVertexSize(AsPointer(animatedVertexLayout.begin()), AsPointer(animatedVertexLayout.end()));
+        std::sort(unifiedVertexIndexToBucketIndex.begin(), unifiedVertexIndexToBucketIndex.end(), CompareSecond<uint16, uint32>());
 
-                        if (!animatedVertexStride) {
-                            ThrowException(FormatError("Could not find any animated vertex elements in skinning controller in node (%s). There must be a problem with vertex input semantics.", GetNodeStringID(node).c_str()));
-                        }
-                            
-                            //      Copy out those parts of the vertex buffer that are unanimated and animated
-                            //      (we also do the vertex reordering here)
-                        std::unique_ptr<uint8[]> unanimatedVertexBuffer  = std::make_unique<uint8[]>(unanimatedVertexStride*unifiedVertexCount);
-                        std::unique_ptr<uint8[]> animatedVertexBuffer    = std::make_unique<uint8[]>(animatedVertexStride*unifiedVertexCount);
-                        CopyVertexElements( unanimatedVertexBuffer.get(),                   unanimatedVertexStride, 
-                                            source->_vertices.get(),                        source->_mainDrawInputAssembly._vertexStride,
-                                            AsPointer(unanimatedVertexLayout.begin()),      AsPointer(unanimatedVertexLayout.end()),
-                                            AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.begin()), AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.end()),
-                                            AsPointer(unifiedVertexReordering.begin()),     AsPointer(unifiedVertexReordering.end()));
-
-                        CopyVertexElements( animatedVertexBuffer.get(),                     animatedVertexStride,
-                                            source->_vertices.get(),                        source->_mainDrawInputAssembly._vertexStride,
-                                            AsPointer(animatedVertexLayout.begin()),        AsPointer(animatedVertexLayout.end()),
-                                            AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.begin()), AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.end()),
-                                            AsPointer(unifiedVertexReordering.begin()),     AsPointer(unifiedVertexReordering.end()));
-
-                            //      We have to remap the index buffer, also.
-                        std::unique_ptr<uint8[]> newIndexBuffer = std::make_unique<uint8[]>(source->_indices.size());
-                        if (source->_indexFormat == Metal::NativeFormat::R16_UINT) {
-                            std::transform(
-                                (const uint16*)source->_indices.begin(), (const uint16*)source->_indices.end(),
-                                (uint16*)newIndexBuffer.get(),
-                                [&unifiedVertexReordering](uint16 inputIndex){return unifiedVertexReordering[inputIndex];});
-                        } else if (source->_indexFormat == Metal::NativeFormat::R8_UINT) {
-                            std::transform(
-                                (const uint8*)source->_indices.begin(), (const uint8*)source->_indices.end(),
-                                (uint8*)newIndexBuffer.get(),
-                                [&unifiedVertexReordering](uint8 inputIndex){return unifiedVertexReordering[inputIndex];});
-                        } else {
-                            ThrowException(FormatError("Unrecognised index format when instantiating skin controller in node (%s).", GetNodeStringID(node).c_str()));
-                        }
-                                
-                            //      We have to define the draw calls that perform the pre-skinning step
+        std::vector<uint16> unifiedVertexReordering;       // unifiedVertexReordering[oldIndex] = newIndex;
+        std::vector<uint16> newUnifiedVertexIndexToPositionIndex;
+        unifiedVertexReordering.resize(unifiedVertexCount, (uint16)~uint16(0x0));
+        newUnifiedVertexIndexToPositionIndex.resize(unifiedVertexCount, (uint16)~uint16(0x0));
 
-                        std::vector<NascentDrawCallDesc> preskinningDrawCalls;
-                        if (bucketEnd[0] > bucketStart[0]) {
-                            preskinningDrawCalls.push_back(NascentDrawCallDesc(
-                                ~unsigned(0x0), bucketEnd[0] - bucketStart[0], bucketStart[0],
-                                4, Metal::Topology::PointList));
-                        }
-                        if (bucketEnd[1] > bucketStart[1]) {
-                            preskinningDrawCalls.push_back(NascentDrawCallDesc(
-                                ~unsigned(0x0), bucketEnd[1] - bucketStart[1], bucketStart[1],
-                                2, Metal::Topology::PointList));
-                        }
-                        if (bucketEnd[2] > bucketStart[2]) {
-                            preskinningDrawCalls.push_back(NascentDrawCallDesc(
-                                ~unsigned(0x0), bucketEnd[2] - bucketStart[2], bucketStart[2],
-                                1, Metal::Topology::PointList));
-                        }
-
-                        assert(bucketEnd[2] <= unifiedVertexCount);
-
-                            //      Build the final vertex weights buffer (our weights are currently stored
-                            //      per vertex-position. So we need to expand to per-unified vertex -- blaggh!)
-                            //      This means the output weights vertex buffer is going to be larger than input ones combined.
+            //
+            //      \todo --    it would better if we tried to maintain the vertex ordering within
+            //                  the bucket. That is, the relative positions of vertices within the
+            //                  bucket should be the same as the relative positions of those vertices
+            //                  as they were in the original
+            //
 
-                        assert(newUnifiedVertexIndexToPositionIndex.size()==unifiedVertexCount);
-                        size_t destinationWeightVertexStride = 0;
-                        const std::vector<Metal::InputElementDesc>* finalWeightBufferFormat = nullptr;
+        uint16 indexAccumulator = 0;
+        const size_t bucketCount = dimof(((UnboundSkinController*)nullptr)->_bucket);
+        uint16 bucketStart  [bucketCount];
+        uint16 bucketEnd    [bucketCount];
+        uint16 currentBucket = 0; bucketStart[0] = 0;
+        for (auto i=unifiedVertexIndexToBucketIndex.cbegin(); i!=unifiedVertexIndexToBucketIndex.cend(); ++i) {
+            if ((i->second >> 16)!=currentBucket) {
+                bucketEnd[currentBucket] = indexAccumulator;
+                bucketStart[++currentBucket] = indexAccumulator;
+            }
+            uint16 newIndex = indexAccumulator++;
+            uint16 oldIndex = i->first;
+            unifiedVertexReordering[oldIndex] = newIndex;
+            newUnifiedVertexIndexToPositionIndex[newIndex] = (uint16)source->_unifiedVertexIndexToPositionIndex[oldIndex];
+        }
+        bucketEnd[currentBucket] = indexAccumulator;
+        for (unsigned b=currentBucket+1; b<bucketCount; ++b) {
+            bucketStart[b] = bucketEnd[b] = indexAccumulator;
+        }
+        if (indexAccumulator != unifiedVertexCount) {
+            ThrowException(FormatError("Vertex count mismatch in node (%s)", GetNodeStringID(*job._node).c_str()));
+        }
 
-                        unsigned bucketVertexSizes[bucketCount];
-                        for (unsigned b=0; b<bucketCount; ++b) {
-                            bucketVertexSizes[b] = CalculateVertexSize(     
-                                AsPointer(controller->_bucket[b]._vertexInputLayout.begin()), 
-                                AsPointer(controller->_bucket[b]._vertexInputLayout.end()));
+            //
+            //      Move vertex data for vertex elements that will be skinned into a separate vertex buffer
+            //      Note that we don't really know which elements will be skinned. We can assume that at
+            //      least "POSITION" will be skinned. But actually this is defined by the particular
+            //      shader. We could wait until binding with the material to make this decision...?
+            //
+        std::vector<Metal::InputElementDesc> unanimatedVertexLayout = source->_mainDrawInputAssembly._vertexInputLayout;
+        std::vector<Metal::InputElementDesc> animatedVertexLayout;
+
+        for (auto i=unanimatedVertexLayout.begin(); i!=unanimatedVertexLayout.end();) {
+            const bool mustBeSkinned = 
+                std::find_if(   elementsToBeSkinned.begin(), elementsToBeSkinned.end(), 
+                                [&](const std::string& s){ return !XlCompareStringI(i->_semanticName.c_str(), s.c_str()); }) 
+                        != elementsToBeSkinned.end();
+            if (mustBeSkinned) {
+                animatedVertexLayout.push_back(*i);
+                i=unanimatedVertexLayout.erase(i);
+            } else ++i;
+        }
 
-                            if (controller->_bucket[b]._vertexBufferSize) {
-                                if (bucketVertexSizes[b] > destinationWeightVertexStride) {
-                                    destinationWeightVertexStride = bucketVertexSizes[b];
-                                    finalWeightBufferFormat = &controller->_bucket[b]._vertexInputLayout;
-                                }
-                            }
-                        }
+        {
+            unsigned elementOffset = 0;     // reset the _alignedByteOffset members in the vertex layout
+            for (auto i=unanimatedVertexLayout.begin(); i!=unanimatedVertexLayout.end();++i) {
+                i->_alignedByteOffset = elementOffset;
+                elementOffset += Metal::BitsPerPixel(i->_nativeFormat)/8;
+            }
+        }
 
-                        unsigned alignedDestinationWeightVertexStride = (unsigned)std::max(destinationWeightVertexStride, size_t(4));
-                        if (alignedDestinationWeightVertexStride != destinationWeightVertexStride) {
-                            Warning("Warning -- vertex buffer had to be expanded for vertex alignment restrictions in node (%s). This will leave some wasted space in the vertex buffer. This can be caused when using skinning when only 1 weight is really required.\n", GetNodeStringID(node).c_str());
-                            destinationWeightVertexStride = alignedDestinationWeightVertexStride;
-                        }
+        unsigned unanimatedVertexStride  = CalculateVertexSize(AsPointer(unanimatedVertexLayout.begin()), AsPointer(unanimatedVertexLayout.end()));
+        unsigned animatedVertexStride    = CalculateVertexSize(AsPointer(animatedVertexLayout.begin()), AsPointer(animatedVertexLayout.end()));
 
-                        std::unique_ptr<uint8[]> skeletonBindingVertices;
-                        if (destinationWeightVertexStride && finalWeightBufferFormat) {
-                            skeletonBindingVertices = std::make_unique<uint8[]>(destinationWeightVertexStride*unifiedVertexCount);
-                            XlSetMemory(skeletonBindingVertices.get(), 0, destinationWeightVertexStride*unifiedVertexCount);
+        if (!animatedVertexStride) {
+            ThrowException(FormatError("Could not find any animated vertex elements in skinning controller in node (%s). There must be a problem with vertex input semantics.", GetNodeStringID(*job._node).c_str()));
+        }
 
-                            for (auto i=newUnifiedVertexIndexToPositionIndex.begin(); i!=newUnifiedVertexIndexToPositionIndex.end(); ++i) {
-                                const size_t destinationVertexIndex = i-newUnifiedVertexIndexToPositionIndex.begin();
-                                unsigned sourceVertexPositionIndex = *i;
-                                
-                                    //
-                                    //      We actually need to find the source position vertex from one of the buckets.
-                                    //      We can make a guess from the ordering, but it's safest to find it again
-                                    //      This lookup could get quite expensive for large meshes!
-                                    //
-                                for (unsigned b=0; b<bucketCount; ++b) {
-                                    auto i = std::find( controller->_bucket[b]._vertexBindings.begin(), 
-                                                        controller->_bucket[b]._vertexBindings.end(), 
-                                                        sourceVertexPositionIndex);
-                                    if (i!=controller->_bucket[b]._vertexBindings.end()) {
-
-                                            //
-                                            //      Note that sometimes we'll be expanding the vertex format in this process
-                                            //      If some buckets are using R8G8, and others are R8G8B8A8 (for example)
-                                            //      then they will all be expanded to the largest size
-                                            //
-
-                                        auto sourceVertexStride = bucketVertexSizes[b];
-                                        size_t sourceVertexInThisBucket = std::distance(controller->_bucket[b]._vertexBindings.begin(), i);
-                                        void* destinationVertex = PtrAdd(skeletonBindingVertices.get(), destinationVertexIndex*destinationWeightVertexStride);
-                                        assert((sourceVertexInThisBucket+1)*sourceVertexStride <= controller->_bucket[b]._vertexBufferSize);
-                                        const void* sourceVertex = PtrAdd(controller->_bucket[b]._vertexBufferData.get(), sourceVertexInThisBucket*sourceVertexStride);
-
-                                        if (sourceVertexStride == destinationWeightVertexStride) {
-                                            XlCopyMemory(destinationVertex, sourceVertex, sourceVertexStride);
-                                        } else {
-                                            const Metal::InputElementDesc* dstElement = AsPointer(finalWeightBufferFormat->cbegin());
-                                            for (   auto srcElement=controller->_bucket[b]._vertexInputLayout.cbegin(); 
-                                                    srcElement!=controller->_bucket[b]._vertexInputLayout.cend(); ++srcElement, ++dstElement) {
-                                                unsigned elementSize = std::min(Metal::BitsPerPixel(srcElement->_nativeFormat)/8, Metal::BitsPerPixel(dstElement->_nativeFormat)/8);
-                                                assert(PtrAdd(destinationVertex, dstElement->_alignedByteOffset+elementSize) <= PtrAdd(skeletonBindingVertices.get(), destinationWeightVertexStride*unifiedVertexCount));
-                                                assert(PtrAdd(sourceVertex, srcElement->_alignedByteOffset+elementSize) <= PtrAdd(controller->_bucket[b]._vertexBufferData.get(), controller->_bucket[b]._vertexBufferSize));
-                                                XlCopyMemory(   PtrAdd(destinationVertex, dstElement->_alignedByteOffset), 
-                                                                PtrAdd(sourceVertex, srcElement->_alignedByteOffset), 
-                                                                elementSize);   // (todo -- precalculate this min of element sizes)
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                        }
+            //      Copy out those parts of the vertex buffer that are unanimated and animated
+            //      (we also do the vertex reordering here)
+        std::unique_ptr<uint8[]> unanimatedVertexBuffer  = std::make_unique<uint8[]>(unanimatedVertexStride*unifiedVertexCount);
+        std::unique_ptr<uint8[]> animatedVertexBuffer    = std::make_unique<uint8[]>(animatedVertexStride*unifiedVertexCount);
+        CopyVertexElements( unanimatedVertexBuffer.get(),                   unanimatedVertexStride, 
+                            source->_vertices.get(),                        source->_mainDrawInputAssembly._vertexStride,
+                            AsPointer(unanimatedVertexLayout.begin()),      AsPointer(unanimatedVertexLayout.end()),
+                            AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.begin()), AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.end()),
+                            AsPointer(unifiedVertexReordering.begin()),     AsPointer(unifiedVertexReordering.end()));
+
+        CopyVertexElements( animatedVertexBuffer.get(),                     animatedVertexStride,
+                            source->_vertices.get(),                        source->_mainDrawInputAssembly._vertexStride,
+                            AsPointer(animatedVertexLayout.begin()),        AsPointer(animatedVertexLayout.end()),
+                            AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.begin()), AsPointer(source->_mainDrawInputAssembly._vertexInputLayout.end()),
+                            AsPointer(unifiedVertexReordering.begin()),     AsPointer(unifiedVertexReordering.end()));
+
+            //      We have to remap the index buffer, also.
+        std::unique_ptr<uint8[]> newIndexBuffer = std::make_unique<uint8[]>(source->_indices.size());
+        if (source->_indexFormat == Metal::NativeFormat::R16_UINT) {
+            std::transform(
+                (const uint16*)source->_indices.begin(), (const uint16*)source->_indices.end(),
+                (uint16*)newIndexBuffer.get(),
+                [&unifiedVertexReordering](uint16 inputIndex){return unifiedVertexReordering[inputIndex];});
+        } else if (source->_indexFormat == Metal::NativeFormat::R8_UINT) {
+            std::transform(
+                (const uint8*)source->_indices.begin(), (const uint8*)source->_indices.end(),
+                (uint8*)newIndexBuffer.get(),
+                [&unifiedVertexReordering](uint8 inputIndex){return unifiedVertexReordering[inputIndex];});
+        } else {
+            ThrowException(FormatError("Unrecognised index format when instantiating skin controller in node (%s).", GetNodeStringID(*job._node).c_str()));
+        }
 
-                            //  Double check that weights are normalized in the binding buffer
-                        #if 0 // defined(_DEBUG)
-
-                            {
-                                unsigned weightsOffset = 0;
-                                Metal::NativeFormat::Enum weightsFormat = Metal::NativeFormat::Unknown;
-                                for (auto i=finalWeightBufferFormat->cbegin(); i!=finalWeightBufferFormat->cend(); ++i) {
-                                    if (!XlCompareStringI(i->_semanticName.c_str(), "WEIGHTS") && i->_semanticIndex == 0) {
-                                        weightsOffset = i->_alignedByteOffset;
-                                        weightsFormat = i->_nativeFormat;
-                                        break;
-                                    }
-                                }
+            //      We have to define the draw calls that perform the pre-skinning step
 
-                                size_t stride = destinationWeightVertexStride;
-                                if (weightsFormat == Metal::NativeFormat::R8G8_UNORM) {
-                                    for (unsigned c=0; c<unifiedVertexCount; ++c) {
-                                        const void* p = PtrAdd(skeletonBindingVertices.get(), c*stride+weightsOffset);
-                                        unsigned char zero   = ((unsigned char*)p)[0];
-                                        unsigned char one    = ((unsigned char*)p)[1];
-                                        assert((zero+one) >= 0xfd);
-                                    }
-                                } else if (weightsFormat == Metal::NativeFormat::R8G8B8A8_UNORM) {
-                                    for (unsigned c=0; c<unifiedVertexCount; ++c) {
-                                        const void* p = PtrAdd(skeletonBindingVertices.get(), c*stride+weightsOffset);
-                                        unsigned char zero   = ((unsigned char*)p)[0];
-                                        unsigned char one    = ((unsigned char*)p)[1];
-                                        unsigned char two    = ((unsigned char*)p)[2];
-                                        unsigned char three  = ((unsigned char*)p)[3];
-                                        assert((zero+one+two+three) >= 0xfd);
-                                    }
-                                } else {
-                                    assert(weightsFormat == Metal::NativeFormat::R8_UNORM);
-                                }
-                            }
-                                
-                        #endif
-
-                            //      We need to map from from our joint indices to output matrix index
-                        const size_t jointCount = controllerAndSkeleton->_jointIds.size();
-                        std::unique_ptr<uint16[]> jointMatrices = std::make_unique<uint16[]>(jointCount);
-                        for (auto i = controllerAndSkeleton->_jointIds.cbegin(); i!=controllerAndSkeleton->_jointIds.cend(); ++i) {
-                            jointMatrices[std::distance(controllerAndSkeleton->_jointIds.cbegin(), i)] = 
-                                (uint16)FindTransformationMachineOutput(*i);
-                        }
+        std::vector<NascentDrawCallDesc> preskinningDrawCalls;
+        if (bucketEnd[0] > bucketStart[0]) {
+            preskinningDrawCalls.push_back(NascentDrawCallDesc(
+                ~unsigned(0x0), bucketEnd[0] - bucketStart[0], bucketStart[0],
+                4, Metal::Topology::PointList));
+        }
+        if (bucketEnd[1] > bucketStart[1]) {
+            preskinningDrawCalls.push_back(NascentDrawCallDesc(
+                ~unsigned(0x0), bucketEnd[1] - bucketStart[1], bucketStart[1],
+                2, Metal::Topology::PointList));
+        }
+        if (bucketEnd[2] > bucketStart[2]) {
+            preskinningDrawCalls.push_back(NascentDrawCallDesc(
+                ~unsigned(0x0), bucketEnd[2] - bucketStart[2], bucketStart[2],
+                1, Metal::Topology::PointList));
+        }
 
-                            //      Calculate the local space bounding box for the input vertex buffer
-                            //      (assuming the position will appear in the animated vertex buffer)
-                        auto boundingBox = InvalidBoundingBox();
-                        Metal::InputElementDesc positionDesc = FindPositionElement(
-                            AsPointer(animatedVertexLayout.begin()),
-                            animatedVertexLayout.size());
-                        if (positionDesc._nativeFormat != Metal::NativeFormat::Unknown) {
-                            AddToBoundingBox(
-                                boundingBox,
-                                animatedVertexBuffer.get(), animatedVertexStride, unifiedVertexCount,
-                                positionDesc, Identity<Float4x4>());
-                        }
+        assert(bucketEnd[2] <= unifiedVertexCount);
 
-                            //      Build the final "BoundSkinnedGeometry" object
-                        NascentBoundSkinnedGeometry result(
-                            DynamicArray<uint8>(std::move(unanimatedVertexBuffer), unanimatedVertexStride*unifiedVertexCount),
-                            DynamicArray<uint8>(std::move(animatedVertexBuffer), animatedVertexStride*unifiedVertexCount),
-                            DynamicArray<uint8>(std::move(skeletonBindingVertices), destinationWeightVertexStride*unifiedVertexCount),
-                            DynamicArray<uint8>(std::move(newIndexBuffer), source->_indices.size()));
+            //      Build the final vertex weights buffer (our weights are currently stored
+            //      per vertex-position. So we need to expand to per-unified vertex -- blaggh!)
+            //      This means the output weights vertex buffer is going to be larger than input ones combined.
 
-                        result._skeletonBindingVertexStride = (unsigned)destinationWeightVertexStride;
-                        result._animatedVertexBufferSize = (unsigned)(animatedVertexStride*unifiedVertexCount);
+        assert(newUnifiedVertexIndexToPositionIndex.size()==unifiedVertexCount);
+        size_t destinationWeightVertexStride = 0;
+        const std::vector<Metal::InputElementDesc>* finalWeightBufferFormat = nullptr;
 
-                        result._inverseBindMatrices = DynamicArray<Float4x4>::Copy(controller->_inverseBindMatrices);
-                        result._jointMatrices = DynamicArray<uint16>(std::move(jointMatrices), jointCount);
-                        result._bindShapeMatrix = controller->_bindShapeMatrix;
+        unsigned bucketVertexSizes[bucketCount];
+        for (unsigned b=0; b<bucketCount; ++b) {
+            bucketVertexSizes[b] = CalculateVertexSize(     
+                AsPointer(controller->_bucket[b]._vertexInputLayout.begin()), 
+                AsPointer(controller->_bucket[b]._vertexInputLayout.end()));
 
-                        result._mainDrawCalls = source->_mainDrawCalls;
-                        result._mainDrawUnanimatedIA._vertexStride = unanimatedVertexStride;
-                        result._mainDrawUnanimatedIA._vertexInputLayout = std::move(unanimatedVertexLayout);
-                        result._indexFormat = source->_indexFormat;
+            if (controller->_bucket[b]._vertexBufferSize) {
+                if (bucketVertexSizes[b] > destinationWeightVertexStride) {
+                    destinationWeightVertexStride = bucketVertexSizes[b];
+                    finalWeightBufferFormat = &controller->_bucket[b]._vertexInputLayout;
+                }
+            }
+        }
 
-                        result._mainDrawAnimatedIA._vertexStride = animatedVertexStride;
-                        result._mainDrawAnimatedIA._vertexInputLayout = std::move(animatedVertexLayout);
+        unsigned alignedDestinationWeightVertexStride = (unsigned)std::max(destinationWeightVertexStride, size_t(4));
+        if (alignedDestinationWeightVertexStride != destinationWeightVertexStride) {
+                // (warning is written by the caller, so warnings stay in node order)
+            expandedWeightStride = true;
+            destinationWeightVertexStride = alignedDestinationWeightVertexStride;
+        }
 
-                        result._preskinningDrawCalls = preskinningDrawCalls;
+        std::unique_ptr<uint8[]> skeletonBindingVertices;
+        if (destinationWeightVertexStride && finalWeightBufferFormat) {
+            skeletonBindingVertices = std::make_unique<uint8[]>(destinationWeightVertexStride*unifiedVertexCount);
+            XlSetMemory(skeletonBindingVertices.get(), 0, destinationWeightVertexStride*unifiedVertexCount);
+
+                //  Build a lookup from position index to the first entry in each bucket's
+                //  vertex bindings that refers to it. This gives the same result as searching
+                //  the bindings for every vertex, without the cost of that search.
+            std::vector<unsigned> bindingLookup[bucketCount];
+            for (unsigned b=0; b<bucketCount; ++b) {
+                const auto& bindings = controller->_bucket[b]._vertexBindings;
+                if (bindings.empty()) continue;
+                bindingLookup[b].resize(size_t(*std::max_element(bindings.cbegin(), bindings.cend()))+1, ~0u);
+                for (auto i=bindings.size(); i>0; --i) {
+                    bindingLookup[b][bindings[i-1]] = unsigned(i-1);
+                }
+            }
 
-                        if (finalWeightBufferFormat) {
-                            result._preskinningIA._vertexInputLayout = *finalWeightBufferFormat;
-                            result._preskinningIA._vertexStride = (unsigned)destinationWeightVertexStride;
-                        }
+            for (auto i=newUnifiedVertexIndexToPositionIndex.begin(); i!=newUnifiedVertexIndexToPositionIndex.end(); ++i) {
+                const size_t destinationVertexIndex = i-newUnifiedVertexIndexToPositionIndex.begin();
+                unsigned sourceVertexPositionIndex = *i;
 
-                        result._localBoundingBox = boundingBox;
+                    //
+                    //      We actually need to find the source position vertex from one of the buckets.
+                    //      We can make a guess from the ordering, but it's safest to find it again
+                    //
+                for (unsigned b=0; b<bucketCount; ++b) {
+                    if (sourceVertexPositionIndex < bindingLookup[b].size() && bindingLookup[b][sourceVertexPositionIndex] != ~0u) {
 
-                        std::tuple<std::string, std::string, COLLADAFW::UniqueId> desc = 
-                            accessableObjects.GetDesc<UnboundSkinController>(controllerAndSkeleton->_unboundControllerId);
-                        ObjectId finalObjectTableId = destinationForNewObjects.Add(
-                            std::get<0>(desc), std::get<1>(desc), std::get<2>(desc),
-                            std::move(result));
-                                
                             //
-                            //  Have to build the material bindings, as well..
+                            //      Note that sometimes we'll be expanding the vertex format in this process
+                            //      If some buckets are using R8G8, and others are R8G8B8A8 (for example)
+                            //      then they will all be expanded to the largest size
                             //
-                        auto materials = BuildMaterialTable(
-                            node.getInstanceControllers()[instanceController]->getMaterialBindings(), source->_materials, accessableObjects);
 
-                        SkinControllerInstance newInstance(finalObjectTableId, FindTransformationMachineOutput(AsHashedColladaUniqueId(node.getUniqueId())), std::move(materials), 0);
-                        _skinControllerInstances.push_back(newInstance);
+                        auto sourceVertexStride = bucketVertexSizes[b];
+                        size_t sourceVertexInThisBucket = bindingLookup[b][sourceVertexPositionIndex];
+                        void* destinationVertex = PtrAdd(skeletonBindingVertices.get(), destinationVertexIndex*destinationWeightVertexStride);
+                        assert((sourceVertexInThisBucket+1)*sourceVertexStride <= controller->_bucket[b]._vertexBufferSize);
+                        const void* sourceVertex = PtrAdd(controller->_bucket[b]._vertexBufferData.get(), sourceVertexInThisBucket*sourceVertexStride);
 
-                    } else {
-                        Warning("Warning -- skin controller attached to bad source object in node (%s). Note that skin controllers must be attached directly to geometry. We don't support cascading controllers.\n", GetNodeStringID(node).c_str());
+                        if (sourceVertexStride == destinationWeightVertexStride) {
+                            XlCopyMemory(destinationVertex, sourceVertex, sourceVertexStride);
+                        } else {
+                            const Metal::InputElementDesc* dstElement = AsPointer(finalWeightBufferFormat->cbegin());
+                            for (   auto srcElement=controller->_bucket[b]._vertexInputLayout.cbegin(); 
+                                    srcElement!=controller->_bucket[b]._vertexInputLayout.cend(); ++srcElement, ++dstElement) {
+                                unsigned elementSize = std::min(Metal::BitsPerPixel(srcElement->_nativeFormat)/8, Metal::BitsPerPixel(dstElement->_nativeFormat)/8);
+                                assert(PtrAdd(destinationVertex, dstElement->_alignedByteOffset+elementSize) <= PtrAdd(skeletonBindingVertices.get(), destinationWeightVertexStride*unifiedVertexCount));
+                                assert(PtrAdd(sourceVertex, srcElement->_alignedByteOffset+elementSize) <= PtrAdd(controller->_bucket[b]._vertexBufferData.get(), controller->_bucket[b]._vertexBufferSize));
+                                XlCopyMemory(   PtrAdd(destinationVertex, dstElement->_alignedByteOffset), 
+                                                PtrAdd(sourceVertex, srcElement->_alignedByteOffset), 
+                                                elementSize);   // (todo -- precalculate this min of element sizes)
+                            }
+                        }
                     }
+                }
+            }
+        }
 
-                } else {
-                    Warning("Warning -- skin controller with attached skeleton points to invalid skin controller in node (%s)\n", GetNodeStringID(node).c_str());
+            //  Double check that weights are normalized in the binding buffer
+        #if 0 // defined(_DEBUG)
+
+            {
+                unsigned weightsOffset = 0;
+                Metal::NativeFormat::Enum weightsFormat = Metal::NativeFormat::Unknown;
+                for (auto i=finalWeightBufferFormat->cbegin(); i!=finalWeightBufferFormat->cend(); ++i) {
+                    if (!XlCompareStringI(i->_semanticName.c_str(), "WEIGHTS") && i->_semanticIndex == 0) {
+                        weightsOffset = i->_alignedByteOffset;
+                        weightsFormat = i->_nativeFormat;
+                        break;
+                    }
                 }
 
+                size_t stride = destinationWeightVertexStride;
+                if (weightsFormat == Metal::NativeFormat::R8G8_UNORM) {
+                    for (unsigned c=0; c<unifiedVertexCount; ++c) {
+                        const void* p = PtrAdd(skeletonBindingVertices.get(), c*stride+weightsOffset);
+                        unsigned char zero   = ((unsigned char*)p)[0];
+                        unsigned char one    = ((unsigned char*)p)[1];
+                        assert((zero+one) >= 0xfd);
+                    }
+                } else if (weightsFormat == Metal::NativeFormat::R8G8B8A8_UNORM) {
+                    for (unsigned c=0; c<unifiedVertexCount; ++c) {
+                        const void* p = PtrAdd(skeletonBindingVertices.get(), c*stride+weightsOffset);
+                        unsigned char zero   = ((unsigned char*)p)[0];
+                        unsigned char one    = ((unsigned char*)p)[1];
+                        unsigned char two    = ((unsigned char*)p)[2];
+                        unsigned char three  = ((unsigned char*)p)[3];
+                        assert((zero+one+two+three) >= 0xfd);
+                    }
+                } else {
+                    assert(weightsFormat == Metal::NativeFormat::R8_UNORM);
+                }
             }
+
+        #endif
+
+            //      We need to map from from our joint indices to output matrix index
+        const size_t jointCount = controllerAndSkeleton->_jointIds.size();
+        std::unique_ptr<uint16[]> jointMatrices = std::make_unique<uint16[]>(jointCount);
+        for (auto i = controllerAndSkeleton->_jointIds.cbegin(); i!=controllerAndSkeleton->_jointIds.cend(); ++i) {
+            jointMatrices[std::distance(controllerAndSkeleton->_jointIds.cbegin(), i)] = 
+                (uint16)FindTransformationMachineOutput(*i);
         }
-            
-        const NodePointerArray& childNodes = node.getChildNodes();
-        for (size_t c=0; c<childNodes.getCount(); ++c) {
-            InstantiateControllers(*childNodes[c], accessableObjects, destinationForNewObjects);
+
+            //      Calculate the local space bounding box for the input vertex buffer
+            //      (assuming the position will appear in the animated vertex buffer)
+        auto boundingBox = InvalidBoundingBox();
+        Metal::InputElementDesc positionDesc = FindPositionElement(
+            AsPointer(animatedVertexLayout.begin()),
+            animatedVertexLayout.size());
+        if (positionDesc._nativeFormat != Metal::NativeFormat::Unknown) {
+            AddToBoundingBox(
+                boundingBox,
+                animatedVertexBuffer.get(), animatedVertexStride, unifiedVertexCount,
+                positionDesc, Identity<Float4x4>());
         }
+
+            //      Build the final "BoundSkinnedGeometry" object
+        NascentBoundSkinnedGeometry result(
+            DynamicArray<uint8>(std::move(unanimatedVertexBuffer), unanimatedVertexStride*unifiedVertexCount),
+            DynamicArray<uint8>(std::move(animatedVertexBuffer), animatedVertexStride*unifiedVertexCount),
+            DynamicArray<uint8>(std::move(skeletonBindingVertices), destinationWeightVertexStride*unifiedVertexCount),
+            DynamicArray<uint8>(std::move(newIndexBuffer), source->_indices.size()));
+
+        result._skeletonBindingVertexStride = (unsigned)destinationWeightVertexStride;
+        result._animatedVertexBufferSize = (unsigned)(animatedVertexStride*unifiedVertexCount);
+
+        result._inverseBindMatrices = DynamicArray<Float4x4>::Copy(controller->_inverseBindMatrices);
+        result._jointMatrices = DynamicArray<uint16>(std::move(jointMatrices), jointCount);
+        result._bindShapeMatrix = controller->_bindShapeMatrix;
+
+        result._mainDrawCalls = source->_mainDrawCalls;
+        result._mainDrawUnanimatedIA._vertexStride = unanimatedVertexStride;
+        result._mainDrawUnanimatedIA._vertexInputLayout = std::move(unanimatedVertexLayout);
+        result._indexFormat = source->_indexFormat;
+
+        result._mainDrawAnimatedIA._vertexStride = animatedVertexStride;
+        result._mainDrawAnimatedIA._vertexInputLayout = std::move(animatedVertexLayout);
+
+        result._preskinningDrawCalls = preskinningDrawCalls;
+
+        if (finalWeightBufferFormat) {
+            result._preskinningIA._vertexInputLayout = *finalWeightBufferFormat;
+            result._preskinningIA._vertexStride = (unsigned)destinationWeightVertexStride;
+        }
+
+        result._localBoundingBox = boundingBox;
+        return std::move(result);
     }
 
     NascentModelCommandStream::NascentModelCommandStream()
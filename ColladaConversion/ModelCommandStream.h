@@ -222,7 +222,8 @@ namespace RenderCore { namespace ColladaConversion
 
         void    PushNode(   const COLLADAFW::Node& node, const TableOfObjects& accessableObjects,
                             const JointReferences& skeletonReferences);
-        void    InstantiateControllers  (const COLLADAFW::Node& node, const TableOfObjects& accessableObjects, TableOfObjects& destinationForNewObjects);
+        void    InstantiateControllers  (const COLLADAFW::Node* const rootNodes[], size_t rootNodeCount, 
+                                         const TableOfObjects& accessableObjects, TableOfObjects& destinationForNewObjects);
 
         bool    IsEmpty() const                 { return _geometryInstances.empty() && _modelInstances.empty() && _cameraInstances.empty() && _skinControllerInstances.empty(); }
 
@@ -239,6 +240,11 @@ namespace RenderCore { namespace ColladaConversion
 
         unsigned    FindTransformationMachineOutput(HashedColladaUniqueId nodeId) const;
 
+        class SkinBindingJob;
+        static void CollectSkinBindingJobs( const COLLADAFW::Node& node, const TableOfObjects& accessableObjects,
+                                            std::vector<SkinBindingJob>& jobs);
+        NascentBoundSkinnedGeometry BindSkinController(const SkinBindingJob& job, bool& expandedWeightStride) const;
+
         NascentModelCommandStream& operator=(const NascentModelCommandStream& copyFrom) never_throws;
         NascentModelCommandStream(const NascentModelCommandStream& copyFrom);
     };
@@ -44,6 +44,7 @@
 #include "../Utility/Streams/StreamTypes.h"
 #include "../Utility/ParameterBox.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/Threading/ParallelFor.h"
 
 #pragma warning(push)
 #pragma warning(disable:4201)       // nonstandard extension used : nameless struct/union
@@ -79,6 +80,7 @@
 #pragma warning(pop)
 
 #include <regex>
+#include <exception>
 
 #pragma warning(disable:4127)       // conditional expression is constant
 
@@ -126,7 +128,7 @@ namespace RenderCore { namespace ColladaConversion
 	    virtual void start(){}
 
 	    /** This method is called after the last write* method. No other methods will be called after this.*/
-	    virtual void finish(){}
+	    virtual void finish() { ConvertPendingObjects(); }
 
 	    /** When this method is called, the writer must write the global document asset.
 	    @return The writer should return true, if writing succeeded, false otherwise.*/
@@ -242,6 +244,23 @@ namespace RenderCore { namespace ColladaConversion
 
         std::vector<AnimationLink>  _animationLinks;
 
+        template<typename Source> class PendingConversion
+        {
+        public:
+            std::string             _idString, _name;
+            COLLADAFW::UniqueId     _id;
+            Source                  _source;
+
+            template<typename Object>
+                PendingConversion(const Object& object)
+                : _idString(object.getOriginalId()), _name(object.getName())
+                , _id(object.getUniqueId()), _source(object) {}
+        };
+
+        std::vector<std::unique_ptr<PendingConversion<ColladaConversion::GeometrySource>>>          _pendingGeometry;
+        std::vector<std::unique_ptr<PendingConversion<ColladaConversion::AnimationCurveSource>>>    _pendingAnimations;
+
+        void ConvertPendingObjects();
         void CompleteProcessing();
 
 	    // private function declarations
@@ -280,12 +299,14 @@ namespace RenderCore { namespace ColladaConversion
 
     bool Writer::writeGeometry(const COLLADAFW::Geometry* geometry)
 	{
+            //
+            //      The loader destroys each framework object as soon as the write method
+            //      returns. So we just copy the source data here, and convert it later
+            //      (in parallel with the other pending objects) in ConvertPendingObjects()
+            //
         TRY {
-            ColladaConversion::NascentRawGeometry geo = ColladaConversion::Convert(geometry);
-            _objects.Add(   geometry->getOriginalId(),
-                            geometry->getName(),
-                            geometry->getUniqueId(),
-                            std::move(geo));
+            _pendingGeometry.push_back(
+                std::make_unique<PendingConversion<ColladaConversion::GeometrySource>>(*geometry));
             return true;
         } CATCH(const FormatError& error) {
             HandleFormatError(error);
@@ -294,6 +315,68 @@ namespace RenderCore { namespace ColladaConversion
         return false;
 	}
 
+    void Writer::ConvertPendingObjects()
+    {
+            //
+            //      Convert all of the geometry and animation curves that have been
+            //      copied by the write methods since the last call. This must happen 
+            //      before anything looks for those objects in the table of objects.
+            //
+            //      The objects are independent, so they can be converted in parallel.
+            //      But we add them to the table in the order the write methods were 
+            //      called. So the object ids and the serialized output are the same as
+            //      converting them one at a time, whatever the thread count.
+            //
+        auto pendingGeometry = std::move(_pendingGeometry);
+        auto pendingAnimations = std::move(_pendingAnimations);
+        _pendingGeometry.clear();
+        _pendingAnimations.clear();
+
+        auto geoCount = unsigned(pendingGeometry.size());
+        auto animCount = unsigned(pendingAnimations.size());
+        if (!geoCount && !animCount) return;
+
+        std::vector<std::unique_ptr<ColladaConversion::NascentRawGeometry>> geos(geoCount);
+        std::vector<std::unique_ptr<Assets::RawAnimationCurve>> curves(animCount);
+        std::vector<std::exception_ptr> errors(geoCount + animCount);
+
+        Threading::ParallelFor(
+            ColladaConversion::ConversionThreadCount, geoCount + animCount,
+            [&](unsigned j) {
+                TRY {
+                    if (j < geoCount) {
+                        geos[j] = std::make_unique<ColladaConversion::NascentRawGeometry>(
+                            ColladaConversion::Convert(pendingGeometry[j]->_source));
+                    } else {
+                        curves[j-geoCount] = std::make_unique<Assets::RawAnimationCurve>(
+                            ColladaConversion::Convert(pendingAnimations[j-geoCount]->_source));
+                    }
+                } CATCH (...) {
+                    errors[j] = std::current_exception();
+                } CATCH_END
+            });
+
+        for (unsigned j=0; j<geoCount; ++j) {
+            const auto& pending = *pendingGeometry[j];
+            TRY {
+                if (errors[j]) std::rethrow_exception(errors[j]);
+                _objects.Add(pending._idString, pending._name, pending._id, std::move(*geos[j]));
+            } CATCH(const FormatError& error) {
+                HandleFormatError(error);
+            } CATCH_END
+        }
+
+        for (unsigned j=0; j<animCount; ++j) {
+            const auto& pending = *pendingAnimations[j];
+            TRY {
+                if (errors[geoCount+j]) std::rethrow_exception(errors[geoCount+j]);
+                _objects.Add(pending._idString, pending._name, pending._id, std::move(*curves[j]));
+            } CATCH(const FormatError& error) {
+                HandleFormatError(error);
+            } CATCH_END
+        }
+    }
+
     static const auto DefaultDiffuseTextureBindingHash = Hash64("DiffuseTexture");
 
     static void AddBoundTexture( 
@@ -483,6 +566,8 @@ namespace RenderCore { namespace ColladaConversion
 
     void Writer::CompleteProcessing()
     {
+        ConvertPendingObjects();
+
             //
             //      Any parameters in the transformation machine that don't have 
             //      animation drivers associated with them should get constant
@@ -523,6 +608,8 @@ namespace RenderCore { namespace ColladaConversion
                 //      that's more useful to use.
                 //          (Also remove any nodes that useless to us)
                 //
+            ConvertPendingObjects();
+
             using namespace COLLADAFW;
             ColladaConversion::NascentModelCommandStream    commandStream;
 
@@ -545,10 +632,8 @@ namespace RenderCore { namespace ColladaConversion
                 //
                 //      Second pass -- find and instantiate all of the referenced controllers
                 //
-            for (size_t c=0; c<rootNodeCount; ++c) {
-                const Node* node = visualScene->getRootNodes()[c];
-                commandStream.InstantiateControllers(*node, _objects, _objects);
-            }
+            commandStream.InstantiateControllers(
+                visualScene->getRootNodes().getData(), rootNodeCount, _objects, _objects);
 
                 //
                 //      Now, read the animation links and add "AnimationDriver" objects as required
@@ -578,6 +663,8 @@ namespace RenderCore { namespace ColladaConversion
     {
         TRY {
 
+            ConvertPendingObjects();
+
             using namespace COLLADAFW;
 
             size_t rootNodeCount = libraryNodes->getNodes().getCount();
@@ -721,12 +808,9 @@ namespace RenderCore { namespace ColladaConversion
     {
         TRY {
 
-            using namespace ColladaConversion;
-            Assets::RawAnimationCurve convertedCurve = Convert(*animation);
-            _objects.Add(   animation->getOriginalId(),
-                            animation->getName(),
-                            animation->getUniqueId(),
-                            std::move(convertedCurve));
+                //  (converted later, in ConvertPendingObjects(). See writeGeometry)
+            _pendingAnimations.push_back(
+                std::make_unique<PendingConversion<ColladaConversion::AnimationCurveSource>>(*animation));
             return true;
 
         } CATCH (const FormatError& error) {
@@ -769,6 +853,8 @@ namespace RenderCore { namespace ColladaConversion
     {
         TRY  {
 
+            ConvertPendingObjects();
+
                     //
                     //      We can use this to attach an animation curve to a specific 
                     //      parameter in the command stream. Each parameter in the 
@@ -1341,5 +1427,10 @@ namespace RenderCore { namespace ColladaConversion
 	{
 		TerminateFileSystemMonitoring();
 	}
+
+    CONVERSION_API void SetConversionThreadCount(unsigned threadCount)
+    {
+        ConversionThreadCount = threadCount;
+    }
 }}
 
@@ -99,6 +99,7 @@ namespace RenderCore { namespace ColladaConversion
     CONVERSION_API std::unique_ptr<NascentModel, Internal::CrossDLLDeletor>     CreateModel(const ResChar identifier[]);
     CONVERSION_API std::pair<const char*, const char*>                          GetVersionInformation();
 	CONVERSION_API void															ShutdownLibrary();
+    CONVERSION_API void                                                         SetConversionThreadCount(unsigned threadCount);
 
     typedef std::unique_ptr<NascentModel, Internal::CrossDLLDeletor> CreateModelFunction(const ResChar identifier[]);
     typedef NascentChunkArray (NascentModel::*ModelSerializeFunction)() const;
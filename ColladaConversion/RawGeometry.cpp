@@ -149,26 +149,6 @@ namespace RenderCore { namespace ColladaConversion
         return outputIterator/3;
     }
 
-    static const COLLADAFW::UIntValuesArray* Get(const COLLADAFW::MeshPrimitive& primitive, const VertexAttribute& attribute)
-    {
-        if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::POSITION) {
-            return &primitive.getPositionIndices();
-        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::NORMAL) {
-            return &primitive.getNormalIndices();
-        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::TANGENT) {
-            return &primitive.getTangentIndices();
-        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::BINORMAL) {
-            return &primitive.getBinormalIndices();
-        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::COLOR) {
-            assert(attribute._index < primitive.getColorIndicesArray().getCount());
-            return &primitive.getColorIndices(attribute._index)->getIndices();
-        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::TEXCOORD) {
-            assert(attribute._index < primitive.getUVCoordIndicesArray().getCount());
-            return &primitive.getUVCoordIndices(attribute._index)->getIndices();
-        }
-        return nullptr;
-    }
-
     class MeshVertexSourceData
     {
     public:
@@ -180,7 +160,6 @@ namespace RenderCore { namespace ColladaConversion
             std::string     _name;
             Param(Type type, const std::string& name) : _type(type), _name(name) {}
         };
-        const COLLADAFW::MeshVertexData*    _vertexData;
         std::string                         _name;
         size_t                              _start, _end, _stride;      // (in elements)
         std::vector<Param>                  _params;
@@ -197,7 +176,6 @@ namespace RenderCore { namespace ColladaConversion
 
     MeshVertexSourceData::MeshVertexSourceData()
     {
-        _vertexData = nullptr;
         _start = _end = _stride = 0;
     }
 
@@ -257,7 +235,6 @@ namespace RenderCore { namespace ColladaConversion
                 //
             auto& vertexData        = primitive.getPositions();
             MeshVertexSourceData result;
-            result._vertexData      = &vertexData;
             result._start           = 0;
             if (vertexData.getNumInputInfos() == 0) {
                 result._name        = std::string();
@@ -277,7 +254,6 @@ namespace RenderCore { namespace ColladaConversion
 
             auto& vertexData        = primitive.getNormals();
             MeshVertexSourceData result;
-            result._vertexData      = &vertexData;
             result._start           = 0;
             if (vertexData.getNumInputInfos() == 0) {
                 result._name        = std::string();
@@ -297,7 +273,6 @@ namespace RenderCore { namespace ColladaConversion
 
             auto& vertexData        = primitive.getTangents();
             MeshVertexSourceData result;
-            result._vertexData      = &vertexData;
             result._start           = 0;
             if (vertexData.getNumInputInfos() == 0) {
                 result._name        = std::string();
@@ -317,7 +292,6 @@ namespace RenderCore { namespace ColladaConversion
 
             auto& vertexData        = primitive.getBinormals();
             MeshVertexSourceData result;
-            result._vertexData      = &vertexData;
             result._start           = 0;
             if (vertexData.getNumInputInfos() == 0) {
                 result._name        = std::string();
@@ -351,7 +325,6 @@ namespace RenderCore { namespace ColladaConversion
             }
 
             MeshVertexSourceData result;
-            result._vertexData  = &vertexData;
             result._start       = sourceOffset;
             result._name        = vertexData.getInputInfosArray()[sourceIndex]->mName;
             result._end         = vertexData.getInputInfosArray()[sourceIndex]->mLength + sourceOffset;
@@ -376,7 +349,6 @@ namespace RenderCore { namespace ColladaConversion
             }
 
             MeshVertexSourceData result;
-            result._vertexData  = &vertexData;
             result._start       = sourceOffset;
             result._name        = vertexData.getInputInfosArray()[sourceIndex]->mName;
             result._end         = vertexData.getInputInfosArray()[sourceIndex]->mLength + sourceOffset;
@@ -466,19 +438,11 @@ namespace RenderCore { namespace ColladaConversion
         }
     }
 
-    // static unsigned Get(const COLLADAFW::MeshPrimitive& primitive, const VertexAttribute& attribute, unsigned indexIntoPrimitive)
-    // {
-    //     auto indexArray = Get(primitive, attribute);
-    //     if (!indexArray) {
-    //         return ~unsigned(0x0);
-    //     }
-    //     assert(indexIntoPrimitive < indexArray->getCount());
-    //     return (*indexArray)[indexIntoPrimitive];
-    // }
-
-    static unsigned Get(const COLLADAFW::MeshPrimitive& primitive, const COLLADAFW::UIntValuesArray* attribute, unsigned indexIntoPrimitive)
+    typedef std::vector<unsigned> IndexStream;
+
+    static unsigned Get(const IndexStream* attribute, unsigned indexIntoPrimitive)
     {
-        assert(indexIntoPrimitive < attribute->getCount());
+        assert(indexIntoPrimitive < attribute->size());
         return (*attribute)[indexIntoPrimitive];
     }
 
@@ -487,8 +451,8 @@ namespace RenderCore { namespace ColladaConversion
     static size_t BuildUnifiedVertex( 
         std::vector<std::vector<unsigned>>& vertexMap,
         VertexHashTable* vertexHashTable,
-        const std::vector<const COLLADAFW::UIntValuesArray*>& semantics,
-        const COLLADAFW::MeshPrimitive& primitive, unsigned indexIntoPrimitive)
+        const std::vector<const IndexStream*>& semantics,
+        unsigned indexIntoPrimitive)
     {
         unsigned indexOfEachAttribute[32];
         if (semantics.size() > dimof(indexOfEachAttribute)) {
@@ -498,7 +462,7 @@ namespace RenderCore { namespace ColladaConversion
         unsigned hashKey = 0;
         auto c = 0u;
         for (auto i = semantics.cbegin(); i != semantics.cend(); ++i, ++c) {
-            indexOfEachAttribute[c] = Get(primitive, *i, indexIntoPrimitive);
+            indexOfEachAttribute[c] = Get(*i, indexIntoPrimitive);
             hashKey += indexOfEachAttribute[c] << (4*std::distance(semantics.cbegin(), i));
         }
         unsigned attributeCount = (unsigned)semantics.size();
@@ -620,17 +584,107 @@ namespace RenderCore { namespace ColladaConversion
         return "<<unknown>>";
     }
 
-    NascentRawGeometry Convert(const COLLADAFW::Geometry* geometry)
+    class GeometrySource::Pimpl
+    {
+    public:
+        class Primitive
+        {
+        public:
+            COLLADAFW::MeshPrimitive::PrimitiveType _type;
+            COLLADAFW::MaterialId                   _materialId;
+            size_t                                  _faceCount;
+            std::vector<VertexAttribute>            _attributes;
+            IndexStream                             _positionIndices, _normalIndices;
+            IndexStream                             _tangentIndices, _binormalIndices;
+            std::vector<IndexStream>                _colorIndices, _uvCoordIndices;
+            std::vector<int>                        _faceVertexCounts;  // (polygons and polylists only)
+        };
+
+        std::string             _name;
+        bool                    _isEmpty;
+        size_t                  _unifiedVertexCountGuess;
+        size_t                  _positionValuesCount;
+        std::vector<Primitive>  _primitives;
+
+            //  The source description for every attribute used by the primitives,
+            //  and the float values from the mesh's vertex data arrays
+        std::vector<std::pair<VertexAttribute, MeshVertexSourceData>>   _vertexSources;
+        std::vector<float>      _positions, _normals, _tangents, _binormals, _colors, _uvCoords;
+
+        const MeshVertexSourceData& GetVertexSource(const VertexAttribute& attribute) const;
+        const std::vector<float>&   GetFloatValues(const VertexAttribute& attribute) const;
+
+        Pimpl() : _isEmpty(true), _unifiedVertexCountGuess(0), _positionValuesCount(0) {}
+    };
+
+    auto GeometrySource::Pimpl::GetVertexSource(const VertexAttribute& attribute) const -> const MeshVertexSourceData&
+    {
+        auto i = std::find_if(
+            _vertexSources.cbegin(), _vertexSources.cend(),
+            [&](const std::pair<VertexAttribute, MeshVertexSourceData>& p) { return p.first == attribute; });
+        assert(i != _vertexSources.cend());
+        return i->second;
+    }
+
+    auto GeometrySource::Pimpl::GetFloatValues(const VertexAttribute& attribute) const -> const std::vector<float>&
+    {
+        switch (attribute._basicSemantic) {
+        case COLLADASaxFWL::InputSemantic::NORMAL:      return _normals;
+        case COLLADASaxFWL::InputSemantic::TANGENT:     return _tangents;
+        case COLLADASaxFWL::InputSemantic::BINORMAL:    return _binormals;
+        case COLLADASaxFWL::InputSemantic::COLOR:       return _colors;
+        case COLLADASaxFWL::InputSemantic::TEXCOORD:    return _uvCoords;
+        default:                                        return _positions;
+        }
+    }
+
+    static const IndexStream* Get(const GeometrySource::Pimpl::Primitive& primitive, const VertexAttribute& attribute)
+    {
+        if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::POSITION) {
+            return &primitive._positionIndices;
+        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::NORMAL) {
+            return &primitive._normalIndices;
+        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::TANGENT) {
+            return &primitive._tangentIndices;
+        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::BINORMAL) {
+            return &primitive._binormalIndices;
+        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::COLOR) {
+            assert(attribute._index < primitive._colorIndices.size());
+            return &primitive._colorIndices[attribute._index];
+        } else if (attribute._basicSemantic == COLLADASaxFWL::InputSemantic::TEXCOORD) {
+            assert(attribute._index < primitive._uvCoordIndices.size());
+            return &primitive._uvCoordIndices[attribute._index];
+        }
+        return nullptr;
+    }
+
+    static IndexStream AsIndexStream(const COLLADAFW::UIntValuesArray& input)
+    {
+        return IndexStream(input.getData(), input.getData() + input.getCount());
+    }
+
+    static std::vector<float> AsFloatValues(const COLLADAFW::MeshVertexData& input)
+    {
+            //  Convert() only writes float source data into the vertex buffer, so 
+            //  there's no need to copy anything else
+        auto* values = input.getFloatValues();
+        if (input.getType() != COLLADAFW::FloatOrDoubleArray::DATA_TYPE_FLOAT || !values) {
+            return std::vector<float>();
+        }
+        return std::vector<float>(values->getData(), values->getData() + values->getCount());
+    }
+
+    GeometrySource::GeometrySource(const COLLADAFW::Geometry& geometry)
     {
             //  
             //      We can only handle "mesh" data inside a geometry element.
             //      Collada also support higher-order surfaces, but these aren't
             //      supported by us currently.
             //
-        if (geometry->getType() != COLLADAFW::Geometry::GEO_TYPE_MESH) {
+        if (geometry.getType() != COLLADAFW::Geometry::GEO_TYPE_MESH) {
             ThrowException(FormatError(
                 "Failed while importing geometry element (%s).\r Non mesh type encountered (%s). This object must be converted into a mesh in the exporter tool.",
-                geometry->getName().c_str(), AsString(geometry->getType())));
+                geometry.getName().c_str(), AsString(geometry.getType())));
         }
 
             //
@@ -643,13 +697,99 @@ namespace RenderCore { namespace ColladaConversion
             //      For flexibility, let's use strings rather than enums for 
             //      semantics while processing.
             //
-        const COLLADAFW::Mesh* mesh = COLLADAFW::objectSafeCast<COLLADAFW::Mesh>(geometry);
+        const COLLADAFW::Mesh* mesh = COLLADAFW::objectSafeCast<COLLADAFW::Mesh>(&geometry);
         if (!mesh) {
-            ThrowException(FormatError("Casting failure while processing geometry node (%s).", geometry->getName().c_str()));
+            ThrowException(FormatError("Casting failure while processing geometry node (%s).", geometry.getName().c_str()));
         }
 
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_name = geometry.getName();
+
             // some exports can have empty meshes -- ideally, we just want to ignore them
-        if (!mesh->getFacesCount() || mesh->getPositions().empty()) {
+        pimpl->_isEmpty = !mesh->getFacesCount() || mesh->getPositions().empty();
+        if (!pimpl->_isEmpty) {
+
+                //
+                //  Guess the max unified vertex count (so Convert() can reserve space)
+                //
+            size_t unifiedVertexCountGuess = 0;
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getPositions().getValuesCount());
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getNormals().getValuesCount());
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getColors().getValuesCount());
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getUVCoords().getValuesCount());
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getTangents().getValuesCount());
+            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getBinormals().getValuesCount());
+            pimpl->_unifiedVertexCountGuess = unifiedVertexCountGuess;
+            pimpl->_positionValuesCount = mesh->getPositions().getValuesCount();
+
+            using namespace COLLADAFW;
+            const MeshPrimitiveArray& meshPrimitives = mesh->getMeshPrimitives();
+            pimpl->_primitives.reserve(meshPrimitives.getCount());
+            for (size_t c=0; c<meshPrimitives.getCount(); ++c) {
+
+                    //  Ignore anything using a material called "proxy"
+                    //  this is sometimes used for secondary models stored inside of the main model
+                    //  (for example, for a physical proxy)
+                if (!XlCompareStringI(meshPrimitives[c]->getMaterial().c_str(), "proxy")) {
+                    continue;
+                }
+
+                pimpl->_primitives.push_back(Pimpl::Primitive());
+                auto& dst = pimpl->_primitives.back();
+                const MeshPrimitive& src = *meshPrimitives[c];
+                dst._type               = src.getPrimitiveType();
+                dst._materialId         = src.getMaterialId();
+                dst._faceCount          = src.getFaceCount();
+                dst._attributes         = GetAttributeList(*meshPrimitives[c]);
+                dst._positionIndices    = AsIndexStream(src.getPositionIndices());
+                dst._normalIndices      = AsIndexStream(src.getNormalIndices());
+                dst._tangentIndices     = AsIndexStream(src.getTangentIndices());
+                dst._binormalIndices    = AsIndexStream(src.getBinormalIndices());
+                for (unsigned q=0; q<src.getColorIndicesArray().getCount(); ++q)
+                    dst._colorIndices.push_back(AsIndexStream(src.getColorIndices(q)->getIndices()));
+                for (unsigned q=0; q<src.getUVCoordIndicesArray().getCount(); ++q)
+                    dst._uvCoordIndices.push_back(AsIndexStream(src.getUVCoordIndices(q)->getIndices()));
+
+                if (dst._type == MeshPrimitive::POLYGONS || dst._type == MeshPrimitive::POLYLIST) {
+                    const MeshPrimitiveWithFaceVertexCount<int>* polygons = 
+                        COLLADAFW::objectSafeCast<const MeshPrimitiveWithFaceVertexCount<int>>(&src);
+                    if (!polygons) {
+                        ThrowException(FormatError("Casting failure while processing geometry node (%s).", geometry.getName().c_str()));
+                    }
+
+                    const Polygons::VertexCountArray& vertexCounts = polygons->getGroupedVerticesVertexCountArray();
+                    dst._faceVertexCounts.assign(vertexCounts.getData(), vertexCounts.getData() + vertexCounts.getCount());
+                }
+
+                    //  Reconstruct the source information for each attribute now, while
+                    //  we still have access to the mesh
+                for (auto i=dst._attributes.cbegin(); i!=dst._attributes.cend(); ++i) {
+                    auto existing = std::find_if(
+                        pimpl->_vertexSources.cbegin(), pimpl->_vertexSources.cend(),
+                        [&](const std::pair<VertexAttribute, MeshVertexSourceData>& p) { return p.first == *i; });
+                    if (existing == pimpl->_vertexSources.cend()) {
+                        pimpl->_vertexSources.push_back(std::make_pair(*i, GetVertexData(*mesh, *i)));
+                    }
+                }
+            }
+
+            pimpl->_positions   = AsFloatValues(mesh->getPositions());
+            pimpl->_normals     = AsFloatValues(mesh->getNormals());
+            pimpl->_tangents    = AsFloatValues(mesh->getTangents());
+            pimpl->_binormals   = AsFloatValues(mesh->getBinormals());
+            pimpl->_colors      = AsFloatValues(mesh->getColors());
+            pimpl->_uvCoords    = AsFloatValues(mesh->getUVCoords());
+        }
+
+        _pimpl = std::move(pimpl);
+    }
+
+    GeometrySource::~GeometrySource() {}
+
+    NascentRawGeometry Convert(const GeometrySource& source)
+    {
+        const auto& src = *source._pimpl;
+        if (src._isEmpty) {
             return NascentRawGeometry();
         }
 
@@ -695,21 +835,10 @@ namespace RenderCore { namespace ColladaConversion
         std::vector<PendingIndexBuffer>     vertexMap;
         VertexHashTable                     vertexHashTable;
 
-        size_t unifiedVertexCountGuess = 0;
-        {
-                //
-                //  Guess the max unified vertex count; and reserve our space.
-                //
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getPositions().getValuesCount());
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getNormals().getValuesCount());
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getColors().getValuesCount());
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getUVCoords().getValuesCount());
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getTangents().getValuesCount());
-            unifiedVertexCountGuess = std::max(unifiedVertexCountGuess, mesh->getBinormals().getValuesCount());
-            vertexHashTable.reserve(unifiedVertexCountGuess);
-        }
+        size_t unifiedVertexCountGuess = src._unifiedVertexCountGuess;
+        vertexHashTable.reserve(unifiedVertexCountGuess);
 
-        std::vector<const COLLADAFW::UIntValuesArray*>  vertexAttributes;
+        std::vector<const IndexStream*>     vertexAttributes;
 
         class DrawOperation
         {
@@ -725,25 +854,19 @@ namespace RenderCore { namespace ColladaConversion
 
             //
             //      First; deal with index buffers and draw calls
+            //      (primitives using the "proxy" material were skipped while copying the source)
             //
-        const MeshPrimitiveArray& meshPrimitives = mesh->getMeshPrimitives();
-        for (size_t c=0; c<meshPrimitives.getCount(); ++c) {
-
-                //  Ignore anything using a material called "proxy"
-                //  this is sometimes used for secondary models stored inside of the main model
-                //  (for example, for a physical proxy)
-            if (!XlCompareStringI(meshPrimitives[c]->getMaterial().c_str(), "proxy")) {
-                continue;
-            }
+        for (auto p=src._primitives.cbegin(); p!=src._primitives.cend(); ++p) {
 
                 //
                 //      First, set up the vertices so we know where and how to write.
                 //      If we need to add new attributes, we should do so now.
                 //
-                //      First, convert from the COLLADAFW::MeshPrimitive scheme of
-                //      separate accessors for each semantic, to something more generic
+                //      The attribute list was converted from the COLLADAFW::MeshPrimitive 
+                //      scheme of separate accessors for each semantic, to something more 
+                //      generic, when we copied the source.
                 //
-            std::vector<VertexAttribute> primitiveAttributes = GetAttributeList(*meshPrimitives[c]);
+            const std::vector<VertexAttribute>& primitiveAttributes = p->_attributes;
 
             auto localIterator = primitiveAttributes.begin();
             auto globalIterator = vertexSemantics.begin();
@@ -776,39 +899,33 @@ namespace RenderCore { namespace ColladaConversion
             vertexAttributes.erase(vertexAttributes.begin(), vertexAttributes.end());   // empty without deallocation
             vertexAttributes.reserve(vertexSemantics.size());
             for (auto i = vertexSemantics.cbegin(); i != vertexSemantics.cend(); ++i) {
-                vertexAttributes.push_back(Get(*meshPrimitives[c], *i));
+                vertexAttributes.push_back(Get(*p, *i));
             }
                 
             DrawOperation convertDrawCall;
             if (!vertexAttributes.empty()) {
-                convertDrawCall._indexBuffer.reserve(vertexAttributes[0]->getCount());      // reserve to some conservative large number
+                convertDrawCall._indexBuffer.reserve(vertexAttributes[0]->size());      // reserve to some conservative large number
             }
 
-            convertDrawCall._materialId = meshPrimitives[c]->getMaterialId();
+            convertDrawCall._materialId = p->_materialId;
 
-            const MeshPrimitive::PrimitiveType primitiveType = meshPrimitives[c]->getPrimitiveType();
+            const MeshPrimitive::PrimitiveType primitiveType = p->_type;
             if (primitiveType == MeshPrimitive::POLYGONS || primitiveType == MeshPrimitive::POLYLIST) {
                     
                 convertDrawCall._topology = Metal::Topology::TriangleList;     // (will become a triangle list.. perhaps some hardware can support convex polygons...?)
 
                     // A list of polygons. 
-                const MeshPrimitiveWithFaceVertexCount<int>* polygons = 
-                    COLLADAFW::objectSafeCast<const MeshPrimitiveWithFaceVertexCount<int>>(meshPrimitives[c]);
-                if (!polygons) {
-                    ThrowException(FormatError("Casting failure while processing geometry node (%s).", geometry->getName().c_str()));
-                }
-
-                const Polygons::VertexCountArray& vertexCounts = polygons->getGroupedVerticesVertexCountArray();
+                const std::vector<int>& vertexCounts = p->_faceVertexCounts;
                 size_t groupStart = 0;
-                for (auto group=0u; group<vertexCounts.getCount(); ++group) {
+                for (auto group=0u; group<vertexCounts.size(); ++group) {
                     size_t groupEnd = groupStart + vertexCounts[group];
 
                     const unsigned MaxPolygonSize = 32;
                     if ((groupEnd - groupStart) > MaxPolygonSize) {
-                        ThrowException(FormatError("Exceeded maximum polygon size in node (%s).", geometry->getName().c_str()));
+                        ThrowException(FormatError("Exceeded maximum polygon size in node (%s).", src._name.c_str()));
                     }
                     if ((groupEnd - groupStart) <=2) {
-                        ThrowException(FormatError("Polygon with less than 3 vertices in node (%s).", geometry->getName().c_str()));
+                        ThrowException(FormatError("Polygon with less than 3 vertices in node (%s).", src._name.c_str()));
                     }
 
                         //
@@ -818,7 +935,7 @@ namespace RenderCore { namespace ColladaConversion
                     size_t unifiedVertices[MaxPolygonSize];
                     for (auto v=groupStart; v!=groupEnd; ++v) {
                         unifiedVertices[v-groupStart] = BuildUnifiedVertex(
-                            vertexMap, &vertexHashTable, vertexAttributes, *polygons, (unsigned)v);
+                            vertexMap, &vertexHashTable, vertexAttributes, (unsigned)v);
                     }
 
                     unsigned triangleWinding[MaxPolygonSize+2];
@@ -837,13 +954,13 @@ namespace RenderCore { namespace ColladaConversion
 
                     //  Triangle list -> triangle list (simpliest conversion)
                 convertDrawCall._topology = Metal::Topology::TriangleList;     // (will become a triangle list.. perhaps some hardware can support convex polygons...?)
-                for (auto index=0u; index<meshPrimitives[c]->getFaceCount()*3; ++index) {
+                for (auto index=0u; index<p->_faceCount*3; ++index) {
                     convertDrawCall._indexBuffer.push_back( 
                         (unsigned)BuildUnifiedVertex(
-                            vertexMap, &vertexHashTable, vertexAttributes, *meshPrimitives[c], index));
+                            vertexMap, &vertexHashTable, vertexAttributes, index));
                 }
             } else {
-                ThrowException(FormatError("Unsupported primitive type found in mesh (%s) (%s)", mesh->getName().c_str(), AsString(primitiveType)));
+                ThrowException(FormatError("Unsupported primitive type found in mesh (%s) (%s)", src._name.c_str(), AsString(primitiveType)));
             }
 
             drawOperations.push_back(std::move(convertDrawCall));
@@ -877,7 +994,7 @@ namespace RenderCore { namespace ColladaConversion
             for (auto i=vertexSemantics.cbegin(); i!=vertexSemantics.cend(); ++i) {
                 auto& nativeElement  = nativeElements[std::distance(vertexSemantics.cbegin(), i)];
                 auto& sourceData     = meshVertexSourceData[std::distance(vertexSemantics.cbegin(), i)];
-                sourceData = GetVertexData(*mesh, *i);
+                sourceData = src.GetVertexSource(*i);
 
                     // Note --  There's a problem here with texture coordinates. Sometimes texture coordinates
                     //          have 3 components in the Collada file. But only 2 components are actually used
@@ -933,7 +1050,7 @@ namespace RenderCore { namespace ColladaConversion
                         //      All we can do is use the position index as a subtitute.
                     if (semanticIndex == 0) {
                         assert(i->_basicSemantic == COLLADASaxFWL::InputSemantic::POSITION);    // assuming the first is position, for simplicity
-                        assert(attributeIndex < mesh->getPositions().getValuesCount());
+                        assert(attributeIndex < src._positionValuesCount);
                         unifiedVertexIndexToPositionIndex[v] = (uint32)attributeIndex;
                     }
 
@@ -944,7 +1061,7 @@ namespace RenderCore { namespace ColladaConversion
                         //      note that the "sourceData._start" offset is already included
                         //      into the attributeIndex value, so we don't have to add it again
                         //
-                    auto sourceStart    = &sourceData._vertexData->getFloatValues()->getData()
+                    auto sourceStart    = &AsPointer(src.GetFloatValues(*i).cbegin())
                         [/*sourceData._start +*/ attributeIndex * sourceData._stride];
                     auto destination    = PtrAdd(vertexDestination, nativeElement._alignedByteOffset);
 
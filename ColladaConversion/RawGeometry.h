@@ -9,7 +9,9 @@
 #include "../RenderCore/Metal/Format.h"
 #include "../RenderCore/Metal/InputLayout.h"
 #include "../RenderCore/Metal/DeviceContext.h"  // for topology
+#include "../Utility/Mixins.h"
 #include <vector>
+#include <memory>
 
 namespace COLLADAFW { class Geometry; }
 namespace Serialization { class NascentBlockSerializer; }
@@ -78,6 +80,23 @@ namespace RenderCore { namespace ColladaConversion
 
         ////////////////////////////////////////////////////////
 
-    NascentRawGeometry Convert(const COLLADAFW::Geometry* geometry);
+        /// <summary>Copy of the source data in a COLLADAFW::Geometry</summary>
+        /// The loader destroys each framework object as soon as the write callback
+        /// returns. So the callback copies the vertex and index arrays into this object,
+        /// and the (much more expensive) conversion can be done later, on any thread.
+    class GeometrySource : noncopyable
+    {
+    public:
+        GeometrySource(const COLLADAFW::Geometry& geometry);
+        ~GeometrySource();
+
+        class Pimpl;
+    private:
+        std::unique_ptr<Pimpl> _pimpl;
+
+        friend NascentRawGeometry Convert(const GeometrySource& source);
+    };
+
+    NascentRawGeometry Convert(const GeometrySource& source);
 
 }}
\ No newline at end of file
@@ -7,7 +7,7 @@
 #include "TransformationMachine.h"
 #include "ColladaUtils.h"
 #include "../Math/Transformations.h"
-#include "../Utility/StringFormat.h"
+#include "../Utility/StringFormatTyped.h"
 
 #pragma warning(push)
 #pragma warning(disable:4201)       // nonstandard extension used : nameless struct/union
@@ -132,8 +132,8 @@ namespace RenderCore { namespace ColladaConversion
                 parameterType = ParameterType_AnimationConstant;
 
                 char buffer[256];
-                xl_snprintf(buffer, dimof(buffer), "%s_%s(%i)", nodeName, AsString(type), typeIndex);
-                parameterHash = Hash32(buffer, &buffer[XlStringLen(buffer)]);
+                auto length = XlFormat(buffer, "%s_%s(%i)", nodeName, AsString(type), typeIndex);
+                parameterHash = Hash32(buffer, &buffer[length]);
             }
 
             if  (type == Transformation::MATRIX) {
@@ -0,0 +1,804 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "AsyncLog.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Core/SelectConfiguration.h"
+#include "../Core/Types.h"
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+#if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+    #include "../Core/WinAPI/IncludeWindows.h"
+#else
+    #include <pthread.h>
+    #include <signal.h>
+#endif
+
+#if COMPILER_ACTIVE == COMPILER_TYPE_MSVC
+    #define ASYNCLOG_THREAD_LOCAL   __declspec(thread)
+#else
+    #define ASYNCLOG_THREAD_LOCAL   __thread
+#endif
+
+namespace ConsoleRig
+{
+        //
+        //      Each log entry in a ring buffer is an EntryHeader, followed by the
+        //      captured arguments. Every argument takes a multiple of 8 bytes:
+        //          integers, characters & pointers     8 bytes
+        //          floating point                      8 bytes (as a double)
+        //          strings                             4 byte length (including the null),
+        //                                              then the characters, padded to 8 bytes
+        //
+        //      The arguments are not tagged with their types. Both the logging thread
+        //      and the background thread walk through the format string to find them.
+        //
+    static const unsigned EntryType_Padding = 0xff;
+    static const unsigned MaxEntrySize = 1024;
+
+    class EntryHeader
+    {
+    public:
+        uint32  _size;              // (including header; always a multiple of 8)
+        uint8   _type;              // LogSeverity::Enum or EntryType_Padding
+        uint8   _verboseLevel;
+        uint16  _capturedSpecs;     // number of format specifiers with captured arguments
+        uint64  _timestamp;
+        uint64  _format;            // (const char*)
+    };
+
+    namespace LengthModifier
+    {
+        enum Enum { None, Char, Short, Long, LongLong, IntMax, Size, PtrDiff, LongDouble, Int32, Int64 };
+    }
+
+    class FormatSpec
+    {
+    public:
+        const char*             _flagsBegin;    // flags, width & precision
+        const char*             _flagsEnd;
+        const char*             _end;           // (one past the conversion character)
+        LengthModifier::Enum    _length;
+        char                    _conversion;
+        bool                    _starWidth;
+        bool                    _starPrecision;
+    };
+
+    static bool ParseFormatSpec(FormatSpec& spec, const char* i)
+    {
+            //  "i" should point to the character after the '%'. Returns false if
+            //  we don't understand the specifier.
+        spec._flagsBegin = i;
+        spec._starWidth = spec._starPrecision = false;
+        while (*i == '-' || *i == '+' || *i == ' ' || *i == '#' || *i == '0') ++i;
+        if (*i == '*') { spec._starWidth = true; ++i; }
+        else { while (*i >= '0' && *i <= '9') ++i; }
+        if (*i == '.') {
+            ++i;
+            if (*i == '*') { spec._starPrecision = true; ++i; }
+            else { while (*i >= '0' && *i <= '9') ++i; }
+        }
+        spec._flagsEnd = i;
+
+        spec._length = LengthModifier::None;
+        switch (*i) {
+        case 'h':   if (i[1] == 'h') { spec._length = LengthModifier::Char; i+=2; } else { spec._length = LengthModifier::Short; ++i; } break;
+        case 'l':   if (i[1] == 'l') { spec._length = LengthModifier::LongLong; i+=2; } else { spec._length = LengthModifier::Long; ++i; } break;
+        case 'q':   spec._length = LengthModifier::LongLong; ++i; break;
+        case 'j':   spec._length = LengthModifier::IntMax; ++i; break;
+        case 'z':   spec._length = LengthModifier::Size; ++i; break;
+        case 't':   spec._length = LengthModifier::PtrDiff; ++i; break;
+        case 'L':   spec._length = LengthModifier::LongDouble; ++i; break;
+        case 'I':       // (msvc specific)
+            if (i[1] == '6' && i[2] == '4') { spec._length = LengthModifier::Int64; i+=3; }
+            else if (i[1] == '3' && i[2] == '2') { spec._length = LengthModifier::Int32; i+=3; }
+            else { spec._length = LengthModifier::Size; ++i; }
+            break;
+        default: break;
+        }
+
+        spec._conversion = *i;
+        if (!strchr("diuoxXcCeEfFgGaAsSpn", spec._conversion) || !spec._conversion) return false;
+        spec._end = i+1;
+        return true;
+    }
+
+    static bool IsWideString(const FormatSpec& spec)    { return spec._conversion == 'S' || (spec._conversion == 's' && spec._length == LengthModifier::Long); }
+    static bool IsWideChar(const FormatSpec& spec)      { return spec._conversion == 'C' || (spec._conversion == 'c' && spec._length == LengthModifier::Long); }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class AsyncLogger::ThreadBuffer
+    {
+    public:
+        std::unique_ptr<uint64[]>   _data;
+        uint32                      _capacity;          // (bytes; power of 2)
+
+            //  _writePos & _readPos are free running byte counters. Only the owning
+            //  thread changes _writePos, and only the background thread changes _readPos.
+        Interlocked::Value volatile _writePos;
+        uint8                       _padding0[64];
+        Interlocked::Value volatile _readPos;
+        uint8                       _padding1[64];
+        Interlocked::Value volatile _droppedCount;
+        Interlocked::Value volatile _ownerFinished;
+
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+            HANDLE                  _ownerThread;
+        #endif
+
+        bool Write(const void* entry, uint32 size, XlHandle wakeEvent);
+        bool IsOwnerFinished();
+
+        ThreadBuffer(uint32 capacity);
+        ~ThreadBuffer();
+    };
+
+    bool AsyncLogger::ThreadBuffer::Write(const void* entry, uint32 size, XlHandle wakeEvent)
+    {
+        auto write = uint32(_writePos);
+        auto read = uint32(Interlocked::Load(&_readPos));
+        auto offset = write & (_capacity-1);
+        auto toEnd = _capacity - offset;
+
+            //  entries are never split across the end of the ring buffer. If the
+            //  entry doesn't fit, we fill the end with a padding entry, and start
+            //  again at the beginning.
+        auto required = size + ((toEnd < size) ? toEnd : 0);
+        auto used = write - read;
+        if ((_capacity - used) < required) return false;
+
+        auto* data = (uint8*)_data.get();
+        if (toEnd < size) {
+            auto& padding = *(EntryHeader*)&data[offset];
+            padding._size = toEnd;
+            padding._type = uint8(EntryType_Padding);
+            offset = 0;
+        }
+        memcpy(&data[offset], entry, size);
+        Interlocked::Exchange(&_writePos, Interlocked::Value(write + required));
+
+            //  Wake the background thread when we're crossing half full (but not
+            //  for every entry, because that's comparatively expensive)
+        if (used < _capacity/2 && (used + required) >= _capacity/2) {
+            XlSetEvent(wakeEvent);
+        }
+        return true;
+    }
+
+    bool AsyncLogger::ThreadBuffer::IsOwnerFinished()
+    {
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+            if (_ownerThread && WaitForSingleObject(_ownerThread, 0) == WAIT_OBJECT_0) {
+                Interlocked::Exchange(&_ownerFinished, 1);
+            }
+        #endif
+        return Interlocked::Load(&_ownerFinished) != 0;
+    }
+
+    AsyncLogger::ThreadBuffer::ThreadBuffer(uint32 capacity)
+    : _capacity(capacity)
+    {
+        _data = std::make_unique<uint64[]>(capacity / sizeof(uint64));
+        _writePos = _readPos = 0;
+        _droppedCount = 0;
+        _ownerFinished = 0;
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+            _ownerThread = OpenThread(SYNCHRONIZE, FALSE, GetCurrentThreadId());
+        #endif
+    }
+
+    AsyncLogger::ThreadBuffer::~ThreadBuffer()
+    {
+        #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+            if (_ownerThread) { CloseHandle(_ownerThread); }
+        #endif
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class AsyncLogger::Pimpl
+    {
+    public:
+        std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+        Threading::Mutex            _buffersLock;
+        uint32                      _threadBufferSize;
+        unsigned                    _writeIntervalMS;
+        unsigned                    _generation;
+        Desc::WriteMessageFn*       _writeMessage;
+
+        XlHandle                    _wakeEvent;
+        XlHandle                    _flushEvent;
+        Interlocked::Value volatile _flushRequested;
+        Interlocked::Value volatile _flushCompleted;
+        Interlocked::Value volatile _quit;
+        std::thread                 _writerThread;
+        bool                        _crashHandlerInstalled;
+
+        #if PLATFORMOS_TARGET != PLATFORMOS_WINDOWS
+            pthread_key_t           _threadExitKey;
+        #endif
+
+        ThreadBuffer*   RegisterThread();
+        void            WriterThread();
+        void            WritePending();
+    };
+
+    static AsyncLogger* volatile s_instance = nullptr;
+    static Interlocked::Value s_nextGeneration = 1;
+    static ASYNCLOG_THREAD_LOCAL AsyncLogger::ThreadBuffer* s_threadBuffer = nullptr;
+    static ASYNCLOG_THREAD_LOCAL unsigned s_threadBufferGeneration = 0;
+
+    #if PLATFORMOS_TARGET != PLATFORMOS_WINDOWS
+        static void OnThreadExit(void* buffer)
+        {
+            auto* b = (AsyncLogger::ThreadBuffer*)buffer;
+            if (s_threadBuffer == b) { s_threadBuffer = nullptr; }
+            Interlocked::Exchange(&b->_ownerFinished, 1);
+        }
+    #endif
+
+    auto AsyncLogger::Pimpl::RegisterThread() -> ThreadBuffer*
+    {
+        auto buffer = std::make_unique<ThreadBuffer>(_threadBufferSize);
+        auto* result = buffer.get();
+        #if PLATFORMOS_TARGET != PLATFORMOS_WINDOWS
+            pthread_setspecific(_threadExitKey, result);
+        #endif
+
+        {
+            ScopedLock(_buffersLock);
+            _buffers.push_back(std::move(buffer));
+        }
+
+        s_threadBuffer = result;
+        s_threadBufferGeneration = _generation;
+        return result;
+    }
+
+    static void FormatEntry(char dst[], size_t dstSize, const EntryHeader& header);
+
+    void AsyncLogger::Pimpl::WritePending()
+    {
+        class PendingEntry
+        {
+        public:
+            uint64              _timestamp;
+            const EntryHeader*  _header;
+        };
+
+        std::vector<ThreadBuffer*> buffers;
+        {
+            ScopedLock(_buffersLock);
+            buffers.reserve(_buffers.size());
+            for (const auto& b:_buffers) buffers.push_back(b.get());
+        }
+
+            //  Check if the owners have finished before reading the write positions.
+            //  Any entries written before the owner finished will be written during
+            //  this pass, and then we can destroy the buffer.
+        std::vector<ThreadBuffer*> finished;
+        for (auto* b:buffers) {
+            if (b->IsOwnerFinished()) finished.push_back(b);
+        }
+
+        std::vector<PendingEntry> pending;
+        std::vector<uint32> ends;
+        ends.reserve(buffers.size());
+        unsigned droppedCount = 0;
+        for (auto* b:buffers) {
+            auto read = uint32(b->_readPos);
+            auto write = uint32(Interlocked::Load(&b->_writePos));
+            const auto* data = (const uint8*)b->_data.get();
+            while (read != write) {
+                const auto* header = (const EntryHeader*)&data[read & (b->_capacity-1)];
+                if (header->_type != EntryType_Padding) {
+                    PendingEntry e = { header->_timestamp, header };
+                    pending.push_back(e);
+                }
+                read += header->_size;
+            }
+            ends.push_back(write);
+            droppedCount += unsigned(Interlocked::Exchange(&b->_droppedCount, 0));
+        }
+
+            //  Merge the entries from all threads into time order.
+        std::stable_sort(
+            pending.begin(), pending.end(),
+            [](const PendingEntry& lhs, const PendingEntry& rhs) { return lhs._timestamp < rhs._timestamp; });
+
+        char buffer[2048];
+        for (const auto& e:pending) {
+            FormatEntry(buffer, dimof(buffer), *e._header);
+            (*_writeMessage)(LogSeverity::Enum(e._header->_type), e._header->_verboseLevel, buffer);
+        }
+
+        if (droppedCount) {
+            _snprintf_s(buffer, _TRUNCATE, "(%u log messages dropped because the log queue was full)", droppedCount);
+            (*_writeMessage)(LogSeverity::Warning, 0, buffer);
+        }
+
+        for (size_t c=0; c<buffers.size(); ++c) {
+            Interlocked::Exchange(&buffers[c]->_readPos, Interlocked::Value(ends[c]));
+        }
+
+        if (!finished.empty()) {
+            ScopedLock(_buffersLock);
+            _buffers.erase(
+                std::remove_if(_buffers.begin(), _buffers.end(),
+                    [&](const std::unique_ptr<ThreadBuffer>& b)
+                    { return std::find(finished.begin(), finished.end(), b.get()) != finished.end(); }),
+                _buffers.end());
+        }
+    }
+
+    void AsyncLogger::Pimpl::WriterThread()
+    {
+        for (;;) {
+            XlWaitForSyncObject(_wakeEvent, _writeIntervalMS);
+
+                //  Anything logged before a flush request was made will be written
+                //  in this pass.
+            auto flushRequested = Interlocked::Load(&_flushRequested);
+            bool quit = Interlocked::Load(&_quit) != 0;
+
+            WritePending();
+
+            Interlocked::Exchange(&_flushCompleted, flushRequested);
+            XlSetEvent(_flushEvent);
+            if (quit) break;
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ArgWriter
+    {
+    public:
+        uint8*  _ptr;
+        uint8*  _end;
+
+        bool Write(uint64 value)
+        {
+            if ((_end - _ptr) < 8) return false;
+            *(uint64*)_ptr = value;
+            _ptr += 8;
+            return true;
+        }
+
+        bool Write(double value)
+        {
+            if ((_end - _ptr) < 8) return false;
+            *(double*)_ptr = value;
+            _ptr += 8;
+            return true;
+        }
+
+        template<typename CharType>
+            bool WriteString(const CharType* str)
+        {
+                //  Strings are truncated to fit in the entry
+            if ((_end - _ptr) < 16) return false;
+            auto maxChars = size_t(_end - _ptr - 8) / sizeof(CharType);
+            auto* dst = (CharType*)(_ptr + 4);
+            size_t c = 0;
+            for (; c<maxChars-1 && str[c]; ++c) dst[c] = str[c];
+            dst[c] = 0;
+            auto bytes = uint32((c+1) * sizeof(CharType));
+            *(uint32*)_ptr = bytes;
+            _ptr += (4 + bytes + 7) & ~7;
+            return true;
+        }
+    };
+
+    static const char s_nullString[] = "(null)";
+    static const wchar_t s_nullWideString[] = L"(null)";
+
+    bool AsyncLogger::Push(LogSeverity::Enum severity, unsigned verboseLevel, const char format[], va_list args)
+    {
+        auto* buffer = s_threadBuffer;
+        if (!buffer || s_threadBufferGeneration != _pimpl->_generation) {
+            buffer = _pimpl->RegisterThread();
+        }
+
+            //  Build the entry on the stack, then copy it into the ring buffer
+        uint64 entry[MaxEntrySize/sizeof(uint64)];
+        auto& header = *(EntryHeader*)entry;
+        header._type = uint8(severity);
+        header._verboseLevel = uint8(std::min(verboseLevel, 0xffu));
+        header._timestamp = GetPerformanceCounter();
+        header._format = uint64(size_t(format));
+
+        ArgWriter writer;
+        writer._ptr = (uint8*)PtrAdd(entry, sizeof(EntryHeader));
+        writer._end = (uint8*)PtrAdd(entry, sizeof(entry));
+
+        unsigned capturedSpecs = 0;
+        for (const char* i = format; *i; ++i) {
+            if (*i != '%') continue;
+            if (i[1] == '%') { ++i; continue; }
+
+            FormatSpec spec;
+            if (!ParseFormatSpec(spec, i+1)) break;
+
+            bool good = true;
+            if (spec._starWidth)        good &= writer.Write(uint64(int64(va_arg(args, int))));
+            if (spec._starPrecision)    good &= writer.Write(uint64(int64(va_arg(args, int))));
+
+            switch (spec._conversion) {
+            case 'd':
+            case 'i':
+                {
+                    int64 value;
+                    switch (spec._length) {
+                    case LengthModifier::Char:      value = (signed char)va_arg(args, int); break;
+                    case LengthModifier::Short:     value = short(va_arg(args, int)); break;
+                    case LengthModifier::Long:      value = va_arg(args, long); break;
+                    case LengthModifier::LongLong:
+                    case LengthModifier::IntMax:
+                    case LengthModifier::Int64:     value = va_arg(args, long long); break;
+                    case LengthModifier::Size:
+                    case LengthModifier::PtrDiff:   value = va_arg(args, ptrdiff_t); break;
+                    default:                        value = va_arg(args, int); break;
+                    }
+                    good &= writer.Write(uint64(value));
+                }
+                break;
+
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                {
+                    uint64 value;
+                    switch (spec._length) {
+                    case LengthModifier::Char:      value = (unsigned char)va_arg(args, unsigned); break;
+                    case LengthModifier::Short:     value = (unsigned short)va_arg(args, unsigned); break;
+                    case LengthModifier::Long:      value = va_arg(args, unsigned long); break;
+                    case LengthModifier::LongLong:
+                    case LengthModifier::IntMax:
+                    case LengthModifier::Int64:     value = va_arg(args, unsigned long long); break;
+                    case LengthModifier::Size:
+                    case LengthModifier::PtrDiff:   value = va_arg(args, size_t); break;
+                    default:                        value = va_arg(args, unsigned); break;
+                    }
+                    good &= writer.Write(value);
+                }
+                break;
+
+            case 'c':
+            case 'C':
+                    // (wint_t & char are promoted to int)
+                good &= writer.Write(uint64(va_arg(args, int)));
+                break;
+
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                if (spec._length == LengthModifier::LongDouble) { good &= writer.Write(double(va_arg(args, long double))); }
+                else { good &= writer.Write(va_arg(args, double)); }
+                break;
+
+            case 's':
+            case 'S':
+                if (IsWideString(spec)) {
+                    auto* str = va_arg(args, const wchar_t*);
+                    good &= writer.WriteString(str ? str : s_nullWideString);
+                } else {
+                    auto* str = va_arg(args, const char*);
+                    good &= writer.WriteString(str ? str : s_nullString);
+                }
+                break;
+
+            case 'p':
+                good &= writer.Write(uint64(size_t(va_arg(args, void*))));
+                break;
+
+            case 'n':
+                    //  (we never write back through %n)
+                va_arg(args, void*);
+                break;
+            }
+
+            if (!good) break;
+            ++capturedSpecs;
+            i = spec._end - 1;
+        }
+
+        header._capturedSpecs = uint16(capturedSpecs);
+        header._size = uint32((size_t(writer._ptr - (uint8*)entry) + 7) & ~size_t(7));
+
+        if (buffer->Write(entry, header._size, _pimpl->_wakeEvent)) {
+            return true;
+        }
+
+            //  The ring buffer is full. Less important messages are just dropped,
+            //  but the caller should write errors directly.
+        if (severity >= LogSeverity::Error) {
+            return false;
+        }
+        Interlocked::Increment(&buffer->_droppedCount);
+        return true;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ArgReader
+    {
+    public:
+        const uint8*    _ptr;
+
+        uint64 ReadInt()        { auto result = *(const uint64*)_ptr; _ptr += 8; return result; }
+        double ReadDouble()     { auto result = *(const double*)_ptr; _ptr += 8; return result; }
+
+        template<typename CharType>
+            const CharType* ReadString()
+        {
+            auto bytes = *(const uint32*)_ptr;
+            auto* result = (const CharType*)(_ptr + 4);
+            _ptr += (4 + bytes + 7) & ~7;
+            return result;
+        }
+    };
+
+    static void FormatEntry(char dst[], size_t dstSize, const EntryHeader& header)
+    {
+            //  Expand the format string using the captured arguments. Each format
+            //  specifier is rebuilt with the integer sizes we've captured (and the
+            //  '*' widths & precisions replaced with their values), and formatted
+            //  separately.
+        ArgReader reader;
+        reader._ptr = (const uint8*)PtrAdd(&header, sizeof(EntryHeader));
+
+        char* out = dst;
+        char* outEnd = dst + dstSize - 1;
+        unsigned specIndex = 0;
+        const char* i = (const char*)size_t(header._format);
+        while (*i && out < outEnd) {
+            if (*i != '%') { *out++ = *i++; continue; }
+            if (i[1] == '%') { *out++ = '%'; i+=2; continue; }
+
+            FormatSpec spec;
+            if (specIndex >= header._capturedSpecs || !ParseFormatSpec(spec, i+1)) {
+                    // (nothing more captured -- just copy in the rest)
+                while (*i && out < outEnd) *out++ = *i++;
+                break;
+            }
+            ++specIndex;
+
+            char specString[64];
+            char* s = specString;
+            *s++ = '%';
+            if (spec._starWidth || spec._starPrecision) {
+                for (const char* f = spec._flagsBegin; f < spec._flagsEnd; ++f) {
+                    if (*f == '*') {
+                        auto value = int(reader.ReadInt());
+                        if (s < specString + 20) {
+                            _snprintf_s(s, specString + 32 - s, _TRUNCATE, "%i", value);
+                            s += strlen(s);
+                        }
+                    } else if (s < specString + 32) {
+                        *s++ = *f;
+                    }
+                }
+            } else {
+                auto flagsLength = std::min(size_t(spec._flagsEnd - spec._flagsBegin), size_t(32));
+                memcpy(s, spec._flagsBegin, flagsLength);
+                s += flagsLength;
+            }
+
+            auto available = size_t(outEnd - out) + 1;
+            int written = 0;
+            switch (spec._conversion) {
+            case 'd':
+            case 'i':
+                s[0] = 'l'; s[1] = 'l'; s[2] = spec._conversion; s[3] = '\0';
+                written = _snprintf_s(out, available, _TRUNCATE, specString, (long long)reader.ReadInt());
+                break;
+
+            case 'u': case 'o': case 'x': case 'X':
+                s[0] = 'l'; s[1] = 'l'; s[2] = spec._conversion; s[3] = '\0';
+                written = _snprintf_s(out, available, _TRUNCATE, specString, (unsigned long long)reader.ReadInt());
+                break;
+
+            case 'c':
+            case 'C':
+                if (IsWideChar(spec)) {
+                    s[0] = 'l'; s[1] = 'c'; s[2] = '\0';
+                    written = _snprintf_s(out, available, _TRUNCATE, specString, wint_t(reader.ReadInt()));
+                } else {
+                    s[0] = 'c'; s[1] = '\0';
+                    written = _snprintf_s(out, available, _TRUNCATE, specString, int(reader.ReadInt()));
+                }
+                break;
+
+            case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+                s[0] = spec._conversion; s[1] = '\0';
+                written = _snprintf_s(out, available, _TRUNCATE, specString, reader.ReadDouble());
+                break;
+
+            case 's':
+            case 'S':
+                if (IsWideString(spec)) {
+                    s[0] = 'l'; s[1] = 's'; s[2] = '\0';
+                    written = _snprintf_s(out, available, _TRUNCATE, specString, reader.ReadString<wchar_t>());
+                } else {
+                    s[0] = 's'; s[1] = '\0';
+                    written = _snprintf_s(out, available, _TRUNCATE, specString, reader.ReadString<char>());
+                }
+                break;
+
+            case 'p':
+                s[0] = 'p'; s[1] = '\0';
+                written = _snprintf_s(out, available, _TRUNCATE, specString, (void*)size_t(reader.ReadInt()));
+                break;
+
+            case 'n':
+                break;
+            }
+
+                // (_snprintf_s returns -1 when the output is truncated)
+            out = (written < 0) ? outEnd : (out + written);
+            i = spec._end;
+        }
+        *out = '\0';
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const unsigned CrashFlushTimeoutMS = 2000;
+
+    #if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+
+        static LPTOP_LEVEL_EXCEPTION_FILTER s_previousExceptionFilter = nullptr;
+
+        static LONG WINAPI CrashExceptionFilter(EXCEPTION_POINTERS* exceptionInfo)
+        {
+            auto* logger = s_instance;
+            if (logger) { logger->Flush(CrashFlushTimeoutMS); }
+            return s_previousExceptionFilter ? s_previousExceptionFilter(exceptionInfo) : EXCEPTION_CONTINUE_SEARCH;
+        }
+
+        static void InstallCrashHandler()   { s_previousExceptionFilter = SetUnhandledExceptionFilter(&CrashExceptionFilter); }
+        static void RemoveCrashHandler()    { SetUnhandledExceptionFilter(s_previousExceptionFilter); s_previousExceptionFilter = nullptr; }
+
+    #else
+
+        static const int s_crashSignals[] = { SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL };
+        static struct sigaction s_previousSignalActions[dimof(s_crashSignals)];
+
+        static void CrashSignalHandler(int signal)
+        {
+                //  Flush, then restore the previous handler and raise the signal again.
+                //  This isn't strictly safe in a signal handler, but it's only a best
+                //  effort to get the last messages out before we go down.
+            auto* logger = s_instance;
+            if (logger) { logger->Flush(CrashFlushTimeoutMS); }
+            for (unsigned c=0; c<dimof(s_crashSignals); ++c) {
+                if (s_crashSignals[c] == signal) {
+                    sigaction(signal, &s_previousSignalActions[c], nullptr);
+                }
+            }
+            raise(signal);
+        }
+
+        static void InstallCrashHandler()
+        {
+            struct sigaction action;
+            XlZeroMemory(action);
+            action.sa_handler = &CrashSignalHandler;
+            sigemptyset(&action.sa_mask);
+            for (unsigned c=0; c<dimof(s_crashSignals); ++c) {
+                sigaction(s_crashSignals[c], &action, &s_previousSignalActions[c]);
+            }
+        }
+
+        static void RemoveCrashHandler()
+        {
+            for (unsigned c=0; c<dimof(s_crashSignals); ++c) {
+                sigaction(s_crashSignals[c], &s_previousSignalActions[c], nullptr);
+            }
+        }
+
+    #endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    bool AsyncLogger::Flush(unsigned timeoutMS)
+    {
+            //  (can't wait for ourselves, if we're called from a crash on the background thread)
+        if (std::this_thread::get_id() == _pimpl->_writerThread.get_id()) {
+            return false;
+        }
+
+        auto target = Interlocked::Increment(&_pimpl->_flushRequested) + 1;
+        XlSetEvent(_pimpl->_wakeEvent);
+
+        auto startTime = Millisecond_Now();
+        while (Interlocked::Value(Interlocked::Load(&_pimpl->_flushCompleted) - target) < 0) {
+            if ((Millisecond_Now() - startTime) >= timeoutMS) {
+                return false;
+            }
+            XlWaitForSyncObject(_pimpl->_flushEvent, 1);
+        }
+        return true;
+    }
+
+    AsyncLogger* AsyncLogger::GetInstance()
+    {
+        return s_instance;
+    }
+
+    AsyncLogger::AsyncLogger(const Desc& desc)
+    {
+        assert(!s_instance);
+
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_threadBufferSize = 4096;
+        while (_pimpl->_threadBufferSize < desc._threadBufferSize) {
+            _pimpl->_threadBufferSize <<= 1;
+        }
+        _pimpl->_writeIntervalMS = desc._writeIntervalMS;
+        _pimpl->_writeMessage = desc._writeMessage ? desc._writeMessage : &Internal::WriteLogMessage;
+        _pimpl->_generation = unsigned(Interlocked::Increment(&s_nextGeneration));
+        _pimpl->_wakeEvent = XlCreateEvent(false);
+        _pimpl->_flushEvent = XlCreateEvent(false);
+        _pimpl->_flushRequested = 0;
+        _pimpl->_flushCompleted = 0;
+        _pimpl->_quit = 0;
+
+        #if PLATFORMOS_TARGET != PLATFORMOS_WINDOWS
+            pthread_key_create(&_pimpl->_threadExitKey, &OnThreadExit);
+        #endif
+
+        auto* pimpl = _pimpl.get();
+        _pimpl->_writerThread = std::thread([pimpl]() { pimpl->WriterThread(); });
+
+        _pimpl->_crashHandlerInstalled = desc._flushOnCrash;
+        if (desc._flushOnCrash) {
+            InstallCrashHandler();
+        }
+
+        s_instance = this;
+    }
+
+    AsyncLogger::~AsyncLogger()
+    {
+        s_instance = nullptr;
+        if (_pimpl->_crashHandlerInstalled) {
+            RemoveCrashHandler();
+        }
+
+            //  The background thread writes everything that's left before it quits
+        Interlocked::Exchange(&_pimpl->_quit, 1);
+        XlSetEvent(_pimpl->_wakeEvent);
+        _pimpl->_writerThread.join();
+
+        #if PLATFORMOS_TARGET != PLATFORMOS_WINDOWS
+            pthread_key_delete(_pimpl->_threadExitKey);
+        #endif
+
+        XlCloseSyncObject(_pimpl->_wakeEvent);
+        XlCloseSyncObject(_pimpl->_flushEvent);
+    }
+
+    AsyncLogger::Desc::Desc()
+    {
+        _threadBufferSize = 64 * 1024;
+        _writeIntervalMS = 10;
+        _flushOnCrash = true;
+        _writeMessage = nullptr;
+    }
+}
+
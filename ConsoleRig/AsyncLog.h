@@ -0,0 +1,81 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include <stdarg.h>
+#include <memory>
+
+namespace ConsoleRig
+{
+    namespace LogSeverity { enum Enum { Verbose, Info, Warning, Error, Fatal }; }
+
+    /// <summary>Moves formatting and writing of log messages onto a background thread</summary>
+    /// While an AsyncLogger exists, the printf style logging functions (LogInfoF, LogWarningF, etc)
+    /// don't format or write their messages. Instead, they record the format string pointer and
+    /// the arguments into a lock free ring buffer that belongs to the calling thread. A dedicated
+    /// thread collects the entries from all threads (in time order), formats them and writes
+    /// them to the normal log output.
+    ///
+    /// Because only the format string pointer is recorded, the format string must still be valid
+    /// when the message is written. String literals are fine, unless they're in a DLL that will
+    /// be unloaded -- call Flush() before unloading. String arguments (%s) are copied.
+    ///
+    /// Memory is bounded by the ring buffer size for each thread. When a ring buffer is full,
+    /// verbose, info & warning messages are dropped (and a count of dropped messages is written
+    /// later). Errors are written directly on the calling thread instead. Fatal messages always
+    /// flush the queue, and are then written directly.
+    ///
+    /// The stream style macros (LogInfo << ...) still write directly.
+    ///
+    /// Only one AsyncLogger can exist at a time. It should be destroyed after other threads
+    /// have stopped logging.
+    class AsyncLogger
+    {
+    public:
+        class Desc
+        {
+        public:
+            unsigned    _threadBufferSize;      ///< bytes in the ring buffer for each thread (rounded up to a power of 2)
+            unsigned    _writeIntervalMS;       ///< how often the background thread checks for new entries
+            bool        _flushOnCrash;          ///< install a crash handler that writes any queued messages
+
+            typedef void (WriteMessageFn)(LogSeverity::Enum severity, unsigned verboseLevel, const char message[]);
+            WriteMessageFn* _writeMessage;      ///< called on the background thread with each formatted message (nullptr for the normal log output)
+
+            Desc();
+        };
+
+            /// <summary>Waits until all messages logged before this call have been written</summary>
+            /// Returns false if that doesn't happen within "timeoutMS"
+        bool Flush(unsigned timeoutMS = ~0u);
+
+            /// <summary>Queues a message for the background thread</summary>
+            /// Returns false if the message can't be queued (in which case the caller should
+            /// write it directly). Normally called by the logging functions in Log.h.
+        bool Push(LogSeverity::Enum severity, unsigned verboseLevel, const char format[], va_list args);
+
+        static AsyncLogger* GetInstance();
+
+        AsyncLogger(const Desc& desc = Desc());
+        ~AsyncLogger();
+
+        class ThreadBuffer;
+        class Pimpl;
+    protected:
+        std::unique_ptr<Pimpl> _pimpl;
+
+        AsyncLogger(const AsyncLogger&);
+        AsyncLogger& operator=(const AsyncLogger&);
+    };
+
+    namespace Internal
+    {
+            // Writes a formatted message to the log output directly (on the calling thread)
+        void WriteLogMessage(LogSeverity::Enum severity, unsigned verboseLevel, const char message[]);
+    }
+}
+
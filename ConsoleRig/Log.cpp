@@ -5,6 +5,7 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "Log.h"
+#include "AsyncLog.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Core/WinAPI/IncludeWindows.h"
 
@@ -39,6 +40,20 @@ namespace ConsoleRig
                 "trivial", easyloggingpp::internal::registeredLoggers->constants(), c));
         }
     }
+
+    namespace Internal
+    {
+        void WriteLogMessage(LogSeverity::Enum severity, unsigned verboseLevel, const char message[])
+        {
+            switch (severity) {
+            case LogSeverity::Verbose:  LogAlwaysVerbose(verboseLevel) << message; break;
+            case LogSeverity::Info:     LogAlwaysInfo << message; break;
+            case LogSeverity::Warning:  LogAlwaysWarning << message; break;
+            case LogSeverity::Error:    LogAlwaysError << message; break;
+            case LogSeverity::Fatal:    LogAlwaysFatal << message; break;
+            }
+        }
+    }
 }
 
 namespace LogUtilMethods
@@ -49,92 +64,92 @@ namespace LogUtilMethods
         //  handle long printf's.
     static const unsigned LogStringMaxLength = 2048;
 
-    void LogVerboseF(unsigned level, const char format[], ...)
+    static void LogF(ConsoleRig::LogSeverity::Enum severity, unsigned verboseLevel, const char format[], va_list args)
     {
+            //  If there's an AsyncLogger, the formatting & writing happens in the background.
+            //  Fatal messages are always written immediately (but after anything that's
+            //  already queued).
+        auto* asyncLogger = ConsoleRig::AsyncLogger::GetInstance();
+        if (asyncLogger) {
+            if (severity == ConsoleRig::LogSeverity::Fatal) {
+                asyncLogger->Flush();
+            } else {
+                    // (Push() consumes the arguments, and we might still need them)
+                va_list argsCopy;
+                va_copy(argsCopy, args);
+                bool queued = asyncLogger->Push(severity, verboseLevel, format, argsCopy);
+                va_end(argsCopy);
+                if (queued) return;
+            }
+        }
+
         char buffer[LogStringMaxLength];
+        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        ConsoleRig::Internal::WriteLogMessage(severity, verboseLevel, buffer);
+    }
+
+    void LogVerboseF(unsigned level, const char format[], ...)
+    {
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Verbose, level, format, args);
         va_end(args);
-
-        LogVerbose(level) << buffer;
     }
 
     void LogInfoF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Info, 0, format, args);
         va_end(args);
-
-        LogInfo << buffer;
     }
 
     void LogWarningF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Warning, 0, format, args);
         va_end(args);
-
-        LogWarning << buffer;
     }
     
     void LogAlwaysVerboseF(unsigned level, const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Verbose, level, format, args);
         va_end(args);
-
-        LogAlwaysVerbose(level) << buffer;
     }
 
     void LogAlwaysInfoF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Info, 0, format, args);
         va_end(args);
-
-        LogAlwaysInfo << buffer;
     }
 
     void LogAlwaysWarningF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Warning, 0, format, args);
         va_end(args);
-
-        LogAlwaysWarning << buffer;
     }
 
     void LogAlwaysErrorF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Error, 0, format, args);
         va_end(args);
-
-        LogAlwaysError << buffer;
     }
 
     void LogAlwaysFatalF(const char format[], ...)
     {
-        char buffer[LogStringMaxLength];
         va_list args;
         va_start(args, format);
-        _vsnprintf_s(buffer, _TRUNCATE, format, args);
+        LogF(ConsoleRig::LogSeverity::Fatal, 0, format, args);
         va_end(args);
-
-        LogAlwaysFatal << buffer;
     }
 }
 
@@ -94,35 +94,9 @@ namespace Math
 
     std::pair<Float3, Float3> TransformBoundingBox(const Float3x4& transformation, std::pair<Float3, Float3> boundingBox)
     {
-        Float3 corners[] = 
-        {
-            Float3(  boundingBox.first[0], boundingBox.first[1],  boundingBox.first[2] ),
-            Float3( boundingBox.second[0], boundingBox.first[1],  boundingBox.first[2] ),
-            Float3(  boundingBox.first[0], boundingBox.second[1], boundingBox.first[2] ),
-            Float3( boundingBox.second[0], boundingBox.second[1], boundingBox.first[2] ),
-
-            Float3(  boundingBox.first[0], boundingBox.first[1],  boundingBox.second[2] ),
-            Float3( boundingBox.second[0], boundingBox.first[1],  boundingBox.second[2] ),
-            Float3(  boundingBox.first[0], boundingBox.second[1], boundingBox.second[2] ),
-            Float3( boundingBox.second[0], boundingBox.second[1], boundingBox.second[2] )
-        };
-
-        for (unsigned c=0; c<dimof(corners); ++c) {
-            corners[c] = TransformPoint(transformation, corners[c]);
-        }
-
-        Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-        for (unsigned c=0; c<dimof(corners); ++c) {
-            mins[0] = std::min(mins[0], corners[c][0]);
-            mins[1] = std::min(mins[1], corners[c][1]);
-            mins[2] = std::min(mins[2], corners[c][2]);
-
-            maxs[0] = std::max(maxs[0], corners[c][0]);
-            maxs[1] = std::max(maxs[1], corners[c][1]);
-            maxs[2] = std::max(maxs[2], corners[c][2]);
-        }
-
-        return std::make_pair(mins, maxs);
+        std::pair<Float3, Float3> result;
+        TransformBoundingBoxes(&result, transformation, &boundingBox, 1);
+        return result;
     }
 
 }
\ No newline at end of file
@@ -22,6 +22,13 @@ namespace Math
 
     std::pair<Float3, Float3> TransformBoundingBox(const Float3x4& transformation, std::pair<Float3, Float3> boundingBox);
 
+        /// <summary>Transforms an array of axis aligned bounding boxes</summary>
+        /// Each result is the axis aligned box that encloses the transformed box, as with
+        /// TransformBoundingBox(). Uses SSE or AVX (see the array transformations in
+        /// Transformations.h). The destination can be the same array as the source.
+    void    TransformBoundingBoxes(std::pair<Float3, Float3> dst[], const Float3x4 transforms[], const std::pair<Float3, Float3> src[], size_t count);
+    void    TransformBoundingBoxes(std::pair<Float3, Float3> dst[], const Float3x4& transform, const std::pair<Float3, Float3> src[], size_t count);
+
     /// <summary>Conversion from cartesian to spherical polar coordinates</summary>
     /// Returns a 3 component vector with:
     ///     [0] = theta
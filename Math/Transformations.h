@@ -103,6 +103,8 @@ namespace Math
     void            Combine_InPlace(Float4x4& transform, RotationX rotation);
     void            Combine_InPlace(Float4x4& transform, RotationY rotation);
     void            Combine_InPlace(Float4x4& transform, RotationZ rotation);
+
+    void            Combine_InPlace(const Float4x4& firstTransform, Float4x4& transform);
     
 
     Float4x4        Combine(const Float3x3& rotation, const Float4x4& transform);
@@ -117,6 +119,32 @@ namespace Math
     Float3          TransformDirectionVector(const Float3x4& transform, Float3 pt);
     Float3          TransformDirectionVector(const Float4x4& transform, Float3 pt);
 
+        //
+        //      Array transformations
+        //
+        //      These do the same thing as the functions above, for whole arrays at a time.
+        //      They use SSE or AVX (depending on what the CPU supports, checked at runtime).
+        //      Results are the same as the single element functions, within floating point
+        //      precision. The destination can be the same array as one of the inputs.
+        //
+        //      The Combine() overloads that take a single matrix use it for every element
+        //      of the other array.
+        //
+    void            Combine(Float4x4 dst[], const Float4x4 firstTransforms[], const Float4x4 secondTransforms[], size_t count);
+    void            Combine(Float4x4 dst[], const Float4x4 firstTransforms[], const Float4x4& secondTransform, size_t count);
+    void            Combine(Float4x4 dst[], const Float4x4& firstTransform, const Float4x4 secondTransforms[], size_t count);
+    void            Combine(Float3x4 dst[], const Float3x4 firstTransforms[], const Float3x4 secondTransforms[], size_t count);
+    void            Combine(Float3x4 dst[], const Float3x4 firstTransforms[], const Float3x4& secondTransform, size_t count);
+    void            Combine(Float3x4 dst[], const Float3x4& firstTransform, const Float3x4 secondTransforms[], size_t count);
+
+    void            TransformPoints(Float3 dst[], const Float3x4& transform, const Float3 src[], size_t count);
+    void            TransformPoints(Float3 dst[], const Float4x4& transform, const Float3 src[], size_t count);
+    void            TransformDirectionVectors(Float3 dst[], const Float3x4& transform, const Float3 src[], size_t count);
+    void            TransformDirectionVectors(Float3 dst[], const Float4x4& transform, const Float3 src[], size_t count);
+
+    void            AsFloat4x4(Float4x4 dst[], const Quaternion src[], size_t count);
+    void            AsFloat3x3(Float3x3 dst[], const Quaternion src[], size_t count);
+
         //
         //      Orthonormal matrices have special properties. Use the following, instead
         //      of more general operations.
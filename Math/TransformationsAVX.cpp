@@ -0,0 +1,227 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+    //
+    //  This file is compiled with AVX code generation (/arch:AVX in the Windows
+    //  project files). See the note in TransformationsSIMD.h about what can be
+    //  included here.
+    //
+
+#include "TransformationsSIMD.h"
+
+#if defined(__AVX__)
+    #include <immintrin.h>
+#endif
+
+namespace Math { namespace Internal
+{
+
+#if defined(__AVX__)
+
+        //  Broadcast element "Element" of each 128 bit lane
+    #define SPLAT_LANES(v, Element) _mm256_permute_ps(v, _MM_SHUFFLE(Element, Element, Element, Element))
+
+    static __m256 LoadLanes(const float lane0[], const float lane1[])
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lane0)), _mm_loadu_ps(lane1), 1);
+    }
+
+    static void StoreLanes(float lane0[], float lane1[], __m256 v)
+    {
+        _mm_storeu_ps(lane0, _mm256_castps256_ps128(v));
+        _mm_storeu_ps(lane1, _mm256_extractf128_ps(v, 1));
+    }
+
+    static void TransposeLanes(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+    {
+            //  Same as _MM_TRANSPOSE4_PS, within each 128 bit lane
+        const __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+        const __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+        r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1,0,1,0));
+        r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3,2,3,2));
+        r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1,0,1,0));
+        r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3,2,3,2));
+    }
+
+    static size_t Combine4x4_AVX(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+            //  Calculate 2 rows of the result at a time (one in each lane). The rows
+            //  of "first" are duplicated in both lanes.
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*16;
+            const float* rhs = first + m*firstStep*16;
+            const __m256 r0 = _mm256_broadcast_ps((const __m128*)rhs);
+            const __m256 r1 = _mm256_broadcast_ps((const __m128*)(rhs+4));
+            const __m256 r2 = _mm256_broadcast_ps((const __m128*)(rhs+8));
+            const __m256 r3 = _mm256_broadcast_ps((const __m128*)(rhs+12));
+            const __m256 l01 = _mm256_loadu_ps(lhs), l23 = _mm256_loadu_ps(lhs+8);
+
+            const __m256 result01 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(SPLAT_LANES(l01, 0), r0), _mm256_mul_ps(SPLAT_LANES(l01, 1), r1)),
+                _mm256_mul_ps(SPLAT_LANES(l01, 2), r2)), _mm256_mul_ps(SPLAT_LANES(l01, 3), r3));
+            const __m256 result23 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+                _mm256_mul_ps(SPLAT_LANES(l23, 0), r0), _mm256_mul_ps(SPLAT_LANES(l23, 1), r1)),
+                _mm256_mul_ps(SPLAT_LANES(l23, 2), r2)), _mm256_mul_ps(SPLAT_LANES(l23, 3), r3));
+            _mm256_storeu_ps(&dst[m*16], result01);
+            _mm256_storeu_ps(&dst[m*16+8], result23);
+        }
+        _mm256_zeroupper();
+        return count;
+    }
+
+    static size_t Combine3x4_AVX(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+            //  As above, with an implied bottom row of (0,0,0,1) in both matrices. The third
+            //  row goes through both lanes, and we just store the bottom half.
+        const __m256 translationMask = _mm256_castsi256_ps(_mm256_set_epi32(-1, 0, 0, 0, -1, 0, 0, 0));
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*12;
+            const float* rhs = first + m*firstStep*12;
+            const __m256 r0 = _mm256_broadcast_ps((const __m128*)rhs);
+            const __m256 r1 = _mm256_broadcast_ps((const __m128*)(rhs+4));
+            const __m256 r2 = _mm256_broadcast_ps((const __m128*)(rhs+8));
+            const __m256 l01 = _mm256_loadu_ps(lhs), l22 = _mm256_broadcast_ps((const __m128*)(lhs+8));
+
+            const __m256 result01 = _mm256_add_ps(_mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(SPLAT_LANES(l01, 0), r0), _mm256_mul_ps(SPLAT_LANES(l01, 1), r1)),
+                _mm256_mul_ps(SPLAT_LANES(l01, 2), r2)), _mm256_and_ps(l01, translationMask));
+            const __m256 result22 = _mm256_add_ps(_mm256_add_ps(
+                _mm256_add_ps(_mm256_mul_ps(SPLAT_LANES(l22, 0), r0), _mm256_mul_ps(SPLAT_LANES(l22, 1), r1)),
+                _mm256_mul_ps(SPLAT_LANES(l22, 2), r2)), _mm256_and_ps(l22, translationMask));
+            _mm256_storeu_ps(&dst[m*12], result01);
+            _mm_storeu_ps(&dst[m*12+8], _mm256_castps256_ps128(result22));
+        }
+        _mm256_zeroupper();
+        return count;
+    }
+
+    static void LoadPoints8(__m256& x, __m256& y, __m256& z, const float src[])
+    {
+            //  Load 8 packed Float3s, and convert to structure-of-arrays form. The first
+            //  4 points go in the bottom lane, and the next 4 in the top lane.
+        const __m256 a = LoadLanes(src, src+12), b = LoadLanes(src+4, src+16), c = LoadLanes(src+8, src+20);
+        x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+        y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+        z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), c, _MM_SHUFFLE(3,0,2,0));
+    }
+
+    static void StorePoints8(float dst[], __m256 x, __m256 y, __m256 z)
+    {
+        StoreLanes(dst,   dst+12, _mm256_shuffle_ps(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(0,0,0,0)), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0)));
+        StoreLanes(dst+4, dst+16, _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)), _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0)));
+        StoreLanes(dst+8, dst+20, _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0)));
+    }
+
+    template<bool Translate>
+        static size_t TransformPoints_AVX(float dst[], const float transform[], const float src[], size_t count)
+    {
+        __m256 m[3][4];
+        for (unsigned r=0; r<3; ++r)
+            for (unsigned c=0; c<4; ++c)
+                m[r][c] = _mm256_broadcast_ss(&transform[r*4+c]);
+
+        size_t p = 0;
+        for (; (p+8)<=count; p+=8) {
+            __m256 x, y, z;
+            LoadPoints8(x, y, z, &src[p*3]);
+            __m256 result[3];
+            for (unsigned r=0; r<3; ++r) {
+                result[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[r][0], x), _mm256_mul_ps(m[r][1], y)), _mm256_mul_ps(m[r][2], z));
+                if (Translate) result[r] = _mm256_add_ps(result[r], m[r][3]);
+            }
+            StorePoints8(&dst[p*3], result[0], result[1], result[2]);
+        }
+        _mm256_zeroupper();
+        return p;
+    }
+
+    static size_t TransformBoundingBoxes_AVX(float dst[], const float transforms[], size_t transformStep, const float src[], size_t count)
+    {
+            //  2 boxes at a time, one in each lane
+        size_t b = 0;
+        for (; (b+2)<=count; b+=2) {
+            const float* t0 = transforms + b*transformStep*12;
+            const float* t1 = transforms + (b+1)*transformStep*12;
+            __m256 c0 = LoadLanes(t0, t1), c1 = LoadLanes(t0+4, t1+4), c2 = LoadLanes(t0+8, t1+8);
+            __m256 translation = _mm256_setzero_ps();
+            TransposeLanes(c0, c1, c2, translation);
+
+                //  (the second load overlaps the first, so we don't read past the end of the box)
+            const __m256 mins = LoadLanes(&src[b*6], &src[b*6+6]), maxs = LoadLanes(&src[b*6+2], &src[b*6+8]);
+            const __m256 a0 = _mm256_mul_ps(c0, SPLAT_LANES(mins, 0)), b0 = _mm256_mul_ps(c0, SPLAT_LANES(maxs, 1));
+            const __m256 a1 = _mm256_mul_ps(c1, SPLAT_LANES(mins, 1)), b1 = _mm256_mul_ps(c1, SPLAT_LANES(maxs, 2));
+            const __m256 a2 = _mm256_mul_ps(c2, SPLAT_LANES(mins, 2)), b2 = _mm256_mul_ps(c2, SPLAT_LANES(maxs, 3));
+            const __m256 lo = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_min_ps(a0, b0), _mm256_min_ps(a1, b1)), _mm256_min_ps(a2, b2)), translation);
+            const __m256 hi = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_max_ps(a0, b0), _mm256_max_ps(a1, b1)), _mm256_max_ps(a2, b2)), translation);
+
+                //  write (lo.xyz, hi.x) and then (lo.z, hi.xyz), overlapping
+            const __m256 t = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(0,0,2,2));
+            const __m256 part0 = _mm256_shuffle_ps(lo, t, _MM_SHUFFLE(2,0,1,0));
+            const __m256 part1 = _mm256_shuffle_ps(t, hi, _MM_SHUFFLE(2,1,2,0));
+            _mm_storeu_ps(&dst[b*6],   _mm256_castps256_ps128(part0));
+            _mm_storeu_ps(&dst[b*6+2], _mm256_castps256_ps128(part1));
+            _mm_storeu_ps(&dst[b*6+6], _mm256_extractf128_ps(part0, 1));
+            _mm_storeu_ps(&dst[b*6+8], _mm256_extractf128_ps(part1, 1));
+        }
+        _mm256_zeroupper();
+        return b;
+    }
+
+    static size_t QuaternionsToFloat4x4_AVX(float dst[], const float src[], size_t count)
+    {
+            //  8 quaternions at a time; the first 4 in the bottom lane, and the next 4 in the top lane
+        const __m256 one = _mm256_set1_ps(1.f), zero = _mm256_setzero_ps();
+        const __m128 lastRow = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+        size_t q = 0;
+        for (; (q+8)<=count; q+=8) {
+            const float* s = &src[q*4];
+            __m256 w = LoadLanes(s, s+16), x = LoadLanes(s+4, s+20), y = LoadLanes(s+8, s+24), z = LoadLanes(s+12, s+28);
+            TransposeLanes(w, x, y, z);
+
+            const __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+            const __m256 xx2 = _mm256_mul_ps(x, x2), yy2 = _mm256_mul_ps(y, y2), zz2 = _mm256_mul_ps(z, z2);
+            const __m256 xy2 = _mm256_mul_ps(x, y2), yz2 = _mm256_mul_ps(y, z2), zx2 = _mm256_mul_ps(z, x2);
+            const __m256 xw2 = _mm256_mul_ps(w, x2), yw2 = _mm256_mul_ps(w, y2), zw2 = _mm256_mul_ps(w, z2);
+
+            __m256 m00 = _mm256_sub_ps(_mm256_sub_ps(one, yy2), zz2), m01 = _mm256_sub_ps(xy2, zw2), m02 = _mm256_add_ps(zx2, yw2), m03 = zero;
+            __m256 m10 = _mm256_add_ps(xy2, zw2), m11 = _mm256_sub_ps(_mm256_sub_ps(one, zz2), xx2), m12 = _mm256_sub_ps(yz2, xw2), m13 = zero;
+            __m256 m20 = _mm256_sub_ps(zx2, yw2), m21 = _mm256_add_ps(yz2, xw2), m22 = _mm256_sub_ps(_mm256_sub_ps(one, xx2), yy2), m23 = zero;
+            TransposeLanes(m00, m01, m02, m03);
+            TransposeLanes(m10, m11, m12, m13);
+            TransposeLanes(m20, m21, m22, m23);
+
+            const __m256 rows[4][3] = { {m00, m10, m20}, {m01, m11, m21}, {m02, m12, m22}, {m03, m13, m23} };
+            for (unsigned c=0; c<4; ++c) {
+                float* lane0 = &dst[(q+c)*16];
+                float* lane1 = &dst[(q+c+4)*16];
+                StoreLanes(lane0,   lane1,   rows[c][0]);
+                StoreLanes(lane0+4, lane1+4, rows[c][1]);
+                StoreLanes(lane0+8, lane1+8, rows[c][2]);
+                _mm_storeu_ps(lane0+12, lastRow);
+                _mm_storeu_ps(lane1+12, lastRow);
+            }
+        }
+        _mm256_zeroupper();
+        return q;
+    }
+
+    #undef SPLAT_LANES
+
+    const TransformKernels TransformKernels_AVX =
+    {
+        &Combine4x4_AVX, &Combine3x4_AVX,
+        &TransformPoints_AVX<true>, &TransformPoints_AVX<false>,
+        &TransformBoundingBoxes_AVX, &QuaternionsToFloat4x4_AVX
+    };
+
+#else
+
+    const TransformKernels TransformKernels_AVX = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+
+#endif
+
+}}
+
@@ -0,0 +1,473 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TransformationsSIMD.h"
+#include "Transformations.h"
+#include "Geometry.h"
+#include "../Core/Prefix.h"
+#include <algorithm>
+
+#if (COMPILER_ACTIVE == COMPILER_TYPE_MSVC) || defined(__SSE2__)
+    #define TRANSFORMS_SSE
+    #include <immintrin.h>
+    #if COMPILER_ACTIVE == COMPILER_TYPE_MSVC
+        #include <intrin.h>
+    #endif
+#endif
+
+namespace Math
+{
+    using Internal::TransformKernels;
+
+    static_assert(sizeof(Float3) == 3*sizeof(float), "Array transformations expect tightly packed Float3s");
+    static_assert(sizeof(Float3x3) == 9*sizeof(float), "Array transformations expect tightly packed Float3x3s");
+    static_assert(sizeof(Float3x4) == 12*sizeof(float), "Array transformations expect tightly packed Float3x4s");
+    static_assert(sizeof(Float4x4) == 16*sizeof(float), "Array transformations expect tightly packed Float4x4s");
+    static_assert(sizeof(Quaternion) == 4*sizeof(float), "Array transformations expect tightly packed Quaternions");
+    static_assert(sizeof(std::pair<Float3, Float3>) == 6*sizeof(float), "Array transformations expect tightly packed bounding boxes");
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        //
+        //      Scalar kernels. These are used when there's no SIMD instruction set, and to
+        //      finish off the elements left over by the SIMD kernels. The order of operations
+        //      matches the SIMD kernels, so all elements get the same results.
+        //
+
+    static size_t Combine4x4_Scalar(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*16;
+            const float* rhs = first + m*firstStep*16;
+            float result[16];
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned c=0; c<4; ++c)
+                    result[r*4+c] = ((lhs[r*4+0] * rhs[c] + lhs[r*4+1] * rhs[4+c]) + lhs[r*4+2] * rhs[8+c]) + lhs[r*4+3] * rhs[12+c];
+            std::copy(result, &result[16], &dst[m*16]);
+        }
+        return count;
+    }
+
+    static size_t Combine3x4_Scalar(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*12;
+            const float* rhs = first + m*firstStep*12;
+            float result[12];
+            for (unsigned r=0; r<3; ++r) {
+                for (unsigned c=0; c<4; ++c)
+                    result[r*4+c] = (lhs[r*4+0] * rhs[c] + lhs[r*4+1] * rhs[4+c]) + lhs[r*4+2] * rhs[8+c];
+                result[r*4+3] += lhs[r*4+3];
+            }
+            std::copy(result, &result[12], &dst[m*12]);
+        }
+        return count;
+    }
+
+    static size_t TransformPoints_Scalar(float dst[], const float transform[], const float src[], size_t count)
+    {
+        for (size_t p=0; p<count; ++p) {
+            const float x = src[p*3+0], y = src[p*3+1], z = src[p*3+2];
+            for (unsigned r=0; r<3; ++r)
+                dst[p*3+r] = ((transform[r*4+0] * x + transform[r*4+1] * y) + transform[r*4+2] * z) + transform[r*4+3];
+        }
+        return count;
+    }
+
+    static size_t TransformDirectionVectors_Scalar(float dst[], const float transform[], const float src[], size_t count)
+    {
+        for (size_t p=0; p<count; ++p) {
+            const float x = src[p*3+0], y = src[p*3+1], z = src[p*3+2];
+            for (unsigned r=0; r<3; ++r)
+                dst[p*3+r] = (transform[r*4+0] * x + transform[r*4+1] * y) + transform[r*4+2] * z;
+        }
+        return count;
+    }
+
+    static size_t TransformBoundingBoxes_Scalar(float dst[], const float transforms[], size_t transformStep, const float src[], size_t count)
+    {
+            //  Rather than transforming all 8 corners, we can find the minimum and
+            //  maximum of each row of the transform independently (as in Graphics Gems,
+            //  "Transforming Axis-Aligned Bounding Boxes", Arvo 1990)
+        for (size_t b=0; b<count; ++b) {
+            const float* t = transforms + b*transformStep*12;
+            const float* mins = &src[b*6];
+            const float* maxs = &src[b*6+3];
+            float result[6];
+            for (unsigned r=0; r<3; ++r) {
+                const float a0 = t[r*4+0] * mins[0], b0 = t[r*4+0] * maxs[0];
+                const float a1 = t[r*4+1] * mins[1], b1 = t[r*4+1] * maxs[1];
+                const float a2 = t[r*4+2] * mins[2], b2 = t[r*4+2] * maxs[2];
+                result[r]   = ((std::min(a0, b0) + std::min(a1, b1)) + std::min(a2, b2)) + t[r*4+3];
+                result[3+r] = ((std::max(a0, b0) + std::max(a1, b1)) + std::max(a2, b2)) + t[r*4+3];
+            }
+            std::copy(result, &result[6], &dst[b*6]);
+        }
+        return count;
+    }
+
+    static size_t QuaternionsToFloat4x4_Scalar(float dst[], const float src[], size_t count)
+    {
+            //  Same as cml::matrix_rotation_quaternion (for column basis vectors)
+        for (size_t q=0; q<count; ++q) {
+            const float w = src[q*4+0], x = src[q*4+1], y = src[q*4+2], z = src[q*4+3];
+            const float x2 = x + x, y2 = y + y, z2 = z + z;
+            const float xx2 = x * x2, yy2 = y * y2, zz2 = z * z2;
+            const float xy2 = x * y2, yz2 = y * z2, zx2 = z * x2;
+            const float xw2 = w * x2, yw2 = w * y2, zw2 = w * z2;
+
+            float* m = &dst[q*16];
+            m[ 0] = (1.f - yy2) - zz2;  m[ 1] = xy2 - zw2;          m[ 2] = zx2 + yw2;          m[ 3] = 0.f;
+            m[ 4] = xy2 + zw2;          m[ 5] = (1.f - zz2) - xx2;  m[ 6] = yz2 - xw2;          m[ 7] = 0.f;
+            m[ 8] = zx2 - yw2;          m[ 9] = yz2 + xw2;          m[10] = (1.f - xx2) - yy2;  m[11] = 0.f;
+            m[12] = 0.f;                m[13] = 0.f;                m[14] = 0.f;                m[15] = 1.f;
+        }
+        return count;
+    }
+
+    static const TransformKernels s_scalarKernels =
+    {
+        &Combine4x4_Scalar, &Combine3x4_Scalar,
+        &TransformPoints_Scalar, &TransformDirectionVectors_Scalar,
+        &TransformBoundingBoxes_Scalar, &QuaternionsToFloat4x4_Scalar
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(TRANSFORMS_SSE)
+
+    template<int Element>
+        static __m128 Splat(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(Element, Element, Element, Element)); }
+
+    static size_t Combine4x4_SSE(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+            //  Each row of the result is a linear combination of the rows of "first",
+            //  weighted by the elements of the same row of "second"
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*16;
+            const float* rhs = first + m*firstStep*16;
+            const __m128 r0 = _mm_loadu_ps(rhs), r1 = _mm_loadu_ps(rhs+4), r2 = _mm_loadu_ps(rhs+8), r3 = _mm_loadu_ps(rhs+12);
+            __m128 result[4];
+            for (unsigned r=0; r<4; ++r) {
+                const __m128 l = _mm_loadu_ps(lhs + r*4);
+                result[r] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(Splat<0>(l), r0), _mm_mul_ps(Splat<1>(l), r1)),
+                    _mm_mul_ps(Splat<2>(l), r2)), _mm_mul_ps(Splat<3>(l), r3));
+            }
+            for (unsigned r=0; r<4; ++r)
+                _mm_storeu_ps(&dst[m*16+r*4], result[r]);
+        }
+        return count;
+    }
+
+    static size_t Combine3x4_SSE(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count)
+    {
+            //  As above, with an implied bottom row of (0,0,0,1) in both matrices
+        const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        for (size_t m=0; m<count; ++m) {
+            const float* lhs = second + m*secondStep*12;
+            const float* rhs = first + m*firstStep*12;
+            const __m128 r0 = _mm_loadu_ps(rhs), r1 = _mm_loadu_ps(rhs+4), r2 = _mm_loadu_ps(rhs+8);
+            __m128 result[3];
+            for (unsigned r=0; r<3; ++r) {
+                const __m128 l = _mm_loadu_ps(lhs + r*4);
+                result[r] = _mm_add_ps(_mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(Splat<0>(l), r0), _mm_mul_ps(Splat<1>(l), r1)),
+                    _mm_mul_ps(Splat<2>(l), r2)), _mm_and_ps(l, translationMask));
+            }
+            for (unsigned r=0; r<3; ++r)
+                _mm_storeu_ps(&dst[m*12+r*4], result[r]);
+        }
+        return count;
+    }
+
+    static void LoadPoints4(__m128& x, __m128& y, __m128& z, const float src[])
+    {
+            //  Load 4 packed Float3s, and convert to structure-of-arrays form
+        const __m128 a = _mm_loadu_ps(src), b = _mm_loadu_ps(src+4), c = _mm_loadu_ps(src+8);
+        x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,3,0));
+        y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0,0,1,1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2,2,3,3)), _MM_SHUFFLE(2,0,2,0));
+        z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1,1,2,2)), c, _MM_SHUFFLE(3,0,2,0));
+    }
+
+    static void StorePoints4(float dst[], __m128 x, __m128 y, __m128 z)
+    {
+        _mm_storeu_ps(dst,   _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(0,0,0,0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0)), _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_ps(dst+4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1,1,1,1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2,2,2,2)), _MM_SHUFFLE(2,0,2,0)));
+        _mm_storeu_ps(dst+8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3,3,2,2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(2,0,2,0)));
+    }
+
+    template<bool Translate>
+        static size_t TransformPoints_SSE(float dst[], const float transform[], const float src[], size_t count)
+    {
+        __m128 m[3][4];
+        for (unsigned r=0; r<3; ++r)
+            for (unsigned c=0; c<4; ++c)
+                m[r][c] = _mm_set1_ps(transform[r*4+c]);
+
+        size_t p = 0;
+        for (; (p+4)<=count; p+=4) {
+            __m128 x, y, z;
+            LoadPoints4(x, y, z, &src[p*3]);
+            __m128 result[3];
+            for (unsigned r=0; r<3; ++r) {
+                result[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m[r][0], x), _mm_mul_ps(m[r][1], y)), _mm_mul_ps(m[r][2], z));
+                if (Translate) result[r] = _mm_add_ps(result[r], m[r][3]);
+            }
+            StorePoints4(&dst[p*3], result[0], result[1], result[2]);
+        }
+        return p;
+    }
+
+    static size_t TransformBoundingBoxes_SSE(float dst[], const float transforms[], size_t transformStep, const float src[], size_t count)
+    {
+        for (size_t b=0; b<count; ++b) {
+                //  Transpose, so we have the columns of the transform (and the translation)
+            const float* t = transforms + b*transformStep*12;
+            __m128 c0 = _mm_loadu_ps(t), c1 = _mm_loadu_ps(t+4), c2 = _mm_loadu_ps(t+8), translation = _mm_setzero_ps();
+            _MM_TRANSPOSE4_PS(c0, c1, c2, translation);
+
+                //  (the second load overlaps the first, so we don't read past the end of the box)
+            const __m128 mins = _mm_loadu_ps(&src[b*6]), maxs = _mm_loadu_ps(&src[b*6+2]);
+            const __m128 a0 = _mm_mul_ps(c0, Splat<0>(mins)), b0 = _mm_mul_ps(c0, Splat<1>(maxs));
+            const __m128 a1 = _mm_mul_ps(c1, Splat<1>(mins)), b1 = _mm_mul_ps(c1, Splat<2>(maxs));
+            const __m128 a2 = _mm_mul_ps(c2, Splat<2>(mins)), b2 = _mm_mul_ps(c2, Splat<3>(maxs));
+            const __m128 lo = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_min_ps(a0, b0), _mm_min_ps(a1, b1)), _mm_min_ps(a2, b2)), translation);
+            const __m128 hi = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_max_ps(a0, b0), _mm_max_ps(a1, b1)), _mm_max_ps(a2, b2)), translation);
+
+                //  write (lo.xyz, hi.x) and then (lo.z, hi.xyz), overlapping
+            const __m128 t0 = _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(0,0,2,2));
+            _mm_storeu_ps(&dst[b*6],   _mm_shuffle_ps(lo, t0, _MM_SHUFFLE(2,0,1,0)));
+            _mm_storeu_ps(&dst[b*6+2], _mm_shuffle_ps(t0, hi, _MM_SHUFFLE(2,1,2,0)));
+        }
+        return count;
+    }
+
+    static size_t QuaternionsToFloat4x4_SSE(float dst[], const float src[], size_t count)
+    {
+        const __m128 one = _mm_set1_ps(1.f), zero = _mm_setzero_ps();
+        const __m128 lastRow = _mm_set_ps(1.f, 0.f, 0.f, 0.f);
+        size_t q = 0;
+        for (; (q+4)<=count; q+=4) {
+            __m128 w = _mm_loadu_ps(&src[q*4]), x = _mm_loadu_ps(&src[q*4+4]), y = _mm_loadu_ps(&src[q*4+8]), z = _mm_loadu_ps(&src[q*4+12]);
+            _MM_TRANSPOSE4_PS(w, x, y, z);
+
+            const __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+            const __m128 xx2 = _mm_mul_ps(x, x2), yy2 = _mm_mul_ps(y, y2), zz2 = _mm_mul_ps(z, z2);
+            const __m128 xy2 = _mm_mul_ps(x, y2), yz2 = _mm_mul_ps(y, z2), zx2 = _mm_mul_ps(z, x2);
+            const __m128 xw2 = _mm_mul_ps(w, x2), yw2 = _mm_mul_ps(w, y2), zw2 = _mm_mul_ps(w, z2);
+
+            __m128 m00 = _mm_sub_ps(_mm_sub_ps(one, yy2), zz2), m01 = _mm_sub_ps(xy2, zw2), m02 = _mm_add_ps(zx2, yw2), m03 = zero;
+            __m128 m10 = _mm_add_ps(xy2, zw2), m11 = _mm_sub_ps(_mm_sub_ps(one, zz2), xx2), m12 = _mm_sub_ps(yz2, xw2), m13 = zero;
+            __m128 m20 = _mm_sub_ps(zx2, yw2), m21 = _mm_add_ps(yz2, xw2), m22 = _mm_sub_ps(_mm_sub_ps(one, xx2), yy2), m23 = zero;
+            _MM_TRANSPOSE4_PS(m00, m01, m02, m03);
+            _MM_TRANSPOSE4_PS(m10, m11, m12, m13);
+            _MM_TRANSPOSE4_PS(m20, m21, m22, m23);
+
+            const __m128 rows[4][3] = { {m00, m10, m20}, {m01, m11, m21}, {m02, m12, m22}, {m03, m13, m23} };
+            for (unsigned c=0; c<4; ++c) {
+                float* m = &dst[(q+c)*16];
+                _mm_storeu_ps(m,    rows[c][0]);
+                _mm_storeu_ps(m+4,  rows[c][1]);
+                _mm_storeu_ps(m+8,  rows[c][2]);
+                _mm_storeu_ps(m+12, lastRow);
+            }
+        }
+        return q;
+    }
+
+    static const TransformKernels s_sseKernels =
+    {
+        &Combine4x4_SSE, &Combine3x4_SSE,
+        &TransformPoints_SSE<true>, &TransformPoints_SSE<false>,
+        &TransformBoundingBoxes_SSE, &QuaternionsToFloat4x4_SSE
+    };
+
+    static bool CPUSupportsAVX()
+    {
+        #if COMPILER_ACTIVE == COMPILER_TYPE_MSVC
+                //  The OS must also be saving the upper halves of the YMM registers
+                //  on context switches (which we check with xgetbv)
+            int info[4];
+            __cpuid(info, 1);
+            const bool osxsave = (info[2] & (1<<27)) != 0;
+            const bool avx = (info[2] & (1<<28)) != 0;
+            return osxsave && avx && ((_xgetbv(0) & 6) == 6);
+        #elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx") != 0;
+        #else
+            return false;
+        #endif
+    }
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static const TransformKernels* const* GetKernels()
+    {
+            //  Returns the kernel sets to use, from fastest to slowest. The scalar kernels
+            //  are always last, and they always finish off all elements.
+            //  The selection is made on first use. Threads racing through here will all come
+            //  to the same result (and the chains are constant), so it doesn't matter which
+            //  write sticks.
+        static const TransformKernels* const scalarChain[] = { &s_scalarKernels };
+        #if defined(TRANSFORMS_SSE)
+            static const TransformKernels* const sseChain[] = { &s_sseKernels, &s_scalarKernels };
+            static const TransformKernels* const avxChain[] = { &Internal::TransformKernels_AVX, &s_sseKernels, &s_scalarKernels };
+        #endif
+
+        static const TransformKernels* const* volatile selected = nullptr;
+        auto* result = selected;
+        if (!result) {
+            result = scalarChain;
+            #if defined(TRANSFORMS_SSE)
+                result = sseChain;
+                if (Internal::TransformKernels_AVX._combine4x4 && CPUSupportsAVX())
+                    result = avxChain;
+            #endif
+            selected = result;
+        }
+        return result;
+    }
+
+    static float* AsFloats(Float3* v)                           { return &(*v)[0]; }
+    static const float* AsFloats(const Float3* v)               { return &(*v)[0]; }
+    static float* AsFloats(Float3x4* m)                         { return &(*m)(0,0); }
+    static const float* AsFloats(const Float3x4* m)             { return &(*m)(0,0); }
+    static float* AsFloats(Float4x4* m)                         { return &(*m)(0,0); }
+    static const float* AsFloats(const Float4x4* m)             { return &(*m)(0,0); }
+    static float* AsFloats(std::pair<Float3, Float3>* b)        { return &b->first[0]; }
+    static const float* AsFloats(const std::pair<Float3, Float3>* b) { return &b->first[0]; }
+    static const float* AsFloats(const Quaternion* q)           { return &(*q)[0]; }
+
+    template<typename Matrix>
+        static void CombineArray(
+            size_t (*TransformKernels::*kernel)(float[], const float[], size_t, const float[], size_t, size_t),
+            Matrix dst[], const Matrix first[], size_t firstStep, const Matrix second[], size_t secondStep, size_t count)
+    {
+        size_t i = 0;
+        for (auto k=GetKernels(); i<count; ++k)
+            i += ((*k)->*kernel)(
+                AsFloats(&dst[i]), AsFloats(&first[i*firstStep]), firstStep,
+                AsFloats(&second[i*secondStep]), secondStep, count-i);
+    }
+
+    void Combine(Float4x4 dst[], const Float4x4 firstTransforms[], const Float4x4 secondTransforms[], size_t count)
+    {
+        CombineArray(&TransformKernels::_combine4x4, dst, firstTransforms, 1, secondTransforms, 1, count);
+    }
+
+    void Combine(Float4x4 dst[], const Float4x4 firstTransforms[], const Float4x4& secondTransform, size_t count)
+    {
+        CombineArray(&TransformKernels::_combine4x4, dst, firstTransforms, 1, &secondTransform, 0, count);
+    }
+
+    void Combine(Float4x4 dst[], const Float4x4& firstTransform, const Float4x4 secondTransforms[], size_t count)
+    {
+        CombineArray(&TransformKernels::_combine4x4, dst, &firstTransform, 0, secondTransforms, 1, count);
+    }
+
+    void Combine(Float3x4 dst[], const Float3x4 firstTransforms[], const Float3x4 secondTransforms[], size_t count)
+    {
+        CombineArray(&TransformKernels::_combine3x4, dst, firstTransforms, 1, secondTransforms, 1, count);
+    }
+
+    void Combine(Float3x4 dst[], const Float3x4 firstTransforms[], const Float3x4& secondTransform, size_t count)
+    {
+        CombineArray(&TransformKernels::_combine3x4, dst, firstTransforms, 1, &secondTransform, 0, count);
+    }
+
+    void Combine(Float3x4 dst[], const Float3x4& firstTransform, const Float3x4 secondTransforms[], size_t count)
+    {
+        CombineArray(&TransformKernels::_combine3x4, dst, &firstTransform, 0, secondTransforms, 1, count);
+    }
+
+    void Combine_InPlace(const Float4x4& firstTransform, Float4x4& transform)
+    {
+            //  (the combine kernels never leave elements behind, so the first set will do)
+        (*GetKernels())->_combine4x4(AsFloats(&transform), AsFloats(&firstTransform), 0, AsFloats(&transform), 0, 1);
+    }
+
+    static void TransformArray(
+        size_t (*TransformKernels::*kernel)(float[], const float[], const float[], size_t),
+        Float3 dst[], const float transform[], const Float3 src[], size_t count)
+    {
+        size_t i = 0;
+        for (auto k=GetKernels(); i<count; ++k)
+            i += ((*k)->*kernel)(AsFloats(&dst[i]), transform, AsFloats(&src[i]), count-i);
+    }
+
+    void TransformPoints(Float3 dst[], const Float3x4& transform, const Float3 src[], size_t count)
+    {
+        TransformArray(&TransformKernels::_transformPoints, dst, AsFloats(&transform), src, count);
+    }
+
+    void TransformPoints(Float3 dst[], const Float4x4& transform, const Float3 src[], size_t count)
+    {
+        TransformArray(&TransformKernels::_transformPoints, dst, AsFloats(&transform), src, count);
+    }
+
+    void TransformDirectionVectors(Float3 dst[], const Float3x4& transform, const Float3 src[], size_t count)
+    {
+        TransformArray(&TransformKernels::_transformDirectionVectors, dst, AsFloats(&transform), src, count);
+    }
+
+    void TransformDirectionVectors(Float3 dst[], const Float4x4& transform, const Float3 src[], size_t count)
+    {
+        TransformArray(&TransformKernels::_transformDirectionVectors, dst, AsFloats(&transform), src, count);
+    }
+
+    static void TransformBoundingBoxArray(
+        std::pair<Float3, Float3> dst[], const Float3x4 transforms[], size_t transformStep,
+        const std::pair<Float3, Float3> src[], size_t count)
+    {
+        size_t i = 0;
+        for (auto k=GetKernels(); i<count; ++k)
+            i += (*k)->_transformBoundingBoxes(
+                AsFloats(&dst[i]), AsFloats(&transforms[i*transformStep]), transformStep,
+                AsFloats(&src[i]), count-i);
+    }
+
+    void TransformBoundingBoxes(
+        std::pair<Float3, Float3> dst[], const Float3x4 transforms[],
+        const std::pair<Float3, Float3> src[], size_t count)
+    {
+        TransformBoundingBoxArray(dst, transforms, 1, src, count);
+    }
+
+    void TransformBoundingBoxes(
+        std::pair<Float3, Float3> dst[], const Float3x4& transform,
+        const std::pair<Float3, Float3> src[], size_t count)
+    {
+        TransformBoundingBoxArray(dst, &transform, 0, src, count);
+    }
+
+    void AsFloat4x4(Float4x4 dst[], const Quaternion src[], size_t count)
+    {
+        size_t i = 0;
+        for (auto k=GetKernels(); i<count; ++k)
+            i += (*k)->_quaternionsToFloat4x4(AsFloats(&dst[i]), AsFloats(&src[i]), count-i);
+    }
+
+    void AsFloat3x3(Float3x3 dst[], const Quaternion src[], size_t count)
+    {
+            //  Convert blocks to 4x4 on the stack, and then copy out the rotation part
+        Float4x4 temp[32];
+        for (size_t i=0; i<count; i+=dimof(temp)) {
+            auto blockCount = std::min(count-i, dimof(temp));
+            AsFloat4x4(temp, &src[i], blockCount);
+            for (size_t c=0; c<blockCount; ++c)
+                for (unsigned r=0; r<3; ++r) {
+                    dst[i+c](r, 0) = temp[c](r, 0);
+                    dst[i+c](r, 1) = temp[c](r, 1);
+                    dst[i+c](r, 2) = temp[c](r, 2);
+                }
+        }
+    }
+}
+
@@ -0,0 +1,57 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include <stddef.h>
+
+namespace Math { namespace Internal
+{
+        //
+        //      Kernels for the array transformations in Transformations.h.
+        //      This is only for TransformationsSIMD.cpp & TransformationsAVX.cpp -- use the
+        //      functions in Transformations.h & Geometry.h instead.
+        //
+        //      The kernels work on raw floats, with the same memory layout as the
+        //      math types:
+        //          Float4x4        16 floats, row major
+        //          Float3x4        12 floats, row major
+        //          Float3          3 floats
+        //          Quaternion      4 floats (w, x, y, z)
+        //          bounding box    6 floats (mins, then maxs)
+        //
+        //      The point & direction kernels take the top 3 rows of the transform (12 floats),
+        //      so they work for both Float3x4 & Float4x4.
+        //
+        //      Matrix array inputs have a "step" (in matrices) that is either 1, or 0 to use
+        //      the same matrix for every element.
+        //
+        //      Each kernel returns the number of elements it has processed, starting from
+        //      the beginning of the arrays. SIMD kernels may leave a few elements at the end,
+        //      and those should be finished off with the next kernel set down.
+        //
+        //      TransformationsAVX.cpp is compiled with AVX code generation. So it must not
+        //      include inline functions or templates that are also used by other translation
+        //      units (otherwise the linker might choose the AVX version of that function for
+        //      everyone). That's why this header doesn't use the math types.
+        //
+    class TransformKernels
+    {
+    public:
+        size_t (*_combine4x4)(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count);
+        size_t (*_combine3x4)(float dst[], const float first[], size_t firstStep, const float second[], size_t secondStep, size_t count);
+        size_t (*_transformPoints)(float dst[], const float transform[], const float src[], size_t count);
+        size_t (*_transformDirectionVectors)(float dst[], const float transform[], const float src[], size_t count);
+        size_t (*_transformBoundingBoxes)(float dst[], const float transforms[], size_t transformStep, const float src[], size_t count);
+        size_t (*_quaternionsToFloat4x4)(float dst[], const float src[], size_t count);
+    };
+
+        //  Kernels from TransformationsAVX.cpp. These are all null if that file wasn't
+        //  compiled with AVX code generation. Only use them after checking that the CPU
+        //  and OS support AVX.
+    extern const TransformKernels TransformKernels_AVX;
+}}
+
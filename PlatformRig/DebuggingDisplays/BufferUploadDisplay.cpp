@@ -7,7 +7,7 @@
 #include "BufferUploadDisplay.h"
 #include "../../Utility/MemoryUtils.h"
 #include "../../Utility/PtrUtils.h"
-#include "../../Utility/StringFormat.h"
+#include "../../Utility/StringFormatTyped.h"
 #include "../../Utility/StringUtils.h"
 #include <assert.h>
 
@@ -90,19 +90,19 @@ namespace PlatformRig { namespace Overlays
         char buffer[2048];
         if (desc._type == BufferDesc::Type::Texture) {
             const TextureDesc& tDesc = desc._textureDesc;
-            xl_snprintf(buffer, dimof(buffer), "[%s] Tex(%s) (%4ix%4i) mips:(%i)", 
+            XlFormat(buffer, "[%s] Tex(%s) (%4ix%4i) mips:(%i)", 
                 desc._name, (tDesc._dimensionality==TextureDesc::Dimensionality::T2D)?"  2D":"Cube",
                 tDesc._width, tDesc._height, tDesc._mipCount);
         } else if (desc._type == BufferDesc::Type::LinearBuffer) {
             if (desc._bindFlags & BindFlag::VertexBuffer) {
-                xl_snprintf(buffer, dimof(buffer), "[%s] VB (%6.2fkb)", 
+                XlFormat(buffer, "[%s] VB (%6.2fkb)", 
                     desc._name, desc._linearBufferDesc._sizeInBytes/1024.f);
             } else if (desc._bindFlags & BindFlag::IndexBuffer) {
-                xl_snprintf(buffer, dimof(buffer), "[%s] IB (%6.2fkb)", 
+                XlFormat(buffer, "[%s] IB (%6.2fkb)", 
                     desc._name, desc._linearBufferDesc._sizeInBytes/1024.f);
             }
         } else {
-            xl_snprintf(buffer, dimof(buffer), "Unknown");
+            XlFormat(buffer, "Unknown");
         }
         return std::string(buffer);
     }
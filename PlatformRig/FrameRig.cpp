@@ -198,6 +198,8 @@ namespace PlatformRig
         ////////////////////////////////
 
         auto renderRes = renderFunction(context);
+        RenderOverlays::OnFontSystemFrameBarrier();
+        RenderCore::Techniques::ResourceBoxes_OnFrameBarrier();
 
         ////////////////////////////////
 
@@ -0,0 +1,256 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "CPUSkinning.h"
+#include "../../Core/Prefix.h"
+#include "../../Utility/PtrUtils.h"
+#include <assert.h>
+
+#if (COMPILER_ACTIVE == COMPILER_TYPE_MSVC) || defined(__SSE__)
+    #define CPUSKINNING_SSE
+    #include <immintrin.h>
+#endif
+
+namespace RenderCore { namespace Assets
+{
+    SkinningStreams::SkinningStreams()
+    : _positions(nullptr), _normals(nullptr), _geoStride(0)
+    , _weights(nullptr), _jointIndices(nullptr), _bindingStride(0) {}
+
+    SkinningOutput::SkinningOutput()
+    : _positions(nullptr), _normals(nullptr), _stride(0) {}
+
+    static void CopyVertices(
+        const SkinningOutput& dst, const SkinningStreams& src,
+        size_t begin, size_t end)
+    {
+        for (auto v=begin; v<end; ++v) {
+            auto* srcPos = PtrAdd(src._positions, v*src._geoStride);
+            auto* dstPos = PtrAdd(dst._positions, v*dst._stride);
+            dstPos[0] = srcPos[0]; dstPos[1] = srcPos[1]; dstPos[2] = srcPos[2];
+            if (dst._normals && src._normals) {
+                auto* srcNormal = PtrAdd(src._normals, v*src._geoStride);
+                auto* dstNormal = PtrAdd(dst._normals, v*dst._stride);
+                dstNormal[0] = srcNormal[0]; dstNormal[1] = srcNormal[1]; dstNormal[2] = srcNormal[2];
+            }
+        }
+    }
+
+    static void SkinVertices_Scalar(
+        const SkinningOutput& dst, const SkinningStreams& src,
+        size_t begin, size_t end,
+        unsigned influenceCount, const Float3x4 jointTransforms[])
+    {
+            //  The order of operations here must match SkinBlocks() exactly,
+            //  so that the two give the same results.
+        for (auto v=begin; v<end; ++v) {
+            auto* srcPos = PtrAdd(src._positions, v*src._geoStride);
+            auto* srcNormal = (dst._normals && src._normals) ? PtrAdd(src._normals, v*src._geoStride) : nullptr;
+            auto* weights = PtrAdd(src._weights, v*src._bindingStride);
+            auto* jointIndices = PtrAdd(src._jointIndices, v*src._bindingStride);
+
+            float px = 0.f, py = 0.f, pz = 0.f;
+            float nx = 0.f, ny = 0.f, nz = 0.f;
+            for (unsigned c=0; c<influenceCount; ++c) {
+                const auto& j = jointTransforms[jointIndices[c]];
+                const float w = float(weights[c]) / 255.f;
+
+                const float tx = ((j(0,0) * srcPos[0] + j(0,1) * srcPos[1]) + j(0,2) * srcPos[2]) + j(0,3);
+                const float ty = ((j(1,0) * srcPos[0] + j(1,1) * srcPos[1]) + j(1,2) * srcPos[2]) + j(1,3);
+                const float tz = ((j(2,0) * srcPos[0] + j(2,1) * srcPos[1]) + j(2,2) * srcPos[2]) + j(2,3);
+                px = px + w * tx; py = py + w * ty; pz = pz + w * tz;
+
+                if (srcNormal) {
+                    const float rx = (j(0,0) * srcNormal[0] + j(0,1) * srcNormal[1]) + j(0,2) * srcNormal[2];
+                    const float ry = (j(1,0) * srcNormal[0] + j(1,1) * srcNormal[1]) + j(1,2) * srcNormal[2];
+                    const float rz = (j(2,0) * srcNormal[0] + j(2,1) * srcNormal[1]) + j(2,2) * srcNormal[2];
+                    nx = nx + w * rx; ny = ny + w * ry; nz = nz + w * rz;
+                }
+            }
+
+            auto* dstPos = PtrAdd(dst._positions, v*dst._stride);
+            dstPos[0] = px; dstPos[1] = py; dstPos[2] = pz;
+            if (srcNormal) {
+                auto* dstNormal = PtrAdd(dst._normals, v*dst._stride);
+                dstNormal[0] = nx; dstNormal[1] = ny; dstNormal[2] = nz;
+            }
+        }
+    }
+
+    void SkinVertices_Reference(
+        const SkinningOutput& dst, const SkinningStreams& src, size_t vertexCount,
+        unsigned influenceCount, const Float3x4 jointTransforms[])
+    {
+        assert(influenceCount == 0 || influenceCount == 1 || influenceCount == 2 || influenceCount == 4);
+        if (!influenceCount) {
+            CopyVertices(dst, src, 0, vertexCount);
+        } else {
+            SkinVertices_Scalar(dst, src, 0, vertexCount, influenceCount, jointTransforms);
+        }
+    }
+
+#if defined(CPUSKINNING_SSE)
+
+        //  "Lanes" classes wrap the vector instruction set, so the same SkinBlocks()
+        //  implementation can be used for both SSE and AVX.
+    class SSELanes
+    {
+    public:
+        typedef __m128 Vector;
+        static const unsigned Width = 4;
+
+        static Vector Zero()                        { return _mm_setzero_ps(); }
+        static Vector Set1(float value)             { return _mm_set1_ps(value); }
+        static Vector Load(const float src[])       { return _mm_loadu_ps(src); }
+        static void Store(float dst[], Vector v)    { _mm_storeu_ps(dst, v); }
+        static Vector Add(Vector a, Vector b)       { return _mm_add_ps(a, b); }
+        static Vector Mul(Vector a, Vector b)       { return _mm_mul_ps(a, b); }
+        static Vector Div(Vector a, Vector b)       { return _mm_div_ps(a, b); }
+
+            //  Load one row of the joint transform for each lane, and transpose
+            //  it into structure-of-arrays form (ie, dst[c] contains column "c" for each lane)
+        static void LoadRow(Vector dst[4], const Float3x4* joints[], unsigned row)
+        {
+            auto r0 = _mm_loadu_ps(&(*joints[0])(row, 0));
+            auto r1 = _mm_loadu_ps(&(*joints[1])(row, 0));
+            auto r2 = _mm_loadu_ps(&(*joints[2])(row, 0));
+            auto r3 = _mm_loadu_ps(&(*joints[3])(row, 0));
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            dst[0] = r0; dst[1] = r1; dst[2] = r2; dst[3] = r3;
+        }
+    };
+
+    #if defined(__AVX__)
+        class AVXLanes
+        {
+        public:
+            typedef __m256 Vector;
+            static const unsigned Width = 8;
+
+            static Vector Zero()                        { return _mm256_setzero_ps(); }
+            static Vector Set1(float value)             { return _mm256_set1_ps(value); }
+            static Vector Load(const float src[])       { return _mm256_loadu_ps(src); }
+            static void Store(float dst[], Vector v)    { _mm256_storeu_ps(dst, v); }
+            static Vector Add(Vector a, Vector b)       { return _mm256_add_ps(a, b); }
+            static Vector Mul(Vector a, Vector b)       { return _mm256_mul_ps(a, b); }
+            static Vector Div(Vector a, Vector b)       { return _mm256_div_ps(a, b); }
+
+            static void LoadRow(Vector dst[4], const Float3x4* joints[], unsigned row)
+            {
+                __m128 lo[4], hi[4];
+                SSELanes::LoadRow(lo, joints, row);
+                SSELanes::LoadRow(hi, &joints[4], row);
+                for (unsigned c=0; c<4; ++c)
+                    dst[c] = _mm256_insertf128_ps(_mm256_castps128_ps256(lo[c]), hi[c], 1);
+            }
+        };
+    #endif
+
+    template<typename Lanes>
+        static size_t SkinBlocks(
+            const SkinningOutput& dst, const SkinningStreams& src,
+            size_t begin, size_t end,
+            unsigned influenceCount, const Float3x4 jointTransforms[])
+    {
+        typedef typename Lanes::Vector Vector;
+        const unsigned W = Lanes::Width;
+        const bool doNormals = dst._normals && src._normals;
+        const auto unormScale = Lanes::Set1(255.f);
+
+        auto v = begin;
+        for (; (v+W)<=end; v+=W) {
+                //  Gather the inputs for this block into structure-of-arrays form
+            float gather[6][W];
+            for (unsigned l=0; l<W; ++l) {
+                auto* srcPos = PtrAdd(src._positions, (v+l)*src._geoStride);
+                gather[0][l] = srcPos[0]; gather[1][l] = srcPos[1]; gather[2][l] = srcPos[2];
+                if (doNormals) {
+                    auto* srcNormal = PtrAdd(src._normals, (v+l)*src._geoStride);
+                    gather[3][l] = srcNormal[0]; gather[4][l] = srcNormal[1]; gather[5][l] = srcNormal[2];
+                }
+            }
+
+            const Vector x = Lanes::Load(gather[0]), y = Lanes::Load(gather[1]), z = Lanes::Load(gather[2]);
+            Vector nx = Lanes::Zero(), ny = Lanes::Zero(), nz = Lanes::Zero();
+            if (doNormals) {
+                nx = Lanes::Load(gather[3]); ny = Lanes::Load(gather[4]); nz = Lanes::Load(gather[5]);
+            }
+
+            Vector px = Lanes::Zero(), py = Lanes::Zero(), pz = Lanes::Zero();
+            Vector ox = Lanes::Zero(), oy = Lanes::Zero(), oz = Lanes::Zero();
+            for (unsigned c=0; c<influenceCount; ++c) {
+                float weights[W];
+                const Float3x4* joints[W];
+                for (unsigned l=0; l<W; ++l) {
+                    auto b = (v+l)*src._bindingStride;
+                    weights[l] = float(src._weights[b+c]);
+                    joints[l] = &jointTransforms[src._jointIndices[b+c]];
+                }
+                const Vector w = Lanes::Div(Lanes::Load(weights), unormScale);
+
+                Vector m[3][4];
+                Lanes::LoadRow(m[0], joints, 0);
+                Lanes::LoadRow(m[1], joints, 1);
+                Lanes::LoadRow(m[2], joints, 2);
+
+                const Vector tx = Lanes::Add(Lanes::Add(Lanes::Add(Lanes::Mul(m[0][0], x), Lanes::Mul(m[0][1], y)), Lanes::Mul(m[0][2], z)), m[0][3]);
+                const Vector ty = Lanes::Add(Lanes::Add(Lanes::Add(Lanes::Mul(m[1][0], x), Lanes::Mul(m[1][1], y)), Lanes::Mul(m[1][2], z)), m[1][3]);
+                const Vector tz = Lanes::Add(Lanes::Add(Lanes::Add(Lanes::Mul(m[2][0], x), Lanes::Mul(m[2][1], y)), Lanes::Mul(m[2][2], z)), m[2][3]);
+                px = Lanes::Add(px, Lanes::Mul(w, tx));
+                py = Lanes::Add(py, Lanes::Mul(w, ty));
+                pz = Lanes::Add(pz, Lanes::Mul(w, tz));
+
+                if (doNormals) {
+                    const Vector rx = Lanes::Add(Lanes::Add(Lanes::Mul(m[0][0], nx), Lanes::Mul(m[0][1], ny)), Lanes::Mul(m[0][2], nz));
+                    const Vector ry = Lanes::Add(Lanes::Add(Lanes::Mul(m[1][0], nx), Lanes::Mul(m[1][1], ny)), Lanes::Mul(m[1][2], nz));
+                    const Vector rz = Lanes::Add(Lanes::Add(Lanes::Mul(m[2][0], nx), Lanes::Mul(m[2][1], ny)), Lanes::Mul(m[2][2], nz));
+                    ox = Lanes::Add(ox, Lanes::Mul(w, rx));
+                    oy = Lanes::Add(oy, Lanes::Mul(w, ry));
+                    oz = Lanes::Add(oz, Lanes::Mul(w, rz));
+                }
+            }
+
+                //  Scatter back out to the interleaved output
+            Lanes::Store(gather[0], px); Lanes::Store(gather[1], py); Lanes::Store(gather[2], pz);
+            if (doNormals) {
+                Lanes::Store(gather[3], ox); Lanes::Store(gather[4], oy); Lanes::Store(gather[5], oz);
+            }
+            for (unsigned l=0; l<W; ++l) {
+                auto* dstPos = PtrAdd(dst._positions, (v+l)*dst._stride);
+                dstPos[0] = gather[0][l]; dstPos[1] = gather[1][l]; dstPos[2] = gather[2][l];
+                if (doNormals) {
+                    auto* dstNormal = PtrAdd(dst._normals, (v+l)*dst._stride);
+                    dstNormal[0] = gather[3][l]; dstNormal[1] = gather[4][l]; dstNormal[2] = gather[5][l];
+                }
+            }
+        }
+
+        return v;
+    }
+
+#endif
+
+    void SkinVertices(
+        const SkinningOutput& dst, const SkinningStreams& src, size_t vertexCount,
+        unsigned influenceCount, const Float3x4 jointTransforms[])
+    {
+        assert(influenceCount == 0 || influenceCount == 1 || influenceCount == 2 || influenceCount == 4);
+        if (!influenceCount) {
+            CopyVertices(dst, src, 0, vertexCount);
+            return;
+        }
+
+        size_t v = 0;
+        #if defined(CPUSKINNING_SSE)
+            #if defined(__AVX__)
+                v = SkinBlocks<AVXLanes>(dst, src, v, vertexCount, influenceCount, jointTransforms);
+            #endif
+            v = SkinBlocks<SSELanes>(dst, src, v, vertexCount, influenceCount, jointTransforms);
+        #endif
+        SkinVertices_Scalar(dst, src, v, vertexCount, influenceCount, jointTransforms);
+    }
+}}
+
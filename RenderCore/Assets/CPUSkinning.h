@@ -0,0 +1,62 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Matrix.h"
+#include "../../Core/Types.h"
+
+namespace RenderCore { namespace Assets
+{
+    /// <summary>Vertex streams for CPU skinning</summary>
+    /// Positions and normals are 3 floats, interleaved with the given stride. The
+    /// skeleton binding stream has "influenceCount" UNORM weights and "influenceCount"
+    /// joint indices per vertex (as built by the collada conversion).
+    class SkinningStreams
+    {
+    public:
+        const float*    _positions;
+        const float*    _normals;           ///< (can be nullptr)
+        unsigned        _geoStride;         ///< in bytes, for both _positions and _normals
+        const uint8*    _weights;
+        const uint8*    _jointIndices;
+        unsigned        _bindingStride;     ///< in bytes, for both _weights and _jointIndices
+
+        SkinningStreams();
+    };
+
+    class SkinningOutput
+    {
+    public:
+        float*          _positions;
+        float*          _normals;           ///< (can be nullptr)
+        unsigned        _stride;            ///< in bytes, for both _positions and _normals
+
+        SkinningOutput();
+    };
+
+    /// <summary>Skin vertices on the CPU</summary>
+    /// Performs the same calculation as the "animation/skinning.vsh" shaders:
+    /// each position is transformed by each joint transform, then weighted and summed.
+    /// Normals are transformed by the rotation part of the joint transforms, and
+    /// are not renormalized.
+    ///
+    /// Vertices are processed in blocks of 4 (SSE) or 8 (AVX, when the compiler
+    /// targets it), in structure-of-arrays form. The result is bit-identical to
+    /// SkinVertices_Reference (so long as the compiler doesn't contract the scalar
+    /// multiplies and adds into fused multiply-adds).
+    ///
+    /// "influenceCount" must be 0, 1, 2 or 4. Joint indices are not range checked.
+    void SkinVertices(
+        const SkinningOutput& dst, const SkinningStreams& src, size_t vertexCount,
+        unsigned influenceCount, const Float3x4 jointTransforms[]);
+
+    /// <summary>Scalar version of SkinVertices, used as a reference in tests</summary>
+    void SkinVertices_Reference(
+        const SkinningOutput& dst, const SkinningStreams& src, size_t vertexCount,
+        unsigned influenceCount, const Float3x4 jointTransforms[]);
+}}
+
@@ -0,0 +1,66 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "InstanceBatching.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace RenderCore { namespace Assets
+{
+    void    InstanceBatches::Build(
+        const std::pair<uint64, unsigned> sortedDrawCalls[], size_t drawCallCount,
+        unsigned ignoredKeyBits,
+        const unsigned transformIndices[], const Float4x4 transforms[],
+        const uint64 drawCallIdentities[])
+    {
+        _batches.clear();
+        _instanceTransforms.clear();
+        assert(ignoredKeyBits < 64);
+
+        size_t runStart = 0;
+        while (runStart < drawCallCount) {
+            auto batchKey = sortedDrawCalls[runStart].first >> uint64(ignoredKeyBits);
+            auto batchIdentity = drawCallIdentities ? drawCallIdentities[sortedDrawCalls[runStart].second] : 0ull;
+            auto runEnd = runStart+1;
+            while (     runEnd < drawCallCount
+                    &&  (runEnd - runStart) < _maxInstanceCount
+                    &&  (sortedDrawCalls[runEnd].first >> uint64(ignoredKeyBits)) == batchKey
+                    &&  (!drawCallIdentities || drawCallIdentities[sortedDrawCalls[runEnd].second] == batchIdentity)) {
+                ++runEnd;
+            }
+
+            Batch batch;
+            batch._firstDrawCall = unsigned(runStart);
+            batch._drawCallCount = unsigned(runEnd - runStart);
+            batch._firstInstance = ~unsigned(0x0);
+
+            if (batch._drawCallCount >= _minInstanceCount) {
+                batch._firstInstance = unsigned(_instanceTransforms.size());
+                for (auto c=runStart; c<runEnd; ++c) {
+                    auto transformIndex = transformIndices[sortedDrawCalls[c].second];
+                    _instanceTransforms.push_back(Truncate(transforms[transformIndex]));
+                }
+            }
+
+            _batches.push_back(batch);
+            runStart = runEnd;
+        }
+    }
+
+    void    InstanceBatches::Clear()
+    {
+        _batches.clear();
+        _instanceTransforms.clear();
+    }
+
+    InstanceBatches::InstanceBatches(unsigned minInstanceCount, unsigned maxInstanceCount)
+    : _minInstanceCount(std::max(2u, minInstanceCount))
+    , _maxInstanceCount(std::max(_minInstanceCount, maxInstanceCount))
+    {}
+
+    InstanceBatches::~InstanceBatches() {}
+}}
+
@@ -0,0 +1,70 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Matrix.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <utility>
+
+namespace RenderCore { namespace Assets
+{
+    /// <summary>Collapses runs of identical draw calls into instanced batches</summary>
+    /// The input is a list of (sort key, draw call index) pairs that has already been
+    /// sorted. Consecutive draw calls with the same key (ignoring the lowest
+    /// "ignoredKeyBits" bits -- normally the depth) become a single batch.
+    ///
+    /// The transforms for instanced batches are packed into a single stream, in
+    /// the layout expected by the "InstanceTransforms" shader buffer. Runs that are
+    /// too short to be worth instancing are still returned as a batch, but
+    /// without instance transforms.
+    ///
+    /// There are no device dependencies here, so batches can be built (and tested)
+    /// without a render device.
+    class InstanceBatches
+    {
+    public:
+        class Batch
+        {
+        public:
+            unsigned    _firstDrawCall;     ///< index into the sorted draw call list
+            unsigned    _drawCallCount;
+            unsigned    _firstInstance;     ///< index into _instanceTransforms, or ~0u if the draw calls should be drawn individually
+
+            bool IsInstanced() const { return _firstInstance != ~unsigned(0x0); }
+        };
+
+        std::vector<Batch>      _batches;
+        std::vector<Float3x4>   _instanceTransforms;
+
+            /// <summary>Rebuild the batches for the given sorted draw calls</summary>
+            /// "transformIndices" maps from draw call index (ie, the second member of
+            /// each pair in "sortedDrawCalls") into "transforms".
+            ///
+            /// Sort keys are normally built from truncated ids, so different draw calls
+            /// can end up with the same key. When "drawCallIdentities" is given (again,
+            /// indexed by draw call index), draw calls are only batched together if
+            /// their identities also match.
+        void    Build(
+            const std::pair<uint64, unsigned> sortedDrawCalls[], size_t drawCallCount,
+            unsigned ignoredKeyBits,
+            const unsigned transformIndices[], const Float4x4 transforms[],
+            const uint64 drawCallIdentities[] = nullptr);
+        void    Clear();
+
+        unsigned GetMinInstanceCount() const { return _minInstanceCount; }
+        unsigned GetMaxInstanceCount() const { return _maxInstanceCount; }
+
+        InstanceBatches(unsigned minInstanceCount = 4, unsigned maxInstanceCount = 1024);
+        ~InstanceBatches();
+
+    private:
+        unsigned    _minInstanceCount;
+        unsigned    _maxInstanceCount;
+    };
+}}
+
@@ -12,6 +12,7 @@
 #include "Material.h"
 #include "RawAnimationCurve.h"
 #include "SharedStateSet.h"
+#include "InstanceBatching.h"
 
 #include "../Techniques/Techniques.h"
 #include "../Techniques/ResourceBox.h"
@@ -34,12 +35,14 @@
 #include "../../Utility/PtrUtils.h"
 #include "../../Utility/Streams/FileUtils.h"
 #include "../../Utility/IteratorUtils.h"
+#include "../../Utility/MemoryUtils.h"
 #include "../../Math/Transformations.h"
 #include "../../ConsoleRig/Console.h"
 
 #include "../../Utility/StringFormat.h"
 
 #include <string>
+#include <algorithm>
 
 #pragma warning(disable:4189)
 
@@ -193,7 +196,8 @@ namespace RenderCore { namespace Assets
 
         static unsigned BuildGeoParamBox(
             const GeoInputAssembly& ia, SharedStateSet& sharedStateSet, 
-            ModelConstruction::ParamBoxDescriptions& paramBoxDesc, bool normalFromSkinning)
+            ModelConstruction::ParamBoxDescriptions& paramBoxDesc, bool normalFromSkinning,
+            bool instancedTransforms = false)
         {
                 //  Build a parameter box for this geometry configuration. The input assembly
             ParameterBox geoParameters;
@@ -205,6 +209,7 @@ namespace RenderCore { namespace Assets
                 { geoParameters.SetParameter("GEO_HAS_TANGENT_FRAME", 1); }
             if (HasElement(ia, "BONEINDICES") && HasElement(ia, "BONEWEIGHTS"))
                 { geoParameters.SetParameter("GEO_HAS_SKIN_WEIGHTS", 1); }
+            if (instancedTransforms) { geoParameters.SetParameter("GEO_INSTANCED_TRANSFORMS", 1); }
             auto result = sharedStateSet.InsertParameterBox(geoParameters);
             paramBoxDesc.Add(result, geoParameters);
             return result;
@@ -599,6 +604,22 @@ namespace RenderCore { namespace Assets
 
             ////////////////////////////////////////////////////////////////////////
 
+            //  The CPU skinning path needs a system memory copy of the animated geometry.
+            //  We only make that copy when "SkinningOnCPU" is set as the model is constructed,
+            //  so the GPU path doesn't pay for it. Toggling the tweakable only affects models
+            //  that are loaded afterwards.
+        std::vector<Pimpl::CPUSkinningSource> cpuSkinningSources;
+        if (Tweakable("SkinningOnCPU", false)) {
+            cpuSkinningSources.reserve(skinnedMeshes.size());
+            for (size_t c=0; c<skinnedMeshes.size(); ++c) {
+                const auto& m = skinnedMeshes[c];
+                cpuSkinningSources.push_back(Pimpl::BuildCPUSkinningSource(
+                    m, skinnedBindings[c],
+                    PtrAdd(AsPointer(nascentVB.cbegin()), m._extraVbOffset[Pimpl::SkinnedMesh::VertexStreams::AnimatedGeo]),
+                    PtrAdd(AsPointer(nascentVB.cbegin()), m._extraVbOffset[Pimpl::SkinnedMesh::VertexStreams::SkeletonBinding])));
+            }
+        }
+
         std::vector<Metal::ConstantBuffer> finalConstantBuffers;
         for (auto cb=prescientMaterialConstantBuffers.cbegin(); cb!=prescientMaterialConstantBuffers.end(); ++cb) {
             assert(cb->size());
@@ -618,6 +639,7 @@ namespace RenderCore { namespace Assets
         pimpl->_meshes = std::move(meshes);
         pimpl->_skinnedMeshes = std::move(skinnedMeshes);
         pimpl->_skinnedBindings = std::move(skinnedBindings);
+        pimpl->_cpuSkinningSources = std::move(cpuSkinningSources);
 
         pimpl->_drawCalls = std::move(drawCalls);
         pimpl->_drawCallRes = std::move(drawCallRes);
@@ -793,6 +815,7 @@ namespace RenderCore { namespace Assets
         result._indexFormat = geo._ib._format;
         result._vertexStride = geo._vb._ia._vertexStride;
         result._geoParamBox = ModelConstruction::BuildGeoParamBox(geo._vb._ia, sharedStateSet, paramBoxDesc, normalFromSkinning);
+        result._instancedGeoParamBox = ModelConstruction::BuildGeoParamBox(geo._vb._ia, sharedStateSet, paramBoxDesc, normalFromSkinning, true);
 
             // (source file locators)
         result._sourceFileIBOffset = geo._ib._offset;
@@ -1019,87 +1042,293 @@ namespace RenderCore { namespace Assets
     class ModelRenderer::SortedModelDrawCalls::Entry
     {
     public:
-        unsigned        _shaderVariationHash;
-
         ModelRenderer*  _renderer;
         unsigned        _drawCallIndex;
-        Float4x4        _meshToWorld;
+        unsigned        _transformIndex;
+        unsigned        _variationId;
 
         unsigned        _indexCount, _firstIndex, _firstVertex;
         Metal::Topology::Enum        _topology;
         
         ModelRenderer::Pimpl::Mesh* _mesh;
+        ModelRenderer::Pimpl::TechniqueInterface _techniqueInterface;
+
+            //  For skinned geometry, the animated vertex elements are in a separate
+            //  stream (either the unskinned elements, or the output of PrepareAnimation)
+        const Metal::VertexBuffer*  _animatedVB;
+        unsigned        _animatedVBOffset, _animatedVBStride;
     };
 
-    void ModelRenderer::SortedModelDrawCalls::Reset() 
+    class ModelRenderer::SortedModelDrawCalls::Pimpl
     {
-        _entries.erase(_entries.begin(), _entries.end());
+    public:
+            //  The full shader variation is (technique interface, shader name, geo params, material params).
+            //  Each unique variation and each unique mesh gets a small id (in the order they are
+            //  first seen), so that they can be packed into the sort key without collisions.
+        typedef std::pair<uint64, uint64> VariationKey;
+        typedef std::pair<uint64, unsigned> DrawCallKey;
+        std::vector<std::pair<VariationKey, unsigned>>  _variations;
+        std::vector<std::pair<DrawCallKey, unsigned>>   _drawCalls;
+
+        std::vector<std::pair<uint64, unsigned>>        _sortKeys;
+        std::vector<std::pair<uint64, unsigned>>        _sortTemp;
+        std::vector<uint64>                             _identities;    ///< full (variation id, draw call id), per entry
+
+        InstanceBatches         _batches;
+        std::vector<unsigned>   _transformIndices;
+
+        Float3      _viewPosition;
+
+        unsigned    GetVariationId(const VariationKey& key);
+        unsigned    GetDrawCallId(const void* geoSource, unsigned drawCallIndex);
+        void        Sort();
+    };
+
+    static const unsigned SortKey_VariationBits = 20;
+    static const unsigned SortKey_DrawCallBits = 20;
+    static const unsigned SortKey_DepthBits = 64 - SortKey_VariationBits - SortKey_DrawCallBits;
+
+    static uint64 MakeSortKey(unsigned variationId, unsigned drawCallId, float distanceSq)
+    {
+            //  Positive floats sort in the same order as their bit patterns, so we can 
+            //  just take the most significant bits (ignoring the sign bit) as the depth.
+        union { float _f; uint32 _i; } depth;
+        depth._f = std::max(0.f, distanceSq);
+        auto quantizedDepth = uint64(depth._i >> (31 - SortKey_DepthBits));
+
+            //  If there are too many unique variations or draw calls, the ids will wrap
+            //  around. That only reduces the quality of the sorting; batches are built
+            //  by comparing the full ids (see Pimpl::_identities).
+        const uint64 variationMask = (1ull << SortKey_VariationBits) - 1ull;
+        const uint64 drawCallMask = (1ull << SortKey_DrawCallBits) - 1ull;
+        const uint64 depthMask = (1ull << SortKey_DepthBits) - 1ull;
+        return    ((uint64(variationId) & variationMask) << (SortKey_DrawCallBits + SortKey_DepthBits))
+                | ((uint64(drawCallId) & drawCallMask) << SortKey_DepthBits)
+                | (quantizedDepth & depthMask);
     }
 
-    ModelRenderer::SortedModelDrawCalls::SortedModelDrawCalls() 
+    unsigned ModelRenderer::SortedModelDrawCalls::Pimpl::GetVariationId(const VariationKey& key)
     {
-        _entries.reserve(10*1000);
+        auto i = std::lower_bound(
+            _variations.begin(), _variations.end(), 
+            key, CompareFirst<VariationKey, unsigned>());
+        if (i == _variations.end() || i->first != key) {
+            i = _variations.insert(i, std::make_pair(key, unsigned(_variations.size())));
+        }
+        return i->second;
     }
 
-    ModelRenderer::SortedModelDrawCalls::~SortedModelDrawCalls() {}
+    unsigned ModelRenderer::SortedModelDrawCalls::Pimpl::GetDrawCallId(const void* geoSource, unsigned drawCallIndex)
+    {
+            //  The draw call determines the mesh, the index range and the material resources.
+            //  So all draw calls with the same id (and variation) can be instanced together.
+            //  Prepare() adds all of the draw calls for a renderer together, so draw calls 
+            //  from the same renderer (and so the same vertex & index buffers) get adjacent ids.
+            //  "geoSource" is normally the renderer. But skinned geometry with prepared animation
+            //  has unique vertex data, so it uses the PreparedAnimation (and so is never instanced)
+        auto key = std::make_pair(uint64(size_t(geoSource)), drawCallIndex);
+        auto i = std::lower_bound(
+            _drawCalls.begin(), _drawCalls.end(), 
+            key, CompareFirst<DrawCallKey, unsigned>());
+        if (i == _drawCalls.end() || i->first != key) {
+            i = _drawCalls.insert(i, std::make_pair(key, unsigned(_drawCalls.size())));
+        }
+        return i->second;
+    }
 
-    bool CompareDrawCall(const ModelRenderer::SortedModelDrawCalls::Entry& lhs, const ModelRenderer::SortedModelDrawCalls::Entry& rhs)
+    void ModelRenderer::SortedModelDrawCalls::Pimpl::Sort()
     {
-        if (lhs._shaderVariationHash == rhs._shaderVariationHash) {
-            if (lhs._renderer == rhs._renderer) {
-                if (lhs._mesh == rhs._mesh) {
-                    return lhs._drawCallIndex < rhs._drawCallIndex;
-                }
-                return lhs._mesh < rhs._mesh;
+            //  Stable LSD radix sort with 8 bit digits. We build the histograms
+            //  for all digits in a single pass, and skip the passes for digits that
+            //  are the same in every key (normally the upper bits of the variation
+            //  and draw call ids are all zero).
+        const unsigned digitCount = 8;
+        const auto count = _sortKeys.size();
+        if (count < 2) return;
+
+        unsigned histograms[digitCount][256];
+        XlZeroMemory(histograms);
+        for (const auto& k:_sortKeys) {
+            auto key = k.first;
+            for (unsigned d=0; d<digitCount; ++d) {
+                ++histograms[d][key & 0xff];
+                key >>= 8;
             }
-            return lhs._renderer < rhs._renderer;
         }
-        return lhs._shaderVariationHash < rhs._shaderVariationHash; 
+
+        _sortTemp.resize(count);
+        for (unsigned d=0; d<digitCount; ++d) {
+            auto& histogram = histograms[d];
+            if (histogram[(_sortKeys[0].first >> (d*8)) & 0xff] == count) continue;
+
+            unsigned offsets[256];
+            unsigned runningTotal = 0;
+            for (unsigned c=0; c<256; ++c) {
+                offsets[c] = runningTotal;
+                runningTotal += histogram[c];
+            }
+
+            for (const auto& k:_sortKeys) {
+                _sortTemp[offsets[(k.first >> (d*8)) & 0xff]++] = k;
+            }
+            std::swap(_sortKeys, _sortTemp);
+        }
+    }
+
+    void ModelRenderer::SortedModelDrawCalls::SetViewPosition(const Float3& viewPosition)
+    {
+        _pimpl->_viewPosition = viewPosition;
+    }
+
+    void ModelRenderer::SortedModelDrawCalls::Reset() 
+    {
+        _entries.erase(_entries.begin(), _entries.end());
+        _transforms.erase(_transforms.begin(), _transforms.end());
+        _pimpl->_sortKeys.erase(_pimpl->_sortKeys.begin(), _pimpl->_sortKeys.end());
+        _pimpl->_identities.erase(_pimpl->_identities.begin(), _pimpl->_identities.end());
+        _pimpl->_variations.erase(_pimpl->_variations.begin(), _pimpl->_variations.end());
+        _pimpl->_drawCalls.erase(_pimpl->_drawCalls.begin(), _pimpl->_drawCalls.end());
+        _pimpl->_batches.Clear();
+    }
+
+    ModelRenderer::SortedModelDrawCalls::SortedModelDrawCalls() 
+    {
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_viewPosition = Zero<Float3>();
+        _entries.reserve(10*1000);
+        _transforms.reserve(10*1000);
+        _pimpl->_sortKeys.reserve(10*1000);
+        _pimpl->_sortTemp.reserve(10*1000);
+        _pimpl->_identities.reserve(10*1000);
     }
 
+    ModelRenderer::SortedModelDrawCalls::~SortedModelDrawCalls() {}
+
     void    ModelRenderer::Prepare(
         SortedModelDrawCalls& dest, 
         const SharedStateSet& sharedStateSet, 
         const Float4x4& modelToWorld,
-        const MeshToModel* transforms)
+        const MeshToModel* transforms,
+        PreparedAnimation* preparedAnimation)
     {
             //  After culling; submit all of the draw-calls in this mesh to a list to be sorted
-            //  Note -- only unskinned geometry supported currently. In theory, we might be able
-            //          to do the same with skinned geometry (at least, when not using the "prepare" step
-        unsigned drawCallIndex = 0;
-        for (auto md=_pimpl->_drawCalls.cbegin(); md!=_pimpl->_drawCalls.cend(); ++md, ++drawCallIndex) {
-            const auto& drawCallRes = _pimpl->_drawCallRes[drawCallIndex];
-            const auto& d = md->second;
-
-            auto geoParamIndex = drawCallRes._geoParamBox;
-            auto matParamIndex = drawCallRes._materialParamBox;
-            auto shaderNameIndex = drawCallRes._shaderName;
-
-            auto& cmdStream = _pimpl->_scaffold->CommandStream();
-            auto& geoCall = cmdStream.GetGeoCall(md->first);
-            auto mesh = FindIf(_pimpl->_meshes, [=](const Pimpl::Mesh& mesh) { return mesh._id == geoCall._geoId; });
-            assert(mesh != _pimpl->_meshes.end());
+        auto& sortPimpl = *dest._pimpl;
+        auto& cmdStream = _pimpl->_scaffold->CommandStream();
+        unsigned modelTransformIndex = ~unsigned(0x0);
 
-            unsigned techniqueInterface = mesh->_techniqueInterface;
+        auto addEntry = [&](
+            SortedModelDrawCalls::Entry& entry, unsigned drawCallIndex, const DrawCallDesc& d,
+            const void* geoSource, const unsigned* transformMarker) {
 
-            SortedModelDrawCalls::Entry entry;
+            const auto& drawCallRes = _pimpl->_drawCallRes[drawCallIndex];
             entry._drawCallIndex = drawCallIndex;
             entry._renderer = this;
-            if (transforms) {
-                entry._meshToWorld = Combine(transforms->GetMeshToModel(geoCall._transformMarker), modelToWorld);
+            if (transforms && transformMarker) {
+                entry._transformIndex = unsigned(dest._transforms.size());
+                dest._transforms.push_back(Combine(transforms->GetMeshToModel(*transformMarker), modelToWorld));
             } else {
-                entry._meshToWorld = modelToWorld;
+                if (modelTransformIndex == ~unsigned(0x0)) {
+                    modelTransformIndex = unsigned(dest._transforms.size());
+                    dest._transforms.push_back(modelToWorld);
+                }
+                entry._transformIndex = modelTransformIndex;
             }
-            entry._shaderVariationHash = techniqueInterface ^ (geoParamIndex << 12) ^ (matParamIndex << 15) ^ (shaderNameIndex << 24);  // simple hash of these indices. Note that collisions might be possible
+            entry._variationId = sortPimpl.GetVariationId(
+                std::make_pair(
+                    (uint64(entry._techniqueInterface) << 32ull) | uint64(drawCallRes._shaderName),
+                    (uint64(drawCallRes._geoParamBox) << 32ull) | uint64(drawCallRes._materialParamBox)));
             entry._indexCount = d._indexCount;
             entry._firstIndex = d._firstIndex;
             entry._firstVertex = d._firstVertex;
             entry._topology = Metal::Topology::Enum(d._topology);
-            entry._mesh = AsPointer(mesh);
+
+            auto distanceSq = MagnitudeSquared(ExtractTranslation(dest._transforms[entry._transformIndex]) - sortPimpl._viewPosition);
+            auto drawCallId = sortPimpl.GetDrawCallId(geoSource, drawCallIndex);
+            auto sortKey = MakeSortKey(entry._variationId, drawCallId, distanceSq);
+            sortPimpl._sortKeys.push_back(std::make_pair(sortKey, unsigned(dest._entries.size())));
+            sortPimpl._identities.push_back((uint64(entry._variationId) << 32ull) | uint64(drawCallId));
             dest._entries.push_back(entry);
+        };
+
+        unsigned drawCallIndex = 0;
+        for (auto md=_pimpl->_drawCalls.cbegin(); md!=_pimpl->_drawCalls.cend(); ++md, ++drawCallIndex) {
+            auto& geoCall = cmdStream.GetGeoCall(md->first);
+            auto mesh = FindIf(_pimpl->_meshes, [=](const Pimpl::Mesh& mesh) { return mesh._id == geoCall._geoId; });
+            assert(mesh != _pimpl->_meshes.end());
+
+            SortedModelDrawCalls::Entry entry;
+            entry._mesh = AsPointer(mesh);
+            entry._techniqueInterface = mesh->_techniqueInterface;
+            entry._animatedVB = nullptr;
+            entry._animatedVBOffset = entry._animatedVBStride = 0;
+            addEntry(entry, drawCallIndex, md->second, this, &geoCall._transformMarker);
+        }
+
+            //  Skinned geometry follows the same rules as Render(). With prepared animation,
+            //  the animated elements come from the skinning buffer (and the mesh to model
+            //  transforms have already been applied). Otherwise we draw the bind pose.
+        auto animGeo = Pimpl::SkinnedMesh::VertexStreams::AnimatedGeo;
+        for (auto md=_pimpl->_skinnedDrawCalls.cbegin(); md!=_pimpl->_skinnedDrawCalls.cend(); ++md, ++drawCallIndex) {
+            auto& geoCall = cmdStream.GetSkinCall(md->first);
+            auto mesh = FindIf(_pimpl->_skinnedMeshes, [=](const Pimpl::SkinnedMesh& mesh) { return mesh._id == geoCall._geoId; });
+            assert(mesh != _pimpl->_skinnedMeshes.end());
+            auto meshIndex = std::distance(_pimpl->_skinnedMeshes.begin(), mesh);
+
+            SortedModelDrawCalls::Entry entry;
+            entry._mesh = AsPointer(mesh);
+            if (preparedAnimation) {
+                entry._techniqueInterface = _pimpl->_skinnedBindings[meshIndex]._techniqueInterface;
+                entry._animatedVB = &preparedAnimation->_skinningBuffer;
+                entry._animatedVBOffset = preparedAnimation->_vbOffsets[meshIndex];
+                entry._animatedVBStride = _pimpl->_skinnedBindings[meshIndex]._vertexStride;
+                addEntry(entry, drawCallIndex, md->second, preparedAnimation, nullptr);
+            } else {
+                entry._techniqueInterface = mesh->_skinnedTechniqueInterface;
+                entry._animatedVB = &_pimpl->_vertexBuffer;
+                entry._animatedVBOffset = mesh->_extraVbOffset[animGeo];
+                entry._animatedVBStride = mesh->_extraVbStride[animGeo];
+                addEntry(entry, drawCallIndex, md->second, this, &geoCall._transformMarker);
+            }
         }
     }
 
+    class InstanceTransformsBox
+    {
+    public:
+        class Desc
+        {
+        public:
+            unsigned _maxInstances;
+            Desc(unsigned maxInstances) : _maxInstances(maxInstances) {}
+        };
+
+        intrusive_ptr<ID3D::Buffer>     _buffer;
+        Metal::ShaderResourceView       _srv;
+
+        InstanceTransformsBox(const Desc& desc);
+        ~InstanceTransformsBox();
+    };
+
+    InstanceTransformsBox::InstanceTransformsBox(const Desc& desc)
+    {
+        using namespace Metal;
+        D3D11_BUFFER_DESC bufferDesc;
+        bufferDesc.ByteWidth = (UINT)(desc._maxInstances * sizeof(Float3x4));
+        bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+        bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        bufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        bufferDesc.StructureByteStride = sizeof(Float3x4);
+
+        ObjectFactory objFactory;
+        _buffer = objFactory.CreateBuffer(&bufferDesc);
+        _srv = ShaderResourceView(_buffer.get());
+    }
+
+    InstanceTransformsBox::~InstanceTransformsBox() {}
+
+    static const unsigned InstanceTransformsSlot = 14;
+
     void ModelRenderer::RenderPrepared(
         const Context&          context,
         SortedModelDrawCalls&   drawCalls)
@@ -1113,31 +1342,60 @@ namespace RenderCore { namespace Assets
         Metal::ConstantBuffer& localTransformBuffer = Techniques::CommonResources()._localTransformBuffer;
         const Metal::ConstantBuffer* pkts[] = { &localTransformBuffer, nullptr };
 
-        std::sort(drawCalls._entries.begin(), drawCalls._entries.end(), CompareDrawCall);
+        auto& sortPimpl = *drawCalls._pimpl;
+        sortPimpl.Sort();
+
+            //  Collapse runs of the same draw call (ignoring depth) into instanced batches.
+            //  Short runs are still drawn one at a time, with the transform in the
+            //  local transform constant buffer.
+        auto& batches = sortPimpl._batches;
+        sortPimpl._transformIndices.resize(drawCalls._entries.size());
+        for (size_t c=0; c<drawCalls._entries.size(); ++c)
+            sortPimpl._transformIndices[c] = drawCalls._entries[c]._transformIndex;
+        batches.Build(
+            AsPointer(sortPimpl._sortKeys.cbegin()), sortPimpl._sortKeys.size(), SortKey_DepthBits,
+            AsPointer(sortPimpl._transformIndices.cbegin()), AsPointer(drawCalls._transforms.cbegin()),
+            AsPointer(sortPimpl._identities.cbegin()));
+
+        const bool autoInstancing = Tweakable("AutoInstancing", true);
+        InstanceTransformsBox* instanceBox = nullptr;
+        if (autoInstancing && !batches._instanceTransforms.empty()) {
+            instanceBox = &Techniques::FindCachedBox<InstanceTransformsBox>(
+                InstanceTransformsBox::Desc(batches.GetMaxInstanceCount()));
+            context._context->BindVS(MakeResourceList(InstanceTransformsSlot, instanceBox->_srv));
+        }
 
         const ModelRenderer::Pimpl::Mesh* currentMesh = nullptr;
+        const Metal::VertexBuffer* currentAnimatedVB = nullptr;
         RenderCore::Metal::BoundUniforms* boundUniforms = nullptr;
-        unsigned currentVariationHash = ~unsigned(0x0);
+        unsigned currentVariationId = ~unsigned(0x0);
+        bool currentVariationInstanced = false;
         unsigned currentTextureSet = ~unsigned(0x0);
         unsigned currentConstantBufferIndex = ~unsigned(0x0);
 
-        for (auto d=drawCalls._entries.cbegin(); d!=drawCalls._entries.cend(); ++d) {
+        for (const auto& batch:batches._batches) {
+                //  Every draw call in a batch has the same renderer, draw call index and variation.
+                //  So we only need to look at the first one to setup the variation and states
+            const auto* d = &drawCalls._entries[sortPimpl._sortKeys[batch._firstDrawCall].second];
             auto& renderer = *d->_renderer;
             const auto& drawCallRes = renderer._pimpl->_drawCallRes[d->_drawCallIndex];
+            const bool instanced = instanceBox && batch.IsInstanced();
 
-                // Note -- at the moment, shader variation hash is the sorting priority.
+                // Note -- at the moment, shader variation is the sorting priority.
                 //          This reduces the shader changes to a minimum. It also means we
                 //          do the work in "BeginVariation" to resolve the variation
                 //          as rarely as possible. However, we could pre-resolve all of the
                 //          variations that we're going to need and use another value as the
                 //          sorting priority instead... That might reduce the API thrashing
                 //          in some cases.
-            if (currentVariationHash != d->_shaderVariationHash) {
+            if (currentVariationId != d->_variationId || currentVariationInstanced != instanced) {
                 boundUniforms = context._sharedStateSet->BeginVariation(
                     context._context, context._parserContext->GetTechniqueContext(), context._techniqueIndex,
-                    drawCallRes._shaderName, d->_mesh->_techniqueInterface, drawCallRes._geoParamBox, 
+                    drawCallRes._shaderName, d->_techniqueInterface, 
+                    instanced ? d->_mesh->_instancedGeoParamBox : drawCallRes._geoParamBox, 
                     drawCallRes._materialParamBox);
-                currentVariationHash = d->_shaderVariationHash;
+                currentVariationId = d->_variationId;
+                currentVariationInstanced = instanced;
                 currentTextureSet = ~unsigned(0x0);
             }
 
@@ -1146,21 +1404,31 @@ namespace RenderCore { namespace Assets
             static Utility::ParameterBox tempGlobalStatesBox;
             context._sharedStateSet->BeginRenderState(context._context, tempGlobalStatesBox, context._techniqueIndex, drawCallRes._renderStateSet);
 
-                // We have to do this transform update very frequently! isn't there a better way?
-            {
+            if (instanced) {
                 D3D11_MAPPED_SUBRESOURCE result;
                 HRESULT hresult = context._context->GetUnderlying()->Map(
-                    localTransformBuffer.GetUnderlying(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
+                    instanceBox->_buffer.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
                 assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
-                CopyTransform(((Techniques::LocalTransformConstants*)result.pData)->_localToWorld, d->_meshToWorld);
-                context._context->GetUnderlying()->Unmap(localTransformBuffer.GetUnderlying(), 0);
+                XlCopyMemory(
+                    result.pData, &batches._instanceTransforms[batch._firstInstance], 
+                    batch._drawCallCount * sizeof(Float3x4));
+                context._context->GetUnderlying()->Unmap(instanceBox->_buffer.get(), 0);
             }
             
-            if (currentMesh != d->_mesh) {
+            if (currentMesh != d->_mesh || currentAnimatedVB != d->_animatedVB) {
                 context._context->Bind(renderer._pimpl->_indexBuffer, Metal::NativeFormat::Enum(d->_mesh->_indexFormat), d->_mesh->_ibOffset);
-                context._context->Bind(ResourceList<Metal::VertexBuffer, 1>(std::make_tuple(std::ref(renderer._pimpl->_vertexBuffer))), 
-                    d->_mesh->_vertexStride, d->_mesh->_vbOffset);
+                if (d->_animatedVB) {
+                        // (skinned geometry has the animated elements in slot 0, like BeginSkinCall)
+                    UINT strides[2] = { d->_animatedVBStride, d->_mesh->_vertexStride };
+                    UINT offsets[2] = { d->_animatedVBOffset, d->_mesh->_vbOffset };
+                    ID3D::Buffer* underlyingVBs[2] = { d->_animatedVB->GetUnderlying(), renderer._pimpl->_vertexBuffer.GetUnderlying() };
+                    context._context->GetUnderlying()->IASetVertexBuffers(0, 2, underlyingVBs, strides, offsets);
+                } else {
+                    context._context->Bind(ResourceList<Metal::VertexBuffer, 1>(std::make_tuple(std::ref(renderer._pimpl->_vertexBuffer))), 
+                        d->_mesh->_vertexStride, d->_mesh->_vbOffset);
+                }
                 currentMesh = d->_mesh;
+                currentAnimatedVB = d->_animatedVB;
                 currentTextureSet = ~unsigned(0x0);
             }
 
@@ -1179,7 +1447,30 @@ namespace RenderCore { namespace Assets
             }
 
             context._context->Bind(d->_topology);
-            context._context->DrawIndexed(d->_indexCount, d->_firstIndex, d->_firstVertex);
+            if (instanced) {
+                context._context->DrawIndexedInstanced(d->_indexCount, batch._drawCallCount, d->_firstIndex, d->_firstVertex);
+                continue;
+            }
+
+            for (unsigned c=0; c<batch._drawCallCount; ++c) {
+                d = &drawCalls._entries[sortPimpl._sortKeys[batch._firstDrawCall + c].second];
+
+                    // We have to do this transform update very frequently! isn't there a better way?
+                {
+                    D3D11_MAPPED_SUBRESOURCE result;
+                    HRESULT hresult = context._context->GetUnderlying()->Map(
+                        localTransformBuffer.GetUnderlying(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
+                    assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
+                    CopyTransform(((Techniques::LocalTransformConstants*)result.pData)->_localToWorld, drawCalls._transforms[d->_transformIndex]);
+                    context._context->GetUnderlying()->Unmap(localTransformBuffer.GetUnderlying(), 0);
+                }
+
+                context._context->DrawIndexed(d->_indexCount, d->_firstIndex, d->_firstVertex);
+            }
+        }
+
+        if (instanceBox) {
+            context._context->UnbindVS<Metal::ShaderResourceView>(InstanceTransformsSlot, 1);
         }
     }
 
@@ -145,11 +145,30 @@ namespace RenderCore { namespace Assets
             PreparedAnimation*  preparedAnimation = nullptr) const;
 
             ////////////////////////////////////////////////////////////
+        /// <summary>Draw calls collected by Prepare(), to be sorted and drawn by RenderPrepared()</summary>
+        /// Each draw call is given a 64 bit sort key made up of (from most significant
+        /// to least significant) the shader variation, the draw call and the distance
+        /// from the view position. Variations and draw calls are given small ids as they are
+        /// first seen, so keys never collide. The entries are sorted indirectly (via a
+        /// radix sort of the keys), and transforms are kept in a separate table, so the
+        /// sort never has to move the (large) entries around.
+        ///
+        /// After sorting, runs of the same draw call (in different places) are drawn
+        /// as a single instanced draw call (see InstanceBatches).
+        ///
+        /// Skinned geometry prepared with a PreparedAnimation has unique vertex data, so it
+        /// is never instanced. The PreparedAnimation must remain valid until RenderPrepared().
         class SortedModelDrawCalls
         {
         public:
             class Entry;
-            std::vector<Entry> _entries;
+            class Pimpl;
+            std::vector<Entry>      _entries;
+            std::vector<Float4x4>   _transforms;
+            std::unique_ptr<Pimpl>  _pimpl;
+
+            void SetViewPosition(const Float3& viewPosition);
+
             SortedModelDrawCalls();
             ~SortedModelDrawCalls();
             void Reset();
@@ -158,7 +177,8 @@ namespace RenderCore { namespace Assets
             SortedModelDrawCalls& dest, 
             const SharedStateSet& sharedStateSet, 
             const Float4x4& modelToWorld,
-            const MeshToModel*  transforms = nullptr);
+            const MeshToModel*  transforms = nullptr,
+            PreparedAnimation*  preparedAnimation = nullptr);
         static void RenderPrepared(
             const Context&          context,
             SortedModelDrawCalls&   drawCalls);
@@ -297,6 +297,7 @@ namespace RenderCore { namespace Assets
             unsigned _vertexStride;
             NativeFormatPlaceholder _indexFormat;
             unsigned _geoParamBox;
+            unsigned _instancedGeoParamBox;     // (same as _geoParamBox, but with GEO_INSTANCED_TRANSFORMS)
             TechniqueInterface _techniqueInterface;
 
             unsigned _sourceFileVBOffset, _sourceFileVBSize;
@@ -328,6 +329,25 @@ namespace RenderCore { namespace Assets
             unsigned    _vertexStride;
         };
 
+            //  Copy of the skinning source streams for the CPU skinning path. Only built
+            //  when "SkinningOnCPU" is set as the model is constructed. The animated geometry
+            //  is converted into the same layout as the output of the skinning step (ie, 
+            //  32 bit floats).
+        class CPUSkinningSource
+        {
+        public:
+            std::unique_ptr<uint8[]>    _animatedGeo;
+            std::unique_ptr<uint8[]>    _skeletonBinding;
+            unsigned    _vertexCount;
+            unsigned    _positionOffset, _normalOffset;     // (~0u when not present)
+            unsigned    _weightsOffset, _jointIndicesOffset;
+            bool        _valid;
+
+            CPUSkinningSource();
+            CPUSkinningSource(CPUSkinningSource&& moveFrom);
+            CPUSkinningSource& operator=(CPUSkinningSource&& moveFrom);
+        };
+
         std::vector<const Metal::DeferredShaderResource*> _boundTextures;
         size_t  _texturesPerMaterial;
 
@@ -361,6 +381,7 @@ namespace RenderCore { namespace Assets
         std::vector<Mesh>           _meshes;
         std::vector<SkinnedMesh>            _skinnedMeshes;
         std::vector<SkinnedMeshAnimBinding> _skinnedBindings;
+        std::vector<CPUSkinningSource>      _cpuSkinningSources;
         std::vector<Metal::ConstantBuffer>  _constantBuffers;
 
         ///////////////////////////////////////////////////////////////////////////////
@@ -416,6 +437,19 @@ namespace RenderCore { namespace Assets
             Metal::VertexBuffer&    outputResult,
             unsigned                outputOffset) const;
 
+        bool BuildSkinnedBuffer_CPU(
+            Metal::DeviceContext*   context,
+            unsigned                skinnedMeshIndex,
+            const Float4x4          transformationMachineResult[],
+            const SkeletonBinding&  skeletonBinding,
+            Metal::VertexBuffer&    outputResult,
+            unsigned                outputOffset) const;
+
+        const CPUSkinningSource& GetCPUSkinningSource(unsigned skinnedMeshIndex) const;
+        static CPUSkinningSource BuildCPUSkinningSource(
+            const SkinnedMesh& mesh, const SkinnedMeshAnimBinding& binding,
+            const void* animatedGeo, const void* skeletonBinding);
+
         static auto BuildMesh(
             const ModelCommandStream::GeoCall& geoInst,
             const RawGeometry& geo,
@@ -9,6 +9,7 @@
 #include "RawAnimationCurve.h"
 #include "SharedStateSet.h"
 #include "AssetUtils.h"     // actually just needed for chunk id
+#include "CPUSkinning.h"
 #include "../RenderUtils.h"
 
 #include "../Metal/Shader.h"
@@ -639,6 +640,200 @@ namespace RenderCore { namespace Assets
         }
     }
 
+    static float HalfToFloat(uint16 input)
+    {
+        union { uint32 _i; float _f; } result;
+        uint32 sign = uint32(input & 0x8000) << 16;
+        uint32 exponent = (input >> 10) & 0x1f;
+        uint32 mantissa = input & 0x3ff;
+        if (exponent == 0x1f) {
+            result._i = sign | 0x7f800000 | (mantissa << 13);       // inf or nan
+        } else if (exponent != 0) {
+            result._i = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+        } else if (mantissa != 0) {
+                // denormalized half; becomes a normalized float
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) { mantissa <<= 1; --exponent; }
+            result._i = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        } else {
+            result._i = sign;
+        }
+        return result._f;
+    }
+
+    static const VertexElement* FindElement(const GeoInputAssembly& ia, const char semantic[])
+    {
+        for (unsigned c=0; c<ia._elementCount; ++c)
+            if (!XlCompareString(ia._elements[c]._semantic, semantic) && ia._elements[c]._semanticIndex == 0)
+                return &ia._elements[c];
+        return nullptr;
+    }
+
+    auto ModelRenderer::Pimpl::BuildCPUSkinningSource(
+        const SkinnedMesh& mesh, const SkinnedMeshAnimBinding& binding,
+        const void* animatedGeo, const void* skeletonBinding) -> CPUSkinningSource
+    {
+            //  This is called while the model is being constructed (from the same data
+            //  that is uploaded to the GPU), and only when "SkinningOnCPU" is set. The
+            //  renderer keeps the result for its lifetime, so the render thread never 
+            //  has to load anything.
+        CPUSkinningSource result;
+        const auto& scaffold = *binding._scaffold;
+        auto animGeo = SkinnedMesh::VertexStreams::AnimatedGeo;
+        auto skelBind = SkinnedMesh::VertexStreams::SkeletonBinding;
+        if (!mesh._extraVbStride[animGeo] || !binding._vertexStride) return result;
+
+        result._vertexCount = mesh._sourceFileExtraVBSize[animGeo] / mesh._extraVbStride[animGeo];
+        auto* sourceGeo = (const uint8*)animatedGeo;
+        result._skeletonBinding = std::make_unique<uint8[]>(mesh._sourceFileExtraVBSize[skelBind]);
+        XlCopyMemory(result._skeletonBinding.get(), skeletonBinding, mesh._sourceFileExtraVBSize[skelBind]);
+
+            //  Convert the animated geometry into the post-skinning layout (this is the
+            //  same conversion that happens with the stream output in the GPU path).
+        const auto& srcIA = scaffold._animatedVertexElements._ia;
+        VertexElement convertedElements[16];
+        unsigned convertedCount = std::min((unsigned)dimof(convertedElements), srcIA._elementCount);
+        ApplyConversionFromStreamOutput(convertedElements, srcIA._elements, convertedCount);
+
+        result._animatedGeo = std::make_unique<uint8[]>(result._vertexCount * binding._vertexStride);
+        result._positionOffset = result._normalOffset = ~unsigned(0x0);
+        unsigned dstOffset = 0;
+        for (unsigned e=0; e<convertedCount; ++e) {
+            auto srcFormat = Metal::NativeFormat::Enum(srcIA._elements[e]._format);
+            auto dstFormat = Metal::NativeFormat::Enum(convertedElements[e]._format);
+            auto dstSize = Metal::BitsPerPixel(dstFormat) / 8;
+            bool isFloat3 = 
+                    Metal::GetComponentType(dstFormat) == Metal::FormatComponentType::Float
+                &&  Metal::GetComponentPrecision(dstFormat) == 32
+                &&  Metal::GetComponentCount(Metal::GetComponents(dstFormat)) == 3;
+            if (isFloat3) {
+                if (!XlCompareString(convertedElements[e]._semantic, "POSITION")) result._positionOffset = dstOffset;
+                else if (!XlCompareString(convertedElements[e]._semantic, "NORMAL")) result._normalOffset = dstOffset;
+            }
+
+            bool halfSource = Metal::GetComponentType(srcFormat) == Metal::FormatComponentType::Float
+                && Metal::GetComponentPrecision(srcFormat) == 16;
+            auto srcSize = Metal::BitsPerPixel(srcFormat) / 8;
+            for (unsigned v=0; v<result._vertexCount; ++v) {
+                auto* src = PtrAdd(sourceGeo, v*mesh._extraVbStride[animGeo] + srcIA._elements[e]._startOffset);
+                auto* dst = PtrAdd(result._animatedGeo.get(), v*binding._vertexStride + dstOffset);
+                if (halfSource) {
+                    for (unsigned c=0; c<dstSize/sizeof(float); ++c)
+                        ((float*)dst)[c] = HalfToFloat(((const uint16*)src)[c]);
+                } else {
+                    XlCopyMemory(dst, src, std::min(srcSize, dstSize));
+                }
+            }
+            dstOffset += dstSize;
+        }
+
+        auto* weights = FindElement(scaffold._skeletonBinding._ia, "WEIGHTS");
+        auto* jointIndices = FindElement(scaffold._skeletonBinding._ia, "JOINTINDICES");
+        result._weightsOffset = weights ? weights->_startOffset : ~unsigned(0x0);
+        result._jointIndicesOffset = jointIndices ? jointIndices->_startOffset : ~unsigned(0x0);
+
+            //  We can only support the vertex layouts produced by the collada conversion;
+            //  anything else must go through the GPU path
+        result._valid = 
+                dstOffset == binding._vertexStride
+            &&  result._positionOffset != ~unsigned(0x0)
+            &&  weights && jointIndices;
+        return result;
+    }
+
+    auto ModelRenderer::Pimpl::GetCPUSkinningSource(unsigned skinnedMeshIndex) const -> const CPUSkinningSource&
+    {
+        assert(skinnedMeshIndex < _cpuSkinningSources.size());
+        return _cpuSkinningSources[skinnedMeshIndex];
+    }
+
+    bool ModelRenderer::Pimpl::BuildSkinnedBuffer_CPU(
+        Metal::DeviceContext*       context,
+        unsigned                    skinnedMeshIndex,
+        const Float4x4              transformationMachineResult[],
+        const SkeletonBinding&      skeletonBinding,
+        Metal::VertexBuffer&        outputResult,
+        unsigned                    outputOffset) const
+    {
+        const auto& source = GetCPUSkinningSource(skinnedMeshIndex);
+        if (!source._valid) return false;
+
+        const auto& mesh = _skinnedMeshes[skinnedMeshIndex];
+        const auto& binding = _skinnedBindings[skinnedMeshIndex];
+        const auto& scaffold = *binding._scaffold;
+        const auto outputStride = binding._vertexStride;
+        const auto bindingStride = mesh._extraVbStride[SkinnedMesh::VertexStreams::SkeletonBinding];
+
+            //  Joint indices are 8 bit, so allocating 256 transforms means the kernel
+            //  never has to range check them
+        const size_t jointTransformCount = 256;
+        auto jointTransforms = std::make_unique<Float3x4[]>(jointTransformCount);
+        std::fill(jointTransforms.get(), &jointTransforms[jointTransformCount], Identity<Float3x4>());
+        WriteJointTransforms(jointTransforms.get(), jointTransformCount, scaffold, transformationMachineResult, skeletonBinding);
+
+            //  Start with a copy of the unskinned geometry, so vertices not covered by a
+            //  preskinning draw call (and any extra elements) are still valid
+        const size_t outputSize = source._vertexCount * outputStride;
+        auto skinned = std::make_unique<uint8[]>(outputSize);
+        XlCopyMemory(skinned.get(), source._animatedGeo.get(), outputSize);
+
+        for (unsigned di=0; di<scaffold._preskinningDrawCallCount; ++di) {
+            auto& d = scaffold._preskinningDrawCalls[di];
+            if (!d._subMaterialIndex || (d._firstVertex + d._indexCount) > source._vertexCount) continue;
+
+            auto geoOffset = d._firstVertex * outputStride;
+            auto bindingOffset = d._firstVertex * bindingStride;
+
+            SkinningStreams src;
+            src._positions = (const float*)PtrAdd(source._animatedGeo.get(), geoOffset + source._positionOffset);
+            if (source._normalOffset != ~unsigned(0x0))
+                src._normals = (const float*)PtrAdd(source._animatedGeo.get(), geoOffset + source._normalOffset);
+            src._geoStride = outputStride;
+            src._weights = PtrAdd(source._skeletonBinding.get(), bindingOffset + source._weightsOffset);
+            src._jointIndices = PtrAdd(source._skeletonBinding.get(), bindingOffset + source._jointIndicesOffset);
+            src._bindingStride = bindingStride;
+
+            SkinningOutput dst;
+            dst._positions = (float*)PtrAdd(skinned.get(), geoOffset + source._positionOffset);
+            if (source._normalOffset != ~unsigned(0x0))
+                dst._normals = (float*)PtrAdd(skinned.get(), geoOffset + source._normalOffset);
+            dst._stride = outputStride;
+
+            SkinVertices(dst, src, d._indexCount, d._subMaterialIndex, jointTransforms.get());
+        }
+
+        D3D11_BOX box;
+        box.left = outputOffset; box.right = UINT(outputOffset + outputSize);
+        box.top = box.front = 0; box.bottom = box.back = 1;
+        context->GetUnderlying()->UpdateSubresource(outputResult.GetUnderlying(), 0, &box, skinned.get(), 0, 0);
+        return true;
+    }
+
+    ModelRenderer::Pimpl::CPUSkinningSource::CPUSkinningSource()
+    : _vertexCount(0)
+    , _positionOffset(~unsigned(0x0)), _normalOffset(~unsigned(0x0))
+    , _weightsOffset(~unsigned(0x0)), _jointIndicesOffset(~unsigned(0x0))
+    , _valid(false) {}
+
+    ModelRenderer::Pimpl::CPUSkinningSource::CPUSkinningSource(CPUSkinningSource&& moveFrom)
+    : _animatedGeo(std::move(moveFrom._animatedGeo))
+    , _skeletonBinding(std::move(moveFrom._skeletonBinding))
+    , _vertexCount(moveFrom._vertexCount)
+    , _positionOffset(moveFrom._positionOffset), _normalOffset(moveFrom._normalOffset)
+    , _weightsOffset(moveFrom._weightsOffset), _jointIndicesOffset(moveFrom._jointIndicesOffset)
+    , _valid(moveFrom._valid) {}
+
+    auto ModelRenderer::Pimpl::CPUSkinningSource::operator=(CPUSkinningSource&& moveFrom) -> CPUSkinningSource&
+    {
+        _animatedGeo = std::move(moveFrom._animatedGeo);
+        _skeletonBinding = std::move(moveFrom._skeletonBinding);
+        _vertexCount = moveFrom._vertexCount;
+        _positionOffset = moveFrom._positionOffset; _normalOffset = moveFrom._normalOffset;
+        _weightsOffset = moveFrom._weightsOffset; _jointIndicesOffset = moveFrom._jointIndicesOffset;
+        _valid = moveFrom._valid;
+        return *this;
+    }
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     auto ModelRenderer::CreatePreparedAnimation() const -> PreparedAnimation
@@ -669,16 +864,33 @@ namespace RenderCore { namespace Assets
         Metal::DeviceContext* context, PreparedAnimation& result, 
         const SkeletonBinding& skeletonBinding) const
     {
+            //  With "SkinningOnCPU", we skin with the SIMD kernels in CPUSkinning.cpp
+            //  and upload the result, instead of using the stream output path. This 
+            //  can be useful when the GPU is the bottleneck (or for debugging). Meshes
+            //  with vertex layouts the CPU path doesn't support still go via the GPU.
+            //  The tweakable is read when the model is constructed (that's when the 
+            //  CPU skinning sources are built), so changing it requires a reload.
+        const bool cpuSkinning = !_pimpl->_cpuSkinningSources.empty();
+        bool usedGPUSkinning = false;
         for (size_t i=0; i<_pimpl->_skinnedMeshes.size(); ++i) {
+            if (cpuSkinning
+                && _pimpl->BuildSkinnedBuffer_CPU(
+                    context, unsigned(i), result._finalMatrices.get(), skeletonBinding,
+                    result._skinningBuffer, result._vbOffsets[i])) {
+                continue;
+            }
+
             _pimpl->BuildSkinnedBuffer(
                 context, 
                 _pimpl->_skinnedMeshes[i], 
                 _pimpl->_skinnedBindings[i],
                 result._finalMatrices.get(), skeletonBinding, 
                 result._skinningBuffer, result._vbOffsets[i]);
+            usedGPUSkinning = true;
         }
 
-        _pimpl->EndBuildingSkinning(*context);
+        if (usedGPUSkinning)
+            _pimpl->EndBuildingSkinning(*context);
     }
 
     static intrusive_ptr<ID3D::Device> ExtractDevice(RenderCore::Metal::DeviceContext* context)
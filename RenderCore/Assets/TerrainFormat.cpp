@@ -6,6 +6,7 @@
 
 #include "TerrainFormat.h"
 #include "../../SceneEngine/TerrainUberSurface.h"
+#include "../../SceneEngine/TerrainCompression.h"
 #include "../../RenderCore/Resource.h"
 #include "../../RenderCore/Metal/Format.h"
 #include "../../Assets/ChunkFile.h"
@@ -34,7 +35,8 @@ namespace RenderCore { namespace Assets
         enum Enum 
         {
             None,
-            QuantRange      ///< high precision min-max range, with low precision values in between
+            QuantRange,     ///< high precision min-max range, with low precision values in between
+            Predictive      ///< same as QuantRange, but values are predicted from neighbours and residuals are bit packed (see SceneEngine::TerrainCompression)
         };
         typedef unsigned Type;
     }
@@ -160,7 +162,10 @@ namespace RenderCore { namespace Assets
 
                         float compressionData[2] = { 0.f, 1.f };
                         if (loadInfo._hdr._compressionDataSize) {
-                            if (loadInfo._hdr._compressionType == Compression::QuantRange && loadInfo._hdr._compressionDataSize >= (sizeof(float)*2)) {
+                            bool hasRange = 
+                                    loadInfo._hdr._compressionType == Compression::QuantRange
+                                ||  loadInfo._hdr._compressionType == Compression::Predictive;
+                            if (hasRange && loadInfo._hdr._compressionDataSize >= (sizeof(float)*2)) {
                                 file.Read(compressionData, sizeof(float), 2);
                                 file.Seek(loadInfo._hdr._compressionDataSize - sizeof(float)*2, SEEK_CUR);
                             } else {
@@ -177,6 +182,8 @@ namespace RenderCore { namespace Assets
                         auto node = std::make_unique<Node>(
                             localToCell, loadInfo._hdr._dataOffset + heightDataChunk._fileOffset, 
                             loadInfo._hdr._dataSize, loadInfo._hdr._dimensionsInElements);
+                        if (loadInfo._hdr._compressionType == Compression::Predictive)
+                            node->_encoding = Node::Encoding::Predictive;
 
                         nodes.push_back(std::move(node));
                     }
@@ -308,7 +315,7 @@ namespace RenderCore { namespace Assets
         static CoverageDataResult WriteCoverageData(
             BasicFile& destinationFile, TerrainUberSurface<Element>& surface,
             unsigned startx, unsigned starty, signed downsample, unsigned dimensionsInElements,
-            Compression::Enum compression)
+            Compression::Enum compression, float errorBound)
     {
         float minValue =  FLT_MAX;
         float maxValue = -FLT_MAX;
@@ -349,7 +356,7 @@ namespace RenderCore { namespace Assets
 
             }
 
-        if (compression == Compression::QuantRange) {
+        if (compression == Compression::QuantRange || compression == Compression::Predictive) {
 
             auto compressedHeightData = std::make_unique<uint16[]>(dimensionsInElements*dimensionsInElements);
             for (unsigned y=0; y<dimensionsInElements; ++y)
@@ -361,7 +368,18 @@ namespace RenderCore { namespace Assets
 
                 // write all these results to the file...
             auto rawDataSize = sizeof(uint16)*dimensionsInElements*dimensionsInElements;
-            destinationFile.Write(compressedHeightData.get(), rawDataSize, 1);
+            if (compression == Compression::Predictive) {
+                    //  "errorBound" is in world units; convert it into a number of
+                    //  16 bit quantization steps for this node's range
+                auto quantStep = TerrainCompression::CalculateQuantizationStep(
+                    errorBound, (maxValue - minValue) / float(0xffff));
+                auto encoded = TerrainCompression::EncodePredictive(
+                    compressedHeightData.get(), dimensionsInElements, quantStep);
+                rawDataSize = encoded.size();
+                destinationFile.Write(AsPointer(encoded.begin()), rawDataSize, 1);
+            } else {
+                destinationFile.Write(compressedHeightData.get(), rawDataSize, 1);
+            }
 
             std::vector<uint8> compressionData;
             compressionData.resize(sizeof(float)*2);
@@ -383,7 +401,7 @@ namespace RenderCore { namespace Assets
         static void WriteCellFromUberSurface(
             const char destinationFile[], TerrainUberSurface<Element>& surface, 
             UInt2 cellMins, UInt2 cellMaxs, unsigned treeDepth, unsigned overlapElements,
-            Compression::Enum compression, std::pair<const char*, const char*> versionInfo)
+            Compression::Enum compression, float errorBound, std::pair<const char*, const char*> versionInfo)
     {
         using namespace Serialization::ChunkFile;
 
@@ -396,7 +414,7 @@ namespace RenderCore { namespace Assets
             //  write an area of the uber surface to our native terrain format
         auto nodeCount = NodeCountFromTreeDepth(treeDepth);
         unsigned compressionDataPerNode = 0;
-        if (compression == Compression::QuantRange) {
+        if (compression == Compression::QuantRange || compression == Compression::Predictive) {
             compressionDataPerNode = sizeof(float)*2;
         }
         std::vector<uint8> nodeHeaders;
@@ -418,9 +436,9 @@ namespace RenderCore { namespace Assets
         outputFile.Seek(nodeHeaders.size(), SEEK_CUR);
 
             //  Now write the header for the height data part
-            //  At the moment each node has the same amount of height data...
-            //  If it varies, we would need a separate pass to calculate the 
-            //  total size of this chunk before we write it.
+            //  Nodes are written sequentially, so the size of each node's data
+            //  doesn't need to be known in advance (with predictive compression
+            //  it varies from node to node)
         outputFile.BeginChunk(ChunkType_CoverageData, 0, "Data");
 
         unsigned heightDataOffsetIterator = 0;
@@ -440,7 +458,7 @@ namespace RenderCore { namespace Assets
 
                     auto p = WriteCoverageData(
                         outputFile, surface, rawCoordX, rawCoordY,
-                        downsample, uniqueElementsDimension + overlapElements, compression);
+                        downsample, uniqueElementsDimension + overlapElements, compression, errorBound);
                     assert(p._compressionData.size() == compressionDataPerNode);
 
                     nodeHdr._dataOffset = heightDataOffsetIterator;
@@ -486,7 +504,8 @@ namespace RenderCore { namespace Assets
     {
         WriteCellFromUberSurface(
             destinationFile, surface, cellMins, cellMaxs, treeDepth, overlapElements,
-            Compression::QuantRange, std::make_pair(VersionString, BuildDateString));
+            _predictiveCompression ? Compression::Predictive : Compression::QuantRange, _heightErrorBound,
+            std::make_pair(VersionString, BuildDateString));
     }
 
     void TerrainFormat::WriteCellCoverage_Shadow(
@@ -496,8 +515,12 @@ namespace RenderCore { namespace Assets
         WriteCellFromUberSurface(
             destinationFile, surface, 
             cellMins, cellMaxs, treeDepth, overlapElements,
-            Compression::None, std::make_pair(VersionString, BuildDateString));
+            Compression::None, 0.f, std::make_pair(VersionString, BuildDateString));
     }
 
+    TerrainFormat::TerrainFormat(bool predictiveCompression, float heightErrorBound)
+    : _predictiveCompression(predictiveCompression)
+    , _heightErrorBound(heightErrorBound) {}
+
 }}
 
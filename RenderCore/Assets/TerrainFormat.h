@@ -28,6 +28,11 @@ namespace RenderCore { namespace Assets
     /// terrain data using the ITerrainFormat interface. This
     /// implementation is a native format for use with XLE centric
     /// applications.
+    ///
+    /// When "predictiveCompression" is enabled, height data is written with
+    /// SceneEngine::TerrainCompression. "heightErrorBound" is the maximum error
+    /// (in world units) allowed in addition to normal 16 bit quantization. Zero
+    /// means the compression is lossless with respect to the 16 bit data.
     class TerrainFormat : public SceneEngine::ITerrainFormat
     {
     public:
@@ -39,6 +44,12 @@ namespace RenderCore { namespace Assets
         virtual void WriteCellCoverage_Shadow(
             const char destinationFile[], SceneEngine::TerrainUberSurface<SceneEngine::ShadowSample>& surface, 
             UInt2 cellMins, UInt2 cellMaxs, unsigned treeDepth, unsigned overlapElements) const;
+
+        TerrainFormat(bool predictiveCompression = false, float heightErrorBound = 0.f);
+
+    private:
+        bool    _predictiveCompression;
+        float   _heightErrorBound;
     };
 }}
 
@@ -176,7 +176,7 @@ namespace RenderCore { namespace Assets
                     // i = AdvanceTo16ByteAlignment(i);
                     const Float4x4& transformMatrix = *reinterpret_cast<const Float4x4*>(AsPointer(i)); 
                     i += 16;
-                    *workingTransform = Combine(transformMatrix, *workingTransform);
+                    Combine_InPlace(transformMatrix, *workingTransform);
                 }
                 break;
 
@@ -221,7 +221,7 @@ namespace RenderCore { namespace Assets
                 {
                     uint32 parameterIndex = *i++;
                     if (parameterIndex < float4x4Count) {
-                        *workingTransform = Combine(float4x4s[parameterIndex], *workingTransform);
+                        Combine_InPlace(float4x4s[parameterIndex], *workingTransform);
                     } else {
                         LogWarning << "Warning -- bad parameter index for TransformFloat4x4_Parameter command (" << parameterIndex << ")";
                     }
@@ -7,6 +7,7 @@
 #include "Shader.h"
 #include "DeviceContext.h"
 #include "../../RenderUtils.h"
+#include "../../ShaderVariationArchive.h"
 #include "../../../Assets/ChunkFile.h"
 #include "../../../Assets/IntermediateResources.h"
 #include "../../../Assets/CompileAndAsyncManager.h"
@@ -37,24 +38,43 @@ namespace RenderCore { namespace Metal_DX11
 {
     static const bool CompileInBackground = true;
 
+        //  Shipping builds only load shaders from the precompiled archive (or
+        //  the shader cache). They never invoke the shader compiler.
+    #if !defined(XL_RELEASE)
+        #define SHADER_RUNTIME_COMPILE
+    #endif
+
     ID3DX11ThreadPump* GetThreadPump();
     void FlushThreadPump();
 
         ////////////////////////////////////////////////////////////
 
-    static const char* AdaptShaderModel(const char inputShaderModel[])
+    static void AdaptShaderModel(
+        ResChar destination[], size_t destinationCount,
+        const char inputShaderModel[], const char bestShaderModel[])
     {
-        if (!inputShaderModel || !inputShaderModel[0]) {
-            return inputShaderModel;
-        }
-
-        size_t length = XlStringLen(inputShaderModel);
+        assert(destinationCount > 0);
+        XlCopyString(destination, destinationCount, inputShaderModel ? inputShaderModel : "");
 
             //
             //      Some shaders end with vs_*, gs_*, etc..
             //      Change this to the highest shader model we can support
             //      with the current device
             //
+        size_t length = XlStringLen(destination);
+        if (length && destination[length-1] == '*') {
+            destination[length-1] = '\0';
+            XlCatString(destination, destinationCount, bestShaderModel);
+        }
+    }
+
+    static const char* AdaptShaderModel(const char inputShaderModel[])
+    {
+        if (!inputShaderModel || !inputShaderModel[0]) {
+            return inputShaderModel;
+        }
+
+        size_t length = XlStringLen(inputShaderModel);
         if (inputShaderModel[length-1] == '*') {
             auto featureLevel = ObjectFactory().GetUnderlying()->GetFeatureLevel();
             const char* bestShaderModel;
@@ -65,9 +85,7 @@ namespace RenderCore { namespace Metal_DX11
             else                                                { bestShaderModel = "4_0_level_9_1"; }
 
             static char buffer[64];
-            XlCopyString(buffer, inputShaderModel);
-            buffer[std::min(length-1, dimof(buffer)-1)] = '\0';
-            XlCatString(buffer, dimof(buffer), bestShaderModel);
+            AdaptShaderModel(buffer, dimof(buffer), inputShaderModel, bestShaderModel);
             return buffer;      // note; returning pointer to static char buffer
         }
 
@@ -809,6 +827,25 @@ namespace RenderCore { namespace Metal_DX11
 
         ////////////////////////////////////////////////////////////
 
+    static std::shared_ptr<ShaderVariationArchive> PrecompiledShaders;
+
+    void SetPrecompiledShaderArchive(std::shared_ptr<ShaderVariationArchive> archive)
+    {
+        PrecompiledShaders = std::move(archive);
+    }
+
+    static std::shared_ptr<std::vector<uint8>> LoadPrecompiledShader(uint64 variationHash)
+    {
+        if (!PrecompiledShaders) return nullptr;
+
+        auto block = PrecompiledShaders->Find(variationHash);
+        if (!block._data) return nullptr;
+        return std::make_shared<std::vector<uint8>>(
+            (const uint8*)block._data, PtrAdd((const uint8*)block._data, block._size));
+    }
+
+        ////////////////////////////////////////////////////////////
+
     class OfflineCompileProcess 
         : public ::Assets::IntermediateResources::IResourceCompiler
         , public std::enable_shared_from_this<OfflineCompileProcess>
@@ -887,6 +924,19 @@ namespace RenderCore { namespace Metal_DX11
 
         if (initializers[0] && initializers[0][0] != '\0' && XlCompareStringI(shaderId._filename, "null")!=0) {
 
+                //  Check the precompiled shader archive first. Precompiled shaders don't
+                //  have dependencies on the source files; so they will never be
+                //  recompiled when the source changes. A marker without an archive cache
+                //  tells the CompiledShaderByteCode to look in the precompiled archive.
+            auto variationHash = MakeShaderVariationHash(initializers[0], definesTable);
+            if (PrecompiledShaders && PrecompiledShaders->HasItem(variationHash)) {
+                marker = std::make_shared<::Assets::PendingCompileMarker>(
+                    ::Assets::AssetState::Ready, archiveName, variationHash, 
+                    std::make_shared<::Assets::DependencyValidation>());
+                DEBUG_ONLY(marker->SetInitializer(initializers[0]));
+                return std::move(marker);
+            }
+
                 //  If this object already exists in the archive, and the dependencies are not
                 //  invalidated, then we can load it immediately
                 //  We can't rely on the dependencies being identical for each version of that
@@ -904,6 +954,13 @@ namespace RenderCore { namespace Metal_DX11
                 }
             } 
 
+            #if !defined(SHADER_RUNTIME_COMPILE)
+                if (!marker) {
+                    LogWarning << "Shader variation missing from precompiled archive (" << initializers[0] << ") with defines (" << (definesTable?definesTable:"") << ")";
+                    marker = std::make_shared<::Assets::PendingCompileMarker>(::Assets::AssetState::Invalid, archiveName, archiveId, nullptr);
+                }
+            #endif
+
             if (!marker) {
                 marker = std::make_shared<::Assets::PendingCompileMarker>(::Assets::AssetState::Pending, archiveName, archiveId, nullptr);
                 marker->_archive = archive;
@@ -953,6 +1010,66 @@ namespace RenderCore { namespace Metal_DX11
 
         ////////////////////////////////////////////////////////////
 
+    class ShaderVariationCompiler_D3D : public IShaderVariationCompiler
+    {
+    public:
+        std::vector<uint8> Compile(const ShaderVariationDesc& variation) const;
+
+        ShaderVariationCompiler_D3D(const char defaultShaderModel[]);
+        ~ShaderVariationCompiler_D3D();
+    private:
+        std::string _defaultShaderModel;
+    };
+
+    std::vector<uint8> ShaderVariationCompiler_D3D::Compile(const ShaderVariationDesc& variation) const
+    {
+            //  This is called from many threads at once. So we can't use the thread pump
+            //  or the device (to find the best shader model), and everything must
+            //  be on the stack. D3DX11CompileFromFile is synchronous without a thread pump.
+        ShaderResId shaderPath(variation._initializer.c_str());
+
+        ResChar shaderModel[dimof(shaderPath._shaderModel)];
+        AdaptShaderModel(shaderModel, dimof(shaderModel), shaderPath._shaderModel, _defaultShaderModel.c_str());
+
+        ResChar directoryName[MaxPath], baseName[MaxPath];
+        XlDirname(directoryName, dimof(directoryName), shaderPath._filename);
+        XlBasename(baseName, dimof(baseName), shaderPath._filename);
+        IncludeHandler includeHandler(directoryName, baseName);
+
+        std::string definesCopy;
+        auto arrayOfDefines = MakeDefinesTable(variation._definesTable.c_str(), shaderPath._shaderModel, definesCopy);
+
+        ID3D::Blob* shaderTemp = nullptr;
+        ID3D::Blob* errorsTemp = nullptr;
+        HRESULT hresult = D3DX11CompileFromFile(
+            shaderPath._filename, AsPointer(arrayOfDefines.cbegin()), &includeHandler, 
+            shaderPath._entryPoint, shaderModel,
+            GetShaderCompilationFlags(),
+            0, nullptr, &shaderTemp, &errorsTemp, nullptr);
+        intrusive_ptr<ID3D::Blob> shader = moveptr(shaderTemp);
+        intrusive_ptr<ID3D::Blob> errors = moveptr(errorsTemp);
+
+        if (!SUCCEEDED(hresult) || !shader) {
+            const char* errorString = (errors && errors->GetBufferPointer()) ? (const char*)errors->GetBufferPointer() : "Unknown error";
+            ThrowException(Assets::Exceptions::InvalidResource(variation._initializer.c_str(), errorString));
+        }
+
+        return std::vector<uint8>(
+            (const uint8*)shader->GetBufferPointer(), 
+            PtrAdd((const uint8*)shader->GetBufferPointer(), shader->GetBufferSize()));
+    }
+
+    ShaderVariationCompiler_D3D::ShaderVariationCompiler_D3D(const char defaultShaderModel[])
+    : _defaultShaderModel(defaultShaderModel) {}
+    ShaderVariationCompiler_D3D::~ShaderVariationCompiler_D3D() {}
+
+    std::unique_ptr<IShaderVariationCompiler> CreateShaderVariationCompiler(const char defaultShaderModel[])
+    {
+        return std::make_unique<ShaderVariationCompiler_D3D>(defaultShaderModel);
+    }
+
+        ////////////////////////////////////////////////////////////
+
     static ShaderStage::Enum AsShaderStage(const char shaderModel[])
     {
         switch (shaderModel[0]) {
@@ -991,6 +1108,8 @@ namespace RenderCore { namespace Metal_DX11
                     } CATCH (...) {
                         ThrowException(Assets::Exceptions::InvalidResource(Initializer(), ""));
                     } CATCH_END
+                } else {
+                    _shader1 = LoadPrecompiledShader(marker->_sourceID1);
                 }
 
                 if (!_shader1 || _shader1->empty()) {
@@ -1019,7 +1138,14 @@ namespace RenderCore { namespace Metal_DX11
             ShaderResId shaderPath(initializer);
             if (XlCompareStringI(shaderPath._filename, "null")!=0) {
                 _stage = AsShaderStage(shaderPath._shaderModel);
-                compileHelper = std::make_unique<ShaderCompileHelper>(shaderPath, definesTable, validationCallback);
+                _shader1 = LoadPrecompiledShader(MakeShaderVariationHash(initializer, definesTable));
+                if (!_shader1) {
+                    #if defined(SHADER_RUNTIME_COMPILE)
+                        compileHelper = std::make_unique<ShaderCompileHelper>(shaderPath, definesTable, validationCallback);
+                    #else
+                        ThrowException(Assets::Exceptions::InvalidResource(initializer, "Shader variation missing from precompiled archive"));
+                    #endif
+                }
             }
         }
 
@@ -1062,6 +1188,8 @@ namespace RenderCore { namespace Metal_DX11
                     } CATCH (...) {
                         LogWarning << "Compilation marker is finished, but shader couldn't be opened from cache (" << _marker->_sourceID0 << ":" <<_marker->_sourceID1 << ")";
                     } CATCH_END
+                } else {
+                    _shader1 = LoadPrecompiledShader(_marker->_sourceID1);
                 }
             }
 
@@ -26,6 +26,7 @@ namespace Assets {
 }
 
 namespace Assets { class DependencyValidation; }
+namespace RenderCore { class ShaderVariationArchive; class IShaderVariationCompiler; }
 
 namespace RenderCore { namespace Metal_DX11
 {
@@ -371,4 +372,16 @@ namespace RenderCore { namespace Metal_DX11
 
     std::unique_ptr<::Assets::CompileAndAsyncManager> CreateCompileAndAsyncManager();
 
+        /// <summary>Use an archive of precompiled shaders</summary>
+        /// Shader variations found in the archive are loaded from there, instead of
+        /// being compiled. Call before any shaders are loaded (not thread safe).
+        /// In shipping (XL_RELEASE) builds, shaders are never compiled at runtime; so
+        /// any variation not in the archive (or the shader cache) will be invalid.
+    void SetPrecompiledShaderArchive(std::shared_ptr<ShaderVariationArchive> archive);
+
+        /// <summary>Creates a compiler backend for the offline shader precompiler</summary>
+        /// "defaultShaderModel" replaces the "*" in shader models like "vs_*" (since
+        /// there is no device to query the feature level from).
+    std::unique_ptr<IShaderVariationCompiler> CreateShaderVariationCompiler(const char defaultShaderModel[] = "5_0");
+
 }}
\ No newline at end of file
@@ -0,0 +1,169 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../Metal/Metal.h"
+
+#if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+
+#include "Device.h"
+#include "Metal/DeviceContext.h"
+#include "../../Utility/PtrUtils.h"
+#include <assert.h>
+
+namespace RenderCore
+{
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    Device::Device(const Metal_Headless::SimulatedGPUDesc& desc)
+    {
+        _gpu = std::make_shared<Metal_Headless::SimulatedGPU>(desc);
+    }
+
+    Device::~Device()
+    {
+        _immediateThreadContext.reset();
+    }
+
+    void*   Device::QueryInterface(const GUID& guid)
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<IPresentationChain>   Device::CreatePresentationChain(const void* platformValue, unsigned width, unsigned height)
+    {
+        return std::make_unique<PresentationChain>(width, height);
+    }
+
+    void    Device::BeginFrame(IPresentationChain* presentationChain) {}
+
+    std::shared_ptr<IThreadContext> Device::GetImmediateContext()
+    {
+        if (!_immediateThreadContext) {
+            _immediateThreadContext = std::make_shared<ThreadContext>(
+                std::make_shared<Metal_Headless::DeviceContext>(_gpu, true), shared_from_this());
+        }
+        return _immediateThreadContext;
+    }
+
+    std::unique_ptr<IThreadContext> Device::CreateDeferredContext()
+    {
+            //  the simulated GPU is thread safe, so we can always create
+            //  deferred contexts
+        return std::make_unique<ThreadContext>(
+            std::make_shared<Metal_Headless::DeviceContext>(_gpu, false), shared_from_this());
+    }
+
+    extern char VersionString[];
+    extern char BuildDateString[];
+        
+    std::pair<const char*, const char*> Device::GetVersionInformation()
+    {
+        return std::make_pair(VersionString, BuildDateString);
+    }
+
+    #if !FLEX_USE_VTABLE_Device && !DOXYGEN
+        namespace Detail
+        {
+            void* Ignore_Device::QueryInterface(const GUID& guid)
+            {
+                return nullptr;
+            }
+        }
+    #endif
+
+    render_dll_export std::shared_ptr<IDevice>    CreateDevice()
+    {
+        return std::make_shared<Device>(Metal_Headless::SimulatedGPUDesc());
+    }
+
+    std::shared_ptr<IDevice>    CreateHeadlessDevice(const Metal_Headless::SimulatedGPUDesc& desc)
+    {
+        return std::make_shared<Device>(desc);
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    PresentationChain::PresentationChain(unsigned width, unsigned height)
+    : _width(width), _height(height)
+    {}
+
+    PresentationChain::~PresentationChain() {}
+
+    void            PresentationChain::Present() {}
+
+    void            PresentationChain::Resize(unsigned newWidth, unsigned newHeight)
+    {
+        _width = newWidth;
+        _height = newHeight;
+    }
+
+    PresentationChainDesc   PresentationChain::GetDesc() const
+    {
+        PresentationChainDesc result;
+        result._dimensions = Int2(int(_width), int(_height));
+        return result;
+    }
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+	#if !FLEX_USE_VTABLE_ThreadContext && !DOXYGEN
+		namespace Detail
+		{
+			void* Ignore_ThreadContext::QueryInterface(const GUID& guid)
+			{
+				return nullptr;
+			}
+		}
+	#endif
+
+    void*   ThreadContext::QueryInterface(const GUID& guid)
+    {
+        return nullptr;
+    }
+
+    bool    ThreadContext::IsImmediate() const
+    {
+        return _underlying->IsImmediate();
+    }
+
+    auto ThreadContext::GetStateDesc() const -> StateDesc
+    {
+        StateDesc result;
+        result._viewportDimensions = Int2(0, 0);
+        return result;
+    }
+
+    std::shared_ptr<IDevice> ThreadContext::GetDevice() const
+    {
+        return _device.lock();
+    }
+
+    void ThreadContext::ClearAllBoundTargets() const {}
+
+    ThreadContext::ThreadContext(std::shared_ptr<Metal_Headless::DeviceContext> devContext, std::shared_ptr<Device> device)
+    : _underlying(std::move(devContext))
+    , _device(std::move(device))
+    {}
+
+    ThreadContext::~ThreadContext() {}
+
+    //////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace Metal_Headless
+    {
+        std::shared_ptr<DeviceContext>  DeviceContext::Get(IThreadContext& threadContext)
+        {
+            return checked_cast<ThreadContext*>(&threadContext)->GetUnderlying();
+        }
+
+        ObjectFactory::ObjectFactory(IDevice* device)
+        : _gpu(checked_cast<Device*>(device)->GetGPU())
+        {}
+    }
+}
+
+#endif
+
@@ -0,0 +1,87 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#define FLEX_CONTEXT_Device				FLEX_CONTEXT_CONCRETE
+#define FLEX_CONTEXT_PresentationChain	FLEX_CONTEXT_CONCRETE
+#define FLEX_CONTEXT_ThreadContext		FLEX_CONTEXT_CONCRETE
+
+#include "../IDevice.h"
+#include "../IThreadContext.h"
+#include "IDeviceHeadless.h"
+
+namespace RenderCore
+{
+////////////////////////////////////////////////////////////////////////////////
+
+    namespace Metal_Headless { class DeviceContext; class SimulatedGPU; }
+
+    class Device;
+
+        //  There's no window to present to; the presentation chain just
+        //  remembers its dimensions
+    class PresentationChain : public Base_PresentationChain
+    {
+    public:
+        void                Present() /*override*/;
+        void                Resize(unsigned newWidth, unsigned newHeight) /*override*/;
+
+        PresentationChainDesc   GetDesc() const;
+
+        PresentationChain(unsigned width, unsigned height);
+        ~PresentationChain();
+    private:
+        unsigned _width, _height;
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+
+    class ThreadContext : public Base_ThreadContext
+    {
+    public:
+        void*                       QueryInterface(const GUID& guid);
+        bool                        IsImmediate() const;
+        StateDesc                   GetStateDesc() const;
+        std::shared_ptr<IDevice>    GetDevice() const;
+        void                        ClearAllBoundTargets() const;
+
+        const std::shared_ptr<Metal_Headless::DeviceContext>& GetUnderlying() const { return _underlying; }
+
+        ThreadContext(std::shared_ptr<Metal_Headless::DeviceContext> devContext, std::shared_ptr<Device> device);
+        ~ThreadContext();
+    protected:
+        std::shared_ptr<Metal_Headless::DeviceContext> _underlying;
+        std::weak_ptr<Device> _device;  // (must be weak, because Device holds a shared_ptr to the immediate context)
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+
+    class Device : public Base_Device, public std::enable_shared_from_this<Device>
+    {
+    public:
+        void*   QueryInterface(const GUID& guid);
+        std::unique_ptr<IPresentationChain>     CreatePresentationChain(const void* platformValue, unsigned width, unsigned height) /*override*/;
+        void    BeginFrame(IPresentationChain* presentationChain);
+
+        std::pair<const char*, const char*>     GetVersionInformation();
+
+        std::shared_ptr<IThreadContext>         GetImmediateContext();
+        std::unique_ptr<IThreadContext>         CreateDeferredContext();
+
+        const std::shared_ptr<Metal_Headless::SimulatedGPU>& GetGPU() const { return _gpu; }
+
+        Device(const Metal_Headless::SimulatedGPUDesc& desc);
+        ~Device();
+
+    protected:
+        std::shared_ptr<Metal_Headless::SimulatedGPU>   _gpu;
+        std::shared_ptr<IThreadContext>                 _immediateThreadContext;
+    };
+
+////////////////////////////////////////////////////////////////////////////////
+}
+
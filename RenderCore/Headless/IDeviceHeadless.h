@@ -0,0 +1,24 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../IDevice.h"
+#include <memory>
+
+namespace RenderCore
+{
+    namespace Metal_Headless { class SimulatedGPUDesc; }
+
+        /// <summary>Creates a device that works only with CPU memory</summary>
+        /// The headless device can't render anything, but it implements resource
+        /// creation, uploads and fences against a simulated GPU (with the timing
+        /// given in the desc). It's intended for benchmarking systems like
+        /// BufferUploads on machines without a real graphics API.
+        /// CreateDevice() returns a headless device with default timing.
+    std::shared_ptr<IDevice>    CreateHeadlessDevice(const Metal_Headless::SimulatedGPUDesc& desc);
+}
+
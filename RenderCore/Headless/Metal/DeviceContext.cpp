@@ -0,0 +1,206 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "DeviceContext.h"
+#include "../../../Utility/Threading/ThreadingUtils.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace RenderCore { namespace Metal_Headless
+{
+    static void WaitUntil(Microsecond time)
+    {
+        for (;;) {
+            auto now = Microsecond_Now();
+            if (now >= time) break;
+                //  sleep for long waits, but spin for short ones (the
+                //  granularity of Sleep() is too coarse for the short waits)
+            if ((time - now) > 2000) {
+                Threading::Sleep(uint32((time - now) / 1000) - 1);
+            } else {
+                Threading::YieldTimeSlice();
+            }
+        }
+    }
+
+    SimulatedGPUDesc::SimulatedGPUDesc()
+    {
+        _submitLatency = 500;
+        _copyBytesPerMicrosecond = 4096;        // roughly 4GB/second
+        _copyOverhead = 5;
+        _createResourceTime = 50;
+        _mapTime = 10;
+    }
+
+    SimulatedGPUMetrics::SimulatedGPUMetrics()
+    {
+        _submitCount = _copyCount = _stallCount = 0;
+        _bytesCopied = 0;
+        _stallTime = _busyTime = 0;
+    }
+
+        ////////////////////////////////////////////////////////////////////////////////
+
+    auto SimulatedGPU::Submit(Microsecond gpuTime, size_t bytesCopied, unsigned copyCount) -> Fence
+    {
+        auto now = Microsecond_Now();
+        ScopedLock(_lock);
+        RetireCompleted(now);
+
+        auto start = std::max(now + _desc._submitLatency, _busyUntil);
+        _busyUntil = start + gpuTime;
+
+        auto fence = _nextFence++;
+        _inFlight.push_back(std::make_pair(fence, _busyUntil));
+
+        ++_metrics._submitCount;
+        _metrics._copyCount += copyCount;
+        _metrics._bytesCopied += bytesCopied;
+        _metrics._busyTime += gpuTime;
+        return fence;
+    }
+
+    auto SimulatedGPU::GetCompletedFence() -> Fence
+    {
+        auto now = Microsecond_Now();
+        ScopedLock(_lock);
+        RetireCompleted(now);
+        return _completedFence;
+    }
+
+    auto SimulatedGPU::GetSubmittedFence() const -> Fence
+    {
+        ScopedLock(_lock);
+        return _nextFence-1;
+    }
+
+    void SimulatedGPU::WaitForFence(Fence fence)
+    {
+        auto now = Microsecond_Now();
+        Microsecond completionTime;
+        {
+            ScopedLock(_lock);
+            RetireCompleted(now);
+            if (fence <= _completedFence) return;
+
+                //  fences are allocated sequentially, so we can find the entry
+                //  in the in-flight list directly
+            assert(!_inFlight.empty() && fence < _nextFence);
+            completionTime = _inFlight[size_t(fence - _inFlight.front().first)].second;
+        }
+
+        WaitUntil(completionTime);
+
+        ScopedLock(_lock);
+        ++_metrics._stallCount;
+        _metrics._stallTime += Microsecond_Now() - now;
+    }
+
+    void SimulatedGPU::SimulateCPUTime(Microsecond time)
+    {
+        if (time) {
+            WaitUntil(Microsecond_Now() + time);
+        }
+    }
+
+    Microsecond SimulatedGPU::CalculateCopyTime(size_t bytes) const
+    {
+        Microsecond result = _desc._copyOverhead;
+        if (_desc._copyBytesPerMicrosecond) {
+            result += Microsecond(bytes / _desc._copyBytesPerMicrosecond);
+        }
+        return result;
+    }
+
+    SimulatedGPUMetrics SimulatedGPU::GetMetrics() const
+    {
+        ScopedLock(_lock);
+        return _metrics;
+    }
+
+    void SimulatedGPU::RetireCompleted(Microsecond now)
+    {
+            //  completion times are in fence order, because the GPU executes
+            //  blocks one at a time
+        while (!_inFlight.empty() && _inFlight.front().second <= now) {
+            _completedFence = _inFlight.front().first;
+            _inFlight.pop_front();
+        }
+    }
+
+    SimulatedGPU::SimulatedGPU(const SimulatedGPUDesc& desc)
+    : _desc(desc)
+    {
+        _nextFence = 1;
+        _completedFence = 0;
+        _busyUntil = 0;
+    }
+
+    SimulatedGPU::~SimulatedGPU() {}
+
+        ////////////////////////////////////////////////////////////////////////////////
+
+    CommandList::CommandList() : _gpuTime(0), _bytesCopied(0), _copyCount(0) {}
+    CommandList::~CommandList() {}
+
+    void DeviceContext::RecordCopy(const Underlying::Resource& destination, size_t bytes)
+    {
+        auto gpuTime = _gpu->CalculateCopyTime(bytes);
+        if (_immediate) {
+            destination.SetGPUFence(_gpu->Submit(gpuTime, bytes, 1));
+        } else {
+            if (!_pendingCommandList) {
+                _pendingCommandList = make_intrusive<CommandList>();
+            }
+            _pendingCommandList->_gpuTime += gpuTime;
+            _pendingCommandList->_bytesCopied += bytes;
+            ++_pendingCommandList->_copyCount;
+            _pendingCommandList->_writtenResources.push_back(
+                intrusive_ptr<Underlying::Resource>(const_cast<Underlying::Resource*>(&destination)));
+        }
+    }
+
+    void DeviceContext::BeginCommandList()
+    {
+        _pendingCommandList.reset();
+    }
+
+    intrusive_ptr<CommandList> DeviceContext::ResolveCommandList()
+    {
+        if (!_pendingCommandList) {
+            return make_intrusive<CommandList>();
+        }
+        return std::move(_pendingCommandList);
+    }
+
+    void DeviceContext::CommitCommandList(CommandList& commandList)
+    {
+        assert(_immediate);
+        auto fence = _gpu->Submit(commandList._gpuTime, commandList._bytesCopied, commandList._copyCount);
+        for (auto i=commandList._writtenResources.cbegin(); i!=commandList._writtenResources.cend(); ++i) {
+            (*i)->SetGPUFence(fence);
+        }
+    }
+
+    DeviceContext::DeviceContext(std::shared_ptr<SimulatedGPU> gpu, bool immediate)
+    : _gpu(std::move(gpu)), _immediate(immediate)
+    {}
+
+    DeviceContext::~DeviceContext() {}
+
+        ////////////////////////////////////////////////////////////////////////////////
+
+    ObjectFactory::ObjectFactory(const Underlying::Resource& resource)
+    : _gpu(resource.GetGPU())
+    {}
+
+    ObjectFactory::ObjectFactory() {}
+    ObjectFactory::~ObjectFactory() {}
+
+        //  (ObjectFactory(IDevice*) and DeviceContext::Get() are implemented in
+        //  Headless/Device.cpp, because they need the concrete device types)
+}}
+
@@ -0,0 +1,153 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Resource.h"
+#include "Types.h"
+#include "Format.h"
+#include "../../IDevice_Forward.h"
+#include "../../IThreadContext_Forward.h"
+#include "../../../Utility/Threading/Mutex.h"
+#include "../../../Utility/IntrusivePtr.h"
+#include "../../../Utility/TimeUtils.h"
+#include "../../../Utility/Mixins.h"
+#include <memory>
+#include <vector>
+#include <deque>
+
+namespace RenderCore { namespace Metal_Headless
+{
+        /// <summary>Timing settings for a simulated GPU</summary>
+        /// These control how long operations take on the simulated GPU (and how
+        /// much CPU time the simulated driver spends in some calls). Use them to
+        /// model the behaviour of a particular platform while benchmarking.
+    class SimulatedGPUDesc
+    {
+    public:
+        Microsecond     _submitLatency;             ///< time between submitting work and the GPU starting on it
+        unsigned        _copyBytesPerMicrosecond;   ///< copy bandwidth on the GPU (0 for unlimited)
+        Microsecond     _copyOverhead;              ///< fixed GPU cost per copy command
+        Microsecond     _createResourceTime;        ///< CPU cost of creating a resource
+        Microsecond     _mapTime;                   ///< CPU cost of a map (not including any stall)
+
+        SimulatedGPUDesc();
+    };
+
+    class SimulatedGPUMetrics
+    {
+    public:
+        unsigned        _submitCount;
+        unsigned        _copyCount;
+        uint64          _bytesCopied;
+        unsigned        _stallCount;
+        Microsecond     _stallTime;                 ///< total time CPU threads spent waiting on the GPU
+        Microsecond     _busyTime;                  ///< total time the GPU spent executing work
+
+        SimulatedGPUMetrics();
+    };
+
+        ///
+        /// <summary>Simulates the timing of a GPU, without doing any GPU work</summary>
+        ///
+        /// Work is submitted as a block of "GPU time". The simulated GPU executes blocks
+        /// in order, one at a time, starting each block no earlier than the submit latency
+        /// after it was submitted. Each block gets a fence value, which completes when
+        /// the wall clock passes the block's end time.
+        ///
+        /// All methods are thread safe.
+        ///
+    class SimulatedGPU : noncopyable
+    {
+    public:
+        typedef uint64  Fence;
+
+        Fence           Submit(Microsecond gpuTime, size_t bytesCopied = 0, unsigned copyCount = 0);
+        Fence           GetCompletedFence();
+        Fence           GetSubmittedFence() const;
+        void            WaitForFence(Fence fence);
+        void            SimulateCPUTime(Microsecond time);
+        Microsecond     CalculateCopyTime(size_t bytes) const;
+
+        const SimulatedGPUDesc& GetDesc() const     { return _desc; }
+        SimulatedGPUMetrics     GetMetrics() const;
+
+        SimulatedGPU(const SimulatedGPUDesc& desc);
+        ~SimulatedGPU();
+    private:
+        SimulatedGPUDesc            _desc;
+        mutable Threading::Mutex    _lock;
+
+        std::deque<std::pair<Fence, Microsecond>> _inFlight;    // (fence, completion time) in fence order
+        Fence                       _nextFence;
+        Fence                       _completedFence;
+        Microsecond                 _busyUntil;
+        SimulatedGPUMetrics         _metrics;
+
+        void    RetireCompleted(Microsecond now);
+    };
+
+        ////////////////////////////////////////////////////////////////////////////////
+
+    class CommandList : public RefCountedObject, noncopyable
+    {
+    public:
+        Microsecond     _gpuTime;
+        size_t          _bytesCopied;
+        unsigned        _copyCount;
+        std::vector<intrusive_ptr<Underlying::Resource>> _writtenResources;
+
+        CommandList();
+        ~CommandList();
+    };
+
+        ///
+        /// <summary>Records work for the simulated GPU</summary>
+        ///
+        /// The immediate context submits each operation as it is recorded. Deferred
+        /// contexts accumulate operations into a CommandList, which is submitted when
+        /// it's committed to the immediate context.
+        ///
+        /// In both cases, the memory copy itself has already happened on the CPU by the
+        /// time the operation is recorded. Only the timing is deferred.
+        ///
+    class DeviceContext : noncopyable
+    {
+    public:
+        void                        RecordCopy(const Underlying::Resource& destination, size_t bytes);
+
+        void                        BeginCommandList();
+        intrusive_ptr<CommandList>  ResolveCommandList();
+        void                        CommitCommandList(CommandList& commandList);
+
+        static std::shared_ptr<DeviceContext> Get(IThreadContext& threadContext);
+
+        SimulatedGPU*               GetUnderlying() const   { return _gpu.get(); }
+        bool                        IsImmediate() const     { return _immediate; }
+
+        DeviceContext(std::shared_ptr<SimulatedGPU> gpu, bool immediate);
+        ~DeviceContext();
+    private:
+        std::shared_ptr<SimulatedGPU>   _gpu;
+        intrusive_ptr<CommandList>      _pendingCommandList;
+        bool                            _immediate;
+    };
+
+    class ObjectFactory
+    {
+    public:
+        SimulatedGPU&   GetGPU() const { return *_gpu; }
+        const std::shared_ptr<SimulatedGPU>& GetGPUPtr() const { return _gpu; }
+
+        ObjectFactory(IDevice* device);
+        ObjectFactory(const Underlying::Resource& resource);
+        ObjectFactory();
+        ~ObjectFactory();
+    private:
+        std::shared_ptr<SimulatedGPU> _gpu;
+    };
+}}
+
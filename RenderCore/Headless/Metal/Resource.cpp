@@ -0,0 +1,54 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "Resource.h"
+#include "DeviceContext.h"
+#include "../../../Utility/PtrUtils.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace RenderCore { namespace Metal_Headless { namespace Underlying
+{
+    void*   Resource::GetData(unsigned subResource) const
+    {
+        assert(subResource < _subResources.size());
+        return PtrAdd(_data.get(), _subResources[subResource]._offset);
+    }
+
+    uint64  Resource::GetGPUFence() const
+    {
+        return uint64(Interlocked::Load64(&_gpuFence));
+    }
+
+    void    Resource::SetGPUFence(uint64 fence) const
+    {
+            //  Fences only move forward. Commits from different threads can
+            //  arrive out of order, so never replace a later fence with an
+            //  earlier one.
+        for (;;) {
+            auto current = Interlocked::Load64(&_gpuFence);
+            if (uint64(current) >= fence) break;
+            if (Interlocked::CompareExchange64(&_gpuFence, Interlocked::Value64(fence), current) == current) break;
+        }
+    }
+
+    Resource::Resource(std::shared_ptr<SimulatedGPU> gpu, std::vector<SubResource>&& subResources)
+    : _gpu(std::move(gpu))
+    , _subResources(std::move(subResources))
+    , _gpuFence(0)
+    {
+        _dataSize = 0;
+        for (auto i=_subResources.cbegin(); i!=_subResources.cend(); ++i) {
+            _dataSize = std::max(_dataSize, i->_offset + i->_size);
+        }
+        if (_dataSize) {
+            _data.reset((uint8*)XlMemAlign(_dataSize, 16));
+        }
+    }
+
+    Resource::~Resource() {}
+}}}
+
@@ -0,0 +1,61 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../../Core/Types.h"
+#include "../../../Utility/Threading/ThreadingUtils.h"
+#include "../../../Utility/MemoryUtils.h"
+#include "../../../Utility/Mixins.h"
+#include <vector>
+#include <memory>
+
+namespace RenderCore { namespace Metal_Headless
+{
+    class SimulatedGPU;
+
+    namespace Underlying
+    {
+            ///
+            /// <summary>A resource that lives in CPU memory</summary>
+            ///
+            /// All of the subresources (mip levels & array layers) are allocated in a single
+            /// block. Copies into and out of the resource happen on the CPU immediately (so
+            /// the contents are always up-to-date). But each write also records the fence of
+            /// the simulated GPU work that will write to it. Map() uses that fence to stall
+            /// in the same situations a real GPU resource would stall.
+            ///
+        class Resource : public RefCountedObject, noncopyable
+        {
+        public:
+            class SubResource
+            {
+            public:
+                size_t      _offset, _size;
+                unsigned    _rowPitch, _slicePitch;
+            };
+
+            void*               GetData(unsigned subResource = 0) const;
+            size_t              GetDataSize() const                     { return _dataSize; }
+            const SubResource&  GetSubResource(unsigned index) const    { return _subResources[index]; }
+            unsigned            GetSubResourceCount() const             { return unsigned(_subResources.size()); }
+
+            uint64              GetGPUFence() const;
+            void                SetGPUFence(uint64 fence) const;
+            const std::shared_ptr<SimulatedGPU>& GetGPU() const         { return _gpu; }
+
+            Resource(std::shared_ptr<SimulatedGPU> gpu, std::vector<SubResource>&& subResources);
+            virtual ~Resource();
+        protected:
+            std::shared_ptr<SimulatedGPU>               _gpu;
+            std::vector<SubResource>                    _subResources;
+            std::unique_ptr<uint8, PODAlignedDeletor>   _data;
+            size_t                                      _dataSize;
+            mutable Interlocked::Value64                _gpuFence;
+        };
+    }
+}}
+
@@ -0,0 +1,31 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Resource.h"
+#include "../../../Utility/IntrusivePtr.h"
+
+namespace RenderCore { namespace Metal_Headless
+{
+        /// <summary>Shader resource view on a headless resource</summary>
+        /// There are no shaders in the headless backend; this just keeps a reference
+        /// to the underlying resource, so client code that holds views can compile.
+    class ShaderResourceView
+    {
+    public:
+        typedef Underlying::Resource    UnderlyingType;
+
+        UnderlyingType*     GetUnderlying() const   { return _resource.get(); }
+        bool                IsGood() const          { return _resource.get() != nullptr; }
+
+        explicit ShaderResourceView(UnderlyingType* resource) : _resource(resource) {}
+        ShaderResourceView() {}
+    private:
+        intrusive_ptr<Underlying::Resource> _resource;
+    };
+}}
+
@@ -0,0 +1,27 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../../Core/Types.h"
+#include "../../../Utility/Threading/ThreadingUtils.h"
+#include "../../../Utility/IntrusivePtr.h"
+
+namespace RenderCore { namespace Metal_Headless
+{
+        /// <summary>Event query on the simulated GPU</summary>
+        /// The query is "triggered" once the simulated GPU has retired the fence
+        /// that was current when the query was ended.
+    class Query : public RefCountedObject
+    {
+    public:
+        uint64  _fence;
+        Query() : _fence(0) {}
+    };
+
+    typedef intrusive_ptr<Query>    UnderlyingQuery;
+}}
+
@@ -11,8 +11,12 @@
 #define GFXAPI_DX11         1
 #define GFXAPI_DX9          2
 #define GFXAPI_OPENGLES     3
+#define GFXAPI_HEADLESS     4       // CPU memory only; see RenderCore/Headless
 
-#if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+#if defined(SELECT_HEADLESS)
+    #define GFXAPI_ACTIVE   GFXAPI_HEADLESS
+
+#elif PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
 
     #if defined(SELECT_OPENGL)
         #define GFXAPI_ACTIVE   GFXAPI_OPENGLES
@@ -22,9 +26,14 @@
 
 #elif PLATFORMOS_ACTIVE == PLATFORMOS_ANDROID
     #define GFXAPI_ACTIVE   GFXAPI_OPENGLES
+#elif PLATFORMOS_ACTIVE == PLATFORMOS_LINUX
+    #define GFXAPI_ACTIVE   GFXAPI_HEADLESS
 #endif
 
-#if PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
+#if defined(SELECT_HEADLESS)
+    #define GFXAPI_TARGET   GFXAPI_HEADLESS
+
+#elif PLATFORMOS_TARGET == PLATFORMOS_WINDOWS
     
     #if defined(SELECT_OPENGL)
         #define GFXAPI_TARGET   GFXAPI_OPENGLES
@@ -34,6 +43,8 @@
 
 #elif PLATFORMOS_TARGET == PLATFORMOS_ANDROID
     #define GFXAPI_TARGET   GFXAPI_OPENGLES
+#elif PLATFORMOS_TARGET == PLATFORMOS_LINUX
+    #define GFXAPI_TARGET   GFXAPI_HEADLESS
 #endif
 
 // #define _PSTE(X,Y) X##Y
@@ -47,6 +58,13 @@
         namespace Metal_DX11 {}
         namespace Metal = Metal_DX11;
     }
+#elif GFXAPI_ACTIVE == GFXAPI_HEADLESS
+    #define METAL_HEADER(X) _STRIZE(../Headless/Metal/X)
+
+    namespace RenderCore {
+        namespace Metal_Headless {}
+        namespace Metal = Metal_Headless;
+    }
 #else
     #define METAL_HEADER(X) _STRIZE(../OpenGLES/Metal/X)
 
@@ -0,0 +1,288 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ShaderVariationArchive.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/ParallelFor.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Core/Exceptions.h"
+#include <algorithm>
+
+namespace RenderCore
+{
+        //  Archive layout:
+        //      ArchiveHeader
+        //      ArchiveSlot[_slotCount]     (open addressing hash table, linear probing)
+        //      byte code blocks            (each aligned to BlockAlignment)
+        //
+        //  _slotCount is always a power of 2, and at least twice the number of
+        //  variations -- so probe sequences are short, and always terminate on
+        //  an empty slot. Variation hashes of 0 are remapped (0 marks an empty slot).
+    class ArchiveHeader
+    {
+    public:
+        uint32      _magic;
+        uint32      _version;
+        uint32      _slotCount;
+        uint32      _variationCount;
+
+        static const uint32 Magic = 0x7a3c5e11;
+        static const uint32 Version = 1;
+    };
+
+    class ArchiveSlot
+    {
+    public:
+        uint64      _hash;
+        uint32      _offset;    // (from the start of the file)
+        uint32      _size;
+    };
+
+    static const unsigned BlockAlignment = 16;
+    static const uint64 EmptySlot = 0;
+    static const uint64 ZeroHashReplacement = 0x9e3779b97f4a7c15ull;
+
+    static size_t AlignUp(size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+    static uint64 AsSlotHash(uint64 hash)   { return (hash != EmptySlot) ? hash : ZeroHashReplacement; }
+    static unsigned FirstSlot(uint64 hash, unsigned slotCount) { return unsigned((hash ^ (hash >> 32)) & uint64(slotCount-1)); }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    uint64 MakeShaderVariationHash(const char initializer[], const char definesTable[])
+    {
+        auto hash = Hash64(initializer ? initializer : "");
+        return Hash64(definesTable ? definesTable : "", hash);
+    }
+
+    uint64 ShaderVariationDesc::GetHash() const
+    {
+        return MakeShaderVariationHash(_initializer.c_str(), _definesTable.c_str());
+    }
+
+    ShaderVariationDesc::ShaderVariationDesc() {}
+    ShaderVariationDesc::ShaderVariationDesc(const char initializer[], const char definesTable[])
+    : _initializer(initializer ? initializer : "")
+    , _definesTable(definesTable ? definesTable : "")
+    {}
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    auto ShaderVariationArchive::Find(uint64 variationHash) const -> Block
+    {
+        Block result;
+        result._data = nullptr;
+        result._size = 0;
+
+        auto& hdr = *(const ArchiveHeader*)_data;
+        auto* slots = (const ArchiveSlot*)PtrAdd(_data, sizeof(ArchiveHeader));
+        auto hash = AsSlotHash(variationHash);
+        auto mask = hdr._slotCount-1;
+        for (unsigned c=0, i=FirstSlot(hash, hdr._slotCount); c<hdr._slotCount; ++c, i=(i+1)&mask) {
+            if (slots[i]._hash == hash) {
+                result._data = PtrAdd(_data, slots[i]._offset);
+                result._size = slots[i]._size;
+                break;
+            }
+            if (slots[i]._hash == EmptySlot) break;
+        }
+        return result;
+    }
+
+    unsigned ShaderVariationArchive::GetVariationCount() const
+    {
+        return ((const ArchiveHeader*)_data)->_variationCount;
+    }
+
+    void ShaderVariationArchive::Validate()
+    {
+            //  Check the header and the slot table, so that Find() never has
+            //  to do any bounds checking
+        if (!_data || _size < sizeof(ArchiveHeader)) {
+            ThrowException(::Exceptions::BasicLabel("Shader variation archive is missing or truncated"));
+        }
+
+        auto& hdr = *(const ArchiveHeader*)_data;
+        if (hdr._magic != ArchiveHeader::Magic || hdr._version != ArchiveHeader::Version) {
+            ThrowException(::Exceptions::BasicLabel("Shader variation archive has unknown format or version"));
+        }
+
+        if (!hdr._slotCount || (hdr._slotCount & (hdr._slotCount-1)) || hdr._variationCount >= hdr._slotCount
+            || (sizeof(ArchiveHeader) + hdr._slotCount * sizeof(ArchiveSlot)) > _size) {
+            ThrowException(::Exceptions::BasicLabel("Shader variation archive has a corrupt index"));
+        }
+
+        auto* slots = (const ArchiveSlot*)PtrAdd(_data, sizeof(ArchiveHeader));
+        for (unsigned c=0; c<hdr._slotCount; ++c) {
+            if (slots[c]._hash != EmptySlot && (uint64(slots[c]._offset) + uint64(slots[c]._size)) > _size) {
+                ThrowException(::Exceptions::BasicLabel("Shader variation archive has a corrupt index"));
+            }
+        }
+    }
+
+    ShaderVariationArchive::ShaderVariationArchive(const char filename[])
+    {
+        _data = nullptr;
+        _size = 0;
+
+        auto fileSize = GetFileSize(filename);
+        auto mappedFile = std::make_unique<MemoryMappedFile>(filename, 0, MemoryMappedFile::Access::Read);
+        if (mappedFile->IsValid()) {
+            _data = mappedFile->GetData();
+            _size = size_t(fileSize);
+        }
+        _mappedFile = std::move(mappedFile);
+        Validate();
+    }
+
+    ShaderVariationArchive::ShaderVariationArchive(std::unique_ptr<uint8[]>&& memoryBlock, size_t size)
+    {
+        _memoryBlock = std::move(memoryBlock);
+        _data = _memoryBlock.get();
+        _size = size;
+        Validate();
+    }
+
+    ShaderVariationArchive::~ShaderVariationArchive() {}
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void ShaderVariationArchiveWriter::Add(uint64 variationHash, const void* byteCodeBegin, const void* byteCodeEnd)
+    {
+        auto hash = AsSlotHash(variationHash);
+        std::vector<uint8> byteCode((const uint8*)byteCodeBegin, (const uint8*)byteCodeEnd);
+        auto i = LowerBound(_variations, hash);
+        if (i != _variations.end() && i->first == hash) {
+            i->second = std::move(byteCode);
+        } else {
+            _variations.insert(i, std::make_pair(hash, std::move(byteCode)));
+        }
+    }
+
+    std::vector<uint8> ShaderVariationArchiveWriter::BuildMemoryBlock() const
+    {
+        unsigned slotCount = 16;
+        while (slotCount < _variations.size()*2) slotCount <<= 1;
+
+        size_t dataStart = sizeof(ArchiveHeader) + slotCount * sizeof(ArchiveSlot);
+        size_t totalSize = AlignUp(dataStart, BlockAlignment);
+        for (const auto& v:_variations) {
+            totalSize += AlignUp(v.second.size(), BlockAlignment);
+        }
+        if (totalSize > size_t(0xffffffffu)) {
+            ThrowException(::Exceptions::BasicLabel("Too much data for a single shader variation archive"));
+        }
+
+        std::vector<uint8> result(totalSize, 0);
+        auto& hdr = *(ArchiveHeader*)AsPointer(result.begin());
+        hdr._magic = ArchiveHeader::Magic;
+        hdr._version = ArchiveHeader::Version;
+        hdr._slotCount = slotCount;
+        hdr._variationCount = unsigned(_variations.size());
+
+        auto* slots = (ArchiveSlot*)PtrAdd(AsPointer(result.begin()), sizeof(ArchiveHeader));
+        auto mask = slotCount-1;
+        auto offset = AlignUp(dataStart, BlockAlignment);
+        for (const auto& v:_variations) {
+            auto i = FirstSlot(v.first, slotCount);
+            while (slots[i]._hash != EmptySlot) i = (i+1)&mask;
+            slots[i]._hash = v.first;
+            slots[i]._offset = uint32(offset);
+            slots[i]._size = uint32(v.second.size());
+
+            if (!v.second.empty()) {
+                XlCopyMemory(&result[offset], AsPointer(v.second.cbegin()), v.second.size());
+            }
+            offset += AlignUp(v.second.size(), BlockAlignment);
+        }
+
+        return std::move(result);
+    }
+
+    void ShaderVariationArchiveWriter::Write(const char filename[]) const
+    {
+        auto block = BuildMemoryBlock();
+        BasicFile file(filename, "wb");
+        if (file.Write(AsPointer(block.cbegin()), 1, block.size()) != block.size()) {
+            ThrowException(::Exceptions::BasicLabel("Failed while writing shader variation archive (%s)", filename));
+        }
+    }
+
+    ShaderVariationArchiveWriter::ShaderVariationArchiveWriter() {}
+    ShaderVariationArchiveWriter::~ShaderVariationArchiveWriter() {}
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    IShaderVariationCompiler::~IShaderVariationCompiler() {}
+
+    ShaderPrecompileResult::ShaderPrecompileResult() : _compiledCount(0) {}
+
+    ShaderPrecompileResult PrecompileShaderVariations(
+        ShaderVariationArchiveWriter& dst,
+        const ShaderVariationDesc variations[], size_t variationCount,
+        const IShaderVariationCompiler& compiler, unsigned threadCount)
+    {
+            //  Find the unique variations first. Techniques with different
+            //  parameters will often resolve to the same shader variation.
+        std::vector<std::pair<uint64, unsigned>> uniqueVariations;
+        uniqueVariations.reserve(variationCount);
+        for (unsigned c=0; c<variationCount; ++c) {
+            auto hash = variations[c].GetHash();
+            auto i = LowerBound(uniqueVariations, hash);
+            if (i == uniqueVariations.end() || i->first != hash) {
+                uniqueVariations.insert(i, std::make_pair(hash, c));
+            }
+        }
+
+        class CompileResult
+        {
+        public:
+            std::vector<uint8>  _byteCode;
+            std::string         _errors;
+            bool                _compiled, _success;
+            CompileResult() : _compiled(false), _success(false) {}
+        };
+        std::vector<CompileResult> compileResults(variationCount);
+
+            //  Each worker thread just pulls the next variation from the list. Shader
+            //  compiles vary a lot in cost, so this balances better than splitting
+            //  the list up front.
+        Threading::ParallelFor(
+            std::max(1u, threadCount), unsigned(uniqueVariations.size()),
+            [&](unsigned index) {
+                auto variationIndex = uniqueVariations[index].second;
+                auto& result = compileResults[variationIndex];
+                result._compiled = true;
+                TRY {
+                    result._byteCode = compiler.Compile(variations[variationIndex]);
+                    result._success = true;
+                } CATCH (const std::exception& e) {
+                    result._errors = e.what();
+                } CATCH (...) {
+                    result._errors = "Unknown exception";
+                } CATCH_END
+            });
+
+            //  Add to the archive in the original order, so the output doesn't
+            //  depend on thread timing
+        ShaderPrecompileResult result;
+        for (unsigned c=0; c<variationCount; ++c) {
+            auto& r = compileResults[c];
+            if (r._success) {
+                dst.Add(
+                    variations[c].GetHash(),
+                    AsPointer(r._byteCode.cbegin()), AsPointer(r._byteCode.cend()));
+                ++result._compiledCount;
+            } else if (r._compiled) {
+                result._failures.push_back(std::make_pair(variations[c], std::move(r._errors)));
+            }
+        }
+
+        return std::move(result);
+    }
+}
+
@@ -0,0 +1,133 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Utility/Mixins.h"
+#include "../Core/Types.h"
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace Utility { class MemoryMappedFile; }
+
+namespace RenderCore
+{
+    /// <summary>Identifies a single compiled shader</summary>
+    /// This is the pair of strings that's passed to the shader compiler when a
+    /// CompiledShaderByteCode asset is constructed: the "file:entrypoint:shadermodel"
+    /// initializer and the defines table ("NAME=value;NAME2=value2;").
+    class ShaderVariationDesc
+    {
+    public:
+        std::string     _initializer;
+        std::string     _definesTable;
+
+        uint64          GetHash() const;
+
+        ShaderVariationDesc();
+        ShaderVariationDesc(const char initializer[], const char definesTable[]);
+    };
+
+    /// <summary>Calculates the key used for a shader variation in a ShaderVariationArchive</summary>
+    /// This must match between the offline precompiler and the run-time lookup, so it's
+    /// calculated directly from the strings passed to the shader compiler. A null defines
+    /// table is equivalent to an empty one.
+    uint64 MakeShaderVariationHash(const char initializer[], const char definesTable[]);
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /// <summary>Read-only packed archive of precompiled shader variations</summary>
+    /// The archive is a single file, containing an open addressing hash table of
+    /// variation hashes (see MakeShaderVariationHash), followed by the compiled
+    /// byte code for each variation. It's designed to be memory mapped and used in
+    /// place; so lookups don't allocate, and are O(1).
+    ///
+    /// Archives are built offline with ShaderVariationArchiveWriter (normally by the
+    /// ShaderPrecompiler tool).
+    class ShaderVariationArchive : noncopyable
+    {
+    public:
+        class Block
+        {
+        public:
+            const void*     _data;
+            size_t          _size;
+        };
+
+            /// <summary>Find a variation</summary>
+            /// Returns a block with null _data if the variation isn't in the archive.
+            /// The returned pointer remains valid for the lifetime of the archive.
+        Block       Find(uint64 variationHash) const;
+        bool        HasItem(uint64 variationHash) const { return Find(variationHash)._data != nullptr; }
+        unsigned    GetVariationCount() const;
+
+        ShaderVariationArchive(const char filename[]);
+        ShaderVariationArchive(std::unique_ptr<uint8[]>&& memoryBlock, size_t size);
+        ~ShaderVariationArchive();
+
+    private:
+        std::unique_ptr<Utility::MemoryMappedFile>  _mappedFile;
+        std::unique_ptr<uint8[]>                    _memoryBlock;
+        const void*                                 _data;
+        size_t                                      _size;
+
+        void Validate();
+    };
+
+    /// <summary>Builds a ShaderVariationArchive</summary>
+    /// Adding the same variation twice will replace the previous byte code.
+    class ShaderVariationArchiveWriter
+    {
+    public:
+        void    Add(uint64 variationHash, const void* byteCodeBegin, const void* byteCodeEnd);
+        size_t  GetVariationCount() const { return _variations.size(); }
+
+        std::vector<uint8>  BuildMemoryBlock() const;
+        void                Write(const char filename[]) const;
+
+        ShaderVariationArchiveWriter();
+        ~ShaderVariationArchiveWriter();
+    private:
+        std::vector<std::pair<uint64, std::vector<uint8>>> _variations;
+    };
+
+        ////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /// <summary>Compiler backend used by the shader precompiler</summary>
+    /// The platform layer provides an implementation that calls the real shader
+    /// compiler (see Metal::CreateShaderVariationCompiler). Other implementations
+    /// can be used for testing, or for cross compiling for another platform.
+    ///
+    /// Compile() will be called from multiple threads simultaneously. On failure,
+    /// it should throw an exception (normally ::Assets::Exceptions::InvalidResource).
+    class IShaderVariationCompiler
+    {
+    public:
+        virtual std::vector<uint8> Compile(const ShaderVariationDesc& variation) const = 0;
+        virtual ~IShaderVariationCompiler();
+    };
+
+    class ShaderPrecompileResult
+    {
+    public:
+        unsigned    _compiledCount;
+        std::vector<std::pair<ShaderVariationDesc, std::string>> _failures;     ///< variation and error message
+
+        ShaderPrecompileResult();
+    };
+
+    /// <summary>Compiles a set of variations in parallel, and adds them to an archive writer</summary>
+    /// Duplicate variations are only compiled once. Variations that fail to compile are
+    /// recorded in the result, and not added to the archive. Variations are added to
+    /// "dst" in the order given, regardless of the order in which the compiles finish,
+    /// so the output is deterministic.
+    ShaderPrecompileResult PrecompileShaderVariations(
+        ShaderVariationArchiveWriter& dst,
+        const ShaderVariationDesc variations[], size_t variationCount,
+        const IShaderVariationCompiler& compiler, unsigned threadCount);
+}
+
@@ -13,6 +13,7 @@ namespace RenderCore { namespace Techniques
     namespace Internal
     {
         std::vector<std::unique_ptr<IBoxTable>> BoxTables;
+        unsigned BoxFrameIndex = 0;
         IBoxTable::~IBoxTable() {}
     }
 
@@ -47,4 +48,22 @@ namespace RenderCore { namespace Techniques
         Internal::BoxTables = std::vector<std::unique_ptr<Internal::IBoxTable>>();
     }
 
+    void ResourceBoxes_OnFrameBarrier()
+    {
+        ++Internal::BoxFrameIndex;
+        for (auto i=Internal::BoxTables.begin(); i!=Internal::BoxTables.end(); ++i) {
+            (*i)->OnFrameBarrier(Internal::BoxFrameIndex);
+        }
+    }
+
+    std::vector<ResourceBoxMetrics> ResourceBoxes_GetMetrics()
+    {
+        std::vector<ResourceBoxMetrics> result;
+        result.reserve(Internal::BoxTables.size());
+        for (auto i=Internal::BoxTables.cbegin(); i!=Internal::BoxTables.cend(); ++i) {
+            result.push_back((*i)->GetMetrics());
+        }
+        return std::move(result);
+    }
+
 }}
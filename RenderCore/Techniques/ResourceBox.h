@@ -13,24 +13,249 @@
 #include "../../Utility/IteratorUtils.h"
 #include <vector>
 #include <algorithm>
+#include <typeinfo>
 
-namespace RenderCore { namespace Techniques 
+namespace RenderCore { namespace Techniques
 {
 
     ///////////////////////////////////////////////////////////////////////////////////////////////
 
+    /// <summary>Eviction settings for a type of cached box</summary>
+    /// By default, boxes are never evicted. Only enable eviction for box types
+    /// where clients don't hold onto the returned reference past the end of the
+    /// frame -- eviction happens in ResourceBoxes_OnFrameBarrier().
+    class BoxEvictionPolicy
+    {
+    public:
+        unsigned    _maxCount;          ///< evict least recently used boxes above this count (0 for unlimited)
+        unsigned    _maxAgeFrames;      ///< evict boxes that haven't been used for this many frames (0 for never)
+
+        BoxEvictionPolicy() : _maxCount(0), _maxAgeFrames(0) {}
+        BoxEvictionPolicy(unsigned maxCount, unsigned maxAgeFrames) : _maxCount(maxCount), _maxAgeFrames(maxAgeFrames) {}
+    };
+
+    class ResourceBoxMetrics
+    {
+    public:
+        const char* _typeName;
+        unsigned    _count;
+        size_t      _bytes;             ///< total of GetBoxAllocationSize() for each box
+        uint64      _hits, _misses;
+        unsigned    _evictions;
+
+        float       GetHitRate() const { return (_hits + _misses) ? float(double(_hits) / double(_hits + _misses)) : 0.f; }
+    };
+
+        /// <summary>Default eviction policy for a type of cached box</summary>
+        /// Box types that want eviction can overload this in their own namespace
+        /// (it's found by argument dependent lookup). It's called once, when the
+        /// table for the type is created. SetBoxEvictionPolicy() can still change the
+        /// policy afterwards.
+    template <typename Box> BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const Box*) { return BoxEvictionPolicy(); }
+
+        /// <summary>Memory owned by a cached box</summary>
+        /// Box types that own GPU resources should overload this in their own namespace
+        /// (it's found by argument dependent lookup), so that ResourceBoxes_GetMetrics()
+        /// reports the real allocation. It's called once, when the box is inserted.
+    template <typename Box> size_t GetBoxAllocationSize(const Box&) { return sizeof(Box); }
+
     namespace Internal
     {
-        struct IBoxTable { virtual ~IBoxTable(); };
+        struct IBoxTable
+        {
+            virtual void                OnFrameBarrier(unsigned frameIndex) = 0;
+            virtual ResourceBoxMetrics  GetMetrics() const = 0;
+            virtual ~IBoxTable();
+        };
         extern std::vector<std::unique_ptr<IBoxTable>> BoxTables;
+        extern unsigned BoxFrameIndex;
 
-        template <typename Box> struct BoxTable : public IBoxTable
+            //
+            //  Open addressing hash table (with linear probing) of boxes, keyed by
+            //  the hash of the desc. The key is already a good hash value, so we
+            //  can use the low bits directly to find the first slot. Removes use
+            //  backward shift deletion, so we don't need tombstones.
+            //
+        template <typename Box> class BoxTable : public IBoxTable
         {
-            std::vector<std::pair<uint64, std::unique_ptr<Box>>>    _internalTable;
+        public:
+            Box*        Find(uint64 hashValue);
+            Box&        Insert(uint64 hashValue, std::unique_ptr<Box>&& box);
+            void        Remove(uint64 hashValue);
+
+            void                OnFrameBarrier(unsigned frameIndex);
+            ResourceBoxMetrics  GetMetrics() const;
+
+            BoxEvictionPolicy   _policy;
+
+            BoxTable();
+            ~BoxTable();
+        private:
+            class Entry
+            {
+            public:
+                uint64                  _hashValue;
+                std::unique_ptr<Box>    _box;       // (null for an empty slot)
+                unsigned                _lastUsedFrame;
+                size_t                  _bytes;
+            };
+            std::unique_ptr<Entry[]>    _entries;
+            unsigned                    _capacity;
+            unsigned                    _count;
+            size_t                      _bytes;
+            uint64                      _hits, _misses;
+            unsigned                    _evictions;
+
+            unsigned    FindSlot(uint64 hashValue) const;
+            void        Grow();
+            static unsigned FirstSlot(uint64 hashValue, unsigned capacity) { return unsigned(hashValue ^ (hashValue >> 32)) & (capacity-1); }
         };
+
+        template <typename Box> unsigned BoxTable<Box>::FindSlot(uint64 hashValue) const
+        {
+                // returns the slot with this hash value, or ~0u if it's not there
+            if (!_capacity) return ~0u;
+            auto mask = _capacity-1;
+            for (auto i=FirstSlot(hashValue, _capacity);; i=(i+1)&mask) {
+                if (!_entries[i]._box) return ~0u;
+                if (_entries[i]._hashValue == hashValue) return i;
+            }
+        }
+
+        template <typename Box> Box* BoxTable<Box>::Find(uint64 hashValue)
+        {
+            auto i = FindSlot(hashValue);
+            if (i == ~0u) { ++_misses; return nullptr; }
+            ++_hits;
+            _entries[i]._lastUsedFrame = BoxFrameIndex;
+            return _entries[i]._box.get();
+        }
+
+        template <typename Box> Box& BoxTable<Box>::Insert(uint64 hashValue, std::unique_ptr<Box>&& box)
+        {
+            auto existing = FindSlot(hashValue);
+            if (existing != ~0u) {
+                _entries[existing]._box = std::move(box);
+                _entries[existing]._lastUsedFrame = BoxFrameIndex;
+                _bytes -= _entries[existing]._bytes;
+                _entries[existing]._bytes = GetBoxAllocationSize(*_entries[existing]._box);
+                _bytes += _entries[existing]._bytes;
+                return *_entries[existing]._box;
+            }
+
+                //  keep the load factor under 3/4, so there's always an empty slot
+                //  to terminate searches
+            if ((_count+1)*4 > _capacity*3) {
+                Grow();
+            }
+
+            auto mask = _capacity-1;
+            auto i = FirstSlot(hashValue, _capacity);
+            while (_entries[i]._box) i = (i+1)&mask;
+            _entries[i]._hashValue = hashValue;
+            _entries[i]._box = std::move(box);
+            _entries[i]._lastUsedFrame = BoxFrameIndex;
+            _entries[i]._bytes = GetBoxAllocationSize(*_entries[i]._box);
+            _bytes += _entries[i]._bytes;
+            ++_count;
+            return *_entries[i]._box;
+        }
+
+        template <typename Box> void BoxTable<Box>::Remove(uint64 hashValue)
+        {
+            auto i = FindSlot(hashValue);
+            if (i == ~0u) return;
+
+            _entries[i]._box.reset();
+            _bytes -= _entries[i]._bytes;
+            --_count;
+
+                //  Shift back following entries in the same probe sequence, so
+                //  that searches still find them
+            auto mask = _capacity-1;
+            for (auto j=(i+1)&mask; _entries[j]._box; j=(j+1)&mask) {
+                auto home = FirstSlot(_entries[j]._hashValue, _capacity);
+                bool canMove = (i <= j) ? (home <= i || home > j) : (home <= i && home > j);
+                if (canMove) {
+                    _entries[i]._hashValue = _entries[j]._hashValue;
+                    _entries[i]._box = std::move(_entries[j]._box);
+                    _entries[i]._lastUsedFrame = _entries[j]._lastUsedFrame;
+                    _entries[i]._bytes = _entries[j]._bytes;
+                    i = j;
+                }
+            }
+        }
+
+        template <typename Box> void BoxTable<Box>::Grow()
+        {
+            auto newCapacity = _capacity ? (_capacity*2) : 16;
+            std::unique_ptr<Entry[]> newEntries(new Entry[newCapacity]);
+            auto mask = newCapacity-1;
+            for (unsigned c=0; c<_capacity; ++c) {
+                if (!_entries[c]._box) continue;
+                auto i = FirstSlot(_entries[c]._hashValue, newCapacity);
+                while (newEntries[i]._box) i = (i+1)&mask;
+                newEntries[i]._hashValue = _entries[c]._hashValue;
+                newEntries[i]._box = std::move(_entries[c]._box);
+                newEntries[i]._lastUsedFrame = _entries[c]._lastUsedFrame;
+                newEntries[i]._bytes = _entries[c]._bytes;
+            }
+            _entries = std::move(newEntries);
+            _capacity = newCapacity;
+        }
+
+        template <typename Box> void BoxTable<Box>::OnFrameBarrier(unsigned frameIndex)
+        {
+            if (!_policy._maxCount && !_policy._maxAgeFrames) return;
+
+            std::vector<std::pair<unsigned, uint64>> toEvict;
+            std::vector<std::pair<unsigned, uint64>> byAge;
+            for (unsigned c=0; c<_capacity; ++c) {
+                if (!_entries[c]._box) continue;
+                auto age = frameIndex - _entries[c]._lastUsedFrame;
+                if (_policy._maxAgeFrames && age > _policy._maxAgeFrames) {
+                    toEvict.push_back(std::make_pair(age, _entries[c]._hashValue));
+                } else {
+                    byAge.push_back(std::make_pair(age, _entries[c]._hashValue));
+                }
+            }
+
+            if (_policy._maxCount && byAge.size() > _policy._maxCount) {
+                    //  evict the least recently used boxes
+                auto evictCount = byAge.size() - _policy._maxCount;
+                std::nth_element(byAge.begin(), byAge.begin() + evictCount, byAge.end(),
+                    [](const std::pair<unsigned, uint64>& lhs, const std::pair<unsigned, uint64>& rhs) { return lhs.first > rhs.first; });
+                toEvict.insert(toEvict.end(), byAge.begin(), byAge.begin() + evictCount);
+            }
+
+            for (auto i=toEvict.cbegin(); i!=toEvict.cend(); ++i) {
+                Remove(i->second);
+            }
+            _evictions += unsigned(toEvict.size());
+        }
+
+        template <typename Box> ResourceBoxMetrics BoxTable<Box>::GetMetrics() const
+        {
+            ResourceBoxMetrics result;
+            result._typeName = typeid(Box).name();
+            result._count = _count;
+            result._bytes = _bytes;
+            result._hits = _hits;
+            result._misses = _misses;
+            result._evictions = _evictions;
+            return result;
+        }
+
+        template <typename Box> BoxTable<Box>::BoxTable()
+        : _capacity(0), _count(0), _bytes(0), _hits(0), _misses(0), _evictions(0)
+        {
+            _policy = GetDefaultBoxEvictionPolicy((const Box*)nullptr);
+        }
+
+        template <typename Box> BoxTable<Box>::~BoxTable() {}
     }
 
-    template <typename Box> std::vector<std::pair<uint64, std::unique_ptr<Box>>>& GetBoxTable()
+    template <typename Box> Internal::BoxTable<Box>& GetBoxTable()
         {
             static Internal::BoxTable<Box>* table = nullptr;
             if (!table) {
@@ -38,24 +263,23 @@ namespace RenderCore { namespace Techniques
                 table = t.get();    // note -- this will end up holding a dangling ptr after calling shutdown (could use a weak_ptr...?)
                 Internal::BoxTables.push_back(std::move(t));
             }
-            return table->_internalTable;
+            return *table;
         }
 
     template <typename Box> Box& FindCachedBox(const typename Box::Desc& desc)
     {
         uint64 hashValue = Hash64(&desc, PtrAdd(&desc, sizeof(typename Box::Desc)));
         auto& boxTable = GetBoxTable<Box>();
-        auto i = std::lower_bound(boxTable.cbegin(), boxTable.cend(), hashValue, CompareFirst<uint64, std::unique_ptr<Box>>());
-        if (i!=boxTable.cend() && i->first==hashValue) {
-            return *i->second;
+        auto* existing = boxTable.Find(hashValue);
+        if (existing) {
+            return *existing;
         }
 
         auto ptr = std::make_unique<Box>(desc);
         ConsoleRig::xleWarningDebugOnly(
-            "Created cached box for type (%s) -- first time. HashValue:(0x%08x%08x)\n", 
+            "Created cached box for type (%s) -- first time. HashValue:(0x%08x%08x)\n",
             typeid(Box).name(), uint32(hashValue>>32), uint32(hashValue));
-        auto i2 = boxTable.insert(i, std::make_pair(hashValue, std::move(ptr)));
-        return *i2->second;
+        return boxTable.Insert(hashValue, std::move(ptr));
     }
 
     template <typename Desc> uint64 CalculateCachedBoxHash(const Desc& desc)
@@ -67,27 +291,37 @@ namespace RenderCore { namespace Techniques
     {
         auto hashValue = CalculateCachedBoxHash(desc);
         auto& boxTable = GetBoxTable<Box>();
-        auto i = std::lower_bound(boxTable.begin(), boxTable.end(), hashValue, CompareFirst<uint64, std::unique_ptr<Box>>());
-        if (i!=boxTable.end() && i->first==hashValue) {
-            if (i->second->GetDependencyValidation().GetValidationIndex()!=0) {
-                i->second = std::make_unique<Box>(desc);
+        auto* existing = boxTable.Find(hashValue);
+        if (existing) {
+            if (existing->GetDependencyValidation().GetValidationIndex()!=0) {
                 ConsoleRig::xleWarningDebugOnly(
-                    "Created cached box for type (%s) -- rebuilding due to validation failure. HashValue:(0x%08x%08x)\n", 
+                    "Created cached box for type (%s) -- rebuilding due to validation failure. HashValue:(0x%08x%08x)\n",
                     typeid(Box).name(), uint32(hashValue>>32), uint32(hashValue));
+                return boxTable.Insert(hashValue, std::make_unique<Box>(desc));
             }
-            return *i->second;
+            return *existing;
         }
 
         auto ptr = std::make_unique<Box>(desc);
-        ConsoleRig::xleWarningDebugOnly(    
-            "Created cached box for type (%s) -- first time. HashValue:(0x%08x%08x)\n", 
+        ConsoleRig::xleWarningDebugOnly(
+            "Created cached box for type (%s) -- first time. HashValue:(0x%08x%08x)\n",
             typeid(Box).name(), uint32(hashValue>>32), uint32(hashValue));
-        auto i2 = boxTable.insert(i, std::make_pair(hashValue, std::move(ptr)));
-        return *i2->second;
+        return boxTable.Insert(hashValue, std::move(ptr));
+    }
+
+    template <typename Box> void SetBoxEvictionPolicy(const BoxEvictionPolicy& policy)
+    {
+        GetBoxTable<Box>()._policy = policy;
     }
 
     void ResourceBoxes_Shutdown();
 
+        /// <summary>Evict unused boxes, and advance the frame counter</summary>
+        /// Call once per frame, at a point where no client is holding a reference
+        /// to a cached box (the frame rig calls it after rendering).
+    void ResourceBoxes_OnFrameBarrier();
+    std::vector<ResourceBoxMetrics> ResourceBoxes_GetMetrics();
+
     ///////////////////////////////////////////////////////////////////////////////////////////////
 
 }}
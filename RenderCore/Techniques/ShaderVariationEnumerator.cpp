@@ -0,0 +1,91 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ShaderVariationEnumerator.h"
+#include "../../Utility/IteratorUtils.h"
+#include <algorithm>
+
+namespace RenderCore { namespace Techniques
+{
+    void    ShaderVariationEnumerator::AddParameterBox(ShaderParameters::Source::Enum source, ParameterBox&& box)
+    {
+        assert(unsigned(source) < ShaderParameters::Source::Max);
+
+            //  ignore duplicates (eg, many materials will have identical
+            //  material parameters)
+        auto hash = box.GetHash() ^ box.GetParameterNamesHash();
+        auto& boxes = _boxes[source];
+        auto i = LowerBound(boxes, hash);
+        if (i != boxes.end() && i->first == hash) {
+            return;
+        }
+        boxes.insert(i, std::make_pair(hash, std::move(box)));
+    }
+
+    void    ShaderVariationEnumerator::AddTechnique(const Technique& technique)
+    {
+        if (!technique.IsValid()) {
+            return;
+        }
+
+        ParameterBox emptyBox;
+            //  The product of the box counts can overflow even 64 bits, so we
+            //  saturate at the limit as we go
+        uint64 counts[ShaderParameters::Source::Max];
+        uint64 combinations = 1;
+        for (unsigned c=0; c<ShaderParameters::Source::Max; ++c) {
+            counts[c] = std::max(uint64(1), uint64(_boxes[c].size()));
+            if (combinations > _maxCombinationsPerTechnique / counts[c]) {
+                ++_techniquesSkipped;
+                return;
+            }
+            combinations *= counts[c];
+        }
+
+        for (uint64 combination=0; combination<combinations; ++combination) {
+            const ParameterBox* state[ShaderParameters::Source::Max];
+            auto index = combination;
+            for (unsigned c=0; c<ShaderParameters::Source::Max; ++c) {
+                auto boxIndex = index % counts[c];
+                index /= counts[c];
+                state[c] = _boxes[c].empty() ? &emptyBox : &_boxes[c][boxIndex].second;
+            }
+
+            auto names = technique.ResolveShaderNames(state);
+            AddVariation(names._vertexShader, names._definesTable);
+            AddVariation(names._pixelShader, names._definesTable);
+            if (!names._geometryShader.empty()) {
+                AddVariation(names._geometryShader, names._definesTable);
+            }
+            ++_combinationsTested;
+        }
+    }
+
+    void    ShaderVariationEnumerator::AddShaderType(const ShaderType& shaderType)
+    {
+        for (unsigned c=0; c<shaderType.GetTechniqueCount(); ++c) {
+            AddTechnique(*shaderType.GetTechnique(c));
+        }
+    }
+
+    void    ShaderVariationEnumerator::AddVariation(const std::string& shader, const std::string& definesTable)
+    {
+        auto hash = MakeShaderVariationHash(shader.c_str(), definesTable.c_str());
+        auto i = std::lower_bound(_variationHashes.begin(), _variationHashes.end(), hash);
+        if (i != _variationHashes.end() && *i == hash) {
+            return;
+        }
+        _variationHashes.insert(i, hash);
+        _variations.push_back(ShaderVariationDesc(shader.c_str(), definesTable.c_str()));
+    }
+
+    ShaderVariationEnumerator::ShaderVariationEnumerator(uint64 maxCombinationsPerTechnique)
+    : _combinationsTested(0)
+    , _maxCombinationsPerTechnique(std::max(uint64(1), maxCombinationsPerTechnique))
+    , _techniquesSkipped(0) {}
+    ShaderVariationEnumerator::~ShaderVariationEnumerator() {}
+}}
+
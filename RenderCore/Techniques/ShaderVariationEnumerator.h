@@ -0,0 +1,59 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Techniques.h"
+#include "../ShaderVariationArchive.h"
+#include <vector>
+
+namespace RenderCore { namespace Techniques
+{
+    /// <summary>Finds the shader variations that techniques can resolve to</summary>
+    /// Used by the shader precompiler to find every shader that might be needed
+    /// at runtime, without compiling anything.
+    ///
+    /// For each parameter source (geometry, global environment, runtime and material),
+    /// the client registers the parameter boxes that can occur (eg, one box for each
+    /// vertex format, one for each material in the material scaffolds that will be
+    /// loaded, one for each lighting configuration...). Then each technique is resolved
+    /// with every combination of those boxes. Since most parameters are filtered out by
+    /// each technique, the combinations collapse down to a much smaller set of unique
+    /// variations.
+    ///
+    /// If no boxes are registered for a source, an empty box is used for that source.
+    ///
+    /// The number of combinations grows very quickly as boxes are added. Techniques
+    /// that would need more than "maxCombinationsPerTechnique" combinations are
+    /// skipped (and counted in GetTechniquesSkipped()), rather than enumerated.
+    class ShaderVariationEnumerator
+    {
+    public:
+        void    AddParameterBox(ShaderParameters::Source::Enum source, ParameterBox&& box);
+        void    AddTechnique(const Technique& technique);
+        void    AddShaderType(const ShaderType& shaderType);
+
+        const std::vector<ShaderVariationDesc>& GetVariations() const { return _variations; }
+        uint64      GetCombinationsTested() const { return _combinationsTested; }
+        unsigned    GetTechniquesSkipped() const { return _techniquesSkipped; }
+
+        ShaderVariationEnumerator(uint64 maxCombinationsPerTechnique = 1ull<<24ull);
+        ~ShaderVariationEnumerator();
+    private:
+        std::vector<std::pair<uint64, ParameterBox>>    _boxes[ShaderParameters::Source::Max];
+        std::vector<ShaderVariationDesc>                _variations;
+        std::vector<uint64>                             _variationHashes;   // (sorted)
+        uint64                                          _combinationsTested;
+        uint64                                          _maxCombinationsPerTechnique;
+        unsigned                                        _techniquesSkipped;
+
+        void    AddVariation(const std::string& shader, const std::string& definesTable);
+
+        ShaderVariationEnumerator(const ShaderVariationEnumerator&);
+        ShaderVariationEnumerator& operator=(const ShaderVariationEnumerator&);
+    };
+}}
+
@@ -13,6 +13,7 @@
 #include "../../Utility/Streams/Data.h"
 #include "../../Utility/Streams/FileUtils.h"
 #include "../../Utility/IteratorUtils.h"
+#include "../../Utility/PtrUtils.h"
 #include <algorithm>
 
 namespace RenderCore { namespace Techniques
@@ -145,6 +146,14 @@ namespace RenderCore { namespace Techniques
         }
     #endif
 
+    static const ResolvedShader* AsResolvedShader(uint64 tableValue) { return (const ResolvedShader*)size_t(tableValue); }
+    static uint64 AsTableValue(const ResolvedShader* shader) { return uint64(size_t(shader)); }
+
+    static bool NeedsRebind(const ResolvedShader& shader)
+    {
+        return shader._shaderProgram && (shader._shaderProgram->GetDependencyValidation().GetValidationIndex()!=0);
+    }
+
     ResolvedShader      Technique::FindVariation(   const ParameterBox* globalState[ShaderParameters::Source::Max],
                                                     const TechniqueInterface& techniqueInterface) const
     {
@@ -162,10 +171,31 @@ namespace RenderCore { namespace Techniques
         }
         
         uint64 globalHashWithInterface = inputHash ^ techniqueInterface.GetHashValue();
-        auto i = std::lower_bound(_globalToResolved.begin(), _globalToResolved.end(), globalHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i!=_globalToResolved.cend() && i->first == globalHashWithInterface) {
-            if (i->second._shaderProgram && (i->second._shaderProgram->GetDependencyValidation().GetValidationIndex()!=0)) {
-                ResolveAndBind(i->second, globalState, techniqueInterface);
+
+            //  Fast path -- wait-free lookup in the global table. This should
+            //  succeed for almost every draw call after the first few frames.
+            //  (when checking for hash conflicts, we always take the slow path)
+        uint64 value;
+        #if !defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
+            if (_globalToResolved.TryGet(globalHashWithInterface, value)) {
+                auto* resolved = AsResolvedShader(value);
+                if (!NeedsRebind(*resolved)) {
+                    Interlocked::Increment(&_hitCount);
+                    return *resolved;
+                }
+            }
+        #endif
+
+        Interlocked::Increment(&_missCount);
+        ScopedLock(_resolveLock);
+
+            //  Another thread may have resolved this variation while we were
+            //  waiting for the lock, so check the global table again
+        if (_globalToResolved.TryGet(globalHashWithInterface, value)) {
+            auto* resolved = AsResolvedShader(value);
+            if (NeedsRebind(*resolved)) {
+                resolved = BuildResolvedShader(*resolved, globalState, techniqueInterface);
+                _globalToResolved.Set(globalHashWithInterface, AsTableValue(resolved));
             }
 
             #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
@@ -173,17 +203,18 @@ namespace RenderCore { namespace Techniques
                 assert(ti!=_globalToResolvedTest.cend() && ti->first == globalHashWithInterface);
                 TestHashConflict(globalState, ti->second);
             #endif
-            return i->second;
+            return *resolved;
         }
 
         uint64 filteredHashValue = _baseParameters.CalculateFilteredHash(inputHash, globalState);
         uint64 filteredHashWithInterface = filteredHashValue ^ techniqueInterface.GetHashValue();
-        auto i2 = std::lower_bound(_filteredToResolved.begin(), _filteredToResolved.end(), filteredHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i2!=_filteredToResolved.cend() && i2->first == filteredHashWithInterface) {
-            _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, i2->second));
-            if (i2->second._shaderProgram && (i2->second._shaderProgram->GetDependencyValidation().GetValidationIndex()!=0)) {
-                ResolveAndBind(i2->second, globalState, techniqueInterface);
+        if (_filteredToResolved.TryGet(filteredHashWithInterface, value)) {
+            auto* resolved = AsResolvedShader(value);
+            if (NeedsRebind(*resolved)) {
+                resolved = BuildResolvedShader(*resolved, globalState, techniqueInterface);
+                _filteredToResolved.Set(filteredHashWithInterface, AsTableValue(resolved));
             }
+            _globalToResolved.Set(globalHashWithInterface, AsTableValue(resolved));
 
             #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
                 auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
@@ -193,14 +224,14 @@ namespace RenderCore { namespace Techniques
                 assert(lti!=_localToResolvedTest.cend() && lti->first == filteredHashWithInterface);
                 TestHashConflict(globalState, lti->second);
             #endif
-            return i2->second;
+            return *resolved;
         }
 
         ResolvedShader newResolvedShader;
         newResolvedShader._variationHash = filteredHashValue;
-        ResolveAndBind(newResolvedShader, globalState, techniqueInterface);
-        _filteredToResolved.insert(i2, std::make_pair(filteredHashWithInterface, newResolvedShader));
-        _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, newResolvedShader));
+        auto* resolved = BuildResolvedShader(newResolvedShader, globalState, techniqueInterface);
+        _filteredToResolved.Set(filteredHashWithInterface, AsTableValue(resolved));
+        _globalToResolved.Set(globalHashWithInterface, AsTableValue(resolved));
 
         #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
             auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
@@ -209,12 +240,33 @@ namespace RenderCore { namespace Techniques
             auto lti = std::lower_bound(_localToResolvedTest.begin(), _localToResolvedTest.end(), filteredHashWithInterface, CompareFirst<uint64, HashConflictTest>());
             _localToResolvedTest.insert(lti, std::make_pair(filteredHashWithInterface, HashConflictTest(globalState, inputHash, filteredHashValue, techniqueInterface.GetHashValue())));
         #endif
-        return newResolvedShader;
+        return *resolved;
+    }
+
+    const ResolvedShader* Technique::BuildResolvedShader(
+        const ResolvedShader& shader,
+        const ParameterBox* globalState[ShaderParameters::Source::Max],
+        const TechniqueInterface& techniqueInterface) const
+    {
+            //  Other threads may be reading the old ResolvedShader object (without a lock),
+            //  so we must never modify it. Instead, create a new one, and the caller will
+            //  replace the pointer in the hash tables. Must be called within _resolveLock.
+        auto newShader = std::make_unique<ResolvedShader>(shader);
+        ResolveAndBind(*newShader, globalState, techniqueInterface);
+        _resolvedShaders.push_back(std::move(newShader));
+        return _resolvedShaders.back().get();
+    }
+
+    auto Technique::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        result._hits = unsigned(Interlocked::Load(&_hitCount));
+        result._misses = unsigned(Interlocked::Load(&_missCount));
+        result._variationCount = unsigned(_globalToResolved.Size());
+        return result;
     }
     
-    void        Technique::ResolveAndBind(  ResolvedShader& resolvedShader, 
-                                            const ParameterBox* globalState[ShaderParameters::Source::Max],
-                                            const TechniqueInterface& techniqueInterface) const
+    ResolvedShaderNames Technique::ResolveShaderNames(const ParameterBox* globalState[ShaderParameters::Source::Max]) const
     {
         std::vector<std::pair<const char*, std::string>> defines;
         _baseParameters.BuildStringTable(defines);
@@ -244,27 +296,41 @@ namespace RenderCore { namespace Techniques
         auto gsi = std::lower_bound(defines.cbegin(), defines.cend(), "gs_", CompareFirst<std::string, std::string>());
         if (gsi != defines.cend() && !XlCompareString(gsi->first, "gs_")) {
             char buffer[32];
-            int integerValue = Utility::XlAtoI32(psi->second.c_str());
+            int integerValue = Utility::XlAtoI32(gsi->second.c_str());
             sprintf_s(buffer, dimof(buffer), ":gs_%i_%i", integerValue/10, integerValue%10);
             gsShaderModel = buffer;
         } else {
             gsShaderModel = ":" GS_DefShaderModel;
         }
 
-        std::string combinedStrings;
+        ResolvedShaderNames result;
         size_t size = 0;
         std::for_each(defines.cbegin(), defines.cend(), 
             [&size](const std::pair<std::string, std::string>& object) { size += 2 + object.first.size() + object.second.size(); });
-        combinedStrings.reserve(size);
+        result._definesTable.reserve(size);
         std::for_each(defines.cbegin(), defines.cend(), 
-            [&combinedStrings](const std::pair<std::string, std::string>& object) 
+            [&result](const std::pair<std::string, std::string>& object) 
             {
-                combinedStrings.insert(combinedStrings.end(), object.first.cbegin(), object.first.cend()); 
-                combinedStrings.push_back('=');
-                combinedStrings.insert(combinedStrings.end(), object.second.cbegin(), object.second.cend()); 
-                combinedStrings.push_back(';');
+                result._definesTable.insert(result._definesTable.end(), object.first.cbegin(), object.first.cend()); 
+                result._definesTable.push_back('=');
+                result._definesTable.insert(result._definesTable.end(), object.second.cbegin(), object.second.cend()); 
+                result._definesTable.push_back(';');
             });
 
+        result._vertexShader = _vertexShaderName + vsShaderModel;
+        result._pixelShader = _pixelShaderName + psShaderModel;
+        if (!_geometryShaderName.empty()) {
+            result._geometryShader = _geometryShaderName + gsShaderModel;
+        }
+        return result;
+    }
+
+    void        Technique::ResolveAndBind(  ResolvedShader& resolvedShader, 
+                                            const ParameterBox* globalState[ShaderParameters::Source::Max],
+                                            const TechniqueInterface& techniqueInterface) const
+    {
+        auto names = ResolveShaderNames(globalState);
+
         using namespace Metal;
     
         std::unique_ptr<ShaderProgram> shaderProgram;
@@ -272,17 +338,17 @@ namespace RenderCore { namespace Techniques
         std::unique_ptr<BoundInputLayout> boundInputLayout;
         std::unique_ptr<ConstantBufferLayout> boundMaterialConstants;
 
-        if (_geometryShaderName.empty()) {
+        if (names._geometryShader.empty()) {
             shaderProgram = std::make_unique<ShaderProgram>(
-                (_vertexShaderName + vsShaderModel).c_str(), 
-                (_pixelShaderName + psShaderModel).c_str(), 
-                combinedStrings.c_str());
+                names._vertexShader.c_str(), 
+                names._pixelShader.c_str(), 
+                names._definesTable.c_str());
         } else {
             shaderProgram = std::make_unique<ShaderProgram>(
-                (_vertexShaderName + vsShaderModel).c_str(), 
-                (_geometryShaderName + gsShaderModel).c_str(), 
-                (_pixelShaderName + psShaderModel).c_str(), 
-                combinedStrings.c_str());
+                names._vertexShader.c_str(), 
+                names._geometryShader.c_str(), 
+                names._pixelShader.c_str(), 
+                names._definesTable.c_str());
         }
 
         boundUniforms = std::make_unique<BoundUniforms>(std::ref(*shaderProgram));
@@ -470,6 +536,8 @@ namespace RenderCore { namespace Techniques
         ::Assets::DirectorySearchRules* searchRules,
         std::vector<const ::Assets::DependencyValidation*>* inherited)
     {
+        _hitCount = _missCount = 0;
+
             //
             //      There are some parameters that will we always have an effect on the
             //      binding. We need to make sure these are initialized with sensible
@@ -488,15 +556,24 @@ namespace RenderCore { namespace Techniques
         _geometryShaderName = source.StrAttribute("GeometryShader");
     }
 
+        //  Note that moving isn't thread safe -- and the mutex itself isn't moved
     Technique::Technique(Technique&& moveFrom)
     :       _name(moveFrom._name)
     ,       _baseParameters(std::move(moveFrom._baseParameters))
     ,       _filteredToResolved(std::move(moveFrom._filteredToResolved))
     ,       _globalToResolved(std::move(moveFrom._globalToResolved))
+    ,       _resolvedShaders(std::move(moveFrom._resolvedShaders))
     ,       _vertexShaderName(moveFrom._vertexShaderName)
     ,       _pixelShaderName(moveFrom._pixelShaderName)
     ,       _geometryShaderName(moveFrom._geometryShaderName)
-    {}
+    ,       _resolvedShaderPrograms(std::move(moveFrom._resolvedShaderPrograms))
+    ,       _resolvedBoundUniforms(std::move(moveFrom._resolvedBoundUniforms))
+    ,       _resolvedBoundInputLayouts(std::move(moveFrom._resolvedBoundInputLayouts))
+    ,       _resolvedMaterialConstantsLayouts(std::move(moveFrom._resolvedMaterialConstantsLayouts))
+    {
+        _hitCount = moveFrom._hitCount;
+        _missCount = moveFrom._missCount;
+    }
 
     Technique& Technique::operator=(Technique&& moveFrom)
     {
@@ -504,9 +581,16 @@ namespace RenderCore { namespace Techniques
         _baseParameters = std::move(moveFrom._baseParameters);
         _filteredToResolved = std::move(moveFrom._filteredToResolved);
         _globalToResolved = std::move(moveFrom._globalToResolved);
+        _resolvedShaders = std::move(moveFrom._resolvedShaders);
         _vertexShaderName = moveFrom._vertexShaderName;
         _pixelShaderName = moveFrom._pixelShaderName;
         _geometryShaderName = moveFrom._geometryShaderName;
+        _resolvedShaderPrograms = std::move(moveFrom._resolvedShaderPrograms);
+        _resolvedBoundUniforms = std::move(moveFrom._resolvedBoundUniforms);
+        _resolvedBoundInputLayouts = std::move(moveFrom._resolvedBoundInputLayouts);
+        _resolvedMaterialConstantsLayouts = std::move(moveFrom._resolvedMaterialConstantsLayouts);
+        _hitCount = moveFrom._hitCount;
+        _missCount = moveFrom._missCount;
         return *this;
     }
 
@@ -526,6 +610,25 @@ namespace RenderCore { namespace Techniques
         return _technique[techniqueIndex].FindVariation(globalState, techniqueInterface);
     }
 
+    const Technique*    ShaderType::GetTechnique(unsigned techniqueIndex) const
+    {
+        if (techniqueIndex >= unsigned(_technique.size())) return nullptr;
+        return &_technique[techniqueIndex];
+    }
+
+    Technique::Metrics  ShaderType::GetMetrics() const
+    {
+        Technique::Metrics result;
+        result._hits = result._misses = result._variationCount = 0;
+        for (const auto& t:_technique) {
+            auto m = t.GetMetrics();
+            result._hits += m._hits;
+            result._misses += m._misses;
+            result._variationCount += m._variationCount;
+        }
+        return result;
+    }
+
     ShaderType::ShaderType(const char resourceName[])
     {
         Data data;
@@ -570,16 +673,35 @@ namespace RenderCore { namespace Techniques
     uint64      ShaderParameters::CalculateFilteredHash(uint64 inputHash, const ParameterBox* globalState[Source::Max]) const
     {
             //      Find a local state to match
-        auto i = std::lower_bound(_globalToFilteredTable.cbegin(), _globalToFilteredTable.cend(), inputHash, CompareFirst<uint64, uint64>());
-        if (i!=_globalToFilteredTable.cend() && i->first == inputHash) {
-            return i->second;
+        uint64 filteredState;
+        if (_globalToFilteredTable.TryGet(inputHash, filteredState)) {
+            return filteredState;
         }
 
-        uint64 filteredState = CalculateFilteredState(globalState);
-        _globalToFilteredTable.insert(i, std::make_pair(inputHash, filteredState));
+        filteredState = CalculateFilteredState(globalState);
+        _globalToFilteredTable.Set(inputHash, filteredState);
         return filteredState;
     }
 
+    ShaderParameters::ShaderParameters() {}
+
+    ShaderParameters::ShaderParameters(ShaderParameters&& moveFrom)
+    : _globalToFilteredTable(std::move(moveFrom._globalToFilteredTable))
+    {
+        for (unsigned c=0; c<dimof(_parameters); ++c) {
+            _parameters[c] = std::move(moveFrom._parameters[c]);
+        }
+    }
+
+    ShaderParameters& ShaderParameters::operator=(ShaderParameters&& moveFrom)
+    {
+        for (unsigned c=0; c<dimof(_parameters); ++c) {
+            _parameters[c] = std::move(moveFrom._parameters[c]);
+        }
+        _globalToFilteredTable = std::move(moveFrom._globalToFilteredTable);
+        return *this;
+    }
+
     void        ShaderParameters::BuildStringTable(std::vector<std::pair<const char*, std::string>>& defines) const
     {
         for (unsigned c=0; c<dimof(_parameters); ++c) {
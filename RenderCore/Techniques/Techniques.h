@@ -9,6 +9,8 @@
 #include "../Metal/Forward.h"
 #include "../Metal/InputLayout.h"        // required for _materialConstantsLayout in ResolvedShader
 #include "../../Utility/ParameterBox.h"
+#include "../../Utility/Threading/LockFreeHashTable.h"
+#include "../../Utility/Threading/Mutex.h"
 #include "../../Core/Prefix.h"
 #include "../../Core/Types.h"
 #include <string>
@@ -26,12 +28,17 @@ namespace RenderCore { namespace Techniques
         struct Source { enum Enum { Geometry, GlobalEnvironment, Runtime, Material, Max }; };
         ParameterBox    _parameters[Source::Max];
 
+            //  CalculateFilteredHash is thread safe when the input hash has been seen
+            //  before. But when it hasn't, only one thread may call it at a time.
         uint64      CalculateFilteredHash(uint64 inputHash, const ParameterBox* globalState[Source::Max]) const;
         void        BuildStringTable(std::vector<std::pair<const char*, std::string>>& defines) const;
 
+        ShaderParameters();
+        ShaderParameters(ShaderParameters&& moveFrom);
+        ShaderParameters& operator=(ShaderParameters&& moveFrom);
     private:
         uint64      CalculateFilteredState(const ParameterBox* globalState[Source::Max]) const;
-        mutable std::vector<std::pair<uint64, uint64>>  _globalToFilteredTable;
+        mutable LockFree::HashTable64   _globalToFilteredTable;
 
         friend class Technique;
     };
@@ -103,10 +110,31 @@ namespace RenderCore { namespace Techniques
         friend class Technique; // makes internal structure easier
     };
 
+        //
+        //  <summary>Shader names and defines that a technique resolves to<summary>
+        //
+        //  These are the exact strings passed to the shader compiler (and so they
+        //  also identify the variation in a precompiled shader archive).
+        //  The shader names are in "file:entrypoint:shadermodel" form.
+        //
+    class ResolvedShaderNames
+    {
+    public:
+        std::string     _vertexShader;
+        std::string     _pixelShader;
+        std::string     _geometryShader;    // (empty if the technique has no geometry shader)
+        std::string     _definesTable;
+    };
+
     // #if defined(_DEBUG)
     //     #define CHECK_TECHNIQUE_HASH_CONFLICTS
     // #endif
 
+        /// <summary>Selects shader variations based on shader parameters</summary>
+        /// FindVariation can be called from multiple threads at the same time. When the
+        /// variation has been used before, the lookup is wait-free. Otherwise we take a
+        /// lock while the new variation is resolved (which usually involves compiling
+        /// or loading shaders).
     class Technique
     {
     public:
@@ -114,14 +142,34 @@ namespace RenderCore { namespace Techniques
                                             const TechniqueInterface& techniqueInterface) const;
         bool                IsValid() const { return !_vertexShaderName.empty(); }
 
+            //  Find the shaders for a given state without compiling anything (used
+            //  by the shader precompiler)
+        ResolvedShaderNames ResolveShaderNames(const ParameterBox* globalState[ShaderParameters::Source::Max]) const;
+
+        class Metrics
+        {
+        public:
+            unsigned _hits, _misses;
+            unsigned _variationCount;
+        };
+        Metrics             GetMetrics() const;
+
         Technique(Utility::Data& source, ::Assets::DirectorySearchRules* searchRules = nullptr, std::vector<const ::Assets::DependencyValidation*>* inherited = nullptr);
         Technique(Technique&& moveFrom);
         Technique& operator=(Technique&& moveFrom);
     protected:
         std::string         _name;
         ShaderParameters    _baseParameters;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _filteredToResolved;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _globalToResolved;
+
+            //  These tables map from hash values to "const ResolvedShader*" (stored in
+            //  _resolvedShaders). Published ResolvedShader objects are never modified;
+            //  when a shader is invalidated, we just build a new one and replace the pointer.
+        mutable LockFree::HashTable64   _filteredToResolved;
+        mutable LockFree::HashTable64   _globalToResolved;
+        mutable std::vector<std::unique_ptr<ResolvedShader>>  _resolvedShaders;
+        mutable Threading::Mutex        _resolveLock;
+        mutable Interlocked::Value      _hitCount, _missCount;
+
         std::string         _vertexShaderName;
         std::string         _pixelShaderName;
         std::string         _geometryShaderName;
@@ -151,6 +199,11 @@ namespace RenderCore { namespace Techniques
             const ParameterBox* globalState[ShaderParameters::Source::Max],
             const TechniqueInterface& techniqueInterface) const;
 
+        const ResolvedShader* BuildResolvedShader(
+            const ResolvedShader& shader,
+            const ParameterBox* globalState[ShaderParameters::Source::Max],
+            const TechniqueInterface& techniqueInterface) const;
+
         mutable std::vector<std::unique_ptr<Metal::ShaderProgram>> _resolvedShaderPrograms;
         mutable std::vector<std::unique_ptr<Metal::BoundUniforms>> _resolvedBoundUniforms;
         mutable std::vector<std::unique_ptr<Metal::BoundInputLayout>> _resolvedBoundInputLayouts;
@@ -162,6 +215,10 @@ namespace RenderCore { namespace Techniques
     public:
         ResolvedShader      FindVariation(int techniqueIndex, const ParameterBox* globalState[ShaderParameters::Source::Max], const TechniqueInterface& techniqueInterface) const;
         const ::Assets::DependencyValidation&         GetDependencyValidation() const     { return *_validationCallback; }
+        Technique::Metrics  GetMetrics() const;
+
+        unsigned            GetTechniqueCount() const { return unsigned(_technique.size()); }
+        const Technique*    GetTechnique(unsigned techniqueIndex) const;
 
         ShaderType(const char resourceName[]);
         ~ShaderType();
@@ -447,6 +447,34 @@ std::pair<const FontChar*, const FontTexture2D*> FTFont::GetChar(ucs4 ch) const
     return std::pair<const FontChar*, const FontTexture2D*>(nullptr, nullptr);
 }
 
+static FT_FontTextureMgr* GetFontTextureMgr(FontTexKind kind)
+{
+    switch (kind) {
+    case FTK_DAMAGEDISPLAY: return damageDisplayFontTexMgr.get();
+    case FTK_GENERAL:
+    default:                return fontTexMgr.get();
+    }
+}
+
+void FTFont::PrepareGlyphs(const ucs4* text, int maxLen) const
+{
+    auto* mgr = GetFontTextureMgr(_texKind);
+    if (mgr) {
+        FT_FontTextureMgr::FontFace* face = mgr->FindFontFace(_face, _size);
+        if (!face) {
+            face = mgr->CreateFontFace(_face, _size);
+        }
+        if (face) {
+            face->EnsureGlyphsResident(text, maxLen, _texKind);
+        }
+    }
+}
+
+void FTFont::EnsureGlyphsResident(const ucs4* text, int maxLen) const
+{
+    PrepareGlyphs(text, maxLen);
+}
+
 void FTFont::TouchFontChar(const FontChar *fc)
 {
     // fc->usedTime = desktop.time;
@@ -656,6 +684,35 @@ std::pair<const FontChar*, const FontTexture2D*> FTFontGroup::GetChar(ucs4 ch) c
     return std::pair<const FontChar*, const FontTexture2D*>(nullptr, nullptr);
 }
 
+void FTFontGroup::EnsureGlyphsResident(const ucs4* text, int maxLen) const
+{
+    auto* mgr = GetFontTextureMgr(_texKind);
+    if (!mgr) return;
+
+        //  Split the string up by sub font, and prepare the glyphs for each
+        //  sub font separately. All of the sub fonts share the same batch.
+    std::vector<std::pair<FTFont*, std::vector<ucs4>>> subFontChars;
+    for (int i = 0; maxLen < 0 || i < maxLen; ++i) {
+        ucs4 ch = text[i];
+        if (!ch) break;
+
+        intrusive_ptr<FTFont> font = FindFTFontByChar(ch);
+        if (!font) continue;
+
+        auto s = std::find_if(subFontChars.begin(), subFontChars.end(), 
+            [&](const std::pair<FTFont*, std::vector<ucs4>>& p) { return p.first == font.get(); });
+        if (s == subFontChars.end()) {
+            subFontChars.push_back(std::make_pair(font.get(), std::vector<ucs4>()));
+            s = subFontChars.end()-1;
+        }
+        s->second.push_back(ch);
+    }
+
+    for (auto s=subFontChars.cbegin(); s!=subFontChars.cend(); ++s) {
+        s->first->PrepareGlyphs(AsPointer(s->second.cbegin()), int(s->second.size()));
+    }
+}
+
 FT_Face FTFontGroup::GetFace()
 {
     if (_defaultFTFont) {
@@ -1009,6 +1066,16 @@ void CheckResetFTFontSystem()
     }
 }
 
+void OnFTFontSystemFrameBarrier()
+{
+    if (fontTexMgr) {
+        fontTexMgr->BeginGlyphBatch();
+    }
+    if (damageDisplayFontTexMgr) {
+        damageDisplayFontTexMgr->BeginGlyphBatch();
+    }
+}
+
 int GetFTFontCount(FontTexKind kind)
 {
     switch (kind) {
@@ -58,12 +58,14 @@ public:
     virtual float LineHeight() const;
     // virtual bool SacrificeChar(int ch);
     virtual void TouchFontChar(const FontChar *fc);
+    virtual void EnsureGlyphsResident(const ucs4* text, int maxLen = -1) const;
     virtual Float2 GetKerning(int prevGlyph, ucs4 ch, int* curGlyph) const;
 
 protected:
     virtual FontCharID  CreateFontChar(ucs4 ch) const;
     virtual void        DeleteFontChar(FontCharID fc);
     virtual float       GetKerning(ucs4 prev, ucs4 ch) const;
+    void                PrepareGlyphs(const ucs4* text, int maxLen) const;
 
     int _ascend;
     FT_Face _face;
@@ -95,6 +97,7 @@ public:
     void LoadSubFTFont(FTFontNameInfo &info, int size);
 
     virtual std::pair<const FontChar*, const FontTexture2D*> GetChar(ucs4 ch) const;
+    virtual void EnsureGlyphsResident(const ucs4* text, int maxLen = -1) const;
 
     virtual FT_Face GetFace();
     virtual FT_Face GetFace(ucs4 ch);
@@ -126,6 +129,7 @@ bool    InitFTFontSystem();
 bool    LoadFontConfigFile();
 void    CleanupFTFontSystem();
 void    CheckResetFTFontSystem();
+void    OnFTFontSystemFrameBarrier();
 int     GetFTFontCount(FontTexKind kind);
 int     GetFTFontFileCount();
 
@@ -11,6 +11,10 @@
 #include "../Utility/PtrUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/MemoryUtils.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/Threading/ThreadObject.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../Utility/Threading/Mutex.h"
 #include "../RenderCore/Metal/Format.h"
 
 #include "../BufferUploads/IBufferUploads.h"
@@ -28,298 +32,274 @@ namespace RenderOverlays
 
 #pragma warning(disable:4127)
 
-class CharSlotArray
+static bool RasterizeGlyph(FT_Face face, ucs4 ch, FontChar& fc, std::vector<uint8>& bitmap)
 {
-private:
-    int         _height;
-    int         _heightEnd;
-    uint32      _usedCount;
-    std::vector<FontChar> _array;
-
-public:
-    CharSlotArray(int height, int heightEnd, int count);
-    ~CharSlotArray();
-
-public:
-    bool            IsFull() const;
-    inline int      GetSlotHeight() const { return _height; }
-    inline int      GetSlotHeightEnd() const { return _heightEnd; }
-
-public:
-        //if there is not empty slot, return -1
-    FontCharID      UseEmptySlot(const FontChar& fc);
-    bool            ReleaseSlot(FontCharID id);
-    const FontChar* GetLeastUsedChar() const;
-    const FontChar* GetChar(unsigned index) const;
-    FontChar*       GetChar(unsigned index);
-};
-
-CharSlotArray::CharSlotArray(int height, int heightEnd, int count)
-{
-    _height = height;
-    _heightEnd = heightEnd;
-    _usedCount = 0;
-
-    _array.resize(count);
-}
-
-CharSlotArray::~CharSlotArray()
-{
-
-}
-
-bool CharSlotArray::IsFull() const
-{
-    if (_usedCount >= _array.size()) {
-        return true;
-    }
-
-    return false;
-}
-
-static bool IsUsed(const FontChar& fc) { return fc.ch != 0; }
+    FT_Error error = FT_Load_Char(face, ch, FT_LOAD_RENDER | FT_LOAD_NO_AUTOHINT);
+    if (error) {
+        if (ch != ' ') {
+            // GameWarning("Failed to load character \'%d\'", ch);
+            return false;
+        }
 
-FontCharID CharSlotArray::UseEmptySlot(const FontChar& fc)
-{
-    uint32 maxCount = (uint32)_array.size();
-    for (uint32 i = 0; i < maxCount; i++) {
-        if (!IsUsed(_array[i])) {
-            _array[i] = fc;
-            _usedCount++;
-            return FontCharID(i);
+        error = FT_Load_Char(face, ch, FT_LOAD_RENDER);
+        if (error) {
+            return false;
         }
     }
 
-    //cannot be reached
-    return FontCharID_Invalid;
-}
+    FT_GlyphSlot glyph = face->glyph;
 
-bool CharSlotArray::ReleaseSlot(FontCharID id)
-{
-    if (id < _array.size()) {
-        _array[id].ch = 0;
-        return true;
-    }
-    return false;
-}
+    fc = FontChar(ch);
+    fc.left     = (float)glyph->bitmap_left;
+    fc.top      = (float)glyph->bitmap_top;
+    fc.width    = (float)glyph->bitmap.width;
+    fc.height   = (float)glyph->bitmap.rows;
+    fc.xAdvance = (float)glyph->advance.x / 64.0f;
 
-const FontChar* CharSlotArray::GetLeastUsedChar() const
-{
-    const FontChar* fontCh = &_array[0];
-    uint32 maxCount = (uint32)_array.size();
-    for(uint32 i = 1; i < maxCount; i++) {
-        const FontChar& cursor = _array[i];
-        if (IsUsed(*fontCh) && IsUsed(cursor)) {
-            if (fontCh->usedTime > cursor.usedTime) {
-                fontCh = &cursor;
-            }
-        } else if (!IsUsed(*fontCh)) {       // (DavidJ -- is this correctly? Or was it intended to be 
-            fontCh = &_array[i];
+        //  Copy the bitmap out into a tightly packed buffer. Only 8 bit
+        //  grey scale bitmaps are supported; anything else is left blank.
+    unsigned width = glyph->bitmap.width, height = glyph->bitmap.rows;
+    bitmap.clear();
+    bitmap.resize(width * height, 0);
+    if (glyph->bitmap.pixel_mode == FT_PIXEL_MODE_GRAY) {
+        for (unsigned j = 0; j < height; ++j) {
+            XlCopyMemory(&bitmap[j * width], &glyph->bitmap.buffer[j * glyph->bitmap.pitch], width);
         }
     }
-    return fontCh;
-}
 
-const FontChar* CharSlotArray::GetChar(unsigned index) const
-{
-    if (index < _array.size()) {
-        return &_array[index];
-    }
-    return NULL;
-}
-
-FontChar* CharSlotArray::GetChar(unsigned index)
-{
-    if (index < _array.size()) {
-        return &_array[index];
-    }
-    return NULL;
+    return true;
 }
 
 //-------------------------------------------------------------------------------------------------
 
-class TextureHeap
+    //  Rasterizes glyphs on a background thread.
+    //  FreeType objects can't be shared between threads, so the background thread
+    //  has its own FT_Library, and its own FT_Face for each font face. These are
+    //  created from the same font file buffers that the main thread faces use.
+    //  Requests are processed in order, so waiting for a request is just a matter
+    //  of waiting for the "last completed" counter to reach it.
+class GlyphRasterizer
 {
-private:
-    enum { CHUNK_MARGIN = 1 };
-
-    struct Chunk
-	{
-		int _start;
-		int _end;
-		Chunk *_prev;
-		Chunk *_next;
-		bool _used;
-
-        Chunk(int start, int end)
-        {
-            _start = start;
-	        _end   = end;
-	        _prev  = NULL;
-	        _next  = NULL;
-	        _used  = false;
-        }
-
-		inline int AllocSize() const { return _end - _start; }
-	};
-
-	typedef std::vector<std::unique_ptr<Chunk>> UsedList;
-	UsedList _usedList;
-
-	typedef std::vector<std::unique_ptr<Chunk>> EmptyList;
-	EmptyList _emptyList;
-
-    int _heapSize;
-
 public:
-    bool IsAllocable(int size);
-    std::unique_ptr<CharSlotArray> CreateCharSlotArray(int size, int maxCount);
-    void DestroyCharSlotArray(CharSlotArray* slot);
+    class Result
+    {
+    public:
+        unsigned            _requestId;
+        unsigned            _faceId;
+        ucs4                _ch;
+        bool                _success;
+        FontChar            _fontChar;
+        std::vector<uint8>  _bitmap;
+    };
+
+    static const unsigned RequestId_Invalid = ~0u;
+
+    unsigned            Queue(unsigned faceId, FT_Face face, int size, ucs4 ch);
+    void                WaitFor(unsigned requestId);
+    void                ReleaseFace(unsigned faceId);
+    std::vector<Result> TakeResults();
+
+    GlyphRasterizer();
+    ~GlyphRasterizer();
 
 private:
-    bool AllocNewChunk(int size, int& startPos, int& endPos);
-    void DeAllocChunk(int startPos);
-
-    Chunk* FindBestChunk(int size);
-    Chunk* FindUsedChunk(int startPos);
-
-public:
-    TextureHeap(int size);
-    virtual ~TextureHeap();
+    class Request
+    {
+    public:
+        unsigned        _requestId;
+        unsigned        _faceId;
+        const void*     _fontData;
+        size_t          _fontDataSize;
+        int             _size;
+        ucs4            _ch;
+        bool            _releaseFace;
+    };
+
+    Threading::Mutex        _lock;
+    std::vector<Request>    _requests;
+    std::vector<Result>     _results;
+    unsigned                _nextRequestId;
+    unsigned                _lastCompletedRequest;
+
+    XlHandle                _wakeUpEvent;
+    XlHandle                _completionEvent;
+    volatile bool           _shutdown;
+    std::unique_ptr<Threading::Thread> _thread;
+
+    static uint32 xl_thread_call ThreadFunction(void* arg);
+    uint32  DoThread();
+    unsigned QueueRequest(Request&& request);
 };
 
-TextureHeap::TextureHeap(int size)
+unsigned GlyphRasterizer::QueueRequest(Request&& request)
 {
-    _heapSize = size;
-	_emptyList.push_back(std::make_unique<Chunk>(0, _heapSize));
+    unsigned result;
+    {
+        ScopedLock(_lock);
+        result = request._requestId = _nextRequestId++;
+        _requests.push_back(std::move(request));
+    }
+    XlSetEvent(_wakeUpEvent);
+    return result;
 }
 
-TextureHeap::~TextureHeap()
+unsigned GlyphRasterizer::Queue(unsigned faceId, FT_Face face, int size, ucs4 ch)
 {
-    if( !_usedList.empty() ) {
-		// GameWarning("TextureHeap - %ld chunks not released", _usedList.size());
-		_usedList.clear();
-	}
+        //  We can only rasterize in the background for faces that were loaded
+        //  from memory (which is always the case for FTFont)
+    if (!face->stream || !face->stream->base || !face->stream->size) {
+        return RequestId_Invalid;
+    }
 
-	// if( _emptyList.size() != 1 ) {
-	// 	GameWarning("TextureHeap - too many empty chunks(%ld) remained", _emptyList.size() );
-	// }
-	_emptyList.clear();
+    Request request;
+    request._faceId = faceId;
+    request._fontData = face->stream->base;
+    request._fontDataSize = face->stream->size;
+    request._size = size;
+    request._ch = ch;
+    request._releaseFace = false;
+    return QueueRequest(std::move(request));
 }
 
-bool TextureHeap::IsAllocable(int size)
+void GlyphRasterizer::WaitFor(unsigned requestId)
 {
-    if( FindBestChunk(size + CHUNK_MARGIN))
-        return true;
-
-    return false;
+    for (;;) {
+        {
+            ScopedLock(_lock);
+            if (int(_lastCompletedRequest - requestId) >= 0) {
+                return;
+            }
+        }
+        XlWaitForSyncObject(_completionEvent, XL_INFINITE);
+    }
 }
 
-std::unique_ptr<CharSlotArray> TextureHeap::CreateCharSlotArray(int size, int maxCount)
+void GlyphRasterizer::ReleaseFace(unsigned faceId)
 {
-    int startPos, endPos;
-    AllocNewChunk(size + CHUNK_MARGIN, startPos, endPos);
-    return std::make_unique<CharSlotArray>(startPos, endPos, maxCount);
+        //  Remove any requests for this face that haven't started yet, and then
+        //  wait for the background thread to destroy its copy of the face. After
+        //  this, the font file buffer can be safely released.
+    {
+        ScopedLock(_lock);
+        _requests.erase(
+            std::remove_if(_requests.begin(), _requests.end(), [=](const Request& r) { return r._faceId == faceId; }),
+            _requests.end());
+    }
+
+    Request request;
+    request._faceId = faceId;
+    request._fontData = nullptr;
+    request._fontDataSize = 0;
+    request._size = 0;
+    request._ch = 0;
+    request._releaseFace = true;
+    WaitFor(QueueRequest(std::move(request)));
 }
 
-void TextureHeap::DestroyCharSlotArray(CharSlotArray* slot)
+auto GlyphRasterizer::TakeResults() -> std::vector<Result>
 {
-    if(slot) {
-        DeAllocChunk(slot->GetSlotHeight());
-        // delete slot;     (delete is called by the owner, now)
-    }
+    std::vector<Result> results;
+    ScopedLock(_lock);
+    results.swap(_results);
+    return results;
 }
 
-bool TextureHeap::AllocNewChunk(int size, int& startPos, int& endPos)
+uint32 xl_thread_call GlyphRasterizer::ThreadFunction(void* arg)
 {
-    startPos = endPos = 0;
-
-    Chunk *bestChunk = FindBestChunk(size);
-    if(!bestChunk) {
-        // GameWarning("TextureHeap - overflow");
-        return false;
-    }
-
-    std::unique_ptr<Chunk> usedChunk;
-    if(bestChunk->AllocSize() == size) {
-        EmptyList::iterator i = std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == bestChunk;});
-        std::swap(usedChunk, *i);
-        _emptyList.erase(i);
-    } else {
-        usedChunk = std::make_unique<Chunk>(bestChunk->_start, bestChunk->_start + size);
-
-		bestChunk->_start = usedChunk->_end;
-		usedChunk->_prev = bestChunk->_prev;
-
-        if( bestChunk->_prev )
-			bestChunk->_prev->_next = usedChunk.get();
-
-		usedChunk->_next = bestChunk;
-		bestChunk->_prev = usedChunk.get();
-    }
-
-    usedChunk->_used = true;
-	startPos = usedChunk->_start;
-    endPos   = usedChunk->_end;
-    _usedList.push_back(std::move(usedChunk));
-	return true;
+    return ((GlyphRasterizer*)arg)->DoThread();
 }
 
-void TextureHeap::DeAllocChunk(int startPos)
+uint32 GlyphRasterizer::DoThread()
 {
-	Chunk *usedChunk = FindUsedChunk(startPos);
-
-    Chunk *prev = usedChunk->_prev;
-	if( prev && !prev->_used ) {
-		usedChunk->_start = prev->_start;
-		usedChunk->_prev  = prev->_prev;
+    FT_Library library = 0;
+    if (FT_Init_FreeType(&library)) {
+        library = 0;
+    }
 
-        if( prev->_prev )
-			prev->_prev->_next = usedChunk;
+    std::vector<std::pair<unsigned, FT_Face>> faces;
+    std::vector<Request> requests;
+    while (!_shutdown) {
+        {
+            ScopedLock(_lock);
+            requests.swap(_requests);
+        }
 
-        _emptyList.erase(std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == prev;}));
-	}
+        if (requests.empty()) {
+            XlWaitForSyncObject(_wakeUpEvent, XL_INFINITE);
+            continue;
+        }
 
-	Chunk *next = usedChunk->_next;
-	if( next && !next->_used ) {
-		usedChunk->_end  = next->_end;
-		usedChunk->_next = next->_next;
-		
-        if( next->_next )
-			next->_next->_prev = usedChunk;
+        for (auto r=requests.begin(); r!=requests.end(); ++r) {
+            auto f = std::find_if(faces.begin(), faces.end(),
+                [=](const std::pair<unsigned, FT_Face>& p) { return p.first == r->_faceId; });
+
+            Result result;
+            result._requestId = r->_requestId;
+            result._faceId = r->_faceId;
+            result._ch = r->_ch;
+            result._success = false;
+
+            if (r->_releaseFace) {
+                if (f != faces.end()) {
+                    FT_Done_Face(f->second);
+                    faces.erase(f);
+                }
+            } else {
+                if (f == faces.end() && library) {
+                    FT_Face newFace = 0;
+                    if (!FT_New_Memory_Face(library, (const FT_Byte*)r->_fontData, (FT_Long)r->_fontDataSize, 0, &newFace)) {
+                        FT_Set_Pixel_Sizes(newFace, 0, r->_size);
+                        faces.push_back(std::make_pair(r->_faceId, newFace));
+                        f = faces.end()-1;
+                    }
+                }
+
+                if (f != faces.end()) {
+                    result._success = RasterizeGlyph(f->second, r->_ch, result._fontChar, result._bitmap);
+                }
+            }
 
-		_emptyList.erase(std::remove_if(_emptyList.begin(), _emptyList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() == next;}));
-	}
+            {
+                ScopedLock(_lock);
+                if (!r->_releaseFace) {
+                    _results.push_back(std::move(result));
+                }
+                _lastCompletedRequest = r->_requestId;
+            }
+            XlSetEvent(_completionEvent);
+        }
+        requests.clear();
+    }
 
-    UsedList::iterator i = std::partition(_usedList.begin(), _usedList.end(), [=](const std::unique_ptr<Chunk>& i){return i.get() != usedChunk;});
-    assert(*i);
-    std::unique_ptr<Chunk> newPtr; std::swap(newPtr, *i);
-    _usedList.erase(i);
-	newPtr->_used = false;
-	_emptyList.push_back(std::move(newPtr));
+    for (auto f=faces.begin(); f!=faces.end(); ++f) {
+        FT_Done_Face(f->second);
+    }
+    if (library) {
+        FT_Done_FreeType(library);
+    }
+    return 0;
 }
 
-TextureHeap::Chunk* TextureHeap::FindBestChunk(int size)
+GlyphRasterizer::GlyphRasterizer()
 {
-    EmptyList::iterator iter = _emptyList.begin();
-    for( ; iter != _emptyList.end(); ++iter) {
-        if((*iter)->AllocSize() >= size)
-            return iter->get();
-    }
-
-    return NULL;
+    _nextRequestId = 0;
+    _lastCompletedRequest = ~0u;
+    _shutdown = false;
+    _wakeUpEvent = XlCreateEvent(false);
+    _completionEvent = XlCreateEvent(false);
+    _thread = std::make_unique<Threading::Thread>(&GlyphRasterizer::ThreadFunction, this);
 }
 
-TextureHeap::Chunk* TextureHeap::FindUsedChunk(int startPos)
+GlyphRasterizer::~GlyphRasterizer()
 {
-    UsedList::iterator iter = _usedList.begin();
-    for( ; iter != _usedList.end(); ++iter) {
-        if((*iter)->_start == startPos)
-            return iter->get();
+    _shutdown = true;
+    XlSetEvent(_wakeUpEvent);
+    if (_thread) {
+        _thread->join();
+        _thread.reset();
     }
-
-	// GameWarning("TextureHeap - cannot find used chunk(%d)", startPos);
-	return NULL;
+    XlCloseSyncObject(_wakeUpEvent);
+    XlCloseSyncObject(_completionEvent);
 }
 
 //------------------------------------------------------
@@ -328,30 +308,17 @@ FT_FontTextureMgr::FT_FontTextureMgr()
 {
     _texWidth = 0;
     _texHeight = 0;
-
-    // _tex = 0;
-
+    _nextFaceId = 0;
     _needReset = false;
 }
 
 FT_FontTextureMgr::~FT_FontTextureMgr()
 {
-    if(!_faceList.empty()) {
-        FontFaceList::iterator faceIter = _faceList.begin();
-        for( ; faceIter != _faceList.end(); ++faceIter) {
-            std::unique_ptr<FontFace>& face = *faceIter;
-
-            CharSlotArrayList::iterator slotIter = face->_slotList.begin();
-            for( ; slotIter != face->_slotList.end(); ++slotIter) {
-                _texHeap->DestroyCharSlotArray((*slotIter).get());
-            }
-
-            face.reset();
-        }
-        _faceList.clear();
-    }
-
-    _texHeap.reset();
+        // faces must be destroyed while the rasterizer still exists
+    _faceList.clear();
+    _rasterizer.reset();
+    _atlas.reset();
+    _texture.reset();
 }
 
 static int NextPower2(int n)
@@ -437,7 +404,9 @@ bool FT_FontTextureMgr::Init(int texWidth, int texHeight)
     _texWidth = NextPower2(texWidth);
     _texHeight = NextPower2(texHeight);
     _texture = std::make_unique<FontTexture2D>(_texWidth, _texHeight, RenderCore::Metal::NativeFormat::R8_UNORM);
-    _texHeap = std::make_unique<TextureHeap>(_texHeight);
+    _atlas = std::make_unique<GlyphAtlas>(
+        _texWidth, _texHeight, [this](uint64 owner) { OnGlyphEvicted(owner); });
+    _rasterizer = std::make_unique<GlyphRasterizer>();
     return true;
 }
 
@@ -482,268 +451,296 @@ void FT_FontTextureMgr::Reset()
 {
     if(!IsNeedReset())  return;
 
-    FontFaceList::iterator faceIter = _faceList.begin();
-    for( ; faceIter != _faceList.end(); ++faceIter) {
-        std::unique_ptr<FontFace>& face = *faceIter;
-
-        CharSlotArrayList::iterator slotIter = face->_slotList.begin();
-        for( ; slotIter != face->_slotList.end(); ++slotIter) {
-            _texHeap->DestroyCharSlotArray((*slotIter).get());
-        }
-    }
     _faceList.clear();
+    if (_atlas) {
+        _atlas->Reset();
+    }
     _needReset = false;
 }
 
-FontCharID FT_FontTextureMgr::FontFace::CreateChar(int ch, FontTexKind kind)
+void FT_FontTextureMgr::BeginGlyphBatch()
 {
-    // if (!_tex) {
-    //     // GameWarning("FT_FontTextureMgr::CreateChar - not initialized");
-    //     return 0;
-    // }
+    if (_atlas) {
+        _atlas->BeginBatch();
+    }
 
-    FT_Error error = FT_Load_Char(_face, ch, FT_LOAD_RENDER | FT_LOAD_NO_AUTOHINT);
-    if (error) {
-        if(ch != ' ') {
-            // GameWarning("Failed to load character \'%d\'", ch);
+    ProcessRasterizedGlyphs();
+    UploadDirtyRegion();
+    for (auto i=_faceList.begin(); i!=_faceList.end(); ++i) {
+        (*i)->_placeholderChars.clear();
+        (*i)->_placeholderIndex.clear();
+    }
+}
 
-            // FontChar* fc = CreateEmptyFontChar(ch);
-            // fc->xAdvance = size * 0.5f;
-            // return fc;
-            return FontCharID_Invalid;
-        } else {
-            error = FT_Load_Char(_face, ch, FT_LOAD_RENDER);
-            if (error) {
-                // FontChar* fc = CreateEmptyFontChar(ch);
-                // fc->xAdvance = size * 0.5f;
-                // return fc;
-                return FontCharID_Invalid;
-            }
+void FT_FontTextureMgr::OnGlyphEvicted(uint64 owner)
+{
+    unsigned faceId = unsigned(owner >> 32);
+    for (auto i=_faceList.begin(); i!=_faceList.end(); ++i) {
+        if ((*i)->_id == faceId) {
+            (*i)->OnEvicted(FontCharID(owner & 0xffffffff));
+            return;
         }
     }
+}
 
-    FT_GlyphSlot glyph = _face->glyph;
+void FT_FontTextureMgr::ProcessRasterizedGlyphs()
+{
+    if (!_rasterizer) return;
 
-    FontChar fc(ch);
-    fc.left     = (float)glyph->bitmap_left;
-    fc.top      = (float)glyph->bitmap_top;
-    fc.width    = (float)glyph->bitmap.width;
-    fc.height   = (float)glyph->bitmap.rows;
-    fc.xAdvance = (float)glyph->advance.x / 64.0f;
+    auto results = _rasterizer->TakeResults();
+    for (auto r=results.begin(); r!=results.end(); ++r) {
+        auto face = std::find_if(_faceList.begin(), _faceList.end(), 
+            [=](const std::unique_ptr<FontFace>& f) { return f->_id == r->_faceId; });
+        if (face == _faceList.end()) continue;
 
-    // assert((face->size->metrics.max_advance / 64) < glyph->bitmap.width);
+        auto& pending = (*face)->_pendingChars;
+        auto p = std::lower_bound(pending.begin(), pending.end(), r->_ch, CompareFirst<ucs4, unsigned>());
+        if (p == pending.end() || p->first != r->_ch || p->second != r->_requestId) continue;
+        pending.erase(p);
 
-    int offsetX, offsetY;
-    FontCharID charID = FindEmptyCharSlot(fc, &offsetX, &offsetY, kind);
-    if (charID != FontCharID_Invalid) {
-        if (_texture) {
-            _texture->UpdateGlyphToTexture( glyph, offsetX, offsetY,
-                                            _face->size->metrics.max_advance / 64, _size);
+            //  On failure, the character will be created synchronously when it's
+            //  next requested (which reproduces the normal failure behaviour)
+        if (r->_success && (*face)->_table[r->_ch] == FontCharID_Invalid) {
+            auto id = (*face)->AddChar(r->_fontChar, AsPointer(r->_bitmap.cbegin()), unsigned(r->_fontChar.width));
+            (*face)->_table[r->_ch] = id;
         }
-        return charID;
-    } else {
-        return FontCharID_Invalid;
-        // RequestReset();
-        // 
-        // int texWidth = NextPower2(glyph->bitmap.width);
-        // int texHeight = NextPower2(glyph->bitmap.rows);
-        // // ITexture *newTex = CreateTempTexture(glyph, texWidth, texHeight);
-        // // fc->tex = newTex;
-        // 
-        // fc.u0 = 0.0f;
-        // fc.v0 = 0.0f;
-        // fc.u1 = (float)glyph->bitmap.width / texWidth;
-        // fc.v1 = (float)glyph->bitmap.rows / texHeight;
-        // 
-        // fc.offsetX = 0;
-        // fc.offsetY = 0;
     }
 }
 
-FT_FontTextureMgr::FontFace* FT_FontTextureMgr::FindFontFace(FT_Face face, int size)
+void FT_FontTextureMgr::UploadDirtyRegion()
 {
-    auto it = _faceList.begin();
-    for( ; it != _faceList.end(); ++it) {
-        if((*it)->_face == face && (*it)->_size == size)
-            return (*it).get();
+    if (!_atlas || !_texture) return;
+
+    auto rect = _atlas->TakeDirtyRect();
+    if (!rect._width || !rect._height) return;
+
+    auto packet = BufferUploads::CreateBasicPacket(
+        rect._width * rect._height, nullptr, std::make_pair(rect._width, rect._width * rect._height));
+    uint8* data = (uint8*)packet->GetData(0,0);
+    const uint8* src = _atlas->GetBackingStore();
+    for (unsigned y = 0; y < rect._height; ++y) {
+        XlCopyMemory(
+            &data[y * rect._width], 
+            &src[(rect._y + y) * _atlas->GetWidth() + rect._x], rect._width);
     }
 
-    return NULL;
+    _texture->UpdateToTexture(packet.get(), rect._x, rect._y, rect._width, rect._height);
 }
 
-auto FT_FontTextureMgr::CreateFontFace(FT_Face face, int size) -> FontFace*
+GlyphAtlas::Metrics FT_FontTextureMgr::GetAtlasMetrics() const
 {
-    if(!_texHeap->IsAllocable(size)) {
-        return nullptr;
-    } else {
-        {
-            std::unique_ptr<FontFace> fontFace = std::make_unique<FontFace>(_texHeap.get(), _texture.get(), _texWidth, _texHeight);
-            fontFace->_face = face;
-            fontFace->_size = size;
-            _faceList.insert(_faceList.begin(), std::move(fontFace));
-        }
+    return _atlas ? _atlas->GetMetrics() : GlyphAtlas::Metrics();
+}
 
-        int maxCount = _texWidth / (face->size->metrics.max_advance / 64);
-        CharSlotArray* newSlot = (*_faceList.begin())->_slotList.insert(
-            (*_faceList.begin())->_slotList.begin(), 
-            _texHeap->CreateCharSlotArray(size, maxCount))->get();
+//------------------------------------------------------
 
-        ClearFontTextureRegion(newSlot->GetSlotHeight(), newSlot->GetSlotHeightEnd());
-        return _faceList.begin()->get();
+FontCharID FT_FontTextureMgr::FontFace::CreateChar(int ch, FontTexKind kind)
+{
+    std::vector<uint8> bitmap;
+    FontChar fc;
+    if (!RasterizeGlyph(_face, ch, fc, bitmap)) {
+        return FontCharID_Invalid;
     }
+
+    return AddChar(fc, AsPointer(bitmap.cbegin()), unsigned(fc.width));
 }
 
-FontCharID FT_FontTextureMgr::FontFace::FindEmptyCharSlot(const FontChar& fc, int *x, int *y, FontTexKind kind)
+FontCharID FT_FontTextureMgr::FontFace::AddChar(const FontChar& fc, const uint8 bitmap[], unsigned pitch)
 {
-    CharSlotArray *slot = NULL;
-    unsigned slotIndex = ~unsigned(0x0);
-    CharSlotArrayList::iterator slotIter = _slotList.begin();
-    for( ; slotIter != _slotList.end(); ++slotIter) {
-        CharSlotArray *cursor = (*slotIter).get();
-        if(!cursor->IsFull()) {
-            slot = cursor;
-            slotIndex = (unsigned)std::distance(_slotList.begin(), slotIter);
-            break;
-        }
+    FontCharID id;
+    if (!_freeChars.empty()) {
+        id = _freeChars[_freeChars.size()-1];
+        _freeChars.pop_back();
+    } else {
+        id = FontCharID(_chars.size());
+        _chars.push_back(FontChar());
+        _atlasGlyphs.push_back(GlyphAtlas::GlyphId_Invalid);
+    }
+
+        //  Note that adding to the atlas can evict other characters from this face
+        //  (which will push them onto _freeChars)
+    auto glyph = _mgr->_atlas->Add(
+        bitmap, unsigned(fc.width), unsigned(fc.height), pitch, 
+        (uint64(_id) << 32) | uint64(id));
+    if (glyph == GlyphAtlas::GlyphId_Invalid) {
+        // GameWarning("Font atlas is full -- all characters are in use");
+        _freeChars.push_back(id);
+        return FontCharID_Invalid;
     }
 
-    if(!slot) {
-        if(!_texHeap->IsAllocable(_size)) {
-            // slot = OverwriteLRUChar(*this, kind);
-            // if(!slot) {
-            //     // all character used current frame, will be reset
-            //     return false;
-            // }
-            return FontCharID_Invalid;
-        } else {
-            int maxCount = _texWidth / (_face->size->metrics.max_advance / 64);
-                // DavidJ -- note --    we have to add on to the back here. The _table member of
-                //                      FontFace keeps indices into the _slotList array. So we can't
-                //                      change the position of existing slot arrays
-            _slotList.push_back(_texHeap->CreateCharSlotArray(_size, maxCount));
-            slotIndex = unsigned(_slotList.size()-1);
-            slot = _slotList[slotIndex].get();
-
-            // ClearFontTextureRegion(slot->GetSlotHeight(), slot->GetSlotHeightEnd());
-        }
-    }
+    auto rect = _mgr->_atlas->GetRect(glyph);
+    FontChar& newChar = _chars[id];
+    newChar = fc;
+    newChar.u0 = (float)rect._x / _mgr->_texWidth;
+    newChar.v0 = (float)rect._y / _mgr->_texHeight;
+    newChar.u1 = (float)(rect._x + rect._width) / _mgr->_texWidth;
+    newChar.v1 = (float)(rect._y + rect._height) / _mgr->_texHeight;
+    newChar.offsetX = rect._x;
+    newChar.offsetY = rect._y;
+    _atlasGlyphs[id] = glyph;
+    return id;
+}
 
-    FontCharID result = slot->UseEmptySlot(fc);
-    if (result != FontCharID_Invalid) {
-        FontChar* newChar = slot->GetChar(result);
-        int offsetX = result * (_face->size->metrics.max_advance / 64);
-        int offsetY = slot->GetSlotHeight();
-        newChar->u0 = (float)offsetX / _texWidth;
-        newChar->v0 = (float)offsetY / _texHeight;
-        newChar->u1 = (float)(offsetX + _face->glyph->bitmap.width) / _texWidth;
-        newChar->v1 = (float)(offsetY + _face->glyph->bitmap.rows) / _texHeight;
-        newChar->offsetX = offsetX;
-        newChar->offsetY = offsetY;
+void FT_FontTextureMgr::FontFace::OnEvicted(FontCharID fc)
+{
+    if (fc >= _chars.size() || !_chars[fc].ch) return;
+    _table[_chars[fc].ch] = FontCharID_Invalid;
+    _chars[fc].ch = 0;
+    _atlasGlyphs[fc] = GlyphAtlas::GlyphId_Invalid;
+    _freeChars.push_back(fc);
+}
 
-        *x = offsetX;
-        *y = offsetY;
+void FT_FontTextureMgr::FontFace::DeleteChar(FontCharID fc)
+{
+    if (fc >= _chars.size() || !_chars[fc].ch) return;
+    _mgr->_atlas->Remove(_atlasGlyphs[fc]);
+    OnEvicted(fc);
+}
+
+bool FT_FontTextureMgr::FontFace::IsPending(ucs4 ch) const
+{
+    auto p = std::lower_bound(_pendingChars.cbegin(), _pendingChars.cend(), ch, CompareFirst<ucs4, unsigned>());
+    return p != _pendingChars.cend() && p->first == ch;
+}
 
-        return (result & 0xffff) | (slotIndex << 16);
+const FontChar* FT_FontTextureMgr::FontFace::GetPlaceholderChar(ucs4 ch)
+{
+    auto i = std::lower_bound(_placeholderIndex.begin(), _placeholderIndex.end(), ch, CompareFirst<ucs4, unsigned>());
+    if (i != _placeholderIndex.end() && i->first == ch) {
+        return &_placeholderChars[i->second];
     }
 
-    return FontCharID_Invalid;
+        //  Load just the metrics for the glyph (no rendering), so layout is the same
+        //  as it will be once the real glyph arrives. The placeholder has no area, so
+        //  nothing is drawn for it.
+    FT_Error error = FT_Load_Char(_face, ch, FT_LOAD_NO_AUTOHINT);
+    if (error) {
+        return nullptr;
+    }
+
+    FT_GlyphSlot glyph = _face->glyph;
+    FontChar fc(ch);
+    fc.u0 = fc.v0 = fc.u1 = fc.v1 = 0.f;
+    fc.left     = (float)glyph->metrics.horiBearingX / 64.0f;
+    fc.top      = (float)glyph->metrics.horiBearingY / 64.0f;
+    fc.width    = 0.f;
+    fc.height   = 0.f;
+    fc.xAdvance = (float)glyph->advance.x / 64.0f;
+
+    _placeholderIndex.insert(i, std::make_pair(ch, unsigned(_placeholderChars.size())));
+    _placeholderChars.push_back(fc);
+    return &_placeholderChars[_placeholderChars.size()-1];
 }
 
-FT_FontTextureMgr::FontFace::FontFace(TextureHeap* texHeap, FontTexture2D* texture, int texWidth, int texHeight)
-: _texHeap(texHeap), _texture(texture), _texWidth(texWidth), _texHeight(texHeight)
+const FontChar* FT_FontTextureMgr::FontFace::GetChar(int ch, FontTexKind kind)
 {
+    _mgr->ProcessRasterizedGlyphs();
+
+    FontCharID id = _table[ch];
+    if (id == FontCharID_Invalid && IsPending(ch)) {
+            //  Don't wait for the background rasterizer; draw this frame without
+            //  the glyph, and pick it up in a later frame when it's ready
+        return GetPlaceholderChar(ch);
+    }
+
+    if (id == FontCharID_Invalid) {
+        id = CreateChar(ch, kind);
+        _table[ch] = id;
+    }
+
+    _mgr->UploadDirtyRegion();
+
+    if (id < _chars.size()) {
+        _mgr->_atlas->Touch(_atlasGlyphs[id]);
+        auto* result = &_chars[id];
+        assert(result->ch == ch);
+        return result;
+    }
+    return NULL;
 }
 
-CharSlotArray* FT_FontTextureMgr::OverwriteLRUChar(FontFace* face, FontTexKind kind)
+void FT_FontTextureMgr::FontFace::EnsureGlyphsResident(const ucs4 chars[], int maxLen, FontTexKind kind)
 {
-    CharSlotArrayList::iterator it = face->_slotList.begin();
+    _mgr->ProcessRasterizedGlyphs();
 
-    CharSlotArray* minSlot = (*it).get();
-    const FontChar* minChar = minSlot->GetLeastUsedChar();
+    for (int i = 0; maxLen < 0 || i < maxLen; ++i) {
+        ucs4 ch = chars[i];
+        if (!ch) break;
 
-    ++it;
+        FontCharID id = _table[ch];
+        if (id != FontCharID_Invalid) {
+            _mgr->_atlas->Touch(_atlasGlyphs[id]);
+            continue;
+        }
 
-    for( ; it != face->_slotList.end(); ++it) {        
-        CharSlotArray* curSlot = (*it).get();
-        const FontChar* curChar = curSlot->GetLeastUsedChar();
-        if (minChar && curChar) {
-            if (minChar->usedTime > curChar->usedTime) {
-                minSlot = curSlot;
-                minChar = curChar;
+        auto p = std::lower_bound(_pendingChars.begin(), _pendingChars.end(), ch, CompareFirst<ucs4, unsigned>());
+        if (p != _pendingChars.end() && p->first == ch) continue;
+
+            //  Characters that can't be rasterized in the background are
+            //  just created synchronously when they are first used
+        if (_mgr->_rasterizer) {
+            auto requestId = _mgr->_rasterizer->Queue(_id, _face, _size, ch);
+            if (requestId != GlyphRasterizer::RequestId_Invalid) {
+                _pendingChars.insert(p, std::make_pair(ch, requestId));
             }
-        } else if (!minChar) {
-            minSlot = curSlot;
-            minChar = curChar;
         }
     }
 
-    assert(minChar);
-
-    // float minTime = minChar->usedTime;
-    // if(minTime - 0.001f <= desktop.time && desktop.time <= minTime + 0.001f) {
-    //     // all character is used current time, will be reset
-    //     return NULL;
-    // }
+    _mgr->UploadDirtyRegion();
+}
 
-    // if(RequestSacrificeChar(face->_face, minChar->ch, kind)) {
-    //     return minSlot;
-    // }
+const FontTexture2D* FT_FontTextureMgr::FontFace::GetTexture() const
+{
+    return _mgr->_texture.get();
+}
 
-    //cannot be reached
-    // GameWarning("OverwriteLRUChar - cannot be reached");
-    return NULL;
+FT_FontTextureMgr::FontFace::FontFace(FT_FontTextureMgr& mgr, unsigned id, FT_Face face, int size)
+: _face(face), _size(size), _mgr(&mgr), _id(id)
+{
 }
 
-void FT_FontTextureMgr::ClearFontTextureRegion(int height, int heightEnd)
+FT_FontTextureMgr::FontFace::~FontFace()
 {
-    int texHeight = heightEnd - height;
-    if(texHeight <= 0) {
-        return;
+    if (_mgr->_rasterizer) {
+        _mgr->_rasterizer->ReleaseFace(_id);
     }
 
-    if(heightEnd > _texHeight) {
-        return;
+    if (_mgr->_atlas) {
+        for (auto i=_atlasGlyphs.cbegin(); i!=_atlasGlyphs.cend(); ++i) {
+            if (*i != GlyphAtlas::GlyphId_Invalid) {
+                _mgr->_atlas->Remove(*i);
+            }
+        }
     }
-
-    auto blankBuf = BufferUploads::CreateBasicPacket(_texWidth * texHeight, nullptr, std::make_pair(_texWidth, _texWidth*texHeight));
-    XlSetMemory(const_cast<void*>(blankBuf->GetData(0,0)), 0, _texWidth * texHeight);
-    _texture->UpdateToTexture(blankBuf.get(), 0, height, _texWidth, texHeight);
 }
 
-void FT_FontTextureMgr::FontFace::DeleteChar(FontCharID fc)
+//------------------------------------------------------
+
+FT_FontTextureMgr::FontFace* FT_FontTextureMgr::FindFontFace(FT_Face face, int size)
 {
-    unsigned slotIndex = fc >> 16;
-    if (slotIndex < _slotList.size()) {
-        CharSlotArray* slot = _slotList[slotIndex].get();
-        slot->ReleaseSlot(fc & 0xffff);
+    auto it = _faceList.begin();
+    for( ; it != _faceList.end(); ++it) {
+        if((*it)->_face == face && (*it)->_size == size)
+            return (*it).get();
     }
+
+    return NULL;
 }
 
-const FontChar* FT_FontTextureMgr::FontFace::GetChar(int ch, FontTexKind kind)
+auto FT_FontTextureMgr::CreateFontFace(FT_Face face, int size) -> FontFace*
 {
-    FontCharID& id = _table[ch];
-    if (id == FontCharID_Invalid) {
-        id = CreateChar(ch, kind);
+    if (!_atlas) {
+        return nullptr;
     }
 
-    unsigned slotIndex = id >> 16;
-    if (slotIndex < _slotList.size()) {
-        auto* result = _slotList[slotIndex]->GetChar(id & 0xffff);
-        assert(result->ch == ch);
-        return result;
-    }
-    return NULL;
+    _faceList.insert(_faceList.begin(), std::make_unique<FontFace>(*this, _nextFaceId++, face, size));
+    return _faceList.begin()->get();
 }
 
 void FT_FontTextureMgr::DeleteFontFace(FTFont* font)
 {
     FontFace *face = FindFontFace(font->GetFace(), font->GetSize());
     if(face) {
-        CharSlotArrayList::iterator it = face->_slotList.begin();
-        for( ; it != face->_slotList.end(); ++it) {
-            _texHeap->DestroyCharSlotArray((*it).get());
-        }
-
             //
             //      operator==( std::unique_ptr<A>, A* ) comparison is not defined
             //      So we need to use a lambda to explicitly do the comparison
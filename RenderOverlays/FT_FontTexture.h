@@ -6,18 +6,18 @@
 
 #pragma once
 
+#include "Font.h"
 #include "FontPrimitives.h"
+#include "GlyphAtlas.h"
 #include <vector>
+#include <deque>
 #include <memory>
 
 namespace RenderOverlays
 {
 
-struct FontChar;
-
 class FTFont;
-class CharSlotArray;
-class TextureHeap;
+class GlyphRasterizer;
 
 class FontTexture2D;
 
@@ -31,7 +31,6 @@ public:
     void            RequestReset();
     void            Reset();
 
-    typedef std::vector<std::unique_ptr<CharSlotArray>> CharSlotArrayList;
     struct FontCharTable
     {
         std::vector<std::vector<std::pair<ucs4, FontCharID> > >  _table;
@@ -47,43 +46,76 @@ public:
         const FontChar*     GetChar(int ch, FontTexKind kind);
         FontCharID          CreateChar(int ch, FontTexKind kind);
         void                DeleteChar(FontCharID fc);
-        const FontTexture2D*    GetTexture() const { return _texture; }
+        const FontTexture2D*    GetTexture() const;
+
+            /// <summary>Prepare all of the glyphs for a string</summary>
+            /// Glyphs that aren't in the atlas yet are queued for rasterization on
+            /// a background thread. Glyphs that are already resident are touched, so
+            /// they are protected from eviction until the next BeginGlyphBatch().
+            /// GetChar() never waits for glyphs that are still in flight. Until they
+            /// arrive, it returns a placeholder with the right metrics but no area.
+        void                EnsureGlyphsResident(const ucs4 chars[], int maxLen, FontTexKind kind);
+
+        FontFace(FT_FontTextureMgr& mgr, unsigned id, FT_Face face, int size);
+        ~FontFace();
 
-        FontFace(TextureHeap* texHeap, FontTexture2D* texture, int texWidth, int texHeight);
-    
-        CharSlotArrayList   _slotList;
         FT_Face             _face;
         int                 _size;
 
     private:
         FontCharTable       _table;
 
-        int                 _texWidth, _texHeight;
-        TextureHeap *       _texHeap;
-        FontTexture2D *     _texture;
+            //  FontChar objects are handed out by pointer, so they are stored in a
+            //  deque (which never moves existing elements). FontCharIDs are indices
+            //  into this array. Slots freed by eviction are reused.
+        std::deque<FontChar>            _chars;
+        std::vector<GlyphAtlas::GlyphId> _atlasGlyphs;
+        std::vector<FontCharID>         _freeChars;
+        std::vector<std::pair<ucs4, unsigned>> _pendingChars;  // (character, rasterizer request id), sorted by character
+
+            //  Stand-ins for glyphs that are still being rasterized. These are cleared
+            //  at the start of each glyph batch, so pointers to them stay valid for a frame.
+        std::deque<FontChar>            _placeholderChars;
+        std::vector<std::pair<ucs4, unsigned>> _placeholderIndex;   // (character, index in _placeholderChars), sorted by character
 
-        FontCharID          FindEmptyCharSlot(const FontChar& fc, int *x, int *y, FontTexKind kind);
+        FT_FontTextureMgr*  _mgr;
+        unsigned            _id;
+
+        FontCharID          AddChar(const FontChar& fc, const uint8 bitmap[], unsigned pitch);
+        void                OnEvicted(FontCharID fc);
+        bool                IsPending(ucs4 ch) const;
+        const FontChar*     GetPlaceholderChar(ucs4 ch);
+
+        friend class FT_FontTextureMgr;
     };
 
     FontFace*       FindFontFace(FT_Face face, int size);
     FontFace*       CreateFontFace(FT_Face face, int size);
     void            DeleteFontFace(FTFont* font);
 
+        /// <summary>Begin a new batch of glyphs (see GlyphAtlas::BeginBatch)</summary>
+        /// Called once per frame (from OnFontSystemFrameBarrier). Glyphs used during
+        /// a frame are protected from eviction until the start of the next frame.
+    void            BeginGlyphBatch();
+    GlyphAtlas::Metrics     GetAtlasMetrics() const;
+
     FT_FontTextureMgr();
     virtual ~FT_FontTextureMgr();
 
 private:
     typedef std::vector<std::unique_ptr<FontFace>> FontFaceList;
 
-    CharSlotArray*      OverwriteLRUChar(FontFace* face, FontTexKind kind);
-    void                ClearFontTextureRegion(int height, int heightEnd);
+    void                OnGlyphEvicted(uint64 owner);
+    void                ProcessRasterizedGlyphs();
+    void                UploadDirtyRegion();
 
     int                             _texWidth, _texHeight;
     FontFaceList                    _faceList;
-    std::unique_ptr<TextureHeap>    _texHeap;
+    unsigned                        _nextFaceId;
+    std::unique_ptr<GlyphAtlas>     _atlas;
+    std::unique_ptr<GlyphRasterizer> _rasterizer;
     std::unique_ptr<FontTexture2D>  _texture;
     bool                            _needReset;
 };
 
-}
-
+}
\ No newline at end of file
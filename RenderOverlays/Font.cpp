@@ -6,6 +6,9 @@
 
 #include "Font.h"
 #include "FT_Font.h"
+#include "TextLayout.h"
+#include <memory>
+#include <algorithm>
 #include <assert.h>
 
 namespace RenderOverlays
@@ -30,62 +33,22 @@ float Font::StringWidth(const ucs4* text, int maxLen, float spaceExtra, bool out
     if (!text)
         return 0.0f;
 
-    int prevGlyph = 0;
+    if (auto* cache = GetTextRunCache())
+        return cache->GetRun(*this, text, maxLen, spaceExtra, outline)._width;
 
-    float x = 0.0f;
+    TextRun run;
+    LayoutTextRun(run, *this, text, maxLen, spaceExtra, outline);
+    return run._width;
+}
 
-        // DavidJ -- Hack -- this function is resulting in virtual call overload. But we
-        //                  can simplify by specialising for "FTFontGroup" type implementations
-    if (IsMultiFontAdapter()) {
-        for (uint32 i = 0; i < (uint32)maxLen; ++i) {
-            int ch = text[i];
-            if (!ch) break;
-            if( ch == '\n') continue;
-
-            int curGlyph;
-            intrusive_ptr<const Font> subFont = GetSubFont(ch);
-            if (subFont) {
-                x += subFont->GetKerning(prevGlyph, ch, &curGlyph)[0];
-
-                const FontChar* chr = subFont->GetChar(ch).first;
-                if(chr) {
-                    x += chr->xAdvance;
-
-                    if(outline) {
-                        x += 2.0f;
-                    }
-                    if(ch == ' ') {
-                        x += spaceExtra;
-                    }
-                }
-                prevGlyph = curGlyph;
-            }
-        }
-    } else {
-        for (uint32 i = 0; i < (uint32)maxLen; ++i) {
-            int ch = text[i];
-            if (!ch) break;
-            if( ch == '\n') continue;
-
-            int curGlyph;
-            x += GetKerning(prevGlyph, ch, &curGlyph)[0];
-
-            const FontChar* chr = GetChar(ch).first;
-            if(chr) {
-                x += chr->xAdvance;
-
-                if(outline) {
-                    x += 2.0f;
-                }
-                if(ch == ' ') {
-                    x += spaceExtra;
-                }
-            }
-            prevGlyph = curGlyph;
+static int CharCountFromWidth(const TextRun& run, float width)
+{
+    for (size_t c=0; c<run._glyphs.size(); ++c) {
+        if (width < run._glyphs[c]._x + run._glyphs[c]._advance) {
+            return int(c);
         }
     }
-
-    return x;
+    return int(run._glyphs.size());
 }
 
 int Font::CharCountFromWidth(const ucs4* text, float width, int maxLen, float spaceExtra, bool outline)
@@ -93,41 +56,12 @@ int Font::CharCountFromWidth(const ucs4* text, float width, int maxLen, float sp
     if (!text)
         return 0;
 
-    int prevGlyph = 0;
-    int charCount = 0;
-
-    float x = 0.0f;
-
-    for (uint32 i = 0; i < (uint32)maxLen; ++i) {
-        int ch = text[i];
-        if (!ch) break;
-        if( ch == '\n') continue;
-
-        int curGlyph;
-        x += GetKerning(prevGlyph, ch, &curGlyph)[0];
-        prevGlyph = curGlyph;
-
-        const FontChar* fc = GetChar(ch).first;
-        if(fc) {
+    if (auto* cache = GetTextRunCache())
+        return RenderOverlays::CharCountFromWidth(cache->GetRun(*this, text, maxLen, spaceExtra, outline), width);
 
-            x += fc->xAdvance;
-
-            if(outline) {
-                x += 2.0f;
-            }
-            if(ch == ' ') {
-                x += spaceExtra;
-            }
-        }
-
-        if (width < x) {
-            return charCount;
-        }
-
-        ++charCount;
-    }
-
-    return charCount;
+    TextRun run;
+    LayoutTextRun(run, *this, text, maxLen, spaceExtra, outline);
+    return RenderOverlays::CharCountFromWidth(run, width);
 }
 
 #pragma warning(disable:4706)   // C4706: assignment within conditional expression
@@ -147,6 +81,30 @@ static void CopyString(ucs4* dst, int count, const ucs4* src)
     *dst = 0;
 }
 
+    //  Returns the width at the first character that ends past "width", and the number
+    //  of input characters to replace with the ellipsis (or ~0 if the string fits, or if
+    //  the output buffer is too small).
+static float FindEllipsisPoint(const TextRun& run, const ucs4* inText, size_t outTextSize, float width, size_t& truncatedCount)
+{
+        //  The run skips newline characters, so we have to walk through the input
+        //  text in parallel to find the character index
+    truncatedCount = ~size_t(0);
+    size_t g = 0;
+    for (size_t i=0; inText[i] && g<run._glyphs.size(); ++i) {
+        if (inText[i] == '\n') continue;
+        float x = run._glyphs[g]._x + run._glyphs[g]._advance;
+        ++g;
+        if (x > width) {
+            size_t count = std::max(i, size_t(1));
+            if ((count + 2) <= outTextSize) {
+                truncatedCount = count;
+            }
+            return x;
+        }
+    }
+    return run._width;
+}
+
 float Font::StringEllipsis(const ucs4* inText, ucs4* outText, size_t outTextSize, float width, float spaceExtra, bool outline)
 {
     if (!inText || !outText)
@@ -156,48 +114,26 @@ float Font::StringEllipsis(const ucs4* inText, ucs4* outText, size_t outTextSize
         return 0.0f;
     }
 
-    int prevGlyph = 0;
-
-    float x = 0.0f;
-
-    for (uint32 i = 0 ; i < (uint32)-1 ; ++i) {
-        int ch = inText[i];
-        if (!ch) break;
-        if( ch == '\n') continue;
-
-        int curGlyph;
-        x += GetKerning(prevGlyph, ch, &curGlyph)[0];
-        prevGlyph = curGlyph;
-
-        const FontChar* fc = GetChar(ch).first;
-        if(fc) {
-
-            x += fc->xAdvance;
-
-            if(outline) {
-                x += 2.0f;
-            }
-            if(ch == ' ') {
-                x += spaceExtra;
-            }
-        }
-
-        if (x > width) {
-            size_t count = size_t(i);
-            if (count > outTextSize - 2) {
-                return x;
-            }
-
-            CopyString(outText, (int)count, inText);
-            outText[count - 1] = '.';
-            outText[count] = '.';
-            outText[count + 1] = 0;
+    size_t count;
+    float x;
+    if (auto* cache = GetTextRunCache()) {
+        x = FindEllipsisPoint(cache->GetRun(*this, inText, -1, spaceExtra, outline), inText, outTextSize, width, count);
+    } else {
+        TextRun run;
+        LayoutTextRun(run, *this, inText, -1, spaceExtra, outline);
+        x = FindEllipsisPoint(run, inText, outTextSize, width, count);
+    }
 
-            return StringWidth(outText, -1, spaceExtra, outline);
-        }
+    if (count == ~size_t(0)) {
+        return x;
     }
 
-    return x;
+    CopyString(outText, (int)count, inText);
+    outText[count - 1] = '.';
+    outText[count] = '.';
+    outText[count + 1] = 0;
+
+    return StringWidth(outText, -1, spaceExtra, outline);
 }
 
 float Font::CharWidth(ucs4 ch, ucs4 prev) const
@@ -252,6 +188,9 @@ intrusive_ptr<Font> GetX2Font(const char* path, int size, FontTexKind kind)
 static float                garbageCollectTime = 0.0f;
 BufferUploads::IManager*    gBufferUploads = nullptr;
 RenderCore::IDevice*        gRenderDevice = nullptr;
+static std::unique_ptr<TextRunCache> gTextRunCache;
+
+TextRunCache* GetTextRunCache() { return gTextRunCache.get(); }
 
 bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* bufferUploads)
 {
@@ -263,6 +202,8 @@ bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* buffer
         return false;
     }
 
+    gTextRunCache = std::make_unique<TextRunCache>();
+
     // if(!InitImageTextFontSystem()) {
     //     return false;
     // }
@@ -272,6 +213,7 @@ bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* buffer
 
 void CleanupFontSystem()
 {
+    gTextRunCache.reset();
     CleanupFTFontSystem();
     // CleanupImageTextFontSystem();
     gBufferUploads = nullptr;
@@ -283,6 +225,13 @@ void CheckResetFontSystem()
     CheckResetFTFontSystem();
 }
 
+void OnFontSystemFrameBarrier()
+{
+    if (gTextRunCache)
+        gTextRunCache->OnFrameBarrier();
+    OnFTFontSystemFrameBarrier();
+}
+
 int GetFontCount(FontTexKind kind)
 {
     switch (kind) {
@@ -34,6 +34,7 @@ namespace RenderOverlays
     };
 
     class FontTexture2D;
+    class TextLayoutRequest;
 
     // font
     #define FONT_IMAGE_TABLE_SIZE 16
@@ -69,6 +70,13 @@ namespace RenderOverlays
         virtual FT_Face     GetFace(ucs4 /*ch*/)     { return nullptr; }
         virtual void        TouchFontChar(const FontChar*)       {}
 
+            /// <summary>Prepare the glyphs for a string that is about to be drawn</summary>
+            /// Missing glyphs are rasterized in the background, and the glyphs for the
+            /// string are protected from eviction until the end of the frame (see
+            /// OnFontSystemFrameBarrier). Glyphs that aren't ready yet are drawn as
+            /// empty space this frame, and will appear in a later frame.
+        virtual void        EnsureGlyphsResident(const ucs4* /*text*/, int /*maxLen*/ = -1) const {}
+
         virtual float       Descent() const = 0;
         virtual float       Ascent(bool includeAccent) const = 0;
         virtual float       LineHeight() const = 0;
@@ -90,6 +98,7 @@ namespace RenderOverlays
     bool InitFontSystem(RenderCore::IDevice* device, BufferUploads::IManager* bufferUploads);
     void CleanupFontSystem();
     void CheckResetFontSystem();
+    void OnFontSystemFrameBarrier();        ///< call once per frame (evicts old entries from the text layout cache, and begins a new glyph batch)
     int GetFontCount(FontTexKind kind);
     int GetFontFileCount();
 
@@ -145,6 +154,12 @@ namespace RenderOverlays
                             float spaceExtra, float scale, float mx, float depth,
                             unsigned colorARGB, UI_TEXT_STATE textState, bool applyDescender, Quad* q) const;
 
+            /// <summary>Draw many strings with a single layout pass</summary>
+            /// Markup (eg, "{Color:...}") isn't interpreted here. See LayoutTextQuads().
+        void        DrawBatch(  RenderCore::Metal::DeviceContext* renderer,
+                                const TextLayoutRequest requests[], size_t requestCount,
+                                float scale, float depth) const;
+
         Float2     AlignText(const Quad& q, UiAlign align, const ucs4* text, int maxLen = -1);
         Float2     AlignText(const Quad& q, UiAlign align, float width, float indent);
         float       StringWidth(const ucs4* text, int maxlen = -1);
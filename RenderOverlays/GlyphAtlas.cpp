@@ -0,0 +1,400 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "GlyphAtlas.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+
+namespace RenderOverlays
+{
+    class GlyphAtlas::Pimpl
+    {
+    public:
+            //  Each glyph is allocated with a single pixel of padding on the right
+            //  and bottom edges (which is always zero in the backing store). This
+            //  stops bilinear filtering from picking up neighbouring glyphs.
+        static const unsigned Padding = 1;
+
+            //  Shelf heights are rounded up to this granularity, so that glyphs
+            //  of similar heights can share a shelf.
+        static const unsigned ShelfGranularity = 4;
+
+        class Shelf
+        {
+        public:
+            unsigned    _y, _height;
+            unsigned    _glyphCount;
+            std::vector<std::pair<unsigned, unsigned>> _freeSpans;     // [begin, end) ranges, sorted by position
+        };
+
+        class Glyph
+        {
+        public:
+            Rect        _rect;          // allocated area (including padding)
+            uint64      _owner;
+            uint64      _lastUsed;
+            GlyphId     _lruPrev, _lruNext;
+            bool        _active;
+        };
+
+        unsigned                _width, _height;
+        std::vector<uint8>      _backingStore;
+        std::vector<Shelf>      _shelves;           // sorted by _y, and packed tightly from the top of the atlas
+        unsigned                _shelvesEnd;
+        std::vector<Glyph>      _glyphs;
+        std::vector<GlyphId>    _freeGlyphIds;
+        GlyphId                 _lruHead, _lruTail; // head is the least recently used glyph
+        uint64                  _tick, _batchStart;
+        EvictionFn              _evictionFn;
+
+        unsigned                _dirtyMinX, _dirtyMinY, _dirtyMaxX, _dirtyMaxY;
+        Metrics                 _metrics;
+
+        bool    TryAllocate(unsigned width, unsigned height, Rect& result);
+        bool    TryAllocateInShelf(Shelf& shelf, unsigned width, Rect& result);
+        void    Free(const Rect& rect);
+        void    CoalesceEmptyShelves();
+        bool    IsCompatibleShelf(const Shelf& shelf, unsigned height) const;
+        void    Evict(GlyphId glyph);
+
+        void    LRUUnlink(GlyphId glyph);
+        void    LRUPushBack(GlyphId glyph);
+        void    MarkDirty(const Rect& rect);
+
+        static unsigned ShelfHeight(unsigned height) { return (height + ShelfGranularity - 1) & ~(ShelfGranularity-1); }
+    };
+
+    bool GlyphAtlas::Pimpl::IsCompatibleShelf(const Shelf& shelf, unsigned height) const
+    {
+            //  Empty shelves can be used for anything that fits (they will be split
+            //  down to size). Otherwise we limit the amount of wasted vertical space
+        if (shelf._height < height) return false;
+        if (!shelf._glyphCount) return true;
+        return shelf._height <= ShelfHeight(height + height/4);
+    }
+
+    bool GlyphAtlas::Pimpl::TryAllocateInShelf(Shelf& shelf, unsigned width, Rect& result)
+    {
+        for (auto s=shelf._freeSpans.begin(); s!=shelf._freeSpans.end(); ++s) {
+            if ((s->second - s->first) < width) continue;
+            result = Rect(s->first, shelf._y, width, 0);
+            s->first += width;
+            if (s->first == s->second)
+                shelf._freeSpans.erase(s);
+            ++shelf._glyphCount;
+            return true;
+        }
+        return false;
+    }
+
+    bool GlyphAtlas::Pimpl::TryAllocate(unsigned width, unsigned height, Rect& result)
+    {
+            //  Find the shelf with the least wasted space that has room for this glyph
+        Shelf* bestShelf = nullptr;
+        for (auto s=_shelves.begin(); s!=_shelves.end(); ++s) {
+            if (!IsCompatibleShelf(*s, height)) continue;
+            if (bestShelf && bestShelf->_height <= s->_height) continue;
+            bool hasRoom = false;
+            for (auto span=s->_freeSpans.cbegin(); span!=s->_freeSpans.cend() && !hasRoom; ++span)
+                hasRoom = (span->second - span->first) >= width;
+            if (hasRoom) bestShelf = AsPointer(s);
+        }
+
+        if (bestShelf && !bestShelf->_glyphCount && bestShelf->_height > ShelfHeight(height)) {
+                //  Split an empty shelf that is taller than we need. The remainder
+                //  becomes a new empty shelf directly below.
+            Shelf remainder;
+            remainder._y = bestShelf->_y + ShelfHeight(height);
+            remainder._height = bestShelf->_height - ShelfHeight(height);
+            remainder._glyphCount = 0;
+            remainder._freeSpans.push_back(std::make_pair(0u, _width));
+            bestShelf->_height = ShelfHeight(height);
+            auto i = _shelves.begin() + (bestShelf - AsPointer(_shelves.begin()));
+            bestShelf = AsPointer(_shelves.insert(i+1, std::move(remainder)) - 1);
+        }
+
+        if (!bestShelf) {
+                //  Open a new shelf at the end of the used area
+            unsigned shelfHeight = std::min(ShelfHeight(height), _height - _shelvesEnd);
+            if (_shelvesEnd >= _height || shelfHeight < height) return false;
+
+            Shelf newShelf;
+            newShelf._y = _shelvesEnd;
+            newShelf._height = shelfHeight;
+            newShelf._glyphCount = 0;
+            newShelf._freeSpans.push_back(std::make_pair(0u, _width));
+            _shelves.push_back(std::move(newShelf));
+            _shelvesEnd += shelfHeight;
+            bestShelf = &_shelves[_shelves.size()-1];
+        }
+
+        if (!TryAllocateInShelf(*bestShelf, width, result)) return false;
+        result._height = height;
+        return true;
+    }
+
+    void GlyphAtlas::Pimpl::Free(const Rect& rect)
+    {
+        auto s = std::find_if(_shelves.begin(), _shelves.end(), [&](const Shelf& s) { return s._y == rect._y; });
+        if (s == _shelves.end()) { assert(0); return; }
+
+        auto& spans = s->_freeSpans;
+        auto newSpan = std::make_pair(rect._x, rect._x + rect._width);
+        auto i = std::lower_bound(spans.begin(), spans.end(), newSpan);
+        i = spans.insert(i, newSpan);
+
+            // merge with neighbours
+        if ((i+1) != spans.end() && (i+1)->first == i->second) {
+            i->second = (i+1)->second;
+            spans.erase(i+1);
+        }
+        if (i != spans.begin() && (i-1)->second == i->first) {
+            (i-1)->second = i->second;
+            spans.erase(i);
+        }
+
+        assert(s->_glyphCount > 0);
+        if (!--s->_glyphCount)
+            CoalesceEmptyShelves();
+    }
+
+    void GlyphAtlas::Pimpl::CoalesceEmptyShelves()
+    {
+            //  Merge adjacent empty shelves, so that their space can be reused
+            //  for glyphs of any height. Empty shelves at the end just return
+            //  their space to the unused area.
+        for (size_t c=0; (c+1)<_shelves.size();) {
+            if (!_shelves[c]._glyphCount && !_shelves[c+1]._glyphCount) {
+                _shelves[c]._height += _shelves[c+1]._height;
+                _shelves.erase(_shelves.begin()+c+1);
+            } else ++c;
+        }
+
+        while (!_shelves.empty() && !_shelves[_shelves.size()-1]._glyphCount) {
+            _shelvesEnd = _shelves[_shelves.size()-1]._y;
+            _shelves.pop_back();
+        }
+    }
+
+    void GlyphAtlas::Pimpl::LRUUnlink(GlyphId glyph)
+    {
+        auto& g = _glyphs[glyph];
+        if (g._lruPrev != GlyphId_Invalid) _glyphs[g._lruPrev]._lruNext = g._lruNext;
+        else _lruHead = g._lruNext;
+        if (g._lruNext != GlyphId_Invalid) _glyphs[g._lruNext]._lruPrev = g._lruPrev;
+        else _lruTail = g._lruPrev;
+        g._lruPrev = g._lruNext = GlyphId_Invalid;
+    }
+
+    void GlyphAtlas::Pimpl::LRUPushBack(GlyphId glyph)
+    {
+        auto& g = _glyphs[glyph];
+        g._lruPrev = _lruTail;
+        g._lruNext = GlyphId_Invalid;
+        if (_lruTail != GlyphId_Invalid) _glyphs[_lruTail]._lruNext = glyph;
+        else _lruHead = glyph;
+        _lruTail = glyph;
+    }
+
+    void GlyphAtlas::Pimpl::MarkDirty(const Rect& rect)
+    {
+        _dirtyMinX = std::min(_dirtyMinX, rect._x);
+        _dirtyMinY = std::min(_dirtyMinY, rect._y);
+        _dirtyMaxX = std::max(_dirtyMaxX, rect._x + rect._width);
+        _dirtyMaxY = std::max(_dirtyMaxY, rect._y + rect._height);
+    }
+
+    void GlyphAtlas::Pimpl::Evict(GlyphId glyph)
+    {
+        auto owner = _glyphs[glyph]._owner;
+        LRUUnlink(glyph);
+        Free(_glyphs[glyph]._rect);
+        _metrics._usedArea -= _glyphs[glyph]._rect._width * _glyphs[glyph]._rect._height;
+        _glyphs[glyph]._active = false;
+        _freeGlyphIds.push_back(glyph);
+        --_metrics._glyphCount;
+        ++_metrics._evictions;
+        if (_evictionFn) _evictionFn(owner);
+    }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+    auto GlyphAtlas::Add(const uint8 bitmap[], unsigned width, unsigned height, unsigned pitch, uint64 owner) -> GlyphId
+    {
+        auto& p = *_pimpl;
+        const unsigned allocWidth = width + Pimpl::Padding, allocHeight = height + Pimpl::Padding;
+        if (allocWidth > p._width || allocHeight > p._height) {
+            ++p._metrics._failedAdditions;
+            return GlyphId_Invalid;
+        }
+
+        Rect rect;
+        bool success = p.TryAllocate(allocWidth, allocHeight, rect);
+        if (!success) {
+                //  First try evicting old glyphs from shelves that could hold this
+                //  glyph, and then fall back to evicting anything that isn't protected
+                //  (which will eventually free entire shelves).
+                //  The LRU list is sorted by _lastUsed, so we can stop at the first
+                //  protected glyph.
+            for (auto g=p._lruHead; g!=GlyphId_Invalid && !success;) {
+                auto next = p._glyphs[g]._lruNext;
+                if (p._glyphs[g]._lastUsed >= p._batchStart) break;
+                auto s = std::find_if(p._shelves.cbegin(), p._shelves.cend(),
+                    [&](const Pimpl::Shelf& s) { return s._y == p._glyphs[g]._rect._y; });
+                if (s != p._shelves.cend() && p.IsCompatibleShelf(*s, allocHeight)) {
+                    p.Evict(g);
+                    success = p.TryAllocate(allocWidth, allocHeight, rect);
+                }
+                g = next;
+            }
+
+            while (!success && p._lruHead != GlyphId_Invalid && p._glyphs[p._lruHead]._lastUsed < p._batchStart) {
+                p.Evict(p._lruHead);
+                success = p.TryAllocate(allocWidth, allocHeight, rect);
+            }
+
+            if (!success) {
+                ++p._metrics._failedAdditions;
+                return GlyphId_Invalid;
+            }
+        }
+
+            //  Copy the bitmap into the backing store, and clear the padding
+        for (unsigned y=0; y<allocHeight; ++y) {
+            auto* dst = &p._backingStore[(rect._y + y) * p._width + rect._x];
+            if (y < height) {
+                if (width) XlCopyMemory(dst, &bitmap[y * pitch], width);
+                dst[width] = 0;
+            } else {
+                XlSetMemory(dst, 0, allocWidth);
+            }
+        }
+        p.MarkDirty(rect);
+
+        GlyphId result;
+        if (!p._freeGlyphIds.empty()) {
+            result = p._freeGlyphIds[p._freeGlyphIds.size()-1];
+            p._freeGlyphIds.pop_back();
+        } else {
+            result = GlyphId(p._glyphs.size());
+            p._glyphs.push_back(Pimpl::Glyph());
+        }
+
+        auto& g = p._glyphs[result];
+        g._rect = rect;
+        g._owner = owner;
+        g._lastUsed = ++p._tick;
+        g._active = true;
+        p.LRUPushBack(result);
+
+        ++p._metrics._glyphCount;
+        ++p._metrics._additions;
+        p._metrics._usedArea += rect._width * rect._height;
+        return result;
+    }
+
+    void GlyphAtlas::Remove(GlyphId glyph)
+    {
+        auto& p = *_pimpl;
+        if (glyph >= p._glyphs.size() || !p._glyphs[glyph]._active) return;
+        p.LRUUnlink(glyph);
+        p.Free(p._glyphs[glyph]._rect);
+        p._metrics._usedArea -= p._glyphs[glyph]._rect._width * p._glyphs[glyph]._rect._height;
+        p._glyphs[glyph]._active = false;
+        p._freeGlyphIds.push_back(glyph);
+        --p._metrics._glyphCount;
+    }
+
+    void GlyphAtlas::Touch(GlyphId glyph)
+    {
+        auto& p = *_pimpl;
+        if (glyph >= p._glyphs.size() || !p._glyphs[glyph]._active) return;
+        p._glyphs[glyph]._lastUsed = ++p._tick;
+        if (p._lruTail != glyph) {
+            p.LRUUnlink(glyph);
+            p.LRUPushBack(glyph);
+        }
+    }
+
+    auto GlyphAtlas::GetRect(GlyphId glyph) const -> Rect
+    {
+        auto& p = *_pimpl;
+        if (glyph >= p._glyphs.size() || !p._glyphs[glyph]._active) return Rect();
+        auto r = p._glyphs[glyph]._rect;
+        return Rect(r._x, r._y, r._width - Pimpl::Padding, r._height - Pimpl::Padding);
+    }
+
+    void GlyphAtlas::BeginBatch()
+    {
+        _pimpl->_batchStart = _pimpl->_tick + 1;
+    }
+
+    const uint8*    GlyphAtlas::GetBackingStore() const { return AsPointer(_pimpl->_backingStore.cbegin()); }
+    unsigned        GlyphAtlas::GetWidth() const        { return _pimpl->_width; }
+    unsigned        GlyphAtlas::GetHeight() const       { return _pimpl->_height; }
+
+    auto GlyphAtlas::TakeDirtyRect() -> Rect
+    {
+        auto& p = *_pimpl;
+        Rect result;
+        if (p._dirtyMaxX > p._dirtyMinX && p._dirtyMaxY > p._dirtyMinY)
+            result = Rect(p._dirtyMinX, p._dirtyMinY, p._dirtyMaxX - p._dirtyMinX, p._dirtyMaxY - p._dirtyMinY);
+        p._dirtyMinX = p._dirtyMinY = ~0u;
+        p._dirtyMaxX = p._dirtyMaxY = 0;
+        return result;
+    }
+
+    auto GlyphAtlas::GetMetrics() const -> Metrics
+    {
+        auto result = _pimpl->_metrics;
+        result._shelfCount = unsigned(_pimpl->_shelves.size());
+        return result;
+    }
+
+    void GlyphAtlas::Reset()
+    {
+            //  Note that the eviction callback isn't called here. The caller
+            //  should reset its own tables.
+        auto& p = *_pimpl;
+        p._shelves.clear();
+        p._shelvesEnd = 0;
+        p._glyphs.clear();
+        p._freeGlyphIds.clear();
+        p._lruHead = p._lruTail = GlyphId_Invalid;
+        p._batchStart = p._tick + 1;
+        p._metrics._glyphCount = 0;
+        p._metrics._usedArea = 0;
+    }
+
+    GlyphAtlas::GlyphAtlas(unsigned width, unsigned height, EvictionFn&& evictionFn)
+    {
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_width = width;
+        pimpl->_height = height;
+        pimpl->_backingStore.resize(width*height, 0);
+        pimpl->_shelvesEnd = 0;
+        pimpl->_lruHead = pimpl->_lruTail = GlyphId_Invalid;
+        pimpl->_tick = 0;
+        pimpl->_batchStart = 1;
+        pimpl->_evictionFn = std::move(evictionFn);
+        pimpl->_dirtyMinX = pimpl->_dirtyMinY = ~0u;
+        pimpl->_dirtyMaxX = pimpl->_dirtyMaxY = 0;
+        _pimpl = std::move(pimpl);
+    }
+
+    GlyphAtlas::~GlyphAtlas() {}
+
+    GlyphAtlas::Metrics::Metrics()
+    {
+        _glyphCount = _shelfCount = 0;
+        _additions = _evictions = _failedAdditions = 0;
+        _usedArea = 0;
+    }
+}
+
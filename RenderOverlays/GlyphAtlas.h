@@ -0,0 +1,92 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Utility/Mixins.h"
+#include "../Core/Types.h"
+#include <memory>
+#include <functional>
+
+namespace RenderOverlays
+{
+    /// <summary>Packs glyph bitmaps into a single 8 bit texture atlas</summary>
+    /// Glyphs are packed into horizontal shelves. Each shelf holds glyphs of
+    /// roughly the same height, and space within a shelf is tracked as a list of
+    /// free spans. So individual glyphs can be freed and their space reused.
+    ///
+    /// When there is no room for a new glyph, glyphs are evicted in least recently
+    /// used order. Glyphs touched since the last call to BeginBatch() are never
+    /// evicted, so a batch of glyphs that are about to be drawn together always stays
+    /// valid. The eviction callback is called with the "owner" value that was passed
+    /// to Add() for each evicted glyph.
+    ///
+    /// The atlas keeps a CPU side copy of the texture. It has no dependencies on
+    /// the device or on FreeType, so it can be used (and tested) headless. Callers
+    /// should copy the region returned by TakeDirtyRect() into the GPU texture.
+    class GlyphAtlas : noncopyable
+    {
+    public:
+        typedef unsigned GlyphId;
+        static const GlyphId GlyphId_Invalid = ~GlyphId(0);
+
+        class Rect
+        {
+        public:
+            unsigned _x, _y, _width, _height;
+            Rect() : _x(0), _y(0), _width(0), _height(0) {}
+            Rect(unsigned x, unsigned y, unsigned width, unsigned height) : _x(x), _y(y), _width(width), _height(height) {}
+        };
+
+        class Metrics
+        {
+        public:
+            unsigned    _glyphCount;
+            unsigned    _shelfCount;
+            unsigned    _additions;
+            unsigned    _evictions;
+            unsigned    _failedAdditions;   ///< glyphs that didn't fit, even after evicting everything possible
+            unsigned    _usedArea;          ///< pixels allocated to glyphs (including padding)
+
+            Metrics();
+        };
+
+        typedef std::function<void(uint64 owner)> EvictionFn;
+
+            /// <summary>Add a glyph, copying its bitmap into the backing store</summary>
+            /// "pitch" is the distance in bytes between rows of "bitmap". Returns
+            /// GlyphId_Invalid if there is no room, even after eviction.
+        GlyphId     Add(const uint8 bitmap[], unsigned width, unsigned height, unsigned pitch, uint64 owner);
+        void        Remove(GlyphId glyph);
+        void        Touch(GlyphId glyph);
+        Rect        GetRect(GlyphId glyph) const;
+
+            /// <summary>Protect glyphs used from here on from eviction</summary>
+            /// Call before looking up all of the glyphs for a string (or a frame).
+            /// Any glyph touched or added after this call won't be evicted until the
+            /// next call to BeginBatch().
+        void        BeginBatch();
+
+        const uint8*    GetBackingStore() const;
+        unsigned        GetWidth() const;
+        unsigned        GetHeight() const;
+
+            /// <summary>Returns the region changed since the last call, and clears it</summary>
+            /// Returns an empty rect when nothing has changed.
+        Rect        TakeDirtyRect();
+
+        Metrics     GetMetrics() const;
+        void        Reset();
+
+        GlyphAtlas(unsigned width, unsigned height, EvictionFn&& evictionFn);
+        ~GlyphAtlas();
+
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+}
+
@@ -0,0 +1,324 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TextLayout.h"
+#include "Font.h"
+#include "../RenderCore/RenderUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/IteratorUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <algorithm>
+#include <string>
+#include <assert.h>
+
+namespace RenderOverlays
+{
+    TextRun::TextRun() : _width(0.f), _complete(true) {}
+
+    static void AddGlyph(TextRun& dst, ucs4 ch, float x, const FontChar* chr, float spaceExtra, bool outline)
+    {
+        TextRun::Glyph glyph;
+        glyph._ch = ch;
+        glyph._x = x;
+        glyph._advance = 0.f;
+        if (chr) {
+            glyph._advance = chr->xAdvance;
+            if (outline) {
+                glyph._advance += 2.0f;
+            }
+            if (ch == ' ') {
+                glyph._advance += spaceExtra;
+            }
+        } else {
+            dst._complete = false;
+        }
+        dst._glyphs.push_back(glyph);
+    }
+
+    void LayoutTextRun(TextRun& dst, Font& font, const ucs4 text[], int maxLen, float spaceExtra, bool outline)
+    {
+        dst._glyphs.clear();
+        dst._width = 0.f;
+        dst._complete = true;
+        if (!text) return;
+
+        int prevGlyph = 0;
+        float x = 0.0f;
+
+            // DavidJ -- Hack -- this function is resulting in virtual call overload. But we
+            //                  can simplify by specialising for "FTFontGroup" type implementations
+        if (font.IsMultiFontAdapter()) {
+            for (uint32 i = 0; i < (uint32)maxLen; ++i) {
+                ucs4 ch = text[i];
+                if (!ch) break;
+                if (ch == '\n') continue;
+
+                int curGlyph;
+                intrusive_ptr<const Font> subFont = font.GetSubFont(ch);
+                if (subFont) {
+                    x += subFont->GetKerning(prevGlyph, ch, &curGlyph)[0];
+                    const FontChar* chr = subFont->GetChar(ch).first;
+                    AddGlyph(dst, ch, x, chr, spaceExtra, outline);
+                    x += dst._glyphs.back()._advance;
+                    prevGlyph = curGlyph;
+                } else {
+                    AddGlyph(dst, ch, x, nullptr, spaceExtra, outline);
+                }
+            }
+        } else {
+            for (uint32 i = 0; i < (uint32)maxLen; ++i) {
+                ucs4 ch = text[i];
+                if (!ch) break;
+                if (ch == '\n') continue;
+
+                int curGlyph;
+                x += font.GetKerning(prevGlyph, ch, &curGlyph)[0];
+                const FontChar* chr = font.GetChar(ch).first;
+                AddGlyph(dst, ch, x, chr, spaceExtra, outline);
+                x += dst._glyphs.back()._advance;
+                prevGlyph = curGlyph;
+            }
+        }
+
+        dst._width = x;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class TextRunCache::Pimpl
+    {
+    public:
+        class Entry
+        {
+        public:
+            std::string         _fontPath;
+            int                 _fontSize;
+            float               _spaceExtra;
+            bool                _outline;
+            std::vector<ucs4>   _text;
+            TextRun             _run;
+            unsigned            _lastUsedFrame;
+
+            bool Matches(const char fontPath[], int fontSize, float spaceExtra, bool outline, const ucs4 text[], size_t length) const
+            {
+                return _fontSize == fontSize && _fontPath == fontPath && _spaceExtra == spaceExtra && _outline == outline
+                    && _text.size() == length && std::equal(_text.begin(), _text.end(), text);
+            }
+        };
+
+            //  Sorted by hash value. Runs are small and the cache is bounded, so
+            //  a sorted vector works better than a node based hash table here.
+        std::vector<std::pair<uint64, Entry>> _entries;
+        TextRun     _uncachedRun;
+
+        unsigned    _currentFrame;
+        unsigned    _maxAgeInFrames;
+        unsigned    _maxRunCount;
+        uint64      _hashMask;
+        Metrics     _metrics;
+
+        void EvictOlderThan(unsigned maxAge);
+    };
+
+    void TextRunCache::Pimpl::EvictOlderThan(unsigned maxAge)
+    {
+        auto currentFrame = _currentFrame;
+        auto i = std::remove_if(
+            _entries.begin(), _entries.end(),
+            [currentFrame, maxAge](const std::pair<uint64, Entry>& e) { return (currentFrame - e.second._lastUsedFrame) > maxAge; });
+        _metrics._evictions += unsigned(std::distance(i, _entries.end()));
+        _entries.erase(i, _entries.end());
+    }
+
+    const TextRun& TextRunCache::GetRun(Font& font, const ucs4 text[], int maxLen, float spaceExtra, bool outline)
+    {
+        auto& pimpl = *_pimpl;
+        ++pimpl._metrics._lookups;
+
+        size_t length = 0;
+        if (text) {
+            while (length < (size_t)(uint32)maxLen && text[length]) ++length;
+        }
+
+        auto fontHash = Hash64(font.GetPath(), DefaultSeed64 + font.GetSize());
+        auto hash = Hash64(text, text + length, fontHash + (outline?1:0));
+        if (spaceExtra != 0.f) {
+            hash = Hash64(&spaceExtra, PtrAdd(&spaceExtra, sizeof(spaceExtra)), hash);
+        }
+
+        hash &= pimpl._hashMask;
+
+        auto i = std::lower_bound(pimpl._entries.begin(), pimpl._entries.end(), hash, CompareFirst<uint64, Pimpl::Entry>());
+        if (i != pimpl._entries.end() && i->first == hash) {
+                //  The hash only selects the entry; the full key must match before
+                //  we can reuse the run
+            auto& entry = i->second;
+            if (entry.Matches(font.GetPath(), font.GetSize(), spaceExtra, outline, text, length)) {
+                ++pimpl._metrics._hits;
+                entry._lastUsedFrame = pimpl._currentFrame;
+                return entry._run;
+            }
+
+                //  Hash collision. Leave the existing entry alone (it may still be in
+                //  use this frame), and don't cache this run.
+            ++pimpl._metrics._collisions;
+            LayoutTextRun(pimpl._uncachedRun, font, text, int(length), spaceExtra, outline);
+            return pimpl._uncachedRun;
+        }
+
+        if (pimpl._entries.size() >= pimpl._maxRunCount) {
+                //  Evict everything not used in this frame. If the cache is still full,
+                //  we just won't cache this run
+            pimpl.EvictOlderThan(0);
+            if (pimpl._entries.size() >= pimpl._maxRunCount) {
+                LayoutTextRun(pimpl._uncachedRun, font, text, int(length), spaceExtra, outline);
+                return pimpl._uncachedRun;
+            }
+            i = std::lower_bound(pimpl._entries.begin(), pimpl._entries.end(), hash, CompareFirst<uint64, Pimpl::Entry>());
+        }
+
+        Pimpl::Entry newEntry;
+        newEntry._fontPath = font.GetPath();
+        newEntry._fontSize = font.GetSize();
+        newEntry._spaceExtra = spaceExtra;
+        newEntry._outline = outline;
+        newEntry._text.assign(text, text + length);
+        newEntry._lastUsedFrame = pimpl._currentFrame;
+        LayoutTextRun(newEntry._run, font, text, int(length), spaceExtra, outline);
+
+            //  Runs that are missing glyphs (eg, because the glyph atlas is full) shouldn't
+            //  be cached; the glyphs may become available later
+        if (!newEntry._run._complete) {
+            pimpl._uncachedRun = std::move(newEntry._run);
+            return pimpl._uncachedRun;
+        }
+
+        i = pimpl._entries.insert(i, std::make_pair(hash, std::move(newEntry)));
+        return i->second._run;
+    }
+
+    void TextRunCache::OnFrameBarrier()
+    {
+        ++_pimpl->_currentFrame;
+        _pimpl->EvictOlderThan(_pimpl->_maxAgeInFrames);
+    }
+
+    void TextRunCache::Clear()
+    {
+        _pimpl->_metrics._evictions += unsigned(_pimpl->_entries.size());
+        _pimpl->_entries.clear();
+    }
+
+    auto TextRunCache::GetMetrics() const -> Metrics
+    {
+        auto result = _pimpl->_metrics;
+        result._runCount = unsigned(_pimpl->_entries.size());
+        return result;
+    }
+
+    TextRunCache::Metrics::Metrics() : _runCount(0), _lookups(0), _hits(0), _evictions(0), _collisions(0) {}
+
+    TextRunCache::TextRunCache(unsigned maxAgeInFrames, unsigned maxRunCount, unsigned hashBits)
+    {
+        _pimpl = std::make_unique<Pimpl>();
+        _pimpl->_currentFrame = 0;
+        _pimpl->_maxAgeInFrames = maxAgeInFrames;
+        _pimpl->_maxRunCount = std::max(1u, maxRunCount);
+        _pimpl->_hashMask = (hashBits >= 64) ? ~uint64(0) : ((uint64(1) << hashBits) - 1);
+    }
+
+    TextRunCache::~TextRunCache() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static unsigned ShadowColor(float opacity)
+    {
+        return unsigned(std::max(0.f, std::min(opacity, 1.f)) * 255.f) << 24;
+    }
+
+    static void PushGlyphQuad(std::vector<GlyphQuad>& dst, const Quad& pos, float offsetX, float offsetY, const Quad& tc, unsigned color, const FontTexture2D* texture)
+    {
+        GlyphQuad q;
+        q._position = Quad::MinMax(pos.min[0] + offsetX, pos.min[1] + offsetY, pos.max[0] + offsetX, pos.max[1] + offsetY);
+        q._texCoords = tc;
+        q._colorABGR = color;
+        q._texture = texture;
+        dst.push_back(q);
+    }
+
+    size_t LayoutTextQuads(
+        std::vector<GlyphQuad>& dst,
+        Font& font, const DrawTextOptions& options,
+        const TextLayoutRequest requests[], size_t requestCount,
+        float scale, float spaceExtra, bool applyDescender)
+    {
+        auto initialSize = dst.size();
+
+            //  Queue all of the missing glyphs first, so they can be rasterized in the
+            //  background together
+        for (size_t c=0; c<requestCount; ++c)
+            font.EnsureGlyphsResident(requests[c]._text, requests[c]._maxLen);
+
+        auto* cache = GetTextRunCache();
+        TextRun localRun;
+        const float descent = applyDescender ? font.Descent() : 0.f;
+        const float xScale = scale, yScale = scale;
+
+        for (size_t c=0; c<requestCount; ++c) {
+            const auto& req = requests[c];
+            if (!req._text) continue;
+
+            const TextRun* run;
+            if (cache) {
+                run = &cache->GetRun(font, req._text, req._maxLen, spaceExtra, !!options.outline);
+            } else {
+                LayoutTextRun(localRun, font, req._text, req._maxLen, spaceExtra, !!options.outline);
+                run = &localRun;
+            }
+
+            float x = req._position[0], y = req._position[1];
+            if (options.snap) {
+                x = xScale * (int)(0.5f + x / xScale);
+                y = yScale * (int)(0.5f + y / yScale);
+            }
+
+            const unsigned color = RenderCore::ARGBtoABGR(req._colorARGB);
+            const unsigned shadowColor = ShadowColor((req._colorARGB >> 24) / float(0xff));
+
+            for (const auto& g:run->_glyphs) {
+                auto charAndTexture = font.GetChar(g._ch);
+                const FontChar* fc = charAndTexture.first;
+                if (!fc) continue;
+
+                float baseX = x + (g._x * xScale) + fc->left * xScale;
+                float baseY = y - (fc->top + descent) * yScale;
+                if (options.snap) {
+                    baseX = xScale * (int)(0.5f + baseX / xScale);
+                    baseY = yScale * (int)(0.5f + baseY / yScale);
+                }
+
+                Quad pos    = Quad::MinMax(baseX, baseY, baseX + fc->width * xScale, baseY + fc->height * yScale);
+                Quad tc     = Quad::MinMax(fc->u0, fc->v0, fc->u1, fc->v1);
+                auto* tex   = charAndTexture.second;
+
+                if (options.outline) {
+                    static const float offsets[][2] =
+                        { {-1.f, -1.f}, {0.f, -1.f}, {1.f, -1.f}, {-1.f, 0.f}, {1.f, 0.f}, {-1.f, 1.f}, {0.f, 1.f}, {1.f, 1.f} };
+                    for (unsigned o=0; o<dimof(offsets); ++o)
+                        PushGlyphQuad(dst, pos, offsets[o][0] * xScale, offsets[o][1] * yScale, tc, shadowColor, tex);
+                }
+
+                if (options.shadow)
+                    PushGlyphQuad(dst, pos, xScale, yScale, tc, shadowColor, tex);
+
+                PushGlyphQuad(dst, pos, 0.f, 0.f, tc, color, tex);
+            }
+        }
+
+        return dst.size() - initialSize;
+    }
+}
+
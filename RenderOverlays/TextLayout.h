@@ -0,0 +1,123 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "FontPrimitives.h"
+#include "../Utility/UTFUtils.h"
+#include "../Utility/Mixins.h"
+#include "../Core/Types.h"
+#include <vector>
+#include <memory>
+
+namespace RenderOverlays
+{
+    class Font;
+    class FontTexture2D;
+    struct DrawTextOptions;
+
+    /// <summary>A single line of text, laid out with a single font</summary>
+    /// Runs store character codes and pen positions only. Glyph bitmaps can be
+    /// evicted from the glyph atlas at any time, so the texture coordinates must
+    /// be looked up with Font::GetChar() when the run is drawn.
+    class TextRun
+    {
+    public:
+        class Glyph
+        {
+        public:
+            ucs4    _ch;
+            float   _x;             ///< pen position after kerning, relative to the start of the run
+            float   _advance;       ///< distance to the pen position of the next glyph (before kerning)
+        };
+
+        std::vector<Glyph>  _glyphs;
+        float               _width;
+        bool                _complete;  ///< false if some glyphs were unavailable during layout
+
+        TextRun();
+    };
+
+        /// <summary>Lay out a string without using the cache</summary>
+        /// Newline characters are skipped. No other markup is interpreted.
+    void LayoutTextRun(TextRun& dst, Font& font, const ucs4 text[], int maxLen, float spaceExtra, bool outline);
+
+    /// <summary>Caches laid out text runs between frames</summary>
+    /// Most of the text drawn by the overlay systems is the same from frame to
+    /// frame. But the layout for each string is normally calculated at least twice
+    /// per frame (once for alignment, and once while drawing), with a few virtual calls
+    /// per character. This cache keeps the result of the layout, keyed by font,
+    /// size and string.
+    ///
+    /// Runs that haven't been used for "maxAgeInFrames" frames are evicted at
+    /// OnFrameBarrier(). The cache isn't thread safe; it should only be used
+    /// by the thread that draws overlays.
+    class TextRunCache : noncopyable
+    {
+    public:
+            /// <summary>Find or build the run for the given string</summary>
+            /// The result is only valid until the next call to GetRun() or OnFrameBarrier().
+        const TextRun&  GetRun(Font& font, const ucs4 text[], int maxLen = -1, float spaceExtra = 0.f, bool outline = false);
+        void            OnFrameBarrier();
+        void            Clear();
+
+        class Metrics
+        {
+        public:
+            unsigned    _runCount;
+            unsigned    _lookups;
+            unsigned    _hits;
+            unsigned    _evictions;
+            unsigned    _collisions;    ///< lookups that weren't cached because another string had the same hash
+            Metrics();
+        };
+        Metrics         GetMetrics() const;
+
+            /// "hashBits" limits the number of bits of the hash value that are used
+            /// for lookups. Only reduce it to exercise the collision handling in tests.
+        TextRunCache(unsigned maxAgeInFrames = 8, unsigned maxRunCount = 4096, unsigned hashBits = 64);
+        ~TextRunCache();
+
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+
+        /// <summary>Returns the cache used by Font, or nullptr if the font system isn't initialised</summary>
+    TextRunCache*   GetTextRunCache();
+
+    /// <summary>A single glyph quad, ready to be written into a vertex buffer</summary>
+    class GlyphQuad
+    {
+    public:
+        Quad                    _position;
+        Quad                    _texCoords;
+        unsigned                _colorABGR;
+        const FontTexture2D*    _texture;
+    };
+
+    class TextLayoutRequest
+    {
+    public:
+        const ucs4*     _text;
+        int             _maxLen;
+        Float2          _position;      ///< pen position at the start of the baseline
+        unsigned        _colorARGB;
+    };
+
+        /// <summary>Lay out many strings at once, and emit the quads for all of them</summary>
+        /// The glyphs for all of the strings are made resident together (in a single
+        /// glyph batch), so the texture coordinates in the output stay valid until
+        /// the next glyph batch begins. The quads for shadows and outlines (as per
+        /// "options") are emitted before the quads for the glyph they belong to.
+        /// Returns the number of quads written.
+    size_t LayoutTextQuads(
+        std::vector<GlyphQuad>& dst,
+        Font& font, const DrawTextOptions& options,
+        const TextLayoutRequest requests[], size_t requestCount,
+        float scale = 1.f, float spaceExtra = 0.f, bool applyDescender = true);
+}
+
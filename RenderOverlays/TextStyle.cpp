@@ -6,6 +6,7 @@
 
 #include "Font.h"
 #include "FontRendering.h"
+#include "TextLayout.h"
 #include "../RenderCore/RenderUtils.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringUtils.h"
@@ -224,6 +225,46 @@ TextStyleResources::TextStyleResources(const Desc& desc)
 TextStyleResources::~TextStyleResources()
 {}
 
+static void BindTextResources(RenderCore::Metal::DeviceContext& renderer)
+{
+    using namespace RenderCore::Metal;
+    auto& res = RenderCore::Techniques::FindCachedBoxDep<TextStyleResources>(TextStyleResources::Desc());
+    renderer.Bind(res._boundInputLayout);     // have to bind a standard P2CT input layout
+    renderer.Bind(*res._shaderProgram);
+    renderer.Bind(Topology::TriangleList);
+
+    renderer.Bind(RenderCore::Techniques::CommonResources()._dssDisable);
+    renderer.Bind(RenderCore::Techniques::CommonResources()._cullDisable);
+
+    {
+        ViewportDesc viewportDesc(renderer);
+        ReciprocalViewportDimensions reciprocalViewportDimensions = { 1.f / float(viewportDesc.Width), 1.f / float(viewportDesc.Height), 0.f, 0.f };
+            
+        // ConstantBuffer constantBuffer(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions));
+        // std::shared_ptr<std::vector<uint8>> packet = constantBuffer.GetUnderlying();
+        auto packet = RenderCore::MakeSharedPkt(
+            (const uint8*)&reciprocalViewportDimensions, 
+            (const uint8*)PtrAdd(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions)));
+        res._boundUniforms.Apply(renderer, UniformsStream(), UniformsStream(&packet, nullptr, 1));
+            
+        // renderer->BindVS(boundLayout, constantBuffer);
+        // renderer.BindVS(ResourceList<ConstantBuffer, 1>(std::make_tuple()));
+    }
+}
+
+static void BindFontTexture(RenderCore::Metal::DeviceContext& renderer, const FontTexture2D* tex)
+{
+    using namespace RenderCore::Metal;
+    ShaderResourceView::UnderlyingResource sourceTexture = 
+        (ShaderResourceView::UnderlyingResource)tex->GetUnderlying();
+    if (!sourceTexture) {
+        throw ::Assets::Exceptions::PendingResource("", "Pending background upload of font texture");
+    }
+
+    ShaderResourceView shadRes(sourceTexture);
+    renderer.BindPS(RenderCore::MakeResourceList(shadRes));
+}
+
 float   TextStyle::Draw(    
     RenderCore::Metal::DeviceContext* renderer, 
     float x, float y, const ucs4 text[], int maxLen,
@@ -247,6 +288,10 @@ float   TextStyle::Draw(
             y = yScale * (int)(0.5f + y / yScale);
         }
 
+            //  Start rasterizing any missing glyphs in the background, and make sure
+            //  none of the glyphs for this string get evicted during this frame
+        _font->EnsureGlyphsResident(text, maxLen);
+
         float width     = _font->StringWidth(text, maxLen, spaceExtra, _options.outline);
         float height    = _font->LineHeight() * yScale;
 
@@ -285,28 +330,7 @@ float   TextStyle::Draw(
         // VertexShader& vshader    = GetResource<VertexShader>(vertexShaderSource);
         // PixelShader& pshader     = GetResource<PixelShader>(pixelShaderSource);
 
-        auto& res = RenderCore::Techniques::FindCachedBoxDep<TextStyleResources>(TextStyleResources::Desc());
-        renderer->Bind(res._boundInputLayout);     // have to bind a standard P2CT input layout
-        renderer->Bind(*res._shaderProgram);
-        renderer->Bind(Topology::TriangleList);
-
-        renderer->Bind(RenderCore::Techniques::CommonResources()._dssDisable);
-        renderer->Bind(RenderCore::Techniques::CommonResources()._cullDisable);
-
-        {
-            ViewportDesc viewportDesc(*renderer);
-            ReciprocalViewportDimensions reciprocalViewportDimensions = { 1.f / float(viewportDesc.Width), 1.f / float(viewportDesc.Height), 0.f, 0.f };
-            
-            // ConstantBuffer constantBuffer(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions));
-            // std::shared_ptr<std::vector<uint8>> packet = constantBuffer.GetUnderlying();
-            auto packet = RenderCore::MakeSharedPkt(
-                (const uint8*)&reciprocalViewportDimensions, 
-                (const uint8*)PtrAdd(&reciprocalViewportDimensions, sizeof(reciprocalViewportDimensions)));
-            res._boundUniforms.Apply(*renderer, UniformsStream(), UniformsStream(&packet, nullptr, 1));
-            
-            // renderer->BindVS(boundLayout, constantBuffer);
-            // renderer.BindVS(ResourceList<ConstantBuffer, 1>(std::make_tuple()));
-        }
+        BindTextResources(*renderer);
         const FontTexture2D *   currentBoundTexture = nullptr;
         WorkingVertexSetPCT     workingVertices;
 
@@ -350,15 +374,7 @@ float   TextStyle::Draw(
                 // Set the new texture if needed (changing state requires flushing completed work)
             if (tex != currentBoundTexture) {
                 Flush(*renderer, workingVertices);
-
-                ShaderResourceView::UnderlyingResource sourceTexture = 
-                    (ShaderResourceView::UnderlyingResource)tex->GetUnderlying();
-                if (!sourceTexture) {
-                    throw ::Assets::Exceptions::PendingResource("", "Pending background upload of font texture");
-                }
-
-                ShaderResourceView shadRes(sourceTexture);
-                renderer->BindPS(RenderCore::MakeResourceList(shadRes));
+                BindFontTexture(*renderer, tex);
                 currentBoundTexture = tex;
             }
 
@@ -506,6 +522,46 @@ float   TextStyle::Draw(
     return x;
 }
 
+void    TextStyle::DrawBatch(
+    RenderCore::Metal::DeviceContext* renderer, 
+    const TextLayoutRequest requests[], size_t requestCount,
+    float scale, float depth) const
+{
+    if (!_font || !requestCount) {
+        return;
+    }
+
+    TRY {
+        std::vector<GlyphQuad> quads;
+        LayoutTextQuads(quads, *_font, _options, requests, requestCount, scale);
+        if (quads.empty()) {
+            return;
+        }
+
+        BindTextResources(*renderer);
+
+        const FontTexture2D *   currentBoundTexture = nullptr;
+        WorkingVertexSetPCT     workingVertices;
+        for (const auto& q:quads) {
+            if (q._texture != currentBoundTexture) {
+                Flush(*renderer, workingVertices);
+                BindFontTexture(*renderer, q._texture);
+                currentBoundTexture = q._texture;
+            }
+
+            if (!workingVertices.PushQuad(q._position, q._colorABGR, q._texCoords, depth)) {
+                Flush(*renderer, workingVertices);
+                workingVertices.PushQuad(q._position, q._colorABGR, q._texCoords, depth);
+            }
+        }
+
+        Flush(*renderer, workingVertices);
+
+    } CATCH(...) {
+        // OutputDebugString("Suppressed exception while drawing text");
+    } CATCH_END
+}
+
 static Float2 GetAlignPos(const Quad& q, const Float2& extent, UiAlign align)
 {
     Float2 pos;
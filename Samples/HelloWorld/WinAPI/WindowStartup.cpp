@@ -6,6 +6,7 @@
 
 #include "../../../PlatformRig/AllocationProfiler.h"
 #include "../../../ConsoleRig/Log.h"
+#include "../../../ConsoleRig/AsyncLog.h"
 #include "../../../Utility/Streams/PathUtils.h"
 #include "../../../Utility/Streams/FileUtils.h"
 #include "../../../Utility/SystemUtils.h"
@@ -68,6 +69,11 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         //  Note that we overwrite the log file every time, destroying previous data.
 	CreateDirectoryRecursive("int");
     ConsoleRig::Logging_Startup("log.cfg", "int/helloworldlog.txt");
+
+        //  Format & write the printf style log messages on a background thread, so
+        //  worker threads don't wait for the log file
+    ConsoleRig::AsyncLogger asyncLogger;
+
     LogInfo << "------------------------------------------------------------------------------------------";
 
     TRY {
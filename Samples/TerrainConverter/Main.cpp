@@ -183,7 +183,7 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     cfg.Save();
 
     ExecuteTerrainConversion(
-        cfg, std::make_shared<RenderCore::Assets::TerrainFormat>(),
+        cfg, std::make_shared<RenderCore::Assets::TerrainFormat>(true),
         TerrainConfig(), nullptr);
 
     return 0;
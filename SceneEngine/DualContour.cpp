@@ -7,6 +7,8 @@
 #include "DualContour.h"
 #include "../Math/Matrix.h"
 #include "../Math/Transformations.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/Threading/ParallelFor.h"
 #include "../Utility/PtrUtils.h"
 
 #pragma warning(disable:4714)
@@ -15,6 +17,9 @@
 #include <Eigen/Dense>
 #pragma pop_macro("new")
 
+#include <thread>
+#include <algorithm>
+
 #pragma warning(disable:4127)       // conditional expression is constant
 
 namespace SceneEngine
@@ -168,14 +173,17 @@ namespace SceneEngine
         ++gridElement._massPointCount;
     }
 
-    static Float3 CalculateCellPoint(const GridElement& gridElement, const Float3& gridElementSize)
+    static Float3 CalculateCellPoint(const GridElement& gridElement, const Float3& gridElementSize, bool legacyMassPoint = false)
     {
         Float3 massPoint = gridElement._massPointAccum / float(gridElement._massPointCount);
 
+            //  Older versions dropped the Z component of the mass point when solving (but
+            //  still added it back on to the result). The legacy DualContourMesh_Build
+            //  overload keeps that, so existing callers get the same mesh as before.
         Eigen::Matrix<float,3,1> massPointVec;
         massPointVec(0,0) = massPoint[0];
         massPointVec(1,0) = massPoint[1];
-        massPointVec(2,0) = 0.f;
+        massPointVec(2,0) = legacyMassPoint ? 0.f : massPoint[2];
 
         Eigen::Matrix<float,3,1> x;
 
@@ -320,242 +328,676 @@ namespace SceneEngine
         
     }
 
-    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
-                                                const IVolumeDensityFunction& fn)
+    static void MergeInGridElement(GridElement& dst, const GridElement& src, const Float3& srcOffset)
+    {
+            //  Merge the equations from "src" into "dst". This is used when collapsing
+            //  the cells of the octree. It's the same as MergeInEdgeIntersection, except
+            //  that we're merging in 4 rows at a time (including the residual row).
+            //  "srcOffset" is the center of "src" minus the center of "dst". The "src"
+            //  equations are relative to the "src" center, so we have to translate
+            //  them first:
+            //      Ahat * (x - srcOffset) = Bhat   ==>   Ahat * x = Bhat + Ahat * srcOffset
+        typedef Eigen::Matrix<float,8,4> Float8x4;
+        Float8x4 mat = Float8x4::Zero();
+
+        Float3 translatedBhat = src._Bhat + TransformDirectionVector(src._Ahat, srcOffset);
+        for (unsigned r=0; r<3; ++r) {
+            for (unsigned c=0; c<3; ++c) {
+                mat(r, c) = dst._Ahat(r, c);
+                mat(4+r, c) = src._Ahat(r, c);
+            }
+            mat(r, 3) = dst._Bhat[r];
+            mat(4+r, 3) = translatedBhat[r];
+        }
+        mat(3, 3) = dst._r;
+        mat(7, 3) = src._r;
+
+        Eigen::HouseholderQR<Float8x4> qr(mat);
+        Float8x4 R = qr.matrixQR().triangularView<Eigen::Upper>();
+
+        for (unsigned r=0; r<3; ++r) {
+            for (unsigned c=0; c<3; ++c) {
+                dst._Ahat(r, c) = R(r, c);
+            }
+            dst._Bhat[r] = R(r, 3);
+        }
+        dst._r = R(3, 3);
+
+        dst._massPointAccum += src._massPointAccum + float(src._massPointCount) * srcOffset;
+        dst._massPointCount += src._massPointCount;
+    }
+
+    static float CalculateCellError(const GridElement& gridElement, const Float3& cellPoint)
+    {
+            //  Sum of the squared distances from "cellPoint" (relative to the
+            //  grid element center) to the planes merged into the grid element.
+        Float3 residual = TransformDirectionVector(gridElement._Ahat, cellPoint) - gridElement._Bhat;
+        return MagnitudeSquared(residual) + gridElement._r * gridElement._r;
+    }
+
+    static bool IsManifoldCornerConfiguration(unsigned insideMask)
+    {
+            //  The surface through a cell is a single sheet if the corners that are
+            //  inside are all connected to each other by cell edges, and the corners
+            //  that are outside are also all connected.
+            //  Corner "c" is at (c&1, (c>>1)&1, (c>>2)&1).
+        for (unsigned s=0; s<2; ++s) {
+            unsigned set = s ? (~insideMask & 0xff) : insideMask;
+            if (!set) continue;
+
+            unsigned reached = set & (~set + 1);
+            for (;;) {
+                unsigned grown = reached;
+                for (unsigned c=0; c<8; ++c) {
+                    if (reached & (1<<c)) {
+                        grown |= ((1<<(c^1)) | (1<<(c^2)) | (1<<(c^4))) & set;
+                    }
+                }
+                if (grown == reached) break;
+                reached = grown;
+            }
+            if (reached != set) return false;
+        }
+        return true;
+    }
+
+    static bool CollapsePreservesTopology(
+        const float densityResults[], unsigned cornerDims,
+        const unsigned origin[3], unsigned size)
+    {
+            //  Test the signs at the corners, edge midpoints, face centers and the
+            //  center of a collapsing cell (a 3x3x3 grid of samples). Collapsing is
+            //  safe if the coarse cell is manifold, and every edge, face and the cell
+            //  itself agree with their corners (ie, if all of the corners of a face
+            //  are inside, the center of the face must be inside, too).
+            //  See "Dual Contouring of Hermite Data" (Ju, Losasso, Schaefer & Warren).
+        const unsigned half = size/2;
+        bool inside[27];
+        for (unsigned s=0; s<27; ++s) {
+            unsigned x = origin[0] + (s%3) * half;
+            unsigned y = origin[1] + ((s/3)%3) * half;
+            unsigned z = origin[2] + (s/9) * half;
+            inside[s] = densityResults[(z * cornerDims + y) * cornerDims + x] < 0.f;
+        }
+
+        unsigned cornerMask = 0;
+        for (unsigned c=0; c<8; ++c) {
+            if (inside[(c&1)*2 + ((c>>1)&1)*6 + ((c>>2)&1)*18]) {
+                cornerMask |= 1<<c;
+            }
+        }
+        if (!IsManifoldCornerConfiguration(cornerMask)) return false;
+
+        for (unsigned s=0; s<27; ++s) {
+            unsigned ijk[] = { s%3, (s/3)%3, s/9 };
+            bool anyInside = false, anyOutside = false;
+            for (unsigned c=0; c<8; ++c) {
+                    //  The corners of the edge/face/cell this sample is the middle of
+                    //  are found by replacing each "1" coordinate with 0 or 2.
+                unsigned corner = 0, scale = 1;
+                bool valid = true;
+                for (unsigned a=0; a<3; ++a, scale*=3) {
+                    unsigned bit = (c>>a)&1;
+                    if (ijk[a] == 1) {
+                        corner += bit * 2 * scale;
+                    } else if (bit) {
+                        valid = false;
+                        break;
+                    } else {
+                        corner += ijk[a] * scale;
+                    }
+                }
+                if (!valid) continue;
+                if (inside[corner]) { anyInside = true; } else { anyOutside = true; }
+            }
+            if (anyInside != anyOutside && anyInside != inside[s]) return false;
+        }
+
+        return true;
+    }
+
+    static uint64 SpreadBits3(uint64 x)
+    {
+        x &= 0x1fffff;
+        x = (x | x << 32) & 0x1f00000000ffffull;
+        x = (x | x << 16) & 0x1f0000ff0000ffull;
+        x = (x | x << 8)  & 0x100f00f00f00f00full;
+        x = (x | x << 4)  & 0x10c30c30c30c30c3ull;
+        x = (x | x << 2)  & 0x1249249249249249ull;
+        return x;
+    }
+
+    static unsigned CompactBits3(uint64 x)
+    {
+        x &= 0x1249249249249249ull;
+        x = (x ^ (x >> 2))  & 0x10c30c30c30c30c3ull;
+        x = (x ^ (x >> 4))  & 0x100f00f00f00f00full;
+        x = (x ^ (x >> 8))  & 0x1f0000ff0000ffull;
+        x = (x ^ (x >> 16)) & 0x1f00000000ffffull;
+        x = (x ^ (x >> 32)) & 0x1fffff;
+        return unsigned(x);
+    }
+
+        //  Cells are identified by the morton code of their grid coordinates. This way,
+        //  the 8 children of an octree node are always adjacent when sorted, and the
+        //  code for the parent is just the child code >> 3.
+    static uint64 CellCode(unsigned x, unsigned y, unsigned z)
+    {
+        return SpreadBits3(x) | (SpreadBits3(y) << 1) | (SpreadBits3(z) << 2);
+    }
+
+    static void CellCoords(unsigned result[3], uint64 code)
+    {
+        result[0] = CompactBits3(code);
+        result[1] = CompactBits3(code >> 1);
+        result[2] = CompactBits3(code >> 2);
+    }
+
+    class CellContribution
+    {
+    public:
+        uint64              _cellCode;
+        EdgeIntersection    _intersection;
+
+        CellContribution(uint64 cellCode, const EdgeIntersection& intersection)
+            : _cellCode(cellCode), _intersection(intersection) {}
+    };
+
+    class DualContourCell
+    {
+    public:
+        uint64      _code;          // CellCode() of the cell coordinates at this octree level
+        GridElement _qef;
+        Float3      _pt;            // (world space; only valid for leaves & collapsed cells)
+        unsigned    _parent;        // index into the next level up
+        unsigned    _vertex;
+        bool        _collapsible;   // surface is a single sheet, and (for non-leaves) the cell has its own vertex
+
+        DualContourCell() : _code(0), _pt(Zero<Float3>()), _parent(~0u), _vertex(~0u), _collapsible(false) {}
+    };
+
+    static DualContourMesh BuildMesh(
+        const DualContourBuildSettings& settings, const IVolumeDensityFunction& fn,
+        bool legacyMassPoint)
     {
             //  Build a mesh of triangles from the given input function
             //      (using dual contouring method)
             //
-            //  First we'll build a grid containing information for each
-            //  voxel. Then we'll go through a calculate the QEF's at
-            //  each grid point -- that will give us enough information
-            //  to generate the triangles needed. Note that the algorithm
-            //  should naturally build quads most of the time. They'll need
-            //  to be split up into triangles.
+            //  First we'll sample the density function at the corners of
+            //  a grid. Then we find the edges of the grid that cross the surface,
+            //  and build the QEF's for the cells around those edges -- that will give
+            //  us enough information to generate the triangles needed. Note that
+            //  the algorithm should naturally build quads most of the time. They'll
+            //  need to be split up into triangles.
             //
-            //  Ideally, we would also do simplification before we calculate
-            //  the QEF's and generate the triangles. But currently, no
-            //  simplification.
-        auto boundary = fn.GetBoundary();
-        auto gridElements = std::make_unique<GridElement[]>(
-            samplingGridDimensions*samplingGridDimensions*samplingGridDimensions);
-
-            //  For each grid element, let's fill it in with the values from the
-            //  density function. Note that we could reduce the work here slightly
-            //  by finding a point within the grid that lies on the surface, and
-            //  then marching along the surface, into each new grid that takes us.
-            //
-            //  The current method will create many redundant tests of the volume
-            //  function -- because most grids are probably not on the surface of the 
-            //  volume.
+            //  Only the cells that touch the surface are stored -- in a list sorted by
+            //  morton code. That list is the bottom of an octree, and we can collapse
+            //  octree nodes to simplify the mesh.
             //
-            //  Let's find and test each edge. When we find a edge that crosses the 
-            //  boundary, we can merge that into the QEF's for that adjacent grid
-            //  elements.
-            //
-            //  It's a good idea to calculate the density results at each corner first
-            //  This will help reduce the number of times we need to call the
-            //  GetDensity() function.
+            //  Every stage is split into independent jobs (usually z slabs of the grid)
+            //  and spread across threads. The results are always combined in the same
+            //  order, so the output doesn't depend on the thread count.
+        const unsigned dims = settings._samplingGridDimensions;
+        if (!dims) { return DualContourMesh(); }
+        assert(dims < (1u<<21));    // (limit of CellCode())
+
+        unsigned threadCount = settings._threadCount;
+        if (!threadCount) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+
+        auto boundary = fn.GetBoundary();
 
         Float3x4 gridToSampleSpace = Zero<Float3x4>();
-        gridToSampleSpace(0,0) = (boundary.second[0] - boundary.first[0]) / float(samplingGridDimensions);
-        gridToSampleSpace(1,1) = (boundary.second[1] - boundary.first[1]) / float(samplingGridDimensions);
-        gridToSampleSpace(2,2) = (boundary.second[2] - boundary.first[2]) / float(samplingGridDimensions);
+        gridToSampleSpace(0,0) = (boundary.second[0] - boundary.first[0]) / float(dims);
+        gridToSampleSpace(1,1) = (boundary.second[1] - boundary.first[1]) / float(dims);
+        gridToSampleSpace(2,2) = (boundary.second[2] - boundary.first[2]) / float(dims);
         gridToSampleSpace(0,3) = boundary.first[0];
         gridToSampleSpace(1,3) = boundary.first[1];
         gridToSampleSpace(2,3) = boundary.first[2];
-        
-        auto densityResults = std::make_unique<float[]>(
-            (samplingGridDimensions+1)*(samplingGridDimensions+1)*(samplingGridDimensions+1));
-        for (int z=0; z<int(samplingGridDimensions+1); ++z)
-            for (int y=0; y<int(samplingGridDimensions+1); ++y)
-                for (int x=0; x<int(samplingGridDimensions+1); ++x) {
-                    Float3 p0 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z)));
-                    densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x] = fn.GetDensity(p0);
+
+        const auto cellSize = Float3(
+            (boundary.second[0] - boundary.first[0]) / float(dims),
+            (boundary.second[1] - boundary.first[1]) / float(dims),
+            (boundary.second[2] - boundary.first[2]) / float(dims));
+
+            //  Center of the cell at "coords" in the given octree level (level 0 are
+            //  the grid cells)
+        auto cellCenter = [&](const unsigned coords[3], unsigned level) -> Float3 {
+            float halfSize = .5f * float(1u<<level);
+            return Float3(
+                LinearInterpolate(boundary.first[0], boundary.second[0], (float(coords[0]<<level) + halfSize) / float(dims)),
+                LinearInterpolate(boundary.first[1], boundary.second[1], (float(coords[1]<<level) + halfSize) / float(dims)),
+                LinearInterpolate(boundary.first[2], boundary.second[2], (float(coords[2]<<level) + halfSize) / float(dims)));
+        };
+
+            //  Sparse sampling --
+            //  The grid is divided into blocks. For each block, we sample the density at
+            //  the block corners and center. If all of those samples are on the same side
+            //  of the surface, and the center density is further from zero than the density
+            //  can change within the block, then the surface can't pass through the block,
+            //  and we don't need to sample the rest of it.
+            //
+            //  If the caller gives us the maximum density gradient, this test is conservative.
+            //  Otherwise we estimate the gradient from the samples (with some safety margin).
+            //  That's only a heuristic -- a small feature that passes between the samples
+            //  can be missed.
+        const unsigned cornerDims = dims+1;
+        const unsigned blockSize = settings._sparseBlockSize;
+        const unsigned blockDims = blockSize ? ((dims + blockSize - 1) / blockSize) : 0;
+        std::vector<uint8> blockActive(blockDims*blockDims*blockDims, uint8(1));
+        std::vector<float> blockDensity(blockDims*blockDims*blockDims, 0.f);
+
+        if (blockSize) {
+            const float estimatedGradientSafetyFactor = 2.f;
+            auto classifyBlocks = [&](unsigned bz) {
+                for (unsigned by=0; by<blockDims; ++by) {
+                    for (unsigned bx=0; bx<blockDims; ++bx) {
+                        unsigned mins[] = { bx*blockSize, by*blockSize, bz*blockSize };
+                        unsigned maxs[] = {
+                            std::min(mins[0] + blockSize, dims),
+                            std::min(mins[1] + blockSize, dims),
+                            std::min(mins[2] + blockSize, dims) };
+
+                        auto minPt = TransformPoint(gridToSampleSpace, Float3(float(mins[0]), float(mins[1]), float(mins[2])));
+                        auto maxPt = TransformPoint(gridToSampleSpace, Float3(float(maxs[0]), float(maxs[1]), float(maxs[2])));
+                        float centerDensity = fn.GetDensity(LinearInterpolate(minPt, maxPt, .5f));
+
+                        bool sameSide = true;
+                        float maxDifference = 0.f;
+                        for (unsigned c=0; c<8; ++c) {
+                            float d = fn.GetDensity(Float3(
+                                (c&1) ? maxPt[0] : minPt[0],
+                                (c&2) ? maxPt[1] : minPt[1],
+                                (c&4) ? maxPt[2] : minPt[2]));
+                            sameSide &= (d < 0.f) == (centerDensity < 0.f);
+                            maxDifference = std::max(maxDifference, XlAbs(d - centerDensity));
+                        }
+
+                        float maxChange = (settings._densityGradientLimit > 0.f)
+                            ? (settings._densityGradientLimit * .5f * Magnitude(maxPt - minPt))
+                            : (estimatedGradientSafetyFactor * maxDifference);
+
+                        auto index = (bz * blockDims + by) * blockDims + bx;
+                        blockActive[index] = uint8(!(sameSide && XlAbs(centerDensity) > maxChange));
+                        blockDensity[index] = centerDensity;
+                    }
                 }
+            };
+            Threading::ParallelFor(threadCount, blockDims, classifyBlocks);
+        }
+
+            //  Calculate the density results at each grid corner first. This will
+            //  help reduce the number of times we need to call the GetDensity() function.
+            //  Corners that only touch empty blocks get the block center density (which
+            //  has the right sign).
+        auto densityResults = std::make_unique<float[]>(cornerDims*cornerDims*cornerDims);
+        auto sampleSlice = [&](unsigned z) {
+            for (unsigned y=0; y<cornerDims; ++y) {
+                for (unsigned x=0; x<cornerDims; ++x) {
+                    auto& result = densityResults[(z * cornerDims + y) * cornerDims + x];
+                    if (blockSize) {
+                        unsigned b[] = {
+                            std::min(x/blockSize, blockDims-1),
+                            std::min(y/blockSize, blockDims-1),
+                            std::min(z/blockSize, blockDims-1) };
+                        unsigned c[] = { x, y, z };
+
+                            //  a corner on a block boundary touches up to 8 blocks
+                        bool active = false;
+                        for (unsigned n=0; n<8 && !active; ++n) {
+                            unsigned nb[3];
+                            bool valid = true;
+                            for (unsigned a=0; a<3; ++a) {
+                                nb[a] = b[a];
+                                if ((n>>a)&1) {
+                                    if (!b[a] || c[a] != b[a] * blockSize) { valid = false; break; }
+                                    --nb[a];
+                                }
+                            }
+                            active = valid && blockActive[(nb[2] * blockDims + nb[1]) * blockDims + nb[0]];
+                        }
 
-            // note --  The order of the cell offsets here is important, because it 
-            //          determines the order of the vertices in the quad. We 
+                        if (!active) {
+                            result = blockDensity[(b[2] * blockDims + b[1]) * blockDims + b[0]];
+                            continue;
+                        }
+                    }
+
+                    result = fn.GetDensity(TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z))));
+                }
+            }
+        };
+        Threading::ParallelFor(threadCount, cornerDims, sampleSlice);
+
+            //  For each grid corner, we're going to test 3 edges (in the +X, +Y & +Z
+            //  directions). Each edge that crosses the surface contributes an edge
+            //  intersection to the 4 cells around it.
+            //  Some edges on the extreme positive boundary of the sampling area will
+            //  never be tested. We'll assume that the function doesn't go through these
+            //  boundary edges.
+            //
+            // note --  The order of the cell offsets here is important, because it
+            //          determines the order of the vertices in the quad. We
         Int3 cellOffsetsX[] = { Int3(0, 0, 0), Int3(0, -1, 0), Int3(0, 0, -1), Int3(0, -1, -1) };
         Int3 cellOffsetsY[] = { Int3(0, 0, 0), Int3(-1, 0, 0), Int3(0, 0, -1), Int3(-1, 0, -1) };
         Int3 cellOffsetsZ[] = { Int3(0, 0, 0), Int3(-1, 0, 0), Int3(0, -1, 0), Int3(-1, -1, 0) };
-
-        for (int z=0; z<int(samplingGridDimensions); ++z) {
-            for (int y=0; y<int(samplingGridDimensions); ++y) {
-                for (int x=0; x<int(samplingGridDimensions); ++x) {
-
-                        //  For each grid element, we're going to test 3 edges.
-                        //  we'll add the effect of those edges to adjacent grids
-                        //  as well. This means each edges gets tested once.
-                        //  However, some edges on the extreme positive boundary
-                        //  of the sampling area will never be tested. We'll assume 
-                        //  that the function doesn't go through these boundary edges.
-
-                    Float3 p0 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z)));
-                    Float3 p1 = TransformPoint(gridToSampleSpace, Float3(float(x+1), float(y), float(z)));
-                    Float3 p2 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y+1), float(z)));
-                    Float3 p3 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z+1)));
-
-                    float d0 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-                    float d1 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x + 1];
-                    float d2 = densityResults[(z * (samplingGridDimensions+1) + y + 1) * (samplingGridDimensions+1) + x];
-                    float d3 = densityResults[((z + 1) * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-
-                        //  Look for edges that contain intersections with the surface, and then merge 
-                        //  those edge into all of the grid cells that contain them.
-                        //  Note that TestEdge() will do extra calls to GetDensity to improve the 
+        const Int3* cellOffsets[] = { cellOffsetsX, cellOffsetsY, cellOffsetsZ };
+
+        std::vector<std::vector<CellContribution>> slabContributions(dims);
+        auto findIntersections = [&](unsigned z) {
+            auto& contributions = slabContributions[z];
+            for (unsigned y=0; y<dims; ++y) {
+                for (unsigned x=0; x<dims; ++x) {
+                    float d[] = {
+                        densityResults[(z * cornerDims + y) * cornerDims + x],
+                        densityResults[(z * cornerDims + y) * cornerDims + x + 1],
+                        densityResults[(z * cornerDims + y + 1) * cornerDims + x],
+                        densityResults[((z + 1) * cornerDims + y) * cornerDims + x]
+                    };
+
+                        //  Note that TestEdge() will do extra calls to GetDensity to improve the
                         //  intersection point.
-                    
-                    if ((d0 < 0.f) != (d1 < 0.f)) {
-                        auto intersection = TestEdge(p0, p1, d0, d1, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsX); ++c) {
-                            Int3 g(x + cellOffsetsX[c][0], y + cellOffsetsX[c][1], z + cellOffsetsX[c][2]);
+                    for (unsigned e=0; e<3; ++e) {
+                        if ((d[0] < 0.f) == (d[e+1] < 0.f)) continue;
+
+                        Float3 p0 = TransformPoint(gridToSampleSpace, Float3(float(x), float(y), float(z)));
+                        Float3 p1 = TransformPoint(gridToSampleSpace, Float3(float(x + (e==0)), float(y + (e==1)), float(z + (e==2))));
+                        auto intersection = TestEdge(p0, p1, d[0], d[e+1], fn);
+                        for (unsigned c=0; c<4; ++c) {
+                            Int3 g(int(x) + cellOffsets[e][c][0], int(y) + cellOffsets[e][c][1], int(z) + cellOffsets[e][c][2]);
                             if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
+                                contributions.push_back(CellContribution(CellCode(g[0], g[1], g[2]), intersection));
                             }
                         }
                     }
+                }
+            }
+        };
+        Threading::ParallelFor(threadCount, dims, findIntersections);
+
+        std::vector<CellContribution> contributions;
+        {
+            size_t total = 0;
+            for (const auto& s:slabContributions) total += s.size();
+            contributions.reserve(total);
+            for (auto& s:slabContributions) {
+                contributions.insert(contributions.end(), s.begin(), s.end());
+                std::vector<CellContribution>().swap(s);
+            }
+        }
 
-                    if ((d0 < 0.f) != (d2 < 0.f)) {
-                        auto intersection = TestEdge(p0, p2, d0, d2, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsY); ++c) {
-                            Int3 g(x + cellOffsetsY[c][0], y + cellOffsetsY[c][1], z + cellOffsetsY[c][2]);
-                            if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
-                            }
-                        }
+            //  Sorting by cell brings together all of the contributions for each cell.
+            //  It's a stable sort, so they get merged in the same order as a single
+            //  threaded pass through the grid.
+        std::stable_sort(
+            contributions.begin(), contributions.end(),
+            [](const CellContribution& lhs, const CellContribution& rhs) { return lhs._cellCode < rhs._cellCode; });
+
+        std::vector<std::vector<DualContourCell>> levels;
+        levels.reserve(settings._maxSimplificationLevels+1);
+        levels.push_back(std::vector<DualContourCell>());
+
+        std::vector<size_t> contributionStarts;
+        {
+            auto& leaves = levels[0];
+            for (size_t c=0; c<contributions.size(); ++c) {
+                if (!c || contributions[c]._cellCode != contributions[c-1]._cellCode) {
+                    DualContourCell cell;
+                    cell._code = contributions[c]._cellCode;
+                    leaves.push_back(cell);
+                    contributionStarts.push_back(c);
+                }
+            }
+            contributionStarts.push_back(contributions.size());
+        }
+
+            //  Now calculate the QEF & the point for each cell that touches the
+            //  surface.
+        const unsigned cellsPerJob = 256;
+        {
+            auto& leaves = levels[0];
+            auto buildLeaves = [&](unsigned job) {
+                auto end = std::min(size_t(job+1) * cellsPerJob, leaves.size());
+                for (auto l=size_t(job) * cellsPerJob; l<end; ++l) {
+                    auto& cell = leaves[l];
+                    unsigned coords[3];
+                    CellCoords(coords, cell._code);
+                    auto center = cellCenter(coords, 0);
+                    for (auto c=contributionStarts[l]; c<contributionStarts[l+1]; ++c) {
+                        MergeInEdgeIntersection(cell._qef, contributions[c]._intersection, center);
                     }
+                    cell._pt = CalculateCellPoint(cell._qef, cellSize, legacyMassPoint) + center;
 
-                    if ((d0 < 0.f) != (d3 < 0.f)) {
-                        auto intersection = TestEdge(p0, p3, d0, d3, fn);
-                        for (unsigned c=0; c<dimof(cellOffsetsZ); ++c) {
-                            Int3 g(x + cellOffsetsZ[c][0], y + cellOffsetsZ[c][1], z + cellOffsetsZ[c][2]);
-                            if (g[0] >= 0 && g[1] >= 0 && g[2] >= 0) {
-                                const auto cellCenter = Float3(
-                                    LinearInterpolate(boundary.first[0], boundary.second[0], (float(g[0]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[1], boundary.second[1], (float(g[1]) + .5f) / float(samplingGridDimensions)),
-                                    LinearInterpolate(boundary.first[2], boundary.second[2], (float(g[2]) + .5f) / float(samplingGridDimensions)));
-
-                                MergeInEdgeIntersection(
-                                    gridElements[(g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0]],
-                                    intersection, cellCenter);
-                            }
+                    unsigned cornerMask = 0;
+                    for (unsigned c=0; c<8; ++c) {
+                        auto x = coords[0] + (c&1), y = coords[1] + ((c>>1)&1), z = coords[2] + ((c>>2)&1);
+                        if (densityResults[(z * cornerDims + y) * cornerDims + x] < 0.f) {
+                            cornerMask |= 1<<c;
                         }
                     }
+                    cell._collapsible = IsManifoldCornerConfiguration(cornerMask);
+                }
+            };
+            Threading::ParallelFor(threadCount, unsigned((leaves.size() + cellsPerJob - 1) / cellsPerJob), buildLeaves);
+        }
+        std::vector<CellContribution>().swap(contributions);
+
+            //  Octree simplification --
+            //  Working up from the leaves, try to collapse each group of 8 siblings
+            //  into their parent. The parent gets its own vertex if all of the children
+            //  that touch the surface were collapsible, the collapse doesn't change the
+            //  topology of the surface, and the merged QEF has a small error. Children
+            //  that don't touch the surface don't exist in the lists.
+        const bool simplify = settings._simplificationThreshold >= 0.f;
+        if (simplify) {
+            for (unsigned level=1; level<=settings._maxSimplificationLevels && (1u<<level)<=dims; ++level) {
+                auto& children = levels[level-1];
+                std::vector<DualContourCell> parents;
+                std::vector<size_t> childStarts;
+                for (size_t c=0; c<children.size(); ++c) {
+                    if (!c || (children[c]._code>>3) != (children[c-1]._code>>3)) {
+                        DualContourCell parent;
+                        parent._code = children[c]._code>>3;
+                        parents.push_back(parent);
+                        childStarts.push_back(c);
+                    }
+                    children[c]._parent = unsigned(parents.size()-1);
+                }
+                childStarts.push_back(children.size());
+
+                const unsigned size = 1u<<level;
+                auto collapse = [&](unsigned job) {
+                    auto end = std::min(size_t(job+1) * cellsPerJob, parents.size());
+                    for (auto p=size_t(job) * cellsPerJob; p<end; ++p) {
+                        auto& parent = parents[p];
+                        unsigned coords[3];
+                        CellCoords(coords, parent._code);
+                        unsigned origin[] = { coords[0]*size, coords[1]*size, coords[2]*size };
+                        if ((origin[0]+size) > dims || (origin[1]+size) > dims || (origin[2]+size) > dims) continue;
+
+                        bool childrenCollapsible = true;
+                        for (auto c=childStarts[p]; c<childStarts[p+1]; ++c) {
+                            childrenCollapsible &= children[c]._collapsible;
+                        }
+                        if (!childrenCollapsible) continue;
+                        if (!CollapsePreservesTopology(densityResults.get(), cornerDims, origin, size)) continue;
+
+                        auto center = cellCenter(coords, level);
+                        for (auto c=childStarts[p]; c<childStarts[p+1]; ++c) {
+                            unsigned childCoords[3];
+                            CellCoords(childCoords, children[c]._code);
+                            MergeInGridElement(parent._qef, children[c]._qef, cellCenter(childCoords, level-1) - center);
+                        }
 
+                            //  Reject points outside of the cell -- that usually means there's
+                            //  too much curvature to represent with a single vertex.
+                        Float3 parentSize = float(size) * cellSize;
+                        auto pt = CalculateCellPoint(parent._qef, parentSize);
+                        if (    XlAbs(pt[0]) > .5f * parentSize[0]
+                            ||  XlAbs(pt[1]) > .5f * parentSize[1]
+                            ||  XlAbs(pt[2]) > .5f * parentSize[2]) continue;
+                        if (CalculateCellError(parent._qef, pt) > settings._simplificationThreshold) continue;
+
+                        parent._pt = pt + center;
+                        parent._collapsible = true;
+                    }
+                };
+                Threading::ParallelFor(threadCount, unsigned((parents.size() + cellsPerJob - 1) / cellsPerJob), collapse);
+
+                bool anyCollapsed = false;
+                for (const auto& p:parents) anyCollapsed |= p._collapsible;
+                if (!anyCollapsed) {
+                    for (auto& c:children) c._parent = ~0u;
+                    break;
                 }
+                levels.push_back(std::move(parents));
             }
         }
 
-            //  Now, we've calculated the error functions for all of the grid elements.
-            //  For each grid element, we can calculate the appropriate point for that
-            //  element. Let's make sure we do this only one per grid element (because
-            //  typically each vertex will be used in multiple quads.
-
-        const auto cellSize = Float3(
-            (boundary.second[0] - boundary.first[0]) / float(samplingGridDimensions),
-            (boundary.second[1] - boundary.first[1]) / float(samplingGridDimensions),
-            (boundary.second[2] - boundary.first[2]) / float(samplingGridDimensions));
+            //  Assign vertices from the top of the octree down. Each cell uses the
+            //  vertex of its highest collapsed ancestor, or otherwise its own vertex.
+            //  The leaves are visited in grid order (rather than morton order), so
+            //  without simplification the vertices are in the same order as earlier
+            //  versions.
+        std::vector<unsigned> leafOrder(levels[0].size());
+        for (unsigned c=0; c<unsigned(leafOrder.size()); ++c) leafOrder[c] = c;
+        {
+            std::vector<uint64> gridIndices(levels[0].size());
+            for (size_t c=0; c<levels[0].size(); ++c) {
+                unsigned coords[3];
+                CellCoords(coords, levels[0][c]._code);
+                gridIndices[c] = (uint64(coords[2]) * dims + coords[1]) * dims + coords[0];
+            }
+            std::sort(leafOrder.begin(), leafOrder.end(),
+                [&](unsigned lhs, unsigned rhs) { return gridIndices[lhs] < gridIndices[rhs]; });
+        }
 
-        std::vector<DualContourMesh::Vertex> vertices;
-        auto vertexIndices = std::make_unique<unsigned[]>(
-            samplingGridDimensions*samplingGridDimensions*samplingGridDimensions);
-        for (int z=0; z<int(samplingGridDimensions); ++z) {
-            for (int y=0; y<int(samplingGridDimensions); ++y) {
-                for (int x=0; x<int(samplingGridDimensions); ++x) {
-                    auto index = (z * samplingGridDimensions + y) * samplingGridDimensions + x;
-                    const auto& g = gridElements[index];
-                    if (!g._massPointCount) {
-                        vertexIndices[index] = 0xffffffff;
+        std::vector<const DualContourCell*> vertexCells;
+        for (auto level=levels.size(); level-->0;) {
+            for (size_t c=0; c<levels[level].size(); ++c) {
+                auto& cell = levels[level][level ? c : leafOrder[c]];
+                if (cell._parent != ~0u) {
+                    auto parentVertex = levels[level+1][cell._parent]._vertex;
+                    if (parentVertex != ~0u) {
+                        cell._vertex = parentVertex;
                         continue;
                     }
-
-                    const auto cellCenter = Float3(
-                        LinearInterpolate(boundary.first[0], boundary.second[0], (float(x) + .5f) / float(samplingGridDimensions)),
-                        LinearInterpolate(boundary.first[1], boundary.second[1], (float(y) + .5f) / float(samplingGridDimensions)),
-                        LinearInterpolate(boundary.first[2], boundary.second[2], (float(z) + .5f) / float(samplingGridDimensions)));
-                    auto pt = CalculateCellPoint(g, cellSize) + cellCenter;
-
-                        //  We need the normal at this location, also.
-                        //  We've lost the locations of the edge intersections -- so we can't
-                        //  just add together the normals from them. However. We can 
-                        //  query the density field again to get the normal at this location.
-                    auto normal = fn.GetNormal(pt);
-                    vertices.push_back(DualContourMesh::Vertex(pt, normal));
-                    vertexIndices[index] = unsigned(vertices.size()-1);
+                }
+                if (!level || cell._collapsible) {
+                    cell._vertex = unsigned(vertexCells.size());
+                    vertexCells.push_back(&cell);
                 }
             }
         }
 
-            //  We just need to calculate the triangles. 
-            //  For each edge with an intersection, we want to create a quad.
-            //  we start at one here, because the edge cells have nothing to join
-            //  on to.
+            //  We need the normal at each vertex, also. We've lost the locations of
+            //  the edge intersections -- so we can't just add together the normals
+            //  from them. However, we can query the density field again to get the
+            //  normal at this location.
+        std::vector<Float3> normals(vertexCells.size());
+        auto calculateNormals = [&](unsigned job) {
+            auto end = std::min(size_t(job+1) * cellsPerJob, vertexCells.size());
+            for (auto v=size_t(job) * cellsPerJob; v<end; ++v) {
+                normals[v] = fn.GetNormal(vertexCells[v]->_pt);
+            }
+        };
+        Threading::ParallelFor(threadCount, unsigned((vertexCells.size() + cellsPerJob - 1) / cellsPerJob), calculateNormals);
 
-        std::vector<DualContourMesh::Quad> quads;
-        for (int z=1; z<int(samplingGridDimensions); ++z) {
-            for (int y=1; y<int(samplingGridDimensions); ++y) {
-                for (int x=1; x<int(samplingGridDimensions); ++x) {
-
-                    float d0 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-                    float d1 = densityResults[(z * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x + 1];
-                    float d2 = densityResults[(z * (samplingGridDimensions+1) + y + 1) * (samplingGridDimensions+1) + x];
-                    float d3 = densityResults[((z + 1) * (samplingGridDimensions+1) + y) * (samplingGridDimensions+1) + x];
-
-                        //  If the edge has a intersection point. We want to create a 
-                        //  quad by joining together all of the cells that use this edge.
-                    if ((d0 < 0.f) != (d1 < 0.f)) {
-                        DualContourMesh::Quad q;
-                        for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsX[c][0], y + cellOffsetsX[c][1], z + cellOffsetsX[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
-                            assert(q._verts[c] < vertices.size());
-                        }
-                        CheckWindingOrder(q, vertices);
-                        quads.push_back(q);
-                    }
+        std::vector<DualContourMesh::Vertex> vertices;
+        vertices.reserve(vertexCells.size());
+        for (size_t v=0; v<vertexCells.size(); ++v) {
+            vertices.push_back(DualContourMesh::Vertex(vertexCells[v]->_pt, normals[v]));
+        }
+
+            //  We just need to calculate the triangles.
+            //  For each edge with an intersection, we want to create a quad by joining
+            //  together all of the cells that use this edge. We start at one here,
+            //  because the edge cells have nothing to join on to.
+            //  When cells have been collapsed, some quads will collapse to lines
+            //  or points (and can be dropped), and others will be duplicated.
+        const auto& leaves = levels[0];
+        auto leafVertex = [&](const Int3& g) -> unsigned {
+            auto code = CellCode(g[0], g[1], g[2]);
+            auto i = std::lower_bound(
+                leaves.begin(), leaves.end(), code,
+                [](const DualContourCell& lhs, uint64 rhs) { return lhs._code < rhs; });
+            assert(i != leaves.end() && i->_code == code);
+            return i->_vertex;
+        };
+
+        std::vector<std::vector<DualContourMesh::Quad>> slabQuads(dims);
+        auto buildQuads = [&](unsigned z) {
+            if (!z) return;
+            auto& quads = slabQuads[z];
+            for (unsigned y=1; y<dims; ++y) {
+                for (unsigned x=1; x<dims; ++x) {
+                    float d[] = {
+                        densityResults[(z * cornerDims + y) * cornerDims + x],
+                        densityResults[(z * cornerDims + y) * cornerDims + x + 1],
+                        densityResults[(z * cornerDims + y + 1) * cornerDims + x],
+                        densityResults[((z + 1) * cornerDims + y) * cornerDims + x]
+                    };
+
+                    for (unsigned e=0; e<3; ++e) {
+                        if ((d[0] < 0.f) == (d[e+1] < 0.f)) continue;
 
-                    if ((d0 < 0.f) != (d2 < 0.f)) {
                         DualContourMesh::Quad q;
                         for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsY[c][0], y + cellOffsetsY[c][1], z + cellOffsetsY[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
+                            q._verts[c] = leafVertex(Int3(int(x) + cellOffsets[e][c][0], int(y) + cellOffsets[e][c][1], int(z) + cellOffsets[e][c][2]));
                             assert(q._verts[c] < vertices.size());
                         }
-                        CheckWindingOrder(q, vertices);
-                        quads.push_back(q);
-                    }
 
-                    if ((d0 < 0.f) != (d3 < 0.f)) {
-                        DualContourMesh::Quad q;
-                        for (unsigned c=0; c<4; ++c) {
-                            Int3 g(x + cellOffsetsZ[c][0], y + cellOffsetsZ[c][1], z + cellOffsetsZ[c][2]);
-                            auto index = (g[2] * samplingGridDimensions + g[1]) * samplingGridDimensions + g[0];
-                            q._verts[c] = vertexIndices[index];
-                            assert(q._verts[c] < vertices.size());
+                        if (simplify) {
+                            unsigned uniqueCount = 1;
+                            for (unsigned c=1; c<4; ++c) {
+                                bool unique = true;
+                                for (unsigned c2=0; c2<c; ++c2) unique &= q._verts[c] != q._verts[c2];
+                                uniqueCount += unsigned(unique);
+                            }
+                            if (uniqueCount < 3) continue;
                         }
+
                         CheckWindingOrder(q, vertices);
                         quads.push_back(q);
                     }
+                }
+            }
+        };
+        Threading::ParallelFor(threadCount, dims, buildQuads);
 
+        std::vector<DualContourMesh::Quad> quads;
+        for (const auto& s:slabQuads) {
+            quads.insert(quads.end(), s.begin(), s.end());
+        }
+
+        if (simplify && !quads.empty()) {
+                //  Remove duplicated quads (keeping the first of each)
+            std::vector<DualContourMesh::Quad> sortedVerts(quads);
+            for (auto& q:sortedVerts) std::sort(q._verts, &q._verts[4]);
+
+            std::vector<unsigned> order(quads.size());
+            for (unsigned c=0; c<unsigned(quads.size()); ++c) order[c] = c;
+            std::sort(order.begin(), order.end(),
+                [&](unsigned lhs, unsigned rhs) -> bool {
+                    auto& l = sortedVerts[lhs]._verts; auto& r = sortedVerts[rhs]._verts;
+                    if (std::lexicographical_compare(l, &l[4], r, &r[4])) return true;
+                    if (std::lexicographical_compare(r, &r[4], l, &l[4])) return false;
+                    return lhs < rhs;
+                });
+
+            std::vector<uint8> keep(quads.size(), uint8(1));
+            for (size_t c=1; c<order.size(); ++c) {
+                if (std::equal(sortedVerts[order[c]]._verts, &sortedVerts[order[c]]._verts[4], sortedVerts[order[c-1]]._verts)) {
+                    keep[order[c]] = 0;
                 }
             }
+
+            size_t dst = 0;
+            for (size_t c=0; c<quads.size(); ++c) {
+                if (keep[c]) quads[dst++] = quads[c];
+            }
+            quads.erase(quads.begin() + dst, quads.end());
         }
 
         DualContourMesh mesh;
@@ -564,6 +1006,29 @@ namespace SceneEngine
         return mesh;
     }
 
+    DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions,
+                                                const IVolumeDensityFunction& fn)
+    {
+        DualContourBuildSettings settings(samplingGridDimensions);
+        settings._sparseBlockSize = 0;
+        settings._simplificationThreshold = -1.f;
+        return BuildMesh(settings, fn, true);
+    }
+
+    DualContourMesh     DualContourMesh_Build(  const DualContourBuildSettings& settings,
+                                                const IVolumeDensityFunction& fn)
+    {
+        return BuildMesh(settings, fn, false);
+    }
+
+    DualContourBuildSettings::DualContourBuildSettings(unsigned samplingGridDimensions)
+    : _samplingGridDimensions(samplingGridDimensions)
+    , _threadCount(0)
+    , _sparseBlockSize(8)
+    , _densityGradientLimit(0.f)
+    , _simplificationThreshold(-1.f)
+    , _maxSimplificationLevels(8)
+    {}
 
 
     DualContourMesh::DualContourMesh() {}
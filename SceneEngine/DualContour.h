@@ -44,8 +44,41 @@ namespace SceneEngine
 
         ////////////////////////////////////////////////////////
 
+    class DualContourBuildSettings
+    {
+    public:
+        unsigned    _samplingGridDimensions;    ///< number of cells along each axis of the sampling grid
+        unsigned    _threadCount;               ///< worker threads to use (0 for one per hardware thread)
+
+            //  Sparse sampling. The grid is divided into blocks of _sparseBlockSize cells,
+            //  and the density function is sampled only at the corners & center of each
+            //  block first. If those samples show the surface can't pass through the block,
+            //  the rest of the block is never sampled.
+        unsigned    _sparseBlockSize;           ///< cells along each axis of a sparse sampling block (0 to sample every grid corner)
+        float       _densityGradientLimit;      ///< maximum rate of change of density per world unit (0 to estimate from the block samples)
+
+            //  Octree simplification. Groups of 2x2x2 cells are collapsed into a single vertex
+            //  when the merged QEF error is small enough and doesn't change the topology of the
+            //  surface. This repeats up the octree for up to _maxSimplificationLevels levels.
+        float       _simplificationThreshold;   ///< maximum QEF error (sum of squared distances to the intersection planes) of a collapsed cell. Negative disables simplification
+        unsigned    _maxSimplificationLevels;   ///< maximum number of octree levels to collapse
+
+        DualContourBuildSettings(unsigned samplingGridDimensions = 64);
+    };
+
+        /// <summary>Builds a quad mesh from a density function using dual contouring</summary>
+        /// The density function is called from multiple threads (unless the thread count is 1),
+        /// so it must be thread safe.
+        ///
+        /// The version that takes only the grid dimensions samples every grid corner and
+        /// doesn't simplify the result. It builds the same mesh as earlier versions of this
+        /// function, including the old QEF solve (which ignores the Z component of the mass
+        /// point). The version that takes DualContourBuildSettings uses the full mass point,
+        /// so its vertices can differ slightly even with dense sampling and no simplification.
     DualContourMesh     DualContourMesh_Build(  unsigned samplingGridDimensions, 
                                                 const IVolumeDensityFunction& fn);
+    DualContourMesh     DualContourMesh_Build(  const DualContourBuildSettings& settings,
+                                                const IVolumeDensityFunction& fn);
 
         ////////////////////////////////////////////////////////
 
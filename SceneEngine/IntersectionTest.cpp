@@ -6,6 +6,7 @@
 
 #include "IntersectionTest.h"
 #include "RayVsModel.h"
+#include "ModelBVH.h"
 #include "LightingParser.h"
 #include "LightingParserContext.h"
 #include "Terrain.h"
@@ -18,12 +19,17 @@
 #include "../RenderCore/DX11/Metal/IncludeDX11.h"
 #include "../RenderCore/DX11/Metal/DX11Utils.h"
 #include "../RenderCore/RenderUtils.h"
+#include "../ConsoleRig/Console.h"
 
 #include "../Math/Transformations.h"
 #include "../Math/Vector.h"
 #include "../Math/ProjectionMath.h"
+#include "../Utility/Threading/ParallelFor.h"
+#include "../Utility/PtrUtils.h"
 
 #include "../Core/WinAPI/IncludeWindows.h"      // *hack* just needed for getting client rect coords!
+#include <thread>
+#include <algorithm>
 
 
 namespace SceneEngine
@@ -75,6 +81,20 @@ namespace SceneEngine
         return FindTerrainIntersection(devContext, parserContext, terrainManager, worldSpaceRay);
     }
 
+    static std::pair<Float3, bool> FindTerrainIntersection_CPU(
+        TerrainManager& terrainManager,
+        std::pair<Float3, Float3> worldSpaceRay)
+    {
+            //  Test against the highest LOD of the height map on the CPU. This doesn't
+            //  need a device or a camera, so single and batched queries get the same
+            //  result (and it matches GetTerrainHeight).
+        TerrainManager::IntersectionResult intersection;
+        if (terrainManager.CalculateHeightMapIntersection(intersection, worldSpaceRay)) {
+            return std::make_pair(intersection._intersectionPoint, true);
+        }
+        return std::make_pair(Float3(0,0,0), false);
+    }
+
     static std::pair<unsigned, float> RayVsPlacements(
         RenderCore::Metal::DeviceContext& metalContext, RayVsModelStateContext& stateContext,
         SceneEngine::PlacementsEditor& placementsEditor, SceneEngine::PlacementGUID object)
@@ -109,6 +129,31 @@ namespace SceneEngine
         return fnResult;
     }
 
+    static std::pair<unsigned, float> RayVsPlacements_CPU(
+        SceneEngine::PlacementsEditor& placementsEditor,
+        const SceneEngine::PlacementsEditor::ObjTransDef& object,
+        std::pair<Float3, Float3> worldSpaceRay,
+        bool& alphaTestedHitFirst)
+    {
+            // Test the ray against the triangles of the model on the CPU. The
+            // placements editor caches a tree for each model, so only the first
+            // test against a model is expensive. There's no alpha test here, so
+            // alpha tested draw calls are skipped, and "alphaTestedHitFirst" is 
+            // set if one of them is in front of the result. The caller should 
+            // use the GPU path for those.
+        auto fnResult = std::make_pair(0u, FLT_MAX);
+        alphaTestedHitFirst = false;
+        auto bvh = placementsEditor.GetModelBVH(object._model.c_str(), object._material.c_str());
+        if (bvh) {
+            RayVsModelStateContext::ResultEntry intersection;
+            if (bvh->FindFirstIntersection(intersection, worldSpaceRay, AsFloat4x4(object._localToWorld), &alphaTestedHitFirst)) {
+                fnResult.first = 1;
+                fnResult.second = intersection._intersectionDepth;
+            }
+        }
+        return fnResult;
+    }
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     auto IntersectionTestScene::FirstRayIntersection(
@@ -121,8 +166,11 @@ namespace SceneEngine
         auto metalContext = RenderCore::Metal::DeviceContext::Get(*context.GetThreadContext());
 
         if ((filter & Type::Terrain) && _terrainManager) {
-            auto intersection = FindTerrainIntersection(
-                metalContext.get(), context, *_terrainManager.get(), worldSpaceRay);
+                //  The GPU path tests against the terrain geometry rendered for the
+                //  current camera. Use "RayVsTerrainGPU" to enable it.
+            auto intersection = Tweakable("RayVsTerrainGPU", false)
+                ? FindTerrainIntersection(metalContext.get(), context, *_terrainManager.get(), worldSpaceRay)
+                : FindTerrainIntersection_CPU(*_terrainManager.get(), worldSpaceRay);
             if (intersection.second) {
                 float distance = Magnitude(intersection.first - worldSpaceRay.first);
                 if (distance < result._distance) {
@@ -150,17 +198,35 @@ namespace SceneEngine
             {
                 float rayLength = Magnitude(worldSpaceRay.second - worldSpaceRay.first);
 
-                auto cam = context.GetCameraDesc();
-                RayVsModelStateContext stateContext(context.GetThreadContext(), context.GetTechniqueContext(), &cam);
-                stateContext.SetRay(worldSpaceRay);
+                    // The GPU path is much slower (and needs the immediate context), but
+                    // it supports alpha test. By default, we only use it for objects where
+                    // the CPU test passes through an alpha tested draw call before the 
+                    // result. Use "RayVsModelGPU" to use it for everything.
+                std::unique_ptr<RayVsModelStateContext> stateContext;
+                auto getStateContext = [&]() -> RayVsModelStateContext& {
+                    if (!stateContext) {
+                        auto cam = context.GetCameraDesc();
+                        stateContext = std::make_unique<RayVsModelStateContext>(context.GetThreadContext(), context.GetTechniqueContext(), &cam);
+                        stateContext->SetRay(worldSpaceRay);
+                    }
+                    return *stateContext;
+                };
+                const bool gpuForEverything = Tweakable("RayVsModelGPU", false);
 
-                // note --  we could do this all in a single render call, except that there
-                //          is no way to associate a low level intersection result with a specific
-                //          draw call.
+                // note --  with the GPU path, we could do this all in a single render call, except
+                //          that there is no way to associate a low level intersection result with
+                //          a specific draw call.
                 auto count = trans->GetObjectCount();
                 for (unsigned c=0; c<count; ++c) {
                     auto guid = trans->GetGuid(c);
-                    auto r = RayVsPlacements(*metalContext.get(), stateContext, *_placements, guid);
+                    bool alphaTestedHitFirst = gpuForEverything;
+                    std::pair<unsigned, float> r;
+                    if (!gpuForEverything) {
+                        r = RayVsPlacements_CPU(*_placements, trans->GetObject(c), worldSpaceRay, alphaTestedHitFirst);
+                    }
+                    if (alphaTestedHitFirst) {
+                        r = RayVsPlacements(*metalContext.get(), getStateContext(), *_placements, guid);
+                    }
 
                     if (r.first && r.second < result._distance) {
                         result = Result();
@@ -188,6 +254,144 @@ namespace SceneEngine
             context, context.CalculateWorldSpaceRay(cursorPosition), filter);
     }
 
+    static uint32 SpreadBits10(uint32 x)
+    {
+            //  spread the bottom 10 bits of x out, so there are 2 zero bits
+            //  between each bit (for interleaving 3 values into a morton code)
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x <<  8)) & 0x0300f00f;
+        x = (x | (x <<  4)) & 0x030c30c3;
+        x = (x | (x <<  2)) & 0x09249249;
+        return x;
+    }
+
+    static std::vector<unsigned> SortRaysCoherently(
+        const IntersectionTestScene::RayQuery queries[], size_t queryCount)
+    {
+            //  Sort the rays so that rays that start close together, and go in the
+            //  same general direction, are adjacent. The key is the octant of the ray
+            //  direction, followed by the morton code of the start point (within the 
+            //  bounding box of all of the start points).
+        Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (size_t c=0; c<queryCount; ++c) {
+            const auto& start = queries[c]._worldSpaceRay.first;
+            for (unsigned e=0; e<3; ++e) {
+                mins[e] = std::min(mins[e], start[e]);
+                maxs[e] = std::max(maxs[e], start[e]);
+            }
+        }
+
+        Float3 scale;
+        for (unsigned e=0; e<3; ++e) {
+            scale[e] = (maxs[e] > mins[e]) ? (1023.f / (maxs[e] - mins[e])) : 0.f;
+        }
+
+        std::vector<std::pair<uint64, unsigned>> keys;
+        keys.reserve(queryCount);
+        for (size_t c=0; c<queryCount; ++c) {
+            const auto& ray = queries[c]._worldSpaceRay;
+            auto direction = ray.second - ray.first;
+            uint32 octant = 
+                  ((direction[0] < 0.f) ? 1 : 0)
+                | ((direction[1] < 0.f) ? 2 : 0)
+                | ((direction[2] < 0.f) ? 4 : 0);
+            uint32 morton = 
+                  (SpreadBits10(uint32((ray.first[0] - mins[0]) * scale[0])) << 2)
+                | (SpreadBits10(uint32((ray.first[1] - mins[1]) * scale[1])) << 1)
+                | (SpreadBits10(uint32((ray.first[2] - mins[2]) * scale[2])));
+            keys.push_back(std::make_pair((uint64(octant) << 30ull) | uint64(morton), unsigned(c)));
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<unsigned> result;
+        result.reserve(queryCount);
+        for (const auto& k:keys) { result.push_back(k.second); }
+        return std::move(result);
+    }
+
+    void IntersectionTestScene::FirstRayIntersections(
+        Result results[],
+        const RayQuery queries[], size_t queryCount,
+        unsigned threadCount) const
+    {
+        for (size_t c=0; c<queryCount; ++c) {
+            results[c] = Result();
+        }
+        if (!queryCount) { return; }
+
+        if (!threadCount) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+
+        auto order = SortRaysCoherently(queries, queryCount);
+
+            //  Terrain first. The terrain queries are independent of each other, so
+            //  each thread just pulls the next chunk of rays from the sorted list. The
+            //  height data for the nodes is shared between threads by the terrain 
+            //  collision cache.
+        if (_terrainManager) {
+            std::vector<unsigned> terrainQueries;
+            terrainQueries.reserve(queryCount);
+            for (auto q:order) {
+                if (queries[q]._filter & Type::Terrain) { terrainQueries.push_back(q); }
+            }
+
+            const size_t raysPerChunk = 64;
+            const auto chunkCount = unsigned((terrainQueries.size() + raysPerChunk - 1) / raysPerChunk);
+            auto& terrainManager = *_terrainManager;
+            Threading::ParallelFor(
+                threadCount, chunkCount,
+                [&](unsigned chunk) {
+                    auto end = std::min(size_t(chunk+1) * raysPerChunk, terrainQueries.size());
+                    for (auto c=size_t(chunk) * raysPerChunk; c<end; ++c) {
+                        auto q = terrainQueries[c];
+                        const auto& ray = queries[q]._worldSpaceRay;
+                        auto intersection = FindTerrainIntersection_CPU(terrainManager, ray);
+                        if (intersection.second) {
+                            auto& result = results[q];
+                            result._type = Type::Terrain;
+                            result._worldSpaceCollision = intersection.first;
+                            result._distance = Magnitude(intersection.first - ray.first);
+                        }
+                    }
+                });
+        }
+
+            //  Placements -- the editor shares the cell and model look ups across 
+            //  the whole batch, and spreads the ray tests across threads itself.
+        if (_placements) {
+            std::vector<unsigned> placementQueries;
+            std::vector<std::pair<Float3, Float3>> rays;
+            placementQueries.reserve(queryCount);
+            rays.reserve(queryCount);
+            for (auto q:order) {
+                if (queries[q]._filter & Type::Placement) {
+                    placementQueries.push_back(q);
+                    rays.push_back(queries[q]._worldSpaceRay);
+                }
+            }
+
+            std::vector<std::pair<PlacementGUID, float>> placementResults(rays.size());
+            _placements->Find_FirstRayIntersections(
+                AsPointer(placementResults.begin()), AsPointer(rays.cbegin()), rays.size(), threadCount);
+
+            for (size_t c=0; c<placementQueries.size(); ++c) {
+                auto& result = results[placementQueries[c]];
+                const auto& ray = rays[c];
+                const auto& r = placementResults[c];
+                if (r.second < result._distance) {
+                    float rayLength = Magnitude(ray.second - ray.first);
+                    result = Result();
+                    result._type = Type::Placement;
+                    result._worldSpaceCollision = LinearInterpolate(ray.first, ray.second, r.second / rayLength);
+                    result._distance = r.second;
+                    result._objectGuid = r.first;
+                }
+            }
+        }
+    }
+
     IntersectionTestScene::IntersectionTestScene(
         std::shared_ptr<TerrainManager> terrainManager,
         std::shared_ptr<PlacementsEditor> placements)
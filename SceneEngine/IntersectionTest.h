@@ -97,6 +97,36 @@ namespace SceneEngine
             Int2 cursorPosition,
             Type::BitField filter = ~Type::BitField(0)) const;
 
+        class RayQuery
+        {
+        public:
+            std::pair<Float3, Float3>   _worldSpaceRay;
+            Type::BitField              _filter;
+
+            RayQuery() : _filter(~Type::BitField(0)) {}
+            RayQuery(const std::pair<Float3, Float3>& worldSpaceRay, Type::BitField filter = ~Type::BitField(0))
+            : _worldSpaceRay(worldSpaceRay), _filter(filter) {}
+        };
+
+            /// <summary>Finds the first intersection for each ray in a large batch</summary>
+            /// This is intended for tools that need very many queries (eg, scattering 
+            /// objects, precalculating visibility or baking). Everything is done on the CPU,
+            /// so no device context is required, and the work is spread across "threadCount" 
+            /// threads (0 means one per hardware thread). The rays are sorted so that rays that
+            /// are close together are tested together, and the placement cells and models that
+            /// might be hit are only looked up once for the whole batch.
+            ///
+            /// Results match FirstRayIntersection (unless the "RayVsModelGPU" or "RayVsTerrainGPU"
+            /// tweakables are set). Terrain intersections are with the highest LOD of the height
+            /// map (see TerrainManager::CalculateHeightMapIntersection) in both.
+            ///
+            /// "results" must have space for "queryCount" entries. Results are in the same
+            /// order as the queries.
+        void FirstRayIntersections(
+            Result results[],
+            const RayQuery queries[], size_t queryCount,
+            unsigned threadCount = 0) const;
+
         IntersectionTestScene(
             std::shared_ptr<TerrainManager> terrainManager = std::shared_ptr<TerrainManager>(),
             std::shared_ptr<PlacementsEditor> placements = std::shared_ptr<PlacementsEditor>());
@@ -0,0 +1,79 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Math/Vector.h"
+#include "../Math/Geometry.h"
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+namespace SceneEngine { namespace Internal
+{
+        ///
+        /// <summary>Splits a batch of rays into chunks of adjacent rays, with a bounding box for each chunk</summary>
+        ///
+        /// Rays in a batch are sorted so that adjacent rays are close together (see
+        /// IntersectionTestScene::FirstRayIntersections). So the box around a chunk of
+        /// adjacent rays is normally small, and an object can be rejected for every ray in
+        /// the chunk with a single box test. This keeps the cost of finding the objects hit
+        /// by a large batch closer to (objects x chunks) than (objects x rays).
+        ///
+        /// The chunks are also the units of work given to worker threads.
+        ///
+    class RayChunks
+    {
+    public:
+        unsigned    GetChunkCount() const { return unsigned(_bounds.size()); }
+        size_t      GetChunkBegin(unsigned chunk) const { return size_t(chunk) * _raysPerChunk; }
+        size_t      GetChunkEnd(unsigned chunk) const { return std::min(size_t(chunk+1) * _raysPerChunk, _rayCount); }
+
+            /// <summary>Returns false if no ray in the chunk can hit the given box</summary>
+        bool        MightHit(unsigned chunk, const Float3& mins, const Float3& maxs) const
+        {
+            const auto& b = _bounds[chunk];
+            return  b.first[0] <= maxs[0] && b.second[0] >= mins[0]
+                &&  b.first[1] <= maxs[1] && b.second[1] >= mins[1]
+                &&  b.first[2] <= maxs[2] && b.second[2] >= mins[2];
+        }
+
+            /// <summary>Returns true if any ray in the batch hits the given box</summary>
+        bool        AnyRayHits(const Float3& mins, const Float3& maxs) const
+        {
+            for (unsigned c=0; c<GetChunkCount(); ++c) {
+                if (!MightHit(c, mins, maxs)) { continue; }
+                for (auto r=GetChunkBegin(c); r<GetChunkEnd(c); ++r) {
+                    if (RayVsAABB(_rays[r], mins, maxs)) { return true; }
+                }
+            }
+            return false;
+        }
+
+        RayChunks(const std::pair<Float3, Float3> rays[], size_t rayCount, size_t raysPerChunk = 64)
+        : _rays(rays), _rayCount(rayCount), _raysPerChunk(raysPerChunk)
+        {
+            _bounds.resize((rayCount + raysPerChunk - 1) / raysPerChunk);
+            for (unsigned c=0; c<GetChunkCount(); ++c) {
+                Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                for (auto r=GetChunkBegin(c); r<GetChunkEnd(c); ++r) {
+                    for (unsigned e=0; e<3; ++e) {
+                        mins[e] = std::min(mins[e], std::min(rays[r].first[e], rays[r].second[e]));
+                        maxs[e] = std::max(maxs[e], std::max(rays[r].first[e], rays[r].second[e]));
+                    }
+                }
+                _bounds[c] = std::make_pair(mins, maxs);
+            }
+        }
+
+    protected:
+        const std::pair<Float3, Float3>*        _rays;
+        size_t                                  _rayCount;
+        size_t                                  _raysPerChunk;
+        std::vector<std::pair<Float3, Float3>>  _bounds;
+    };
+}}
+
@@ -10,6 +10,7 @@
 
 #include "../RenderCore/Techniques/Techniques.h"
 #include "../RenderCore/Techniques/CommonResources.h"
+#include "../RenderCore/Techniques/ResourceBox.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/StringFormat.h"
 
@@ -39,7 +40,7 @@ namespace SceneEngine
     }
 
     MainTargetsBox::MainTargetsBox(const Desc& desc) 
-    : _desc(desc)
+    : _desc(desc), _allocatedBytes(0)
     {
         using namespace RenderCore;
         using namespace RenderCore::Metal;
@@ -60,6 +61,7 @@ namespace SceneEngine
             if (desc._gbufferFormats[c]._resourceFormat != NativeFormat::Unknown) {
                 bufferUploadsDesc._textureDesc._nativePixelFormat = AsDXGIFormat(desc._gbufferFormats[c]._resourceFormat);
                 gbufferTextures[c] = CreateResourceImmediate(bufferUploadsDesc);
+                _allocatedBytes += GetBufferUploads()->ByteCount(bufferUploadsDesc);
                 gbufferRTV[c] = RenderTargetView(gbufferTextures[c].get(), desc._gbufferFormats[c]._writeFormat);
                 gbufferSRV[c] = ShaderResourceView(gbufferTextures[c].get(), desc._gbufferFormats[c]._shaderReadFormat);
             }
@@ -75,6 +77,7 @@ namespace SceneEngine
             "MainDepth");
         auto msaaDepthBufferTexture = CreateResourceImmediate(depthBufferDesc);
         auto secondaryDepthBufferTexture = CreateResourceImmediate(depthBufferDesc);
+        _allocatedBytes += 2 * GetBufferUploads()->ByteCount(depthBufferDesc);
         DepthStencilView msaaDepthBuffer(msaaDepthBufferTexture.get(), desc._depthFormat._writeFormat);
         DepthStencilView secondaryDepthBuffer(secondaryDepthBufferTexture.get(), desc._depthFormat._writeFormat);
         ShaderResourceView msaaDepthBufferSRV(msaaDepthBufferTexture.get(), desc._depthFormat._shaderReadFormat);
@@ -113,7 +116,7 @@ namespace SceneEngine
     }
 
     ForwardTargetsBox::ForwardTargetsBox(const Desc& desc) 
-    : _desc(desc)
+    : _desc(desc), _allocatedBytes(0)
     {
         using namespace RenderCore;
         using namespace RenderCore::Metal;
@@ -126,6 +129,7 @@ namespace SceneEngine
 
         auto msaaDepthBufferTexture = CreateResourceImmediate(bufferUploadsDesc);
         auto secondaryDepthBufferTexture = CreateResourceImmediate(bufferUploadsDesc);
+        _allocatedBytes = 2 * GetBufferUploads()->ByteCount(bufferUploadsDesc);
 
             /////////
 
@@ -149,6 +153,18 @@ namespace SceneEngine
 
     ForwardTargetsBox::~ForwardTargetsBox() {}
 
+    static const unsigned MainTargetsEvictionFrames = 300;
+
+    RenderCore::Techniques::BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const MainTargetsBox*)
+    {
+        return RenderCore::Techniques::BoxEvictionPolicy(0, MainTargetsEvictionFrames);
+    }
+
+    RenderCore::Techniques::BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const ForwardTargetsBox*)
+    {
+        return RenderCore::Techniques::BoxEvictionPolicy(0, MainTargetsEvictionFrames);
+    }
+
     ///////////////////////////////////////////////////////////////////////////////////////////////
 
     LightingResolveTextureBox::Desc::Desc( unsigned width, unsigned height, 
@@ -15,6 +15,8 @@
 
 #include "../BufferUploads/IBufferUploads.h"
 
+namespace RenderCore { namespace Techniques { class BoxEvictionPolicy; }}
+
 namespace SceneEngine
 {
     class MainTargetsBox
@@ -56,6 +58,8 @@ namespace SceneEngine
         SRV _gbufferRTVsSRV[s_gbufferTextureCount];
         SRV _msaaDepthBufferSRV;
         SRV _secondaryDepthBufferSRV;
+
+        size_t _allocatedBytes;
     };
 
     class ForwardTargetsBox
@@ -88,8 +92,18 @@ namespace SceneEngine
 
         SRV _msaaDepthBufferSRV;
         SRV _secondaryDepthBufferSRV;
+
+        size_t _allocatedBytes;
     };
 
+        //  The main targets are created for every viewport size we see (eg, while
+        //  resizing windows in the editor). So these box types release sizes that
+        //  haven't been used for a while (see RenderCore/Techniques/ResourceBox.h)
+    RenderCore::Techniques::BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const MainTargetsBox*);
+    RenderCore::Techniques::BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const ForwardTargetsBox*);
+    inline size_t GetBoxAllocationSize(const MainTargetsBox& box) { return box._allocatedBytes; }
+    inline size_t GetBoxAllocationSize(const ForwardTargetsBox& box) { return box._allocatedBytes; }
+
     class LightingResolveTextureBox
     {
     public:
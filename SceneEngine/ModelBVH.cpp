@@ -0,0 +1,954 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ModelBVH.h"
+#include "../RenderCore/Assets/ModelRunTime.h"
+#include "../RenderCore/Assets/ModelRunTimeInternal.h"
+#include "../RenderCore/Assets/MaterialScaffold.h"
+#include "../RenderCore/Assets/Material.h"
+#include "../RenderCore/Metal/Format.h"
+#include "../RenderCore/Metal/DeviceContext.h"
+#include "../Assets/Assets.h"
+#include "../Math/Transformations.h"
+#include "../Utility/HeapUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Core/Prefix.h"
+#include <algorithm>
+#include <float.h>
+#include <assert.h>
+
+#if (COMPILER_ACTIVE == COMPILER_TYPE_MSVC) || defined(__SSE__)
+    #define MODELBVH_SSE
+    #include <immintrin.h>
+#endif
+
+namespace SceneEngine
+{
+    using RenderCore::Assets::ModelScaffold;
+    using RenderCore::Assets::MaterialScaffold;
+    using RenderCore::Assets::ModelCommandStream;
+    using RenderCore::Assets::ModelImmutableData;
+    using RenderCore::Assets::RawGeometry;
+    using RenderCore::Assets::DrawCallDesc;
+    using RenderCore::Assets::VertexData;
+    using RenderCore::Assets::IndexData;
+    using RenderCore::Assets::VertexElement;
+    using RenderCore::Assets::GeoInputAssembly;
+    namespace Metal = RenderCore::Metal;
+
+    static const unsigned s_leafBit = 0x80000000;
+    static const unsigned s_maxLeafTriangles = 4;
+    static const unsigned s_maxBuildDepth = 48;
+    static const unsigned s_maxStackDepth = 3*s_maxBuildDepth + 1;
+    static const unsigned s_binCount = 16;
+
+    namespace Internal
+    {
+            //  The bounding boxes of the children are stored as structures of arrays,
+            //  so all 4 can be tested against a ray at once. Used children come first.
+        class Node
+        {
+        public:
+            float       _mins[3][4];
+            float       _maxs[3][4];
+            unsigned    _children[4];       // (s_leafBit | index into _leaves) for leaves
+            unsigned    _childCount;
+        };
+
+        class Leaf
+        {
+        public:
+            unsigned    _firstPacket, _packetCount;
+        };
+
+            //  4 triangles, as first corner and 2 edges (the form used by the intersection test)
+        class TrianglePacket
+        {
+        public:
+            float       _v0[3][4];
+            float       _e1[3][4];
+            float       _e2[3][4];
+            unsigned    _triangles[4];      // index into _triangles (~0 for unused lanes)
+        };
+
+        class Triangle
+        {
+        public:
+            Float3      _corners[3];
+            unsigned    _drawCallIndex;
+        };
+
+        class Tree
+        {
+        public:
+            std::vector<Node>           _nodes;
+            std::vector<Leaf>           _leaves;
+            std::vector<TrianglePacket> _packets;
+            std::vector<Triangle>       _triangles;
+            std::vector<bool>           _alphaTestedDrawCalls;
+            std::pair<Float3, Float3>   _boundingBox;
+
+            bool IsAlphaTested(const Triangle& tri) const
+            {
+                return tri._drawCallIndex < _alphaTestedDrawCalls.size() && _alphaTestedDrawCalls[tri._drawCallIndex];
+            }
+        };
+    }
+
+    class ModelBVH::Pimpl
+    {
+    public:
+        Internal::Tree  _tree;
+
+        const ::Assets::DependencyValidation*   _validation;
+        unsigned                                _validationIndex;
+        const ::Assets::DependencyValidation*   _materialValidation;
+        unsigned                                _materialValidationIndex;
+    };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      g e o m e t r y         //
+
+    static float HalfToFloat(uint16 input)
+    {
+        union { uint32 _i; float _f; } result;
+        uint32 sign = uint32(input & 0x8000) << 16;
+        uint32 exponent = (input >> 10) & 0x1f;
+        uint32 mantissa = input & 0x3ff;
+        if (exponent == 0x1f) {
+            result._i = sign | 0x7f800000 | (mantissa << 13);       // inf or nan
+        } else if (exponent != 0) {
+            result._i = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+        } else if (mantissa != 0) {
+                // denormalized half; becomes a normalized float
+            exponent = 127 - 15 + 1;
+            while (!(mantissa & 0x400)) { mantissa <<= 1; --exponent; }
+            result._i = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        } else {
+            result._i = sign;
+        }
+        return result._f;
+    }
+
+    static const VertexElement* FindElement(const GeoInputAssembly& ia, const char semantic[])
+    {
+        for (unsigned c=0; c<ia._elementCount; ++c)
+            if (!XlCompareString(ia._elements[c]._semantic, semantic) && ia._elements[c]._semanticIndex == 0)
+                return &ia._elements[c];
+        return nullptr;
+    }
+
+    static bool LoadPositions(
+        std::vector<Float3>& dst, BasicFile& file, unsigned largeBlocksOffset,
+        const VertexData& vb)
+    {
+            //  Only float and half float positions are supported (which covers
+            //  everything the collada conversion produces)
+        auto* element = FindElement(vb._ia, "POSITION");
+        if (!element || !vb._ia._vertexStride) { return false; }
+
+        auto format = Metal::NativeFormat::Enum(element->_format);
+        auto precision = Metal::GetComponentPrecision(format);
+        if (    Metal::GetComponentType(format) != Metal::FormatComponentType::Float
+            ||  Metal::GetComponentCount(Metal::GetComponents(format)) < 3
+            ||  (precision != 32 && precision != 16)
+            ||  element->_startOffset + 3 * precision / 8 > vb._ia._vertexStride) {
+            return false;
+        }
+
+        std::vector<uint8> rawData(vb._size);
+        file.Seek(largeBlocksOffset + vb._offset, SEEK_SET);
+        file.Read(AsPointer(rawData.begin()), 1, vb._size);
+
+        auto vertexCount = vb._size / vb._ia._vertexStride;
+        dst.resize(vertexCount);
+        for (unsigned v=0; v<vertexCount; ++v) {
+            const void* src = PtrAdd(AsPointer(rawData.cbegin()), v * vb._ia._vertexStride + element->_startOffset);
+            if (precision == 32) {
+                auto* f = (const float*)src;
+                dst[v] = Float3(f[0], f[1], f[2]);
+            } else {
+                auto* h = (const uint16*)src;
+                dst[v] = Float3(HalfToFloat(h[0]), HalfToFloat(h[1]), HalfToFloat(h[2]));
+            }
+        }
+        return true;
+    }
+
+    static void LoadIndices(
+        std::vector<unsigned>& dst, BasicFile& file, unsigned largeBlocksOffset,
+        const IndexData& ib)
+    {
+        const bool is32Bit = Metal::NativeFormat::Enum(ib._format) == Metal::NativeFormat::R32_UINT;
+        std::vector<uint8> rawData(ib._size);
+        file.Seek(largeBlocksOffset + ib._offset, SEEK_SET);
+        file.Read(AsPointer(rawData.begin()), 1, ib._size);
+
+        if (is32Bit) {
+            auto* src = (const uint32*)AsPointer(rawData.cbegin());
+            dst.assign(src, src + ib._size / sizeof(uint32));
+        } else {
+            auto* src = (const uint16*)AsPointer(rawData.cbegin());
+            dst.assign(src, src + ib._size / sizeof(uint16));
+        }
+    }
+
+    static void AddTriangles(
+        std::vector<Internal::Triangle>& dst,
+        const DrawCallDesc& drawCall, unsigned drawCallIndex,
+        const std::vector<Float3>& positions, const std::vector<unsigned>& indices)
+    {
+        auto topology = Metal::Topology::Enum(drawCall._topology);
+        if (topology != Metal::Topology::TriangleList && topology != Metal::Topology::TriangleStrip) {
+            return;     // (lines and points can't be hit)
+        }
+        if (drawCall._firstIndex + drawCall._indexCount > indices.size() || drawCall._indexCount < 3) {
+            return;
+        }
+
+        const unsigned step = (topology == Metal::Topology::TriangleList) ? 3 : 1;
+        const auto* i = &indices[drawCall._firstIndex];
+        for (unsigned c=0; c+2<drawCall._indexCount; c+=step) {
+            unsigned v0 = i[c] + drawCall._firstVertex;
+            unsigned v1 = i[c+1] + drawCall._firstVertex;
+            unsigned v2 = i[c+2] + drawCall._firstVertex;
+            if (v0 >= positions.size() || v1 >= positions.size() || v2 >= positions.size()) { continue; }
+            if (v0 == v1 || v1 == v2 || v2 == v0) { continue; }     // (degenerate strip joins)
+
+                // winding order doesn't matter, because we hit back faces as well
+            Internal::Triangle tri;
+            tri._corners[0] = positions[v0];
+            tri._corners[1] = positions[v1];
+            tri._corners[2] = positions[v2];
+            tri._drawCallIndex = drawCallIndex;
+            dst.push_back(tri);
+        }
+    }
+
+    static bool IsAlphaTested(
+        const MaterialScaffold* material,
+        const ModelCommandStream::GeoCall& geoCall, const DrawCallDesc& drawCall)
+    {
+            //  (this is the same way that ModelRenderer finds the material for a draw call)
+        if (!material || drawCall._subMaterialIndex >= geoCall._materialCount) { return false; }
+        auto* mat = material->GetMaterial(geoCall._materialGuids[drawCall._subMaterialIndex]);
+        if (!mat) { return false; }
+        auto alphaTest = mat->_matParams.GetParameter<unsigned>("MAT_ALPHA_TEST");
+        return alphaTest.first && alphaTest.second != 0;
+    }
+
+    static void AddGeoCall(
+        Internal::Tree& dst, unsigned& drawCallIndex,
+        BasicFile& file, unsigned largeBlocksOffset,
+        const RawGeometry& geo, const VertexData& positionStream,
+        const ModelCommandStream::GeoCall& geoCall, const MaterialScaffold* material)
+    {
+        std::vector<Float3> positions;
+        std::vector<unsigned> indices;
+        const bool loaded = LoadPositions(positions, file, largeBlocksOffset, positionStream);
+        if (loaded) {
+            LoadIndices(indices, file, largeBlocksOffset, geo._ib);
+        }
+
+            //  Draw call indices must be incremented in the same way as ModelRenderer,
+            //  even for geometry we can't use
+        for (unsigned d=0; d<geo._drawCallsCount; ++d) {
+            const auto& drawCall = geo._drawCalls[d];
+            if (!drawCall._indexCount) { continue; }
+            if (loaded) {
+                AddTriangles(dst._triangles, drawCall, drawCallIndex, positions, indices);
+            }
+            dst._alphaTestedDrawCalls.push_back(IsAlphaTested(material, geoCall, drawCall));
+            ++drawCallIndex;
+        }
+    }
+
+    static void LoadTriangles(
+        Internal::Tree& result,
+        const ModelScaffold& scaffold, const MaterialScaffold* material, unsigned levelOfDetail)
+    {
+        const auto& cmdStream = scaffold.CommandStream();
+        const auto& data = scaffold.ImmutableData();
+        BasicFile file(scaffold.Filename().c_str(), "rb");
+        const auto largeBlocksOffset = scaffold.LargeBlocksOffset();
+
+        unsigned drawCallIndex = 0;
+        for (unsigned gi=0; gi<cmdStream.GetGeoCallCount(); ++gi) {
+            const auto& geoCall = cmdStream.GetGeoCall(gi);
+            if (geoCall._levelOfDetail != levelOfDetail) { continue; }
+            assert(geoCall._geoId < data._geoCount);
+            const auto& geo = data._geos[geoCall._geoId];
+            AddGeoCall(result, drawCallIndex, file, largeBlocksOffset, geo, geo._vb, geoCall, material);
+        }
+
+            //  For skinned geometry, the positions are in the animated vertex stream
+            //  (and we only have the bind pose)
+        for (unsigned gi=0; gi<cmdStream.GetSkinCallCount(); ++gi) {
+            const auto& skinCall = cmdStream.GetSkinCall(gi);
+            if (skinCall._levelOfDetail != levelOfDetail) { continue; }
+            assert(skinCall._geoId < data._boundSkinnedControllerCount);
+            const auto& geo = data._boundSkinnedControllers[skinCall._geoId];
+            AddGeoCall(result, drawCallIndex, file, largeBlocksOffset, geo, geo._animatedVertexElements, skinCall, material);
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      c o n s t r u c t i o n         //
+
+    namespace Internal
+    {
+        class BuildTriangle
+        {
+        public:
+            Float3      _mins, _maxs, _centroid;
+            unsigned    _index;
+        };
+
+        class BuildNode
+        {
+        public:
+            Float3      _mins, _maxs;
+            unsigned    _children[2];
+            unsigned    _firstTriangle, _triangleCount;     // (leaves only)
+        };
+
+        static float SurfaceArea(const Float3& mins, const Float3& maxs)
+        {
+            auto d = maxs - mins;
+            return 2.f * (d[0]*d[1] + d[1]*d[2] + d[2]*d[0]);
+        }
+
+        static void AddToBounds(Float3& mins, Float3& maxs, const Float3& mins2, const Float3& maxs2)
+        {
+            for (unsigned c=0; c<3; ++c) {
+                mins[c] = std::min(mins[c], mins2[c]);
+                maxs[c] = std::max(maxs[c], maxs2[c]);
+            }
+        }
+
+            ///
+            /// Builds a binary tree, splitting along the longest axis of the triangle
+            /// centroids. Split positions are chosen with the surface area heuristic,
+            /// evaluated at the boundaries of a fixed number of bins.
+            ///
+        class SAHBuilder
+        {
+        public:
+            std::vector<BuildTriangle>  _triangles;
+            std::vector<BuildNode>      _nodes;
+
+            unsigned Build(unsigned begin, unsigned end, unsigned depth);
+        };
+
+        unsigned SAHBuilder::Build(unsigned begin, unsigned end, unsigned depth)
+        {
+            BuildNode node;
+            node._mins = Float3(FLT_MAX, FLT_MAX, FLT_MAX);
+            node._maxs = Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+            node._children[0] = node._children[1] = ~unsigned(0x0);
+            node._firstTriangle = node._triangleCount = 0;
+
+            Float3 centroidMins = node._mins, centroidMaxs = node._maxs;
+            for (unsigned t=begin; t<end; ++t) {
+                AddToBounds(node._mins, node._maxs, _triangles[t]._mins, _triangles[t]._maxs);
+                AddToBounds(centroidMins, centroidMaxs, _triangles[t]._centroid, _triangles[t]._centroid);
+            }
+
+            const unsigned nodeIndex = (unsigned)_nodes.size();
+            const unsigned count = end - begin;
+            if (count <= s_maxLeafTriangles || depth >= s_maxBuildDepth) {
+                node._firstTriangle = begin;
+                node._triangleCount = count;
+                _nodes.push_back(node);
+                return nodeIndex;
+            }
+            _nodes.push_back(node);
+
+            auto extents = centroidMaxs - centroidMins;
+            unsigned axis = 0;
+            if (extents[1] > extents[axis]) { axis = 1; }
+            if (extents[2] > extents[axis]) { axis = 2; }
+
+            unsigned mid = begin;
+            if (extents[axis] > 0.f) {
+                    //  Bin the centroids, and then sweep from both sides to find
+                    //  the area & count on each side of each bin boundary
+                unsigned binCounts[s_binCount];
+                Float3 binMins[s_binCount], binMaxs[s_binCount];
+                for (unsigned b=0; b<s_binCount; ++b) {
+                    binCounts[b] = 0;
+                    binMins[b] = Float3(FLT_MAX, FLT_MAX, FLT_MAX);
+                    binMaxs[b] = Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                }
+
+                const float binScale = float(s_binCount) * (1.f - 1e-5f) / extents[axis];
+                const float binBase = centroidMins[axis];
+                auto binIndex = [=](const BuildTriangle& t)
+                    { return std::min(unsigned((t._centroid[axis] - binBase) * binScale), s_binCount-1); };
+
+                for (unsigned t=begin; t<end; ++t) {
+                    auto b = binIndex(_triangles[t]);
+                    ++binCounts[b];
+                    AddToBounds(binMins[b], binMaxs[b], _triangles[t]._mins, _triangles[t]._maxs);
+                }
+
+                float rightCost[s_binCount];
+                Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                unsigned rightCount = 0;
+                for (unsigned b=s_binCount-1; b>0; --b) {
+                    AddToBounds(mins, maxs, binMins[b], binMaxs[b]);
+                    rightCount += binCounts[b];
+                    rightCost[b] = rightCount ? (rightCount * SurfaceArea(mins, maxs)) : 0.f;
+                }
+
+                unsigned bestSplit = 0;
+                float bestCost = FLT_MAX;
+                mins = Float3(FLT_MAX, FLT_MAX, FLT_MAX); maxs = Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+                unsigned leftCount = 0;
+                for (unsigned b=1; b<s_binCount; ++b) {
+                    AddToBounds(mins, maxs, binMins[b-1], binMaxs[b-1]);
+                    leftCount += binCounts[b-1];
+                    if (!leftCount || leftCount == count) { continue; }
+                    float cost = leftCount * SurfaceArea(mins, maxs) + rightCost[b];
+                    if (cost < bestCost) { bestCost = cost; bestSplit = b; }
+                }
+
+                if (bestSplit) {
+                    auto i = std::partition(
+                        _triangles.begin() + begin, _triangles.begin() + end,
+                        [=](const BuildTriangle& t) { return binIndex(t) < bestSplit; });
+                    mid = unsigned(i - _triangles.begin());
+                }
+            }
+
+                //  If the centroids can't be separated, just split the list in half
+            if (mid == begin || mid == end) {
+                mid = begin + count / 2;
+                std::nth_element(
+                    _triangles.begin() + begin, _triangles.begin() + mid, _triangles.begin() + end,
+                    [=](const BuildTriangle& lhs, const BuildTriangle& rhs) { return lhs._centroid[axis] < rhs._centroid[axis]; });
+            }
+
+            auto left = Build(begin, mid, depth+1);
+            auto right = Build(mid, end, depth+1);
+            _nodes[nodeIndex]._children[0] = left;
+            _nodes[nodeIndex]._children[1] = right;
+            return nodeIndex;
+        }
+
+        static unsigned AddLeaf(Tree& dst, const SAHBuilder& builder, const BuildNode& node)
+        {
+            Internal::Leaf leaf;
+            leaf._firstPacket = (unsigned)dst._packets.size();
+            leaf._packetCount = (node._triangleCount + 3) / 4;
+
+            for (unsigned p=0; p<leaf._packetCount; ++p) {
+                Internal::TrianglePacket packet;
+                XlZeroMemory(packet);       // (unused lanes have zero length edges, and never hit)
+                for (unsigned lane=0; lane<4; ++lane) {
+                    auto t = p*4 + lane;
+                    if (t >= node._triangleCount) {
+                        packet._triangles[lane] = ~unsigned(0x0);
+                        continue;
+                    }
+
+                    auto triIndex = builder._triangles[node._firstTriangle + t]._index;
+                    const auto& tri = dst._triangles[triIndex];
+                    for (unsigned c=0; c<3; ++c) {
+                        packet._v0[c][lane] = tri._corners[0][c];
+                        packet._e1[c][lane] = tri._corners[1][c] - tri._corners[0][c];
+                        packet._e2[c][lane] = tri._corners[2][c] - tri._corners[0][c];
+                    }
+                    packet._triangles[lane] = triIndex;
+                }
+                dst._packets.push_back(packet);
+            }
+
+            dst._leaves.push_back(leaf);
+            return s_leafBit | unsigned(dst._leaves.size()-1);
+        }
+
+            ///
+            /// Converts the binary tree into a tree with 4 children per node, by pulling
+            /// up grandchildren. We expand the largest children first, because they are
+            /// the most likely to be hit.
+            ///
+        static unsigned Collapse(Tree& dst, const SAHBuilder& builder, unsigned binaryNode)
+        {
+            unsigned children[4];
+            unsigned childCount = 0;
+            const auto& root = builder._nodes[binaryNode];
+            if (root._triangleCount) {
+                children[childCount++] = binaryNode;
+            } else {
+                children[childCount++] = root._children[0];
+                children[childCount++] = root._children[1];
+                while (childCount < 4) {
+                    unsigned bestChild = ~unsigned(0x0);
+                    float bestArea = -1.f;
+                    for (unsigned c=0; c<childCount; ++c) {
+                        const auto& child = builder._nodes[children[c]];
+                        if (child._triangleCount) { continue; }
+                        auto area = SurfaceArea(child._mins, child._maxs);
+                        if (area > bestArea) { bestArea = area; bestChild = c; }
+                    }
+                    if (bestChild == ~unsigned(0x0)) { break; }
+
+                    const auto& expand = builder._nodes[children[bestChild]];
+                    children[bestChild] = expand._children[0];
+                    children[childCount++] = expand._children[1];
+                }
+            }
+
+            const unsigned nodeIndex = (unsigned)dst._nodes.size();
+            dst._nodes.push_back(Internal::Node());
+
+            unsigned encodedChildren[4];
+            for (unsigned c=0; c<childCount; ++c) {
+                const auto& child = builder._nodes[children[c]];
+                encodedChildren[c] = child._triangleCount
+                    ? AddLeaf(dst, builder, child)
+                    : Collapse(dst, builder, children[c]);
+            }
+
+                //  (recursion above can reallocate _nodes, so we fill in the node last)
+            auto& node = dst._nodes[nodeIndex];
+            XlZeroMemory(node);
+            for (unsigned c=0; c<4; ++c) {
+                node._children[c] = ~unsigned(0x0);
+            }
+            for (unsigned c=0; c<childCount; ++c) {
+                const auto& child = builder._nodes[children[c]];
+                for (unsigned a=0; a<3; ++a) {
+                    node._mins[a][c] = child._mins[a];
+                    node._maxs[a][c] = child._maxs[a];
+                }
+                node._children[c] = encodedChildren[c];
+            }
+            node._childCount = childCount;
+            return nodeIndex;
+        }
+    }
+
+    static void BuildTree(Internal::Tree& tree)
+    {
+        tree._boundingBox = std::make_pair(Float3(0.f, 0.f, 0.f), Float3(0.f, 0.f, 0.f));
+
+        if (!tree._triangles.empty()) {
+            Internal::SAHBuilder builder;
+            builder._triangles.resize(tree._triangles.size());
+            for (unsigned t=0; t<(unsigned)tree._triangles.size(); ++t) {
+                const auto& src = tree._triangles[t];
+                auto& dst = builder._triangles[t];
+                dst._mins = dst._maxs = src._corners[0];
+                Internal::AddToBounds(dst._mins, dst._maxs, src._corners[1], src._corners[1]);
+                Internal::AddToBounds(dst._mins, dst._maxs, src._corners[2], src._corners[2]);
+                dst._centroid = .5f * (dst._mins + dst._maxs);
+                dst._index = t;
+            }
+
+            builder._nodes.reserve(2 * builder._triangles.size() / s_maxLeafTriangles + 1);
+            auto root = builder.Build(0, (unsigned)builder._triangles.size(), 0);
+            Internal::Collapse(tree, builder, root);
+            tree._boundingBox = std::make_pair(builder._nodes[root]._mins, builder._nodes[root]._maxs);
+        }
+    }
+
+    ModelBVH::ModelBVH(const ModelScaffold& scaffold, const MaterialScaffold* material, unsigned levelOfDetail)
+    {
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_validation = &scaffold.GetDependencyValidation();
+        pimpl->_validationIndex = scaffold.GetDependencyValidation().GetValidationIndex();
+        pimpl->_materialValidation = material ? &material->GetDependencyValidation() : nullptr;
+        pimpl->_materialValidationIndex = material ? material->GetDependencyValidation().GetValidationIndex() : 0;
+        LoadTriangles(pimpl->_tree, scaffold, material, levelOfDetail);
+        BuildTree(pimpl->_tree);
+        _pimpl = std::move(pimpl);
+    }
+
+    ModelBVH::ModelBVH(
+        const Float3 positions[], const unsigned indices[], size_t indexCount,
+        const unsigned drawCallIndices[], const std::vector<bool>& alphaTestedDrawCalls)
+    {
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_validation = pimpl->_materialValidation = nullptr;
+        pimpl->_validationIndex = pimpl->_materialValidationIndex = 0;
+        pimpl->_tree._triangles.reserve(indexCount/3);
+        for (size_t i=0; i+2<indexCount; i+=3) {
+            Internal::Triangle tri;
+            for (unsigned c=0; c<3; ++c) { tri._corners[c] = positions[indices[i+c]]; }
+            tri._drawCallIndex = drawCallIndices ? drawCallIndices[i/3] : 0;
+            pimpl->_tree._triangles.push_back(tri);
+        }
+        pimpl->_tree._alphaTestedDrawCalls = alphaTestedDrawCalls;
+        BuildTree(pimpl->_tree);
+        _pimpl = std::move(pimpl);
+    }
+
+    ModelBVH::~ModelBVH() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //      q u e r i e s         //
+
+    namespace Internal
+    {
+        class SegmentQuery
+        {
+        public:
+            Float3      _origin;
+            Float3      _direction;         // (not normalized; t=1 is the end of the segment)
+            Float3      _invDirection;
+            float       _minT;
+            float       _worldSpaceLength;
+        };
+
+        static bool MakeSegmentQuery(
+            SegmentQuery& query, const std::pair<Float3, Float3>& worldSpaceSegment,
+            const Float4x4& modelToWorld)
+        {
+            query._worldSpaceLength = Magnitude(worldSpaceSegment.second - worldSpaceSegment.first);
+            if (!(query._worldSpaceLength > 0.f)) { return false; }
+
+                //  Intersection parameters along the segment are the same in both spaces
+                //  (even with scale in "modelToWorld")
+            auto worldToModel = Inverse(modelToWorld);
+            query._origin = TransformPoint(worldToModel, worldSpaceSegment.first);
+            query._direction = TransformPoint(worldToModel, worldSpaceSegment.second) - query._origin;
+            for (unsigned c=0; c<3; ++c) {
+                    // avoid infinities (and "0 * infinity") in the box tests
+                float d = query._direction[c];
+                if (XlAbs(d) < 1e-20f) { d = (d < 0.f) ? -1e-20f : 1e-20f; }
+                query._invDirection[c] = 1.f / d;
+            }
+
+                // (same epsilon as the GPU version, in raytest.gsh)
+            query._minT = 0.00001f / query._worldSpaceLength;
+            return true;
+        }
+
+        #if defined(MODELBVH_SSE)
+
+            static unsigned SegmentVsBoxes(
+                const Internal::Node& node, const SegmentQuery& query,
+                float maxT, float nearT[4])
+            {
+                auto tNear = _mm_setzero_ps();
+                auto tFar = _mm_set1_ps(maxT);
+                for (unsigned a=0; a<3; ++a) {
+                    auto origin = _mm_set1_ps(query._origin[a]);
+                    auto invDirection = _mm_set1_ps(query._invDirection[a]);
+                    auto t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node._mins[a]), origin), invDirection);
+                    auto t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node._maxs[a]), origin), invDirection);
+                    tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+                    tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+                }
+                _mm_storeu_ps(nearT, tNear);
+                return unsigned(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar))) & ((1u << node._childCount) - 1);
+            }
+
+            static unsigned SegmentVsTriangles(
+                const Internal::TrianglePacket& packet, const SegmentQuery& query,
+                float maxT, float t[4], float u[4], float v[4])
+            {
+                    //  Moller-Trumbore, without back face culling (matching raytest.gsh)
+                auto dx = _mm_set1_ps(query._direction[0]);
+                auto dy = _mm_set1_ps(query._direction[1]);
+                auto dz = _mm_set1_ps(query._direction[2]);
+                auto e1x = _mm_loadu_ps(packet._e1[0]), e1y = _mm_loadu_ps(packet._e1[1]), e1z = _mm_loadu_ps(packet._e1[2]);
+                auto e2x = _mm_loadu_ps(packet._e2[0]), e2y = _mm_loadu_ps(packet._e2[1]), e2z = _mm_loadu_ps(packet._e2[2]);
+
+                auto hx = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+                auto hy = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+                auto hz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+                auto a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, hx), _mm_mul_ps(e1y, hy)), _mm_mul_ps(e1z, hz));
+                auto f = _mm_div_ps(_mm_set1_ps(1.f), a);
+
+                auto sx = _mm_sub_ps(_mm_set1_ps(query._origin[0]), _mm_loadu_ps(packet._v0[0]));
+                auto sy = _mm_sub_ps(_mm_set1_ps(query._origin[1]), _mm_loadu_ps(packet._v0[1]));
+                auto sz = _mm_sub_ps(_mm_set1_ps(query._origin[2]), _mm_loadu_ps(packet._v0[2]));
+                auto uu = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, hx), _mm_mul_ps(sy, hy)), _mm_mul_ps(sz, hz)));
+
+                auto qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+                auto qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+                auto qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+                auto vv = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)));
+                auto tt = _mm_mul_ps(f, _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)));
+
+                auto zero = _mm_setzero_ps();
+                auto mask = _mm_cmpneq_ps(a, zero);
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+                mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+                mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.f)));
+                mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, _mm_set1_ps(query._minT)));
+                mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_set1_ps(maxT)));
+
+                _mm_storeu_ps(t, tt);
+                _mm_storeu_ps(u, uu);
+                _mm_storeu_ps(v, vv);
+                return unsigned(_mm_movemask_ps(mask));
+            }
+
+        #else
+
+            static unsigned SegmentVsBoxes(
+                const Internal::Node& node, const SegmentQuery& query,
+                float maxT, float nearT[4])
+            {
+                unsigned result = 0;
+                for (unsigned c=0; c<node._childCount; ++c) {
+                    float tNear = 0.f, tFar = maxT;
+                    for (unsigned a=0; a<3; ++a) {
+                        float t0 = (node._mins[a][c] - query._origin[a]) * query._invDirection[a];
+                        float t1 = (node._maxs[a][c] - query._origin[a]) * query._invDirection[a];
+                        tNear = std::max(tNear, std::min(t0, t1));
+                        tFar = std::min(tFar, std::max(t0, t1));
+                    }
+                    nearT[c] = tNear;
+                    if (tNear <= tFar) { result |= 1u << c; }
+                }
+                return result;
+            }
+
+            static unsigned SegmentVsTriangles(
+                const Internal::TrianglePacket& packet, const SegmentQuery& query,
+                float maxT, float t[4], float u[4], float v[4])
+            {
+                    //  Moller-Trumbore, without back face culling (matching raytest.gsh)
+                unsigned result = 0;
+                for (unsigned lane=0; lane<4; ++lane) {
+                    Float3 e1(packet._e1[0][lane], packet._e1[1][lane], packet._e1[2][lane]);
+                    Float3 e2(packet._e2[0][lane], packet._e2[1][lane], packet._e2[2][lane]);
+                    Float3 v0(packet._v0[0][lane], packet._v0[1][lane], packet._v0[2][lane]);
+                    auto h = Cross(query._direction, e2);
+                    float a = Dot(e1, h);
+                    if (a == 0.f) { continue; }
+
+                    float f = 1.f / a;
+                    auto s = query._origin - v0;
+                    u[lane] = f * Dot(s, h);
+                    auto q = Cross(s, e1);
+                    v[lane] = f * Dot(query._direction, q);
+                    t[lane] = f * Dot(e2, q);
+                    if (    u[lane] >= 0.f && v[lane] >= 0.f && (u[lane] + v[lane]) <= 1.f
+                        &&  t[lane] > query._minT && t[lane] < maxT) {
+                        result |= 1u << lane;
+                    }
+                }
+                return result;
+            }
+
+        #endif
+
+        static ModelBVH::ResultEntry MakeResult(
+            const Internal::Triangle& tri, float t, float u, float v,
+            const SegmentQuery& query, const Float4x4& modelToWorld)
+        {
+            ModelBVH::ResultEntry result;
+            result._intersectionDepth = t * query._worldSpaceLength;
+            result._pt[0] = Expand(TransformPoint(modelToWorld, tri._corners[0]), 1.f - u - v);
+            result._pt[1] = Expand(TransformPoint(modelToWorld, tri._corners[1]), u);
+            result._pt[2] = Expand(TransformPoint(modelToWorld, tri._corners[2]), v);
+            result._drawCallIndex = tri._drawCallIndex;
+            return result;
+        }
+    }
+
+    unsigned ModelBVH::FindAllIntersections(
+        std::vector<ResultEntry>& results,
+        const std::pair<Float3, Float3>& worldSpaceSegment,
+        const Float4x4& modelToWorld) const
+    {
+        Internal::SegmentQuery query;
+        if (_pimpl->_tree._nodes.empty() || !Internal::MakeSegmentQuery(query, worldSpaceSegment, modelToWorld)) {
+            return 0;
+        }
+
+        const auto startSize = results.size();
+        unsigned stack[s_maxStackDepth];
+        unsigned stackSize = 0;
+        stack[stackSize++] = 0;
+
+        while (stackSize) {
+            const auto& node = _pimpl->_tree._nodes[stack[--stackSize]];
+            float nearT[4];
+            auto hitMask = Internal::SegmentVsBoxes(node, query, 1.f, nearT);
+            for (unsigned c=0; c<node._childCount; ++c) {
+                if (!(hitMask & (1u << c))) { continue; }
+
+                auto child = node._children[c];
+                if (!(child & s_leafBit)) {
+                    assert(stackSize < s_maxStackDepth);
+                    stack[stackSize++] = child;
+                    continue;
+                }
+
+                const auto& leaf = _pimpl->_tree._leaves[child & ~s_leafBit];
+                for (unsigned p=0; p<leaf._packetCount; ++p) {
+                    const auto& packet = _pimpl->_tree._packets[leaf._firstPacket + p];
+                    float t[4], u[4], v[4];
+                    auto triMask = Internal::SegmentVsTriangles(packet, query, 1.f, t, u, v);
+                    for (unsigned lane=0; lane<4; ++lane) {
+                        if (!(triMask & (1u << lane))) { continue; }
+                        const auto& tri = _pimpl->_tree._triangles[packet._triangles[lane]];
+                        if (_pimpl->_tree.IsAlphaTested(tri)) { continue; }
+                        results.push_back(Internal::MakeResult(tri, t[lane], u[lane], v[lane], query, modelToWorld));
+                    }
+                }
+            }
+        }
+
+        return unsigned(results.size() - startSize);
+    }
+
+    bool ModelBVH::FindFirstIntersection(
+        ResultEntry& result,
+        const std::pair<Float3, Float3>& worldSpaceSegment,
+        const Float4x4& modelToWorld,
+        bool* alphaTestedHitFirst) const
+    {
+        if (alphaTestedHitFirst) { *alphaTestedHitFirst = false; }
+
+        Internal::SegmentQuery query;
+        if (_pimpl->_tree._nodes.empty() || !Internal::MakeSegmentQuery(query, worldSpaceSegment, modelToWorld)) {
+            return false;
+        }
+
+            //  Nodes are visited nearest first, and we skip anything further away than
+            //  the closest hit so far. The stack records the distance to each node,
+            //  because the closest hit might have changed since it was pushed.
+        std::pair<unsigned, float> stack[s_maxStackDepth];
+        unsigned stackSize = 0;
+        stack[stackSize++] = std::make_pair(0u, 0.f);
+
+        float bestT = 1.f;
+        unsigned bestTriangle = ~unsigned(0x0);
+        float bestU = 0.f, bestV = 0.f;
+
+            //  Alpha tested triangles are never the result, but we track the closest one
+            //  (anything further than "bestT" can't be in front of the result anyway)
+        float alphaTestedT = FLT_MAX;
+
+        while (stackSize) {
+            auto entry = stack[--stackSize];
+            if (entry.second >= bestT) { continue; }
+
+            const auto& node = _pimpl->_tree._nodes[entry.first];
+            float nearT[4];
+            auto hitMask = Internal::SegmentVsBoxes(node, query, bestT, nearT);
+
+            std::pair<unsigned, float> interiorHits[4];
+            unsigned interiorHitCount = 0;
+            for (unsigned c=0; c<node._childCount; ++c) {
+                if (!(hitMask & (1u << c))) { continue; }
+
+                auto child = node._children[c];
+                if (!(child & s_leafBit)) {
+                    interiorHits[interiorHitCount++] = std::make_pair(child, nearT[c]);
+                    continue;
+                }
+
+                const auto& leaf = _pimpl->_tree._leaves[child & ~s_leafBit];
+                for (unsigned p=0; p<leaf._packetCount; ++p) {
+                    const auto& packet = _pimpl->_tree._packets[leaf._firstPacket + p];
+                    float t[4], u[4], v[4];
+                    auto triMask = Internal::SegmentVsTriangles(packet, query, bestT, t, u, v);
+                    for (unsigned lane=0; lane<4; ++lane) {
+                        if (!(triMask & (1u << lane)) || t[lane] >= bestT) { continue; }
+                        if (_pimpl->_tree.IsAlphaTested(_pimpl->_tree._triangles[packet._triangles[lane]])) {
+                            alphaTestedT = std::min(alphaTestedT, t[lane]);
+                            continue;
+                        }
+                        bestT = t[lane]; bestU = u[lane]; bestV = v[lane];
+                        bestTriangle = packet._triangles[lane];
+                    }
+                }
+            }
+
+                //  push furthest first, so the nearest is popped next
+            std::sort(interiorHits, &interiorHits[interiorHitCount],
+                [](const std::pair<unsigned, float>& lhs, const std::pair<unsigned, float>& rhs) { return lhs.second > rhs.second; });
+            for (unsigned c=0; c<interiorHitCount; ++c) {
+                assert(stackSize < s_maxStackDepth);
+                stack[stackSize++] = interiorHits[c];
+            }
+        }
+
+        if (alphaTestedHitFirst) { *alphaTestedHitFirst = alphaTestedT < bestT; }
+        if (bestTriangle == ~unsigned(0x0)) {
+            return false;
+        }
+
+        result = Internal::MakeResult(_pimpl->_tree._triangles[bestTriangle], bestT, bestU, bestV, query, modelToWorld);
+        return true;
+    }
+
+    unsigned ModelBVH::GetTriangleCount() const
+    {
+        return (unsigned)_pimpl->_tree._triangles.size();
+    }
+
+    std::pair<Float3, Float3> ModelBVH::GetBoundingBox() const
+    {
+        return _pimpl->_tree._boundingBox;
+    }
+
+    bool ModelBVH::IsBuiltFrom(const ModelScaffold& scaffold, const MaterialScaffold* material) const
+    {
+        if (    _pimpl->_validation != &scaffold.GetDependencyValidation()
+            ||  _pimpl->_validationIndex != scaffold.GetDependencyValidation().GetValidationIndex()) {
+            return false;
+        }
+        if (!material) { return !_pimpl->_materialValidation; }
+        return  _pimpl->_materialValidation == &material->GetDependencyValidation()
+            &&  _pimpl->_materialValidationIndex == material->GetDependencyValidation().GetValidationIndex();
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class ModelBVHCache::Pimpl
+    {
+    public:
+        Threading::Mutex    _lock;
+        LRUCache<ModelBVH>  _cache;
+
+        Pimpl(unsigned cacheSize) : _cache(cacheSize) {}
+    };
+
+    std::shared_ptr<ModelBVH> ModelBVHCache::Get(const ModelScaffold& scaffold, const MaterialScaffold* material, unsigned levelOfDetail)
+    {
+            //  The material decides which draw calls are alpha tested, so the same model
+            //  with different materials needs different trees
+        auto hash = Hash64(scaffold.Filename(), uint64(size_t(material))) + levelOfDetail;
+        {
+            ScopedLock(_pimpl->_lock);
+            auto& existing = _pimpl->_cache.Get(hash);
+            if (existing && existing->IsBuiltFrom(scaffold, material)) {
+                return existing;
+            }
+        }
+
+            //  If 2 threads build the same tree at the same time, the last one
+            //  to finish replaces the other (but both results are valid)
+        auto newTree = std::make_shared<ModelBVH>(scaffold, material, levelOfDetail);
+        {
+            ScopedLock(_pimpl->_lock);
+            _pimpl->_cache.Insert(hash, newTree);
+        }
+        return std::move(newTree);
+    }
+
+    ModelBVHCache::ModelBVHCache(unsigned cacheSize)
+    {
+        _pimpl = std::make_unique<Pimpl>(cacheSize);
+    }
+
+    ModelBVHCache::~ModelBVHCache() {}
+}
+
@@ -0,0 +1,115 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "RayVsModel.h"
+#include "../Math/Matrix.h"
+#include "../Math/Vector.h"
+#include "../Utility/Mixins.h"
+#include <memory>
+#include <vector>
+
+namespace RenderCore { namespace Assets { class ModelScaffold; class MaterialScaffold; }}
+
+namespace SceneEngine
+{
+        ///
+        /// <summary>Bounding volume hierarchy for the triangles in a model</summary>
+        ///
+        /// Built on the CPU from the vertex and index buffers of a ModelScaffold, for ray
+        /// tests that don't need a device context (see RayVsModelStateContext for the GPU
+        /// version). The tree is built with the surface area heuristic, and then collapsed
+        /// into nodes with 4 children, so traversal can test a ray against 4 bounding boxes
+        /// (or 4 triangles) at once with SSE.
+        ///
+        /// Triangles are in model space, with identity mesh-to-model transforms (which is
+        /// how placements are rendered). Skinned geometry is in its bind pose.
+        ///
+        /// Results are the same as RayVsModelStateContext::GetResults(): the depth is the
+        /// world space distance from the start of the segment, and _pt holds the world space
+        /// corners of the triangle, with the barycentric coordinates of the intersection in W.
+        /// Draw call indices count the draw calls of the level of detail in the order that
+        /// ModelRenderer draws them (assuming every draw call has a material). Like the GPU
+        /// version, both front and back faces are hit.
+        ///
+        /// Alpha test isn't supported. When the tree is built with a material scaffold, the
+        /// draw calls with "MAT_ALPHA_TEST" materials are recorded, and their triangles are
+        /// never returned as hits. FindFirstIntersection() can report when one of those is
+        /// in front of the result, so the caller can use RayVsModelStateContext instead.
+        ///
+        /// The tree is immutable after construction, so queries are thread safe.
+        ///
+    class ModelBVH : noncopyable
+    {
+    public:
+        typedef RayVsModelStateContext::ResultEntry ResultEntry;
+
+            /// <summary>Finds every intersection between a segment and the model</summary>
+            /// Results are appended to "results" in no particular order. Returns the number
+            /// of results appended.
+        unsigned    FindAllIntersections(
+                        std::vector<ResultEntry>& results,
+                        const std::pair<Float3, Float3>& worldSpaceSegment,
+                        const Float4x4& modelToWorld) const;
+
+            /// <summary>Finds the intersection closest to the start of a segment</summary>
+            /// Returns false if the segment doesn't hit the model (and "result" is unchanged).
+            /// If "alphaTestedHitFirst" isn't null, it's set to true when the segment hits an
+            /// alpha tested draw call closer than the result (or hits one, and nothing else).
+        bool        FindFirstIntersection(
+                        ResultEntry& result,
+                        const std::pair<Float3, Float3>& worldSpaceSegment,
+                        const Float4x4& modelToWorld,
+                        bool* alphaTestedHitFirst = nullptr) const;
+
+        unsigned                    GetTriangleCount() const;
+        std::pair<Float3, Float3>   GetBoundingBox() const;
+
+            /// <summary>Returns true if this tree was built from the given scaffolds, and they haven't changed since</summary>
+        bool                        IsBuiltFrom(
+                                        const RenderCore::Assets::ModelScaffold& scaffold,
+                                        const RenderCore::Assets::MaterialScaffold* material = nullptr) const;
+
+            /// "material" is only used to find the alpha tested draw calls (it can be null).
+        ModelBVH(   const RenderCore::Assets::ModelScaffold& scaffold, 
+                    const RenderCore::Assets::MaterialScaffold* material = nullptr,
+                    unsigned levelOfDetail = 0);
+
+            /// <summary>Builds a tree from a model space triangle list (3 indices per triangle)</summary>
+            /// "drawCallIndices" has the draw call index for each triangle (if it's null, every
+            /// triangle gets draw call index 0). "alphaTestedDrawCalls" has a flag for each draw
+            /// call. Not built from a scaffold, so IsBuiltFrom() is always false.
+        ModelBVH(   const Float3 positions[], const unsigned indices[], size_t indexCount,
+                    const unsigned drawCallIndices[] = nullptr,
+                    const std::vector<bool>& alphaTestedDrawCalls = std::vector<bool>());
+        ~ModelBVH();
+    protected:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+
+        /// <summary>Builds and caches a ModelBVH for each model and material</summary>
+        /// Trees are rebuilt when the scaffolds they were built from are invalidated. The
+        /// least recently used trees are released when the cache is full.
+        /// Get() is thread safe. Trees are built outside of the lock, so threads looking
+        /// up other models aren't held up by a build.
+    class ModelBVHCache : noncopyable
+    {
+    public:
+        std::shared_ptr<ModelBVH>   Get(
+                                        const RenderCore::Assets::ModelScaffold& scaffold,
+                                        const RenderCore::Assets::MaterialScaffold* material = nullptr,
+                                        unsigned levelOfDetail = 0);
+
+        ModelBVHCache(unsigned cacheSize = 500);
+        ~ModelBVHCache();
+    protected:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+}
+
@@ -11,6 +11,8 @@
 #include "PlacementsManager.h"
 #include "PlacementsQuadTree.h"
 #include "LightingParserContext.h"
+#include "ModelBVH.h"
+#include "IntersectionTestInternal.h"
 #include "../RenderCore/Assets/SharedStateSet.h"
 
 #if MODEL_FORMAT == MODEL_FORMAT_RUNTIME
@@ -45,6 +47,7 @@
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/DataSerialize.h"
 #include "../Utility/Streams/PathUtils.h"
+#include "../Utility/Threading/ParallelFor.h"
 #include "../Core/Types.h"
 
 #include <random>
@@ -317,6 +320,9 @@ namespace SceneEngine
         typedef ModelRenderer::SortedModelDrawCalls PreparedState;
         
         auto GetCachedModel(const ResChar filename[]) -> const ModelScaffold&;
+        auto GetCachedMaterial(const ResChar filename[]) -> const MaterialScaffold*;
+        auto GetCachedModelBVH(const ResChar modelFilename[], const ResChar materialFilename[]) -> std::shared_ptr<ModelBVH>;
+        auto GetCachedModelBVH(const ModelScaffold& model, const MaterialScaffold* material) -> std::shared_ptr<ModelBVH>;
         auto GetCachedPlacements(uint64 hash, const ResChar filename[]) -> const Placements&;
         void SetOverride(uint64 guid, const Placements* placements);
         auto GetModelFormat() -> std::shared_ptr<RenderCore::Assets::IModelFormat>& { return _modelFormat; }
@@ -332,6 +338,7 @@ namespace SceneEngine
             LRUCache<ModelScaffold>             _modelScaffolds;
             LRUCache<MaterialScaffold>          _materialScaffolds;
             LRUCache<ModelRenderer>             _modelRenderers;
+            ModelBVHCache                       _modelBVHs;
             RenderCore::Assets::SharedStateSet  _sharedStates;
             PreparedState                       _preparedRenders;
 
@@ -464,6 +471,42 @@ namespace SceneEngine
         return *model;
     }
 
+    auto PlacementsRenderer::GetCachedMaterial(const ResChar filename[]) -> const MaterialScaffold*
+    {
+            //  Returns null if the material can't be loaded (like Render(), we 
+            //  sometimes get missing files)
+        auto hash = Hash64(filename);
+        auto material = _cache->_materialScaffolds.Get(hash);
+        if (!material) {
+            TRY {
+                material = Internal::CreateMaterialScaffold(filename, *_modelFormat);
+            } CATCH (...) {
+                return nullptr;
+            } CATCH_END
+            _cache->_materialScaffolds.Insert(hash, material);
+        }
+        return material.get();
+    }
+
+    auto PlacementsRenderer::GetCachedModelBVH(const ResChar modelFilename[], const ResChar materialFilename[]) -> std::shared_ptr<ModelBVH>
+    {
+        #if MODEL_FORMAT == MODEL_FORMAT_RUNTIME
+            return GetCachedModelBVH(GetCachedModel(modelFilename), GetCachedMaterial(materialFilename));
+        #else
+            return nullptr;
+        #endif
+    }
+
+    auto PlacementsRenderer::GetCachedModelBVH(const ModelScaffold& model, const MaterialScaffold* material) -> std::shared_ptr<ModelBVH>
+    {
+            // (this is thread safe, because the BVH cache has its own lock)
+        #if MODEL_FORMAT == MODEL_FORMAT_RUNTIME
+            return _cache->_modelBVHs.Get(model, material);
+        #else
+            return nullptr;
+        #endif
+    }
+
     auto PlacementsRenderer::GetCachedPlacements(uint64 filenameHash, const ResChar filename[]) -> const Placements&
     {
         auto i = LowerBound(_cellOverrides, filenameHash);
@@ -742,6 +785,9 @@ namespace SceneEngine
         
         __declspec(align(16)) auto cellToCullSpace = Combine(cellToWorld, parserContext.GetProjectionDesc()._worldToProjection);
         auto cameraPosition = ExtractTranslation(parserContext.GetProjectionDesc()._cameraToWorld);
+        #if MODEL_FORMAT == MODEL_FORMAT_RUNTIME
+            _cache->_preparedRenders.SetViewPosition(cameraPosition);
+        #endif
         cameraPosition = TransformPoint(InvertOrthonormalTransform(cellToWorld), cameraPosition);
 
         const uint64* filterIterator = filterStart;
@@ -1144,6 +1190,191 @@ namespace SceneEngine
         return std::move(result);
     }
 
+    namespace Internal
+    {
+        class RayTestModel
+        {
+        public:
+            const ModelScaffold*        _scaffold;
+            const MaterialScaffold*     _material;
+            std::pair<Float3, Float3>   _localBoundingBox;
+        };
+
+        class RayTestObject
+        {
+        public:
+            Float4x4                    _localToCell;
+            Float4x4                    _localToWorld;
+            std::pair<Float3, Float3>   _cellSpaceBoundary;
+            unsigned                    _model;
+            PlacementGUID               _guid;
+        };
+
+        class RayTestCell
+        {
+        public:
+            Float3x4    _worldToCell;
+            Float3      _mins, _maxs;
+            unsigned    _objectsBegin, _objectsEnd;
+        };
+    }
+
+    void PlacementsEditor::Find_FirstRayIntersections(
+        std::pair<PlacementGUID, float> results[],
+        const std::pair<Float3, Float3> rays[], size_t rayCount,
+        unsigned threadCount)
+    {
+        for (size_t c=0; c<rayCount; ++c) {
+            results[c] = std::make_pair(PlacementGUID(0ull, 0ull), FLT_MAX);
+        }
+        if (!rayCount) { return; }
+
+            //  Find the cells that might be hit by any ray in the batch. The rays are
+            //  split into chunks of adjacent rays, so most cells are rejected for a
+            //  whole chunk at a time. The culling here must match Find_RayIntersection,
+            //  so we get the same results as the single ray path.
+        const float placementAssumedMaxRadius = 100.f;
+        const Float3 cellPadding(placementAssumedMaxRadius, placementAssumedMaxRadius, placementAssumedMaxRadius);
+        Internal::RayChunks chunks(rays, rayCount);
+        std::vector<unsigned char> cellHit(_pimpl->_cells.size(), 0);
+        Threading::ParallelFor(
+            threadCount, unsigned(_pimpl->_cells.size()),
+            [&](unsigned c) {
+                const auto& registered = _pimpl->_cells[c];
+                cellHit[c] = chunks.AnyRayHits(registered._aabbMin - cellPadding, registered._aabbMax + cellPadding);
+            });
+
+            //  Gather the objects in those cells. This goes through the renderer's caches
+            //  (which aren't thread safe), so it's done once for the whole batch, on this thread.
+        std::vector<Internal::RayTestCell> cells;
+        std::vector<Internal::RayTestObject> objects;
+        std::vector<Internal::RayTestModel> models;
+        std::vector<std::pair<uint64, unsigned>> modelLookup;     // (keyed on both the model and material hashes)
+
+        for (auto i=_pimpl->_cells.cbegin(); i!=_pimpl->_cells.cend(); ++i) {
+            if (!cellHit[i - _pimpl->_cells.cbegin()]) { continue; }
+
+            Internal::RayTestCell cell;
+            cell._worldToCell = InvertOrthonormalTransform(i->_cellToWorld);
+            cell._mins = i->_aabbMin - cellPadding;
+            cell._maxs = i->_aabbMax + cellPadding;
+            cell._objectsBegin = cell._objectsEnd = unsigned(objects.size());
+
+            TRY {
+                auto& p = _pimpl->_renderer->GetCachedPlacements(i->_filenameHash, i->_filename);
+                for (unsigned c=0; c<p.GetObjectReferenceCount(); ++c) {
+                    auto& obj = p.GetObjectReferences()[c];
+
+                        //  Models are shared by many objects, so we only look up each 
+                        //  model once for the batch. The material decides which draw calls
+                        //  are alpha tested, so each model & material pair gets its own tree.
+                    auto modelHash = *(uint64*)PtrAdd(p.GetFilenamesBuffer(), obj._modelFilenameOffset);
+                    auto materialHash = *(uint64*)PtrAdd(p.GetFilenamesBuffer(), obj._materialFilenameOffset);
+                    auto modelAndMaterialHash = Hash64(&materialHash, PtrAdd(&materialHash, sizeof(materialHash)), modelHash);
+                    auto m = LowerBound(modelLookup, modelAndMaterialHash);
+                    if (m == modelLookup.end() || m->first != modelAndMaterialHash) {
+                        Internal::RayTestModel model;
+                        model._scaffold = nullptr;
+                        model._material = nullptr;
+                        TRY {
+                            auto& scaffold = _pimpl->_renderer->GetCachedModel(
+                                (const char*)PtrAdd(p.GetFilenamesBuffer(), obj._modelFilenameOffset + sizeof(uint64)));
+                            model._localBoundingBox = scaffold.GetStaticBoundingBox();
+                            model._scaffold = &scaffold;
+                            model._material = _pimpl->_renderer->GetCachedMaterial(
+                                (const char*)PtrAdd(p.GetFilenamesBuffer(), obj._materialFilenameOffset + sizeof(uint64)));
+                        } CATCH (...) {
+                        } CATCH_END
+                        m = modelLookup.insert(m, std::make_pair(modelAndMaterialHash, unsigned(models.size())));
+                        models.push_back(model);
+                    }
+                    if (!models[m->second]._scaffold) { continue; }
+
+                    Internal::RayTestObject o;
+                    o._localToCell = AsFloat4x4(obj._localToCell);
+                    o._localToWorld = AsFloat4x4(Combine(obj._localToCell, i->_cellToWorld));
+                    o._cellSpaceBoundary = obj._cellSpaceBoundary;
+                    o._model = m->second;
+                    o._guid = std::make_pair(i->_filenameHash, obj._guid);
+                    objects.push_back(o);
+                }
+            } CATCH (...) {
+            } CATCH_END
+
+            cell._objectsEnd = unsigned(objects.size());
+            if (cell._objectsEnd > cell._objectsBegin) {
+                cells.push_back(cell);
+            }
+        }
+
+        if (cells.empty()) { return; }
+
+            //  Now test the rays against the objects in worker threads. Each thread 
+            //  pulls the next chunk of rays from the list. Adjacent rays are normally 
+            //  close together (the caller should sort them), so they should touch 
+            //  the same objects and tree nodes.
+        auto& renderer = *_pimpl->_renderer;
+
+        Threading::ParallelFor(
+            threadCount, chunks.GetChunkCount(),
+            [&](unsigned chunk) {
+                    //  Each chunk keeps its own table of trees, so we don't go through
+                    //  the lock in the tree cache for every object we test
+                std::vector<std::shared_ptr<ModelBVH>> bvhs(models.size());
+                std::vector<bool> bvhLookedUp(models.size(), false);
+
+                std::vector<const Internal::RayTestCell*> chunkCells;
+                for (const auto& cell:cells) {
+                    if (chunks.MightHit(chunk, cell._mins, cell._maxs)) { chunkCells.push_back(&cell); }
+                }
+
+                for (auto r=chunks.GetChunkBegin(chunk); r<chunks.GetChunkEnd(chunk); ++r) {
+                    const auto& ray = rays[r];
+                    auto& result = results[r];
+
+                    for (const auto* cellPtr:chunkCells) {
+                        const auto& cell = *cellPtr;
+                        if (!RayVsAABB(ray, cell._mins, cell._maxs)) { continue; }
+
+                        auto cellSpaceRay = std::make_pair(
+                            TransformPoint(cell._worldToCell, ray.first),
+                            TransformPoint(cell._worldToCell, ray.second));
+
+                        for (auto o=cell._objectsBegin; o<cell._objectsEnd; ++o) {
+                            const auto& obj = objects[o];
+                            if (!RayVsAABB(cellSpaceRay, obj._cellSpaceBoundary.first, obj._cellSpaceBoundary.second)) {
+                                continue;
+                            }
+
+                            const auto& model = models[obj._model];
+                            if (!RayVsAABB(cellSpaceRay, obj._localToCell, model._localBoundingBox.first, model._localBoundingBox.second)) {
+                                continue;
+                            }
+
+                            if (!bvhLookedUp[obj._model]) {
+                                TRY {
+                                    bvhs[obj._model] = renderer.GetCachedModelBVH(*model._scaffold, model._material);
+                                } CATCH (...) {
+                                } CATCH_END
+                                bvhLookedUp[obj._model] = true;
+                            }
+
+                            auto* bvh = bvhs[obj._model].get();
+                            if (!bvh) { continue; }
+
+                                //  There's no GPU fallback here, so alpha tested draw calls are
+                                //  just skipped (rays go through them)
+                            ModelBVH::ResultEntry intersection;
+                            if (    bvh->FindFirstIntersection(intersection, ray, obj._localToWorld)
+                                &&  intersection._intersectionDepth < result.second) {
+                                result = std::make_pair(obj._guid, intersection._intersectionDepth);
+                            }
+                        }
+                    }
+                }
+            });
+    }
+
     std::vector<PlacementGUID> PlacementsEditor::Find_BoxIntersection(
         const Float3& worldSpaceMins, const Float3& worldSpaceMaxs,
         const std::function<bool(const ObjIntersectionDef&)>& predicate)
@@ -1671,6 +1902,11 @@ namespace SceneEngine
         return model.GetStaticBoundingBox();
     }
 
+    std::shared_ptr<ModelBVH> PlacementsEditor::GetModelBVH(const ResChar modelName[], const ResChar materialName[]) const
+    {
+        return _pimpl->_renderer->GetCachedModelBVH(modelName, materialName);
+    }
+
     auto PlacementsEditor::Transaction_Begin(
         const PlacementGUID* placementsBegin, 
         const PlacementGUID* placementsEnd) -> std::shared_ptr<ITransaction>
@@ -19,6 +19,7 @@ namespace RenderCore { namespace Assets { class IModelFormat; } }
 namespace SceneEngine
 {
     class LightingParserContext;
+    class ModelBVH;
 
     class WorldPlacementsConfig
     {
@@ -130,6 +131,21 @@ namespace SceneEngine
             const Float3& rayStart, const Float3& rayEnd,
             const std::function<bool(const ObjIntersectionDef&)>& predicate = nullptr);
 
+            /// <summary>Finds the closest placement hit by each ray in a batch</summary>
+            /// Rays are tested against the triangles of the models on the CPU (see ModelBVH),
+            /// spread across "threadCount" threads (0 means one per hardware thread). The cells
+            /// and models that could be hit are looked up once for the whole batch, so this is
+            /// much cheaper than many calls to Find_RayIntersection. Rays that are close together
+            /// should be adjacent in the array.
+            ///
+            /// "results" gets one entry per ray: the placement hit, and the world space distance
+            /// from the start of the ray to the intersection. Rays that don't hit anything get a 
+            /// zero guid and FLT_MAX.
+        void Find_FirstRayIntersections(
+            std::pair<PlacementGUID, float> results[],
+            const std::pair<Float3, Float3> rays[], size_t rayCount,
+            unsigned threadCount = 0);
+
         void RenderFiltered(
             RenderCore::Metal::DeviceContext* context,
             LightingParserContext& parserContext,
@@ -145,6 +161,12 @@ namespace SceneEngine
         std::shared_ptr<RenderCore::Assets::IModelFormat> GetModelFormat();
         std::pair<Float3, Float3> GetModelBoundingBox(const Assets::ResChar modelName[]) const;
 
+            /// <summary>Returns a tree of the model's triangles, for ray tests on the CPU</summary>
+            /// Trees are cached, so they are only built the first time a model is tested.
+            /// The material is used to find the alpha tested draw calls (see ModelBVH).
+            /// Returns null if the model format doesn't support it.
+        std::shared_ptr<ModelBVH> GetModelBVH(const Assets::ResChar modelName[], const Assets::ResChar materialName[]) const;
+
         PlacementsEditor(std::shared_ptr<PlacementsRenderer> renderer);
         ~PlacementsEditor();
     protected:
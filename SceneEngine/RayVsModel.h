@@ -20,6 +20,11 @@ namespace SceneEngine
     class RayVsModelResources;
     class LightingParserContext;
 
+        /// <summary>Finds intersections between a ray and models, using the GPU</summary>
+        /// Models are rendered with a geometry shader that tests each triangle against
+        /// the ray, and writes the hits into a stream output buffer (so there can be no
+        /// more than s_maxResultCount results). See ModelBVH for a version that runs on
+        /// the CPU, and doesn't need a device context.
     class RayVsModelStateContext
     {
     public:
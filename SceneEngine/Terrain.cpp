@@ -7,6 +7,7 @@
 #include "Terrain.h"
 #include "TerrainInternal.h"
 #include "TerrainUberSurface.h"
+#include "TerrainCompression.h"
 
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/PtrUtils.h"
@@ -67,19 +68,11 @@ namespace SceneEngine
 
         for (unsigned n=0; n<dimof(sourceNodes); ++n) {
             const Node& node = *_nodes[sourceNodes[n]];
-            if (node._heightMapFileSize > 0) {
-                if (node._heightMapFileSize == expectingSize) {
-                    sourceFile.Seek(node._heightMapFileOffset, SEEK_SET);
-                    sourceFile.Read(sourceData.get(), 2, nodeDim*nodeDim);
-                } else {
-                        //  some nodes have holes... These aren't fully supported.
-                        //  just use the lowest valid height
-                    XlSetMemory(sourceData.get(), 0, expectingSize);
-                }
-            } else {
-                assert(node._secondaryCacheSize == expectingSize);
-                secondaryCache.Seek(node._secondaryCacheOffset, SEEK_SET);
-                secondaryCache.Read(sourceData.get(), 2, nodeDim*nodeDim);
+            assert(node._heightMapFileSize || node._secondaryCacheSize == expectingSize);
+            if (!TerrainCompression::LoadNodeHeights((uint16*)sourceData.get(), node, sourceFile, &secondaryCache)) {
+                    //  some nodes have holes... These aren't fully supported.
+                    //  just use the lowest valid height
+                XlSetMemory(sourceData.get(), 0, expectingSize);
             }
 
             for (unsigned y=0; y<nodeDim; ++y)
@@ -135,7 +128,15 @@ namespace SceneEngine
     : _localToCell(localToCell), _heightMapFileOffset(heightMapFileOffset), _heightMapFileSize(heightMapFileSize)
     , _secondaryCacheOffset(0x0), _secondaryCacheSize(0x0)
     , _widthInElements(widthInElements)
+    , _encoding(Encoding::Raw)
+    {
+    }
+
+    size_t TerrainCell::Node::GetHeightDataSize() const
     {
+        if (_heightMapFileSize && _encoding != Encoding::Raw)
+            return _widthInElements*_widthInElements*sizeof(uint16);
+        return std::max(_heightMapFileSize, _secondaryCacheSize);
     }
 
     //////////////////////////////////////////////////////////////////////////////////////////
@@ -130,6 +130,20 @@ namespace SceneEngine
             RenderCore::Metal::DeviceContext* context,
             LightingParserContext& parserContext);
 
+            /// <summary>Finds the first intersection between a ray and the terrain height map, on the CPU<summary>
+            ///
+            /// Unlike CalculateIntersections, this tests against the highest LOD of the height map
+            /// (the same heights returned by GetTerrainHeight). So the results don't change as the
+            /// camera moves, and no device context is required. Like CalculateIntersections, 
+            /// intersections with back faces aren't returned.
+            ///
+            /// This is thread safe. IntersectionTestScene uses it for both single and batched
+            /// ray tests (see IntersectionTestScene::FirstRayIntersections).
+            ///
+        bool CalculateHeightMapIntersection(
+            IntersectionResult& result,
+            std::pair<Float3, Float3> ray) const;
+
         TerrainUberSurfaceInterface*    GetUberSurfaceInterface();
         ISurfaceHeightsProvider*        GetHeightsProvider();
 
@@ -148,6 +162,10 @@ namespace SceneEngine
     };
 
     float   GetTerrainHeight(ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, Float2 queryPosition);
+    bool    FindTerrainHeightMapIntersection(
+                Float3& result,
+                ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, 
+                std::pair<Float3, Float3> ray);
 
     class TerrainCell;
     class TerrainCellTexture;
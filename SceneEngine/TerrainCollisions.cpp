@@ -6,11 +6,16 @@
 
 #include "Terrain.h"
 #include "TerrainInternal.h"
+#include "TerrainCollisions.h"
+#include "TerrainCompression.h"
 #include "../RenderCore/Resource.h"
 #include "../ConsoleRig/Log.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/HeapUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/Threading/Mutex.h"
 #include <memory>
+#include <algorithm>
 
 namespace SceneEngine
 {
@@ -18,6 +23,7 @@ namespace SceneEngine
     {
     public:
         float GetHeight(Float2 cellBasedCoord) const;
+        std::pair<float, float> GetHeightRange() const { return _heightRange; }
 
         const Assets::DependencyValidation& GetDependencyValidation() const   { return *_validationCallback; }
 
@@ -27,6 +33,7 @@ namespace SceneEngine
         TerrainCell::Node			_scaffoldData;
         std::unique_ptr<uint16[]>	_heightData;
         std::shared_ptr<Assets::DependencyValidation>  _validationCallback;
+        std::pair<float, float>     _heightRange;
 
         float GetHeightSample(Int2 coord) const;
     };
@@ -72,7 +79,7 @@ namespace SceneEngine
     }
 
     TerrainNodeHeightCollision::TerrainNodeHeightCollision(const char cellFilename[], ITerrainFormat& ioFormat, unsigned nodeIndex)
-        : _scaffoldData(Identity<Float4x4>(), 0, 0, 0)
+        : _scaffoldData(Identity<Float4x4>(), 0, 0, 0), _heightRange(0.f, 0.f)
     {
         auto& cell = ioFormat.LoadHeights(cellFilename);
         if (nodeIndex >= cell._nodes.size()) {
@@ -86,17 +93,27 @@ namespace SceneEngine
             //  a coordinate space defined by a single precision floating 
             //  point transform.
         auto& node = *cell._nodes[nodeIndex];
-        auto heightData = std::make_unique<uint16[]>(node._heightMapFileSize/2);
+        auto heightData = std::make_unique<uint16[]>(node._widthInElements*node._widthInElements);
         {
             BasicFile file(cellFilename, "rb");
-            file.Seek(node._heightMapFileOffset, SEEK_SET);
-            file.Read(heightData.get(), 1, node._heightMapFileSize);
+            if (!TerrainCompression::LoadNodeHeights(heightData.get(), node, file, nullptr))
+                XlSetMemory(heightData.get(), 0, node._widthInElements*node._widthInElements*sizeof(uint16));
         }
 
         auto validCallback = std::make_shared<Assets::DependencyValidation>();
         ::Assets::RegisterAssetDependency(validCallback, &cell.GetDependencyValidation());
         ::Assets::RegisterFileDependency(validCallback, cellFilename);
 
+            //  Record the range of heights in the node, so ray tests can skip
+            //  over it when the ray is entirely above or below
+        auto sampleCount = node._widthInElements*node._widthInElements;
+        if (sampleCount) {
+            auto minMax = std::minmax_element(heightData.get(), heightData.get() + sampleCount);
+            float h0 = float(*minMax.first) * node._localToCell(2, 2) + node._localToCell(2, 3);
+            float h1 = float(*minMax.second) * node._localToCell(2, 2) + node._localToCell(2, 3);
+            _heightRange = std::make_pair(std::min(h0, h1), std::max(h0, h1));
+        }
+
         _heightData = std::move(heightData);
         _validationCallback = std::move(validCallback);
         _scaffoldData = node;
@@ -107,53 +124,196 @@ namespace SceneEngine
 
     extern Int2 TerrainOffset;
 
-    float GetTerrainHeight(ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, Float2 queryPosition)
+    namespace Internal
     {
-        TRY
+            //  Cache of recently used TerrainNodeHeightCollision objects, so we don't
+            //  have to continually re-load the height data for every query. This is shared
+            //  by every query, on every thread. Nodes are loaded outside of the lock.
+        class TerrainCollisionCache
+        {
+        public:
+            std::shared_ptr<TerrainNodeHeightCollision> Get(
+                ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+                UInt2 cellIndex, unsigned nodeIndex);
+
+            TerrainCollisionCache() : _cache(64) {}
+        protected:
+            Threading::Mutex                        _lock;
+            LRUCache<TerrainNodeHeightCollision>    _cache;
+        };
+
+        std::shared_ptr<TerrainNodeHeightCollision> TerrainCollisionCache::Get(
+            ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+            UInt2 cellIndex, unsigned nodeIndex)
+        {
+            char cellFilename[MaxPath];
+            cfg.GetCellFilename(cellFilename, dimof(cellFilename), cellIndex, TerrainConfig::FileType::Heightmap);
+            auto hash = Hash64(cellFilename, nodeIndex);
+
+            {
+                ScopedLock(_lock);
+                auto& existing = _cache.Get(hash);
+                if (existing && existing->GetDependencyValidation().GetValidationIndex() == 0) {
+                    return existing;
+                }
+            }
+
+            auto newObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
+            {
+                ScopedLock(_lock);
+                _cache.Insert(hash, newObject);
+            }
+            return std::move(newObject);
+        }
+
+        static TerrainCollisionCache& GetCollisionCache()
+        {
+                //      -- \todo -- this cache should be in a manager object! todo many statics in functions!
+            static TerrainCollisionCache result;
+            return result;
+        }
+
+        class TerrainNodeRef
+        {
+        public:
+            UInt2       _cellIndex;
+            unsigned    _nodeIndex;
+            Float2      _cellFrac;
+        };
+
+        static bool FindTerrainNode(
+            TerrainNodeRef& result, const TerrainConfig& cfg, Float2 cellBasedCoord)
         {
                 //
                 //  Find the cell and node that contains this position.
-                //  Once we've found it, we need to find a cached TerrainNodeHeightCollision
-                //  for the given node, and get the height data from that.
                 //
                 //  We're going to make some assumptions to make this faster. 
                 //      * We'll assume that the cells are arranged in a grid, so we can find the cell quickly
                 //      * we'll also make similar assumptions about the arrangement of nodes within
                 //          the cell, so we can find the node index directly (within loading the cell node)
                 //  
-
-            auto terrainPosition = coords.WorldSpaceToTerrainCoords(queryPosition);
-            auto cellBasedCoord = cfg.TerrainCoordsToCellBasedCoords(terrainPosition);
             Float2 cellIndex(XlFloor(cellBasedCoord[0]), XlFloor(cellBasedCoord[1]));
 
             if (    cellIndex[0] < 0.f || cellIndex[0] >= float(cfg._cellCount[0])
                 ||  cellIndex[1] < 0.f || cellIndex[1] >= float(cfg._cellCount[1])) {
-                return 0.f;
+                return false;
             }
 
             Float2 cellFrac(cellBasedCoord[0] - cellIndex[0], cellBasedCoord[1] - cellIndex[1]);
         
             auto cellDimsInNodes = cfg.CellDimensionsInNodes();
-            float nodeX = XlFloor(cellFrac[0] * float(cellDimsInNodes[0]));
-            float nodeY = XlFloor(cellFrac[1] * float(cellDimsInNodes[1]));
-            unsigned nodeIndex = 85 + unsigned(nodeY) * cellDimsInNodes[0] + unsigned(nodeX);
+            unsigned nodeX = std::min(unsigned(cellFrac[0] * float(cellDimsInNodes[0])), cellDimsInNodes[0]-1);
+            unsigned nodeY = std::min(unsigned(cellFrac[1] * float(cellDimsInNodes[1])), cellDimsInNodes[1]-1);
 
-            uint64 cellHash = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 6ull) | uint64(cellIndex[0]);
+            result._cellIndex = UInt2(unsigned(cellIndex[0]), unsigned(cellIndex[1]));
+            result._nodeIndex = 85 + nodeY * cellDimsInNodes[0] + nodeX;
+            result._cellFrac = cellFrac;
+            return true;
+        }
 
-                // (simple cache for recently used terrain files -- so we don't have to continually re-load every frame)
-                //      -- \todo -- this cache should be in a manager object! todo many statics in functions!
-            static LRUCache<TerrainNodeHeightCollision> CollisionCache(8);
-            auto collisionObject = CollisionCache.Get(cellHash);
-            if (!collisionObject) {
-                char cellFilename[MaxPath];
-                cfg.GetCellFilename(cellFilename, dimof(cellFilename), UInt2(unsigned(cellIndex[0]), unsigned(cellIndex[1])), TerrainConfig::FileType::Heightmap);
-                collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
-                CollisionCache.Insert(cellHash, collisionObject);
+        static Float2 WorldSpaceToCellBasedCoords(
+            const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, Float2 queryPosition)
+        {
+            return cfg.TerrainCoordsToCellBasedCoords(coords.WorldSpaceToTerrainCoords(queryPosition));
+        }
+
+            //  Samples heights for a series of nearby queries (eg, along a ray), holding
+            //  onto the last node used, so we only go back to the shared cache when the 
+            //  queries move onto another node.
+        class TerrainHeightSampler
+        {
+        public:
+            bool GetHeight(float& result, Float2 queryPosition);
+            bool GetHeightCellBased(float& result, Float2 cellBasedCoord);
+            const TerrainNodeHeightCollision& GetNode(UInt2 cellIndex, unsigned nodeIndex);
+
+            TerrainHeightSampler(ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords)
+            : _ioFormat(&ioFormat), _cfg(&cfg), _coords(&coords)
+            , _lastCell(~0u, ~0u), _lastNodeIndex(~0u) {}
+        protected:
+            ITerrainFormat* _ioFormat;
+            const TerrainConfig* _cfg;
+            const TerrainCoordinateSystem* _coords;
+
+            std::shared_ptr<TerrainNodeHeightCollision> _lastNode;
+            UInt2 _lastCell;
+            unsigned _lastNodeIndex;
+        };
+
+        const TerrainNodeHeightCollision& TerrainHeightSampler::GetNode(UInt2 cellIndex, unsigned nodeIndex)
+        {
+            if (    nodeIndex != _lastNodeIndex 
+                ||  cellIndex[0] != _lastCell[0] || cellIndex[1] != _lastCell[1]) {
+                _lastNode = GetCollisionCache().Get(*_ioFormat, *_cfg, cellIndex, nodeIndex);
+                _lastCell = cellIndex;
+                _lastNodeIndex = nodeIndex;
+            }
+
+            assert(_lastNode);
+            return *_lastNode;
+        }
+
+        bool TerrainHeightSampler::GetHeightCellBased(float& result, Float2 cellBasedCoord)
+        {
+            TerrainNodeRef nodeRef;
+            if (!FindTerrainNode(nodeRef, *_cfg, cellBasedCoord)) {
+                return false;
             }
 
-            assert(collisionObject);
-            return collisionObject->GetHeight(cellFrac);
+            result = GetNode(nodeRef._cellIndex, nodeRef._nodeIndex).GetHeight(nodeRef._cellFrac);
+            return true;
+        }
 
+        bool TerrainHeightSampler::GetHeight(float& result, Float2 queryPosition)
+        {
+            return GetHeightCellBased(result, WorldSpaceToCellBasedCoords(*_cfg, *_coords, queryPosition));
+        }
+
+            //  The terrain height map, in the "node grid" space used by FindHeightFieldIntersection
+            //  (ie, cell based coordinates scaled so each node is a unit square)
+        class TerrainHeightField
+        {
+        public:
+            bool GetHeight(float& result, Float2 gridCoord)
+            {
+                return _sampler->GetHeightCellBased(
+                    result, Float2(gridCoord[0] / float(_cellDimsInNodes[0]), gridCoord[1] / float(_cellDimsInNodes[1])));
+            }
+
+            bool GetHeightRange(float& minHeight, float& maxHeight, int gridX, int gridY)
+            {
+                if (    gridX < 0 || gridX >= int(_cfg->_cellCount[0] * _cellDimsInNodes[0])
+                    ||  gridY < 0 || gridY >= int(_cfg->_cellCount[1] * _cellDimsInNodes[1])) {
+                    return false;
+                }
+
+                UInt2 cellIndex(unsigned(gridX) / _cellDimsInNodes[0], unsigned(gridY) / _cellDimsInNodes[1]);
+                unsigned nodeX = unsigned(gridX) % _cellDimsInNodes[0];
+                unsigned nodeY = unsigned(gridY) % _cellDimsInNodes[1];
+                auto range = _sampler->GetNode(cellIndex, 85 + nodeY * _cellDimsInNodes[0] + nodeX).GetHeightRange();
+                minHeight = range.first;
+                maxHeight = range.second;
+                return true;
+            }
+
+            TerrainHeightField(TerrainHeightSampler& sampler, const TerrainConfig& cfg)
+            : _sampler(&sampler), _cfg(&cfg), _cellDimsInNodes(cfg.CellDimensionsInNodes()) {}
+        protected:
+            TerrainHeightSampler* _sampler;
+            const TerrainConfig* _cfg;
+            UInt2 _cellDimsInNodes;
+        };
+    }
+
+    float GetTerrainHeight(ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, Float2 queryPosition)
+    {
+        TRY
+        {
+            float result = 0.f;
+            Internal::TerrainHeightSampler sampler(ioFormat, cfg, coords);
+            if (sampler.GetHeight(result, queryPosition)) {
+                return result;
+            }
         } CATCH(const ::Assets::Exceptions::PendingResource&) {
         } CATCH(const std::exception&) {
             // we can sometimes get missing files. Just return a default height
@@ -163,4 +323,45 @@ namespace SceneEngine
         return 0.f;
     }
 
+    bool FindTerrainHeightMapIntersection(
+        Float3& result,
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, 
+        std::pair<Float3, Float3> ray)
+    {
+            //  The march is done in "node grid" space, and only samples the heights
+            //  in nodes where the ray passes through the range of heights in the node
+            //  (see Internal::FindHeightFieldIntersection). Steps are half a height
+            //  map element.
+        TRY
+        {
+            Internal::TerrainHeightSampler sampler(ioFormat, cfg, coords);
+            Internal::TerrainHeightField field(sampler, cfg);
+
+            auto cellDimsInNodes = cfg.CellDimensionsInNodes();
+            auto toGrid = [&](const Float3& worldSpacePosition) -> Float3
+            {
+                auto cellBased = Internal::WorldSpaceToCellBasedCoords(cfg, coords, Truncate(worldSpacePosition));
+                return Float3(
+                    cellBased[0] * float(cellDimsInNodes[0]), cellBased[1] * float(cellDimsInNodes[1]),
+                    worldSpacePosition[2]);
+            };
+            Float2 gridMaxs(
+                float(cfg._cellCount[0] * cellDimsInNodes[0]),
+                float(cfg._cellCount[1] * cellDimsInNodes[1]));
+
+            float t;
+            if (Internal::FindHeightFieldIntersection(
+                    t, field, toGrid(ray.first), toGrid(ray.second), Float2(0.f, 0.f), gridMaxs,
+                    .5f / float(cfg.NodeDimensionsInElements()[0]))) {
+                result = ray.first + t * (ray.second - ray.first);
+                return true;
+            }
+        } CATCH(const ::Assets::Exceptions::PendingResource&) {
+        } CATCH(const std::exception&) {
+            LogWarning << "Error when testing ray against terrain height map";
+        } CATCH_END
+
+        return false;
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,196 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Math/Vector.h"
+#include "../Math/Math.h"
+#include <algorithm>
+#include <float.h>
+
+namespace SceneEngine { namespace Internal
+{
+        //
+        //      Ray marching against the terrain height map. This works in "node grid"
+        //      space: X and Y are scaled so each height map node (at the highest level
+        //      of detail) is a unit square, and Z is the world space height. The height
+        //      field itself is abstracted, so the march can be tested without any
+        //      terrain files.
+        //
+
+        /// <summary>Upper limit for the number of height samples in a single ray test</summary>
+        /// With 32x32 nodes, this is enough to march across about 700 nodes that are close
+        /// to the ray. Nodes that are entirely above or below the ray aren't sampled.
+    static const unsigned HeightFieldMaxSampleCount = 1u<<16u;
+
+        ///
+        /// <summary>Finds the first place a ray passes from above to below a height field</summary>
+        ///
+        /// Like the rendered terrain, only the front face of the surface is hit (ie, rays
+        /// going upwards pass through the surface). "start" and "end" are in node grid space.
+        ///
+        /// The ray is clipped to [gridMins, gridMaxs], and then walked through the grid
+        /// node by node. Nodes where the ray is entirely above or below the range of heights
+        /// in the node are skipped without sampling. In the other nodes, we march along
+        /// the ray in steps of "stepLength" (in grid units), looking for a change in sign
+        /// of (ray height - terrain height), and refine it with a few bisection steps.
+        /// This will miss features smaller than the step (eg, when the ray only just grazes
+        /// the peak of a hill). The march stops after "maxSampleCount" height samples, and
+        /// then reports no intersection.
+        ///
+        /// "Field" must have:
+        ///     bool GetHeightRange(float& minHeight, float& maxHeight, int gridX, int gridY);
+        ///     bool GetHeight(float& height, Float2 gridCoord);
+        /// Both return false for coordinates that are outside of the terrain (crossings can't
+        /// span across these gaps).
+        ///
+        /// Returns true and writes the ray parameter (0 at "start", 1 at "end") of the
+        /// intersection to "result" when there is an intersection.
+        ///
+    template<typename Field>
+        bool FindHeightFieldIntersection(
+            float& result, Field& field,
+            const Float3& start, const Float3& end,
+            const Float2& gridMins, const Float2& gridMaxs,
+            float stepLength, unsigned maxSampleCount = HeightFieldMaxSampleCount)
+        {
+            Float3 direction = end - start;
+            unsigned sampleCount = 0;
+            auto difference = [&](float& diff, float t) -> bool
+            {
+                ++sampleCount;
+                float height;
+                if (!field.GetHeight(height, Float2(start[0] + t * direction[0], start[1] + t * direction[1]))) return false;
+                diff = start[2] + t * direction[2] - height;
+                return true;
+            };
+
+            float horizontalLength = XlSqrt(direction[0]*direction[0] + direction[1]*direction[1]);
+            if (horizontalLength < 1e-4f * stepLength) {
+                    // vertical ray. Only one height to test against
+                float height;
+                if (!field.GetHeight(height, Float2(start[0], start[1]))) return false;
+                if (start[2] <= height || end[2] > height) return false;
+                result = (start[2] - height) / (start[2] - end[2]);
+                return true;
+            }
+
+                //  Clip to the grid bounds, so rays that start or end far outside of
+                //  the terrain don't walk through empty nodes
+            float tMin = 0.f, tMax = 1.f;
+            for (unsigned a=0; a<2; ++a) {
+                if (XlAbs(direction[a]) < 1e-20f) {
+                    if (start[a] < gridMins[a] || start[a] > gridMaxs[a]) return false;
+                    continue;
+                }
+                float t0 = (gridMins[a] - start[a]) / direction[a];
+                float t1 = (gridMaxs[a] - start[a]) / direction[a];
+                tMin = std::max(tMin, std::min(t0, t1));
+                tMax = std::min(tMax, std::max(t0, t1));
+            }
+            if (tMin > tMax) return false;
+
+                //  Walk through the nodes the ray touches (in the same way as a 2D DDA
+                //  line walk), keeping track of the parameter where it leaves each one
+            Float2 entry(start[0] + tMin * direction[0], start[1] + tMin * direction[1]);
+            int node[2], nodeStep[2];
+            float tNext[2], tDelta[2];
+            for (unsigned a=0; a<2; ++a) {
+                node[a] = int(XlFloor(entry[a]));
+                if (direction[a] > 0.f) {
+                    nodeStep[a] = 1;
+                    tDelta[a] = 1.f / direction[a];
+                    tNext[a] = (float(node[a]+1) - start[a]) / direction[a];
+                } else if (direction[a] < 0.f) {
+                    nodeStep[a] = -1;
+                    tDelta[a] = -1.f / direction[a];
+                    tNext[a] = (float(node[a]) - start[a]) / direction[a];
+                } else {
+                    nodeStep[a] = 0;
+                    tDelta[a] = FLT_MAX;
+                    tNext[a] = FLT_MAX;
+                }
+            }
+
+            const float tStep = stepLength / horizontalLength;
+            bool havePrev = false;
+            float prevT = 0.f, prevDiff = 0.f;
+
+            auto refine = [&](float t0, float t1) -> float
+            {
+                for (unsigned c=0; c<12; ++c) {
+                    float tm = .5f * (t0 + t1);
+                    float dm;
+                    if (!difference(dm, tm)) break;
+                    if (dm > 0.f) { t0 = tm; }
+                    else { t1 = tm; }
+                }
+                return .5f * (t0 + t1);
+            };
+
+            float tEnter = tMin;
+            for (;;) {
+                float tExit = std::min(std::min(tNext[0], tNext[1]), tMax);
+
+                float minHeight, maxHeight;
+                if (!field.GetHeightRange(minHeight, maxHeight, node[0], node[1])) {
+                        // outside of the terrain area. Crossings can't span across this gap
+                    havePrev = false;
+                } else {
+                    float zEnter = start[2] + tEnter * direction[2];
+                    float zExit = start[2] + tExit * direction[2];
+                    if (std::min(zEnter, zExit) > maxHeight) {
+                            //  Entirely above this node, so no crossings within it
+                        havePrev = true;
+                        prevT = tExit;
+                        prevDiff = std::min(zEnter, zExit) - maxHeight;
+                    } else if (std::max(zEnter, zExit) < minHeight) {
+                            //  Entirely below. But the ray might have been above the
+                            //  surface when it left the previous node
+                        if (havePrev && prevDiff > 0.f) {
+                            result = refine(prevT, tEnter);
+                            return true;
+                        }
+                        havePrev = true;
+                        prevT = tExit;
+                        prevDiff = std::max(zEnter, zExit) - minHeight;
+                    } else {
+                            //  (the sample at the start of this node was the last sample of the previous one)
+                        float t = (havePrev && prevT == tEnter) ? std::min(tEnter + tStep, tExit) : tEnter;
+                        for (;; t = std::min(t + tStep, tExit)) {
+                            if (sampleCount >= maxSampleCount) return false;
+
+                            float diff;
+                            if (!difference(diff, t)) {
+                                havePrev = false;
+                            } else {
+                                if (havePrev && prevDiff > 0.f && diff <= 0.f) {
+                                    result = refine(prevT, t);
+                                    return true;
+                                }
+                                havePrev = true;
+                                prevT = t;
+                                prevDiff = diff;
+                            }
+
+                            if (t >= tExit) break;
+                        }
+                    }
+                }
+
+                if (tExit >= tMax) break;
+
+                    //  step into the next node
+                tEnter = tExit;
+                unsigned a = (tNext[0] < tNext[1]) ? 0 : 1;
+                node[a] += nodeStep[a];
+                tNext[a] += tDelta[a];
+            }
+
+            return false;
+        }
+}}
+
@@ -0,0 +1,196 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TerrainCompression.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace SceneEngine { namespace TerrainCompression
+{
+        //  Encoded layout:
+        //      PredictiveHeader
+        //      uint8 rowBitCount[dimension]    (padded to a multiple of 4 bytes)
+        //      uint32 bitstream[]              (residuals, least significant bit first)
+    class PredictiveHeader
+    {
+    public:
+        uint16  _quantizationStep;
+        uint16  _dimension;
+    };
+
+    static unsigned PaddedRowTableSize(unsigned dimension) { return (dimension + 3) & ~3u; }
+
+    static uint32 ZigZag(int32 value)       { return (uint32(value) << 1) ^ uint32(value >> 31); }
+    static int32 UnZigZag(uint32 value)     { return int32(value >> 1) ^ -int32(value & 1); }
+
+    static unsigned BitCount(uint32 value)
+    {
+        unsigned result = 0;
+        while (value) { ++result; value >>= 1; }
+        return result;
+    }
+
+    template<typename Type>
+        static int32 Predict(const Type values[], unsigned x, unsigned y, unsigned dimension)
+    {
+            //  "parallelogram" predictor. This is exact for planar surfaces.
+            //  On the edges, we fall back to a simple delta from the neighbour.
+        if (y == 0) return (x == 0) ? 0 : int32(values[x-1]);
+        if (x == 0) return int32(values[(y-1)*dimension]);
+        return    int32(values[y*dimension + x-1])
+                + int32(values[(y-1)*dimension + x])
+                - int32(values[(y-1)*dimension + x-1]);
+    }
+
+    std::vector<uint8> EncodePredictive(const uint16 input[], unsigned dimension, unsigned quantizationStep)
+    {
+        assert(dimension > 0 && dimension <= 0xffff);
+        quantizationStep = std::max(1u, std::min(quantizationStep, 0xffffu));
+
+            //  Values are first reduced to quantization steps. The rounding here is
+            //  the only lossy part of the encoding -- the prediction & residual part
+            //  works on integers and is exact.
+        const unsigned elementCount = dimension*dimension;
+        std::vector<uint32> steps(elementCount);
+        for (unsigned c=0; c<elementCount; ++c)
+            steps[c] = (uint32(input[c]) + quantizationStep/2) / quantizationStep;
+
+        std::vector<uint32> residuals(elementCount);
+        std::vector<uint8> rowBits(PaddedRowTableSize(dimension), 0);
+        size_t totalBits = 0;
+        for (unsigned y=0; y<dimension; ++y) {
+            uint32 rowMax = 0;
+            for (unsigned x=0; x<dimension; ++x) {
+                auto r = ZigZag(int32(steps[y*dimension+x]) - Predict(AsPointer(steps.cbegin()), x, y, dimension));
+                residuals[y*dimension+x] = r;
+                rowMax = std::max(rowMax, r);
+            }
+            rowBits[y] = uint8(BitCount(rowMax));
+            totalBits += rowBits[y] * dimension;
+        }
+
+        const size_t wordCount = (totalBits + 31) / 32;
+        std::vector<uint8> result(sizeof(PredictiveHeader) + rowBits.size() + wordCount*sizeof(uint32), 0);
+
+        auto& hdr = *(PredictiveHeader*)AsPointer(result.begin());
+        hdr._quantizationStep = uint16(quantizationStep);
+        hdr._dimension = uint16(dimension);
+        XlCopyMemory(PtrAdd(AsPointer(result.begin()), sizeof(PredictiveHeader)), AsPointer(rowBits.cbegin()), rowBits.size());
+
+        auto* words = (uint32*)PtrAdd(AsPointer(result.begin()), sizeof(PredictiveHeader) + rowBits.size());
+        size_t bitIterator = 0;
+        for (unsigned y=0; y<dimension; ++y) {
+            const unsigned bits = rowBits[y];
+            if (!bits) continue;
+            for (unsigned x=0; x<dimension; ++x) {
+                uint64 r = residuals[y*dimension+x];
+                size_t word = bitIterator / 32, shift = bitIterator % 32;
+                words[word] |= uint32(r << shift);
+                if ((shift + bits) > 32)
+                    words[word+1] |= uint32(r >> (32 - shift));
+                bitIterator += bits;
+            }
+        }
+        assert(bitIterator == totalBits);
+
+        return std::move(result);
+    }
+
+    bool DecodePredictive(uint16 output[], unsigned dimension, const void* encodedData, size_t encodedDataSize)
+    {
+        if (encodedDataSize < sizeof(PredictiveHeader)) return false;
+        const auto& hdr = *(const PredictiveHeader*)encodedData;
+        if (hdr._dimension != dimension || !hdr._quantizationStep) return false;
+
+        const unsigned rowTableSize = PaddedRowTableSize(dimension);
+        if (encodedDataSize < sizeof(PredictiveHeader) + rowTableSize) return false;
+        const auto* rowBits = (const uint8*)PtrAdd(encodedData, sizeof(PredictiveHeader));
+        const auto* words = (const uint32*)PtrAdd(encodedData, sizeof(PredictiveHeader) + rowTableSize);
+        const size_t wordCount = (encodedDataSize - sizeof(PredictiveHeader) - rowTableSize) / sizeof(uint32);
+
+        size_t totalBits = 0;
+        for (unsigned y=0; y<dimension; ++y) {
+            if (rowBits[y] > 32) return false;
+            totalBits += rowBits[y] * dimension;
+        }
+        if (totalBits > wordCount * 32) return false;
+
+            //  Reconstruct in quantization step units first (we need the unclamped
+            //  values for prediction), and then scale to the final 16 bit values.
+            //  We use a 64 bit bit-buffer, refilled 32 bits at a time.
+        const unsigned step = hdr._quantizationStep;
+        auto steps = std::make_unique<int32[]>(dimension*dimension);
+        uint64 bitBuffer = 0;
+        unsigned bitsInBuffer = 0;
+        const uint32* wordIterator = words;
+        const uint32* wordEnd = words + wordCount;
+
+        for (unsigned y=0; y<dimension; ++y) {
+            const unsigned bits = rowBits[y];
+            const uint64 mask = (uint64(1) << bits) - 1;
+            int32* row = &steps[y*dimension];
+            for (unsigned x=0; x<dimension; ++x) {
+                uint32 r = 0;
+                if (bits) {
+                    if (bitsInBuffer < bits) {
+                        if (wordIterator < wordEnd)
+                            bitBuffer |= uint64(*wordIterator++) << bitsInBuffer;
+                        bitsInBuffer += 32;
+                    }
+                    r = uint32(bitBuffer & mask);
+                    bitBuffer >>= bits;
+                    bitsInBuffer -= bits;
+                }
+                row[x] = Predict(steps.get(), x, y, dimension) + UnZigZag(r);
+            }
+        }
+
+        for (unsigned c=0; c<dimension*dimension; ++c)
+            output[c] = uint16(std::max(int64(0), std::min(int64(steps[c]) * int64(step), int64(0xffff))));
+
+        return true;
+    }
+
+    unsigned CalculateQuantizationStep(float errorBound, float valueScale)
+    {
+            //  Rounding to the nearest step introduces an error of at most step/2
+            //  (in addition to the normal 16 bit quantization)
+        if (errorBound <= 0.f || valueScale <= 0.f) return 1;
+        float step = 2.f * errorBound / valueScale;
+        return unsigned(std::max(1.f, std::min(step, float(0xffff))));
+    }
+
+    bool LoadNodeHeights(
+        uint16 output[], const TerrainCell::Node& node,
+        Utility::BasicFile& sourceFile, Utility::BasicFile* secondaryCache)
+    {
+        const size_t expectedSize = node._widthInElements*node._widthInElements*sizeof(uint16);
+        if (node._heightMapFileSize) {
+            if (node._encoding == TerrainCell::Node::Encoding::Predictive) {
+                auto encoded = std::make_unique<uint8[]>(node._heightMapFileSize);
+                sourceFile.Seek(node._heightMapFileOffset, SEEK_SET);
+                if (sourceFile.Read(encoded.get(), 1, node._heightMapFileSize) != node._heightMapFileSize)
+                    return false;
+                return DecodePredictive(output, node._widthInElements, encoded.get(), node._heightMapFileSize);
+            }
+
+            if (node._heightMapFileSize != expectedSize) return false;     // (nodes with holes)
+            sourceFile.Seek(node._heightMapFileOffset, SEEK_SET);
+            return sourceFile.Read(output, 1, expectedSize) == expectedSize;
+        }
+
+        if (secondaryCache && node._secondaryCacheSize == expectedSize) {
+            secondaryCache->Seek(node._secondaryCacheOffset, SEEK_SET);
+            return secondaryCache->Read(output, 1, expectedSize) == expectedSize;
+        }
+
+        return false;
+    }
+}}
+
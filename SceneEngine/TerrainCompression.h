@@ -0,0 +1,53 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "TerrainInternal.h"
+#include "../Core/Types.h"
+#include <vector>
+
+namespace Utility { class BasicFile; }
+
+namespace SceneEngine
+{
+    /// <summary>Predictive compression for terrain height data</summary>
+    /// Terrain height data is normally stored as 16 bit values within a per-node
+    /// min/max range ("QuantRange"). This codec stores exactly the same kind of
+    /// values, but more compactly:
+    ///     <list>
+    ///         <item>values are optionally quantized further by "quantizationStep" (this is how
+    ///             the error bound is applied. A step of 1 is lossless with respect to the 16 bit input)</item>
+    ///         <item>each value is predicted from its left, top and top-left neighbours (a + b - c).
+    ///             This predictor is exact for planar regions, so smooth slopes cost very few bits</item>
+    ///         <item>residuals are zig-zag encoded and bit-packed, with a separate bit width for each row</item>
+    ///     </list>
+    /// Decoding produces the same 16 bit values the renderer already expects, so nothing
+    /// downstream of the decoder needs to know that the data was compressed.
+    namespace TerrainCompression
+    {
+        std::vector<uint8> EncodePredictive(
+            const uint16 input[], unsigned dimension, unsigned quantizationStep);
+
+        bool DecodePredictive(
+            uint16 output[], unsigned dimension,
+            const void* encodedData, size_t encodedDataSize);
+
+            /// <summary>Calculate the quantization step for a given world space error bound</summary>
+            /// "valueScale" is the world space size of one unit of the 16 bit value
+            /// (ie, _localToCell(2,2) for a node).
+        unsigned CalculateQuantizationStep(float errorBound, float valueScale);
+
+            /// <summary>Load the 16 bit height values for a node</summary>
+            /// Reads from the source file (decoding if necessary) or from the
+            /// secondary cache. "output" must have room for _widthInElements^2 values.
+            /// Returns false if the node has no complete data.
+        bool LoadNodeHeights(
+            uint16 output[], const TerrainCell::Node& node,
+            Utility::BasicFile& sourceFile, Utility::BasicFile* secondaryCache);
+    }
+}
+
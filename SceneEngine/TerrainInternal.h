@@ -37,10 +37,19 @@ namespace SceneEngine
             size_t      _secondaryCacheOffset;
             size_t      _secondaryCacheSize;
             unsigned    _widthInElements;
+
+                //  Encoding of the data at _heightMapFileOffset. Data in the secondary
+                //  cache is always raw 16 bit values.
+            struct Encoding { enum Enum { Raw, Predictive }; };
+            Encoding::Enum _encoding;
+
             Node(const Float4x4& localToCell, size_t heightMapFileOffset, size_t heightMapFileSize, unsigned widthInElements);
 
                 //  Note -- hack here for 32x32 tiles!
             unsigned    GetOverlapWidth() const { return (_widthInElements==33)?1:2; }
+
+                //  Size of the height data after decoding (0 for nodes with no data)
+            size_t      GetHeightDataSize() const;
         };
 
         //////////////////////////////////////////////////////////////////
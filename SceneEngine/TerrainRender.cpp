@@ -7,11 +7,13 @@
 #include "Terrain.h"
 #include "TerrainInternal.h"
 #include "TerrainUberSurface.h"
+#include "TerrainCompression.h"
 #include "LightingParserContext.h"
 #include "Noise.h"
 #include "SimplePatchBox.h"
 #include "SceneEngineUtility.h"
 #include "SurfaceHeightsProvider.h"
+#include "TerrainStreaming.h"
 #include "../RenderCore/Techniques/Techniques.h"
 #include "../RenderCore/Techniques/ResourceBox.h"
 #include "../RenderCore/Techniques/CommonResources.h"
@@ -39,6 +41,7 @@
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/Conversion.h"
+#include "../Utility/TimeUtils.h"
 #include "../ConsoleRig/Console.h"
 
 #include "../../RenderCore/DX11/Metal/DX11.h"
@@ -136,6 +139,9 @@ namespace SceneEngine
         void    Transaction_Begin(
                     TextureTile& tile,
                     const void* fileHandle, size_t offset, size_t dataSize);
+        void    Transaction_Begin(
+                    TextureTile& tile,
+                    BufferUploads::RawDataPacket* dataPacket);
 
         bool    IsValid(TextureTile& tile);
 
@@ -192,6 +198,14 @@ namespace SceneEngine
     void    TextureTileSet::Transaction_Begin(
                 TextureTile& tile,
                 const void* fileHandle, size_t offset, size_t dataSize)
+    {
+        auto dataPacket = BufferUploads::CreateFileDataSource(fileHandle, offset, dataSize);
+        Transaction_Begin(tile, dataPacket.get());
+    }
+
+    void    TextureTileSet::Transaction_Begin(
+                TextureTile& tile,
+                BufferUploads::RawDataPacket* dataPacket)
     {
         CompleteCreation();
         if (!_resource || _resource->IsEmpty()) {
@@ -267,12 +281,61 @@ namespace SceneEngine
         tile._uploadId = uploadId;
         assert(tile._width != ~unsigned(0x0) && tile._height != ~unsigned(0x0));
 
-        auto dataPacket = BufferUploads::CreateFileDataSource(fileHandle, offset, dataSize);
         _bufferUploads->UpdateData(
-            tile._transaction, dataPacket.get(),
+            tile._transaction, dataPacket,
             BufferUploads::PartialResource(destinationBox, 0, 0, address[2]));
     }
 
+    //////////////////////////////////////////////////////////////////////////////////////////
+        /// <summary>Decodes compressed height data as it's passed to buffer uploads</summary>
+        /// Wraps the file data source, and decodes the first time the data is requested.
+        /// That happens in the buffer uploads thread; so the decompression doesn't cost
+        /// anything in the thread that queues the upload.
+    class DecodedHeightsDataPacket : public BufferUploads::RawDataPacket
+    {
+    public:
+        virtual void*                           GetData             (unsigned mipIndex, unsigned arrayIndex);
+        virtual size_t                          GetDataSize         (unsigned mipIndex, unsigned arrayIndex) const;
+        virtual std::pair<unsigned,unsigned>    GetRowAndSlicePitch (unsigned mipIndex, unsigned arrayIndex) const;
+
+        DecodedHeightsDataPacket(intrusive_ptr<BufferUploads::RawDataPacket>&& encodedSource, unsigned dimension);
+
+    protected:
+        intrusive_ptr<BufferUploads::RawDataPacket> _encodedSource;
+        std::unique_ptr<uint16[]>   _decoded;
+        unsigned                    _dimension;
+    };
+
+    void* DecodedHeightsDataPacket::GetData(unsigned mipIndex, unsigned arrayIndex)
+    {
+        if (mipIndex != 0) return nullptr;
+        if (!_decoded) {
+            auto decoded = std::make_unique<uint16[]>(_dimension*_dimension);
+            bool success = TerrainCompression::DecodePredictive(
+                decoded.get(), _dimension,
+                _encodedSource->GetData(0, 0), _encodedSource->GetDataSize(0, 0));
+            if (!success)
+                XlSetMemory(decoded.get(), 0, _dimension*_dimension*sizeof(uint16));
+            _decoded = std::move(decoded);
+            _encodedSource.reset();
+        }
+        return _decoded.get();
+    }
+
+    size_t DecodedHeightsDataPacket::GetDataSize(unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return (mipIndex == 0) ? (_dimension*_dimension*sizeof(uint16)) : 0;
+    }
+
+    std::pair<unsigned,unsigned> DecodedHeightsDataPacket::GetRowAndSlicePitch(unsigned mipIndex, unsigned arrayIndex) const
+    {
+        return std::make_pair(unsigned(_dimension*sizeof(uint16)), unsigned(_dimension*_dimension*sizeof(uint16)));
+    }
+
+    DecodedHeightsDataPacket::DecodedHeightsDataPacket(intrusive_ptr<BufferUploads::RawDataPacket>&& encodedSource, unsigned dimension)
+    : _encodedSource(std::move(encodedSource)), _dimension(dimension)
+    {}
+
     bool    TextureTileSet::IsValid(TextureTile& tile)
     {
         if (tile._width == ~unsigned(0x0) || tile._height == ~unsigned(0x0))
@@ -454,6 +517,7 @@ namespace SceneEngine
         void WriteQueuedNodes(TerrainRenderingContext& renderingContext, TerrainCollapseContext& collapseContext);
         void CompletePendingUploads();
         void QueueUploads(TerrainRenderingContext& terrainContext);
+        void UpdateResidency(const RenderCore::Techniques::ProjectionDesc& projDesc, float viewportHeight);
         void Render(DeviceContext* context, LightingParserContext& parserContext, TerrainRenderingContext& terrainContext);
 
         void HeightMapShortCircuit(std::string cellName, UInt2 cellOrigin, UInt2 cellMax, const ShortCircuitUpdate& upd);
@@ -475,7 +539,8 @@ namespace SceneEngine
 
             void QueueHeightMapUpload(      TextureTileSet& heightMapTileSet, 
                                             const void* filePtr, const void* cacheFilePtr,
-                                            const TerrainCell::Node& sourceNode);
+                                            const TerrainCell::Node& sourceNode,
+                                            const TerrainResidencyManager::NodeData& residentData);
             void QueueCoverageUpload(       unsigned index, TextureTileSet& coverageTileSet, 
                                             const void* filePtr, unsigned fileOffset, unsigned fileSize);
             bool CompleteHeightMapUpload(   BufferUploads::IManager& bufferUploads);
@@ -501,6 +566,7 @@ namespace SceneEngine
             const void*                 _heightMapStreamingFilePtr;
             const void*                 _heightMapCacheStreamingFilePtr;
             const void*                 _coverageStreamingFilePtr[TerrainCellId::CoverageCount];
+            unsigned                    _residencyCellId;   // id in TerrainCellRenderer::_residency (or ~0 if not registered)
 
         private:
             CellRenderInfo(const CellRenderInfo& );
@@ -521,6 +587,10 @@ namespace SceneEngine
 
         std::shared_ptr<ITerrainFormat> _ioFormat;
 
+        std::unique_ptr<TerrainResidencyManager> _residency;
+        Float3                          _lastCameraPosition;
+        Millisecond                     _lastResidencyUpdate;
+
         friend class TerrainRenderingContext;
         friend class TerrainCollapseContext;
         friend class TerrainSurfaceHeightsProvider;
@@ -841,6 +911,8 @@ namespace SceneEngine
                     if (pi == _pendingCoverageUploads.end()) break;
                     _pendingCoverageUploads.erase(pi);
                 }
+                if (i->second->_residencyCellId != ~unsigned(0x0))
+                    _residency->RemoveCell(i->second->_residencyCellId);
                 i->second.reset();
 
                 TerrainCellTexture const* tex[TerrainCellId::CoverageCount];
@@ -866,6 +938,9 @@ namespace SceneEngine
 
         }
 
+        if (renderInfo->_sourceCell && renderInfo->_residencyCellId == ~unsigned(0x0))
+            renderInfo->_residencyCellId = _residency->AddCell(*renderInfo->_sourceCell, cell._cellToWorld);
+
             // find all of the nodes that we're go to render this frame
         static bool useNewCulling = true;
         if (!useNewCulling) {
@@ -931,7 +1006,8 @@ namespace SceneEngine
                 auto& sourceNode = sourceCell._nodes[n];
                 renderNode.QueueHeightMapUpload(
                     *_heightMapTileSet, 
-                    cellRenderInfo._heightMapStreamingFilePtr, cellRenderInfo._heightMapCacheStreamingFilePtr, *sourceNode);
+                    cellRenderInfo._heightMapStreamingFilePtr, cellRenderInfo._heightMapCacheStreamingFilePtr, *sourceNode,
+                    _residency->GetNodeData(cellRenderInfo._residencyCellId, n));
                 ++uploadsThisFrame;
                 _pendingHeightMapUploads.push_back(UploadPair(&cellRenderInfo, n));
             }
@@ -959,6 +1035,23 @@ namespace SceneEngine
         }
     }
 
+    void        TerrainCellRenderer::UpdateResidency(const RenderCore::Techniques::ProjectionDesc& projDesc, float viewportHeight)
+    {
+            //  The residency manager keeps a CPU side copy of the node data that we're likely to
+            //  need soon (prefetched along the camera path). Height map uploads for resident nodes
+            //  don't need to go to disk (see QueueHeightMapUpload)
+        auto cameraPosition = ExtractTranslation(projDesc._cameraToWorld);
+        auto now = Millisecond_Now();
+        Float3 velocity = Zero<Float3>();
+        if (_lastResidencyUpdate && now > _lastResidencyUpdate)
+            velocity = (cameraPosition - _lastCameraPosition) / (float(now - _lastResidencyUpdate) / 1000.f);
+        _lastCameraPosition = cameraPosition;
+        _lastResidencyUpdate = now;
+
+        float lodErrorScale = viewportHeight / (2.f * XlTan(.5f * projDesc._verticalFov));
+        _residency->Update(cameraPosition, velocity, lodErrorScale);
+    }
+
     class TerrainCollapseContext
     {
     public:
@@ -1334,7 +1427,7 @@ namespace SceneEngine
             auto& sourceNode = sourceCell._nodes[n];
 
             const unsigned expectedDataSize = sourceNode->_widthInElements*sourceNode->_widthInElements*2;
-            if (std::max(sourceNode->_heightMapFileSize, sourceNode->_secondaryCacheSize) < expectedDataSize) {
+            if (sourceNode->GetHeightDataSize() < expectedDataSize) {
                     // some nodes have "holes". We have to ignore them.
                 cullResults[n - field._nodeBegin] = AABBIntersection::Culled;
             } else {
@@ -1456,7 +1549,7 @@ namespace SceneEngine
             }
             
             const unsigned expectedDataSize = sourceNode->_widthInElements*sourceNode->_widthInElements*2;
-            if (std::max(sourceNode->_heightMapFileSize, sourceNode->_secondaryCacheSize) < expectedDataSize) {
+            if (sourceNode->GetHeightDataSize() < expectedDataSize) {
                 continue;   // some nodes have "holes". We have to ignore them.
             }
 
@@ -1777,6 +1870,9 @@ namespace SceneEngine
         _elementSize = heightMapNodeElementWidth;
         _coverageElementSize = coverageElementSize;
         _ioFormat = std::move(ioFormat);
+        _residency = std::make_unique<TerrainResidencyManager>();
+        _lastCameraPosition = Zero<Float3>();
+        _lastResidencyUpdate = 0;
     }
 
     TerrainCellRenderer::~TerrainCellRenderer()
@@ -1799,6 +1895,7 @@ namespace SceneEngine
         std::fill(_sourceCoverage, &_sourceCoverage[dimof(_sourceCoverage)], nullptr);
         _heightMapStreamingFilePtr = _heightMapCacheStreamingFilePtr = INVALID_HANDLE_VALUE;
         std::fill(_coverageStreamingFilePtr, &_coverageStreamingFilePtr[dimof(_coverageStreamingFilePtr)], INVALID_HANDLE_VALUE);
+        _residencyCellId = ~unsigned(0x0);
 
         if (nodeCount && !cell.SourceFile().empty()) {
             std::vector<NodeRenderInfo> nodes;
@@ -1866,6 +1963,7 @@ namespace SceneEngine
         _sourceCell = std::move(moveFrom._sourceCell);
         _heightMapStreamingFilePtr = std::move(moveFrom._heightMapStreamingFilePtr);
         _heightMapCacheStreamingFilePtr = std::move(moveFrom._heightMapCacheStreamingFilePtr);
+        _residencyCellId = moveFrom._residencyCellId;
 
         for (unsigned c=0; c<TerrainCellId::CoverageCount; ++c) {
             _sourceCoverage[c] = std::move(moveFrom._sourceCoverage[c]);
@@ -1874,6 +1972,7 @@ namespace SceneEngine
 
         moveFrom._heightMapStreamingFilePtr = INVALID_HANDLE_VALUE;
         moveFrom._heightMapCacheStreamingFilePtr = INVALID_HANDLE_VALUE;
+        moveFrom._residencyCellId = ~unsigned(0x0);
         std::fill(moveFrom._coverageStreamingFilePtr, &moveFrom._coverageStreamingFilePtr[dimof(moveFrom._coverageStreamingFilePtr)], INVALID_HANDLE_VALUE);
     }
 
@@ -1883,6 +1982,7 @@ namespace SceneEngine
         _sourceCell = std::move(moveFrom._sourceCell);
         _heightMapStreamingFilePtr = std::move(moveFrom._heightMapStreamingFilePtr);
         _heightMapCacheStreamingFilePtr = std::move(moveFrom._heightMapCacheStreamingFilePtr);
+        _residencyCellId = moveFrom._residencyCellId;
 
         for (unsigned c=0; c<TerrainCellId::CoverageCount; ++c) {
             _sourceCoverage[c] = std::move(moveFrom._sourceCoverage[c]);
@@ -1891,6 +1991,7 @@ namespace SceneEngine
 
         moveFrom._heightMapStreamingFilePtr = INVALID_HANDLE_VALUE;
         moveFrom._heightMapCacheStreamingFilePtr = INVALID_HANDLE_VALUE;
+        moveFrom._residencyCellId = ~unsigned(0x0);
         std::fill(moveFrom._coverageStreamingFilePtr, &moveFrom._coverageStreamingFilePtr[dimof(moveFrom._coverageStreamingFilePtr)], INVALID_HANDLE_VALUE);
         return *this;
     }
@@ -1973,15 +2074,42 @@ namespace SceneEngine
 
     void        TerrainCellRenderer::NodeRenderInfo::QueueHeightMapUpload(
                         TextureTileSet& heightMapTileSet,
-                        const void* filePtr, const void* cacheFilePtr, const TerrainCell::Node& sourceNode)
+                        const void* filePtr, const void* cacheFilePtr, const TerrainCell::Node& sourceNode,
+                        const TerrainResidencyManager::NodeData& residentData)
     {
             // the caller should check to see if we need an upload before calling this
         assert(!heightMapTileSet.IsValid(_heightMapTile));
         assert(!heightMapTileSet.IsValid(_heightMapPendingTile));
 
+        if (residentData._data) {
+                //  The residency manager already has the file data in memory, so we can skip
+                //  the disk read. It's the same data we'd get from the file (including the
+                //  encoding), but it's only valid until the next update, so we must copy it.
+            if (sourceNode._heightMapFileSize && sourceNode._encoding == TerrainCell::Node::Encoding::Predictive) {
+                auto decodingPacket = make_intrusive<DecodedHeightsDataPacket>(
+                    BufferUploads::CreateBasicPacket(residentData._size, residentData._data),
+                    sourceNode._widthInElements);
+                heightMapTileSet.Transaction_Begin(_heightMapPendingTile, decodingPacket.get());
+            } else {
+                auto rowPitch = unsigned(sourceNode._widthInElements * sizeof(uint16));
+                auto packet = BufferUploads::CreateBasicPacket(
+                    residentData._size, residentData._data,
+                    std::make_pair(rowPitch, unsigned(residentData._size)));
+                heightMapTileSet.Transaction_Begin(_heightMapPendingTile, packet.get());
+            }
+            return;
+        }
+
         if (sourceNode._heightMapFileSize) {
-            heightMapTileSet.Transaction_Begin(_heightMapPendingTile, filePtr, 
-                sourceNode._heightMapFileOffset, sourceNode._heightMapFileSize);
+            if (sourceNode._encoding == TerrainCell::Node::Encoding::Predictive) {
+                auto decodingPacket = make_intrusive<DecodedHeightsDataPacket>(
+                    BufferUploads::CreateFileDataSource(filePtr, sourceNode._heightMapFileOffset, sourceNode._heightMapFileSize),
+                    sourceNode._widthInElements);
+                heightMapTileSet.Transaction_Begin(_heightMapPendingTile, decodingPacket.get());
+            } else {
+                heightMapTileSet.Transaction_Begin(_heightMapPendingTile, filePtr, 
+                    sourceNode._heightMapFileOffset, sourceNode._heightMapFileSize);
+            }
         } else {
             assert(sourceNode._secondaryCacheSize);
             heightMapTileSet.Transaction_Begin(_heightMapPendingTile, cacheFilePtr, 
@@ -2825,6 +2953,7 @@ namespace SceneEngine
         state._currentViewport = ViewportDesc(*context);
         _pimpl->CullNodes(context, parserContext, state);
 
+        renderer->UpdateResidency(parserContext.GetProjectionDesc(), state._currentViewport.Height);
         renderer->CompletePendingUploads();
         renderer->QueueUploads(state);
 
@@ -3083,6 +3212,27 @@ namespace SceneEngine
         parentNode->Save(StringMeld<MaxPath>() << _baseDir << "\\world.cfg");
     }
 
+    bool TerrainManager::CalculateHeightMapIntersection(
+        IntersectionResult& result,
+        std::pair<Float3, Float3> ray) const
+    {
+        Float3 intersection;
+        if (!FindTerrainHeightMapIntersection(intersection, *_pimpl->_ioFormat, _pimpl->_cfg, _pimpl->_coords, ray)) {
+            return false;
+        }
+
+        auto cellBasedCoord = _pimpl->_cfg.TerrainCoordsToCellBasedCoords(
+            _pimpl->_coords.WorldSpaceToTerrainCoords(Truncate(intersection)));
+        result._intersectionPoint = intersection;
+        result._cellCoordinates = Float2(
+            cellBasedCoord[0] - XlFloor(cellBasedCoord[0]), 
+            cellBasedCoord[1] - XlFloor(cellBasedCoord[1]));
+        result._fullTerrainCoordinates = Float2(
+            cellBasedCoord[0] / float(_pimpl->_cfg._cellCount[0]), 
+            cellBasedCoord[1] / float(_pimpl->_cfg._cellCount[1]));
+        return true;
+    }
+
     const TerrainCoordinateSystem&  TerrainManager::GetCoords() const       { return _pimpl->_coords; }
     TerrainUberSurfaceInterface* TerrainManager::GetUberSurfaceInterface()  { return _pimpl->_uberSurfaceInterface.get(); }
     ISurfaceHeightsProvider* TerrainManager::GetHeightsProvider()           { return _pimpl->_heightsProvider.get(); }
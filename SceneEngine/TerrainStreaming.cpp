@@ -0,0 +1,603 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TerrainStreaming.h"
+#include "TerrainInternal.h"
+
+#include "../Math/Transformations.h"
+#include "../Utility/Threading/ThreadObject.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../Utility/Threading/Mutex.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <float.h>
+
+namespace SceneEngine
+{
+    class TerrainResidencyManager::Pimpl
+    {
+    public:
+        struct NodeState
+        {
+            enum Enum { NotResident, Pending, Resident };
+        };
+
+        class Node
+        {
+        public:
+            std::vector<uint8>  _data;
+            size_t              _fileOffset;
+            size_t              _fileSize;
+            unsigned            _fileIndex;         // 0 = source file, 1 = secondary cache, ~0 = no data
+            unsigned            _parent;            // ~0 for the root node
+            Float3              _center;
+            float               _radius;
+            float               _geometricError;    // world space distance between adjacent height elements
+
+            NodeState::Enum     _state;
+            bool                _wanted;
+            float               _screenError;
+            float               _priority;
+            unsigned            _lastUsedFrame;
+            unsigned            _lastLookupFrame;   // frame in which GetNodeData() last returned this node's data
+            unsigned            _pendingRequest;    // id of the read we're waiting on (when _state == Pending)
+        };
+
+        class Cell
+        {
+        public:
+            std::string         _files[2];
+            std::vector<Node>   _nodes;
+            bool                _active;
+        };
+
+        class ReadRequest
+        {
+        public:
+            unsigned    _cellId, _nodeIndex, _requestId;
+            std::string _filename;
+            size_t      _offset, _size;
+        };
+
+        class ReadResult
+        {
+        public:
+            unsigned            _cellId, _nodeIndex, _requestId;
+            size_t              _requestedSize;
+            std::vector<uint8>  _data;
+            bool                _success;
+        };
+
+        Desc                        _desc;
+        std::vector<Cell>           _cells;
+        unsigned                    _frameIndex;
+        unsigned                    _nextRequestId;
+        Metrics                     _metrics;
+
+        Threading::Mutex            _queueLock;
+        std::vector<ReadRequest>    _requests;
+        std::vector<ReadResult>     _completions;
+        unsigned                    _outstandingReads;      // protected by _queueLock
+
+        XlHandle                    _wakeUpEvent;
+        XlHandle                    _completionEvent;
+        volatile bool               _shutdownBackgroundThread;
+        std::unique_ptr<Threading::Thread> _backgroundThread;
+
+        void    ProcessCompletions();
+        void    CalculatePriorities(const Float3& cameraPosition, const Float3& cameraVelocity, float lodErrorScale);
+        void    IssueReads();
+        bool    MakeRoom(size_t requiredBytes, float requestingPriority, bool force);
+        void    Evict(Node& node);
+        void    CancelRead(Node& node);
+
+        static uint32 xl_thread_call BackgroundThreadFunction(void*);
+        uint32  DoBackgroundThread();
+    };
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+    static bool ReadFromFile(std::vector<uint8>& dst, BasicFile& file, size_t offset, size_t size)
+    {
+        dst.resize(size);
+        if (!size) return true;
+        file.Seek(offset, SEEK_SET);
+        return file.Read(AsPointer(dst.begin()), 1, size) == size;
+    }
+
+    uint32 xl_thread_call TerrainResidencyManager::Pimpl::BackgroundThreadFunction(void* arg)
+    {
+        return ((Pimpl*)arg)->DoBackgroundThread();
+    }
+
+    uint32 TerrainResidencyManager::Pimpl::DoBackgroundThread()
+    {
+            //  Keep a small number of files open, so we don't have to reopen the
+            //  source file for every node read. Most of the time, reads will be
+            //  clustered into the same few cells.
+        const unsigned maxOpenFiles = 8;
+        std::vector<std::pair<std::string, BasicFile>> openFiles;
+
+        std::vector<ReadRequest> requests;
+        while (!_shutdownBackgroundThread) {
+            {
+                ScopedLock(_queueLock);
+                requests.swap(_requests);
+            }
+
+            if (requests.empty()) {
+                XlWaitForSyncObject(_wakeUpEvent, XL_INFINITE);
+                continue;
+            }
+
+            for (auto r=requests.begin(); r!=requests.end(); ++r) {
+                ReadResult result;
+                result._cellId = r->_cellId;
+                result._nodeIndex = r->_nodeIndex;
+                result._requestId = r->_requestId;
+                result._requestedSize = r->_size;
+                result._success = false;
+
+                auto f = std::find_if(openFiles.begin(), openFiles.end(),
+                    [&](const std::pair<std::string, BasicFile>& p) { return p.first == r->_filename; });
+                if (f == openFiles.end()) {
+                    TRY {
+                        if (openFiles.size() >= maxOpenFiles)
+                            openFiles.erase(openFiles.begin());
+                        openFiles.push_back(std::make_pair(r->_filename, BasicFile(r->_filename.c_str(), "rb")));
+                        f = openFiles.end()-1;
+                    } CATCH (...) {
+                        f = openFiles.end();
+                    } CATCH_END
+                }
+
+                if (f != openFiles.end())
+                    result._success = ReadFromFile(result._data, f->second, r->_offset, r->_size);
+
+                {
+                    ScopedLock(_queueLock);
+                    _completions.push_back(std::move(result));
+                    --_outstandingReads;
+                }
+                XlSetEvent(_completionEvent);
+            }
+            requests.clear();
+        }
+
+        return 0;
+    }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+    void TerrainResidencyManager::Pimpl::ProcessCompletions()
+    {
+        std::vector<ReadResult> completions;
+        {
+            ScopedLock(_queueLock);
+            completions.swap(_completions);
+        }
+
+        for (auto c=completions.begin(); c!=completions.end(); ++c) {
+            _metrics._bytesInFlight -= c->_requestedSize;
+            ++_metrics._readsCompleted;
+
+            if (c->_cellId >= _cells.size() || !_cells[c->_cellId]._active) continue;
+            auto& node = _cells[c->_cellId]._nodes[c->_nodeIndex];
+
+                //  If the node was read synchronously in the meantime, the request was
+                //  abandoned (see CancelRead) and we just drop this result.
+            if (node._state != NodeState::Pending || node._pendingRequest != c->_requestId) continue;
+
+            if (!c->_success) {
+                ++_metrics._readFailures;
+                node._state = NodeState::NotResident;
+                node._fileIndex = ~unsigned(0);     // don't keep retrying a bad node
+                continue;
+            }
+
+            node._data = std::move(c->_data);
+            node._state = NodeState::Resident;
+            _metrics._bytesResident += node._data.size();
+            _metrics._totalBytesRead += node._data.size();
+        }
+    }
+
+    void TerrainResidencyManager::Pimpl::CalculatePriorities(
+        const Float3& cameraPosition, const Float3& cameraVelocity, float lodErrorScale)
+    {
+            //  Calculate the screen space error for each node, both from the current camera
+            //  position and from where the camera is predicted to be after _predictionTime.
+            //  A node is wanted when its parent is too coarse for either position. Nodes only
+            //  wanted for the predicted position get a reduced priority, so that the current
+            //  view is always serviced first.
+        const float predictedWeight = .5f;
+        const float minDistance = 1e-3f;
+        Float3 predictedPosition = cameraPosition + _desc._predictionTime * cameraVelocity;
+
+        for (auto c=_cells.begin(); c!=_cells.end(); ++c) {
+            if (!c->_active) continue;
+            for (auto n=c->_nodes.begin(); n!=c->_nodes.end(); ++n) {
+                float d0 = std::max(minDistance, Magnitude(n->_center - cameraPosition) - n->_radius);
+                float d1 = std::max(minDistance, Magnitude(n->_center - predictedPosition) - n->_radius);
+                float e0 = n->_geometricError * lodErrorScale / d0;
+                float e1 = n->_geometricError * lodErrorScale / d1;
+                n->_screenError = std::max(e0, e1);
+
+                bool parentWantsCurrent = true, parentWantsPredicted = true;
+                if (n->_parent != ~unsigned(0)) {
+                    const auto& parent = c->_nodes[n->_parent];
+                    float pd0 = std::max(minDistance, Magnitude(parent._center - cameraPosition) - parent._radius);
+                    float pd1 = std::max(minDistance, Magnitude(parent._center - predictedPosition) - parent._radius);
+                    parentWantsCurrent   = parent._wanted && (parent._geometricError * lodErrorScale / pd0) > _desc._lodErrorThreshold;
+                    parentWantsPredicted = parent._wanted && (parent._geometricError * lodErrorScale / pd1) > _desc._lodErrorThreshold;
+                }
+
+                n->_wanted = parentWantsCurrent || parentWantsPredicted;
+                if (parentWantsCurrent)         n->_priority = e0;
+                else if (parentWantsPredicted)  n->_priority = predictedWeight * e1;
+                else                            n->_priority = 0.f;
+
+                if (n->_parent == ~unsigned(0))
+                    n->_priority = FLT_MAX;     // root nodes are always the most important
+
+                if (n->_wanted)
+                    n->_lastUsedFrame = _frameIndex;
+            }
+        }
+    }
+
+    void TerrainResidencyManager::Pimpl::Evict(Node& node)
+    {
+        assert(node._state == NodeState::Resident);
+        _metrics._bytesResident -= node._data.size();
+        std::vector<uint8>().swap(node._data);
+        node._state = NodeState::NotResident;
+        ++_metrics._evictions;
+    }
+
+    void TerrainResidencyManager::Pimpl::CancelRead(Node& node)
+    {
+            //  If the background thread hasn't picked up the request yet, we can just
+            //  remove it from the queue. Otherwise the read will complete, and
+            //  ProcessCompletions will drop the result (because the request id will no
+            //  longer match).
+        assert(node._state == NodeState::Pending);
+        {
+            ScopedLock(_queueLock);
+            auto i = std::find_if(_requests.begin(), _requests.end(),
+                [&](const ReadRequest& r) { return r._requestId == node._pendingRequest; });
+            if (i != _requests.end()) {
+                _metrics._bytesInFlight -= i->_size;
+                --_outstandingReads;
+                _requests.erase(i);
+            }
+        }
+        node._pendingRequest = 0;
+        node._state = NodeState::NotResident;
+    }
+
+    bool TerrainResidencyManager::Pimpl::MakeRoom(size_t requiredBytes, float requestingPriority, bool force)
+    {
+        if ((_metrics._bytesResident + _metrics._bytesInFlight + requiredBytes) <= _desc._residentByteLimit)
+            return true;
+
+            //  Find eviction candidates. Nodes that are no longer wanted go first (in LRU
+            //  order), then wanted nodes in order of increasing priority. We will only evict
+            //  a wanted node for a node with higher priority (unless "force" is set)
+            //  Data returned by GetNodeData() must stay valid until the next Update(), so
+            //  nodes looked up this frame are never candidates. That can leave us over the
+            //  limit after a stall; Update() will trim back down.
+        std::vector<Node*> candidates;
+        for (auto c=_cells.begin(); c!=_cells.end(); ++c) {
+            if (!c->_active) continue;
+            for (auto n=c->_nodes.begin(); n!=c->_nodes.end(); ++n)
+                if (n->_state == NodeState::Resident && n->_lastLookupFrame != _frameIndex)
+                    candidates.push_back(AsPointer(n));
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+            [](const Node* lhs, const Node* rhs)
+            {
+                if (lhs->_wanted != rhs->_wanted) return !lhs->_wanted;
+                if (!lhs->_wanted && lhs->_lastUsedFrame != rhs->_lastUsedFrame)
+                    return lhs->_lastUsedFrame < rhs->_lastUsedFrame;
+                return lhs->_priority < rhs->_priority;
+            });
+
+        for (auto i=candidates.begin(); i!=candidates.end(); ++i) {
+            if ((_metrics._bytesResident + _metrics._bytesInFlight + requiredBytes) <= _desc._residentByteLimit)
+                break;
+            if ((*i)->_wanted && !force && (*i)->_priority >= requestingPriority)
+                break;
+            Evict(**i);
+        }
+
+        return force || (_metrics._bytesResident + _metrics._bytesInFlight + requiredBytes) <= _desc._residentByteLimit;
+    }
+
+    void TerrainResidencyManager::Pimpl::IssueReads()
+    {
+        typedef std::pair<unsigned, unsigned> NodeId;
+        std::vector<std::pair<float, NodeId>> candidates;
+        for (unsigned c=0; c<unsigned(_cells.size()); ++c) {
+            const auto& cell = _cells[c];
+            if (!cell._active) continue;
+            for (unsigned n=0; n<unsigned(cell._nodes.size()); ++n) {
+                const auto& node = cell._nodes[n];
+                if (node._wanted && node._state == NodeState::NotResident && node._fileIndex != ~unsigned(0))
+                    candidates.push_back(std::make_pair(node._priority, NodeId(c, n)));
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+            [](const std::pair<float, NodeId>& lhs, const std::pair<float, NodeId>& rhs)
+            { return lhs.first > rhs.first; });
+
+        std::vector<ReadRequest> newRequests;
+        for (auto i=candidates.begin(); i!=candidates.end(); ++i) {
+            auto& cell = _cells[i->second.first];
+            auto& node = cell._nodes[i->second.second];
+            if ((_metrics._bytesReadThisFrame + node._fileSize) > _desc._frameReadBudget) break;
+            if ((_metrics._bytesInFlight + node._fileSize) > _desc._maxBytesInFlight) break;
+            if (!MakeRoom(node._fileSize, node._priority, false)) break;
+
+            ReadRequest req;
+            req._cellId = i->second.first;
+            req._nodeIndex = i->second.second;
+            req._filename = cell._files[node._fileIndex];
+            req._offset = node._fileOffset;
+            req._size = node._fileSize;
+            req._requestId = ++_nextRequestId;
+            if (!req._requestId) req._requestId = ++_nextRequestId;     // (0 is reserved for "no request")
+            node._state = NodeState::Pending;
+            node._pendingRequest = req._requestId;
+            newRequests.push_back(std::move(req));
+
+            _metrics._bytesReadThisFrame += node._fileSize;
+            _metrics._bytesInFlight += node._fileSize;
+            _metrics._peakBytesInFlight = std::max(_metrics._peakBytesInFlight, _metrics._bytesInFlight);
+            ++_metrics._readsIssued;
+        }
+
+        if (!newRequests.empty()) {
+            {
+                ScopedLock(_queueLock);
+                _outstandingReads += unsigned(newRequests.size());
+                for (auto r=newRequests.begin(); r!=newRequests.end(); ++r)
+                    _requests.push_back(std::move(*r));
+            }
+            XlSetEvent(_wakeUpEvent);
+        }
+    }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+    unsigned TerrainResidencyManager::AddCell(const TerrainCell& cell, const Float4x4& cellToWorld)
+    {
+        Pimpl::Cell newCell;
+        newCell._files[0] = cell.SourceFile();
+        newCell._files[1] = cell.SecondaryCacheFile();
+        newCell._active = true;
+        newCell._nodes.resize(cell._nodes.size());
+
+        for (auto f=cell._nodeFields.begin(); f!=cell._nodeFields.end(); ++f) {
+            auto parentField = (f == cell._nodeFields.begin()) ? cell._nodeFields.end() : (f-1);
+
+            for (unsigned n=f->_nodeBegin; n<f->_nodeEnd; ++n) {
+                const auto& src = *cell._nodes[n];
+                auto& dst = newCell._nodes[n];
+
+                if (src._heightMapFileSize) {
+                    dst._fileIndex = 0;
+                    dst._fileOffset = src._heightMapFileOffset;
+                    dst._fileSize = src._heightMapFileSize;
+                } else if (src._secondaryCacheSize && !newCell._files[1].empty()) {
+                    dst._fileIndex = 1;
+                    dst._fileOffset = src._secondaryCacheOffset;
+                    dst._fileSize = src._secondaryCacheSize;
+                } else {
+                    dst._fileIndex = ~unsigned(0);
+                    dst._fileOffset = dst._fileSize = 0;
+                }
+
+                dst._parent = ~unsigned(0);
+                if (parentField != cell._nodeFields.end()) {
+                    unsigned fieldIndex = n - f->_nodeBegin;
+                    unsigned x = fieldIndex % f->_widthInNodes, y = fieldIndex / f->_widthInNodes;
+                    dst._parent = parentField->_nodeBegin + (x/2) + (y/2) * parentField->_widthInNodes;
+                }
+
+                    //  The node local space is 0->1 in XY. In Z, height values are stored in
+                    //  compressed form, and _localToCell decompresses to cell space.
+                    //  We don't know the exact height range (without reading the data), but we
+                    //  can assume it covers the full range of a 16 bit value.
+                auto localToWorld = Combine(src._localToCell, cellToWorld);
+                Float3 mins = TransformPoint(localToWorld, Float3(0.f, 0.f, 0.f));
+                Float3 maxs = TransformPoint(localToWorld, Float3(1.f, 1.f, float(0xffff)));
+                dst._center = .5f * (mins + maxs);
+                dst._radius = .5f * Magnitude(Float2(maxs[0] - mins[0], maxs[1] - mins[1]));
+                dst._geometricError =
+                    Magnitude(Float2(maxs[0] - mins[0], maxs[1] - mins[1]))
+                    / float(std::max(1u, src._widthInElements - src.GetOverlapWidth()));
+
+                dst._state = Pimpl::NodeState::NotResident;
+                dst._wanted = false;
+                dst._screenError = dst._priority = 0.f;
+                dst._lastUsedFrame = 0;
+                dst._lastLookupFrame = ~unsigned(0);
+                dst._pendingRequest = 0;
+            }
+        }
+
+        _pimpl->_cells.push_back(std::move(newCell));
+        return unsigned(_pimpl->_cells.size()-1);
+    }
+
+    void TerrainResidencyManager::RemoveCell(unsigned cellId)
+    {
+        if (cellId >= _pimpl->_cells.size()) return;
+        auto& cell = _pimpl->_cells[cellId];
+        for (auto n=cell._nodes.begin(); n!=cell._nodes.end(); ++n) {
+            if (n->_state == Pimpl::NodeState::Resident) {
+                _pimpl->Evict(*n);
+            } else if (n->_state == Pimpl::NodeState::Pending) {
+                _pimpl->CancelRead(*n);
+            }
+        }
+        cell._active = false;
+        std::vector<Pimpl::Node>().swap(cell._nodes);
+    }
+
+    void TerrainResidencyManager::Update(const Float3& cameraPosition, const Float3& cameraVelocity, float lodErrorScale)
+    {
+        ++_pimpl->_frameIndex;
+        _pimpl->_metrics._bytesReadThisFrame = 0;
+
+        _pimpl->ProcessCompletions();
+        _pimpl->CalculatePriorities(cameraPosition, cameraVelocity, lodErrorScale);
+
+            //  Stalling lookups in the previous frame may have pushed us over the limit
+            //  (they can't evict anything returned in the same frame). Pointers from last
+            //  frame are no longer valid, so trim back down now.
+        _pimpl->MakeRoom(0, 0.f, true);
+        _pimpl->IssueReads();
+    }
+
+    auto TerrainResidencyManager::GetNodeData(unsigned cellId, unsigned nodeIndex, bool allowStall) -> NodeData
+    {
+        ++_pimpl->_metrics._lookups;
+        if (cellId >= _pimpl->_cells.size() || !_pimpl->_cells[cellId]._active) return NodeData();
+        auto& cell = _pimpl->_cells[cellId];
+        if (nodeIndex >= cell._nodes.size()) return NodeData();
+
+        auto& node = cell._nodes[nodeIndex];
+        node._lastUsedFrame = _pimpl->_frameIndex;
+        if (node._state == Pimpl::NodeState::Resident) {
+            ++_pimpl->_metrics._hits;
+            node._lastLookupFrame = _pimpl->_frameIndex;
+            return NodeData(AsPointer(node._data.cbegin()), node._data.size());
+        }
+
+        if (!allowStall || node._fileIndex == ~unsigned(0))
+            return NodeData();
+
+            //  Synchronous read on this thread. If there is already a read in flight,
+            //  cancel it (or, if it has already started, make sure its result is dropped)
+        ++_pimpl->_metrics._stalls;
+        if (node._state == Pimpl::NodeState::Pending)
+            _pimpl->CancelRead(node);
+        _pimpl->MakeRoom(node._fileSize, node._priority, true);
+        std::vector<uint8> data;
+        TRY {
+            BasicFile file(cell._files[node._fileIndex].c_str(), "rb");
+            if (!ReadFromFile(data, file, node._fileOffset, node._fileSize)) {
+                ++_pimpl->_metrics._readFailures;
+                return NodeData();
+            }
+        } CATCH (...) {
+            ++_pimpl->_metrics._readFailures;
+            return NodeData();
+        } CATCH_END
+
+        node._data = std::move(data);
+        node._state = Pimpl::NodeState::Resident;
+        node._lastLookupFrame = _pimpl->_frameIndex;
+        _pimpl->_metrics._bytesResident += node._data.size();
+        _pimpl->_metrics._totalBytesRead += node._data.size();
+        return NodeData(AsPointer(node._data.cbegin()), node._data.size());
+    }
+
+    bool TerrainResidencyManager::IsResident(unsigned cellId, unsigned nodeIndex) const
+    {
+        if (cellId >= _pimpl->_cells.size() || nodeIndex >= _pimpl->_cells[cellId]._nodes.size()) return false;
+        return _pimpl->_cells[cellId]._nodes[nodeIndex]._state == Pimpl::NodeState::Resident;
+    }
+
+    bool TerrainResidencyManager::IsWanted(unsigned cellId, unsigned nodeIndex) const
+    {
+        if (cellId >= _pimpl->_cells.size() || nodeIndex >= _pimpl->_cells[cellId]._nodes.size()) return false;
+        return _pimpl->_cells[cellId]._nodes[nodeIndex]._wanted;
+    }
+
+    void TerrainResidencyManager::Flush()
+    {
+        for (;;) {
+            unsigned outstanding;
+            {
+                ScopedLock(_pimpl->_queueLock);
+                outstanding = _pimpl->_outstandingReads;
+            }
+            if (!outstanding) break;
+            XlWaitForSyncObject(_pimpl->_completionEvent, XL_INFINITE);
+        }
+        _pimpl->ProcessCompletions();
+    }
+
+    auto TerrainResidencyManager::GetMetrics() const -> Metrics
+    {
+        return _pimpl->_metrics;
+    }
+
+    void TerrainResidencyManager::ResetMetrics()
+    {
+            // only the counters are reset. Byte totals reflect the current state
+        auto& m = _pimpl->_metrics;
+        m._lookups = m._hits = m._stalls = 0;
+        m._readsIssued = m._readsCompleted = m._readFailures = m._evictions = 0;
+        m._peakBytesInFlight = m._bytesInFlight;
+        m._totalBytesRead = 0;
+    }
+
+    TerrainResidencyManager::TerrainResidencyManager(const Desc& desc)
+    {
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_desc = desc;
+        pimpl->_frameIndex = 0;
+        pimpl->_nextRequestId = 0;
+        pimpl->_outstandingReads = 0;
+        pimpl->_shutdownBackgroundThread = false;
+        pimpl->_wakeUpEvent = XlCreateEvent(false);
+        pimpl->_completionEvent = XlCreateEvent(false);
+        _pimpl = std::move(pimpl);
+
+        _pimpl->_backgroundThread = std::make_unique<Threading::Thread>(&Pimpl::BackgroundThreadFunction, _pimpl.get());
+    }
+
+    TerrainResidencyManager::~TerrainResidencyManager()
+    {
+        _pimpl->_shutdownBackgroundThread = true;
+        XlSetEvent(_pimpl->_wakeUpEvent);
+        if (_pimpl->_backgroundThread) {
+            _pimpl->_backgroundThread->join();
+            _pimpl->_backgroundThread.reset();
+        }
+        XlCloseSyncObject(_pimpl->_wakeUpEvent);
+        XlCloseSyncObject(_pimpl->_completionEvent);
+    }
+
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+    TerrainResidencyManager::Desc::Desc()
+    {
+        _residentByteLimit = 64 * 1024 * 1024;
+        _frameReadBudget = 2 * 1024 * 1024;
+        _maxBytesInFlight = 8 * 1024 * 1024;
+        _lodErrorThreshold = 4.f;
+        _predictionTime = .5f;
+    }
+
+    TerrainResidencyManager::Metrics::Metrics()
+    {
+        _lookups = _hits = _stalls = 0;
+        _readsIssued = _readsCompleted = _readFailures = _evictions = 0;
+        _bytesInFlight = _peakBytesInFlight = _bytesResident = 0;
+        _bytesReadThisFrame = _totalBytesRead = 0;
+    }
+}
+
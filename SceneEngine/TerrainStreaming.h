@@ -0,0 +1,117 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Math/Vector.h"
+#include "../Math/Matrix.h"
+#include "../Utility/Mixins.h"
+#include "../Core/Types.h"
+#include <memory>
+
+namespace SceneEngine
+{
+    class TerrainCell;
+
+    /// <summary>CPU side residency manager for terrain node height data</summary>
+    /// Tracks a priority for every node of every registered cell, based on the
+    /// camera position, the camera velocity and the screen space error of the node.
+    /// Each frame, the most important non-resident nodes are read from disk on a
+    /// background thread, up to a per-frame byte budget. When the resident set
+    /// exceeds its limit, nodes are evicted by least-recently-used order (nodes that
+    /// are no longer wanted go first, then wanted nodes with the lowest priority).
+    ///
+    /// The manager deals only with raw node data (exactly as it is stored in the cell
+    /// source file or the secondary cache). It has no dependencies on the device, so
+    /// it can be driven entirely headless -- for example by replaying a recorded camera
+    /// path against a terrain on disk.
+    ///
+    /// All methods (other than the background reading) should be called from a single
+    /// thread.
+    class TerrainResidencyManager : noncopyable
+    {
+    public:
+        class Desc
+        {
+        public:
+            size_t      _residentByteLimit;     ///< total bytes of node data that can be resident at once
+            size_t      _frameReadBudget;       ///< maximum bytes of new reads issued per Update()
+            size_t      _maxBytesInFlight;      ///< maximum bytes of reads that can be outstanding at once
+            float       _lodErrorThreshold;     ///< screen space error (in pixels) above which a node is refined
+            float       _predictionTime;        ///< look-ahead (in seconds) used for prefetching along the camera velocity
+
+            Desc();
+        };
+
+        class Metrics
+        {
+        public:
+            unsigned    _lookups;           ///< calls to GetNodeData()
+            unsigned    _hits;              ///< lookups that found resident data
+            unsigned    _stalls;            ///< lookups that had to wait for a blocking read
+            unsigned    _readsIssued;
+            unsigned    _readsCompleted;
+            unsigned    _readFailures;
+            unsigned    _evictions;
+            size_t      _bytesInFlight;
+            size_t      _peakBytesInFlight;
+            size_t      _bytesResident;
+            size_t      _bytesReadThisFrame;
+            size_t      _totalBytesRead;
+
+            float       HitRate() const { return _lookups ? float(_hits) / float(_lookups) : 1.f; }
+
+            Metrics();
+        };
+
+        class NodeData
+        {
+        public:
+            const void* _data;
+            size_t      _size;
+            NodeData() : _data(nullptr), _size(0) {}
+            NodeData(const void* data, size_t size) : _data(data), _size(size) {}
+        };
+
+            /// <summary>Register a terrain cell</summary>
+            /// The cell must outlive its registration (the same rule as for the
+            /// renderer). Returns an id that is used to identify the cell in
+            /// other methods.
+        unsigned    AddCell(const TerrainCell& cell, const Float4x4& cellToWorld);
+        void        RemoveCell(unsigned cellId);
+
+            /// <summary>Recalculate priorities, issue new reads and evict</summary>
+            /// "lodErrorScale" converts a world space error at a distance of 1 into
+            /// pixels. For a perspective camera, this is normally
+            ///     viewportHeight / (2 * tan(verticalFOV / 2))
+        void        Update(const Float3& cameraPosition, const Float3& cameraVelocity, float lodErrorScale);
+
+            /// <summary>Find the data for a node, if it is resident</summary>
+            /// When the data isn't resident and "allowStall" is set, the data will be
+            /// read synchronously (this is counted as a stall in the metrics).
+            /// The returned pointer is valid until the next call to Update() or RemoveCell().
+            /// Nothing returned this frame will be evicted before then, so a stalling lookup
+            /// can temporarily push the resident set over its limit (Update() trims it back).
+            /// If a background read for the node is in flight, a stalling lookup cancels it.
+        NodeData    GetNodeData(unsigned cellId, unsigned nodeIndex, bool allowStall = false);
+        bool        IsResident(unsigned cellId, unsigned nodeIndex) const;
+        bool        IsWanted(unsigned cellId, unsigned nodeIndex) const;
+
+            /// <summary>Block until all outstanding reads have completed</summary>
+        void        Flush();
+
+        Metrics     GetMetrics() const;
+        void        ResetMetrics();
+
+        TerrainResidencyManager(const Desc& desc = Desc());
+        ~TerrainResidencyManager();
+
+    private:
+        class Pimpl;
+        std::unique_ptr<Pimpl> _pimpl;
+    };
+}
+
@@ -6,6 +6,7 @@
 
 #include "TerrainUberSurface.h"
 #include "TerrainInternal.h"
+#include "TerrainCompression.h"
 #include "Terrain.h"
 #include "SceneEngineUtility.h"
 #include "LightingParserContext.h"
@@ -67,21 +68,15 @@ namespace SceneEngine
 
             // todo -- check for incomplete nodes (ie, with holes)
         if (node._heightMapFileSize) {
-            auto count = node._heightMapFileSize/sizeof(uint16);
-            if (count == expectedCount) {
-                BasicFile file(sourceFileName, "rb");
-                rawData = std::make_unique<uint16[]>(count);
-                file.Seek(node._heightMapFileOffset, SEEK_SET);
-                file.Read(rawData.get(), sizeof(uint16), count);
-            }
+            BasicFile file(sourceFileName, "rb");
+            rawData = std::make_unique<uint16[]>(expectedCount);
+            if (!TerrainCompression::LoadNodeHeights(rawData.get(), node, file, nullptr))
+                rawData.reset();
         } else if (node._secondaryCacheSize) {
-            auto count = node._secondaryCacheSize/sizeof(uint16);
-            if (count == expectedCount) {
-                BasicFile file(secondaryCacheName, "rb");
-                rawData = std::make_unique<uint16[]>(count);
-                file.Seek(node._secondaryCacheOffset, SEEK_SET);
-                file.Read(rawData.get(), sizeof(uint16), count);
-            }
+            BasicFile sourceFile, file(secondaryCacheName, "rb");
+            rawData = std::make_unique<uint16[]>(expectedCount);
+            if (!TerrainCompression::LoadNodeHeights(rawData.get(), node, sourceFile, &file))
+                rawData.reset();
         }
 
         const unsigned dimsNoOverlay = node._widthInElements - node.GetOverlapWidth();
@@ -0,0 +1,137 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+    //
+    //  BufferUploads benchmark
+    //
+    //  Replays a transaction trace (recorded with BufferUploads::BeginTransactionTrace)
+    //  through a new BufferUploads manager, and reports latency and throughput.
+    //
+    //  The benchmark is built with the headless graphics API (the "-Headless"
+    //  configurations, which define SELECT_HEADLESS). The device is a simulated
+    //  GPU, and the timing of the GPU can be set on the command line. When built
+    //  for another graphics API, the default device for that API is used.
+    //
+    //  Usage:
+    //      BufferUploadsBenchmark -i <trace file>
+    //          [-realtime 0|1]                     (wait between events to match the trace; default 1)
+    //          [-drain <ms>]                       (time to wait for outstanding transactions at the end)
+    //          [-framebytes <bytes>]               (frame budget for steps that aren't due; default unlimited)
+    //          [-frametime <us>]                   (frame budget for steps that aren't due; default unlimited)
+    //          [-latency <us>]                     (headless only: simulated submit latency)
+    //          [-bandwidth <bytes per us>]         (headless only: simulated copy bandwidth, 0 for unlimited)
+    //          [-copyoverhead <us>]                (headless only: simulated GPU cost per copy)
+    //          [-createtime <us>]                  (headless only: simulated CPU cost of creating a resource)
+    //          [-maptime <us>]                     (headless only: simulated CPU cost of a map)
+    //
+
+#include "../../BufferUploads/TransactionTrace.h"
+#include "../../BufferUploads/IBufferUploads.h"
+#include "../../RenderCore/IDevice.h"
+#include "../../RenderCore/IThreadContext.h"
+#include "../../RenderCore/Metal/Metal.h"
+#include "../../Core/Exceptions.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include <iostream>
+
+#if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+    #include "../../RenderCore/Headless/IDeviceHeadless.h"
+    #include "../../RenderCore/Metal/DeviceContext.h"
+#endif
+
+static void PrintResults(const BufferUploads::TraceReplayResults& results)
+{
+    std::cout << "Transactions:        " << results._transactionCount << " (plus " << results._immediateCount << " immediate, " << results._updateDataCount << " updates)" << std::endl;
+    std::cout << "Frames:              " << results._frameCount << std::endl;
+    std::cout << "Incomplete:          " << results._incompleteCount << std::endl;
+    std::cout << "Bytes requested:     " << results._bytesRequested << std::endl;
+    std::cout << "Bytes uploaded:      " << results._bytesUploaded << " (in " << results._commandListCount << " command lists)" << std::endl;
+    std::cout << "Cancelled steps:     " << results._cancelledSteps << std::endl;
+    std::cout << "Wall time:           " << results._wallTime / 1000 << "ms" << std::endl;
+    std::cout << "Latency (us):        min " << results._latencyMin << ", median " << results._latencyMedian
+        << ", 95th " << results._latency95th << ", max " << results._latencyMax << std::endl;
+    if (results._wallTime) {
+        std::cout << "Throughput:          " << (results._bytesUploaded / results._wallTime) << " bytes/us" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace RenderCore;
+
+    const char* inputFile = nullptr;
+    BufferUploads::TraceReplaySettings settings;
+    BufferUploads::FrameBudget frameBudget;
+    #if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+        Metal::SimulatedGPUDesc gpuDesc;
+    #endif
+
+    for (int c=1; c<argc; ++c) {
+        const char* arg = argv[c];
+        const char* value = (c+1 < argc) ? argv[c+1] : nullptr;
+        if (!value) {
+            std::cerr << "Missing value for argument (" << arg << ")" << std::endl;
+            return 1;
+        }
+
+        if (!XlCompareString(arg, "-i"))                { inputFile = value; }
+        else if (!XlCompareString(arg, "-realtime"))    { settings._realTime = XlAtoI32(value) != 0; }
+        else if (!XlCompareString(arg, "-drain"))       { settings._drainTimeout = Microsecond(std::max(0, XlAtoI32(value))) * 1000; }
+        else if (!XlCompareString(arg, "-framebytes"))  { frameBudget._bytesPerFrame = std::max(0, XlAtoI32(value)); }
+        else if (!XlCompareString(arg, "-frametime"))   { frameBudget._microsecondsPerFrame = std::max(0, XlAtoI32(value)); }
+        #if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+            else if (!XlCompareString(arg, "-latency"))         { gpuDesc._submitLatency = std::max(0, XlAtoI32(value)); }
+            else if (!XlCompareString(arg, "-bandwidth"))       { gpuDesc._copyBytesPerMicrosecond = std::max(0, XlAtoI32(value)); }
+            else if (!XlCompareString(arg, "-copyoverhead"))    { gpuDesc._copyOverhead = std::max(0, XlAtoI32(value)); }
+            else if (!XlCompareString(arg, "-createtime"))      { gpuDesc._createResourceTime = std::max(0, XlAtoI32(value)); }
+            else if (!XlCompareString(arg, "-maptime"))         { gpuDesc._mapTime = std::max(0, XlAtoI32(value)); }
+        #endif
+        else {
+            std::cerr << "Unknown argument (" << arg << ")" << std::endl;
+            return 1;
+        }
+        ++c;
+    }
+
+    if (!inputFile) {
+        std::cerr << "Usage: BufferUploadsBenchmark -i <trace file> [-realtime 0|1] [-drain <ms>] [-framebytes <bytes>] [-frametime <us>] [-latency <us>] [-bandwidth <bytes per us>] [-copyoverhead <us>] [-createtime <us>] [-maptime <us>]" << std::endl;
+        return 1;
+    }
+
+    TRY {
+        auto trace = BufferUploads::TransactionTrace::Load(inputFile);
+        std::cout << "Loaded " << trace._events.size() << " events from (" << inputFile << ")" << std::endl;
+
+        #if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+            auto device = CreateHeadlessDevice(gpuDesc);
+        #else
+            auto device = CreateDevice();
+        #endif
+        auto immediateContext = device->GetImmediateContext();
+
+        BufferUploads::TraceReplayResults results;
+        {
+            auto manager = BufferUploads::CreateManager(device.get());
+            manager->SetFrameBudget(frameBudget);
+            results = BufferUploads::ReplayTransactionTrace(*manager, *immediateContext, trace, settings);
+        }
+        PrintResults(results);
+
+        #if GFXAPI_ACTIVE == GFXAPI_HEADLESS
+            auto gpuMetrics = Metal::ObjectFactory(device.get()).GetGPU().GetMetrics();
+            std::cout << "Simulated GPU:       " << gpuMetrics._submitCount << " submits, " << gpuMetrics._copyCount << " copies, "
+                << gpuMetrics._bytesCopied << " bytes copied, busy " << gpuMetrics._busyTime / 1000 << "ms" << std::endl;
+            std::cout << "CPU stalls on GPU:   " << gpuMetrics._stallCount << " (" << gpuMetrics._stallTime / 1000 << "ms total)" << std::endl;
+        #endif
+
+        return results._incompleteCount ? 2 : 0;
+    } CATCH (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    } CATCH_END
+}
+
@@ -0,0 +1,197 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+    //
+    //  Offline shader precompiler
+    //
+    //  Finds all of the shader variations that can be reached from a set of technique
+    //  files and material scaffolds, compiles them in parallel and writes them into a
+    //  single ShaderVariationArchive (see RenderCore/ShaderVariationArchive.h).
+    //
+    //  Usage:
+    //      ShaderPrecompiler -o <output archive> -t <technique file> [-t ...]
+    //          [-m <material scaffold>]...         (material parameters from all materials in the scaffold)
+    //          [-g "A=1;B=2"]...                   (geometry parameter set)
+    //          [-e "A=1;B=2"]...                   (global environment parameter set)
+    //          [-r "A=1;B=2"]...                   (runtime parameter set)
+    //          [-sm 5_0]                           (shader model used for "vs_*", etc)
+    //          [-j <threads>]
+    //          [-w <working directory>]
+    //
+    //  Each "-g", "-e", "-r" and "-m" option adds one possible state for that parameter
+    //  source. Every combination of states is tested.
+    //
+
+#include "../../RenderCore/ShaderVariationArchive.h"
+#include "../../RenderCore/Techniques/ShaderVariationEnumerator.h"
+#include "../../RenderCore/Techniques/Techniques.h"
+#include "../../RenderCore/Assets/MaterialScaffold.h"
+#include "../../RenderCore/Assets/ModelRunTimeInternal.h"
+#include "../../RenderCore/Assets/Material.h"
+#include "../../RenderCore/Metal/Shader.h"
+#include "../../Assets/CompileAndAsyncManager.h"
+#include "../../Assets/IntermediateResources.h"
+#include "../../Assets/Assets.h"
+#include "../../ConsoleRig/Log.h"
+#include "../../Utility/Streams/PathUtils.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/ParameterBox.h"
+#include "../../Utility/SystemUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include <thread>
+#include <iostream>
+
+using namespace RenderCore;
+using namespace RenderCore::Techniques;
+
+static void SetWorkingDirectory()
+{
+        //
+        //      For convenience, set the working directory to be ../Working
+        //              (relative to the application path)
+        //
+    nchar_t appPath     [MaxPath];
+    nchar_t appDir      [MaxPath];
+    nchar_t workingDir  [MaxPath];
+
+    XlGetProcessPath    (appPath, dimof(appPath));
+    XlSimplifyPath      (appPath, dimof(appPath), appPath, a2n("\\/"));
+    XlDirname           (appDir, dimof(appDir), appPath);
+    XlConcatPath        (workingDir, dimof(workingDir), appDir, a2n("..\\Working"));
+    XlSimplifyPath      (workingDir, dimof(workingDir), workingDir, a2n("\\/"));
+    XlChDir             (workingDir);
+}
+
+static ParameterBox ParseParameterSet(const char input[])
+{
+        //  Parse a string in the same form as a defines table:
+        //      "NAME=value;NAME2=value2;NAME3"
+        //  (names without values are given the value "1")
+    ParameterBox result;
+    std::string str = input;
+    size_t offset = 0;
+    while (offset < str.size()) {
+        auto end = str.find_first_of(';', offset);
+        if (end == std::string::npos) end = str.size();
+
+        auto item = str.substr(offset, end-offset);
+        if (!item.empty()) {
+            auto equals = item.find_first_of('=');
+            if (equals != std::string::npos) {
+                result.SetParameter(item.substr(0, equals).c_str(), item.substr(equals+1).c_str());
+            } else {
+                result.SetParameter(item.c_str(), 1u);
+            }
+        }
+        offset = end+1;
+    }
+    return std::move(result);
+}
+
+static void AddMaterialScaffold(ShaderVariationEnumerator& enumerator, const char initializer[])
+{
+    auto& scaffold = ::Assets::GetAssetComp<RenderCore::Assets::MaterialScaffold>(initializer);
+    const auto& materials = scaffold.ImmutableData()._materials;
+    for (auto i=materials.cbegin(); i!=materials.cend(); ++i) {
+        ParameterBox matParams;
+        matParams.MergeIn(i->second._matParams);
+        enumerator.AddParameterBox(ShaderParameters::Source::Material, std::move(matParams));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    const char* outputFile = nullptr;
+    const char* shaderModel = "5_0";
+    const char* workingDir = nullptr;
+    unsigned threadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<const char*> techniqueFiles;
+    std::vector<const char*> materialScaffolds;
+    std::vector<std::pair<ShaderParameters::Source::Enum, const char*>> parameterSets;
+
+    for (int c=1; c<argc; ++c) {
+        const char* arg = argv[c];
+        const char* value = (c+1 < argc) ? argv[c+1] : nullptr;
+        if (!value) {
+            std::cerr << "Missing value for argument (" << arg << ")" << std::endl;
+            return 1;
+        }
+
+        if (!XlCompareString(arg, "-o"))            { outputFile = value; }
+        else if (!XlCompareString(arg, "-t"))       { techniqueFiles.push_back(value); }
+        else if (!XlCompareString(arg, "-m"))       { materialScaffolds.push_back(value); }
+        else if (!XlCompareString(arg, "-g"))       { parameterSets.push_back(std::make_pair(ShaderParameters::Source::Geometry, value)); }
+        else if (!XlCompareString(arg, "-e"))       { parameterSets.push_back(std::make_pair(ShaderParameters::Source::GlobalEnvironment, value)); }
+        else if (!XlCompareString(arg, "-r"))       { parameterSets.push_back(std::make_pair(ShaderParameters::Source::Runtime, value)); }
+        else if (!XlCompareString(arg, "-sm"))      { shaderModel = value; }
+        else if (!XlCompareString(arg, "-j"))       { threadCount = std::max(1, XlAtoI32(value)); }
+        else if (!XlCompareString(arg, "-w"))       { workingDir = value; }
+        else {
+            std::cerr << "Unknown argument (" << arg << ")" << std::endl;
+            return 1;
+        }
+        ++c;
+    }
+
+    if (!outputFile || techniqueFiles.empty()) {
+        std::cerr << "Usage: ShaderPrecompiler -o <output archive> -t <technique file> [-m <material scaffold>] [-g|-e|-r \"A=1;B=2\"] [-sm <shader model>] [-j <threads>] [-w <working dir>]" << std::endl;
+        return 1;
+    }
+
+    if (workingDir) {
+        XlChDir((const utf8*)workingDir);
+    } else {
+        SetWorkingDirectory();
+    }
+    CreateDirectoryRecursive("int");
+    ConsoleRig::Logging_Startup("log.cfg", "int/shaderprecompilerlog.txt");
+
+        //  We need the intermediate resources store (and the material scaffold compiler)
+        //  to load material scaffolds. But we never create a device; shaders are compiled
+        //  directly through the IShaderVariationCompiler interface.
+    auto compileAndAsync = std::make_unique<::Assets::CompileAndAsyncManager>();
+    compileAndAsync->GetIntermediateCompilers().AddCompiler(
+        RenderCore::Assets::MaterialScaffold::CompileProcessType,
+        std::make_shared<RenderCore::Assets::MaterialScaffoldCompiler>());
+
+    TRY {
+        ShaderVariationEnumerator enumerator;
+        for (auto i=parameterSets.cbegin(); i!=parameterSets.cend(); ++i) {
+            enumerator.AddParameterBox(i->first, ParseParameterSet(i->second));
+        }
+        for (auto i=materialScaffolds.cbegin(); i!=materialScaffolds.cend(); ++i) {
+            AddMaterialScaffold(enumerator, *i);
+        }
+        for (auto i=techniqueFiles.cbegin(); i!=techniqueFiles.cend(); ++i) {
+            enumerator.AddShaderType(::Assets::GetAssetDep<ShaderType>(*i));
+        }
+
+        const auto& variations = enumerator.GetVariations();
+        std::cout << "Found " << variations.size() << " shader variations (from " << enumerator.GetCombinationsTested() << " technique states)" << std::endl;
+        if (enumerator.GetTechniquesSkipped())
+            std::cout << "Warning: skipped " << enumerator.GetTechniquesSkipped() << " techniques with too many parameter combinations" << std::endl;
+
+        auto compiler = Metal::CreateShaderVariationCompiler(shaderModel);
+        ShaderVariationArchiveWriter writer;
+        auto result = PrecompileShaderVariations(
+            writer, AsPointer(variations.cbegin()), variations.size(),
+            *compiler, threadCount);
+
+        for (auto i=result._failures.cbegin(); i!=result._failures.cend(); ++i) {
+            std::cerr << "Failed to compile (" << i->first._initializer << ") with defines (" << i->first._definesTable << "):" << std::endl;
+            std::cerr << i->second << std::endl;
+        }
+
+        writer.Write(outputFile);
+        std::cout << "Wrote " << result._compiledCount << " compiled shaders to (" << outputFile << ")" << std::endl;
+
+        return result._failures.empty() ? 0 : 2;
+    } CATCH (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    } CATCH_END
+}
+
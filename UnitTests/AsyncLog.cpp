@@ -0,0 +1,157 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../ConsoleRig/AsyncLog.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdarg.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using ConsoleRig::AsyncLogger;
+    namespace LogSeverity = ConsoleRig::LogSeverity;
+
+        //  Messages written by the background thread. Only read after Flush() returns.
+    static std::vector<std::pair<LogSeverity::Enum, std::string>> s_writtenMessages;
+
+        //  When s_blockNextMessage is set, the next message blocks the background thread
+        //  (in the middle of writing) until s_releaseWriter is set.
+    static Interlocked::Value volatile s_blockNextMessage = 0;
+    static XlHandle s_writerBlocked = nullptr;
+    static XlHandle s_releaseWriter = nullptr;
+
+    static void TestWriteMessage(LogSeverity::Enum severity, unsigned, const char message[])
+    {
+        if (Interlocked::Exchange(&s_blockNextMessage, 0)) {
+            XlSetEvent(s_writerBlocked);
+            XlWaitForSyncObject(s_releaseWriter, 10000);
+        }
+        s_writtenMessages.push_back(std::make_pair(severity, std::string(message)));
+    }
+
+    static bool PushF(AsyncLogger& logger, LogSeverity::Enum severity, const char format[], ...)
+    {
+        va_list args;
+        va_start(args, format);
+        bool result = logger.Push(severity, 0, format, args);
+        va_end(args);
+        return result;
+    }
+
+    static AsyncLogger::Desc TestLoggerDesc()
+    {
+        AsyncLogger::Desc desc;
+        desc._threadBufferSize = 4096;
+        desc._writeIntervalMS = 60 * 1000;      // (only write when woken)
+        desc._flushOnCrash = false;
+        desc._writeMessage = &TestWriteMessage;
+        return desc;
+    }
+
+    TEST_CLASS(AsyncLog)
+    {
+    public:
+        TEST_METHOD(CaptureAndFormat)
+        {
+            s_writtenMessages.clear();
+            {
+                AsyncLogger logger(TestLoggerDesc());
+
+                    //  '*' widths & precisions, wide strings and 64 bit integers (with both
+                    //  the standard and the msvc length modifiers)
+                PushF(logger, LogSeverity::Info, "[%*.*f][%-*.*f]", 10, 3, 3.14159, 8, 2, -2.5);
+                PushF(logger, LogSeverity::Info, "%ls and %s", L"wide string", "narrow");
+                PushF(logger, LogSeverity::Warning, "%lld %llu %I64d %I64u", -1234567890123ll, 18446744073709551615ull, 9000000000ll, 9000000001ull);
+                PushF(logger, LogSeverity::Info, "%hhd %hd %ld %zu %c %x %.1e %s %%", -3, -300, -70000l, size_t(12345), 'Q', 0xbeefu, 12500.0, (const char*)nullptr);
+
+                    //  String arguments are copied when the message is logged
+                char buffer[] = "original";
+                PushF(logger, LogSeverity::Info, "copied %s", buffer);
+                buffer[0] = 'X';
+
+                    //  Strings are truncated so that the entry fits in 1KB. Nothing after
+                    //  them can be captured, so the rest of the format string is copied as is.
+                std::string longString(3000, 'x');
+                PushF(logger, LogSeverity::Error, "[%s] %d", longString.c_str(), 5);
+
+                Assert::IsTrue(logger.Flush());
+            }
+
+            Assert::AreEqual(size_t(6), s_writtenMessages.size());
+            Assert::AreEqual(std::string("[     3.142][-2.50   ]"), s_writtenMessages[0].second);
+            Assert::AreEqual(std::string("wide string and narrow"), s_writtenMessages[1].second);
+            Assert::AreEqual(std::string("-1234567890123 18446744073709551615 9000000000 9000000001"), s_writtenMessages[2].second);
+            Assert::AreEqual(std::string("-3 -300 -70000 12345 Q beef 1.2e+04 (null) %"), s_writtenMessages[3].second);
+            Assert::AreEqual(std::string("copied original"), s_writtenMessages[4].second);
+
+            Assert::AreEqual(int(LogSeverity::Info), int(s_writtenMessages[0].first));
+            Assert::AreEqual(int(LogSeverity::Warning), int(s_writtenMessages[2].first));
+            Assert::AreEqual(int(LogSeverity::Error), int(s_writtenMessages[5].first));
+
+            const auto& truncated = s_writtenMessages[5].second;
+            auto xCount = std::count(truncated.begin(), truncated.end(), 'x');
+            Assert::IsTrue(xCount > 900 && xCount < 1024);
+            Assert::AreEqual(std::string("[") + std::string(xCount, 'x') + "] %d", truncated);
+        }
+
+        TEST_METHOD(DroppedMessages)
+        {
+            s_writtenMessages.clear();
+            s_writerBlocked = XlCreateEvent(false);
+            s_releaseWriter = XlCreateEvent(false);
+            unsigned pushedCount = 0;
+            bool errorAccepted = true;
+            {
+                AsyncLogger logger(TestLoggerDesc());
+
+                    //  Block the background thread while it's writing the first message. It
+                    //  won't free up any space in the ring buffer until it's released.
+                Interlocked::Exchange(&s_blockNextMessage, 1);
+                PushF(logger, LogSeverity::Info, "first");
+                logger.Flush(0);        // (just wakes the background thread)
+                Assert::AreEqual(0u, XlWaitForSyncObject(s_writerBlocked, 10000));
+
+                    //  Fill the ring buffer (4096 bytes, 40 bytes per message). Messages that
+                    //  don't fit are dropped, but errors are given back to the caller
+                for (unsigned c=0; c<200; ++c) {
+                    Assert::IsTrue(PushF(logger, LogSeverity::Info, "message %i", c));
+                    ++pushedCount;
+                }
+                errorAccepted = PushF(logger, LogSeverity::Error, "error");
+
+                XlSetEvent(s_releaseWriter);
+                Assert::IsTrue(logger.Flush());
+            }
+            XlCloseSyncObject(s_writerBlocked);
+            XlCloseSyncObject(s_releaseWriter);
+            s_writerBlocked = s_releaseWriter = nullptr;
+
+            Assert::IsFalse(errorAccepted);
+
+                //  "first", then the messages that fit (in order), then the number dropped
+            Assert::IsTrue(s_writtenMessages.size() > 50);
+            Assert::AreEqual(std::string("first"), s_writtenMessages[0].second);
+            unsigned writtenCount = unsigned(s_writtenMessages.size()) - 2;
+            for (unsigned c=0; c<writtenCount; ++c) {
+                Assert::AreEqual("message " + std::to_string(c), s_writtenMessages[c+1].second);
+            }
+
+            auto droppedCount = pushedCount - writtenCount;
+            Assert::IsTrue(droppedCount > 0);
+            Assert::AreEqual(
+                "(" + std::to_string(droppedCount) + " log messages dropped because the log queue was full)",
+                s_writtenMessages.back().second);
+            Assert::AreEqual(int(LogSeverity::Warning), int(s_writtenMessages.back().first));
+        }
+    };
+}
+
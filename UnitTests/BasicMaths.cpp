@@ -5,7 +5,11 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "../Math/Transformations.h"
+#include "../Math/Geometry.h"
 #include <CppUnitTest.h>
+#include <random>
+#include <vector>
+#include <float.h>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -73,5 +77,80 @@ namespace UnitTests
 
 		}
 
+		TEST_METHOD(ArrayTransformations)
+		{
+				// Compare the SIMD array transformations to the single element
+				// versions. The array lengths aren't multiples of the SIMD widths,
+				// so the left over elements are also tested.
+			const float tolerance = 1.e-4f;
+			std::mt19937 rng(11);
+			std::uniform_real_distribution<float> dist(-10.f, 10.f);
+
+			const size_t count = 37;
+			std::vector<Float4x4> first(count), second(count), result(count);
+			std::vector<Float3x4> first34(count), second34(count), result34(count);
+			for (size_t c=0; c<count; ++c)
+				for (unsigned e=0; e<16; ++e) {
+					first[c](e/4, e%4) = dist(rng);
+					second[c](e/4, e%4) = dist(rng);
+					if (e < 12) {
+						first34[c](e/4, e%4) = dist(rng);
+						second34[c](e/4, e%4) = dist(rng);
+					}
+				}
+
+			Combine(&result[0], &first[0], &second[0], count);
+			for (size_t c=0; c<count; ++c)
+				Assert::IsTrue(Equivalent(result[c], Combine(first[c], second[c]), tolerance));
+
+			Combine(&result34[0], &first34[0], second34[0], count);
+			for (size_t c=0; c<count; ++c)
+				Assert::IsTrue(Equivalent(AsFloat4x4(result34[c]), AsFloat4x4(Combine(first34[c], second34[0])), tolerance));
+
+			Float4x4 inPlace = second[0];
+			Combine_InPlace(first[0], inPlace);
+			Assert::IsTrue(Equivalent(inPlace, Combine(first[0], second[0]), tolerance));
+
+			std::vector<Float3> points(count), transformed(count);
+			for (auto& p:points) p = Float3(dist(rng), dist(rng), dist(rng));
+			TransformPoints(&transformed[0], first34[0], &points[0], count);
+			for (size_t c=0; c<count; ++c)
+				Assert::IsTrue(Equivalent(transformed[c], TransformPoint(first34[0], points[c]), tolerance));
+			TransformDirectionVectors(&transformed[0], first[0], &points[0], count);
+			for (size_t c=0; c<count; ++c)
+				Assert::IsTrue(Equivalent(transformed[c], TransformDirectionVector(first[0], points[c]), tolerance));
+
+				// bounding boxes are compared to the box around the 8 transformed corners
+				// (which adds up the same values in a different order)
+			const float boxTolerance = 1.e-3f;
+			std::vector<std::pair<Float3, Float3>> boxes(count), transformedBoxes(count);
+			for (auto& b:boxes) {
+				b.first = Float3(dist(rng), dist(rng), dist(rng));
+				b.second = b.first + Float3(5.f, 6.f, 7.f);
+			}
+			TransformBoundingBoxes(&transformedBoxes[0], &first34[0], &boxes[0], count);
+			for (size_t c=0; c<count; ++c) {
+				Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				for (unsigned corner=0; corner<8; ++corner) {
+					auto pt = TransformPoint(first34[c], Float3(
+						(corner&1) ? boxes[c].second[0] : boxes[c].first[0],
+						(corner&2) ? boxes[c].second[1] : boxes[c].first[1],
+						(corner&4) ? boxes[c].second[2] : boxes[c].first[2]));
+					for (unsigned e=0; e<3; ++e) {
+						mins[e] = std::min(mins[e], pt[e]);
+						maxs[e] = std::max(maxs[e], pt[e]);
+					}
+				}
+				Assert::IsTrue(Equivalent(transformedBoxes[c].first, mins, boxTolerance));
+				Assert::IsTrue(Equivalent(transformedBoxes[c].second, maxs, boxTolerance));
+			}
+
+			std::vector<Quaternion> quats(count);
+			for (auto& q:quats) q = MakeRotationQuaternion(Normalize(Float3(dist(rng), dist(rng), dist(rng))), dist(rng));
+			AsFloat4x4(&result[0], &quats[0], count);
+			for (size_t c=0; c<count; ++c)
+				Assert::IsTrue(Equivalent(result[c], AsFloat4x4(quats[c]), tolerance));
+		}
+
 	};
 }
\ No newline at end of file
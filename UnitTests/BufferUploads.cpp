@@ -0,0 +1,395 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../BufferUploads/IBufferUploads.h"
+#include "../BufferUploads/TransactionTrace.h"
+#include "../BufferUploads/StepSchedule.h"
+#include "../RenderCore/Metal/Format.h"
+#include "../RenderCore/IDevice.h"
+#include "../RenderCore/IThreadContext.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/StringUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Packet that is filled some time after the transaction begins (like a
+        //  file read that hasn't finished yet). The test decides when it completes,
+        //  and whether it succeeds.
+    class LatePacket : public BufferUploads::RawDataPacket
+    {
+    public:
+        enum State { Pending, Ready, Failed };
+
+        void* GetData(unsigned mipIndex, unsigned arrayIndex)
+        {
+            if (mipIndex != 0 || arrayIndex != 0) return nullptr;
+            while (Interlocked::Load(&_state) == Pending)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            return (Interlocked::Load(&_state) == Ready) ? AsPointer(_data.begin()) : nullptr;
+        }
+        size_t GetDataSize(unsigned mipIndex, unsigned arrayIndex) const { return (mipIndex == 0 && arrayIndex == 0) ? _data.size() : 0; }
+        std::pair<unsigned,unsigned> GetRowAndSlicePitch(unsigned, unsigned) const { return std::make_pair(unsigned(_data.size()), unsigned(_data.size())); }
+        bool IsDataReady() const { return Interlocked::Load(&_state) == Ready; }
+        bool HasFailed() const { return Interlocked::Load(&_state) == Failed; }
+
+        void Complete(State newState) { Interlocked::Exchange(&_state, newState); }
+
+        LatePacket(size_t size) : _data(size, 0x7f), _state(Pending) {}
+
+    protected:
+        std::vector<uint8> _data;
+        mutable Interlocked::Value _state;
+    };
+
+    static BufferUploads::BufferDesc MakeVertexBufferDesc(unsigned size)
+    {
+        using namespace BufferUploads;
+        LinearBufferDesc lbDesc;
+        lbDesc._structureByteSize = 0;
+        lbDesc._sizeInBytes = size;
+        return CreateDesc(BindFlag::VertexBuffer, 0, GPUAccess::Read, lbDesc, "LatePacketTest");
+    }
+
+    TEST_CLASS(UploadsManager)
+    {
+    public:
+        TEST_METHOD(FramePriorityLatePacket)
+        {
+                //  A frame priority transaction must be complete after the barrier
+                //  and the next Update(), even if its data arrives after the barrier
+                //  is set. If the data fails to load, the transaction must still
+                //  complete (rather than waiting forever).
+            using namespace BufferUploads;
+            auto renderDevice = RenderCore::CreateDevice();
+            auto manager = CreateManager(renderDevice.get());
+            auto immediateContext = renderDevice->GetImmediateContext();
+
+            const unsigned size = 1024;
+            const LatePacket::State finalStates[] = { LatePacket::Ready, LatePacket::Failed };
+            for (unsigned c=0; c<dimof(finalStates); ++c) {
+                auto packet = make_intrusive<LatePacket>(size);
+                auto id = manager->Transaction_Begin(MakeVertexBufferDesc(size), packet.get(), TransactionOptions::FramePriority);
+
+                    //  give the background thread a chance to see (and skip) the pending step
+                manager->Update(*immediateContext);
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+                Assert::IsFalse(manager->IsCompleted(id));
+
+                auto finalState = finalStates[c];
+                std::thread completer(
+                    [packet, finalState]()
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                        packet->Complete(finalState);
+                    });
+
+                manager->FramePriority_Barrier();
+                manager->Update(*immediateContext);
+                completer.join();
+
+                Assert::IsTrue(manager->IsCompleted(id));
+                auto resource = manager->GetResource(id);
+                Assert::IsTrue(resource && !resource->IsEmpty());
+                manager->Transaction_End(id);
+            }
+        }
+    };
+
+    static void AssertSameDesc(const BufferUploads::BufferDesc& lhs, const BufferUploads::BufferDesc& rhs)
+    {
+        using namespace BufferUploads;
+        Assert::AreEqual(unsigned(lhs._type), unsigned(rhs._type));
+        Assert::AreEqual(lhs._bindFlags, rhs._bindFlags);
+        Assert::AreEqual(lhs._cpuAccess, rhs._cpuAccess);
+        Assert::AreEqual(lhs._gpuAccess, rhs._gpuAccess);
+        Assert::AreEqual(lhs._allocationRules, rhs._allocationRules);
+        if (lhs._type == BufferDesc::Type::LinearBuffer) {
+            Assert::AreEqual(lhs._linearBufferDesc._sizeInBytes, rhs._linearBufferDesc._sizeInBytes);
+            Assert::AreEqual(lhs._linearBufferDesc._structureByteSize, rhs._linearBufferDesc._structureByteSize);
+        } else if (lhs._type == BufferDesc::Type::Texture) {
+            auto &l = lhs._textureDesc, &r = rhs._textureDesc;
+            Assert::AreEqual(unsigned(l._dimensionality), unsigned(r._dimensionality));
+            Assert::AreEqual(l._width, r._width);
+            Assert::AreEqual(l._height, r._height);
+            Assert::AreEqual(l._depth, r._depth);
+            Assert::AreEqual(l._nativePixelFormat, r._nativePixelFormat);
+            Assert::AreEqual(unsigned(l._mipCount), unsigned(r._mipCount));
+            Assert::AreEqual(unsigned(l._arrayCount), unsigned(r._arrayCount));
+            Assert::AreEqual(unsigned(l._samples._sampleCount), unsigned(r._samples._sampleCount));
+            Assert::AreEqual(unsigned(l._samples._samplingQuality), unsigned(r._samples._samplingQuality));
+        }
+    }
+
+    static void AssertSamePart(const BufferUploads::PartialResource& lhs, const BufferUploads::PartialResource& rhs)
+    {
+        Assert::AreEqual(lhs._box._left, rhs._box._left);
+        Assert::AreEqual(lhs._box._top, rhs._box._top);
+        Assert::AreEqual(lhs._box._right, rhs._box._right);
+        Assert::AreEqual(lhs._box._bottom, rhs._box._bottom);
+        Assert::AreEqual(lhs._lodLevelMin, rhs._lodLevelMin);
+        Assert::AreEqual(lhs._lodLevelMax, rhs._lodLevelMax);
+        Assert::AreEqual(lhs._arrayIndex, rhs._arrayIndex);
+    }
+
+    static bool RejectsTrace(const char* begin, const char* end)
+    {
+        try {
+            BufferUploads::TransactionTrace::Parse(begin, end);
+        } catch (const std::exception&) {
+            return true;
+        }
+        return false;
+    }
+
+    TEST_CLASS(TransactionTraces)
+    {
+    public:
+        TEST_METHOD(SerializeRoundTrip)
+        {
+                //  Every event type, with texture and linear buffer descs, must
+                //  come back out of Parse() the same as it went into Serialize()
+            using namespace BufferUploads;
+            typedef TransactionTraceEvent::Type Type;
+
+            LinearBufferDesc lbDesc;
+            lbDesc._sizeInBytes = 64*1024;
+            lbDesc._structureByteSize = 16;
+            auto vbDesc = CreateDesc(BindFlag::VertexBuffer|BindFlag::StructuredBuffer, CPUAccess::Write, GPUAccess::Read, lbDesc, "MeshBuffer");
+            auto texDesc = CreateDesc(
+                BindFlag::ShaderResource, 0, GPUAccess::Read,
+                TextureDesc::Plain2D(256, 128, RenderCore::Metal::NativeFormat::R8G8B8A8_UNORM, 9, 4, TextureSamples::Create(4, 2)),
+                "Terrain Texture");
+            texDesc._allocationRules = AllocationRules::Staging;
+            auto unnamedDesc = CreateDesc(BindFlag::IndexBuffer, 0, GPUAccess::Read, lbDesc, "");
+
+            TransactionTrace original;
+            const Type::Enum types[] = {
+                Type::Begin, Type::Begin, Type::UpdateData, Type::AddRef, Type::SetPriority,
+                Type::Update, Type::FramePriorityBarrier, Type::Immediate, Type::End, Type::End, Type::Begin };
+            for (unsigned c=0; c<dimof(types); ++c) {
+                TransactionTraceEvent e;
+                e._type = types[c];
+                e._time = 1000ull * c + 7;
+                e._id = 100 + (c%3);
+                e._desc = (c==0 || c==7) ? texDesc : ((c==10) ? unnamedDesc : vbDesc);
+                e._flags = (c&1) ? TransactionOptions::FramePriority : TransactionOptions::LongTerm;
+                e._dataSize = (c%4) ? (c * 4096) : 0;
+                e._part = PartialResource(Box2D(c, 2*c, 16+c, 32+c), c%2, 1+c%3, c%4);
+                e._framesUntilRequired = c;
+                e._priority = c*2;
+                original._events.push_back(e);
+            }
+
+            auto text = original.Serialize();
+            auto parsed = TransactionTrace::Parse(AsPointer(text.cbegin()), AsPointer(text.cend()));
+            Assert::AreEqual(original._events.size(), parsed._events.size());
+            for (unsigned c=0; c<original._events.size(); ++c) {
+                auto &o = original._events[c], &p = parsed._events[c];
+                Assert::AreEqual(unsigned(o._type), unsigned(p._type));
+                Assert::IsTrue(o._time == p._time);
+
+                    //  Only the fields used by each event type are written
+                switch (o._type) {
+                case Type::Begin:
+                    Assert::IsTrue(o._id == p._id);
+                    Assert::AreEqual(o._flags, p._flags);
+                    Assert::AreEqual(o._dataSize, p._dataSize);
+                    AssertSameDesc(o._desc, p._desc);
+                    break;
+                case Type::UpdateData:
+                    Assert::IsTrue(o._id == p._id);
+                    Assert::AreEqual(o._dataSize, p._dataSize);
+                    AssertSamePart(o._part, p._part);
+                    break;
+                case Type::End:
+                case Type::AddRef:
+                    Assert::IsTrue(o._id == p._id);
+                    break;
+                case Type::Immediate:
+                    Assert::AreEqual(o._dataSize, p._dataSize);
+                    AssertSamePart(o._part, p._part);
+                    AssertSameDesc(o._desc, p._desc);
+                    break;
+                case Type::SetPriority:
+                    Assert::IsTrue(o._id == p._id);
+                    Assert::AreEqual(o._framesUntilRequired, p._framesUntilRequired);
+                    Assert::AreEqual(o._priority, p._priority);
+                    break;
+                default: break;
+                }
+            }
+
+                //  Names are written as a single token (spaces become underscores)
+            Assert::IsTrue(XlEqString(parsed._events[0]._desc._name, "Terrain_Texture"));
+            Assert::IsTrue(XlEqString(parsed._events[1]._desc._name, "MeshBuffer"));
+            Assert::IsTrue(XlEqString(parsed._events[10]._desc._name, ""));
+
+                //  Serializing the parsed trace again gives exactly the same text
+            Assert::IsTrue(parsed.Serialize() == text);
+
+                //  Damaged traces are rejected
+            const char missingDesc[] = "BufferUploadsTrace 1\nB 7 100 1 0\n";
+            const char unknownEvent[] = "BufferUploadsTrace 1\nF 7\nX 8\n";
+            const char badHeader[] = "NotATrace 1\n";
+            Assert::IsTrue(RejectsTrace(missingDesc, &missingDesc[dimof(missingDesc)-1]));
+            Assert::IsTrue(RejectsTrace(unknownEvent, &unknownEvent[dimof(unknownEvent)-1]));
+            Assert::IsTrue(RejectsTrace(badHeader, &badHeader[dimof(badHeader)-1]));
+        }
+    };
+
+    static BufferUploads::Internal::ScheduledStep<unsigned> MakeStep(unsigned id, unsigned requiredByFrame, unsigned priority, unsigned sequence)
+    {
+        BufferUploads::Internal::ScheduledStep<unsigned> result;
+        result._key._requiredByFrame = requiredByFrame;
+        result._key._priority = priority;
+        result._key._sequence = sequence;
+        result._step = id;
+        return result;
+    }
+
+    TEST_CLASS(StepSchedule)
+    {
+    public:
+        TEST_METHOD(DeadlineOrdering)
+        {
+                //  The most urgent step is at the back. Earliest deadline first, then
+                //  highest priority, then first queued. Steps without a deadline go last.
+            using namespace BufferUploads::Internal;
+            const unsigned noDeadline = ~0u;
+            std::vector<ScheduledStep<unsigned>> steps;
+            steps.push_back(MakeStep(6, noDeadline, 5, 0));
+            steps.push_back(MakeStep(2, 10, 1, 1));
+            steps.push_back(MakeStep(4, 12, 9, 2));
+            steps.push_back(MakeStep(0, 10, 3, 3));
+            MergeScheduledSteps(steps, 0);
+
+                //  a second batch, merged into the sorted list
+            const size_t oldSize = steps.size();
+            steps.push_back(MakeStep(7, noDeadline, 0, 4));
+            steps.push_back(MakeStep(1, 10, 3, 5));
+            steps.push_back(MakeStep(3, 10, 0, 6));
+            steps.push_back(MakeStep(5, 12, 9, 7));
+            MergeScheduledSteps(steps, oldSize);
+
+            Assert::AreEqual(size_t(8), steps.size());
+            for (unsigned c=0; c<8; ++c) {
+                Assert::AreEqual(c, steps.back()._step);
+                steps.pop_back();
+            }
+
+            Assert::IsTrue(IsDue(11, 10));
+            Assert::IsTrue(IsDue(3, 10));
+            Assert::IsFalse(IsDue(12, 10));
+            Assert::IsFalse(IsDue(noDeadline, 10));
+            Assert::IsFalse(IsDue(noDeadline, noDeadline));
+        }
+
+        TEST_METHOD(AttemptLimit)
+        {
+                //  Steps that aren't ready are skipped, but only the most urgent
+                //  ScheduleMaxAttempts steps are tried on each call
+            using namespace BufferUploads::Internal;
+            const unsigned stepCount = ScheduleMaxAttempts + 4;
+            std::vector<ScheduledStep<unsigned>> steps;
+            for (unsigned c=0; c<stepCount; ++c) {
+                steps.push_back(MakeStep(c, 100 + c, 0, c));
+            }
+            MergeScheduledSteps(steps, 0);
+            auto alwaysWithinBudget = []() { return true; };
+
+            std::vector<unsigned> tried;
+            unsigned readyStep = ScheduleMaxAttempts;     // (just out of reach)
+            auto process = [&](const unsigned& step) -> bool { tried.push_back(step); return step == readyStep; };
+
+            auto result = ProcessMostUrgentStep(steps, 0, process, alwaysWithinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::NotReady), unsigned(result));
+            Assert::AreEqual(size_t(ScheduleMaxAttempts), tried.size());
+            for (unsigned c=0; c<ScheduleMaxAttempts; ++c) {
+                Assert::AreEqual(c, tried[c]);
+            }
+            Assert::AreEqual(size_t(stepCount), steps.size());
+
+                //  The last step within reach is processed and removed; the rest keep their order
+            readyStep = ScheduleMaxAttempts-1;
+            tried.clear();
+            result = ProcessMostUrgentStep(steps, 0, process, alwaysWithinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::Processed), unsigned(result));
+            Assert::AreEqual(size_t(ScheduleMaxAttempts), tried.size());
+            Assert::AreEqual(size_t(stepCount-1), steps.size());
+            for (unsigned c=0; c<steps.size(); ++c) {
+                unsigned expected = stepCount-1-c;
+                if (expected <= ScheduleMaxAttempts-1) --expected;
+                Assert::AreEqual(expected, steps[c]._step);
+            }
+
+                //  Once it's within reach, the step we skipped before gets processed
+            readyStep = ScheduleMaxAttempts;
+            result = ProcessMostUrgentStep(steps, 0, process, alwaysWithinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::Processed), unsigned(result));
+            Assert::AreEqual(size_t(stepCount-2), steps.size());
+        }
+
+        TEST_METHOD(FrameBudget)
+        {
+                //  Due steps are processed even when the frame budget is used up. Steps
+                //  that aren't due wait for the budget.
+            using namespace BufferUploads::Internal;
+            const unsigned currentFrame = 10;
+            std::vector<ScheduledStep<unsigned>> steps;
+            steps.push_back(MakeStep(0, currentFrame+1, 0, 0));     // due
+            steps.push_back(MakeStep(1, currentFrame+1, 0, 1));     // due, but not ready
+            steps.push_back(MakeStep(2, currentFrame+5, 0, 2));     // not due
+            steps.push_back(MakeStep(3, ~0u, 0, 3));                // no deadline
+            MergeScheduledSteps(steps, 0);
+
+            bool budgetLeft = false;
+            unsigned budgetChecks = 0;
+            auto withinBudget = [&]() -> bool { ++budgetChecks; return budgetLeft; };
+            std::vector<unsigned> tried;
+            auto process = [&](const unsigned& step) -> bool { tried.push_back(step); return step != 1; };
+
+            auto result = ProcessMostUrgentStep(steps, currentFrame, process, withinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::Processed), unsigned(result));
+            Assert::AreEqual(0u, budgetChecks);
+            Assert::AreEqual(size_t(1), tried.size());
+            Assert::AreEqual(0u, tried[0]);
+
+                //  step 1 is tried (and isn't ready), then we stop at step 2
+            tried.clear();
+            result = ProcessMostUrgentStep(steps, currentFrame, process, withinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::OverBudget), unsigned(result));
+            Assert::AreEqual(size_t(1), tried.size());
+            Assert::AreEqual(1u, tried[0]);
+            Assert::AreEqual(size_t(3), steps.size());
+
+                //  with budget left, step 2 is processed
+            budgetLeft = true;
+            tried.clear();
+            result = ProcessMostUrgentStep(steps, currentFrame, process, withinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::Processed), unsigned(result));
+            Assert::AreEqual(2u, tried.back());
+            Assert::AreEqual(size_t(2), steps.size());
+
+                //  much later, step 1 is still due and never checks the budget; only the
+                //  step with no deadline does
+            budgetLeft = false;
+            budgetChecks = 0;
+            tried.clear();
+            result = ProcessMostUrgentStep(steps, currentFrame+20, process, withinBudget);
+            Assert::AreEqual(unsigned(ScheduleResult::OverBudget), unsigned(result));
+            Assert::AreEqual(1u, budgetChecks);     // (only checked for the step with no deadline)
+            Assert::AreEqual(size_t(1), tried.size());
+        }
+    };
+}
+
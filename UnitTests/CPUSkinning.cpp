@@ -0,0 +1,121 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderCore/Assets/CPUSkinning.h"
+#include "../Math/Transformations.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(CPUSkinning)
+    {
+    public:
+        TEST_METHOD(MatchesReference)
+        {
+            using namespace RenderCore::Assets;
+
+                //  Interleaved position & normal (as in the animated geometry stream),
+                //  with a vertex count that isn't a multiple of the block size, so the
+                //  scalar tail is also exercised.
+            const unsigned vertexCount = 1003;
+            const unsigned jointCount = 37;
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> dist(-10.f, 10.f);
+
+            std::vector<float> geo(vertexCount * 6);
+            for (auto& f:geo) f = dist(rng);
+
+            std::vector<Float3x4> joints;
+            for (unsigned c=0; c<jointCount; ++c) {
+                Float4x4 transform = AsFloat4x4(Float3(dist(rng), dist(rng), dist(rng)));
+                Combine_InPlace(RotationX(dist(rng)), transform);
+                Combine_InPlace(RotationZ(dist(rng)), transform);
+                joints.push_back(Truncate(transform));
+            }
+
+            const unsigned influenceCounts[] = { 0, 1, 2, 4 };
+            for (auto influenceCount:influenceCounts) {
+                const unsigned bindingStride = std::max(4u, influenceCount*2);
+                std::vector<uint8> binding(vertexCount * bindingStride, 0);
+                for (unsigned v=0; v<vertexCount; ++v) {
+                    for (unsigned c=0; c<influenceCount; ++c) {
+                        binding[v*bindingStride + c] = uint8(rng() & 0xff);
+                        binding[v*bindingStride + influenceCount + c] = uint8(rng() % jointCount);
+                    }
+                }
+
+                SkinningStreams src;
+                src._positions = AsPointer(geo.cbegin());
+                src._normals = AsPointer(geo.cbegin()) + 3;
+                src._geoStride = 6 * sizeof(float);
+                src._weights = AsPointer(binding.cbegin());
+                src._jointIndices = AsPointer(binding.cbegin()) + influenceCount;
+                src._bindingStride = bindingStride;
+
+                std::vector<float> result(vertexCount * 6, 0.f), reference(vertexCount * 6, 1.f);
+                SkinningOutput dst;
+                dst._stride = 6 * sizeof(float);
+
+                dst._positions = AsPointer(result.begin()); dst._normals = AsPointer(result.begin()) + 3;
+                SkinVertices(dst, src, vertexCount, influenceCount, AsPointer(joints.cbegin()));
+
+                dst._positions = AsPointer(reference.begin()); dst._normals = AsPointer(reference.begin()) + 3;
+                SkinVertices_Reference(dst, src, vertexCount, influenceCount, AsPointer(joints.cbegin()));
+
+                    // results must be bit-identical
+                Assert::IsTrue(XlCompareMemory(AsPointer(result.cbegin()), AsPointer(reference.cbegin()), result.size()*sizeof(float)) == 0);
+            }
+        }
+
+        TEST_METHOD(SingleJoint)
+        {
+            using namespace RenderCore::Assets;
+
+                //  With every vertex fully weighted to a single translation, the result
+                //  should just be the translated input (and unchanged normals).
+            const unsigned vertexCount = 21;
+            std::vector<Float3> positions, normals;
+            for (unsigned v=0; v<vertexCount; ++v) {
+                positions.push_back(Float3(float(v), 1.f, 2.f));
+                normals.push_back(Float3(0.f, 0.f, 1.f));
+            }
+            std::vector<uint8> binding(vertexCount * 4, 0);
+            for (unsigned v=0; v<vertexCount; ++v) {
+                binding[v*4+0] = 0xff;  // weight
+                binding[v*4+1] = 1;     // joint index
+            }
+
+            Float3x4 joints[2] = { Identity<Float3x4>(), Truncate(AsFloat4x4(Float3(5.f, 0.f, 0.f))) };
+
+            SkinningStreams src;
+            src._positions = &positions[0][0];
+            src._normals = &normals[0][0];
+            src._geoStride = sizeof(Float3);
+            src._weights = AsPointer(binding.cbegin());
+            src._jointIndices = AsPointer(binding.cbegin()) + 1;
+            src._bindingStride = 4;
+
+            std::vector<Float3> outPositions(vertexCount), outNormals(vertexCount);
+            SkinningOutput dst;
+            dst._positions = &outPositions[0][0];
+            dst._normals = &outNormals[0][0];
+            dst._stride = sizeof(Float3);
+            SkinVertices(dst, src, vertexCount, 1, joints);
+
+            for (unsigned v=0; v<vertexCount; ++v) {
+                Assert::IsTrue(Equivalent(Float3(positions[v] + Float3(5.f, 0.f, 0.f)), outPositions[v], 1e-5f));
+                Assert::IsTrue(Equivalent(normals[v], outNormals[v], 1e-5f));
+            }
+        }
+    };
+}
+
@@ -0,0 +1,197 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../Assets/DependencyDatabase.h"
+#include "../Assets/AssetUtils.h"
+#include "../Assets/Assets.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/Streams/FileSystemMonitor.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include <CppUnitTest.h>
+#include <string>
+#include <thread>
+#include <chrono>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    typedef Assets::IntermediateResources::DependencyDatabase DepDB;
+
+    static void WriteTextFile(const char filename[], const char contents[])
+    {
+        BasicFile file(filename, "wb");
+        file.Write(contents, 1, XlStringLen(contents));
+    }
+
+    static Assets::FileAndTime MakeDependency(const char directory[], const char filename[])
+    {
+        std::string fullPath = std::string(directory) + "/" + filename;
+        return Assets::FileAndTime(filename, GetFileModificationTime(fullPath.c_str()));
+    }
+
+    static DepDB::Status::Enum Validate(DepDB& db, const char intermediateName[])
+    {
+        auto validation = std::make_shared<Assets::DependencyValidation>();
+        return db.Validate(intermediateName, validation);
+    }
+
+    class CountingCallback : public Utility::OnChangeCallback
+    {
+    public:
+        Interlocked::Value _count;
+        void OnChange() { Interlocked::Increment(&_count); }
+        CountingCallback() : _count(0) {}
+    };
+
+    static bool WaitForCount(const CountingCallback& callback, unsigned expected)
+    {
+            //  changes are coalesced, and delivered from a background thread
+        for (unsigned c=0; c<200; ++c) {
+            if (unsigned(Interlocked::Load(&callback._count)) >= expected) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+    TEST_CLASS(DependencyDatabase)
+    {
+    public:
+        TEST_METHOD(MergeAndFlush)
+        {
+            const char directory[] = "DepDBTest";
+            const char dbFilename[] = "DepDBTest/test.depdb";
+            CreateDirectoryRecursive(directory);
+            if (DoesFileExist(dbFilename)) XlDeleteFile((const utf8*)dbFilename);
+
+            WriteTextFile("DepDBTest/a.txt", "source a");
+            WriteTextFile("DepDBTest/b.txt", "source b");
+            WriteTextFile("DepDBTest/c.txt", "source c");
+
+            {
+                DepDB db(dbFilename);
+
+                    //  First flush creates the file
+                std::vector<Assets::FileAndTime> deps;
+                deps.push_back(MakeDependency(directory, "a.txt"));
+                deps.push_back(MakeDependency(directory, "b.txt"));
+                db.Write("int1", directory, deps);
+                deps.clear();
+                deps.push_back(MakeDependency(directory, "c.txt"));
+                db.Write("int2", directory, deps);
+                Assert::AreEqual(2u, db.GetMetrics()._pendingRecordCount);
+
+                db.Flush();
+                Assert::AreEqual(0u, db.GetMetrics()._pendingRecordCount);
+                Assert::AreEqual(2u, db.GetMetrics()._recordCount);
+                Assert::IsFalse(DoesFileExist("DepDBTest/test.depdb.tmp"));
+
+                    //  Second flush merges new records with the records in the file.
+                    //  "int1" is replaced, and now depends only on "c.txt"
+                deps.clear();
+                deps.push_back(MakeDependency(directory, "c.txt"));
+                db.Write("int1", directory, deps);
+                deps.clear();
+                deps.push_back(MakeDependency(directory, "a.txt"));
+                db.Write("int3", directory, deps);
+
+                    //  pending records are visible before the flush
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int1")));
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int3")));
+
+                db.Flush();
+                Assert::AreEqual(0u, db.GetMetrics()._pendingRecordCount);
+                Assert::AreEqual(3u, db.GetMetrics()._recordCount);
+                Assert::IsFalse(DoesFileExist("DepDBTest/test.depdb.tmp"));
+            }
+
+                //  Change the contents of "b.txt". "int1" no longer depends on it, so it
+                //  should still be valid after reloading.
+            WriteTextFile("DepDBTest/b.txt", "source b (changed)");
+            {
+                DepDB db(dbFilename);
+                Assert::AreEqual(3u, db.GetMetrics()._recordCount);
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int1")));
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int2")));
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int3")));
+                Assert::AreEqual(unsigned(DepDB::Status::NoRecord), unsigned(Validate(db, "int4")));
+            }
+
+                //  Change "c.txt" and touch "a.txt" without changing its contents.
+                //  The content hash should keep "int3" valid.
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            WriteTextFile("DepDBTest/c.txt", "source c (changed)");
+            WriteTextFile("DepDBTest/a.txt", "source a");
+            {
+                DepDB db(dbFilename);
+                Assert::AreEqual(unsigned(DepDB::Status::Invalid), unsigned(Validate(db, "int1")));
+                Assert::AreEqual(unsigned(DepDB::Status::Invalid), unsigned(Validate(db, "int2")));
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int3")));
+
+                    //  The new time for "a.txt" is written back, so the next validation
+                    //  doesn't need to hash it again
+                Assert::AreEqual(1u, db.GetMetrics()._pendingRecordCount);
+                db.Flush();
+                Assert::AreEqual(3u, db.GetMetrics()._recordCount);
+            }
+            {
+                DepDB db(dbFilename);
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int3")));
+                Assert::AreEqual(0u, db.GetMetrics()._contentHashes);
+            }
+
+                //  A stale temporary file from an interrupted flush must not be picked up,
+                //  and must be replaced by the next flush
+            WriteTextFile("DepDBTest/test.depdb.tmp", "garbage");
+            {
+                DepDB db(dbFilename);
+                Assert::AreEqual(3u, db.GetMetrics()._recordCount);
+                std::vector<Assets::FileAndTime> deps;
+                deps.push_back(MakeDependency(directory, "b.txt"));
+                db.Write("int4", directory, deps);
+                db.Flush();
+                Assert::AreEqual(4u, db.GetMetrics()._recordCount);
+                Assert::IsFalse(DoesFileExist("DepDBTest/test.depdb.tmp"));
+                Assert::AreEqual(unsigned(DepDB::Status::Valid), unsigned(Validate(db, "int4")));
+            }
+
+                //  (the database monitors the source files)
+            Utility::TerminateFileSystemMonitoring();
+        }
+
+        TEST_METHOD(MonitorSharedDirectory)
+        {
+                //  Monitor the same directory through two different names. Both
+                //  callbacks must be triggered by changes.
+            CreateDirectoryRecursive("MonitorTest");
+            WriteTextFile("MonitorTest/first.txt", "0");
+            WriteTextFile("MonitorTest/second.txt", "0");
+
+            auto first = std::make_shared<CountingCallback>();
+            auto second = std::make_shared<CountingCallback>();
+            Utility::AttachFileSystemMonitor("MonitorTest", "first.txt", first);
+            Utility::AttachFileSystemMonitor("MonitorTest/../MonitorTest", "second.txt", second);
+
+            WriteTextFile("MonitorTest/first.txt", "1");
+            WriteTextFile("MonitorTest/second.txt", "1");
+            Assert::IsTrue(WaitForCount(*first, 1));
+            Assert::IsTrue(WaitForCount(*second, 1));
+
+                //  Shutting down releases every watch (including the shared one). After
+                //  that, monitoring must start up again cleanly.
+            Utility::TerminateFileSystemMonitoring();
+
+            auto third = std::make_shared<CountingCallback>();
+            Utility::AttachFileSystemMonitor("MonitorTest", "first.txt", third);
+            WriteTextFile("MonitorTest/first.txt", "2");
+            Assert::IsTrue(WaitForCount(*third, 1));
+            Utility::TerminateFileSystemMonitoring();
+        }
+    };
+}
+
@@ -0,0 +1,251 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../SceneEngine/DualContour.h"
+#include "../Math/Math.h"
+#include "../Core/Types.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using SceneEngine::DualContourMesh;
+    using SceneEngine::DualContourBuildSettings;
+
+        //  Signed distance functions (so the density gradient is never more than 1)
+    class SphereDensity : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        Boundary    GetBoundary() const { return Boundary(Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)); }
+        float       GetDensity(const Float3& pt) const { return Magnitude(pt - _center) - _radius; }
+        Float3      GetNormal(const Float3& pt) const { return Normalize(pt - _center); }
+
+        SphereDensity(Float3 center, float radius) : _center(center), _radius(radius) {}
+        Float3 _center; float _radius;
+    };
+
+    class TorusDensity : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        Boundary    GetBoundary() const { return Boundary(Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)); }
+        float       GetDensity(const Float3& pt) const
+        {
+            float ringDistance = XlSqrt(pt[0]*pt[0] + pt[1]*pt[1]) - _majorRadius;
+            return XlSqrt(ringDistance*ringDistance + pt[2]*pt[2]) - _minorRadius;
+        }
+        Float3      GetNormal(const Float3& pt) const
+        {
+            float horizontal = XlSqrt(pt[0]*pt[0] + pt[1]*pt[1]);
+            Float3 ringPt(pt[0] * _majorRadius / horizontal, pt[1] * _majorRadius / horizontal, 0.f);
+            return Normalize(pt - ringPt);
+        }
+
+        TorusDensity(float majorRadius, float minorRadius) : _majorRadius(majorRadius), _minorRadius(minorRadius) {}
+        float _majorRadius, _minorRadius;
+    };
+
+    class PlaneDensity : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        Boundary    GetBoundary() const { return Boundary(Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)); }
+        float       GetDensity(const Float3& pt) const { return Dot(pt, _normal) - _distance; }
+        Float3      GetNormal(const Float3&) const { return _normal; }
+
+        PlaneDensity(Float3 normal, float distance) : _normal(Normalize(normal)), _distance(distance) {}
+        Float3 _normal; float _distance;
+    };
+
+        //  Counts calls to GetDensity (only for single threaded builds)
+    class CountingDensity : public SceneEngine::IVolumeDensityFunction
+    {
+    public:
+        Boundary    GetBoundary() const { return _fn->GetBoundary(); }
+        float       GetDensity(const Float3& pt) const { ++_densityCalls; return _fn->GetDensity(pt); }
+        Float3      GetNormal(const Float3& pt) const { return _fn->GetNormal(pt); }
+
+        CountingDensity(const SceneEngine::IVolumeDensityFunction& fn) : _fn(&fn), _densityCalls(0) {}
+        const SceneEngine::IVolumeDensityFunction* _fn;
+        mutable unsigned _densityCalls;
+    };
+
+    static bool IdenticalMeshes(const DualContourMesh& lhs, const DualContourMesh& rhs)
+    {
+        if (lhs._vertices.size() != rhs._vertices.size() || lhs._quads.size() != rhs._quads.size()) return false;
+        for (size_t v=0; v<lhs._vertices.size(); ++v) {
+            for (unsigned e=0; e<3; ++e) {
+                if (lhs._vertices[v]._pt[e] != rhs._vertices[v]._pt[e]) return false;
+                if (lhs._vertices[v]._normal[e] != rhs._vertices[v]._normal[e]) return false;
+            }
+        }
+        for (size_t q=0; q<lhs._quads.size(); ++q) {
+            if (!std::equal(lhs._quads[q]._verts, &lhs._quads[q]._verts[4], rhs._quads[q]._verts)) return false;
+        }
+        return true;
+    }
+
+        //  Returns the Euler characteristic (V - E + F) of the mesh, or INT_MIN if the
+        //  mesh isn't a closed manifold (ie, some edge isn't shared by exactly 2 faces).
+        //  Quads that have been collapsed to triangles count as triangles.
+    static int ClosedMeshEulerCharacteristic(const DualContourMesh& mesh)
+    {
+        std::map<std::pair<unsigned, unsigned>, unsigned> edges;
+        std::vector<uint8> used(mesh._vertices.size(), uint8(0));
+        unsigned faceCount = 0;
+        for (const auto& q:mesh._quads) {
+                //  (quad vertices are in a "Z" pattern)
+            unsigned loop[] = { q._verts[0], q._verts[1], q._verts[3], q._verts[2] };
+            unsigned polygon[4], count = 0;
+            for (unsigned c=0; c<4; ++c) {
+                if (!count || polygon[count-1] != loop[c]) polygon[count++] = loop[c];
+            }
+            if (count > 1 && polygon[count-1] == polygon[0]) --count;
+            if (count < 3) return INT_MIN;
+
+            for (unsigned c=0; c<count; ++c) {
+                unsigned a = polygon[c], b = polygon[(c+1)%count];
+                ++edges[std::make_pair(std::min(a, b), std::max(a, b))];
+                used[a] = 1;
+            }
+            ++faceCount;
+        }
+
+        for (const auto& e:edges) {
+            if (e.second != 2) return INT_MIN;
+        }
+
+        int vertexCount = 0;
+        for (auto u:used) vertexCount += u;
+        return vertexCount - int(edges.size()) + int(faceCount);
+    }
+
+    static DualContourBuildSettings DenseSettings(unsigned dims, unsigned threadCount)
+    {
+        DualContourBuildSettings settings(dims);
+        settings._threadCount = threadCount;
+        settings._sparseBlockSize = 0;
+        settings._simplificationThreshold = -1.f;
+        return settings;
+    }
+
+    TEST_CLASS(DualContour)
+    {
+    public:
+        TEST_METHOD(SparseMatchesDense)
+        {
+                //  Blocks are only skipped when the surface can't pass through them, so
+                //  sparse sampling should give exactly the same mesh as dense sampling,
+                //  with far fewer density samples.
+            SphereDensity sphere(Float3(.1f, -.05f, .02f), .6f);
+            TorusDensity torus(.55f, .2f);
+            const SceneEngine::IVolumeDensityFunction* fns[] = { &sphere, &torus };
+            for (unsigned f=0; f<dimof(fns); ++f) {
+                CountingDensity denseFn(*fns[f]);
+                auto dense = SceneEngine::DualContourMesh_Build(DenseSettings(48, 1), denseFn);
+                Assert::IsFalse(dense._quads.empty());
+
+                    //  with a known gradient limit, and with the gradient estimated from the samples
+                float gradientLimits[] = { 1.f, 0.f };
+                for (unsigned g=0; g<dimof(gradientLimits); ++g) {
+                    auto settings = DenseSettings(48, 1);
+                    settings._sparseBlockSize = 8;
+                    settings._densityGradientLimit = gradientLimits[g];
+                    CountingDensity sparseFn(*fns[f]);
+                    auto sparse = SceneEngine::DualContourMesh_Build(settings, sparseFn);
+                    Assert::IsTrue(IdenticalMeshes(dense, sparse));
+                    if (gradientLimits[g] > 0.f) {
+                        Assert::IsTrue(sparseFn._densityCalls < denseFn._densityCalls / 2);
+                    } else {
+                            //  (the estimated gradient has a safety margin, so fewer blocks are skipped)
+                        Assert::IsTrue(sparseFn._densityCalls < denseFn._densityCalls);
+                    }
+                }
+
+                    //  the old overload samples densely, too
+                auto legacy = SceneEngine::DualContourMesh_Build(48, *fns[f]);
+                Assert::AreEqual(dense._vertices.size(), legacy._vertices.size());
+                Assert::AreEqual(dense._quads.size(), legacy._quads.size());
+            }
+        }
+
+        TEST_METHOD(ThreadCountDoesNotChangeMesh)
+        {
+            TorusDensity torus(.5f, .25f);
+            auto settings = DenseSettings(40, 1);
+            settings._sparseBlockSize = 4;
+            settings._simplificationThreshold = 1e-5f;
+            auto reference = SceneEngine::DualContourMesh_Build(settings, torus);
+            auto referenceDense = SceneEngine::DualContourMesh_Build(DenseSettings(40, 1), torus);
+
+            unsigned threadCounts[] = { 2, 3, 7, 0 };
+            for (unsigned c=0; c<dimof(threadCounts); ++c) {
+                settings._threadCount = threadCounts[c];
+                Assert::IsTrue(IdenticalMeshes(reference, SceneEngine::DualContourMesh_Build(settings, torus)));
+                Assert::IsTrue(IdenticalMeshes(referenceDense, SceneEngine::DualContourMesh_Build(DenseSettings(40, threadCounts[c]), torus)));
+            }
+        }
+
+        TEST_METHOD(SimplificationPreservesTopology)
+        {
+                //  Collapsing cells should reduce the vertex count, but leave a closed
+                //  surface with the same genus (sphere: V-E+F = 2, torus: V-E+F = 0)
+            SphereDensity sphere(Float3(.03f, .01f, -.02f), .7f);
+            TorusDensity torus(.55f, .25f);
+            const SceneEngine::IVolumeDensityFunction* fns[] = { &sphere, &torus };
+            int expectedCharacteristic[] = { 2, 0 };
+            for (unsigned f=0; f<dimof(fns); ++f) {
+                auto full = SceneEngine::DualContourMesh_Build(DenseSettings(32, 0), *fns[f]);
+                Assert::AreEqual(expectedCharacteristic[f], ClosedMeshEulerCharacteristic(full));
+
+                std::vector<std::tuple<float, float, float>> fullPositions;
+                for (const auto& v:full._vertices) fullPositions.push_back(std::make_tuple(v._pt[0], v._pt[1], v._pt[2]));
+                std::sort(fullPositions.begin(), fullPositions.end());
+
+                size_t prevVertexCount = full._vertices.size();
+                float thresholds[] = { 1e-6f, 1e-4f, 1e-3f };
+                for (unsigned t=0; t<dimof(thresholds); ++t) {
+                    auto settings = DenseSettings(32, 0);
+                    settings._simplificationThreshold = thresholds[t];
+                    auto simplified = SceneEngine::DualContourMesh_Build(settings, *fns[f]);
+                    Assert::AreEqual(expectedCharacteristic[f], ClosedMeshEulerCharacteristic(simplified));
+
+                        //  larger thresholds never give more vertices. And the QEF error
+                        //  limits how far collapsed vertices can be from the surface (vertices
+                        //  of cells that weren't collapsed are the same as in the full mesh)
+                    Assert::IsTrue(simplified._vertices.size() <= prevVertexCount);
+                    prevVertexCount = simplified._vertices.size();
+                    for (const auto& v:simplified._vertices) {
+                        auto key = std::make_tuple(v._pt[0], v._pt[1], v._pt[2]);
+                        if (std::binary_search(fullPositions.begin(), fullPositions.end(), key)) continue;
+                        Assert::IsTrue(XlAbs(fns[f]->GetDensity(v._pt)) < XlSqrt(thresholds[t]) + 1e-2f);
+                    }
+                }
+                Assert::IsTrue(prevVertexCount < full._vertices.size() / 2);
+            }
+
+                //  A plane is flat everywhere, so any threshold collapses cells up to the
+                //  largest level, and every vertex stays on the plane
+            PlaneDensity plane(Float3(.2f, .3f, 1.f), .1f);
+            auto full = SceneEngine::DualContourMesh_Build(DenseSettings(32, 0), plane);
+            auto settings = DenseSettings(32, 0);
+            settings._simplificationThreshold = 1e-8f;
+            auto simplified = SceneEngine::DualContourMesh_Build(settings, plane);
+            Assert::IsTrue(simplified._vertices.size() * 8 < full._vertices.size());
+            for (const auto& v:simplified._vertices) {
+                Assert::IsTrue(XlAbs(plane.GetDensity(v._pt)) < 1e-3f);
+            }
+
+                //  A negative threshold disables simplification
+            settings._simplificationThreshold = -1.f;
+            Assert::IsTrue(IdenticalMeshes(full, SceneEngine::DualContourMesh_Build(settings, plane)));
+        }
+    };
+}
+
@@ -0,0 +1,221 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderOverlays/GlyphAtlas.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    typedef RenderOverlays::GlyphAtlas Atlas;
+
+        //  Build a glyph bitmap with a pitch wider than the glyph, filling the
+        //  glyph with "value" and the extra space at the end of each row with
+        //  a value that must never be copied into the atlas.
+    static std::vector<uint8> BuildGlyphBitmap(unsigned width, unsigned height, unsigned pitch, uint8 value)
+    {
+        std::vector<uint8> result(pitch * height, uint8(0xee));
+        for (unsigned y=0; y<height; ++y)
+            for (unsigned x=0; x<width; ++x)
+                result[y*pitch+x] = value;
+        return result;
+    }
+
+    static bool GlyphMatches(const Atlas& atlas, Atlas::GlyphId glyph, uint8 value)
+    {
+        auto rect = atlas.GetRect(glyph);
+        auto* store = atlas.GetBackingStore();
+        for (unsigned y=0; y<rect._height; ++y)
+            for (unsigned x=0; x<rect._width; ++x)
+                if (store[(rect._y+y)*atlas.GetWidth() + rect._x+x] != value) return false;
+        return true;
+    }
+
+    static bool Overlaps(const Atlas::Rect& lhs, const Atlas::Rect& rhs)
+    {
+        return lhs._x < (rhs._x + rhs._width) && rhs._x < (lhs._x + lhs._width)
+            && lhs._y < (rhs._y + rhs._height) && rhs._y < (lhs._y + lhs._height);
+    }
+
+    TEST_CLASS(GlyphAtlas)
+    {
+    public:
+        TEST_METHOD(PackAndCopy)
+        {
+            Atlas atlas(128, 128, nullptr);
+
+                // mixed sizes, including an empty glyph (like a space)
+            const unsigned sizes[][2] = { {7,9}, {12,12}, {3,15}, {0,0}, {20,6}, {9,9}, {31,17}, {5,11}, {16,16}, {1,1} };
+            std::vector<Atlas::GlyphId> glyphs;
+            for (unsigned c=0; c<dimof(sizes); ++c) {
+                auto bitmap = BuildGlyphBitmap(sizes[c][0], sizes[c][1], sizes[c][0]+3, uint8(c+1));
+                auto glyph = atlas.Add(AsPointer(bitmap.cbegin()), sizes[c][0], sizes[c][1], sizes[c][0]+3, c);
+                Assert::IsTrue(glyph != Atlas::GlyphId_Invalid);
+                glyphs.push_back(glyph);
+            }
+
+            auto dirty = atlas.TakeDirtyRect();
+            for (unsigned c=0; c<unsigned(glyphs.size()); ++c) {
+                auto rect = atlas.GetRect(glyphs[c]);
+                Assert::AreEqual(sizes[c][0], rect._width);
+                Assert::AreEqual(sizes[c][1], rect._height);
+                Assert::IsTrue((rect._x + rect._width) < atlas.GetWidth());
+                Assert::IsTrue((rect._y + rect._height) < atlas.GetHeight());
+
+                    //  the copy must honour the pitch, and the padding on the right
+                    //  and bottom must be cleared (so bilinear filtering doesn't pick up
+                    //  neighbouring glyphs)
+                Assert::IsTrue(GlyphMatches(atlas, glyphs[c], uint8(c+1)));
+                auto* store = atlas.GetBackingStore();
+                for (unsigned y=0; y<=rect._height; ++y)
+                    Assert::AreEqual(0u, unsigned(store[(rect._y+y)*atlas.GetWidth() + rect._x + rect._width]));
+                for (unsigned x=0; x<=rect._width; ++x)
+                    Assert::AreEqual(0u, unsigned(store[(rect._y+rect._height)*atlas.GetWidth() + rect._x + x]));
+
+                    //  glyphs (with their padding) must not overlap
+                Atlas::Rect padded(rect._x, rect._y, rect._width+1, rect._height+1);
+                for (unsigned c2=0; c2<c; ++c2) {
+                    auto other = atlas.GetRect(glyphs[c2]);
+                    Assert::IsFalse(Overlaps(padded, Atlas::Rect(other._x, other._y, other._width+1, other._height+1)));
+                }
+
+                    //  the dirty rect must cover everything added
+                Assert::IsTrue(rect._x >= dirty._x && (rect._x + rect._width) <= (dirty._x + dirty._width));
+                Assert::IsTrue(rect._y >= dirty._y && (rect._y + rect._height) <= (dirty._y + dirty._height));
+            }
+
+            auto empty = atlas.TakeDirtyRect();
+            Assert::AreEqual(0u, empty._width);
+            Assert::AreEqual(0u, empty._height);
+
+            auto metrics = atlas.GetMetrics();
+            Assert::AreEqual(unsigned(dimof(sizes)), metrics._glyphCount);
+            Assert::AreEqual(unsigned(dimof(sizes)), metrics._additions);
+            Assert::AreEqual(0u, metrics._evictions);
+            Assert::AreEqual(0u, metrics._failedAdditions);
+
+                // too large for the atlas, even when empty
+            std::vector<uint8> huge(128*128, 1);
+            Assert::IsTrue(atlas.Add(AsPointer(huge.cbegin()), 128, 4, 128, 100) == Atlas::GlyphId_Invalid);
+            Assert::IsTrue(atlas.Add(AsPointer(huge.cbegin()), 4, 128, 4, 100) == Atlas::GlyphId_Invalid);
+            Assert::AreEqual(2u, atlas.GetMetrics()._failedAdditions);
+        }
+
+        TEST_METHOD(LRUEviction)
+        {
+            std::vector<uint64> evicted;
+            Atlas atlas(64, 64, [&evicted](uint64 owner) { evicted.push_back(owner); });
+
+                //  15x15 glyphs take 16x16 with padding, so exactly 16 fit
+            const unsigned glyphSize = 15;
+            std::vector<Atlas::GlyphId> glyphs;
+            for (unsigned c=0; c<16; ++c) {
+                auto bitmap = BuildGlyphBitmap(glyphSize, glyphSize, glyphSize, uint8(c+1));
+                glyphs.push_back(atlas.Add(AsPointer(bitmap.cbegin()), glyphSize, glyphSize, glyphSize, c));
+                Assert::IsTrue(glyphs[c] != Atlas::GlyphId_Invalid);
+            }
+            Assert::IsTrue(evicted.empty());
+
+                //  New batch. Touch the second half, and then add more glyphs. The
+                //  untouched glyphs should be evicted, oldest first.
+            atlas.BeginBatch();
+            for (unsigned c=8; c<16; ++c)
+                atlas.Touch(glyphs[c]);
+
+            for (unsigned c=16; c<24; ++c) {
+                auto bitmap = BuildGlyphBitmap(glyphSize, glyphSize, glyphSize, uint8(c+1));
+                glyphs.push_back(atlas.Add(AsPointer(bitmap.cbegin()), glyphSize, glyphSize, glyphSize, c));
+                Assert::IsTrue(glyphs[c] != Atlas::GlyphId_Invalid);
+            }
+            Assert::AreEqual(8u, unsigned(evicted.size()));
+            for (unsigned c=0; c<8; ++c)
+                Assert::AreEqual(uint64(c), evicted[c]);
+
+                //  glyphs used in this batch must still be intact
+            for (unsigned c=8; c<24; ++c)
+                Assert::IsTrue(GlyphMatches(atlas, glyphs[c], uint8(c+1)));
+
+                //  Everything in the atlas has now been used in this batch, so there's
+                //  nothing that can be evicted
+            {
+                auto bitmap = BuildGlyphBitmap(glyphSize, glyphSize, glyphSize, 0xff);
+                auto glyph = atlas.Add(AsPointer(bitmap.cbegin()), glyphSize, glyphSize, glyphSize, 100);
+                Assert::IsTrue(glyph == Atlas::GlyphId_Invalid);
+                Assert::AreEqual(8u, unsigned(evicted.size()));
+                Assert::AreEqual(1u, atlas.GetMetrics()._failedAdditions);
+                for (unsigned c=8; c<24; ++c)
+                    Assert::IsTrue(GlyphMatches(atlas, glyphs[c], uint8(c+1)));
+            }
+
+                //  After the next BeginBatch, the least recently used glyph goes first.
+                //  That's the first of the glyphs touched above.
+            atlas.BeginBatch();
+            {
+                auto bitmap = BuildGlyphBitmap(glyphSize, glyphSize, glyphSize, 0xff);
+                auto glyph = atlas.Add(AsPointer(bitmap.cbegin()), glyphSize, glyphSize, glyphSize, 100);
+                Assert::IsTrue(glyph != Atlas::GlyphId_Invalid);
+                Assert::AreEqual(9u, unsigned(evicted.size()));
+                Assert::AreEqual(uint64(8), evicted[8]);
+                Assert::IsTrue(GlyphMatches(atlas, glyph, 0xff));
+            }
+
+            auto metrics = atlas.GetMetrics();
+            Assert::AreEqual(16u, metrics._glyphCount);
+            Assert::AreEqual(9u, metrics._evictions);
+            Assert::AreEqual(16u * 16u * 16u, metrics._usedArea);
+        }
+
+        TEST_METHOD(RemoveAndReuse)
+        {
+            Atlas atlas(64, 64, nullptr);
+
+                //  Fill the atlas with small glyphs (7x7 takes 8x8 with padding)
+            std::vector<Atlas::GlyphId> glyphs;
+            auto smallBitmap = BuildGlyphBitmap(7, 7, 7, 1);
+            for (unsigned c=0; c<64; ++c) {
+                glyphs.push_back(atlas.Add(AsPointer(smallBitmap.cbegin()), 7, 7, 7, c));
+                Assert::IsTrue(glyphs[c] != Atlas::GlyphId_Invalid);
+            }
+            Assert::AreEqual(8u, atlas.GetMetrics()._shelfCount);
+            Assert::IsTrue(atlas.Add(AsPointer(smallBitmap.cbegin()), 7, 7, 7, 100) == Atlas::GlyphId_Invalid);
+
+                //  Removing a glyph frees exactly its space
+            auto freedRect = atlas.GetRect(glyphs[10]);
+            atlas.Remove(glyphs[10]);
+            auto replacement = atlas.Add(AsPointer(smallBitmap.cbegin()), 7, 7, 7, 101);
+            Assert::IsTrue(replacement != Atlas::GlyphId_Invalid);
+            Assert::AreEqual(freedRect._x, atlas.GetRect(replacement)._x);
+            Assert::AreEqual(freedRect._y, atlas.GetRect(replacement)._y);
+            glyphs[10] = replacement;
+
+                //  Once all glyphs are removed, the shelves should be merged, and the
+                //  whole atlas should be available for a single large glyph
+            for (auto i=glyphs.cbegin(); i!=glyphs.cend(); ++i)
+                atlas.Remove(*i);
+            auto metrics = atlas.GetMetrics();
+            Assert::AreEqual(0u, metrics._glyphCount);
+            Assert::AreEqual(0u, metrics._shelfCount);
+            Assert::AreEqual(0u, metrics._usedArea);
+            Assert::AreEqual(0u, metrics._evictions);
+
+            auto largeBitmap = BuildGlyphBitmap(63, 63, 63, 2);
+            auto large = atlas.Add(AsPointer(largeBitmap.cbegin()), 63, 63, 63, 200);
+            Assert::IsTrue(large != Atlas::GlyphId_Invalid);
+            Assert::AreEqual(0u, atlas.GetRect(large)._x);
+            Assert::AreEqual(0u, atlas.GetRect(large)._y);
+            Assert::IsTrue(GlyphMatches(atlas, large, 2));
+
+                //  Removing an invalid glyph is harmless
+            atlas.Remove(Atlas::GlyphId_Invalid);
+            atlas.Remove(1000);
+            Assert::AreEqual(1u, atlas.GetMetrics()._glyphCount);
+        }
+    };
+}
+
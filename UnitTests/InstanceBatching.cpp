@@ -0,0 +1,111 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderCore/Assets/InstanceBatching.h"
+#include "../Math/Transformations.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(InstanceBatching)
+    {
+    public:
+        TEST_METHOD(CollapseRuns)
+        {
+            using RenderCore::Assets::InstanceBatches;
+            const unsigned depthBits = 24;
+
+                //  A sorted list as the model renderer would build it: a long run of
+                //  one draw call (a forest), a short run of another, then a long run
+                //  that must be split at the maximum instance count.
+            std::vector<std::pair<uint64, unsigned>> sortedDrawCalls;
+            std::vector<unsigned> transformIndices;
+            std::vector<Float4x4> transforms;
+            auto addDrawCall = [&](uint64 drawCallKey, unsigned depth) {
+                sortedDrawCalls.push_back(std::make_pair((drawCallKey << uint64(depthBits)) | depth, unsigned(transformIndices.size())));
+                transformIndices.push_back(unsigned(transforms.size()));
+                transforms.push_back(AsFloat4x4(Float3(float(transforms.size()), 0.f, 0.f)));
+            };
+            for (unsigned c=0; c<100; ++c) addDrawCall(1, c);
+            for (unsigned c=0; c<2; ++c) addDrawCall(2, c);
+            for (unsigned c=0; c<20; ++c) addDrawCall(3, c);
+
+            InstanceBatches batches(4, 16);
+            batches.Build(
+                AsPointer(sortedDrawCalls.cbegin()), sortedDrawCalls.size(), depthBits,
+                AsPointer(transformIndices.cbegin()), AsPointer(transforms.cbegin()));
+
+                // 100 -> 7 batches (6 of 16, 1 of 4); 2 -> 1 uninstanced batch; 20 -> 16 + 4
+            Assert::AreEqual(10u, unsigned(batches._batches.size()));
+            Assert::AreEqual(120u, unsigned(batches._instanceTransforms.size()));
+
+            unsigned drawCallCount = 0;
+            for (const auto& b:batches._batches) {
+                Assert::AreEqual(drawCallCount, b._firstDrawCall);
+                Assert::IsTrue(b._drawCallCount <= 16);
+                drawCallCount += b._drawCallCount;
+
+                if (b.IsInstanced()) {
+                    for (unsigned c=0; c<b._drawCallCount; ++c) {
+                        auto& t = batches._instanceTransforms[b._firstInstance + c];
+                        Assert::AreEqual(float(b._firstDrawCall + c), t(0,3));
+                    }
+                }
+            }
+            Assert::AreEqual(unsigned(sortedDrawCalls.size()), drawCallCount);
+            Assert::IsFalse(batches._batches[7].IsInstanced());
+            Assert::AreEqual(2u, batches._batches[7]._drawCallCount);
+        }
+
+        TEST_METHOD(SplitOnIdentity)
+        {
+            using RenderCore::Assets::InstanceBatches;
+            const unsigned depthBits = 24;
+
+                //  Variation ids 1 and (1<<20)+1 give the same sort key once they are
+                //  truncated to 20 bits. So the sorted list can interleave two different
+                //  draw calls with equal keys; they must never share a batch.
+            std::vector<std::pair<uint64, unsigned>> sortedDrawCalls;
+            std::vector<unsigned> transformIndices;
+            std::vector<uint64> identities;
+            std::vector<Float4x4> transforms;
+            const unsigned variationIds[] = { 1, 1, 1, 1, (1u<<20u)+1, (1u<<20u)+1, (1u<<20u)+1, (1u<<20u)+1, 1, 1 };
+            for (unsigned c=0; c<dimof(variationIds); ++c) {
+                auto maskedVariation = uint64(variationIds[c]) & ((1ull<<20ull)-1ull);
+                sortedDrawCalls.push_back(std::make_pair((maskedVariation << uint64(depthBits+20)) | c, c));
+                transformIndices.push_back(c);
+                identities.push_back(uint64(variationIds[c]) << 32ull);
+                transforms.push_back(AsFloat4x4(Float3(float(c), 0.f, 0.f)));
+            }
+
+            InstanceBatches batches(4, 16);
+            batches.Build(
+                AsPointer(sortedDrawCalls.cbegin()), sortedDrawCalls.size(), depthBits,
+                AsPointer(transformIndices.cbegin()), AsPointer(transforms.cbegin()),
+                AsPointer(identities.cbegin()));
+
+            Assert::AreEqual(3u, unsigned(batches._batches.size()));
+            for (const auto& b:batches._batches)
+                for (unsigned c=1; c<b._drawCallCount; ++c)
+                    Assert::IsTrue(
+                        identities[sortedDrawCalls[b._firstDrawCall+c].second]
+                        == identities[sortedDrawCalls[b._firstDrawCall].second]);
+            Assert::IsTrue(batches._batches[0].IsInstanced());
+            Assert::IsTrue(batches._batches[1].IsInstanced());
+            Assert::IsFalse(batches._batches[2].IsInstanced());
+
+                //  without the identities, everything collapses into one batch
+            batches.Build(
+                AsPointer(sortedDrawCalls.cbegin()), sortedDrawCalls.size(), depthBits,
+                AsPointer(transformIndices.cbegin()), AsPointer(transforms.cbegin()));
+            Assert::AreEqual(1u, unsigned(batches._batches.size()));
+        }
+    };
+}
+
@@ -0,0 +1,267 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../SceneEngine/TerrainCollisions.h"
+#include "../SceneEngine/IntersectionTestInternal.h"
+#include "../Math/Geometry.h"
+#include "../Math/Math.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Height field made up of square nodes, with a lattice of height samples
+        //  that are bilinearly filtered (like the terrain height map)
+    class TestHeightField
+    {
+    public:
+        unsigned            _widthInNodes, _elementsPerNode;
+        std::vector<float>  _heights;
+        unsigned            _sampleCount;
+
+        bool GetHeight(float& result, Float2 gridCoord)
+        {
+            ++_sampleCount;
+            float x = gridCoord[0] * float(_elementsPerNode), y = gridCoord[1] * float(_elementsPerNode);
+            unsigned lastElement = _widthInNodes * _elementsPerNode;
+            if (x < 0.f || y < 0.f || x > float(lastElement) || y > float(lastElement)) { return false; }
+
+            unsigned x0 = std::min(unsigned(x), lastElement-1), y0 = std::min(unsigned(y), lastElement-1);
+            float fx = x - float(x0), fy = y - float(y0);
+            result =
+                  (1.f-fx) * (1.f-fy) * Lattice(x0, y0) + fx * (1.f-fy) * Lattice(x0+1, y0)
+                + (1.f-fx) * fy * Lattice(x0, y0+1) + fx * fy * Lattice(x0+1, y0+1);
+            return true;
+        }
+
+        bool GetHeightRange(float& minHeight, float& maxHeight, int gridX, int gridY)
+        {
+            if (gridX < 0 || gridY < 0 || gridX >= int(_widthInNodes) || gridY >= int(_widthInNodes)) { return false; }
+            minHeight = FLT_MAX; maxHeight = -FLT_MAX;
+            for (unsigned y=0; y<=_elementsPerNode; ++y)
+                for (unsigned x=0; x<=_elementsPerNode; ++x) {
+                    float h = Lattice(gridX*_elementsPerNode + x, gridY*_elementsPerNode + y);
+                    minHeight = std::min(minHeight, h);
+                    maxHeight = std::max(maxHeight, h);
+                }
+            return true;
+        }
+
+        float Lattice(unsigned x, unsigned y) const { return _heights[y * (_widthInNodes * _elementsPerNode + 1) + x]; }
+
+        template<typename Fn>
+            TestHeightField(unsigned widthInNodes, unsigned elementsPerNode, Fn heightFn)
+            : _widthInNodes(widthInNodes), _elementsPerNode(elementsPerNode), _sampleCount(0)
+        {
+            unsigned latticeWidth = widthInNodes * elementsPerNode + 1;
+            _heights.resize(latticeWidth * latticeWidth);
+            for (unsigned y=0; y<latticeWidth; ++y)
+                for (unsigned x=0; x<latticeWidth; ++x)
+                    _heights[y * latticeWidth + x] = heightFn(float(x) / float(elementsPerNode), float(y) / float(elementsPerNode));
+        }
+    };
+
+        //  Plain march with a much smaller step, and no skipping of nodes
+    static bool ReferenceHeightFieldIntersection(
+        float& result, TestHeightField& field, const Float3& start, const Float3& end, float stepLength)
+    {
+        Float3 direction = end - start;
+        float horizontalLength = XlSqrt(direction[0]*direction[0] + direction[1]*direction[1]);
+        float tStep = stepLength / horizontalLength;
+        bool havePrev = false;
+        float prevT = 0.f, prevDiff = 0.f;
+        for (float t=0.f;; t = std::min(t + tStep, 1.f)) {
+            float height;
+            if (!field.GetHeight(height, Float2(start[0] + t * direction[0], start[1] + t * direction[1]))) {
+                havePrev = false;
+            } else {
+                float diff = start[2] + t * direction[2] - height;
+                if (havePrev && prevDiff > 0.f && diff <= 0.f) {
+                    float t0 = prevT, t1 = t;
+                    for (unsigned c=0; c<20; ++c) {
+                        float tm = .5f * (t0 + t1);
+                        float hm;
+                        field.GetHeight(hm, Float2(start[0] + tm * direction[0], start[1] + tm * direction[1]));
+                        if (start[2] + tm * direction[2] - hm > 0.f) { t0 = tm; } else { t1 = tm; }
+                    }
+                    result = .5f * (t0 + t1);
+                    return true;
+                }
+                havePrev = true;
+                prevT = t;
+                prevDiff = diff;
+            }
+            if (t >= 1.f) break;
+        }
+        return false;
+    }
+
+        //  (std::uniform_real_distribution isn't the same on every platform)
+    static float RandomFloat(std::mt19937& rng, float min, float max) { return min + (max - min) * float(rng() % 100000) / 100000.f; }
+
+    TEST_CLASS(IntersectionTest)
+    {
+    public:
+        TEST_METHOD(HeightFieldMatchesReference)
+        {
+            using SceneEngine::Internal::FindHeightFieldIntersection;
+            const unsigned widthInNodes = 8, elementsPerNode = 8;
+            TestHeightField field(widthInNodes, elementsPerNode,
+                [](float x, float y) { return .6f + .2f * XlSin(.7f * x) + .2f * XlCos(.9f * y); });
+            const float gridWidth = float(widthInNodes);
+            const Float2 gridMins(0.f, 0.f), gridMaxs(gridWidth, gridWidth);
+            const float stepLength = .5f / float(elementsPerNode);
+
+            std::mt19937 rng(3461);
+
+                //  Steep rays that start above the surface and finish below it cross it
+                //  exactly once. So we should always find that crossing.
+            for (unsigned c=0; c<500; ++c) {
+                Float3 start(RandomFloat(rng, .5f, 7.5f), RandomFloat(rng, .5f, 7.5f), 2.f);
+                Float3 end(start[0] + RandomFloat(rng, -.4f, .4f), start[1] + RandomFloat(rng, -.4f, .4f), -1.f);
+                float t, tRef;
+                Assert::IsTrue(FindHeightFieldIntersection(t, field, start, end, gridMins, gridMaxs, stepLength));
+                Assert::IsTrue(ReferenceHeightFieldIntersection(tRef, field, start, end, stepLength / 8.f));
+                Assert::IsTrue(XlAbs(t - tRef) < 1e-3f);
+            }
+
+                //  Rays in any direction (including ones that start and finish outside of
+                //  the height field). Rays that only just graze the surface can be missed by
+                //  the march, but everything else should match.
+            unsigned hitCount = 0, mismatchCount = 0;
+            const unsigned rayCount = 2000;
+            for (unsigned c=0; c<rayCount; ++c) {
+                Float3 start(RandomFloat(rng, -2.f, 10.f), RandomFloat(rng, -2.f, 10.f), RandomFloat(rng, -.5f, 2.f));
+                Float3 end(RandomFloat(rng, -2.f, 10.f), RandomFloat(rng, -2.f, 10.f), RandomFloat(rng, -.5f, 2.f));
+                float t = -1.f, tRef = -1.f;
+                bool hit = FindHeightFieldIntersection(t, field, start, end, gridMins, gridMaxs, stepLength);
+                bool refHit = ReferenceHeightFieldIntersection(tRef, field, start, end, stepLength / 8.f);
+                if (hit) {
+                        //  every hit is on the surface
+                    Float3 pt = start + t * (end - start);
+                    float height;
+                    Assert::IsTrue(field.GetHeight(height, Truncate(pt)));
+                    Assert::IsTrue(XlAbs(pt[2] - height) < 1e-2f);
+                    ++hitCount;
+                }
+                if (hit != refHit || (hit && XlAbs(t - tRef) > 1e-3f)) {
+                    ++mismatchCount;
+                }
+            }
+            Assert::IsTrue(hitCount > rayCount/10);
+            Assert::IsTrue(mismatchCount <= rayCount/100);
+
+                //  Vertical rays, and rays that go up through the surface (back faces aren't hit)
+            {
+                float t, height;
+                Assert::IsTrue(FindHeightFieldIntersection(t, field, Float3(3.3f, 4.1f, 2.f), Float3(3.3f, 4.1f, -1.f), gridMins, gridMaxs, stepLength));
+                field.GetHeight(height, Float2(3.3f, 4.1f));
+                Assert::IsTrue(XlAbs((2.f - 3.f * t) - height) < 1e-4f);
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, Float3(3.3f, 4.1f, -1.f), Float3(3.3f, 4.1f, 2.f), gridMins, gridMaxs, stepLength));
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, Float3(1.f, 1.f, -1.f), Float3(7.f, 6.f, 2.f), gridMins, gridMaxs, stepLength));
+            }
+        }
+
+        TEST_METHOD(HeightFieldSkipsNodes)
+        {
+            using SceneEngine::Internal::FindHeightFieldIntersection;
+            const unsigned widthInNodes = 8, elementsPerNode = 8;
+            const float gridWidth = float(widthInNodes);
+            const Float2 gridMins(0.f, 0.f), gridMaxs(gridWidth, gridWidth);
+            const float stepLength = .5f / float(elementsPerNode);
+            float t;
+
+                //  Rays that are entirely above or below the range of heights in every node
+                //  they touch don't sample the heights at all. Rays that start and end a
+                //  long way outside of the height field are clipped to it first.
+            {
+                TestHeightField field(widthInNodes, elementsPerNode,
+                    [](float x, float y) { return .6f + .2f * XlSin(.7f * x) + .2f * XlCos(.9f * y); });
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, Float3(-1e6f, 3.5f, 1.5f), Float3(1e6f, 4.5f, 1.2f), gridMins, gridMaxs, stepLength));
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, Float3(-1e6f, -1e6f, 10.f), Float3(1e6f, 1e6f, -10.f), gridMins, gridMaxs, stepLength));
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, Float3(1e6f, 1e6f, 1.f), Float3(2e6f, 1e6f, -1.f), gridMins, gridMaxs, stepLength));
+                Assert::AreEqual(0u, field._sampleCount);
+
+                    //  A ray that descends into the surface only samples the node where it crosses
+                Assert::IsTrue(FindHeightFieldIntersection(t, field, Float3(.5f, 4.5f, 10.f), Float3(7.5f, 4.5f, -10.f), gridMins, gridMaxs, stepLength));
+                Assert::IsTrue(field._sampleCount < 2 * elementsPerNode * 2 + 12);
+            }
+
+                //  A spike at the corner of every node means every node has to be marched
+                //  by a ray that runs through the middle of them. The march stops after
+                //  "maxSampleCount" samples.
+            {
+                TestHeightField field(widthInNodes, elementsPerNode,
+                    [](float x, float y) { return (XlFloor(x) == x && XlFloor(y) == y) ? 1.f : 0.f; });
+                Float3 start(0.f, 4.5f, .5f), end(8.f, 4.5f, .5f);
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, start, end, gridMins, gridMaxs, stepLength));
+                Assert::IsTrue(field._sampleCount >= widthInNodes * elementsPerNode * 2);
+
+                field._sampleCount = 0;
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, start, end, gridMins, gridMaxs, stepLength, 20));
+                Assert::IsTrue(field._sampleCount <= 20);
+
+                    //  A tiny step would take millions of samples without the limit
+                field._sampleCount = 0;
+                Assert::IsFalse(FindHeightFieldIntersection(t, field, start, end, gridMins, gridMaxs, 1e-7f));
+                Assert::IsTrue(field._sampleCount <= SceneEngine::Internal::HeightFieldMaxSampleCount);
+            }
+        }
+
+        TEST_METHOD(RayChunkCulling)
+        {
+                //  Whether any ray hits a box should be the same as testing every ray
+            std::mt19937 rng(7812);
+            std::vector<std::pair<Float3, Float3>> rays;
+            for (unsigned c=0; c<1000; ++c) {
+                    //  (groups of nearby rays, like a sorted batch)
+                Float3 base(RandomFloat(rng, -100.f, 100.f), RandomFloat(rng, -100.f, 100.f), RandomFloat(rng, -100.f, 100.f));
+                for (unsigned r=0; r<10; ++r) {
+                    Float3 start = base + Float3(RandomFloat(rng, -2.f, 2.f), RandomFloat(rng, -2.f, 2.f), RandomFloat(rng, -2.f, 2.f));
+                    Float3 end = start + Float3(RandomFloat(rng, -10.f, 10.f), RandomFloat(rng, -10.f, 10.f), RandomFloat(rng, -10.f, 10.f));
+                    rays.push_back(std::make_pair(start, end));
+                }
+            }
+
+            SceneEngine::Internal::RayChunks chunks(AsPointer(rays.cbegin()), rays.size(), 64);
+            Assert::AreEqual(unsigned((rays.size() + 63) / 64), chunks.GetChunkCount());
+            Assert::AreEqual(size_t(0), chunks.GetChunkBegin(0));
+            for (unsigned c=1; c<chunks.GetChunkCount(); ++c) {
+                Assert::AreEqual(chunks.GetChunkEnd(c-1), chunks.GetChunkBegin(c));
+            }
+            Assert::AreEqual(rays.size(), chunks.GetChunkEnd(chunks.GetChunkCount()-1));
+
+            unsigned hitCount = 0;
+            for (unsigned b=0; b<500; ++b) {
+                Float3 mins(RandomFloat(rng, -110.f, 100.f), RandomFloat(rng, -110.f, 100.f), RandomFloat(rng, -110.f, 100.f));
+                Float3 maxs = mins + Float3(RandomFloat(rng, 0.f, 10.f), RandomFloat(rng, 0.f, 10.f), RandomFloat(rng, 0.f, 10.f));
+
+                bool expected = false;
+                for (unsigned c=0; c<chunks.GetChunkCount(); ++c) {
+                    bool chunkHit = false;
+                    for (auto r=chunks.GetChunkBegin(c); r<chunks.GetChunkEnd(c); ++r) {
+                        chunkHit |= RayVsAABB(rays[r], mins, maxs);
+                    }
+                        //  chunks that are rejected can't have any hits
+                    Assert::IsTrue(!chunkHit || chunks.MightHit(c, mins, maxs));
+                    expected |= chunkHit;
+                }
+                Assert::AreEqual(expected, chunks.AnyRayHits(mins, maxs));
+                if (expected) { ++hitCount; }
+            }
+            Assert::IsTrue(hitCount > 10);
+
+            SceneEngine::Internal::RayChunks empty(nullptr, 0);
+            Assert::AreEqual(0u, empty.GetChunkCount());
+            Assert::IsFalse(empty.AnyRayHits(Float3(-1.f, -1.f, -1.f), Float3(1.f, 1.f, 1.f)));
+        }
+    };
+}
+
@@ -0,0 +1,248 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../SceneEngine/ModelBVH.h"
+#include "../Math/Transformations.h"
+#include "../Utility/PtrUtils.h"
+#include "../Core/Types.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <algorithm>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Linear scan over every triangle, with the same intersection test and
+        //  epsilon as the tree. Returns the world space depths of every hit.
+    static std::vector<float> BruteForceIntersections(
+        const std::vector<Float3>& positions, const std::vector<unsigned>& indices,
+        const std::pair<Float3, Float3>& worldSpaceSegment, const Float4x4& modelToWorld)
+    {
+        std::vector<float> result;
+        float worldSpaceLength = Magnitude(worldSpaceSegment.second - worldSpaceSegment.first);
+        auto worldToModel = Inverse(modelToWorld);
+        Float3 origin = TransformPoint(worldToModel, worldSpaceSegment.first);
+        Float3 direction = TransformPoint(worldToModel, worldSpaceSegment.second) - origin;
+        float minT = 0.00001f / worldSpaceLength;
+
+        for (size_t i=0; i+2<indices.size(); i+=3) {
+            Float3 v0 = positions[indices[i]];
+            Float3 e1 = positions[indices[i+1]] - v0;
+            Float3 e2 = positions[indices[i+2]] - v0;
+            Float3 h = Cross(direction, e2);
+            float a = Dot(e1, h);
+            if (a == 0.f) { continue; }
+            float f = 1.f / a;
+            Float3 s = origin - v0;
+            float u = f * Dot(s, h);
+            Float3 q = Cross(s, e1);
+            float v = f * Dot(direction, q);
+            float t = f * Dot(e2, q);
+            if (u >= 0.f && v >= 0.f && (u+v) <= 1.f && t > minT && t < 1.f) {
+                result.push_back(t * worldSpaceLength);
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static bool CloseDepth(float lhs, float rhs) { return XlAbs(lhs - rhs) <= 1e-3f * std::max(1.f, XlAbs(rhs)); }
+
+    TEST_CLASS(ModelBVH)
+    {
+    public:
+        TEST_METHOD(MatchesLinearScan)
+        {
+                //  A soup of small random triangles, and a large ground plane under them
+            std::mt19937 rng(6521);
+            std::uniform_real_distribution<float> centre(-10.f, 10.f), offset(-.75f, .75f);
+            std::vector<Float3> positions;
+            std::vector<unsigned> indices;
+            for (unsigned t=0; t<3000; ++t) {
+                Float3 c(centre(rng), centre(rng), centre(rng));
+                for (unsigned v=0; v<3; ++v) {
+                    indices.push_back(unsigned(positions.size()));
+                    positions.push_back(c + Float3(offset(rng), offset(rng), offset(rng)));
+                }
+            }
+            const unsigned planeBase = unsigned(positions.size());
+            positions.push_back(Float3(-20.f, -20.f, -12.f));
+            positions.push_back(Float3( 20.f, -20.f, -12.f));
+            positions.push_back(Float3(-20.f,  20.f, -12.f));
+            positions.push_back(Float3( 20.f,  20.f, -12.f));
+            unsigned planeIndices[] = { 0, 1, 2, 2, 1, 3 };
+            for (unsigned c=0; c<dimof(planeIndices); ++c) { indices.push_back(planeBase + planeIndices[c]); }
+
+            SceneEngine::ModelBVH bvh(AsPointer(positions.cbegin()), AsPointer(indices.cbegin()), indices.size());
+            Assert::AreEqual(unsigned(indices.size()/3), bvh.GetTriangleCount());
+
+            auto modelToWorld = AsFloat4x4(Float3(100.f, 5.f, -3.f));
+            Combine_InPlace(UniformScale(2.f), modelToWorld);
+
+            typedef SceneEngine::ModelBVH::ResultEntry ResultEntry;
+            std::uniform_real_distribution<float> endPoint(-30.f, 30.f);
+            unsigned hitCount = 0, missCount = 0;
+            for (unsigned s=0; s<1000; ++s) {
+                auto segment = std::make_pair(
+                    TransformPoint(modelToWorld, Float3(endPoint(rng), endPoint(rng), endPoint(rng))),
+                    TransformPoint(modelToWorld, Float3(endPoint(rng), endPoint(rng), endPoint(rng))));
+                auto expected = BruteForceIntersections(positions, indices, segment, modelToWorld);
+
+                    //  every hit, at the same depths
+                std::vector<ResultEntry> all;
+                all.push_back(ResultEntry());       // (results are appended)
+                auto count = bvh.FindAllIntersections(all, segment, modelToWorld);
+                Assert::AreEqual(unsigned(expected.size()), count);
+                Assert::AreEqual(expected.size()+1, all.size());
+                std::sort(all.begin()+1, all.end(), &ResultEntry::CompareDepth);
+                for (unsigned c=0; c<count; ++c) {
+                    Assert::IsTrue(CloseDepth(all[c+1]._intersectionDepth, expected[c]));
+
+                        //  the barycentric coordinates in W give the point on the segment at that depth
+                    const auto& r = all[c+1];
+                    Assert::IsTrue(Equivalent(r._pt[0][3] + r._pt[1][3] + r._pt[2][3], 1.f, 1e-4f));
+                    Float3 pt = r._pt[0][3] * Truncate(r._pt[0]) + r._pt[1][3] * Truncate(r._pt[1]) + r._pt[2][3] * Truncate(r._pt[2]);
+                    Float3 expectedPt = segment.first + (r._intersectionDepth / Magnitude(segment.second - segment.first)) * (segment.second - segment.first);
+                    Assert::IsTrue(Magnitude(pt - expectedPt) < 1e-2f);
+                }
+
+                    //  the nearest hit, or no change to the result on a miss
+                ResultEntry first;
+                first._intersectionDepth = -1.f;
+                first._drawCallIndex = 1234;
+                bool hit = bvh.FindFirstIntersection(first, segment, modelToWorld);
+                Assert::AreEqual(!expected.empty(), hit);
+                if (hit) {
+                    Assert::IsTrue(CloseDepth(first._intersectionDepth, expected[0]));
+                    Assert::AreEqual(0u, first._drawCallIndex);
+                    ++hitCount;
+                } else {
+                    Assert::AreEqual(-1.f, first._intersectionDepth);
+                    Assert::AreEqual(1234u, first._drawCallIndex);
+                    ++missCount;
+                }
+            }
+
+                //  (make sure the random segments cover both cases)
+            Assert::IsTrue(hitCount > 100 && missCount > 10);
+
+                //  Segments that miss the bounding box entirely, stop short of the
+                //  plane, or have no length
+            std::pair<Float3, Float3> misses[] = {
+                std::make_pair(Float3(0.f, 0.f, 100.f), Float3(10.f, 10.f, 200.f)),
+                std::make_pair(Float3(-25.f, 25.f, -11.f), Float3(25.f, 25.f, -13.f)),
+                std::make_pair(Float3(0.f, 0.f, -25.f), Float3(0.f, 0.f, -12.5f)),
+                std::make_pair(Float3(1.f, 2.f, 3.f), Float3(1.f, 2.f, 3.f))
+            };
+            for (unsigned c=0; c<dimof(misses); ++c) {
+                auto segment = std::make_pair(TransformPoint(modelToWorld, misses[c].first), TransformPoint(modelToWorld, misses[c].second));
+                std::vector<ResultEntry> all;
+                Assert::AreEqual(0u, bvh.FindAllIntersections(all, segment, modelToWorld));
+                Assert::IsTrue(all.empty());
+                ResultEntry first;
+                Assert::IsFalse(bvh.FindFirstIntersection(first, segment, modelToWorld));
+            }
+
+                //  Straight down through the plane (from below, so the back face is hit too)
+            {
+                auto segment = std::make_pair(
+                    TransformPoint(modelToWorld, Float3(15.f, -15.f, -20.f)),
+                    TransformPoint(modelToWorld, Float3(15.f, -15.f, -10.f)));
+                ResultEntry first;
+                Assert::IsTrue(bvh.FindFirstIntersection(first, segment, modelToWorld));
+                Assert::IsTrue(CloseDepth(first._intersectionDepth, 2.f * 8.f));
+            }
+
+                //  An empty tree never hits
+            {
+                SceneEngine::ModelBVH empty(nullptr, nullptr, 0);
+                Assert::AreEqual(0u, empty.GetTriangleCount());
+                std::vector<ResultEntry> all;
+                Assert::AreEqual(0u, empty.FindAllIntersections(all, std::make_pair(Float3(-1.f, 0.f, 0.f), Float3(1.f, 0.f, 0.f)), Identity<Float4x4>()));
+            }
+        }
+
+        TEST_METHOD(AlphaTestedDrawCallsAreSkipped)
+        {
+                //  An alpha tested quad (draw call 1) at z=0, partially in front of an
+                //  opaque quad (draw call 0) at z=-5
+            Float3 positions[] = {
+                Float3(-2.f, -1.f, -5.f), Float3( 2.f, -1.f, -5.f), Float3(-2.f,  1.f, -5.f), Float3( 2.f,  1.f, -5.f),
+                Float3(-1.f, -1.f,  0.f), Float3( 3.f, -1.f,  0.f), Float3(-1.f,  1.f,  0.f), Float3( 3.f,  1.f,  0.f)
+            };
+            unsigned indices[] = { 0, 1, 2, 2, 1, 3,  4, 5, 6, 6, 5, 7 };
+            unsigned drawCallIndices[] = { 0, 0, 1, 1 };
+            std::vector<bool> alphaTested;
+            alphaTested.push_back(false);
+            alphaTested.push_back(true);
+
+            SceneEngine::ModelBVH bvh(positions, indices, dimof(indices), drawCallIndices, alphaTested);
+            SceneEngine::ModelBVH noAlphaTest(positions, indices, dimof(indices), drawCallIndices);
+            auto modelToWorld = Identity<Float4x4>();
+            typedef SceneEngine::ModelBVH::ResultEntry ResultEntry;
+
+                //  Through both quads: the opaque one is the result, and we're told the 
+                //  alpha tested one was in front of it
+            {
+                auto segment = std::make_pair(Float3(0.f, .3f, 10.f), Float3(0.f, .3f, -10.f));
+                ResultEntry first;
+                bool alphaTestedHitFirst = false;
+                Assert::IsTrue(bvh.FindFirstIntersection(first, segment, modelToWorld, &alphaTestedHitFirst));
+                Assert::AreEqual(0u, first._drawCallIndex);
+                Assert::IsTrue(CloseDepth(first._intersectionDepth, 15.f));
+                Assert::IsTrue(alphaTestedHitFirst);
+
+                std::vector<ResultEntry> all;
+                Assert::AreEqual(1u, bvh.FindAllIntersections(all, segment, modelToWorld));
+                Assert::AreEqual(0u, all[0]._drawCallIndex);
+
+                    //  without the flags, the alpha tested quad is hit first
+                Assert::IsTrue(noAlphaTest.FindFirstIntersection(first, segment, modelToWorld, &alphaTestedHitFirst));
+                Assert::AreEqual(1u, first._drawCallIndex);
+                Assert::IsTrue(CloseDepth(first._intersectionDepth, 10.f));
+                Assert::IsFalse(alphaTestedHitFirst);
+            }
+
+                //  The other way, the alpha tested quad is behind the result
+            {
+                auto segment = std::make_pair(Float3(0.f, .3f, -10.f), Float3(0.f, .3f, 10.f));
+                ResultEntry first;
+                bool alphaTestedHitFirst = true;
+                Assert::IsTrue(bvh.FindFirstIntersection(first, segment, modelToWorld, &alphaTestedHitFirst));
+                Assert::AreEqual(0u, first._drawCallIndex);
+                Assert::IsTrue(CloseDepth(first._intersectionDepth, 5.f));
+                Assert::IsFalse(alphaTestedHitFirst);
+            }
+
+                //  Only through the alpha tested quad: no hit
+            {
+                auto segment = std::make_pair(Float3(2.5f, .3f, 10.f), Float3(2.5f, .3f, -10.f));
+                ResultEntry first;
+                first._drawCallIndex = 1234;
+                bool alphaTestedHitFirst = false;
+                Assert::IsFalse(bvh.FindFirstIntersection(first, segment, modelToWorld, &alphaTestedHitFirst));
+                Assert::AreEqual(1234u, first._drawCallIndex);
+                Assert::IsTrue(alphaTestedHitFirst);
+
+                std::vector<ResultEntry> all;
+                Assert::AreEqual(0u, bvh.FindAllIntersections(all, segment, modelToWorld));
+            }
+
+                //  Only through the opaque quad
+            {
+                auto segment = std::make_pair(Float3(-1.5f, .3f, 10.f), Float3(-1.5f, .3f, -10.f));
+                ResultEntry first;
+                bool alphaTestedHitFirst = true;
+                Assert::IsTrue(bvh.FindFirstIntersection(first, segment, modelToWorld, &alphaTestedHitFirst));
+                Assert::AreEqual(0u, first._drawCallIndex);
+                Assert::IsFalse(alphaTestedHitFirst);
+            }
+        }
+    };
+}
+
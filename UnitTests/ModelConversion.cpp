@@ -8,6 +8,7 @@
 #include "../RenderCore/Assets/ModelRunTime.h"
 #include "../RenderCore/Assets/ModelRunTimeInternal.h"
 #include "../RenderCore/Assets/ColladaCompilerInterface.h"
+#include "../ColladaConversion/NascentModel.h"
 #include "../Assets/Assets.h"
 #include "../ConsoleRig/Console.h"
 #include "../ConsoleRig/Log.h"
@@ -15,9 +16,12 @@
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/SystemUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/MemoryUtils.h"
 #include "../Utility/TimeUtils.h"
 #include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/WinAPI/WinAPIWrapper.h"
 #include <CppUnitTest.h>
+#include <sstream>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -61,6 +65,257 @@ namespace UnitTests
 		compilers.AddCompiler(ColladaCompiler::Type_Skeleton, colladaProcessor);
 	}
 
+	static void WriteSkinnedTestModel(const char filename[], unsigned meshCount, unsigned gridSize)
+	{
+			//	Writes a Collada file with a simple 2 joint skeleton, and "meshCount"
+			//	separately skinned grid meshes. Vertices in the middle of each grid are
+			//	weighted to both joints, and the edges only to one. So each controller 
+			//	uses more than one weight bucket.
+		std::stringstream str;
+		str << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+		str << "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n";
+		str << "<asset><unit name=\"meter\" meter=\"1\"/><up_axis>Z_UP</up_axis></asset>\n";
+
+		const unsigned vertexCount = (gridSize+1) * (gridSize+1);
+		const unsigned triangleCount = gridSize * gridSize * 2;
+
+		str << "<library_geometries>\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<geometry id=\"mesh" << m << "\" name=\"mesh" << m << "\"><mesh>\n";
+			str << "<source id=\"mesh" << m << "-positions\"><float_array id=\"mesh" << m << "-positions-array\" count=\"" << vertexCount*3 << "\">";
+			for (unsigned y=0; y<=gridSize; ++y)
+				for (unsigned x=0; x<=gridSize; ++x)
+					str << float(x) / float(gridSize) + float(m) << " " << float(y) / float(gridSize) << " " << float((x*7+y*3+m)%5) * 0.1f << " ";
+			str << "</float_array><technique_common><accessor source=\"#mesh" << m << "-positions-array\" count=\"" << vertexCount << "\" stride=\"3\">";
+			str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"mesh" << m << "-normals\"><float_array id=\"mesh" << m << "-normals-array\" count=\"3\">0 0 1</float_array>";
+			str << "<technique_common><accessor source=\"#mesh" << m << "-normals-array\" count=\"1\" stride=\"3\">";
+			str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<vertices id=\"mesh" << m << "-vertices\"><input semantic=\"POSITION\" source=\"#mesh" << m << "-positions\"/></vertices>\n";
+			str << "<triangles count=\"" << triangleCount << "\"><input semantic=\"VERTEX\" source=\"#mesh" << m << "-vertices\" offset=\"0\"/>";
+			str << "<input semantic=\"NORMAL\" source=\"#mesh" << m << "-normals\" offset=\"1\"/><p>";
+			for (unsigned y=0; y<gridSize; ++y)
+				for (unsigned x=0; x<gridSize; ++x) {
+					unsigned i0 = y*(gridSize+1)+x, i1 = i0+1, i2 = i0+gridSize+1, i3 = i2+1;
+					str << i0 << " 0 " << i1 << " 0 " << i3 << " 0 " << i0 << " 0 " << i3 << " 0 " << i2 << " 0 ";
+				}
+			str << "</p></triangles>\n</mesh></geometry>\n";
+		}
+		str << "</library_geometries>\n";
+
+		str << "<library_controllers>\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<controller id=\"skin" << m << "\"><skin source=\"#mesh" << m << "\">\n";
+			str << "<bind_shape_matrix>1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1</bind_shape_matrix>\n";
+			str << "<source id=\"skin" << m << "-joints\"><Name_array id=\"skin" << m << "-joints-array\" count=\"2\">joint0 joint1</Name_array>";
+			str << "<technique_common><accessor source=\"#skin" << m << "-joints-array\" count=\"2\" stride=\"1\"><param name=\"JOINT\" type=\"name\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"skin" << m << "-bindposes\"><float_array id=\"skin" << m << "-bindposes-array\" count=\"32\">";
+			str << "1 0 0 0 0 1 0 0 0 0 1 0 0 0 0 1 1 0 0 0 0 1 0 0 0 0 1 -1 0 0 0 1</float_array>";
+			str << "<technique_common><accessor source=\"#skin" << m << "-bindposes-array\" count=\"2\" stride=\"16\"><param name=\"TRANSFORM\" type=\"float4x4\"/></accessor></technique_common></source>\n";
+
+			std::stringstream vcount, v, weights;
+			unsigned weightCount = 0;
+			for (unsigned y=0; y<=gridSize; ++y)
+				for (unsigned x=0; x<=gridSize; ++x) {
+					if (x == 0 || x == gridSize) {
+						vcount << "1 ";
+						v << (x ? 1 : 0) << " " << weightCount++ << " ";
+						weights << "1 ";
+					} else {
+						float w = float(x) / float(gridSize);
+						vcount << "2 ";
+						v << "0 " << weightCount++ << " 1 " << weightCount++ << " ";
+						weights << 1.f-w << " " << w << " ";
+					}
+				}
+			str << "<source id=\"skin" << m << "-weights\"><float_array id=\"skin" << m << "-weights-array\" count=\"" << weightCount << "\">" << weights.str() << "</float_array>";
+			str << "<technique_common><accessor source=\"#skin" << m << "-weights-array\" count=\"" << weightCount << "\" stride=\"1\"><param name=\"WEIGHT\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<joints><input semantic=\"JOINT\" source=\"#skin" << m << "-joints\"/><input semantic=\"INV_BIND_MATRIX\" source=\"#skin" << m << "-bindposes\"/></joints>\n";
+			str << "<vertex_weights count=\"" << vertexCount << "\"><input semantic=\"JOINT\" source=\"#skin" << m << "-joints\" offset=\"0\"/>";
+			str << "<input semantic=\"WEIGHT\" source=\"#skin" << m << "-weights\" offset=\"1\"/>";
+			str << "<vcount>" << vcount.str() << "</vcount><v>" << v.str() << "</v></vertex_weights>\n";
+			str << "</skin></controller>\n";
+		}
+		str << "</library_controllers>\n";
+
+		str << "<library_visual_scenes><visual_scene id=\"scene\">\n";
+		str << "<node id=\"joint0\" name=\"joint0\" sid=\"joint0\" type=\"JOINT\"><translate sid=\"translate\">0 0 0</translate>\n";
+		str << "<node id=\"joint1\" name=\"joint1\" sid=\"joint1\" type=\"JOINT\"><translate sid=\"translate\">0 0 1</translate></node>\n";
+		str << "</node>\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<node id=\"skinned" << m << "\" name=\"skinned" << m << "\"><instance_controller url=\"#skin" << m << "\"><skeleton>#joint0</skeleton></instance_controller></node>\n";
+		}
+		str << "</visual_scene></library_visual_scenes>\n";
+		str << "<scene><instance_visual_scene url=\"#scene\"/></scene>\n";
+		str << "</COLLADA>\n";
+
+		auto text = str.str();
+		BasicFile file(filename, "wb");
+		file.Write(text.c_str(), 1, text.size());
+	}
+
+	static void WriteStaticAnimatedTestModel(const char filename[], unsigned meshCount, unsigned gridSize, unsigned keyCount)
+	{
+			//	Writes a Collada file with "meshCount" static meshes (no skin controllers),
+			//	each instanced by its own node. Every node has a translation that is
+			//	animated by a separate curve. Even meshes use <triangles> and odd meshes
+			//	use <polylist> with quads, so both primitive paths are exercised.
+		std::stringstream str;
+		str << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+		str << "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n";
+		str << "<asset><unit name=\"meter\" meter=\"1\"/><up_axis>Z_UP</up_axis></asset>\n";
+
+		const unsigned vertexCount = (gridSize+1) * (gridSize+1);
+
+		str << "<library_geometries>\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<geometry id=\"static" << m << "\" name=\"static" << m << "\"><mesh>\n";
+			str << "<source id=\"static" << m << "-positions\"><float_array id=\"static" << m << "-positions-array\" count=\"" << vertexCount*3 << "\">";
+			for (unsigned y=0; y<=gridSize; ++y)
+				for (unsigned x=0; x<=gridSize; ++x)
+					str << float(x) / float(gridSize) << " " << float(y) / float(gridSize) << " " << float((x*5+y*3+m)%7) * 0.1f << " ";
+			str << "</float_array><technique_common><accessor source=\"#static" << m << "-positions-array\" count=\"" << vertexCount << "\" stride=\"3\">";
+			str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"static" << m << "-normals\"><float_array id=\"static" << m << "-normals-array\" count=\"6\">0 0 1 0 1 0</float_array>";
+			str << "<technique_common><accessor source=\"#static" << m << "-normals-array\" count=\"2\" stride=\"3\">";
+			str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"static" << m << "-map\"><float_array id=\"static" << m << "-map-array\" count=\"" << vertexCount*2 << "\">";
+			for (unsigned y=0; y<=gridSize; ++y)
+				for (unsigned x=0; x<=gridSize; ++x)
+					str << float(y) / float(gridSize) << " " << float(x) / float(gridSize) << " ";
+			str << "</float_array><technique_common><accessor source=\"#static" << m << "-map-array\" count=\"" << vertexCount << "\" stride=\"2\">";
+			str << "<param name=\"S\" type=\"float\"/><param name=\"T\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<vertices id=\"static" << m << "-vertices\"><input semantic=\"POSITION\" source=\"#static" << m << "-positions\"/></vertices>\n";
+
+			const char* inputs[] = { "VERTEX", "NORMAL", "TEXCOORD" };
+			const char* sources[] = { "vertices", "normals", "map" };
+			std::stringstream inputStr;
+			for (unsigned i=0; i<dimof(inputs); ++i)
+				inputStr << "<input semantic=\"" << inputs[i] << "\" source=\"#static" << m << "-" << sources[i] << "\" offset=\"" << i << "\"" << (i==2?" set=\"0\"":"") << "/>";
+
+			std::stringstream p;
+			for (unsigned y=0; y<gridSize; ++y)
+				for (unsigned x=0; x<gridSize; ++x) {
+					unsigned i0 = y*(gridSize+1)+x, i1 = i0+1, i2 = i0+gridSize+1, i3 = i2+1;
+					unsigned n = (x+y)&1;
+					if (m & 1) {
+						p << i0 << " " << n << " " << i0 << " " << i1 << " " << n << " " << i1 << " ";
+						p << i3 << " " << n << " " << i3 << " " << i2 << " " << n << " " << i2 << " ";
+					} else {
+						p << i0 << " " << n << " " << i0 << " " << i1 << " " << n << " " << i1 << " " << i3 << " " << n << " " << i3 << " ";
+						p << i0 << " " << n << " " << i0 << " " << i3 << " " << n << " " << i3 << " " << i2 << " " << n << " " << i2 << " ";
+					}
+				}
+
+			if (m & 1) {
+				str << "<polylist count=\"" << gridSize * gridSize << "\">" << inputStr.str() << "<vcount>";
+				for (unsigned q=0; q<gridSize*gridSize; ++q) str << "4 ";
+				str << "</vcount><p>" << p.str() << "</p></polylist>\n";
+			} else {
+				str << "<triangles count=\"" << gridSize * gridSize * 2 << "\">" << inputStr.str();
+				str << "<p>" << p.str() << "</p></triangles>\n";
+			}
+			str << "</mesh></geometry>\n";
+		}
+		str << "</library_geometries>\n";
+
+		str << "<library_animations>\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<animation id=\"anim" << m << "\">\n";
+			str << "<source id=\"anim" << m << "-input\"><float_array id=\"anim" << m << "-input-array\" count=\"" << keyCount << "\">";
+			for (unsigned k=0; k<keyCount; ++k) str << float(k) / 30.f << " ";
+			str << "</float_array><technique_common><accessor source=\"#anim" << m << "-input-array\" count=\"" << keyCount << "\" stride=\"1\">";
+			str << "<param name=\"TIME\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"anim" << m << "-output\"><float_array id=\"anim" << m << "-output-array\" count=\"" << keyCount*3 << "\">";
+			for (unsigned k=0; k<keyCount; ++k)
+				str << float(m) * 2.f << " " << float((k*3+m)%11) * 0.25f << " " << float(k) * 0.01f << " ";
+			str << "</float_array><technique_common><accessor source=\"#anim" << m << "-output-array\" count=\"" << keyCount << "\" stride=\"3\">";
+			str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/></accessor></technique_common></source>\n";
+			str << "<source id=\"anim" << m << "-interpolation\"><Name_array id=\"anim" << m << "-interpolation-array\" count=\"" << keyCount << "\">";
+			for (unsigned k=0; k<keyCount; ++k) str << "LINEAR ";
+			str << "</Name_array><technique_common><accessor source=\"#anim" << m << "-interpolation-array\" count=\"" << keyCount << "\" stride=\"1\">";
+			str << "<param name=\"INTERPOLATION\" type=\"name\"/></accessor></technique_common></source>\n";
+			str << "<sampler id=\"anim" << m << "-sampler\"><input semantic=\"INPUT\" source=\"#anim" << m << "-input\"/>";
+			str << "<input semantic=\"OUTPUT\" source=\"#anim" << m << "-output\"/><input semantic=\"INTERPOLATION\" source=\"#anim" << m << "-interpolation\"/></sampler>\n";
+			str << "<channel source=\"#anim" << m << "-sampler\" target=\"node" << m << "/translate\"/>\n";
+			str << "</animation>\n";
+		}
+		str << "</library_animations>\n";
+
+		str << "<library_visual_scenes><visual_scene id=\"scene\">\n";
+		for (unsigned m=0; m<meshCount; ++m) {
+			str << "<node id=\"node" << m << "\" name=\"node" << m << "\" sid=\"node" << m << "\"><translate sid=\"translate\">" << float(m) * 2.f << " 0 0</translate>";
+			str << "<instance_geometry url=\"#static" << m << "\"/></node>\n";
+		}
+		str << "</visual_scene></library_visual_scenes>\n";
+		str << "<scene><instance_visual_scene url=\"#scene\"/></scene>\n";
+		str << "</COLLADA>\n";
+
+		auto text = str.str();
+		BasicFile file(filename, "wb");
+		file.Write(text.c_str(), 1, text.size());
+	}
+
+	static void CheckParallelConversionMatches(const char testModel[], const char* serializeFnNames[], unsigned serializeFnCount)
+	{
+			//	Convert the given model with a single thread, and then with several 
+			//	threads. Work is done in parallel, but the results should be merged in
+			//	the same order, so the serialized output must be byte-identical.
+		auto library = (*Windows::Fn_LoadLibrary)("ColladaConversion.dll");
+		Assert::IsTrue(library && library != INVALID_HANDLE_VALUE, L"Could not load ColladaConversion.dll");
+
+		using namespace RenderCore::ColladaConversion;
+		#if !TARGET_64BIT
+			const char CreateModelName[]		= "?CreateModel@ColladaConversion@RenderCore@@YA?AV?$unique_ptr@VNascentModel@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@QBD@Z";
+		#else
+			const char CreateModelName[]		= "?CreateModel@ColladaConversion@RenderCore@@YA?AV?$unique_ptr@VNascentModel@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@QEBD@Z";
+		#endif
+		const char SetThreadCountName[]	= "?SetConversionThreadCount@ColladaConversion@RenderCore@@YAXI@Z";
+		const char ShutdownName[]		= "?ShutdownLibrary@ColladaConversion@RenderCore@@YAXXZ";
+
+		auto createModel = (CreateModelFunction*)(*Windows::Fn_GetProcAddress)(library, CreateModelName);
+		auto setThreadCount = (void(*)(unsigned))(*Windows::Fn_GetProcAddress)(library, SetThreadCountName);
+		auto shutdownFn = (void(*)())(*Windows::Fn_GetProcAddress)(library, ShutdownName);
+		Assert::IsTrue(createModel && setThreadCount && shutdownFn, L"Missing interface functions in ColladaConversion.dll");
+
+		(*setThreadCount)(1);
+		auto serialModel = (*createModel)(testModel);
+		(*setThreadCount)(8);
+		auto parallelModel = (*createModel)(testModel);
+		(*setThreadCount)(0);
+
+		for (unsigned f=0; f<serializeFnCount; ++f) {
+			ModelSerializeFunction serializeFn = nullptr;
+			*(FARPROC*)&serializeFn = (*Windows::Fn_GetProcAddress)(library, serializeFnNames[f]);
+			Assert::IsTrue(serializeFn != nullptr, L"Missing serialize function in ColladaConversion.dll");
+
+			auto serialChunks = ((*serialModel).*serializeFn)();
+			auto parallelChunks = ((*parallelModel).*serializeFn)();
+
+			Assert::IsTrue(serialChunks.second > 0);
+			Assert::AreEqual(serialChunks.second, parallelChunks.second);
+			for (unsigned c=0; c<serialChunks.second; ++c) {
+				const auto& s = serialChunks.first[c];
+				const auto& p = parallelChunks.first[c];
+				Assert::IsTrue(!XlCompareMemory(&s._hdr, &p._hdr, sizeof(s._hdr)), L"Chunk headers differ between serial and parallel conversion");
+				Assert::IsTrue(s._data == p._data, L"Chunk data differs between serial and parallel conversion");
+			}
+		}
+
+			//	(release everything allocated by the DLL before unloading it)
+		serialModel.reset(); parallelModel.reset();
+		(*shutdownFn)();
+		(*Windows::FreeLibrary)(library);
+	}
+
+	#if !TARGET_64BIT
+		static const char ModelSerializeSkinName[]			= "?SerializeSkin@NascentModel@ColladaConversion@RenderCore@@QBE?AU?$pair@V?$unique_ptr@$$BY0A@VNascentChunk@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@I@std@@XZ";
+		static const char ModelSerializeAnimationName[]		= "?SerializeAnimationSet@NascentModel@ColladaConversion@RenderCore@@QBE?AU?$pair@V?$unique_ptr@$$BY0A@VNascentChunk@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@I@std@@XZ";
+	#else
+		static const char ModelSerializeSkinName[]			= "?SerializeSkin@NascentModel@ColladaConversion@RenderCore@@QEBA?AU?$pair@V?$unique_ptr@$$BY0A@VNascentChunk@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@I@std@@XZ";
+		static const char ModelSerializeAnimationName[]		= "?SerializeAnimationSet@NascentModel@ColladaConversion@RenderCore@@QEBA?AU?$pair@V?$unique_ptr@$$BY0A@VNascentChunk@ColladaConversion@RenderCore@@VCrossDLLDeletor@Internal@23@@std@@I@std@@XZ";
+	#endif
+
 	TEST_CLASS(ModelConversion)
 	{
 	public:
@@ -123,5 +378,35 @@ namespace UnitTests
 			}
 		}
 
+		TEST_METHOD(ColladaParallelSkinBinding)
+		{
+				//	Skin controllers are bound in parallel. Check that a model with
+				//	several skinned meshes serializes identically with 1 and 8 threads.
+			SetWorkingDirectory();
+			CreateDirectoryRecursive("int");
+			ConsoleRig::Logging_Startup("log.cfg", "int/unittest.txt");
+
+			const char testModel[] = "int/unittest-skinned.dae";
+			WriteSkinnedTestModel(testModel, 12, 24);
+
+			const char* serializeFns[] = { ModelSerializeSkinName };
+			CheckParallelConversionMatches(testModel, serializeFns, dimof(serializeFns));
+		}
+
+		TEST_METHOD(ColladaParallelStaticAndAnimation)
+		{
+				//	Geometry and animation curves are also converted in parallel. This
+				//	file has no skin controllers at all (like a large environment file),
+				//	so only those paths are exercised.
+			SetWorkingDirectory();
+			CreateDirectoryRecursive("int");
+			ConsoleRig::Logging_Startup("log.cfg", "int/unittest.txt");
+
+			const char testModel[] = "int/unittest-static-animated.dae";
+			WriteStaticAnimatedTestModel(testModel, 16, 16, 24);
+
+			const char* serializeFns[] = { ModelSerializeSkinName, ModelSerializeAnimationName };
+			CheckParallelConversionMatches(testModel, serializeFns, dimof(serializeFns));
+		}
 	};
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderCore/Techniques/ResourceBox.h"
+#include <CppUnitTest.h>
+#include <vector>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    class TestBox
+    {
+    public:
+        class Desc { public: unsigned _value; Desc(unsigned value) : _value(value) {} };
+        unsigned _value;
+        TestBox(const Desc& desc) : _value(desc._value) {}
+    };
+
+    class TestBoxWithHooks
+    {
+    public:
+        class Desc { public: unsigned _value; Desc(unsigned value) : _value(value) {} };
+        unsigned _value;
+        TestBoxWithHooks(const Desc& desc) : _value(desc._value) {}
+    };
+
+        //  (found by argument dependent lookup from ResourceBox.h)
+    RenderCore::Techniques::BoxEvictionPolicy GetDefaultBoxEvictionPolicy(const TestBoxWithHooks*)
+    {
+        return RenderCore::Techniques::BoxEvictionPolicy(0, 10);
+    }
+    size_t GetBoxAllocationSize(const TestBoxWithHooks& box) { return 1000 + box._value; }
+
+        //  Hash values that all start probing from the same slot (for any table
+        //  with up to 256 slots), so every lookup has to walk the probe sequence
+    static uint64 CollidingHash(unsigned index) { return uint64(index+1) << 40ull; }
+
+    TEST_CLASS(ResourceBox)
+    {
+    public:
+        TEST_METHOD(BoxTableCollisions)
+        {
+            using namespace RenderCore::Techniques;
+            Internal::BoxTable<TestBox> table;
+            const unsigned count = 100;
+            for (unsigned c=0; c<count; ++c) {
+                Assert::IsTrue(table.Find(CollidingHash(c)) == nullptr);
+                auto& box = table.Insert(CollidingHash(c), std::make_unique<TestBox>(TestBox::Desc(c)));
+                Assert::AreEqual(c, box._value);
+            }
+            for (unsigned c=0; c<count; ++c) {
+                auto* box = table.Find(CollidingHash(c));
+                Assert::IsTrue(box != nullptr);
+                Assert::AreEqual(c, box->_value);
+            }
+
+                //  Remove from the front, middle and end of the probe sequence. The
+                //  following entries are shifted back, and must still be found
+            for (unsigned c=0; c<count; c+=3)
+                table.Remove(CollidingHash(c));
+            table.Remove(CollidingHash(count+5));        // (not in the table)
+            for (unsigned c=0; c<count; ++c) {
+                auto* box = table.Find(CollidingHash(c));
+                if ((c%3) == 0) {
+                    Assert::IsTrue(box == nullptr);
+                } else {
+                    Assert::IsTrue(box != nullptr);
+                    Assert::AreEqual(c, box->_value);
+                }
+            }
+
+                //  Inserting again with an existing hash replaces the box
+            table.Insert(CollidingHash(1), std::make_unique<TestBox>(TestBox::Desc(500)));
+            Assert::AreEqual(500u, table.Find(CollidingHash(1))->_value);
+
+            auto metrics = table.GetMetrics();
+            Assert::AreEqual(count - (count+2)/3, metrics._count);
+            Assert::AreEqual(size_t(metrics._count * sizeof(TestBox)), metrics._bytes);
+            Assert::AreEqual(0u, metrics._evictions);
+        }
+
+        TEST_METHOD(BoxTableEviction)
+        {
+            using namespace RenderCore::Techniques;
+            auto oldFrameIndex = Internal::BoxFrameIndex;
+            Internal::BoxFrameIndex = 0;
+
+                //  No eviction, unless a policy is set
+            {
+                Internal::BoxTable<TestBox> table;
+                for (unsigned c=0; c<20; ++c)
+                    table.Insert(CollidingHash(c), std::make_unique<TestBox>(TestBox::Desc(c)));
+                table.OnFrameBarrier(1000);
+                Assert::AreEqual(20u, table.GetMetrics()._count);
+            }
+
+                //  Least recently used boxes are evicted first
+            {
+                Internal::BoxTable<TestBox> table;
+                table._policy = BoxEvictionPolicy(8, 0);
+                for (unsigned c=0; c<20; ++c) {
+                    Internal::BoxFrameIndex = c;
+                    table.Insert(CollidingHash(c), std::make_unique<TestBox>(TestBox::Desc(c)));
+                }
+                    // touching a box makes it recent again
+                Internal::BoxFrameIndex = 20;
+                Assert::IsTrue(table.Find(CollidingHash(0)) != nullptr);
+                table.OnFrameBarrier(21);
+
+                Assert::AreEqual(8u, table.GetMetrics()._count);
+                Assert::AreEqual(12u, table.GetMetrics()._evictions);
+                Assert::IsTrue(table.Find(CollidingHash(0)) != nullptr);
+                for (unsigned c=1; c<13; ++c)
+                    Assert::IsTrue(table.Find(CollidingHash(c)) == nullptr);
+                for (unsigned c=13; c<20; ++c)
+                    Assert::IsTrue(table.Find(CollidingHash(c)) != nullptr);
+            }
+
+                //  The default policy and allocation size come from the box type's hooks
+            {
+                Internal::BoxFrameIndex = 0;
+                Internal::BoxTable<TestBoxWithHooks> table;
+                Assert::AreEqual(10u, table._policy._maxAgeFrames);
+                for (unsigned c=0; c<4; ++c)
+                    table.Insert(CollidingHash(c), std::make_unique<TestBoxWithHooks>(TestBoxWithHooks::Desc(c)));
+                Assert::AreEqual(size_t(4000 + 0+1+2+3), table.GetMetrics()._bytes);
+
+                Internal::BoxFrameIndex = 8;
+                table.Find(CollidingHash(2));
+                table.OnFrameBarrier(11);       // (the others are now 11 frames old)
+                Assert::AreEqual(1u, table.GetMetrics()._count);
+                Assert::AreEqual(size_t(1002), table.GetMetrics()._bytes);
+                Assert::AreEqual(2u, table.Find(CollidingHash(2))->_value);
+
+                table.OnFrameBarrier(30);
+                Assert::AreEqual(0u, table.GetMetrics()._count);
+                Assert::AreEqual(size_t(0), table.GetMetrics()._bytes);
+            }
+
+            Internal::BoxFrameIndex = oldFrameIndex;
+        }
+    };
+}
+
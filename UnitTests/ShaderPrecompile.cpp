@@ -0,0 +1,106 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderCore/ShaderVariationArchive.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/Threading/ThreadingUtils.h"
+#include "../Core/Exceptions.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Stand-in for the platform shader compiler. The "byte code" is just
+        //  the initializer and defines table, so we can check that the right
+        //  byte code comes back out of the archive.
+    class StubShaderCompiler : public RenderCore::IShaderVariationCompiler
+    {
+    public:
+        std::vector<uint8> Compile(const RenderCore::ShaderVariationDesc& variation) const
+        {
+            Interlocked::Increment(&_compileCount);
+            if (variation._initializer.find("broken") != std::string::npos) {
+                ThrowException(::Exceptions::BasicLabel("Syntax error"));
+            }
+            auto str = variation._initializer + "|" + variation._definesTable;
+            return std::vector<uint8>(str.begin(), str.end());
+        }
+
+        mutable Interlocked::Value _compileCount;
+        StubShaderCompiler() : _compileCount(0) {}
+    };
+
+    static std::string AsString(const RenderCore::ShaderVariationArchive::Block& block)
+    {
+        return std::string((const char*)block._data, (const char*)block._data + block._size);
+    }
+
+    TEST_CLASS(ShaderPrecompile)
+    {
+    public:
+        TEST_METHOD(PrecompileAndLookup)
+        {
+            using namespace RenderCore;
+
+            std::vector<ShaderVariationDesc> variations;
+            for (unsigned c=0; c<200; ++c) {
+                StringMeld<64> defines;
+                defines << "SKIN=" << c%2 << ";LIGHTS=" << c/2;
+                variations.push_back(ShaderVariationDesc("game/xleres/forward.psh:main:ps_*", defines));
+            }
+            variations.push_back(variations[7]);        // duplicates should only be compiled once
+            variations.push_back(ShaderVariationDesc("game/xleres/broken.psh:main:ps_*", ""));
+
+            StubShaderCompiler compiler;
+            ShaderVariationArchiveWriter writer;
+            auto result = PrecompileShaderVariations(
+                writer, AsPointer(variations.cbegin()), variations.size(), compiler, 4);
+
+            Assert::AreEqual(201, int(compiler._compileCount));
+            Assert::AreEqual(200u, unsigned(writer.GetVariationCount()));
+            Assert::AreEqual(size_t(1), result._failures.size());
+            Assert::IsTrue(result._failures[0].first._initializer == "game/xleres/broken.psh:main:ps_*");
+
+            auto block = writer.BuildMemoryBlock();
+            auto memoryBlock = std::make_unique<uint8[]>(block.size());
+            XlCopyMemory(memoryBlock.get(), AsPointer(block.cbegin()), block.size());
+            ShaderVariationArchive archive(std::move(memoryBlock), block.size());
+
+            Assert::AreEqual(200u, archive.GetVariationCount());
+            for (unsigned c=0; c<200; ++c) {
+                auto found = archive.Find(MakeShaderVariationHash(variations[c]._initializer.c_str(), variations[c]._definesTable.c_str()));
+                Assert::IsNotNull(found._data);
+                Assert::IsTrue(AsString(found) == variations[c]._initializer + "|" + variations[c]._definesTable);
+            }
+
+            Assert::IsFalse(archive.HasItem(variations[201].GetHash()));
+            Assert::IsFalse(archive.HasItem(MakeShaderVariationHash("game/xleres/forward.psh:main:ps_*", "SKIN=2")));
+
+                //  a null defines table should be the same as an empty one
+            Assert::AreEqual(
+                MakeShaderVariationHash("game/xleres/forward.psh:main:ps_*", nullptr),
+                MakeShaderVariationHash("game/xleres/forward.psh:main:ps_*", ""));
+        }
+
+        TEST_METHOD(RejectCorruptArchive)
+        {
+            using namespace RenderCore;
+            auto memoryBlock = std::make_unique<uint8[]>(64);
+            XlSetMemory(memoryBlock.get(), 0xcd, 64);
+            bool gotException = false;
+            try {
+                ShaderVariationArchive archive(std::move(memoryBlock), 64);
+            } catch (const std::exception&) {
+                gotException = true;
+            }
+            Assert::IsTrue(gotException);
+        }
+    };
+}
+
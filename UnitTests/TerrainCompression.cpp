@@ -0,0 +1,185 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../SceneEngine/TerrainCompression.h"
+#include "../SceneEngine/TerrainInternal.h"
+#include "../Math/Transformations.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace SceneEngine;
+
+        //  Build a node's worth of height values. Each row uses a different kind of
+        //  data, so that a single node contains rows with very different residual
+        //  bit widths (including rows that need no bits at all, and rows that need
+        //  more than 16 bits).
+    static std::vector<uint16> BuildMixedHeights(unsigned dimension, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::vector<uint16> result(dimension*dimension);
+        for (unsigned y=0; y<dimension; ++y) {
+            uint16* row = &result[y*dimension];
+            switch (y % 6) {
+            case 0:     // flat at the top of the range
+                std::fill(row, row+dimension, uint16(0xffff));
+                break;
+            case 1:     // flat at the bottom of the range
+                std::fill(row, row+dimension, uint16(0));
+                break;
+            case 2:     // alternating extremes (largest possible residuals)
+                for (unsigned x=0; x<dimension; ++x) row[x] = (x&1) ? uint16(0xffff) : uint16(0);
+                break;
+            case 3:     // steep slope
+                for (unsigned x=0; x<dimension; ++x) row[x] = uint16(std::min(0xffffu, 1000u * x + 5u * y));
+                break;
+            case 4:     // gentle noise
+                for (unsigned x=0; x<dimension; ++x) row[x] = uint16(30000 + (rng() % 64));
+                break;
+            default:    // full range noise
+                for (unsigned x=0; x<dimension; ++x) row[x] = uint16(rng() & 0xffff);
+                break;
+            }
+        }
+        return result;
+    }
+
+    TEST_CLASS(TerrainCompression)
+    {
+    public:
+        TEST_METHOD(PredictiveRoundTrip)
+        {
+            const unsigned dimensions[] = { 1, 2, 33, 34, 65 };
+            for (unsigned d=0; d<dimof(dimensions); ++d) {
+                const unsigned dimension = dimensions[d];
+                auto input = BuildMixedHeights(dimension, dimension);
+
+                auto encoded = SceneEngine::TerrainCompression::EncodePredictive(AsPointer(input.cbegin()), dimension, 1);
+                std::vector<uint16> decoded(dimension*dimension, 0xcdcd);
+                Assert::IsTrue(SceneEngine::TerrainCompression::DecodePredictive(
+                    AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), encoded.size()));
+
+                    // a quantization step of 1 must be lossless
+                Assert::IsTrue(input == decoded);
+            }
+
+                //  Smooth data should compress well (a plane is predicted exactly, except
+                //  along the first row and column)
+            {
+                const unsigned dimension = 65;
+                std::vector<uint16> plane(dimension*dimension);
+                for (unsigned y=0; y<dimension; ++y)
+                    for (unsigned x=0; x<dimension; ++x)
+                        plane[y*dimension+x] = uint16(20000 + 37*x + 11*y);
+                auto encoded = SceneEngine::TerrainCompression::EncodePredictive(AsPointer(plane.cbegin()), dimension, 1);
+                Assert::IsTrue(encoded.size() < plane.size() * sizeof(uint16) / 2);
+
+                std::vector<uint16> decoded(dimension*dimension);
+                Assert::IsTrue(SceneEngine::TerrainCompression::DecodePredictive(
+                    AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), encoded.size()));
+                Assert::IsTrue(plane == decoded);
+            }
+        }
+
+        TEST_METHOD(PredictiveErrorBound)
+        {
+            const unsigned dimension = 33;
+            auto input = BuildMixedHeights(dimension, 12345);
+
+            const unsigned steps[] = { 2, 3, 7, 64, 1000, 0xffff };
+            for (unsigned s=0; s<dimof(steps); ++s) {
+                auto encoded = SceneEngine::TerrainCompression::EncodePredictive(AsPointer(input.cbegin()), dimension, steps[s]);
+                std::vector<uint16> decoded(dimension*dimension);
+                Assert::IsTrue(SceneEngine::TerrainCompression::DecodePredictive(
+                    AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), encoded.size()));
+
+                    //  every value must be within half a step of the input (and
+                    //  the extremes of the range must not wrap around)
+                for (unsigned c=0; c<dimension*dimension; ++c) {
+                    int error = std::abs(int(decoded[c]) - int(input[c]));
+                    Assert::IsTrue(unsigned(error) <= steps[s]/2);
+                }
+            }
+
+                // the step calculation must honour the error bound, and never return 0
+            Assert::AreEqual(1u, SceneEngine::TerrainCompression::CalculateQuantizationStep(0.f, 1.f));
+            Assert::AreEqual(1u, SceneEngine::TerrainCompression::CalculateQuantizationStep(1.f, 0.f));
+            Assert::AreEqual(4u, SceneEngine::TerrainCompression::CalculateQuantizationStep(.5f, .25f));
+            Assert::AreEqual(0xffffu, SceneEngine::TerrainCompression::CalculateQuantizationStep(1e9f, 1.f));
+        }
+
+        TEST_METHOD(PredictiveRejectsBadData)
+        {
+            const unsigned dimension = 33;
+            auto input = BuildMixedHeights(dimension, 7);
+            auto encoded = SceneEngine::TerrainCompression::EncodePredictive(AsPointer(input.cbegin()), dimension, 1);
+            std::vector<uint16> decoded(dimension*dimension);
+
+                // wrong dimension
+            Assert::IsFalse(SceneEngine::TerrainCompression::DecodePredictive(
+                AsPointer(decoded.begin()), dimension+1, AsPointer(encoded.cbegin()), encoded.size()));
+
+                // truncated (header only, row table only, and missing the last word of the bitstream)
+            Assert::IsFalse(SceneEngine::TerrainCompression::DecodePredictive(AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), 2));
+            Assert::IsFalse(SceneEngine::TerrainCompression::DecodePredictive(AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), 4 + 36));
+            Assert::IsFalse(SceneEngine::TerrainCompression::DecodePredictive(AsPointer(decoded.begin()), dimension, AsPointer(encoded.cbegin()), encoded.size()-4));
+
+                // impossible row bit width
+            auto corrupt = encoded;
+            corrupt[4] = 33;
+            Assert::IsFalse(SceneEngine::TerrainCompression::DecodePredictive(
+                AsPointer(decoded.begin()), dimension, AsPointer(corrupt.cbegin()), corrupt.size()));
+        }
+
+        TEST_METHOD(LoadMixedNodeEncodings)
+        {
+                //  Write a file containing raw and predictive nodes next to each other
+                //  (as in a partially recompressed cell) and load them back through the
+                //  same path used by collisions and the uber-surface.
+            const unsigned dimension = 33;
+            const char filename[] = "TerrainCompressionTest.dat";
+            std::vector<std::vector<uint16>> heights;
+            std::vector<std::unique_ptr<TerrainCell::Node>> nodes;
+            {
+                BasicFile file(filename, "wb");
+                size_t offset = 0;
+                for (unsigned n=0; n<6; ++n) {
+                    heights.push_back(BuildMixedHeights(dimension, 100+n));
+                    const auto& h = heights[n];
+                    const bool predictive = (n%2) != 0;
+
+                    size_t size;
+                    if (predictive) {
+                        auto encoded = SceneEngine::TerrainCompression::EncodePredictive(AsPointer(h.cbegin()), dimension, 1);
+                        file.Write(AsPointer(encoded.cbegin()), 1, encoded.size());
+                        size = encoded.size();
+                    } else {
+                        size = h.size() * sizeof(uint16);
+                        file.Write(AsPointer(h.cbegin()), 1, size);
+                    }
+
+                    auto node = std::make_unique<TerrainCell::Node>(Identity<Float4x4>(), offset, size, dimension);
+                    node->_encoding = predictive ? TerrainCell::Node::Encoding::Predictive : TerrainCell::Node::Encoding::Raw;
+                    nodes.push_back(std::move(node));
+                    offset += size;
+                }
+            }
+
+            BasicFile file(filename, "rb");
+            for (unsigned n=0; n<unsigned(nodes.size()); ++n) {
+                std::vector<uint16> decoded(dimension*dimension);
+                Assert::IsTrue(SceneEngine::TerrainCompression::LoadNodeHeights(AsPointer(decoded.begin()), *nodes[n], file, nullptr));
+                Assert::IsTrue(heights[n] == decoded);
+            }
+        }
+    };
+}
+
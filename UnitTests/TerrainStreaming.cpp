@@ -0,0 +1,196 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../SceneEngine/TerrainStreaming.h"
+#include "../SceneEngine/TerrainInternal.h"
+#include "../Math/Transformations.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Synthetic terrain cell, written to disk in the same breadth-first node
+        //  layout used by the native terrain format. Every element of a node contains
+        //  the node index, so we can verify that the right data was read.
+    class SyntheticTerrainCell : public SceneEngine::TerrainCell
+    {
+    public:
+        static const unsigned NodeWidth = 33;
+
+        SyntheticTerrainCell(const char filename[], unsigned treeDepth, float cellSize)
+        {
+            BasicFile file(filename, "wb");
+            std::vector<uint16> nodeData(NodeWidth*NodeWidth);
+
+            size_t offset = 0;
+            unsigned nodeCount = 0;
+            for (unsigned l=0; l<treeDepth; ++l) {
+                unsigned fieldNodeCount = (1<<l) * (1<<l);
+                _nodeFields.push_back(NodeField(1<<l, 1<<l, nodeCount, nodeCount + fieldNodeCount));
+
+                float xyDim = std::pow(2.f, -float(l));
+                for (unsigned y=0; y<(1u<<l); ++y)
+                    for (unsigned x=0; x<(1u<<l); ++x, ++nodeCount) {
+                        std::fill(nodeData.begin(), nodeData.end(), uint16(nodeCount));
+                        file.Write(AsPointer(nodeData.begin()), sizeof(uint16), nodeData.size());
+
+                        Float4x4 localToCell(
+                            cellSize * xyDim, 0.f, 0.f, cellSize * float(x) * xyDim,
+                            0.f, cellSize * xyDim, 0.f, cellSize * float(y) * xyDim,
+                            0.f, 0.f, 1.f / float(0xffff), 0.f,
+                            0.f, 0.f, 0.f, 1.f);
+                        size_t size = nodeData.size() * sizeof(uint16);
+                        _nodes.push_back(std::make_unique<Node>(localToCell, offset, size, NodeWidth));
+                        offset += size;
+                    }
+            }
+
+            _sourceFileName = filename;
+        }
+    };
+
+    TEST_CLASS(TerrainStreaming)
+    {
+    public:
+        TEST_METHOD(ReplayCameraPath)
+        {
+            const unsigned treeDepth = 5;
+            SyntheticTerrainCell cell("TerrainStreamingTest.dat", treeDepth, 1024.f);
+            const size_t nodeBytes = SyntheticTerrainCell::NodeWidth * SyntheticTerrainCell::NodeWidth * sizeof(uint16);
+
+            SceneEngine::TerrainResidencyManager::Desc desc;
+            desc._residentByteLimit = 128 * nodeBytes;
+            desc._frameReadBudget = 8 * nodeBytes;
+            desc._maxBytesInFlight = 16 * nodeBytes;
+            desc._lodErrorThreshold = 8.f;
+            SceneEngine::TerrainResidencyManager manager(desc);
+            auto cellId = manager.AddCell(cell, Identity<Float4x4>());
+
+                //  Fly diagonally across the cell, close to the ground. Each frame, we
+                //  look up the data for the nodes that are wanted, as the renderer would.
+            const unsigned frameCount = 200;
+            const float lodErrorScale = 100.f;
+            Float3 start(-64.f, -64.f, 16.f), end(1088.f, 1088.f, 16.f);
+            Float3 velocity = (end - start) / (float(frameCount) / 60.f);
+            for (unsigned f=0; f<frameCount; ++f) {
+                Float3 cameraPosition = start + (end - start) * (float(f) / float(frameCount-1));
+                manager.Update(cameraPosition, velocity, lodErrorScale);
+
+                for (unsigned n=0; n<unsigned(cell._nodes.size()); ++n) {
+                    if (!manager.IsWanted(cellId, n)) continue;
+                    auto data = manager.GetNodeData(cellId, n);
+                    if (data._data) {
+                        Assert::AreEqual(unsigned(nodeBytes), unsigned(data._size));
+                        Assert::AreEqual(unsigned(n), unsigned(((const uint16*)data._data)[0]));
+                    }
+                }
+
+                auto metrics = manager.GetMetrics();
+                Assert::IsTrue(metrics._bytesResident + metrics._bytesInFlight <= desc._residentByteLimit);
+                Assert::IsTrue(metrics._bytesReadThisFrame <= desc._frameReadBudget);
+
+                    //  Let the reads for this frame finish before the next one (as if the
+                    //  disk was keeping up with the frame rate). Otherwise the results of the
+                    //  test would depend on the timing of the background thread.
+                manager.Flush();
+            }
+
+            manager.Flush();
+            auto metrics = manager.GetMetrics();
+            Assert::AreEqual(0u, unsigned(metrics._bytesInFlight));
+            Assert::AreEqual(0u, metrics._readFailures);
+            Assert::IsTrue(metrics._evictions > 0);
+            Assert::IsTrue(metrics.HitRate() > .5f);
+
+                // the root node is always wanted, and should never be evicted
+            Assert::IsTrue(manager.IsResident(cellId, 0));
+
+                // stalling lookups should always return data
+            auto data = manager.GetNodeData(cellId, unsigned(cell._nodes.size()-1), true);
+            Assert::IsTrue(data._data != nullptr);
+            Assert::AreEqual(unsigned(cell._nodes.size()-1), unsigned(((const uint16*)data._data)[0]));
+        }
+
+        TEST_METHOD(StallKeepsReturnedData)
+        {
+            const unsigned treeDepth = 4;
+            SyntheticTerrainCell cell("TerrainStreamingTest.dat", treeDepth, 1024.f);
+            const size_t nodeBytes = SyntheticTerrainCell::NodeWidth * SyntheticTerrainCell::NodeWidth * sizeof(uint16);
+
+            SceneEngine::TerrainResidencyManager::Desc desc;
+            desc._residentByteLimit = 4 * nodeBytes;
+            SceneEngine::TerrainResidencyManager manager(desc);
+            auto cellId = manager.AddCell(cell, Identity<Float4x4>());
+
+                //  Stall on more nodes than can fit within the limit. Everything returned
+                //  within a frame must stay valid until the next Update()
+            const Float3 farCamera(512.f, 512.f, 100000.f);
+            manager.Update(farCamera, Zero<Float3>(), 100.f);
+            manager.Flush();
+
+            std::vector<std::pair<unsigned, const uint16*>> returned;
+            for (unsigned n=unsigned(cell._nodes.size())-12; n<unsigned(cell._nodes.size()); ++n) {
+                auto data = manager.GetNodeData(cellId, n, true);
+                Assert::IsTrue(data._data != nullptr);
+                returned.push_back(std::make_pair(n, (const uint16*)data._data));
+            }
+            for (auto i=returned.begin(); i!=returned.end(); ++i) {
+                Assert::IsTrue(manager.IsResident(cellId, i->first));
+                Assert::AreEqual(i->first, unsigned(i->second[0]));
+                Assert::AreEqual(i->first, unsigned(i->second[SyntheticTerrainCell::NodeWidth*SyntheticTerrainCell::NodeWidth-1]));
+            }
+
+                // the next update should bring us back within the limit
+            manager.Update(farCamera, Zero<Float3>(), 100.f);
+            auto metrics = manager.GetMetrics();
+            Assert::IsTrue(metrics._bytesResident + metrics._bytesInFlight <= desc._residentByteLimit);
+            Assert::IsTrue(metrics._evictions > 0);
+            manager.Flush();
+        }
+
+        TEST_METHOD(StallDuringPendingRead)
+        {
+            const unsigned treeDepth = 4;
+            SyntheticTerrainCell cell("TerrainStreamingTest.dat", treeDepth, 1024.f);
+            const size_t nodeBytes = SyntheticTerrainCell::NodeWidth * SyntheticTerrainCell::NodeWidth * sizeof(uint16);
+
+            SceneEngine::TerrainResidencyManager manager;
+            auto cellId = manager.AddCell(cell, Identity<Float4x4>());
+
+                //  The first update issues background reads, including the root node.
+                //  Those reads can't be completed until the next Update() or Flush(), so
+                //  a stalling lookup now must replace the in-flight read.
+            const Float3 camera(512.f, 512.f, 64.f);
+            manager.Update(camera, Zero<Float3>(), 100.f);
+            Assert::IsFalse(manager.IsResident(cellId, 0));
+            Assert::IsTrue(manager.GetMetrics()._bytesInFlight > 0);
+
+            auto data = manager.GetNodeData(cellId, 0, true);
+            Assert::IsTrue(data._data != nullptr);
+            Assert::AreEqual(0u, unsigned(((const uint16*)data._data)[0]));
+
+            manager.Flush();
+            manager.Update(camera, Zero<Float3>(), 100.f);
+            manager.Flush();
+
+                //  The abandoned read must not have replaced the data, or been counted
+                //  twice in the resident total
+            Assert::IsTrue(manager.IsResident(cellId, 0));
+            unsigned residentCount = 0;
+            for (unsigned n=0; n<unsigned(cell._nodes.size()); ++n)
+                if (manager.IsResident(cellId, n)) ++residentCount;
+            auto metrics = manager.GetMetrics();
+            Assert::AreEqual(0u, unsigned(metrics._bytesInFlight));
+            Assert::AreEqual(unsigned(residentCount * nodeBytes), unsigned(metrics._bytesResident));
+            Assert::AreEqual(0u, metrics._readFailures);
+            Assert::AreEqual(1u, metrics._stalls);
+        }
+    };
+}
+
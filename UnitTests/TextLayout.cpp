@@ -0,0 +1,203 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../RenderOverlays/TextLayout.h"
+#include "../RenderOverlays/Font.h"
+#include "../Utility/StringUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Font with fixed metrics, and no dependencies on FreeType or the device.
+        //  "W" is wide, and the pair "AV" is kerned, so that layout depends on
+        //  the order of characters (not just the character counts).
+    class FixedMetricsFont : public RenderOverlays::Font
+    {
+    public:
+        std::pair<const RenderOverlays::FontChar*, const RenderOverlays::FontTexture2D*> GetChar(ucs4 ch) const
+        {
+            auto i = _chars.find(ch);
+            if (i == _chars.end()) {
+                RenderOverlays::FontChar fc(ch);
+                fc.xAdvance = _advance * ((ch == 'W') ? 2.f : 1.f);
+                i = _chars.insert(std::make_pair(ch, fc)).first;
+            }
+            return std::make_pair(&i->second, (const RenderOverlays::FontTexture2D*)nullptr);
+        }
+
+        float Descent() const { return 2.f; }
+        float Ascent(bool) const { return 8.f; }
+        float LineHeight() const { return 10.f; }
+        RenderOverlays::FontTexKind GetTexKind() { return RenderOverlays::FTK_GENERAL; }
+        Float2 GetKerning(int prevGlyph, ucs4 ch, int* curGlyph) const
+        {
+            if (curGlyph) *curGlyph = int(ch);
+            return Float2((prevGlyph == 'A' && ch == 'V') ? -1.5f : 0.f, 0.f);
+        }
+
+        FixedMetricsFont(const char path[], int size, float advance) : _advance(advance)
+        {
+            XlCopyString(_path, path);
+            _size = size;
+        }
+
+    protected:
+        RenderOverlays::FontCharID CreateFontChar(ucs4) const { return 0; }
+        void DeleteFontChar(RenderOverlays::FontCharID) {}
+        float GetKerning(ucs4 prev, ucs4 ch) const { return GetKerning(int(prev), ch, nullptr)[0]; }
+
+        float _advance;
+        mutable std::map<ucs4, RenderOverlays::FontChar> _chars;
+    };
+
+    static std::vector<ucs4> AsUCS4(const char str[])
+    {
+        std::vector<ucs4> result;
+        while (*str) result.push_back(ucs4(*str++));
+        result.push_back(0);
+        return result;
+    }
+
+        //  The original per-character implementation of Font::StringEllipsis,
+        //  used as a reference. Returns the number of characters kept before the
+        //  ellipsis (or ~0 if the string fits).
+    static size_t ReferenceEllipsisPoint(RenderOverlays::Font& font, const ucs4* inText, float width, float spaceExtra, bool outline, float& x)
+    {
+        int prevGlyph = 0;
+        x = 0.0f;
+        for (uint32 i = 0 ; inText[i]; ++i) {
+            ucs4 ch = inText[i];
+            if (ch == '\n') continue;
+
+            int curGlyph;
+            x += font.GetKerning(prevGlyph, ch, &curGlyph)[0];
+            prevGlyph = curGlyph;
+
+            const RenderOverlays::FontChar* fc = font.GetChar(ch).first;
+            if (fc) {
+                x += fc->xAdvance;
+                if (outline) x += 2.0f;
+                if (ch == ' ') x += spaceExtra;
+            }
+
+            if (x > width) return std::max(size_t(i), size_t(1));
+        }
+        return ~size_t(0);
+    }
+
+    TEST_CLASS(TextLayout)
+    {
+    public:
+        TEST_METHOD(RunCacheKey)
+        {
+            using namespace RenderOverlays;
+            TextRunCache cache(2, 64);
+            FixedMetricsFont font("fonts/a.ttf", 12, 5.f), biggerFont("fonts/a.ttf", 16, 7.f), otherFont("fonts/b.ttf", 12, 6.f);
+
+            auto text = AsUCS4("AVW x"), text2 = AsUCS4("AVW y");
+            const float expectedWidth = 5.f - 1.5f + 5.f + 10.f + 5.f + 5.f;
+            Assert::AreEqual(expectedWidth, cache.GetRun(font, text.data())._width);
+            Assert::AreEqual(expectedWidth, cache.GetRun(font, text.data())._width);
+            Assert::AreEqual(1u, cache.GetMetrics()._hits);
+
+                //  Every part of the key must select a different run
+            Assert::AreEqual(expectedWidth, cache.GetRun(font, text2.data())._width);
+            Assert::AreEqual(expectedWidth + 3.f, cache.GetRun(font, text.data(), -1, 3.f)._width);
+            Assert::AreEqual(expectedWidth + 10.f, cache.GetRun(font, text.data(), -1, 0.f, true)._width);
+            Assert::AreEqual(7.f - 1.5f + 7.f + 14.f + 7.f + 7.f, cache.GetRun(biggerFont, text.data())._width);
+            Assert::AreEqual(6.f - 1.5f + 6.f + 12.f + 6.f + 6.f, cache.GetRun(otherFont, text.data())._width);
+            Assert::AreEqual(5.f - 1.5f + 5.f, cache.GetRun(font, text.data(), 2)._width);
+
+            auto metrics = cache.GetMetrics();
+            Assert::AreEqual(1u, metrics._hits);
+            Assert::AreEqual(7u, metrics._runCount);
+            Assert::AreEqual(0u, metrics._collisions);
+
+                //  Runs not used for more than 2 frames are evicted
+            cache.OnFrameBarrier();
+            cache.GetRun(font, text.data());
+            cache.OnFrameBarrier();
+            cache.OnFrameBarrier();
+            Assert::AreEqual(1u, cache.GetMetrics()._runCount);
+            Assert::AreEqual(6u, cache.GetMetrics()._evictions);
+        }
+
+        TEST_METHOD(RunCacheCollisions)
+        {
+                //  With only 1 bit of hash, most strings collide. Colliding strings
+                //  must never be given each other's runs, and must not replace the
+                //  cached entry.
+            using namespace RenderOverlays;
+            TextRunCache cache(8, 64, 1);
+            FixedMetricsFont font("fonts/a.ttf", 12, 5.f);
+
+            std::vector<std::vector<ucs4>> strings;
+            for (unsigned c=1; c<=16; ++c)
+                strings.push_back(AsUCS4(std::string(c, (c&1) ? 'W' : 'x').c_str()));
+
+            for (unsigned pass=0; pass<3; ++pass) {
+                for (unsigned c=0; c<unsigned(strings.size()); ++c) {
+                    float expected = float(c+1) * (((c+1)&1) ? 10.f : 5.f);
+                    auto& run = cache.GetRun(font, strings[c].data());
+                    Assert::AreEqual(expected, run._width);
+                    Assert::AreEqual(unsigned(c+1), unsigned(run._glyphs.size()));
+                }
+            }
+
+            auto metrics = cache.GetMetrics();
+            Assert::IsTrue(metrics._runCount <= 2);
+            Assert::IsTrue(metrics._collisions > 0);
+            Assert::AreEqual(metrics._lookups, metrics._hits + metrics._collisions + metrics._runCount);
+        }
+
+        TEST_METHOD(StringEllipsis)
+        {
+            FixedMetricsFont font("fonts/a.ttf", 12, 5.f);
+            const char* strings[] = { "AVWAVW some text", "a\nb\nc\nd\ne", "W", "\n\nAVAVAV", "no truncation" };
+            const float widths[] = { 1.f, 4.9f, 5.f, 8.5f, 13.f, 20.f, 33.5f, 50.f, 1000.f };
+            const float spaceExtras[] = { 0.f, 2.f };
+
+            for (unsigned s=0; s<dimof(strings); ++s)
+                for (unsigned w=0; w<dimof(widths); ++w)
+                    for (unsigned e=0; e<dimof(spaceExtras); ++e)
+                        for (unsigned o=0; o<2; ++o) {
+                            auto text = AsUCS4(strings[s]);
+                            float refX;
+                            auto refCount = ReferenceEllipsisPoint(font, text.data(), widths[w], spaceExtras[e], o!=0, refX);
+
+                            ucs4 output[64];
+                            std::fill(output, &output[dimof(output)], ucs4(0xcdcd));
+                            float result = font.StringEllipsis(text.data(), output, dimof(output), widths[w], spaceExtras[e], o!=0);
+
+                            if (refCount == ~size_t(0)) {
+                                    //  the string fits; the output isn't touched
+                                Assert::AreEqual(refX, result);
+                                Assert::AreEqual(unsigned(0xcdcd), unsigned(output[0]));
+                            } else {
+                                    //  the first "refCount-1" characters, followed by ".."
+                                std::vector<ucs4> expected(text.begin(), text.begin() + (refCount-1));
+                                expected.push_back('.'); expected.push_back('.'); expected.push_back(0);
+                                Assert::IsTrue(std::equal(expected.begin(), expected.end(), output));
+                                Assert::AreEqual(font.StringWidth(expected.data(), -1, spaceExtras[e], o!=0), result);
+                            }
+                        }
+
+                //  An output buffer too small for the ellipsis isn't written to
+            auto text = AsUCS4("WWWWWWWW");
+            ucs4 output[3] = { 0xcdcd, 0xcdcd, 0xcdcd };
+            float result = font.StringEllipsis(text.data(), output, 3, 25.f);
+            Assert::AreEqual(30.f, result);
+            Assert::AreEqual(unsigned(0xcdcd), unsigned(output[0]));
+        }
+    };
+}
+
@@ -0,0 +1,897 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../Utility/UTFUtils.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/StringFormat.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  The scalar conversions from before the SSE2 fast paths were added, kept as a
+        //  reference for the tests below. They're copied as they were, except for the
+        //  changes marked "(fixed)", which are the bug fixes that came with the new code.
+        //  The other fixes don't need changes here:
+        //      * UCE_ILLEGAL used to have the same value as UCE_DST_EXHAUSTED (these use
+        //        the values in the current header)
+        //      * terminators could be written one past "dl" (the tests never give these
+        //        functions a destination that can fill up)
+    namespace ScalarUTF
+    {
+
+#define UNI_SUR_HIGH_START  (ucs4)0xD800
+#define UNI_SUR_HIGH_END    (ucs4)0xDBFF
+#define UNI_SUR_LOW_START   (ucs4)0xDC00
+#define UNI_SUR_LOW_END     (ucs4)0xDFFF
+
+static const int HALF_SHIFT  = 10;
+static const ucs4 HALF_BASE = 0x00010000UL;
+static const ucs4 HALF_MASK = 0x000003FFUL;
+
+static const uint32 _offsets_magic[6] =
+{
+    0x00000000UL, 0x00003080UL, 0x000E2080UL,
+    0x03C82080UL, 0xFA082080UL, 0x82082080UL
+};
+
+static const utf8 _trailing_bytes[256] =
+{
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+    1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+    2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2, 3,3,3,3,3,3,3,3,4,4,4,4,5,5,5,5
+};
+
+#pragma warning(push)
+#pragma warning(disable:4127)       // warning C4127: conditional expression is constant
+
+static bool IsValid(const utf8* src, size_t len)
+{
+    utf8 a;
+    const utf8* srcptr = src + len;
+    switch (len) {
+    default: return false;
+    // everything else falls through when "true"...
+    case 4: if ((a = (*--srcptr)) < 0x80 || a > 0xBF) return false;
+    case 3: if ((a = (*--srcptr)) < 0x80 || a > 0xBF) return false;
+    case 2: if ((a = (*--srcptr)) > 0xBF) return false;
+
+    switch (*src) {
+        case 0xE0: if (a < 0xA0) return false;
+            break;
+        case 0xED: if ((a < 0x80) || (a > 0x9F)) return false;
+            break;
+        case 0xF0: if (a < 0x90) return false;
+            break;
+        case 0xF4: if ((a < 0x80) || (a > 0x8F)) return false;     // (fixed: "F4 xx" used to accept any xx below 0x90)
+            break;
+        default:   if (a < 0x80) return false;
+    }
+
+    case 1: if (*src >= 0x80 && *src < 0xC2) return false;
+    }
+    if (*src > 0xF4) return false;
+    return true;
+}
+
+static int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl)
+{
+    ucs4 ch;
+    int nb;
+
+    const utf8* s = src;
+    const utf8* se = src + sl;
+    const ucs4* de = dst + dl;
+    ucs4* d = dst;
+
+    ucs_conv_error err = UCE_OK;
+
+    while (s < se) {
+        nb = _trailing_bytes[*s];           // (fixed: read from "s", which never used to advance)
+        if (s + nb >= se) {
+            err = UCE_SRC_EXHAUSTED;
+            break;
+        }
+
+        if (!IsValid(s, nb + 1)) {
+            err =  UCE_ILLEGAL;
+            break;
+        }
+
+        ch = 0;
+        switch (nb) {
+        case 3: ch += *s++; ch <<= 6;
+        case 2: ch += *s++; ch <<= 6;
+        case 1: ch += *s++; ch <<= 6;
+        case 0: ch += *s++;
+        }
+
+        ch -= _offsets_magic[nb];
+
+        if (d >= de) {
+            s -= (nb + 1);
+            err = UCE_DST_EXHAUSTED;
+            break;
+        }
+
+        if (ch == 0) {
+            break;
+        }
+        *d++ = ch;
+    }
+
+    *d = '\0';
+
+    if (err != UCE_OK) {
+        return err;
+    }
+
+    return (int)(d - dst);
+}
+
+static int ucs2_2_utf8(const ucs2* src, size_t sl, utf8* dst, size_t dl)
+{
+    ucs4 ch;
+    size_t i = 0;
+    const utf8* dend = dst + dl;
+
+    while (i < sl) {
+        ch = src[i];
+        if (ch == 0) {
+            break;
+        }
+            // (fixed: surrogate pairs used to be written as 2 separate 3 byte sequences)
+        if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_HIGH_END && (i+1) < sl
+            && src[i+1] >= UNI_SUR_LOW_START && src[i+1] <= UNI_SUR_LOW_END) {
+            ch = ((ch - UNI_SUR_HIGH_START) << HALF_SHIFT) + (src[i+1] - UNI_SUR_LOW_START) + HALF_BASE;
+            ++i;
+        }
+        if (ch < 0x80) {
+            if (dst >= dend) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = (utf8)ch;
+        }
+        else if (ch < 0x800) {
+            if (dst >= dend - 1) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8((ch >> 6) | 0xC0);
+            *dst++ = utf8((ch & 0x3F) | 0x80);
+        }
+        else if (ch < 0x10000) {
+            if (dst >= dend - 2) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8((ch>>12) | 0xE0);
+            *dst++ = utf8(((ch>>6) & 0x3F) | 0x80);
+            *dst++ = utf8((ch & 0x3F) | 0x80);
+        }
+        else if (ch < 0x110000) {
+            if (dst >= dend - 3) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8((ch>>18) | 0xF0);
+            *dst++ = utf8(((ch>>12) & 0x3F) | 0x80);
+            *dst++ = utf8(((ch>>6) & 0x3F) | 0x80);
+            *dst++ = utf8((ch & 0x3F) | 0x80);
+        }
+        i++;
+    }
+
+    if (dst < dend) {
+        *dst = '\0';
+    }
+    return (int)i;
+}
+
+static int ucs4_2_utf8(const ucs4* src, size_t sl, utf8* dst, size_t dl)
+{
+    ucs4 ch;
+    size_t i = 0;
+    const utf8* dend = dst + dl;
+
+    while (i < sl) {
+        ch = src[i];
+
+        if (ch < 0x80) {
+            if (dst >= dend) {
+                return UCE_DST_EXHAUSTED;
+            }
+            if (ch == 0) {
+                break;
+            }
+            *dst++ = utf8(ch);
+        }
+        else if (ch >= 0x80  && ch < 0x800) {
+            if (dst >= dend - 1) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8((ch >> 6)   | 0xC0);
+            *dst++ = utf8((ch & 0x3F) | 0x80);
+        }
+        else if (ch >= 0x800 && ch < 0x10000) {     // (fixed: 0xFFFF used to be dropped)
+            if (dst >= dend - 2) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8(((ch >> 12)       ) | 0xE0);
+            *dst++ = utf8(((ch >> 6 ) & 0x3F) | 0x80);
+            *dst++ = utf8(((ch      ) & 0x3F) | 0x80);
+        }
+        else if (ch >= 0x10000 && ch < 0x110000) {  // (fixed: code points above the BMP used to be dropped)
+            if (dst >= dend - 3) {
+                return UCE_DST_EXHAUSTED;
+            }
+            *dst++ = utf8((ch >> 18) | 0xF0);
+            *dst++ = utf8(((ch >> 12) & 0x3F) | 0x80);
+            *dst++ = utf8(((ch >> 6 ) & 0x3F) | 0x80);
+            *dst++ = utf8(((ch      ) & 0x3F) | 0x80);
+        }
+        i++;
+    }
+
+    if (dst < dend) {
+        *dst = '\0';
+    }
+    return (int)i;
+}
+
+static int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl)
+{
+    const utf8* s = src;
+    const utf8* se = src + sl;
+    ucs2* d = dst;
+    const ucs2* de = dst + dl;
+
+    ucs_conv_rule flags = UCR_STRICT;
+    ucs_conv_error err = UCE_OK;
+
+    while (s < se) {
+        ucs4 ch = 0;
+        utf8 nb = _trailing_bytes[*s];
+        if (s + nb >= se) {
+            err = UCE_SRC_EXHAUSTED;
+            break;
+        }
+
+        if (!IsValid(s, nb + 1)) {
+            err =  UCE_ILLEGAL;
+            break;
+        }
+
+        switch (nb) {
+            case 5: ch += *s++; ch <<= 6;
+            case 4: ch += *s++; ch <<= 6;
+            case 3: ch += *s++; ch <<= 6;
+            case 2: ch += *s++; ch <<= 6;
+            case 1: ch += *s++; ch <<= 6;
+            case 0: ch += *s++;
+        }
+        ch -= _offsets_magic[nb];
+
+        if (d >= de) {
+            s -= (nb + 1); // Back up source pointer!
+            err = UCE_DST_EXHAUSTED;
+            break;
+        }
+
+        if (ch <= UTF_MAX_BMP) { // Target is a character <= 0xFFFF
+            // utf-16 surrogate values are illegal in utf-32
+            if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_LOW_END) {
+                if (flags == UCR_STRICT) {
+                    s -= (nb+1); // return to the illegal value itself
+                    err = UCE_ILLEGAL;
+                    break;
+                } else {
+                    *d++ = UTF_REPLACEMENT_CHAR;
+                }
+            } else {
+                if (ch == 0) {
+                    break;
+                }
+                *d++ = (ucs2)ch;
+            }
+        } else if (ch > UTF_MAX_UTF16) {
+            if (flags == UCR_STRICT) {
+                err = UCE_ILLEGAL;
+                s -= (nb+1); // return to the start
+                break; // Bail out; shouldn't continue
+            } else {
+                *d++ = UTF_REPLACEMENT_CHAR;
+            }
+        } else {
+            // target is a character in range 0xFFFF - 0x10FFFF.
+            if (d + 1 >= de) {
+                s -= (nb+1); // Back up source pointer!
+                //result = targetExhausted; break;
+                break;
+            }
+            ch -= HALF_BASE;
+            *d++ = (ucs2)((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
+            *d++ = (ucs2)((ch & HALF_MASK) + UNI_SUR_LOW_START);
+        }
+    }
+
+    *d = '\0';
+    if (err != UCE_OK) {
+        return err;
+    }
+
+    return (int) (d - dst);
+}
+
+static int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl)
+{
+    const ucs4* s = src;
+    ucs2* d = dst;
+
+    const ucs4* se = src + sl;
+    const ucs2* de = dst + dl;
+
+    ucs_conv_rule flags = UCR_STRICT;
+    ucs_conv_error err = UCE_OK;
+
+    while (s < se) {
+        ucs4 ch;
+        if (d >= de) {
+            // target exhausted
+            break;
+        }
+        ch = *s++;
+        if (ch <= UTF_MAX_BMP) { // Target is a character <= 0xFFFF
+            // utf-16 surrogate values are illegal in utf-32; 0xffff or 0xfffe are both reserved values
+            if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_LOW_END) {
+                if (flags == UCR_STRICT) {
+                    --s; // return to the illegal value itself
+                    err = UCE_ILLEGAL;
+                    break;
+                } else {
+                    *d++ = UTF_REPLACEMENT_CHAR;
+                }
+            } else {
+                if (ch == 0) {
+                    break;
+                }
+                *d++ = (ucs2)ch;
+            }
+        } else if (ch > UTF_MAX_LEGAL_UTF32) {
+            if (flags == UCR_STRICT) {
+                err = UCE_ILLEGAL;
+                break;
+            } else {
+                *d++ = UTF_REPLACEMENT_CHAR;
+            }
+        } else {
+            // target is a character in range 0xFFFF - 0x10FFFF.
+            if (d + 1 >= de) {
+                --s;
+                err = UCE_DST_EXHAUSTED;
+                break;
+            }
+            ch -= HALF_BASE;
+            *d++ = (ucs2)((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
+            *d++ = (ucs2)((ch & HALF_MASK) + UNI_SUR_LOW_START);
+        }
+    }
+
+    *d = '\0';
+
+    if (err != UCE_OK) {
+        return err;
+    }
+
+    return (int)(d - dst);
+}
+
+static int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl)
+{
+    const ucs2* s = src;
+    ucs4* d = dst;
+
+    const ucs2* se = src + sl;
+    const ucs4* de = dst + dl;
+
+    ucs4 ch, ch2;
+
+    ucs_conv_rule flags = UCR_STRICT;
+    ucs_conv_error err = UCE_OK;
+
+    while (s < se) {
+        const ucs2* os = s; //  In case we have to back up because of target overflow.
+        ch = *s++;
+        // If we have a surrogate pair, convert to UTF32 first.
+        if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_HIGH_END) {
+            // If the 16 bits following the high surrogate are in the source buffer...
+            if (s < se) {
+                ch2 = *s;
+                // If it's a low surrogate, convert to UTF32.
+                if (ch2 >= UNI_SUR_LOW_START && ch2 <= UNI_SUR_LOW_END) {
+                    ch = ((ch - UNI_SUR_HIGH_START) << HALF_SHIFT)
+                        + (ch2 - UNI_SUR_LOW_START) + HALF_BASE;
+                    ++s;
+                } else {
+                    if (flags == UCR_STRICT) { // it's an unpaired high surrogate
+                        --s;
+                        err = UCE_ILLEGAL;
+                        break;
+                    }
+                }
+            } else { // We don't have the 16 bits following the high surrogate.
+                --s;
+                err = UCE_SRC_EXHAUSTED;
+                break;
+            }
+        } else if (flags == UCR_STRICT) {
+            // utf-16 surrogate values are illegal in utf-32
+            if (ch >= UNI_SUR_LOW_START && ch <= UNI_SUR_LOW_END) {
+                --s;
+                err = UCE_ILLEGAL;
+                break;
+            }
+        }
+
+        if (d >= de) {
+            s = os;
+            err = UCE_DST_EXHAUSTED;
+            break;
+        }
+        if (ch == 0) {
+            break;
+        }
+        *d++ = ch;
+    }
+
+    *d = '\0';
+    if (err != UCE_OK) {
+        return err;
+    }
+
+    return (int)(d - dst);
+}
+
+#pragma warning(pop)
+
+#undef UNI_SUR_HIGH_START
+#undef UNI_SUR_HIGH_END
+#undef UNI_SUR_LOW_START
+#undef UNI_SUR_LOW_END
+
+    }
+
+    static bool IsSurrogate(ucs4 ch)        { return ch >= 0xD800 && ch <= 0xDFFF; }
+    static bool IsHighSurrogate(ucs4 ch)    { return ch >= 0xD800 && ch <= 0xDBFF; }
+    static bool IsLowSurrogate(ucs4 ch)     { return ch >= 0xDC00 && ch <= 0xDFFF; }
+
+        //  The new lenient conversions replace anything ill-formed with U+FFFD. The old
+        //  functions either wrote it through as is, or dropped it. So the reference is
+        //  given input that has already had the replacements made.
+    static std::vector<ucs4> ReplaceIllFormed(const ucs4 src[], size_t sl)
+    {
+        std::vector<ucs4> result(src, &src[sl]);
+        for (auto& ch:result)
+            if (IsSurrogate(ch) || ch > UTF_MAX_LEGAL_UTF32) ch = UTF_REPLACEMENT_CHAR;
+        return result;
+    }
+
+    static std::vector<ucs2> ReplaceIllFormed(const ucs2 src[], size_t sl)
+    {
+        std::vector<ucs2> result(src, &src[sl]);
+        for (size_t c=0; c<sl; ++c) {
+            if (IsHighSurrogate(src[c]) && (c+1) < sl && IsLowSurrogate(src[c+1])) { ++c; continue; }
+            if (IsSurrogate(src[c])) result[c] = ucs2(UTF_REPLACEMENT_CHAR);
+        }
+        return result;
+    }
+
+        //  true if anything before the first null would be replaced by ReplaceIllFormed
+    template<typename CharType>
+        static bool HasIllFormed(const CharType src[], size_t sl)
+    {
+        auto replaced = ReplaceIllFormed(src, sl);
+        for (size_t c=0; c<sl && src[c]; ++c)
+            if (replaced[c] != src[c]) return true;
+        return false;
+    }
+
+    template<typename CharType>
+        static size_t StringLength(const CharType str[])
+    {
+        size_t c = 0;
+        while (str[c]) ++c;
+        return c;
+    }
+
+    template<typename CharType>
+        static bool SameString(const CharType lhs[], const CharType rhs[])
+    {
+        auto length = StringLength(lhs);
+        return length == StringLength(rhs) && std::equal(lhs, &lhs[length], rhs);
+    }
+
+    template<typename CharType>
+        static bool IsPrefix(const CharType prefix[], size_t prefixLength, const CharType str[])
+    {
+        return prefixLength <= StringLength(str) && std::equal(prefix, &prefix[prefixLength], str);
+    }
+
+        //  Random code points, in runs of the same kind, so that there are long enough runs
+        //  for the block copies as well as frequent switches to the scalar path.
+        //  "illFormedOdds" is the chance (out of 1000) of a surrogate or an out of range value
+    template<typename Rng>
+        static void RandomCodePoints(Rng& rng, ucs4 dst[], size_t count, unsigned illFormedOdds)
+    {
+        size_t c = 0;
+        while (c < count) {
+            auto kind = rng() % 6;
+            auto runLength = std::min(size_t(1 + rng() % 24), count - c);
+            for (size_t i=0; i<runLength; ++i, ++c) {
+                if ((rng() % 1000) < illFormedOdds) {
+                    switch (rng() % 4) {
+                    case 0:     dst[c] = 0xD800 + rng() % 0x400; break;
+                    case 1:     dst[c] = 0xDC00 + rng() % 0x400; break;
+                    case 2:     dst[c] = 0x110000 + rng() % 0x1000; break;
+                    default:    dst[c] = 0x80000000 | ucs4(rng()); break;
+                    }
+                    continue;
+                }
+                switch (kind) {
+                case 0:     dst[c] = 0x80 + rng() % (0x800 - 0x80); break;
+                case 1:     dst[c] = 0xAC00 + rng() % (0xD7A4 - 0xAC00); break;
+                case 2:     dst[c] = 0x10000 + rng() % (0x110000 - 0x10000); break;
+                case 3:     dst[c] = 0xE000 + rng() % (0x10000 - 0xE000); break;
+                default:    dst[c] = 1 + rng() % 0x7f; break;
+                }
+            }
+        }
+            //  (occasionally, a null part way through)
+        if (count && (rng() % 16) == 0) dst[rng() % count] = 0;
+    }
+
+        //  Well formed utf8 (encoded by the reference), and then sometimes damaged
+    template<typename Rng>
+        static size_t RandomUTF8(Rng& rng, utf8 dst[], size_t dstSize)
+    {
+        ucs4 codePoints[64];
+        auto count = rng() % dimof(codePoints);
+        RandomCodePoints(rng, codePoints, count, 0);
+        ScalarUTF::ucs4_2_utf8(codePoints, count, dst, dstSize);
+        size_t length = StringLength(dst);
+
+        auto damage = rng() % 4;
+        for (unsigned c=0; c<damage && length; ++c) {
+            auto i = rng() % length;
+            switch (rng() % 5) {
+            case 0:     dst[i] = utf8(0x80 + rng() % 0x80); break;      // continuation, or a lead byte
+            case 1:     dst[i] = utf8(rng()); break;
+            case 2:     length = i; break;                              // truncate, maybe part way through a sequence
+            case 3:     dst[i] ^= utf8(1 << (rng() % 8)); break;
+            default:    dst[i] = utf8(0xC0 + rng() % 0x40); break;
+            }
+        }
+
+            //  Sometimes, just random bytes
+        if ((rng() % 32) == 0) {
+            length = rng() % 64;
+            for (size_t c=0; c<length; ++c) dst[c] = utf8(rng());
+        }
+        dst[length] = 0;
+        return length;
+    }
+
+    template<typename Rng>
+        static size_t RandomUTF16(Rng& rng, ucs2 dst[], size_t dstSize, unsigned illFormedOdds)
+    {
+        ucs4 codePoints[64];
+        auto count = rng() % dimof(codePoints);
+        RandomCodePoints(rng, codePoints, count, 0);
+        ScalarUTF::ucs4_2_ucs2(codePoints, count, dst, dstSize);
+        size_t length = StringLength(dst);
+        for (size_t c=0; c<length; ++c) {
+            if ((rng() % 1000) < illFormedOdds) {
+                switch (rng() % 3) {
+                case 0:     dst[c] = ucs2(0xD800 + rng() % 0x400); break;
+                case 1:     dst[c] = ucs2(0xDC00 + rng() % 0x400); break;
+                default:    length = c; break;                  // (maybe between the halves of a pair)
+                }
+            }
+        }
+        dst[length] = 0;
+        return length;
+    }
+
+        //  Random text for the throughput tests
+    enum class TextKind { ASCII, Mixed, Korean };
+
+    static std::vector<ucs4> ThroughputText(TextKind kind, size_t length)
+    {
+        std::mt19937 rng(1);
+        std::vector<ucs4> result(length+1, 0);
+        for (size_t c=0; c<length; ++c) {
+            auto r = rng() % 100;
+            switch (kind) {
+            case TextKind::ASCII:
+                result[c] = (r < 15) ? ' ' : ucs4('a' + rng() % 26);
+                break;
+            case TextKind::Mixed:
+                    //  mostly ascii, with some latin-1, cyrillic & cjk
+                if (r < 80)         result[c] = (r < 12) ? ' ' : ucs4('a' + rng() % 26);
+                else if (r < 90)    result[c] = 0xC0 + rng() % 0x40;
+                else if (r < 96)    result[c] = 0x410 + rng() % 0x40;
+                else                result[c] = 0x4E00 + rng() % 0x5000;
+                break;
+            case TextKind::Korean:
+                result[c] = (r < 20) ? ' ' : ucs4(0xAC00 + rng() % (0xD7A4 - 0xAC00));
+                break;
+            }
+        }
+        return result;
+    }
+
+    TEST_CLASS(UTFConversion)
+    {
+    public:
+        TEST_METHOD(MatchesScalarReference)
+        {
+                //  Random and ill-formed input through each conversion, compared to the
+                //  old scalar functions. Destinations are large enough that they never
+                //  fill up (that's tested separately, below).
+            std::mt19937 rng(0);
+            for (unsigned iteration=0; iteration<20000; ++iteration) {
+                ucs4 u32[80], u32Ref[300], u32New[300];
+                ucs2 u16[160], u16Ref[300], u16New[300];
+                utf8 u8[320], u8Ref[600], u8New[600];
+
+                    //  utf8 -> utf32 & utf16. The old functions had no lenient mode, so the
+                    //  lenient output should match the reference up to the first ill-formed
+                    //  sequence, and then have a replacement character.
+                    //  The old functions also report a truncated sequence (UCE_SRC_EXHAUSTED)
+                    //  before checking the continuation bytes that are there. The new ones
+                    //  report those as UCE_ILLEGAL.
+                {
+                    auto sl = RandomUTF8(rng, u8, dimof(u8));
+                    auto ref = ScalarUTF::utf8_2_ucs4(u8, sl, u32Ref, dimof(u32Ref));
+                    auto result = utf8_2_ucs4(u8, sl, u32New, dimof(u32New));
+                    Assert::IsTrue(result == ref || (ref == UCE_SRC_EXHAUSTED && result == UCE_ILLEGAL), L"utf8 -> ucs4 result");
+                    Assert::IsTrue(SameString(u32Ref, u32New), L"utf8 -> ucs4 output");
+
+                    auto lenient = utf8_2_ucs4(u8, sl, u32New, dimof(u32New), UCR_LENIENT);
+                    if (ref >= 0) {
+                        Assert::IsTrue(lenient == ref && SameString(u32Ref, u32New), L"utf8 -> ucs4 lenient (well formed)");
+                    } else {
+                        auto prefixLength = StringLength(u32Ref);
+                        Assert::IsTrue(lenient > int(prefixLength) && IsPrefix(u32Ref, prefixLength, u32New), L"utf8 -> ucs4 lenient prefix");
+                        Assert::IsTrue(u32New[prefixLength] == UTF_REPLACEMENT_CHAR, L"utf8 -> ucs4 lenient replacement");
+                    }
+
+                    ref = ScalarUTF::utf8_2_ucs2(u8, sl, u16Ref, dimof(u16Ref));
+                    result = utf8_2_ucs2(u8, sl, u16New, dimof(u16New));
+                    Assert::IsTrue(result == ref || (ref == UCE_SRC_EXHAUSTED && result == UCE_ILLEGAL), L"utf8 -> ucs2 result");
+                    Assert::IsTrue(SameString(u16Ref, u16New), L"utf8 -> ucs2 output");
+
+                    lenient = utf8_2_ucs2(u8, sl, u16New, dimof(u16New), UCR_LENIENT);
+                    if (ref >= 0) {
+                        Assert::IsTrue(lenient == ref && SameString(u16Ref, u16New), L"utf8 -> ucs2 lenient (well formed)");
+                    } else {
+                        auto prefixLength = StringLength(u16Ref);
+                        Assert::IsTrue(lenient > int(prefixLength) && IsPrefix(u16Ref, prefixLength, u16New), L"utf8 -> ucs2 lenient prefix");
+                        Assert::IsTrue(u16New[prefixLength] == UTF_REPLACEMENT_CHAR, L"utf8 -> ucs2 lenient replacement");
+                    }
+
+                        //  utf8_validate gives the longest prefix the old functions accept
+                    auto validLength = utf8_validate(u8, sl);
+                    Assert::IsTrue(validLength <= sl, L"utf8_validate range");
+                    Assert::IsTrue(ScalarUTF::utf8_2_ucs4(u8, validLength, u32Ref, dimof(u32Ref)) >= 0, L"utf8_validate prefix");
+                    bool nullInPrefix = std::find(u8, &u8[validLength], utf8(0)) != &u8[validLength];
+                    if (validLength < sl && !nullInPrefix) {
+                        Assert::IsTrue(ScalarUTF::utf8_2_ucs4(u8, sl, u32Ref, dimof(u32Ref)) < 0, L"utf8_validate ill-formed");
+                    }
+                }
+
+                    //  utf32 -> utf8 & utf16. The reference gets input with the ill-formed
+                    //  code points replaced (which is what the new lenient functions do)
+                {
+                    auto sl = rng() % dimof(u32);
+                    RandomCodePoints(rng, u32, sl, (rng() % 4) ? 0 : 20);
+                    u32[sl] = 0;
+                    auto replaced = ReplaceIllFormed(u32, sl+1);
+                    bool illFormed = HasIllFormed(u32, sl);
+
+                    auto ref = ScalarUTF::ucs4_2_utf8(AsPointer(replaced.begin()), sl, u8Ref, dimof(u8Ref));
+                    auto result = ucs4_2_utf8(u32, sl, u8New, dimof(u8New));
+                    Assert::IsTrue(result == ref && SameString(u8Ref, u8New), L"ucs4 -> utf8");
+                    Assert::IsTrue(utf8_validate(u8New, StringLength(u8New)) == StringLength(u8New), L"ucs4 -> utf8 is well formed");
+                    result = ucs4_2_utf8(u32, sl, u8New, dimof(u8New), UCR_STRICT);
+                    Assert::IsTrue(illFormed ? (result == UCE_ILLEGAL) : (result == ref && SameString(u8Ref, u8New)), L"ucs4 -> utf8 strict");
+
+                        //  (the old ucs4_2_ucs2 had strict validation already)
+                    ref = ScalarUTF::ucs4_2_ucs2(u32, sl, u16Ref, dimof(u16Ref));
+                    result = ucs4_2_ucs2(u32, sl, u16New, dimof(u16New));
+                    Assert::IsTrue(result == ref && SameString(u16Ref, u16New), L"ucs4 -> ucs2");
+                    ref = ScalarUTF::ucs4_2_ucs2(AsPointer(replaced.begin()), sl, u16Ref, dimof(u16Ref));
+                    result = ucs4_2_ucs2(u32, sl, u16New, dimof(u16New), UCR_LENIENT);
+                    Assert::IsTrue(result == ref && SameString(u16Ref, u16New), L"ucs4 -> ucs2 lenient");
+                }
+
+                    //  utf16 -> utf8 & utf32
+                {
+                    auto sl = RandomUTF16(rng, u16, dimof(u16), (rng() % 4) ? 0 : 30);
+                    auto replaced = ReplaceIllFormed(u16, sl+1);
+                    bool illFormed = HasIllFormed(u16, sl);
+
+                    auto ref = ScalarUTF::ucs2_2_utf8(AsPointer(replaced.begin()), sl, u8Ref, dimof(u8Ref));
+                    auto result = ucs2_2_utf8(u16, sl, u8New, dimof(u8New));
+                    Assert::IsTrue(result == ref && SameString(u8Ref, u8New), L"ucs2 -> utf8");
+                    Assert::IsTrue(utf8_validate(u8New, StringLength(u8New)) == StringLength(u8New), L"ucs2 -> utf8 is well formed");
+                    result = ucs2_2_utf8(u16, sl, u8New, dimof(u8New), UCR_STRICT);
+                    Assert::IsTrue(illFormed ? (result < 0) : (result == ref && SameString(u8Ref, u8New)), L"ucs2 -> utf8 strict");
+
+                        //  (the old ucs2_2_ucs4 had strict validation already)
+                    ref = ScalarUTF::ucs2_2_ucs4(u16, sl, u32Ref, dimof(u32Ref));
+                    result = ucs2_2_ucs4(u16, sl, u32New, dimof(u32New));
+                    Assert::IsTrue(result == ref && SameString(u32Ref, u32New), L"ucs2 -> ucs4");
+                    ref = ScalarUTF::ucs2_2_ucs4(AsPointer(replaced.begin()), sl, u32Ref, dimof(u32Ref));
+                    result = ucs2_2_ucs4(u16, sl, u32New, dimof(u32New), UCR_LENIENT);
+                    Assert::IsTrue(result == ref && SameString(u32Ref, u32New), L"ucs2 -> ucs4 lenient");
+                }
+            }
+        }
+
+        TEST_METHOD(DestinationLimits)
+        {
+                //  With every destination size up to the full output, the conversions must
+                //  write only inside the destination, and write a prefix of the full output.
+                //  Conversions to utf8 never write part of a sequence (and only add a
+                //  terminator if there's space), and conversions to utf16 & utf32 are
+                //  always terminated.
+            const unsigned sentinel = 0xFF;     // (never appears in utf8)
+            std::mt19937 rng(1);
+            for (unsigned iteration=0; iteration<2000; ++iteration) {
+                ucs4 u32[64]; ucs2 u16[128]; utf8 u8[256];
+                auto rule = (rng() % 2) ? UCR_STRICT : UCR_LENIENT;
+
+                auto sl32 = rng() % dimof(u32);
+                RandomCodePoints(rng, u32, sl32, 0);
+                u32[sl32] = 0;
+                utf8 full8[300];
+                auto fullResult = ucs4_2_utf8(u32, sl32, full8, dimof(full8), rule);
+                auto fullLength = StringLength(full8);
+                for (size_t dl=0; dl<=fullLength+1; ++dl) {
+                    utf8 out[300];
+                    std::fill(out, &out[dimof(out)], utf8(sentinel));
+                    auto result = ucs4_2_utf8(u32, sl32, out, dl, rule);
+                    Assert::IsTrue(std::count(&out[dl], &out[dimof(out)], utf8(sentinel)) == ptrdiff_t(dimof(out) - dl), L"ucs4 -> utf8 stays inside the destination");
+                    Assert::IsTrue(result == ((dl >= fullLength) ? fullResult : int(UCE_DST_EXHAUSTED)), L"ucs4 -> utf8 exhausted");
+                    size_t written = 0;
+                    while (written < dl && out[written] != 0 && out[written] != sentinel) ++written;
+                    Assert::IsTrue(std::equal(out, &out[written], full8), L"ucs4 -> utf8 prefix");
+                    Assert::IsTrue(utf8_validate(out, written) == written, L"ucs4 -> utf8 no partial sequences");
+                }
+
+                auto sl16 = RandomUTF16(rng, u16, dimof(u16), 0);
+                auto fullResult16 = ucs2_2_utf8(u16, sl16, full8, dimof(full8), rule);
+                fullLength = StringLength(full8);
+                for (size_t dl=0; dl<=fullLength+1; ++dl) {
+                    utf8 out[300];
+                    std::fill(out, &out[dimof(out)], utf8(sentinel));
+                    auto result = ucs2_2_utf8(u16, sl16, out, dl, rule);
+                    Assert::IsTrue(std::count(&out[dl], &out[dimof(out)], utf8(sentinel)) == ptrdiff_t(dimof(out) - dl), L"ucs2 -> utf8 stays inside the destination");
+                    Assert::IsTrue(result == ((dl >= fullLength) ? fullResult16 : int(UCE_DST_EXHAUSTED)), L"ucs2 -> utf8 exhausted");
+                    size_t written = 0;
+                    while (written < dl && out[written] != 0 && out[written] != sentinel) ++written;
+                    Assert::IsTrue(std::equal(out, &out[written], full8), L"ucs2 -> utf8 prefix");
+                    Assert::IsTrue(utf8_validate(out, written) == written, L"ucs2 -> utf8 no partial sequences");
+                }
+
+                auto sl8 = RandomUTF8(rng, u8, dimof(u8));
+                ucs4 full32[300]; ucs2 full16[300];
+                auto fullResult32 = utf8_2_ucs4(u8, sl8, full32, dimof(full32), rule);
+                fullResult16 = utf8_2_ucs2(u8, sl8, full16, dimof(full16), rule);
+                for (size_t dl=0; dl<=StringLength(full16)+1; ++dl) {
+                    ucs4 out32[300]; ucs2 out16[300];
+                    std::fill(out32, &out32[dimof(out32)], ucs4(sentinel));
+                    std::fill(out16, &out16[dimof(out16)], ucs2(sentinel));
+                    auto result32 = utf8_2_ucs4(u8, sl8, out32, dl, rule);
+                    auto result16 = utf8_2_ucs2(u8, sl8, out16, dl, rule);
+                    Assert::IsTrue(std::count(&out32[dl], &out32[dimof(out32)], ucs4(sentinel)) == ptrdiff_t(dimof(out32) - dl), L"utf8 -> ucs4 stays inside the destination");
+                    Assert::IsTrue(std::count(&out16[dl], &out16[dimof(out16)], ucs2(sentinel)) == ptrdiff_t(dimof(out16) - dl), L"utf8 -> ucs2 stays inside the destination");
+                    if (!dl) {
+                        Assert::IsTrue(result32 == UCE_DST_EXHAUSTED && result16 == UCE_DST_EXHAUSTED, L"utf8 -> ucs empty destination");
+                        continue;
+                    }
+
+                        //  (an error in the source can come before the destination fills up)
+                    auto length32 = StringLength(out32), length16 = StringLength(out16);
+                    Assert::IsTrue(IsPrefix(out32, length32, full32) && IsPrefix(out16, length16, full16), L"utf8 -> ucs prefix");
+                    Assert::IsTrue(result32 == fullResult32 || (result32 == UCE_DST_EXHAUSTED && length32 == dl-1), L"utf8 -> ucs4 exhausted");
+                    Assert::IsTrue(result16 == fullResult16 || (result16 == UCE_DST_EXHAUSTED && (length16+2) >= dl), L"utf8 -> ucs2 exhausted");
+                    if (dl > StringLength(full32)) Assert::IsTrue(result32 == fullResult32, L"utf8 -> ucs4 fits");
+                    if (dl > StringLength(full16)) Assert::IsTrue(result16 == fullResult16, L"utf8 -> ucs2 fits");
+                }
+
+                for (size_t dl=0; dl<=StringLength(full16)+1; ++dl) {
+                    ucs2 out16[300];
+                    std::fill(out16, &out16[dimof(out16)], ucs2(sentinel));
+                    auto result = ucs4_2_ucs2(full32, StringLength(full32), out16, dl, rule);
+                    Assert::IsTrue(std::count(&out16[dl], &out16[dimof(out16)], ucs2(sentinel)) == ptrdiff_t(dimof(out16) - dl), L"ucs4 -> ucs2 stays inside the destination");
+                    if (!dl) continue;
+                    Assert::IsTrue(IsPrefix(out16, StringLength(out16), full16), L"ucs4 -> ucs2 prefix");
+                    Assert::IsTrue((dl > StringLength(full16)) ? (result == int(StringLength(full16))) : (result == UCE_DST_EXHAUSTED), L"ucs4 -> ucs2 exhausted");
+                }
+
+                for (size_t dl=0; dl<=StringLength(full32)+1; ++dl) {
+                    ucs4 out32[300];
+                    std::fill(out32, &out32[dimof(out32)], ucs4(sentinel));
+                    auto result = ucs2_2_ucs4(full16, StringLength(full16), out32, dl, rule);
+                    Assert::IsTrue(std::count(&out32[dl], &out32[dimof(out32)], ucs4(sentinel)) == ptrdiff_t(dimof(out32) - dl), L"ucs2 -> ucs4 stays inside the destination");
+                    if (!dl) continue;
+                    Assert::IsTrue(IsPrefix(out32, StringLength(out32), full32), L"ucs2 -> ucs4 prefix");
+                    Assert::IsTrue((dl > StringLength(full32)) ? (result == int(StringLength(full32))) : (result == UCE_DST_EXHAUSTED), L"ucs2 -> ucs4 exhausted");
+                }
+            }
+        }
+
+        TEST_METHOD(Throughput)
+        {
+                //  utf8 -> utf16 and utf16 -> utf8, old scalar functions against the
+                //  new ones, in MB/s of source text. Outputs must match.
+            const size_t textLength = 64 * 1024;
+            const unsigned repeats = 40;
+            const char* kindNames[] = { "ascii", "mixed", "korean" };
+            TextKind kinds[] = { TextKind::ASCII, TextKind::Mixed, TextKind::Korean };
+            auto freq = double(GetPerformanceCounterFrequency());
+
+            for (unsigned k=0; k<dimof(kinds); ++k) {
+                auto text = ThroughputText(kinds[k], textLength);
+                std::vector<utf8> u8(textLength * 4 + 1), u8Out(textLength * 4 + 1);
+                std::vector<ucs2> u16(textLength * 2 + 1), u16Out(textLength * 2 + 1);
+                ScalarUTF::ucs4_2_utf8(AsPointer(text.begin()), textLength, AsPointer(u8.begin()), u8.size());
+                auto u8Length = StringLength(AsPointer(u8.begin()));
+                auto u16Length = ScalarUTF::utf8_2_ucs2(AsPointer(u8.begin()), u8Length, AsPointer(u16.begin()), u16.size());
+                Assert::IsTrue(u16Length == int(textLength), L"Throughput text");
+
+                uint64 times[4] = { 0, 0, 0, 0 };
+                for (unsigned r=0; r<repeats; ++r) {
+                    auto t0 = GetPerformanceCounter();
+                    ScalarUTF::utf8_2_ucs2(AsPointer(u8.begin()), u8Length, AsPointer(u16Out.begin()), u16Out.size());
+                    auto t1 = GetPerformanceCounter();
+                    utf8_2_ucs2(AsPointer(u8.begin()), u8Length, AsPointer(u16Out.begin()), u16Out.size());
+                    auto t2 = GetPerformanceCounter();
+                    ScalarUTF::ucs2_2_utf8(AsPointer(u16.begin()), u16Length, AsPointer(u8Out.begin()), u8Out.size());
+                    auto t3 = GetPerformanceCounter();
+                    ucs2_2_utf8(AsPointer(u16.begin()), u16Length, AsPointer(u8Out.begin()), u8Out.size());
+                    auto t4 = GetPerformanceCounter();
+                    times[0] += t1-t0; times[1] += t2-t1; times[2] += t3-t2; times[3] += t4-t3;
+                }
+                Assert::IsTrue(std::equal(u16.begin(), u16.begin() + u16Length + 1, u16Out.begin()), L"utf8 -> ucs2 output");
+                Assert::IsTrue(std::equal(u8.begin(), u8.begin() + u8Length + 1, u8Out.begin()), L"ucs2 -> utf8 output");
+
+                double mb[] = {
+                    double(u8Length * repeats) / (1024.0 * 1024.0),
+                    double(u16Length * sizeof(ucs2) * repeats) / (1024.0 * 1024.0) };
+                XlOutputDebugString(
+                    StringMeld<256>()
+                        << "UTF conversion throughput (" << kindNames[k] << ", MB/s, old -> new): utf8->utf16 "
+                        << unsigned(mb[0] / (double(times[0]) / freq)) << " -> " << unsigned(mb[0] / (double(times[1]) / freq))
+                        << ", utf16->utf8 "
+                        << unsigned(mb[1] / (double(times[2]) / freq)) << " -> " << unsigned(mb[1] / (double(times[3]) / freq))
+                        << "\n");
+            }
+        }
+    };
+}
+
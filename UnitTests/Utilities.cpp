@@ -7,12 +7,64 @@
 #include "../Utility/ParameterBox.h"
 #include "../Utility/SystemUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/StringFormatTyped.h"
+#include "../Utility/StringUtils.h"
+#include "../Utility/Threading/LockFreeHashTable.h"
+#include "../Utility/BitHeap.h"
+#include "../Utility/UTFUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/Threading/ReadWriteMutex.h"
 #include <CppUnitTest.h>
+#include <thread>
+#include <algorithm>
+#include <random>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
+        //  Several threads doing short reads of a small table (with an occasional
+        //  write) under "MutexType". Readers check that they never see a partially
+        //  written table. Returns the elapsed time in performance counter ticks.
+    template<typename MutexType, typename ReadLock, typename WriteLock>
+        static uint64 ReadMostlyBenchmark(unsigned threadCount, unsigned opsPerThread, bool& badRead)
+    {
+        MutexType mutex;
+        unsigned table[16];
+        std::fill(table, &table[dimof(table)], 0u);
+        volatile bool go = false;
+        volatile bool bad = false;
+
+        std::vector<std::thread> threads;
+        for (unsigned t=0; t<threadCount; ++t) {
+            threads.push_back(std::thread(
+                [&]() {
+                    while (!go) Threading::YieldTimeSlice();
+                    for (unsigned c=0; c<opsPerThread; ++c) {
+                        if ((c % 100) == 99) {
+                            WriteLock lock(mutex);
+                            for (unsigned i=0; i<dimof(table); ++i) ++table[i];
+                        } else {
+                            ReadLock lock(mutex);
+                            for (unsigned i=1; i<dimof(table); ++i)
+                                if (table[i] != table[0]) bad = true;
+                        }
+                    }
+                }));
+        }
+
+        auto startTime = GetPerformanceCounter();
+        go = true;
+        for (auto& t:threads) t.join();
+        auto elapsed = GetPerformanceCounter() - startTime;
+
+        badRead = bad || (table[0] != threadCount * (opsPerThread / 100));
+        return elapsed;
+    }
+
     TEST_CLASS(Utilities)
     {
     public:
@@ -51,6 +103,382 @@ namespace UnitTests
             }
 
         }
+
+        TEST_METHOD(ParameterBoxMergeAndStringTables)
+        {
+            typedef std::vector<std::pair<const char*, std::string>> StringTable;
+            auto isSortedByName = [](const StringTable& table) {
+                for (size_t c=1; c<table.size(); ++c)
+                    if (XlCompareString(table[c-1].first, table[c].first) >= 0) return false;
+                return true;
+            };
+            auto findInTable = [](const StringTable& table, const char name[]) -> const std::string* {
+                for (auto i=table.cbegin(); i!=table.cend(); ++i)
+                    if (!XlCompareString(i->first, name)) return &i->second;
+                return nullptr;
+            };
+
+            ParameterBox base({
+                std::make_pair("Alpha", "1u"), std::make_pair("Beta", "2.5f"),
+                std::make_pair("Gamma", "true"), std::make_pair("Delta", "{1u, 2u}v") });
+            ParameterBox overrides({ std::make_pair("Beta", "7.5f"), std::make_pair("Epsilon", "3u") });
+
+                //  MergeIn: values in the source override ours, new values are added
+            {
+                ParameterBox merged({
+                    std::make_pair("Alpha", "1u"), std::make_pair("Beta", "2.5f"),
+                    std::make_pair("Gamma", "true"), std::make_pair("Delta", "{1u, 2u}v") });
+                auto hashBefore = merged.GetHash();
+                merged.MergeIn(overrides);
+                Assert::IsTrue(merged.GetHash() != hashBefore, L"MergeIn resets the cached hash");
+                Assert::AreEqual(1u, merged.GetParameter<unsigned>("Alpha").second, L"MergeIn keeps our values");
+                Assert::AreEqual(7.5f, merged.GetParameter<float>("Beta").second, L"MergeIn overrides");
+                Assert::IsTrue(merged.GetParameter<bool>("Gamma").second, L"MergeIn keeps our values");
+                Assert::AreEqual(3u, merged.GetParameter<unsigned>("Epsilon").second, L"MergeIn adds new values");
+
+                    //  must be identical to a box built directly with the final values
+                ParameterBox expected({
+                    std::make_pair("Epsilon", "3u"), std::make_pair("Delta", "{1u, 2u}v"),
+                    std::make_pair("Gamma", "true"), std::make_pair("Beta", "7.5f"), std::make_pair("Alpha", "1u") });
+                Assert::IsTrue(merged.GetHash() == expected.GetHash(), L"MergeIn result hash");
+                Assert::IsTrue(merged.GetParameterNamesHash() == expected.GetParameterNamesHash(), L"MergeIn result names");
+                Assert::IsTrue(merged.ParameterNamesAreEqual(expected), L"MergeIn result names");
+
+                    //  merging an empty box, or merging into an empty box
+                merged.MergeIn(ParameterBox());
+                Assert::IsTrue(merged.GetHash() == expected.GetHash(), L"MergeIn empty box");
+                ParameterBox empty;
+                empty.MergeIn(expected);
+                Assert::IsTrue(empty.GetHash() == expected.GetHash(), L"MergeIn into empty box");
+            }
+
+                //  TranslateHash: the hash of our box with the source values applied,
+                //  but only for parameters we already have (and with the same type)
+            {
+                ParameterBox expected({
+                    std::make_pair("Alpha", "1u"), std::make_pair("Beta", "7.5f"),
+                    std::make_pair("Gamma", "true"), std::make_pair("Delta", "{1u, 2u}v") });
+                Assert::IsTrue(base.TranslateHash(overrides) == expected.GetHash(), L"TranslateHash override");
+                Assert::IsTrue(base.TranslateHash(ParameterBox()) == base.GetHash(), L"TranslateHash empty source");
+
+                ParameterBox otherType({ std::make_pair("Beta", "7u"), std::make_pair("Zeta", "1.f") });
+                Assert::IsTrue(base.TranslateHash(otherType) == base.GetHash(), L"TranslateHash ignores type mismatches");
+
+                    //  more overrides than fit in the fixed size list
+                ParameterBox large, largeOverrides, largeExpected;
+                for (unsigned c=0; c<100; ++c) {
+                    auto name = "P" + std::to_string(c);
+                    large.SetParameter(name.c_str(), c);
+                    largeOverrides.SetParameter(name.c_str(), c * 3 + 1);
+                    largeExpected.SetParameter(name.c_str(), c * 3 + 1);
+                }
+                Assert::IsTrue(large.TranslateHash(largeOverrides) == largeExpected.GetHash(), L"TranslateHash many overrides");
+            }
+
+                //  BuildStringTable: merges with an existing (sorted) table, our values win
+            {
+                StringTable table;
+                table.push_back(std::make_pair("Beta", std::string("old")));
+                table.push_back(std::make_pair("ZZZ", std::string("kept")));
+                base.BuildStringTable(table);
+
+                Assert::AreEqual(size_t(5), table.size(), L"BuildStringTable merge");
+                Assert::IsTrue(isSortedByName(table), L"BuildStringTable order");
+                Assert::IsTrue(*findInTable(table, "Alpha") == "1", L"BuildStringTable value");
+                Assert::IsTrue(*findInTable(table, "Beta") == "2.5", L"BuildStringTable override");
+                Assert::IsTrue(*findInTable(table, "Delta") == "{1, 2}v", L"BuildStringTable array");
+                Assert::IsTrue(*findInTable(table, "ZZZ") == "kept", L"BuildStringTable keeps other defines");
+
+                    //  OverrideStringTable only changes defines that are already there
+                overrides.OverrideStringTable(table);
+                Assert::AreEqual(size_t(5), table.size(), L"OverrideStringTable doesn't add");
+                Assert::IsTrue(*findInTable(table, "Beta") == "7.5", L"OverrideStringTable value");
+                Assert::IsTrue(findInTable(table, "Epsilon") == nullptr, L"OverrideStringTable doesn't add");
+                Assert::IsTrue(*findInTable(table, "Alpha") == "1", L"OverrideStringTable leaves others");
+                ParameterBox().OverrideStringTable(table);
+                Assert::AreEqual(size_t(5), table.size(), L"OverrideStringTable empty box");
+
+                    //  Round trip: parsing the string table back into a box, and building
+                    //  the table again gives the same strings ("ZZZ" isn't a typed value)
+                table.pop_back();
+                ParameterBox reparsed;
+                for (auto i=table.cbegin(); i!=table.cend(); ++i)
+                    reparsed.SetParameter(i->first, i->second.c_str());
+                StringTable table2;
+                reparsed.BuildStringTable(table2);
+                Assert::AreEqual(table.size(), table2.size(), L"String table round trip");
+                for (size_t c=0; c<table.size(); ++c) {
+                    Assert::AreEqual(0, XlCompareString(table[c].first, table2[c].first), L"String table round trip");
+                    Assert::IsTrue(table[c].second == table2[c].second, L"String table round trip");
+                }
+                Assert::AreEqual(7.5f, reparsed.GetParameter<float>("Beta").second, L"String table round trip");
+            }
+        }
+
+        TEST_METHOD(LockFreeHashTableTest)
+        {
+            auto valueForKey = [](uint64 key) { return (key * 0x100000001b3ull) ^ 0xff; };
+
+            LockFree::HashTable64 table(16);
+            const unsigned count = 5000;    // (forces the table to grow a few times)
+            for (unsigned c=0; c<count; ++c) {
+                table.Set(uint64(c+1) << 20, valueForKey(uint64(c+1) << 20));
+            }
+            Assert::AreEqual(size_t(count), table.Size(), L"Insert count");
+
+            uint64 value = 0;
+            for (unsigned c=0; c<count; ++c) {
+                Assert::IsTrue(table.TryGet(uint64(c+1) << 20, value), L"Lookup after growth");
+                Assert::IsTrue(value == valueForKey(uint64(c+1) << 20), L"Lookup after growth");
+            }
+            Assert::IsFalse(table.TryGet(1, value), L"Lookup of missing key");
+
+            table.Set(0, 123);      // zero key is remapped internally, but is still a normal key
+            table.Set(0, 456);
+            Assert::IsTrue(table.TryGet(0, value) && value == 456, L"Replace value");
+            Assert::AreEqual(size_t(count+1), table.Size(), L"Replace doesn't add an entry");
+
+                //  Readers running concurrently with a single writer should only
+                //  ever see complete entries
+            LockFree::HashTable64 concurrentTable;
+            volatile bool done = false;
+            volatile bool badValue = false;
+            std::vector<std::thread> readers;
+            for (unsigned t=0; t<3; ++t) {
+                readers.push_back(std::thread(
+                    [&]() {
+                        while (!done) {
+                            for (unsigned c=0; c<count; ++c) {
+                                uint64 v;
+                                if (concurrentTable.TryGet(uint64(c) + 1, v) && v != valueForKey(uint64(c) + 1))
+                                    badValue = true;
+                            }
+                        }
+                    }));
+            }
+            for (unsigned c=0; c<count; ++c) {
+                concurrentTable.Set(uint64(c) + 1, valueForKey(uint64(c) + 1));
+            }
+            done = true;
+            for (auto& r:readers) r.join();
+            Assert::IsFalse(badValue, L"Concurrent lookups");
+        }
+
+        TEST_METHOD(BitHeapTest)
+        {
+            BitHeap heap(100);
+            std::vector<uint32> allocated;
+            for (;;) {
+                auto slot = heap.AllocateNoExpand();
+                if (slot == ~uint32(0)) break;
+                allocated.push_back(slot);
+            }
+            Assert::AreEqual(size_t(100), allocated.size(), L"AllocateNoExpand respects the slot count");
+            for (uint32 c=0; c<100; ++c) {
+                Assert::AreEqual(c, allocated[c], L"Single threaded allocations are in order");
+                Assert::IsTrue(heap.IsAllocated(c), L"IsAllocated");
+            }
+
+            heap.Deallocate(37);
+            Assert::IsFalse(heap.IsAllocated(37), L"Deallocate");
+            Assert::AreEqual(uint32(37), heap.Allocate(), L"Reuse freed slot");
+            Assert::AreEqual(uint32(100), heap.Allocate(), L"Expand");
+
+                //  Batch allocations can span many leaves and blocks
+            std::vector<uint32> batch(10000);
+            Assert::AreEqual(10000u, heap.Allocate(AsPointer(batch.begin()), 10000u), L"Batch allocate");
+            std::sort(batch.begin(), batch.end());
+            for (uint32 c=0; c<10000; ++c) {
+                Assert::AreEqual(c+101, batch[c], L"Batch allocate results");
+            }
+
+                //  Many threads allocating and deallocating at the same time
+                //  should never get the same slot
+            BitHeap concurrentHeap;
+            const unsigned threadCount = 8, slotsPerThread = 2000;
+            std::vector<std::vector<uint32>> threadSlots(threadCount);
+            std::vector<std::thread> threads;
+            for (unsigned t=0; t<threadCount; ++t) {
+                threads.push_back(std::thread(
+                    [&concurrentHeap, &threadSlots, t]() {
+                        auto& slots = threadSlots[t];
+                        for (unsigned c=0; c<slotsPerThread; ++c) {
+                            slots.push_back(concurrentHeap.Allocate());
+                            if ((c%3) == 2) {
+                                concurrentHeap.Deallocate(slots[c/2]);
+                                slots[c/2] = ~uint32(0);
+                            }
+                        }
+                    }));
+            }
+            for (auto& t:threads) t.join();
+
+            std::vector<uint32> allSlots;
+            for (const auto& s:threadSlots)
+                for (auto slot:s)
+                    if (slot != ~uint32(0)) {
+                        allSlots.push_back(slot);
+                        Assert::IsTrue(concurrentHeap.IsAllocated(slot), L"Concurrent IsAllocated");
+                    }
+            std::sort(allSlots.begin(), allSlots.end());
+            Assert::IsTrue(std::unique(allSlots.begin(), allSlots.end()) == allSlots.end(), L"Concurrent allocations are unique");
+        }
+
+        TEST_METHOD(TypedFormatTest)
+        {
+            char buffer[256];
+            XlFormat(buffer, "[%s] Tex(%s) (%4ix%4i) mips:(%i)", "name", std::string("Cube"), 256, 128, 9u);
+            Assert::AreEqual("[name] Tex(Cube) ( 256x 128) mips:(9)", buffer, L"Basic formatting");
+
+            XlFormat(buffer, "%05d|%-4d|%+d|%x|%#X|%.3d", -42, 7, 7, -1, 255, 5);
+            Assert::AreEqual("-0042|7   |+7|ffffffff|0XFF|005", buffer, L"Integer flags");
+
+            XlFormat(buffer, "%llu %I64d", ~0ull, (long long)(1ull<<63));
+            Assert::AreEqual("18446744073709551615 -9223372036854775808", buffer, L"64 bit integers");
+
+                //  The argument type decides the conversion, not the format string
+            XlFormat(buffer, "%d %f %s %s %c", 3.7f, 2, true, 'x', 65);
+            Assert::AreEqual("3 2.000000 true x A", buffer, L"Mismatched types");
+
+            XlFormat(buffer, "%.2f %6.1f %.0f %.2f", 1.005, -2.25, 0.5, 1e-10);
+            Assert::AreEqual("1.00   -2.3 1 0.00", buffer, L"Fixed precision");
+
+            XlFormat(buffer, "%g %g %g %g %g", 0.1, 0.1f, 1e21, 5e-324, 3.4028235e38f);
+            Assert::AreEqual("0.1 0.1 1e+21 5e-324 3.4028235e+38", buffer, L"Shortest representation");
+
+            XlFormat(buffer, "%*d|%.*s|%d %d", 4, 1, 2, "abc", 5);
+            Assert::AreEqual("   1|ab|5 %d", buffer, L"Star arguments and missing arguments");
+
+            char small[6];
+            Assert::IsTrue(XlFormat(small, "%s", "truncated") == 5, L"Truncation");
+            Assert::AreEqual("trunc", small, L"Truncation");
+
+            StringMeld<64> meld;
+            XlFormat(meld << "x = ", "%.1f", 0.25f) << "!";
+            Assert::AreEqual("x = 0.3!", (const char*)meld, L"Append to StringMeld");
+
+                //  Shortest strings must read back to exactly the same value
+            std::mt19937_64 rng(0);
+            for (unsigned c=0; c<100000; ++c) {
+                uint64 bits = rng();
+                double d; std::memcpy(&d, &bits, sizeof(d));
+                if (!std::isfinite(d)) continue;
+                XlFloatToString(buffer, dimof(buffer), d);
+                Assert::IsTrue(std::strtod(buffer, nullptr) == d, L"Double round trip");
+
+                float f; uint32 fbits = uint32(bits); std::memcpy(&f, &fbits, sizeof(f));
+                if (!std::isfinite(f)) continue;
+                XlFloatToString(buffer, dimof(buffer), f);
+                Assert::IsTrue(std::strtof(buffer, nullptr) == f, L"Float round trip");
+            }
+        }
+
+        TEST_METHOD(UTFConversionTest)
+        {
+                //  Random code points (biased towards ASCII, so both the block copies
+                //  and the scalar path get used) through utf8 -> utf16 -> utf32 -> utf8
+            std::mt19937 rng(0);
+            for (unsigned c=0; c<10000; ++c) {
+                ucs4 original[96];
+                unsigned length = rng() % 95;
+                for (unsigned i=0; i<length; ++i) {
+                    switch (rng() % 8) {
+                    case 0:     original[i] = 0x80 + rng() % (0x800 - 0x80); break;
+                    case 1:     original[i] = 0xE000 + rng() % (0x10000 - 0xE000); break;
+                    case 2:     original[i] = 0x10000 + rng() % (0x110000 - 0x10000); break;
+                    default:    original[i] = 1 + rng() % 0x7f; break;
+                    }
+                }
+                original[length] = 0;
+
+                utf8 u8[512]; ucs2 u16[256]; ucs4 u32[128]; utf8 u8b[512];
+                Assert::IsTrue(ucs4_2_utf8(original, length, u8, dimof(u8)) == int(length), L"ucs4 -> utf8");
+                auto u8Length = XlStringLen(u8);
+                Assert::IsTrue(utf8_validate(u8, u8Length) == u8Length, L"Validate");
+                auto u16Length = utf8_2_ucs2(u8, u8Length, u16, dimof(u16));
+                Assert::IsTrue(u16Length >= int(length), L"utf8 -> ucs2");
+                Assert::IsTrue(ucs2_2_ucs4(u16, u16Length, u32, dimof(u32)) == int(length), L"ucs2 -> ucs4");
+                Assert::IsTrue(std::equal(original, &original[length+1], u32), L"Round trip through utf16");
+                Assert::IsTrue(ucs2_2_utf8(u16, u16Length, u8b, dimof(u8b)) == u16Length, L"ucs2 -> utf8");
+                Assert::IsTrue(XlEqString((const char*)u8, (const char*)u8b), L"Round trip to utf8");
+                Assert::IsTrue(utf8_2_ucs4(u8, u8Length, u32, dimof(u32)) == int(length), L"utf8 -> ucs4");
+                Assert::IsTrue(std::equal(original, &original[length+1], u32), L"Round trip through utf8");
+            }
+
+                //  Ill-formed input. Strict conversions stop (keeping what came before),
+                //  lenient conversions replace each bad sequence with U+FFFD
+            const utf8 badUtf8[] = { 'a', 0xC0, 0xAF, 'b', 0xED, 0xA0, 0x80, 'c', 0xF4, 0x90, 0x80, 0x80, 'd', 0xE2, 0x82 };
+            ucs4 u32[32];
+            Assert::IsTrue(utf8_2_ucs4(badUtf8, dimof(badUtf8), u32, dimof(u32)) == UCE_ILLEGAL, L"Strict utf8");
+            Assert::IsTrue(u32[0] == 'a' && u32[1] == 0, L"Strict utf8 partial result");
+            Assert::IsTrue(utf8_validate(badUtf8, dimof(badUtf8)) == 1, L"Validate ill-formed");
+            Assert::IsTrue(utf8_2_ucs4(&badUtf8[12], 3, u32, dimof(u32)) == UCE_SRC_EXHAUSTED, L"Truncated utf8");
+            const ucs4 expected[] = { 'a', 0xFFFD, 0xFFFD, 'b', 0xFFFD, 0xFFFD, 0xFFFD, 'c', 0xFFFD, 0xFFFD, 0xFFFD, 0xFFFD, 'd', 0xFFFD, 0 };
+            Assert::IsTrue(utf8_2_ucs4(badUtf8, dimof(badUtf8), u32, dimof(u32), UCR_LENIENT) == int(dimof(expected)-1), L"Lenient utf8");
+            Assert::IsTrue(std::equal(expected, &expected[dimof(expected)], u32), L"Lenient utf8 replacement");
+
+            const ucs2 badUtf16[] = { 'a', 0xDC00, 0xD83D, 0xDE00, 0xD800 };
+            utf8 u8[32];
+            Assert::IsTrue(ucs2_2_ucs4(badUtf16, dimof(badUtf16), u32, dimof(u32)) == UCE_ILLEGAL, L"Strict utf16");
+            Assert::IsTrue(ucs2_2_utf8(badUtf16, dimof(badUtf16), u8, dimof(u8)) == int(dimof(badUtf16)), L"Lenient utf16 -> utf8");
+            Assert::IsTrue(XlEqString((const char*)u8, "a\xEF\xBF\xBD\xF0\x9F\x98\x80\xEF\xBF\xBD"), L"Lenient utf16 replacement");
+
+                //  Never write past the end of the destination
+            ucs2 small[8];
+            std::fill(small, &small[dimof(small)], ucs2(0xBEEF));
+            Assert::IsTrue(utf8_2_ucs2((const utf8*)"abcdefghijklmnopqrstuvwxyz", 26, small, 5) == UCE_DST_EXHAUSTED, L"Destination exhausted");
+            Assert::IsTrue(small[3] == 'd' && small[4] == 0 && small[5] == 0xBEEF, L"Destination exhausted result");
+        }
+
+        TEST_METHOD(ReadWriteMutexTest)
+        {
+            Threading::ReadWriteMutex mutex;
+            {
+                    //  readers share the lock, writers exclude everyone
+                ScopedReadLock(mutex);
+                bool otherReader = false, otherWriter = true;
+                std::thread(
+                    [&]() {
+                        otherReader = mutex.try_lock_shared();
+                        if (otherReader) mutex.unlock_shared();
+                        otherWriter = mutex.try_lock();
+                        if (otherWriter) mutex.unlock();
+                    }).join();
+                Assert::IsTrue(otherReader, L"Concurrent readers");
+                Assert::IsFalse(otherWriter, L"Writer excluded by reader");
+            }
+            {
+                ScopedModifyLock(mutex);
+                bool otherReader = true;
+                std::thread(
+                    [&]() {
+                        otherReader = mutex.try_lock_shared();
+                        if (otherReader) mutex.unlock_shared();
+                    }).join();
+                Assert::IsFalse(otherReader, L"Reader excluded by writer");
+            }
+
+                //  Contention benchmark -- read mostly access from every core, compared
+                //  to a normal mutex
+            const unsigned threadCount = std::max(4u, std::thread::hardware_concurrency());
+            const unsigned opsPerThread = 200000;
+            bool badRead = false;
+            auto rwTime = ReadMostlyBenchmark<
+                Threading::ReadWriteMutex, Threading::SharedLock,
+                std::unique_lock<Threading::ReadWriteMutex>>(threadCount, opsPerThread, badRead);
+            Assert::IsFalse(badRead, L"ReadWriteMutex protects the table");
+            auto mutexTime = ReadMostlyBenchmark<
+                Threading::Mutex, std::unique_lock<Threading::Mutex>,
+                std::unique_lock<Threading::Mutex>>(threadCount, opsPerThread, badRead);
+            Assert::IsFalse(badRead, L"Mutex protects the table");
+
+            auto freq = double(GetPerformanceCounterFrequency());
+            auto totalOps = double(threadCount) * double(opsPerThread);
+            XlOutputDebugString(
+                StringMeld<256>() 
+                    << "Read mostly contention (" << threadCount << " threads): ReadWriteMutex "
+                    << unsigned(totalOps / (double(rwTime) / freq) / 1000.0) << "k ops/sec, Mutex "
+                    << unsigned(totalOps / (double(mutexTime) / freq) / 1000.0) << "k ops/sec\n");
+        }
     };
 }
-
@@ -7,27 +7,60 @@
 #pragma once
 
 #include "Threading/Mutex.h"
+#include "Threading/ThreadingUtils.h"
 #include "../Core/Types.h"
 #include <vector>
+#include <memory>
 
 namespace Utility
 {
+    /// <summary>Allocates integer slots, with a bit for each slot</summary>
+    /// The bits are grouped into 64 bit "leaf" words. Every 64 leaves have a summary word,
+    /// with a bit set for each leaf that might have free slots. So finding a free slot only
+    /// requires looking at one summary word per 4096 slots, and then a single leaf.
+    ///
+    /// Allocate(), Deallocate() and IsAllocated() are lock free. They work with compare-exchange
+    /// on the leaf and summary words. Only expanding the heap (when Allocate() can't find a free
+    /// slot, or in Reserve()) takes a lock. Blocks of slots are never moved or released while
+    /// the heap is alive, so expanding never gets in the way of the lock free paths.
+    ///
+    /// When only one thread is allocating, Allocate() returns the lowest free slot. With
+    /// many threads, it's not guaranteed to be the lowest, but it will still be low, so the
+    /// allocated slots stay compact.
+    ///
+    /// The move operators are not thread safe.
     class BitHeap
     {
     public:
-        uint32  Allocate();
-        uint32  AllocateNoExpand();
-        void    Deallocate(uint32 value);
-        bool    IsAllocated(uint32 value) const;
-        void    Reserve(uint32 count);
+        uint32      Allocate();
+        uint32      AllocateNoExpand();
+        void        Deallocate(uint32 value);
+        bool        IsAllocated(uint32 value) const;
+        void        Reserve(uint32 count);
+
+            /// <summary>Allocates "count" slots at once</summary>
+            /// This is faster than allocating the slots one by one, because multiple slots
+            /// can be taken from a leaf with a single compare-exchange. The slots aren't
+            /// necessarily contiguous. Returns the number of slots written to "results"
+            /// (which is always "count" for the expanding version).
+        unsigned    Allocate(uint32 results[], unsigned count);
+        unsigned    AllocateNoExpand(uint32 results[], unsigned count);
 
         BitHeap(unsigned slotCount = 8 * 64);
         BitHeap(BitHeap&& moveFrom);
         BitHeap& operator=(BitHeap&& moveFrom);
         ~BitHeap();
     private:
-        std::vector<uint64>         _heap;
-        mutable Threading::Mutex    _lock;
+        class Block;
+        class BlockTable;
+
+        BlockTable* volatile                        _currentTable;
+        Interlocked::Value                          _slotCount;
+        std::vector<std::unique_ptr<Block>>         _blocks;
+        std::vector<std::unique_ptr<BlockTable>>    _tables;    // (includes retired tables)
+        Threading::Mutex                            _expandLock;
+
+        void        Expand(uint32 newSlotCount);
 
         BitHeap(const BitHeap& cloneFrom);
         BitHeap& operator=(const BitHeap& cloneFrom);
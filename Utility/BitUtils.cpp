@@ -6,87 +6,279 @@
 
 #include "BitUtils.h"
 #include "BitHeap.h"
+#include <algorithm>
 #include <assert.h>
 
 namespace Utility
 {
-    uint32  BitHeap::Allocate()
+        //  Set bits mark free slots. Each block has 64 leaves of 64 slots, and
+        //  a summary word with a bit for each leaf that might have a free slot.
+        //
+        //  The summary is only a hint, but it must never miss a leaf with free
+        //  slots. So:
+        //      * Deallocate() sets the leaf bit first, and then the summary bit
+        //      * when Allocate() clears a summary bit, it checks the leaf again
+        //          afterwards, and restores the summary bit if a slot was freed
+        //          in the mean time
+    static const unsigned SlotsPerLeaf = 64;
+    static const unsigned LeavesPerBlock = 64;
+    static const unsigned SlotsPerBlock = SlotsPerLeaf * LeavesPerBlock;
+
+    class BitHeap::Block
+    {
+    public:
+        Interlocked::Value64    _summary;
+        Interlocked::Value64    _leaves[LeavesPerBlock];
+
+        unsigned    TryAllocate(uint32 results[], unsigned count, uint32 baseSlot);
+        void        ClearSummaryBit(unsigned leafIndex);
+
+        Block()
+        {
+            _summary = 0;
+            for (unsigned c=0; c<LeavesPerBlock; ++c) { _leaves[c] = 0; }
+        }
+    };
+
+    class BitHeap::BlockTable
+    {
+    public:
+        std::unique_ptr<Block*[]>   _blocks;
+        unsigned                    _count;
+    };
+
+    static uint64 Load(Interlocked::Value64 volatile const* target)
+    {
+        return uint64(Interlocked::Load64(target));
+    }
+
+    static uint64 InterlockedOr(Interlocked::Value64 volatile* target, uint64 bits)
+    {
+        for (;;) {
+            auto oldValue = Interlocked::Load64(target);
+            if (Interlocked::CompareExchange64(target, oldValue | Interlocked::Value64(bits), oldValue) == oldValue) {
+                return uint64(oldValue);
+            }
+        }
+    }
+
+    static uint64 InterlockedAnd(Interlocked::Value64 volatile* target, uint64 bits)
     {
-        ScopedLock(_lock);
-        for (auto i=_heap.begin(); i!=_heap.end(); ++i) {
-            if (*i != 0) {
-                auto bitIndex = LeastSignificantBitSet(*i);
-                (*i) &= ~(1ui64<<uint64(bitIndex));
-                return ((uint32)std::distance(_heap.begin(), i))*64 + bitIndex;
+        for (;;) {
+            auto oldValue = Interlocked::Load64(target);
+            if (Interlocked::CompareExchange64(target, oldValue & Interlocked::Value64(bits), oldValue) == oldValue) {
+                return uint64(oldValue);
             }
         }
+    }
 
-        _heap.push_back(~uint64(1));
-        return uint32(_heap.size()-1)*64;
+    void BitHeap::Block::ClearSummaryBit(unsigned leafIndex)
+    {
+        auto bit = 1ull << uint64(leafIndex);
+        InterlockedAnd(&_summary, ~bit);
+        if (Load(&_leaves[leafIndex]) != 0) {
+            InterlockedOr(&_summary, bit);
+        }
     }
 
-    uint32  BitHeap::AllocateNoExpand()
+    unsigned BitHeap::Block::TryAllocate(uint32 results[], unsigned count, uint32 baseSlot)
     {
-        ScopedLock(_lock);
-        for (auto i=_heap.begin(); i!=_heap.end(); ++i) {
-            if (*i != 0) {
-                auto bitIndex = LeastSignificantBitSet(*i);
-                (*i) &= ~(1ui64<<uint64(bitIndex));
-                return ((uint32)std::distance(_heap.begin(), i))*64 + bitIndex;
+        unsigned found = 0;
+        while (found < count) {
+            auto summary = Load(&_summary);
+            if (!summary) break;
+
+            auto leafIndex = LeastSignificantBitSet(summary);
+            auto& leaf = _leaves[leafIndex];
+            for (;;) {
+                auto bits = Load(&leaf);
+                if (!bits) {
+                        // the summary was stale (or another thread took the last slot)
+                    ClearSummaryBit(leafIndex);
+                    break;
+                }
+
+                    //  take the lowest free slots in this leaf, up to the number we need
+                uint64 taken = 0, remaining = bits;
+                unsigned takenCount = 0;
+                while (remaining && takenCount < (count - found)) {
+                    taken |= remaining & (~remaining + 1);
+                    remaining &= remaining - 1;
+                    ++takenCount;
+                }
+
+                auto newBits = bits & ~taken;
+                if (uint64(Interlocked::CompareExchange64(&leaf, Interlocked::Value64(newBits), Interlocked::Value64(bits))) != bits) {
+                    continue;
+                }
+
+                auto leafBase = baseSlot + leafIndex * SlotsPerLeaf;
+                while (taken) {
+                    results[found++] = leafBase + LeastSignificantBitSet(taken);
+                    taken &= taken - 1;
+                }
+
+                if (!newBits) {
+                    ClearSummaryBit(leafIndex);
+                }
+                break;
             }
         }
+        return found;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    uint32  BitHeap::Allocate()
+    {
+        uint32 result;
+        Allocate(&result, 1);
+        return result;
+    }
 
+    uint32  BitHeap::AllocateNoExpand()
+    {
+        uint32 result;
+        if (AllocateNoExpand(&result, 1) == 1) {
+            return result;
+        }
         return ~uint32(0x0);
     }
 
+    unsigned BitHeap::Allocate(uint32 results[], unsigned count)
+    {
+        unsigned found = AllocateNoExpand(results, count);
+        while (found < count) {
+                //  Slow path -- we need to expand. Another thread may have expanded
+                //  while we were waiting for the lock, so try again first. Expand in
+                //  whole leaves (like the old BitHeap, which expanded by 64 slots at a time).
+            ScopedLock(_expandLock);
+            found += AllocateNoExpand(&results[found], count - found);
+            if (found < count) {
+                auto required = ((count - found) + SlotsPerLeaf - 1) & ~(SlotsPerLeaf - 1);
+                Expand(uint32(Interlocked::Load(&_slotCount)) + required);
+                found += AllocateNoExpand(&results[found], count - found);
+            }
+        }
+        return found;
+    }
+
+    unsigned BitHeap::AllocateNoExpand(uint32 results[], unsigned count)
+    {
+        auto* table = (const BlockTable*)Interlocked::LoadPointer((void* volatile const*)&_currentTable);
+        if (!table) return 0;
+
+        unsigned found = 0;
+        for (unsigned b=0; b<table->_count && found < count; ++b) {
+            found += table->_blocks[b]->TryAllocate(&results[found], count - found, b * SlotsPerBlock);
+        }
+        return found;
+    }
+
     void    BitHeap::Deallocate(uint32 value)
     {
-        uint32 bitIndex = value&(64-1);
-        uint32 arrayIndex = value>>6;
-        ScopedLock(_lock);
-        if (arrayIndex < _heap.size()) {
-            assert((_heap[arrayIndex] & (1ui64<<uint64(bitIndex))) == 0);
-            _heap[arrayIndex] |= 1ui64<<uint64(bitIndex);
+        if (value >= uint32(Interlocked::Load(&_slotCount))) return;
+
+        auto* table = (const BlockTable*)Interlocked::LoadPointer((void* volatile const*)&_currentTable);
+        auto& block = *table->_blocks[value / SlotsPerBlock];
+        auto leafIndex = (value / SlotsPerLeaf) % LeavesPerBlock;
+        auto bit = 1ull << uint64(value % SlotsPerLeaf);
+
+        auto oldBits = InterlockedOr(&block._leaves[leafIndex], bit);
+        assert((oldBits & bit) == 0); (void)oldBits;
+
+        auto summaryBit = 1ull << uint64(leafIndex);
+        if (!(Load(&block._summary) & summaryBit)) {
+            InterlockedOr(&block._summary, summaryBit);
         }
     }
 
     bool    BitHeap::IsAllocated(uint32 value) const
     {
-        uint32 bitIndex = value&(64-1);
-        uint32 arrayIndex = value>>6;
-        ScopedLock(_lock);
-        if (arrayIndex < _heap.size()) {
-            return (_heap[arrayIndex] & (1ui64<<uint64(bitIndex))) == 0;
-        }
-        return false;
+        if (value >= uint32(Interlocked::Load((Interlocked::Value volatile*)&_slotCount))) return false;
+
+        auto* table = (const BlockTable*)Interlocked::LoadPointer((void* volatile const*)&_currentTable);
+        auto& block = *table->_blocks[value / SlotsPerBlock];
+        auto leafIndex = (value / SlotsPerLeaf) % LeavesPerBlock;
+        auto bit = 1ull << uint64(value % SlotsPerLeaf);
+        return (Load(&block._leaves[leafIndex]) & bit) == 0;
     }
     
     void    BitHeap::Reserve(uint32 count)
     {
-        unsigned elementCount = (count + 64 - 1) / 64;
-        if (_heap.size() < elementCount) {
-            _heap.resize(elementCount, ~uint64(0x0));
+        ScopedLock(_expandLock);
+        Expand(count);
+    }
+
+    void    BitHeap::Expand(uint32 newSlotCount)
+    {
+            // (must be called with _expandLock locked)
+        auto oldSlotCount = uint32(_slotCount);
+        if (newSlotCount <= oldSlotCount) return;
+
+        auto blockCount = (newSlotCount + SlotsPerBlock - 1) / SlotsPerBlock;
+        if (blockCount > _blocks.size()) {
+            while (_blocks.size() < blockCount) {
+                _blocks.push_back(std::make_unique<Block>());
+            }
+
+                //  Publish a new table. Threads still working with the old table
+                //  will finish safely, because we never free it while the heap is alive
+            auto newTable = std::make_unique<BlockTable>();
+            newTable->_count = unsigned(_blocks.size());
+            newTable->_blocks = std::unique_ptr<Block*[]>(new Block*[newTable->_count]);
+            for (unsigned c=0; c<newTable->_count; ++c) {
+                newTable->_blocks[c] = _blocks[c].get();
+            }
+            auto* t = newTable.get();
+            _tables.push_back(std::move(newTable));
+            Interlocked::ExchangePointer((void* volatile*)&_currentTable, t);
+        }
+
+            //  Increase the slot count before we free the new slots, so that
+            //  IsAllocated() never says a slot that's been allocated is free
+        Interlocked::Exchange(&_slotCount, Interlocked::Value(newSlotCount));
+
+        for (auto slot=oldSlotCount; slot<newSlotCount;) {
+            auto leafEnd = std::min((slot / SlotsPerLeaf + 1) * SlotsPerLeaf, newSlotCount);
+            auto firstBit = slot % SlotsPerLeaf;
+            auto bitCount = leafEnd - slot;
+            auto bits = ((bitCount == 64) ? ~0ull : ((1ull << uint64(bitCount)) - 1ull)) << uint64(firstBit);
+
+            auto& block = *_blocks[slot / SlotsPerBlock];
+            auto leafIndex = (slot / SlotsPerLeaf) % LeavesPerBlock;
+            InterlockedOr(&block._leaves[leafIndex], bits);
+            InterlockedOr(&block._summary, 1ull << uint64(leafIndex));
+
+            slot = leafEnd;
         }
     }
 
     BitHeap::BitHeap(unsigned slotCount)
     {
-        unsigned longLongCount = (slotCount + 64 - 1) / 64;
-        _heap.resize(longLongCount, ~uint64(0x0));
-        if ((slotCount % 64) != 0) {
-                // prevent top bits from being allocated
-            _heap[longLongCount-1] = ((slotCount % 64) - 1);
-        }
+        _currentTable = nullptr;
+        _slotCount = 0;
+        Expand(slotCount);
     }
 
     BitHeap::BitHeap(BitHeap&& moveFrom)
+    : _blocks(std::move(moveFrom._blocks))
+    , _tables(std::move(moveFrom._tables))
     {
-        _heap = std::move(moveFrom._heap);
+        _currentTable = moveFrom._currentTable;
+        _slotCount = moveFrom._slotCount;
+        moveFrom._currentTable = nullptr;
+        moveFrom._slotCount = 0;
     }
 
     BitHeap& BitHeap::operator=(BitHeap&& moveFrom)
     {
-        _heap = std::move(moveFrom._heap);
+        _blocks = std::move(moveFrom._blocks);
+        _tables = std::move(moveFrom._tables);
+        _currentTable = moveFrom._currentTable;
+        _slotCount = moveFrom._slotCount;
+        moveFrom._currentTable = nullptr;
+        moveFrom._slotCount = 0;
         return *this;
     }
 
@@ -6,6 +6,9 @@
 
 #pragma once
 
+#include <vector>
+#include <algorithm>
+
 namespace Utility
 {
         //
@@ -41,7 +44,7 @@ namespace Utility
 
     template <typename First, typename Second, typename Allocator>
         static typename std::vector<std::pair<First, Second>, Allocator>::const_iterator LowerBound(
-            typename const std::vector<std::pair<First, Second>, Allocator>&v, First compareToFirst)
+            const std::vector<std::pair<First, Second>, Allocator>&v, First compareToFirst)
         {
             return std::lower_bound(v.cbegin(), v.cend(), compareToFirst, CompareFirst<First, Second>());
         }
@@ -52,10 +52,10 @@ namespace Utility
         inline void* XlMemAlign(size_t size, size_t alignment)
         {
             // void* result = nullptr;
-            // int errorNumber = posix_memalign(&result, size, alignment);
+            // int errorNumber = posix_memalign(&result, alignment, size);
             // assert(!errorNumber);
             // return result;
-            return memalign(size, alignment);
+            return memalign(alignment, size);
         }
         
         inline void XlMemAlignFree(void* data)
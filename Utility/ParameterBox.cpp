@@ -12,6 +12,7 @@
 #include "StringFormat.h"
 #include <algorithm>
 #include <utility>
+#include <iterator>
 #include <regex>
 
 namespace Utility
@@ -207,6 +208,7 @@ namespace Utility
                 case TypeCat::Void:     result << "<<void>>"; break;
                 default:                result << "<<error>>"; break;
                 }
+                data = PtrAdd(data, TypeDesc(desc._type).GetSize());
             }
 
             if (arrayCount > 1) {
@@ -304,14 +306,14 @@ namespace Utility
         }
 
             // just update the value
-        assert(!XlCompareString(&_names[index], name));
         const auto offset = _offsets[index];
+        assert(!XlCompareString(&_names[offset.first], name));
         const auto& existingType = _types[index];
 
         if (existingType.GetSize() == valueSize) {
 
                 // same type, or type with the same size...
-            XlCopyMemory(&_values[offset.first], (uint8*)value, valueSize);
+            XlCopyMemory(&_values[offset.second], (uint8*)value, valueSize);
             _types[index] = insertType;
 
         } else {
@@ -422,37 +424,55 @@ namespace Utility
 
     uint64      ParameterBox::TranslateHash(const ParameterBox& source) const
     {
-        if (_values.size() > 1024) {
-            assert(0);
-            return 0;
-        }
-
-        uint8 temporaryValues[1024];
-        std::copy(_values.cbegin(), _values.cend(), temporaryValues);
+            //  Find the values in "source" that override our values (both hash
+            //  lists are sorted, so this is a single merge pass). If nothing is
+            //  overridden, the result is just our own hash.
+        std::pair<unsigned, unsigned> overrides[64];
+        unsigned overrideCount = 0;
+        std::vector<std::pair<unsigned, unsigned>> overflowOverrides;
 
         auto i  = _parameterHashValues.cbegin();
         auto i2 = source._parameterHashValues.cbegin();
         while (i < _parameterHashValues.cend() && i2 < source._parameterHashValues.cend()) {
-
             if (*i < *i2)       { ++i; } 
             else if (*i > *i2)  { ++i2; } 
-            else if (*i == *i2) {
-                auto offsetDest = _offsets[std::distance(_parameterHashValues.cbegin(), i)].second;
-                auto typeDest   = _types[std::distance(_parameterHashValues.cbegin(), i)];
-                auto offsetSrc  = source._offsets[std::distance(source._parameterHashValues.cbegin(), i2)].second;
-                auto typeSrc    = source._types[std::distance(source._parameterHashValues.cbegin(), i2)];
-                
-                if (typeDest == typeSrc) {
-                    XlCopyMemory(
-                        PtrAdd(temporaryValues, offsetDest), 
-                        PtrAdd(AsPointer(source._values.cbegin()), offsetSrc),
-                        typeDest.GetSize());
+            else {
+                auto indexDest = unsigned(std::distance(_parameterHashValues.cbegin(), i));
+                auto indexSrc = unsigned(std::distance(source._parameterHashValues.cbegin(), i2));
+                if (_types[indexDest] == source._types[indexSrc]) {
+                    if (overrideCount < dimof(overrides)) {
+                        overrides[overrideCount++] = std::make_pair(indexDest, indexSrc);
+                    } else {
+                        overflowOverrides.push_back(std::make_pair(indexDest, indexSrc));
+                    }
                 }
-
                 ++i; ++i2;
             }
+        }
+
+        if (!overrideCount) {
+            return GetHash();
+        }
 
+            //  Build the overridden values table, and hash that. Small tables are
+            //  built on the stack.
+        uint8 stackBuffer[1024];
+        std::unique_ptr<uint8[]> heapBuffer;
+        uint8* temporaryValues = stackBuffer;
+        if (_values.size() > dimof(stackBuffer)) {
+            heapBuffer = std::make_unique<uint8[]>(_values.size());
+            temporaryValues = heapBuffer.get();
         }
+        std::copy(_values.cbegin(), _values.cend(), temporaryValues);
+
+        auto applyOverride = [&](const std::pair<unsigned, unsigned>& o) {
+            XlCopyMemory(
+                PtrAdd(temporaryValues, _offsets[o.first].second), 
+                PtrAdd(AsPointer(source._values.cbegin()), source._offsets[o.second].second),
+                _types[o.first].GetSize());
+        };
+        std::for_each(overrides, &overrides[overrideCount], applyOverride);
+        std::for_each(overflowOverrides.cbegin(), overflowOverrides.cend(), applyOverride);
 
         return Hash64(temporaryValues, PtrAdd(temporaryValues, _values.size()));
     }
@@ -476,36 +496,64 @@ namespace Utility
         }
     };
 
+    std::vector<unsigned> ParameterBox::SortedByName() const
+    {
+            //  Our parameters are sorted by hash value; but string tables are
+            //  sorted by name. Returns parameter indices in name order.
+        std::vector<unsigned> result;
+        result.reserve(_offsets.size());
+        for (unsigned c=0; c<unsigned(_offsets.size()); ++c) {
+            result.push_back(c);
+        }
+        std::sort(result.begin(), result.end(),
+            [this](unsigned lhs, unsigned rhs) 
+            { return XlCompareString(&_names[_offsets[lhs].first], &_names[_offsets[rhs].first]) < 0; });
+        return std::move(result);
+    }
+
     void ParameterBox::BuildStringTable(std::vector<std::pair<const char*, std::string>>& defines) const
     {
-        for (auto i=_offsets.cbegin(); i!=_offsets.cend(); ++i) {
-            const auto* name = &_names[i->first];
-            const void* value = &_values[i->second];
-            const auto& type = _types[std::distance(_offsets.begin(), i)];
-            auto stringFormat = ImpliedTyping::AsString(value, _values.size() - i->second, type);
-
-            auto insertPosition = std::lower_bound(
-                defines.begin(), defines.end(), name, StringTableComparison());
-            if (insertPosition!=defines.cend() && !XlCompareString(insertPosition->first, name)) {
-                insertPosition->second = stringFormat;
-            } else {
-                defines.insert(insertPosition, std::make_pair(name, stringFormat));
+        if (_offsets.empty()) return;
+
+            //  Merge our parameters (in name order) with the existing sorted table in
+            //  one pass. Our values override values already in the table.
+        auto sortedParams = SortedByName();
+        std::vector<std::pair<const char*, std::string>> result;
+        result.reserve(defines.size() + sortedParams.size());
+
+        auto d = defines.begin();
+        for (auto p=sortedParams.cbegin(); p!=sortedParams.cend(); ++p) {
+            const auto* name = &_names[_offsets[*p].first];
+            while (d!=defines.end() && XlCompareString(d->first, name) < 0) {
+                result.push_back(std::move(*d));
+                ++d;
+            }
+            if (d!=defines.end() && !XlCompareString(d->first, name)) {
+                ++d;    // (replaced by our value)
             }
+
+            auto valueOffset = _offsets[*p].second;
+            result.push_back(std::make_pair(
+                name, ImpliedTyping::AsString(&_values[valueOffset], _values.size() - valueOffset, _types[*p])));
         }
+        std::move(d, defines.end(), std::back_inserter(result));
+
+        defines = std::move(result);
     }
 
     void ParameterBox::OverrideStringTable(std::vector<std::pair<const char*, std::string>>& defines) const
     {
-        for (auto i=_offsets.cbegin(); i!=_offsets.cend(); ++i) {
-            const auto* name = &_names[i->first];
-            const void* value = &_values[i->second];
-            const auto& type = _types[std::distance(_offsets.begin(), i)];
-
-            auto insertPosition = std::lower_bound(
-                defines.begin(), defines.end(), name, StringTableComparison());
-
-            if (insertPosition!=defines.cend() && !XlCompareString(insertPosition->first, name)) {
-                insertPosition->second = ImpliedTyping::AsString(value, _values.size()-i->second, type);
+        if (_offsets.empty() || defines.empty()) return;
+
+        auto sortedParams = SortedByName();
+        auto d = defines.begin();
+        for (auto p=sortedParams.cbegin(); p!=sortedParams.cend() && d!=defines.end(); ++p) {
+            const auto* name = &_names[_offsets[*p].first];
+            d = std::lower_bound(d, defines.end(), name, StringTableComparison());
+            if (d!=defines.end() && !XlCompareString(d->first, name)) {
+                auto valueOffset = _offsets[*p].second;
+                d->second = ImpliedTyping::AsString(&_values[valueOffset], _values.size() - valueOffset, _types[*p]);
+                ++d;
             }
         }
     }
@@ -521,16 +569,58 @@ namespace Utility
 
     void ParameterBox::MergeIn(const ParameterBox& source)
     {
-            // simple implementation... 
-            //  We could build a more effective implementation taking into account
-            //  the fact that both parameter boxes are sorted.
-        for (auto i=source._offsets.cbegin(); i!=source._offsets.cend(); ++i) {
-            const auto* name = &source._names[i->first];
-            SetParameter(
-                name, 
-                &source._values[i->second],
-                source._types[std::distance(source._offsets.cbegin(), i)]);
+        if (source._parameterHashValues.empty()) return;
+
+            //  Both boxes are sorted by parameter hash, so we can build the merged 
+            //  tables in a single pass (rather than inserting parameters one by one)
+        decltype(_parameterHashValues)  newHashValues;
+        decltype(_offsets)              newOffsets;
+        decltype(_names)                newNames;
+        decltype(_values)               newValues;
+        decltype(_types)                newTypes;
+
+        auto maxCount = _parameterHashValues.size() + source._parameterHashValues.size();
+        newHashValues.reserve(maxCount);
+        newOffsets.reserve(maxCount);
+        newTypes.reserve(maxCount);
+        newNames.reserve(_names.size() + source._names.size());
+        newValues.reserve(_values.size() + source._values.size());
+
+        auto append = [&](const ParameterBox& box, size_t index) {
+            const auto& offsets = box._offsets[index];
+            const auto* name = &box._names[offsets.first];
+            const auto* value = &box._values[offsets.second];
+            const auto& type = box._types[index];
+
+            newHashValues.push_back(box._parameterHashValues[index]);
+            newOffsets.push_back(std::make_pair(uint32(newNames.size()), uint32(newValues.size())));
+            newNames.insert(newNames.end(), name, &name[XlStringLen(name)+1]);
+            newValues.insert(newValues.end(), value, PtrAdd(value, type.GetSize()));
+            newTypes.push_back(type);
+        };
+
+        size_t i = 0, i2 = 0;
+        const auto count = _parameterHashValues.size(), sourceCount = source._parameterHashValues.size();
+        while (i < count && i2 < sourceCount) {
+            if (_parameterHashValues[i] < source._parameterHashValues[i2]) {
+                append(*this, i++);
+            } else if (_parameterHashValues[i] > source._parameterHashValues[i2]) {
+                append(source, i2++);
+            } else {
+                append(source, i2++);   // source value overrides ours
+                ++i;
+            }
         }
+        for (; i<count; ++i) append(*this, i);
+        for (; i2<sourceCount; ++i2) append(source, i2);
+
+        _parameterHashValues = std::move(newHashValues);
+        _offsets = std::move(newOffsets);
+        _names = std::move(newNames);
+        _values = std::move(newValues);
+        _types = std::move(newTypes);
+        _cachedHash = 0;
+        _cachedParameterNameHash = 0;
     }
 
     void ParameterBox::Serialize(Serialization::NascentBlockSerializer& serializer) const
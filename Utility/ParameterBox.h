@@ -124,6 +124,7 @@ namespace Utility
         Serialization::Vector<TypeDesc> _types;
 
         const void* GetValue(size_t index) const;
+        std::vector<unsigned> SortedByName() const;
         uint64      CalculateHash() const;
         uint64      CalculateParameterNamesHash() const;
     };
@@ -0,0 +1,302 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "../../../Core/Prefix.h"
+#include "../FileSystemMonitor.h"
+
+#if PLATFORMOS_TARGET == PLATFORMOS_LINUX
+
+#include "../../../Core/Types.h"
+#include "../../MemoryUtils.h"
+#include "../../IteratorUtils.h"
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <assert.h>
+
+namespace Utility
+{
+        //  Editors and compilers normally write a file in a few steps (truncate,
+        //  write, write, close, or write to a temporary file and rename). Each step
+        //  raises an inotify event. So we wait until the directory has been quiet
+        //  for a short time, and then call each callback only once.
+    static const int CoalesceQuietMilliseconds = 50;
+    static const int CoalesceMaxMilliseconds = 500;
+
+    static const uint32 WatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+    class MonitoredDirectory
+    {
+    public:
+        MonitoredDirectory(const char directoryName[], int watchDescriptor);
+        ~MonitoredDirectory();
+
+        static uint64   HashFilename(const char filename[]);
+        void            AttachCallback(uint64 filenameHash, std::shared_ptr<OnChangeCallback> callback);
+        void            FindCallbacks(std::vector<std::shared_ptr<OnChangeCallback>>& dst, uint64 filenameHash) const;
+        void            FindAllCallbacks(std::vector<std::shared_ptr<OnChangeCallback>>& dst) const;
+        int             GetWatchDescriptor() const { return _watchDescriptor; }
+
+    private:
+        std::vector<std::pair<uint64, std::shared_ptr<OnChangeCallback>>>  _callbacks;
+        std::string     _directoryName;
+        int             _watchDescriptor;
+    };
+
+    static std::mutex                                                           MonitoredDirectoriesLock;
+    static std::vector<std::pair<uint64, std::unique_ptr<MonitoredDirectory>>>  MonitoredDirectories;
+    static std::unique_ptr<std::thread>                                         MonitoringThread;
+        //  inotify returns the same watch descriptor when the same directory is added
+        //  via different path names. So the watch can be shared by multiple
+        //  MonitoredDirectory objects; we count the references to each descriptor, and
+        //  only remove the watch when the last one goes away.
+    static std::vector<std::pair<int, unsigned>>                                WatchReferences;
+    static int      InotifyHandle = -1;
+    static int      WakePipe[2] = { -1, -1 };
+    static bool     MonitoringQuit = false;
+
+    MonitoredDirectory::MonitoredDirectory(const char directoryName[], int watchDescriptor)
+    : _directoryName(directoryName), _watchDescriptor(watchDescriptor)
+    {
+            // (MonitoredDirectoriesLock must be locked)
+        if (_watchDescriptor < 0) return;
+        auto i = LowerBound(WatchReferences, _watchDescriptor);
+        if (i != WatchReferences.end() && i->first == _watchDescriptor) {
+            ++i->second;
+        } else {
+            WatchReferences.insert(i, std::make_pair(_watchDescriptor, 1u));
+        }
+    }
+
+    MonitoredDirectory::~MonitoredDirectory()
+    {
+            // (MonitoredDirectoriesLock must be locked)
+        if (_watchDescriptor < 0) return;
+        auto i = LowerBound(WatchReferences, _watchDescriptor);
+        assert(i != WatchReferences.end() && i->first == _watchDescriptor && i->second > 0);
+        if (i == WatchReferences.end() || i->first != _watchDescriptor) return;
+        if (--i->second) return;
+
+        WatchReferences.erase(i);
+        if (InotifyHandle >= 0) {
+            inotify_rm_watch(InotifyHandle, _watchDescriptor);
+        }
+    }
+
+    uint64          MonitoredDirectory::HashFilename(const char filename[])
+    {
+            //  (lower case, to match the behaviour of the Windows implementation)
+        char buffer[MaxPath];
+        char *b = buffer;
+        while (*filename !='\0' && b!=&buffer[MaxPath]) {
+            *b = (char)tolower(*filename); ++filename; ++b;
+        }
+        return Hash64(buffer, b);
+    }
+
+    void            MonitoredDirectory::AttachCallback(uint64 filenameHash, std::shared_ptr<OnChangeCallback> callback)
+    {
+        _callbacks.insert(
+            std::lower_bound(   _callbacks.cbegin(), _callbacks.cend(),
+                                filenameHash, CompareFirst<uint64, std::shared_ptr<OnChangeCallback>>()),
+            std::make_pair(filenameHash, std::move(callback)));
+    }
+
+    void            MonitoredDirectory::FindCallbacks(std::vector<std::shared_ptr<OnChangeCallback>>& dst, uint64 filenameHash) const
+    {
+        auto i = std::equal_range(
+            _callbacks.cbegin(), _callbacks.cend(),
+            filenameHash, CompareFirst<uint64, std::shared_ptr<OnChangeCallback>>());
+        for (auto i2=i.first; i2!=i.second; ++i2)
+            dst.push_back(i2->second);
+    }
+
+    void            MonitoredDirectory::FindAllCallbacks(std::vector<std::shared_ptr<OnChangeCallback>>& dst) const
+    {
+        for (const auto& c:_callbacks)
+            dst.push_back(c.second);
+    }
+
+        //  Read all of the events that are currently queued, and add them to "pendingChanges"
+        //  as (watch descriptor, filename hash) pairs. Returns false if the queue overflowed
+        //  (in which case we don't know which files have changed)
+    static bool ReadEvents(std::vector<std::pair<int, uint64>>& pendingChanges)
+    {
+        bool noOverflow = true;
+        alignas(struct inotify_event) char buffer[4096];
+        for (;;) {
+            auto bytesRead = read(InotifyHandle, buffer, sizeof(buffer));
+            if (bytesRead <= 0) break;
+
+            for (const char* i = buffer; i < buffer + bytesRead; ) {
+                const auto& evnt = *(const struct inotify_event*)i;
+                if (evnt.mask & IN_Q_OVERFLOW) {
+                    noOverflow = false;
+                } else if (evnt.len && !(evnt.mask & IN_ISDIR)) {
+                    pendingChanges.push_back(std::make_pair(evnt.wd, MonitoredDirectory::HashFilename(evnt.name)));
+                }
+                i += sizeof(struct inotify_event) + evnt.len;
+            }
+        }
+        return noOverflow;
+    }
+
+    static void DispatchChanges(std::vector<std::pair<int, uint64>>& pendingChanges, bool overflow)
+    {
+        std::sort(pendingChanges.begin(), pendingChanges.end());
+        pendingChanges.erase(std::unique(pendingChanges.begin(), pendingChanges.end()), pendingChanges.end());
+
+            //  Collect the callbacks while we hold the lock, but call them after it has
+            //  been released. That way OnChange() can safely attach new monitors.
+        std::vector<std::shared_ptr<OnChangeCallback>> callbacks;
+        {
+            std::unique_lock<std::mutex> lock(MonitoredDirectoriesLock);
+            if (overflow) {
+                for (const auto& d:MonitoredDirectories)
+                    d.second->FindAllCallbacks(callbacks);
+            } else {
+                for (const auto& change:pendingChanges) {
+                        //  (inotify returns the same watch descriptor when the same directory
+                        //  is added via different path names, so there may be multiple matches)
+                    for (const auto& d:MonitoredDirectories)
+                        if (d.second->GetWatchDescriptor() == change.first)
+                            d.second->FindCallbacks(callbacks, change.second);
+                }
+            }
+        }
+
+        std::sort(callbacks.begin(), callbacks.end());
+        callbacks.erase(std::unique(callbacks.begin(), callbacks.end()), callbacks.end());
+        for (const auto& c:callbacks)
+            c->OnChange();
+    }
+
+    static void MonitoringEntryPoint()
+    {
+        typedef std::chrono::steady_clock Clock;
+        std::vector<std::pair<int, uint64>> pendingChanges;
+        bool overflow = false;
+        Clock::time_point firstEventTime, lastEventTime;
+
+        while (!MonitoringQuit) {
+            struct pollfd fds[2];
+            fds[0].fd = InotifyHandle; fds[0].events = POLLIN; fds[0].revents = 0;
+            fds[1].fd = WakePipe[0]; fds[1].events = POLLIN; fds[1].revents = 0;
+
+                //  when there are pending changes, we only wait long enough to know that
+                //  the burst of changes has finished
+            bool hasPending = !pendingChanges.empty() || overflow;
+            int timeout = -1;
+            if (hasPending) {
+                auto quietTime = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - lastEventTime).count();
+                timeout = std::max(0, CoalesceQuietMilliseconds - int(quietTime));
+            }
+
+            int result = poll(fds, 2, timeout);
+            if (result < 0) continue;       // (EINTR)
+
+            if (fds[1].revents & POLLIN) {
+                char dummy[16];
+                while (read(WakePipe[0], dummy, sizeof(dummy)) > 0) {}
+            }
+
+            auto now = Clock::now();
+            if (fds[0].revents & POLLIN) {
+                overflow |= !ReadEvents(pendingChanges);
+                if (!hasPending) firstEventTime = now;
+                lastEventTime = now;
+            }
+
+            if (!pendingChanges.empty() || overflow) {
+                using std::chrono::milliseconds;
+                if (    (now - lastEventTime) >= milliseconds(CoalesceQuietMilliseconds)
+                    ||  (now - firstEventTime) >= milliseconds(CoalesceMaxMilliseconds)) {
+                    DispatchChanges(pendingChanges, overflow);
+                    pendingChanges.clear();
+                    overflow = false;
+                }
+            }
+        }
+    }
+
+    static bool StartMonitoring()
+    {
+            // (MonitoredDirectoriesLock must be locked)
+        if (InotifyHandle >= 0) return true;
+
+        InotifyHandle = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (InotifyHandle < 0) return false;
+
+        if (pipe2(WakePipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+            close(InotifyHandle);
+            InotifyHandle = -1;
+            return false;
+        }
+
+        MonitoringQuit = false;
+        MonitoringThread = std::make_unique<std::thread>(MonitoringEntryPoint);
+        return true;
+    }
+
+    void TerminateFileSystemMonitoring()
+    {
+        std::unique_ptr<std::thread> thread;
+        {
+            std::unique_lock<std::mutex> lock(MonitoredDirectoriesLock);
+            thread = std::move(MonitoringThread);
+            MonitoringQuit = true;
+            if (WakePipe[1] >= 0) {
+                char wake = 0;
+                auto ignored = write(WakePipe[1], &wake, 1); (void)ignored;
+            }
+        }
+
+        if (thread)
+            thread->join();
+
+        std::unique_lock<std::mutex> lock(MonitoredDirectoriesLock);
+        MonitoredDirectories.clear();
+        if (InotifyHandle >= 0) { close(InotifyHandle); InotifyHandle = -1; }
+        if (WakePipe[0] >= 0) { close(WakePipe[0]); WakePipe[0] = -1; }
+        if (WakePipe[1] >= 0) { close(WakePipe[1]); WakePipe[1] = -1; }
+    }
+
+    void AttachFileSystemMonitor(   const char directoryName[], const char filename[],
+                                    const std::shared_ptr<OnChangeCallback>& callback)
+    {
+        std::unique_lock<std::mutex> lock(MonitoredDirectoriesLock);
+        assert(directoryName && directoryName[0]);
+
+        auto hash = MonitoredDirectory::HashFilename(directoryName);
+        auto i = std::lower_bound(
+            MonitoredDirectories.cbegin(), MonitoredDirectories.cend(),
+            hash, CompareFirst<uint64, std::unique_ptr<MonitoredDirectory>>());
+        if (i != MonitoredDirectories.cend() && i->first == hash) {
+            i->second->AttachCallback(MonitoredDirectory::HashFilename(filename), callback);
+            return;
+        }
+
+        if (!StartMonitoring()) return;
+
+            //  If the directory doesn't exist (or we've hit the watch limit), we still
+            //  record the callbacks, but they will never be triggered.
+        int watchDescriptor = inotify_add_watch(InotifyHandle, directoryName, WatchMask);
+        auto i2 = MonitoredDirectories.insert(i, std::make_pair(hash, std::make_unique<MonitoredDirectory>(directoryName, watchDescriptor)));
+        i2->second->AttachCallback(MonitoredDirectory::HashFilename(filename), callback);
+    }
+
+}
+
+#endif
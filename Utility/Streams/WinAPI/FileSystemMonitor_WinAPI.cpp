@@ -199,6 +199,7 @@ namespace Utility
     {
         ScopedLock(MonitoringThreadLock);
         if (!MonitoringThread) {
+            MonitoringQuit = false;     // (we may be restarting after TerminateFileSystemMonitoring)
             RestartMonitoringEvent = XlCreateEvent(false);
             MonitoringThread = std::make_unique<Utility::Threading::Thread>(MonitoringEntryPoint, nullptr);
         }
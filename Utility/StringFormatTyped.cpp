@@ -0,0 +1,756 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "StringFormatTyped.h"
+#include "StringFormat.h"
+#include "StringUtils.h"
+#include "ArithmeticUtils.h"
+#include "../Core/Types.h"
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+namespace Utility { namespace Internal
+{
+    namespace
+    {
+        class OutputBuffer
+        {
+        public:
+            char*   _ptr;
+            char*   _end;       // (one space before the end is kept for the terminator)
+
+            void Put(char c)                                { if (_ptr < _end) *_ptr++ = c; }
+            void Put(const char str[], size_t length)
+            {
+                length = std::min(length, size_t(_end - _ptr));
+                memcpy(_ptr, str, length);
+                _ptr += length;
+            }
+            void Fill(char c, int count)                    { while (count-- > 0 && _ptr < _end) *_ptr++ = c; }
+        };
+
+        class FormatSpec
+        {
+        public:
+            int     _width;
+            int     _precision;     // -1 when there's no precision
+            char    _sign;          // '+', ' ' or 0
+            char    _conversion;
+            bool    _leftAlign;
+            bool    _zeroPad;
+            bool    _alternate;
+
+            FormatSpec() : _width(0), _precision(-1), _sign(0), _conversion(0), _leftAlign(false), _zeroPad(false), _alternate(false) {}
+        };
+
+        void WriteField(
+            OutputBuffer& out, const FormatSpec& spec,
+            const char prefix[], size_t prefixLength,
+            const char body[], size_t bodyLength,
+            bool allowZeroPad)
+        {
+            int padding = spec._width - int(prefixLength + bodyLength);
+            if (spec._leftAlign) {
+                out.Put(prefix, prefixLength);
+                out.Put(body, bodyLength);
+                out.Fill(' ', padding);
+            } else if (spec._zeroPad && allowZeroPad) {
+                out.Put(prefix, prefixLength);
+                out.Fill('0', padding);
+                out.Put(body, bodyLength);
+            } else {
+                out.Fill(' ', padding);
+                out.Put(prefix, prefixLength);
+                out.Put(body, bodyLength);
+            }
+        }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+            //  I N T E G E R S
+
+        static const char s_digitPairs[] =
+            "0001020304050607080910111213141516171819"
+            "2021222324252627282930313233343536373839"
+            "4041424344454647484950515253545556575859"
+            "6061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+            // Writes the digits backwards from "end", and returns the first character.
+            // Two digits at a time, and only using 64 bit division while the value
+            // doesn't fit in 32 bits (it's expensive on 32 bit targets).
+        char* WriteDecimalBackwards(char* end, uint64 value)
+        {
+            while (value > 0xffffffffull) {
+                auto pair = unsigned(value % 100) * 2;
+                value /= 100;
+                end -= 2;
+                end[0] = s_digitPairs[pair];
+                end[1] = s_digitPairs[pair+1];
+            }
+
+            uint32 v = uint32(value);
+            while (v >= 100) {
+                auto pair = (v % 100) * 2;
+                v /= 100;
+                end -= 2;
+                end[0] = s_digitPairs[pair];
+                end[1] = s_digitPairs[pair+1];
+            }
+
+            if (v >= 10) {
+                end -= 2;
+                end[0] = s_digitPairs[v*2];
+                end[1] = s_digitPairs[v*2+1];
+            } else {
+                *--end = char('0' + v);
+            }
+            return end;
+        }
+
+        char* WritePow2Backwards(char* end, uint64 value, unsigned bitsPerDigit, bool upperCase)
+        {
+            const char* digits = upperCase ? "0123456789ABCDEF" : "0123456789abcdef";
+            const unsigned mask = (1u << bitsPerDigit) - 1;
+            do {
+                *--end = digits[unsigned(value) & mask];
+                value >>= bitsPerDigit;
+            } while (value);
+            return end;
+        }
+
+        void WriteInteger(OutputBuffer& out, const FormatSpec& spec, uint64 magnitude, bool negative, bool isSigned)
+        {
+            char buffer[96];
+            char* end = &buffer[dimof(buffer)];
+            char* start = end;
+
+            const bool hex = spec._conversion == 'x' || spec._conversion == 'X';
+            const bool octal = spec._conversion == 'o';
+            if (spec._precision != 0 || magnitude != 0) {
+                if (hex)        start = WritePow2Backwards(end, magnitude, 4, spec._conversion == 'X');
+                else if (octal) start = WritePow2Backwards(end, magnitude, 3, false);
+                else            start = WriteDecimalBackwards(end, magnitude);
+            }
+
+            if (spec._precision > 0) {
+                auto minDigits = std::min(spec._precision, int(dimof(buffer) - 1));
+                while ((end - start) < minDigits) *--start = '0';
+            }
+
+            char prefix[2];
+            size_t prefixLength = 0;
+            if (negative) {
+                prefix[prefixLength++] = '-';
+            } else if (isSigned && spec._sign) {
+                prefix[prefixLength++] = spec._sign;
+            }
+
+            if (spec._alternate) {
+                if (hex && magnitude) {
+                    prefix[prefixLength++] = '0';
+                    prefix[prefixLength++] = spec._conversion;
+                } else if (octal && (start == end || *start != '0')) {
+                    *--start = '0';
+                }
+            }
+
+                // (like printf, zero padding is ignored when there's a precision)
+            WriteField(out, spec, prefix, prefixLength, start, end - start, spec._precision < 0);
+        }
+
+        void WritePointer(OutputBuffer& out, const FormatSpec& spec, uint64 value)
+        {
+                // (matches the MSVC CRT: upper case, padded to the full width of a pointer)
+            char buffer[32];
+            char* end = &buffer[dimof(buffer)];
+            char* start = WritePow2Backwards(end, value, 4, true);
+            while ((end - start) < int(2*sizeof(void*))) *--start = '0';
+            WriteField(out, spec, nullptr, 0, start, end - start, false);
+        }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+            //  F L O A T I N G   P O I N T
+
+            // "Grisu2" from "Printing Floating-Point Numbers Quickly and Accurately with Integers"
+            // (Florian Loitsch, 2010). It always generates digits that read back to the same value,
+            // and almost always the shortest such digits. Everything is done in 64 bit integers
+            // with a small table of cached powers of 10.
+
+        class DiyFp
+        {
+        public:
+            uint64  _f;
+            int     _e;
+
+            DiyFp() {}
+            DiyFp(uint64 f, int e) : _f(f), _e(e) {}
+
+            DiyFp operator*(const DiyFp& rhs) const
+            {
+                    // 64 x 64 -> upper 64 bits (rounded), in 32 bit pieces
+                const uint64 M32 = 0xffffffffull;
+                uint64 a = _f >> 32, b = _f & M32;
+                uint64 c = rhs._f >> 32, d = rhs._f & M32;
+                uint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+                uint64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+                tmp += 1u << 31;
+                return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), _e + rhs._e + 64);
+            }
+
+            DiyFp operator-(const DiyFp& rhs) const { return DiyFp(_f - rhs._f, _e); }
+
+            DiyFp Normalize() const
+            {
+                auto shift = int(xl_clz8(_f));
+                return DiyFp(_f << shift, _e - shift);
+            }
+        };
+
+            // Normalized f * 2^e approximations of 10^k for k = -348, -340, ... 340
+        struct CachedPower { uint64 _f; int16 _e; };
+        static const CachedPower s_cachedPowers[] =
+        {
+            { 0xfa8fd5a0081c0288ull, -1220 }, // 1e-348
+            { 0xbaaee17fa23ebf76ull, -1193 }, // 1e-340
+            { 0x8b16fb203055ac76ull, -1166 }, // 1e-332
+            { 0xcf42894a5dce35eaull, -1140 }, // 1e-324
+            { 0x9a6bb0aa55653b2dull, -1113 }, // 1e-316
+            { 0xe61acf033d1a45dfull, -1087 }, // 1e-308
+            { 0xab70fe17c79ac6caull, -1060 }, // 1e-300
+            { 0xff77b1fcbebcdc4full, -1034 }, // 1e-292
+            { 0xbe5691ef416bd60cull, -1007 }, // 1e-284
+            { 0x8dd01fad907ffc3cull,  -980 }, // 1e-276
+            { 0xd3515c2831559a83ull,  -954 }, // 1e-268
+            { 0x9d71ac8fada6c9b5ull,  -927 }, // 1e-260
+            { 0xea9c227723ee8bcbull,  -901 }, // 1e-252
+            { 0xaecc49914078536dull,  -874 }, // 1e-244
+            { 0x823c12795db6ce57ull,  -847 }, // 1e-236
+            { 0xc21094364dfb5637ull,  -821 }, // 1e-228
+            { 0x9096ea6f3848984full,  -794 }, // 1e-220
+            { 0xd77485cb25823ac7ull,  -768 }, // 1e-212
+            { 0xa086cfcd97bf97f4ull,  -741 }, // 1e-204
+            { 0xef340a98172aace5ull,  -715 }, // 1e-196
+            { 0xb23867fb2a35b28eull,  -688 }, // 1e-188
+            { 0x84c8d4dfd2c63f3bull,  -661 }, // 1e-180
+            { 0xc5dd44271ad3cdbaull,  -635 }, // 1e-172
+            { 0x936b9fcebb25c996ull,  -608 }, // 1e-164
+            { 0xdbac6c247d62a584ull,  -582 }, // 1e-156
+            { 0xa3ab66580d5fdaf6ull,  -555 }, // 1e-148
+            { 0xf3e2f893dec3f126ull,  -529 }, // 1e-140
+            { 0xb5b5ada8aaff80b8ull,  -502 }, // 1e-132
+            { 0x87625f056c7c4a8bull,  -475 }, // 1e-124
+            { 0xc9bcff6034c13053ull,  -449 }, // 1e-116
+            { 0x964e858c91ba2655ull,  -422 }, // 1e-108
+            { 0xdff9772470297ebdull,  -396 }, // 1e-100
+            { 0xa6dfbd9fb8e5b88full,  -369 }, // 1e-92
+            { 0xf8a95fcf88747d94ull,  -343 }, // 1e-84
+            { 0xb94470938fa89bcfull,  -316 }, // 1e-76
+            { 0x8a08f0f8bf0f156bull,  -289 }, // 1e-68
+            { 0xcdb02555653131b6ull,  -263 }, // 1e-60
+            { 0x993fe2c6d07b7facull,  -236 }, // 1e-52
+            { 0xe45c10c42a2b3b06ull,  -210 }, // 1e-44
+            { 0xaa242499697392d3ull,  -183 }, // 1e-36
+            { 0xfd87b5f28300ca0eull,  -157 }, // 1e-28
+            { 0xbce5086492111aebull,  -130 }, // 1e-20
+            { 0x8cbccc096f5088ccull,  -103 }, // 1e-12
+            { 0xd1b71758e219652cull,   -77 }, // 1e-4
+            { 0x9c40000000000000ull,   -50 }, // 1e4
+            { 0xe8d4a51000000000ull,   -24 }, // 1e12
+            { 0xad78ebc5ac620000ull,     3 }, // 1e20
+            { 0x813f3978f8940984ull,    30 }, // 1e28
+            { 0xc097ce7bc90715b3ull,    56 }, // 1e36
+            { 0x8f7e32ce7bea5c70ull,    83 }, // 1e44
+            { 0xd5d238a4abe98068ull,   109 }, // 1e52
+            { 0x9f4f2726179a2245ull,   136 }, // 1e60
+            { 0xed63a231d4c4fb27ull,   162 }, // 1e68
+            { 0xb0de65388cc8ada8ull,   189 }, // 1e76
+            { 0x83c7088e1aab65dbull,   216 }, // 1e84
+            { 0xc45d1df942711d9aull,   242 }, // 1e92
+            { 0x924d692ca61be758ull,   269 }, // 1e100
+            { 0xda01ee641a708deaull,   295 }, // 1e108
+            { 0xa26da3999aef774aull,   322 }, // 1e116
+            { 0xf209787bb47d6b85ull,   348 }, // 1e124
+            { 0xb454e4a179dd1877ull,   375 }, // 1e132
+            { 0x865b86925b9bc5c2ull,   402 }, // 1e140
+            { 0xc83553c5c8965d3dull,   428 }, // 1e148
+            { 0x952ab45cfa97a0b3ull,   455 }, // 1e156
+            { 0xde469fbd99a05fe3ull,   481 }, // 1e164
+            { 0xa59bc234db398c25ull,   508 }, // 1e172
+            { 0xf6c69a72a3989f5cull,   534 }, // 1e180
+            { 0xb7dcbf5354e9beceull,   561 }, // 1e188
+            { 0x88fcf317f22241e2ull,   588 }, // 1e196
+            { 0xcc20ce9bd35c78a5ull,   614 }, // 1e204
+            { 0x98165af37b2153dfull,   641 }, // 1e212
+            { 0xe2a0b5dc971f303aull,   667 }, // 1e220
+            { 0xa8d9d1535ce3b396ull,   694 }, // 1e228
+            { 0xfb9b7cd9a4a7443cull,   720 }, // 1e236
+            { 0xbb764c4ca7a44410ull,   747 }, // 1e244
+            { 0x8bab8eefb6409c1aull,   774 }, // 1e252
+            { 0xd01fef10a657842cull,   800 }, // 1e260
+            { 0x9b10a4e5e9913129ull,   827 }, // 1e268
+            { 0xe7109bfba19c0c9dull,   853 }, // 1e276
+            { 0xac2820d9623bf429ull,   880 }, // 1e284
+            { 0x80444b5e7aa7cf85ull,   907 }, // 1e292
+            { 0xbf21e44003acdd2dull,   933 }, // 1e300
+            { 0x8e679c2f5e44ff8full,   960 }, // 1e308
+            { 0xd433179d9c8cb841ull,   986 }, // 1e316
+            { 0x9e19db92b4e31ba9ull,  1013 }, // 1e324
+            { 0xeb96bf6ebadf77d9ull,  1039 }, // 1e332
+            { 0xaf87023b9bf0ee6bull,  1066 }, // 1e340
+        };
+
+        static const uint32 s_pow10_32[] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000 };
+
+        DiyFp GetCachedPower(int e, int& K)
+        {
+                // choose the power so the product's exponent lands in [-60, -32]
+            double dk = (-61 - e) * 0.30102999566398114 + 347;
+            int k = int(dk);
+            if (dk - k > 0.0) ++k;
+            unsigned index = unsigned((k >> 3) + 1);
+            K = -(-348 + int(index << 3));
+            return DiyFp(s_cachedPowers[index]._f, s_cachedPowers[index]._e);
+        }
+
+        void GrisuRound(char buffer[], int length, uint64 delta, uint64 rest, uint64 tenKappa, uint64 wpw)
+        {
+            while (rest < wpw && (delta - rest) >= tenKappa
+                && (rest + tenKappa < wpw || (wpw - rest) > (rest + tenKappa - wpw))) {
+                buffer[length - 1]--;
+                rest += tenKappa;
+            }
+        }
+
+        int DigitGen(const DiyFp& W, const DiyFp& Mp, uint64 delta, char buffer[], int& K)
+        {
+            const DiyFp one(uint64(1) << -Mp._e, Mp._e);
+            const DiyFp wpw = Mp - W;
+            uint32 p1 = uint32(Mp._f >> -one._e);
+            uint64 p2 = Mp._f & (one._f - 1);
+
+            int kappa = 1;
+            while (kappa < 10 && p1 >= s_pow10_32[kappa]) ++kappa;
+
+            int length = 0;
+            while (kappa > 0) {
+                uint32 d = p1 / s_pow10_32[kappa-1];
+                p1 %= s_pow10_32[kappa-1];
+                if (d || length) buffer[length++] = char('0' + d);
+                --kappa;
+                uint64 tmp = (uint64(p1) << -one._e) + p2;
+                if (tmp <= delta) {
+                    K += kappa;
+                    GrisuRound(buffer, length, delta, tmp, uint64(s_pow10_32[kappa]) << -one._e, wpw._f);
+                    return length;
+                }
+            }
+
+            for (;;) {
+                p2 *= 10;
+                delta *= 10;
+                char d = char(p2 >> -one._e);
+                if (d || length) buffer[length++] = char('0' + d);
+                p2 &= one._f - 1;
+                --kappa;
+                if (p2 < delta) {
+                    K += kappa;
+                    GrisuRound(buffer, length, delta, p2, one._f, (-kappa < 10) ? wpw._f * s_pow10_32[-kappa] : 0);
+                    return length;
+                }
+            }
+        }
+
+            // value = f * 2^e (not zero). Writes the digits and returns the count; the value
+            // is then (digits) * 10^K
+        int Grisu2(uint64 f, int e, bool lowerBoundaryCloser, char digits[], int& K)
+        {
+            DiyFp plus = DiyFp((f << 1) + 1, e - 1).Normalize();
+            DiyFp minus = lowerBoundaryCloser ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+            minus._f <<= minus._e - plus._e;
+            minus._e = plus._e;
+
+            const DiyFp cachedPower = GetCachedPower(plus._e, K);
+            const DiyFp W = DiyFp(f, e).Normalize() * cachedPower;
+            DiyFp Wp = plus * cachedPower;
+            DiyFp Wm = minus * cachedPower;
+            ++Wm._f;
+            --Wp._f;
+            return DigitGen(W, Wp, Wp._f - Wm._f, digits, K);
+        }
+
+            // Places the decimal point. Plain notation for decimal exponents in [-6, 21),
+            // otherwise scientific notation (with at least 2 exponent digits, like printf)
+        size_t Prettify(char buffer[], const char digits[], int length, int K)
+        {
+            char* dst = buffer;
+            const int kk = length + K;      // position of the decimal point
+            if (length <= kk && kk <= 21) {
+                memcpy(dst, digits, length); dst += length;
+                for (int i=length; i<kk; ++i) *dst++ = '0';
+            } else if (0 < kk && kk <= 21) {
+                memcpy(dst, digits, kk); dst += kk;
+                *dst++ = '.';
+                memcpy(dst, digits + kk, length - kk); dst += length - kk;
+            } else if (-6 < kk && kk <= 0) {
+                *dst++ = '0';
+                *dst++ = '.';
+                for (int i=kk; i<0; ++i) *dst++ = '0';
+                memcpy(dst, digits, length); dst += length;
+            } else {
+                *dst++ = digits[0];
+                if (length > 1) {
+                    *dst++ = '.';
+                    memcpy(dst, digits + 1, length - 1); dst += length - 1;
+                }
+                *dst++ = 'e';
+                int exp = kk - 1;
+                if (exp < 0) { *dst++ = '-'; exp = -exp; }
+                else *dst++ = '+';
+                char expBuffer[8];
+                char* expEnd = &expBuffer[dimof(expBuffer)];
+                char* expStart = WriteDecimalBackwards(expEnd, uint64(exp));
+                if ((expEnd - expStart) < 2) *dst++ = '0';
+                memcpy(dst, expStart, expEnd - expStart); dst += expEnd - expStart;
+            }
+            return size_t(dst - buffer);
+        }
+
+            // Writes the magnitude of a finite, non-zero value. "buffer" needs 32 characters
+        size_t WriteShortestMagnitude(char buffer[], double value)
+        {
+            uint64 bits; memcpy(&bits, &value, sizeof(bits));
+            const uint64 mantissa = bits & ((uint64(1) << 52) - 1);
+            const int biasedExponent = int((bits >> 52) & 0x7ff);
+            uint64 f; int e;
+            if (biasedExponent) { f = mantissa | (uint64(1) << 52); e = biasedExponent - 1075; }
+            else                { f = mantissa; e = -1074; }
+
+            char digits[24]; int K;
+            int length = Grisu2(f, e, mantissa == 0 && biasedExponent > 1, digits, K);
+            return Prettify(buffer, digits, length, K);
+        }
+
+        size_t WriteShortestMagnitude(char buffer[], float value)
+        {
+            uint32 bits; memcpy(&bits, &value, sizeof(bits));
+            const uint32 mantissa = bits & ((1u << 23) - 1);
+            const int biasedExponent = int((bits >> 23) & 0xff);
+            uint64 f; int e;
+            if (biasedExponent) { f = mantissa | (1u << 23); e = biasedExponent - 150; }
+            else                { f = mantissa; e = -149; }
+
+                // (the boundaries are the float neighbours, so we get the digits for the float
+                // value, not for the double it converts to)
+            char digits[24]; int K;
+            int length = Grisu2(f, e, mantissa == 0 && biasedExponent > 1, digits, K);
+            return Prettify(buffer, digits, length, K);
+        }
+
+        static const double s_pow10_f64[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17 };
+
+            // Fixed precision ("%.3f"), for values where value * 10^precision fits in
+            // the double mantissa. Rounds half away from zero (like the MSVC CRT).
+            // Returns 0 if the value is outside of the range this handles.
+        size_t WriteFixedMagnitude(char buffer[], double magnitude, int precision)
+        {
+            if (precision >= int(dimof(s_pow10_f64))) return 0;
+
+            const double scale = s_pow10_f64[precision];
+            const double scaled = magnitude * scale;
+            if (!(scaled < 4503599627370496.0)) return 0;      // 2^52
+
+                // "scaled" is rounded, but the rounding only matters when it lands exactly on a
+                // half. Then the sign of the rounding error tells us which way to go.
+            const double integral = std::floor(scaled);
+            const double fraction = scaled - integral;
+            uint64 rounded = uint64(integral);
+            if (fraction > 0.5 || (fraction == 0.5 && std::fma(magnitude, scale, -scaled) >= 0.0))
+                ++rounded;
+
+            uint64 divisor = 1;
+            for (int c=0; c<precision; ++c) divisor *= 10;
+
+            char temp[48];
+            char* end = &temp[dimof(temp)];
+            char* start = end;
+            if (precision > 0) {
+                start = WriteDecimalBackwards(end, rounded % divisor);
+                while ((end - start) < precision) *--start = '0';
+                *--start = '.';
+            }
+            start = WriteDecimalBackwards(start, rounded / divisor);
+
+            memcpy(buffer, start, end - start);
+            return size_t(end - start);
+        }
+
+        void WriteFloat(OutputBuffer& out, const FormatSpec& spec, double value, bool singlePrecision)
+        {
+            uint64 bits; memcpy(&bits, &value, sizeof(bits));
+            const bool negative = (bits >> 63) != 0;
+            const bool upperCase = spec._conversion == 'F' || spec._conversion == 'E' || spec._conversion == 'G';
+            const double magnitude = negative ? -value : value;
+
+            char prefix[1];
+            size_t prefixLength = 0;
+            if (negative)           prefix[prefixLength++] = '-';
+            else if (spec._sign)    prefix[prefixLength++] = spec._sign;
+
+            if (magnitude != magnitude || magnitude > std::numeric_limits<double>::max()) {
+                const char* text = (magnitude != magnitude) ? (upperCase ? "NAN" : "nan") : (upperCase ? "INF" : "inf");
+                WriteField(out, spec, prefix, prefixLength, text, 3, false);
+                return;
+            }
+
+            char buffer[512];
+            size_t length = 0;
+            char conversion = spec._conversion;
+            if (conversion == 'f' || conversion == 'F') {
+                length = WriteFixedMagnitude(buffer, magnitude, (spec._precision < 0) ? 6 : spec._precision);
+            } else if (conversion != 'e' && conversion != 'E' && spec._precision < 0) {
+                if (magnitude == 0.0) {
+                    buffer[0] = '0';
+                    length = 1;
+                } else {
+                    length = singlePrecision
+                        ? WriteShortestMagnitude(buffer, float(magnitude))
+                        : WriteShortestMagnitude(buffer, magnitude);
+                }
+                if (upperCase)
+                    for (size_t c=0; c<length; ++c)
+                        if (buffer[c] == 'e') buffer[c] = 'E';
+            }
+
+            if (!length) {
+                    // anything else goes through the CRT printf
+                if (conversion != 'f' && conversion != 'F' && conversion != 'e' && conversion != 'E' && conversion != 'G')
+                    conversion = 'g';
+                char fmt[] = "%.*?";
+                fmt[3] = conversion;
+                int precision = std::min((spec._precision < 0) ? 6 : spec._precision, 99);
+                int count = _snprintf_s(buffer, _TRUNCATE, fmt, precision, magnitude);
+                length = (count < 0) ? XlStringLen(buffer) : size_t(count);
+            }
+
+            WriteField(out, spec, prefix, prefixLength, buffer, length, true);
+        }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+        int64 AsInt64(const FormatArg& arg)
+        {
+            switch (arg._type) {
+            case FormatArgType::Float:
+            case FormatArgType::Double:
+                if (!(arg._double > -9.2233720368547758e18)) return std::numeric_limits<int64>::min();
+                if (!(arg._double < 9.2233720368547758e18)) return std::numeric_limits<int64>::max();
+                return int64(arg._double);
+            case FormatArgType::String:     return 0;
+            default:                        return arg._signed;
+            }
+        }
+
+            // The bits of an integer argument, as the original (unsigned) type
+        uint64 AsUnsigned(const FormatArg& arg)
+        {
+            if ((arg._type == FormatArgType::Signed || arg._type == FormatArgType::Char) && arg._size < sizeof(uint64))
+                return arg._unsigned & ((uint64(1) << (arg._size * 8)) - 1);
+            if (arg._type == FormatArgType::Float || arg._type == FormatArgType::Double)
+                return uint64(AsInt64(arg));
+            return arg._unsigned;
+        }
+
+        void WriteString(OutputBuffer& out, const FormatSpec& spec, const char str[], size_t length)
+        {
+            if (!str) { str = "(null)"; length = 6; }
+            if (length == ~size_t(0)) {
+                    // (don't read past "precision" characters; the string might not be terminated)
+                if (spec._precision >= 0) {
+                    auto* term = (const char*)memchr(str, 0, size_t(spec._precision));
+                    length = term ? size_t(term - str) : size_t(spec._precision);
+                } else {
+                    length = XlStringLen(str);
+                }
+            } else if (spec._precision >= 0) {
+                length = std::min(length, size_t(spec._precision));
+            }
+            WriteField(out, spec, nullptr, 0, str, length, false);
+        }
+
+        void WriteArg(OutputBuffer& out, const FormatSpec& spec, const FormatArg& arg)
+        {
+            const char conv = spec._conversion;
+            const bool floatConversion = conv == 'f' || conv == 'F' || conv == 'e' || conv == 'E' || conv == 'g' || conv == 'G';
+            const bool unsignedConversion = conv == 'u' || conv == 'x' || conv == 'X' || conv == 'o';
+
+            switch (arg._type) {
+            case FormatArgType::String:
+                WriteString(out, spec, arg._string, arg._stringLength);
+                return;
+
+            case FormatArgType::Float:
+            case FormatArgType::Double:
+                if (floatConversion || conv == 's') {
+                    WriteFloat(out, spec, arg._double, arg._type == FormatArgType::Float);
+                    return;
+                }
+                break;
+
+            case FormatArgType::Bool:
+                if (conv == 's') {
+                    WriteString(out, spec, arg._unsigned ? "true" : "false", arg._unsigned ? 4 : 5);
+                    return;
+                }
+                break;
+
+            case FormatArgType::Char:
+                if (conv == 's') {
+                    char c = char(arg._signed);
+                    WriteString(out, spec, &c, 1);
+                    return;
+                }
+                break;
+
+            case FormatArgType::Pointer:
+                if (conv == 's') {
+                    WritePointer(out, spec, uint64(uintptr(arg._pointer)));
+                    return;
+                }
+                break;
+
+            default:
+                break;
+            }
+
+                // integer conversions (also used for floats that are written with an integer conversion)
+            if (conv == 'c') {
+                char c = char(AsInt64(arg));
+                WriteField(out, spec, nullptr, 0, &c, 1, false);
+            } else if (conv == 'p') {
+                WritePointer(out, spec, AsUnsigned(arg));
+            } else if (floatConversion) {
+                double value = (arg._type == FormatArgType::Unsigned) ? double(arg._unsigned) : double(arg._signed);
+                WriteFloat(out, spec, value, false);
+            } else if (unsignedConversion || arg._type == FormatArgType::Unsigned || arg._type == FormatArgType::Pointer) {
+                WriteInteger(out, spec, AsUnsigned(arg), false, false);
+            } else {
+                int64 value = AsInt64(arg);
+                uint64 magnitude = (value < 0) ? (0 - uint64(value)) : uint64(value);
+                WriteInteger(out, spec, magnitude, value < 0, true);
+            }
+        }
+
+        const char* ParseNumber(const char* f, int& result)
+        {
+            result = 0;
+            while (*f >= '0' && *f <= '9') {
+                result = std::min(result * 10 + (*f - '0'), 100000);
+                ++f;
+            }
+            return f;
+        }
+    }
+
+    size_t FormatImpl(
+        char destination[], size_t destinationSize,
+        const char format[], const FormatArg args[], size_t argCount)
+    {
+        if (!destinationSize) return 0;
+
+        OutputBuffer out;
+        out._ptr = destination;
+        out._end = destination + destinationSize - 1;
+
+        size_t argIndex = 0;
+        const char* f = format;
+        for (;;) {
+            const char* literal = f;
+            while (*f && *f != '%') ++f;
+            out.Put(literal, size_t(f - literal));
+            if (!*f) break;
+
+            const char* specStart = f++;
+            if (*f == '%') { out.Put('%'); ++f; continue; }
+
+            FormatSpec spec;
+            for (;;) {
+                if (*f == '-')      spec._leftAlign = true;
+                else if (*f == '+') spec._sign = '+';
+                else if (*f == ' ') { if (!spec._sign) spec._sign = ' '; }
+                else if (*f == '0') spec._zeroPad = true;
+                else if (*f == '#') spec._alternate = true;
+                else break;
+                ++f;
+            }
+
+            if (*f == '*') {
+                ++f;
+                int64 width = (argIndex < argCount) ? AsInt64(args[argIndex++]) : 0;
+                if (width < 0) { spec._leftAlign = true; width = -width; }
+                spec._width = int(std::min(width, int64(100000)));
+            } else {
+                f = ParseNumber(f, spec._width);
+            }
+
+            if (*f == '.') {
+                ++f;
+                if (*f == '*') {
+                    ++f;
+                    int64 precision = (argIndex < argCount) ? AsInt64(args[argIndex++]) : 0;
+                    spec._precision = (precision < 0) ? -1 : int(std::min(precision, int64(100000)));
+                } else {
+                    f = ParseNumber(f, spec._precision);
+                }
+            }
+
+                // length modifiers aren't needed, because we know the argument types
+            for (;;) {
+                if (*f == 'h' || *f == 'l' || *f == 'L' || *f == 'q' || *f == 'j' || *f == 'z' || *f == 't') {
+                    ++f;
+                } else if (*f == 'I') {
+                    ++f;
+                    while (*f >= '0' && *f <= '9') ++f;
+                } else break;
+            }
+
+            if (!*f) { out.Put(specStart, size_t(f - specStart)); break; }
+            spec._conversion = *f++;
+
+            if (argIndex >= argCount || spec._conversion == 'n') {
+                    // missing argument (or unsupported conversion) -- write the specifier as is
+                out.Put(specStart, size_t(f - specStart));
+                continue;
+            }
+
+            WriteArg(out, spec, args[argIndex++]);
+        }
+
+        *out._ptr = '\0';
+        return size_t(out._ptr - destination);
+    }
+
+    template<typename Type>
+        static size_t WriteShortestT(char destination[], size_t destinationSize, Type value)
+    {
+        if (!destinationSize) return 0;
+        FormatSpec spec;
+        spec._conversion = 'g';
+        OutputBuffer out;
+        out._ptr = destination;
+        out._end = destination + destinationSize - 1;
+        WriteFloat(out, spec, double(value), sizeof(Type) == sizeof(float));
+        *out._ptr = '\0';
+        return size_t(out._ptr - destination);
+    }
+
+    size_t WriteShortest(char destination[], size_t destinationSize, double value)    { return WriteShortestT(destination, destinationSize, value); }
+    size_t WriteShortest(char destination[], size_t destinationSize, float value)     { return WriteShortestT(destination, destinationSize, value); }
+
+}}
+
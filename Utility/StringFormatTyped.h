@@ -0,0 +1,133 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "StringFormat.h"
+#include "../Core/Types.h"
+#include "Detail/API.h"
+#include <string>
+
+namespace Utility
+{
+    namespace Internal
+    {
+        namespace FormatArgType { enum Enum { None, Bool, Char, Signed, Unsigned, Float, Double, String, Pointer }; }
+
+            // Type erased argument for XlFormat. Records the value and
+            // the original type, so the formatter can choose the right
+            // conversion regardless of what the format string asks for.
+        class FormatArg
+        {
+        public:
+            union
+            {
+                int64           _signed;
+                uint64          _unsigned;
+                double          _double;
+                const char*     _string;
+                const void*     _pointer;
+            };
+            size_t              _stringLength;      ///< ~size_t(0) for null terminated strings
+            uint8               _type;              ///< FormatArgType::Enum
+            uint8               _size;              ///< sizeof the original integer type
+
+            FormatArg() : _unsigned(0), _stringLength(0), _type(FormatArgType::None), _size(0) {}
+            FormatArg(FormatArgType::Enum type, uint8 size) : _unsigned(0), _stringLength(~size_t(0)), _type(uint8(type)), _size(size) {}
+        };
+
+        inline FormatArg MakeSigned(int64 value, uint8 size)        { FormatArg a(FormatArgType::Signed, size); a._signed = value; return a; }
+        inline FormatArg MakeUnsigned(uint64 value, uint8 size)     { FormatArg a(FormatArgType::Unsigned, size); a._unsigned = value; return a; }
+
+        inline FormatArg MakeFormatArg(bool value)                  { FormatArg a(FormatArgType::Bool, 1); a._unsigned = value; return a; }
+        inline FormatArg MakeFormatArg(char value)                  { FormatArg a(FormatArgType::Char, 1); a._signed = value; return a; }
+        inline FormatArg MakeFormatArg(signed char value)           { return MakeSigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(unsigned char value)         { return MakeUnsigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(short value)                 { return MakeSigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(unsigned short value)        { return MakeUnsigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(int value)                   { return MakeSigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(unsigned value)              { return MakeUnsigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(long value)                  { return MakeSigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(unsigned long value)         { return MakeUnsigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(long long value)             { return MakeSigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(unsigned long long value)    { return MakeUnsigned(value, sizeof(value)); }
+        inline FormatArg MakeFormatArg(float value)                 { FormatArg a(FormatArgType::Float, sizeof(value)); a._double = value; return a; }
+        inline FormatArg MakeFormatArg(double value)                { FormatArg a(FormatArgType::Double, sizeof(value)); a._double = value; return a; }
+        inline FormatArg MakeFormatArg(long double value)           { FormatArg a(FormatArgType::Double, sizeof(double)); a._double = double(value); return a; }
+        inline FormatArg MakeFormatArg(const char value[])          { FormatArg a(FormatArgType::String, 0); a._string = value; return a; }
+        inline FormatArg MakeFormatArg(const std::string& value)    { FormatArg a(FormatArgType::String, 0); a._string = value.c_str(); a._stringLength = value.size(); return a; }
+        inline FormatArg MakeFormatArg(const void* value)           { FormatArg a(FormatArgType::Pointer, sizeof(value)); a._pointer = value; return a; }
+
+        XL_UTILITY_API size_t FormatImpl(
+            char destination[], size_t destinationSize,
+            const char format[], const FormatArg args[], size_t argCount);
+
+        XL_UTILITY_API size_t WriteShortest(char destination[], size_t destinationSize, double value);
+        XL_UTILITY_API size_t WriteShortest(char destination[], size_t destinationSize, float value);
+    }
+
+    /// <summary>Type-safe printf style formatting</summary>
+    /// Formats into a fixed size buffer, without any allocations. The format string uses
+    /// the normal printf syntax (flags, width, precision and "*" are supported, length
+    /// modifiers like "l", "ll", "I64" and "z" are accepted and ignored). But the type
+    /// of each argument is known, and that decides how it is written:
+    /// <list>
+    ///     <item>mismatches are never undefined behaviour. "%i" with a float argument
+    ///         writes the truncated integer, "%f" with an int argument writes a float,
+    ///         "%s" works with any argument</item>
+    ///     <item>std::string can be passed directly to "%s"</item>
+    ///     <item>float and double written with "%g" or "%s" (and no precision) use
+    ///         the shortest decimal representation that reads back to exactly the
+    ///         same value (rather than 6 significant digits)</item>
+    ///     <item>types that have no conversion (wide strings, class types) are
+    ///         compile errors</item>
+    /// </list>
+    ///
+    /// The result is always null terminated, and truncated if it doesn't fit. Returns
+    /// the number of characters written (not including the terminator).
+    ///
+    /// The format string is parsed at runtime, in a single pass with the formatting.
+    /// There's a single (non template) implementation shared by all call sites; each
+    /// call site only builds the array of arguments.
+    ///
+    /// <example>
+    ///     <code>\code
+    ///         char buffer[128];
+    ///         XlFormat(buffer, "[%s] Tex(%s) (%4ix%4i)", name, std::string("RGBA8"), width, height);
+    ///     \endcode</code>
+    /// </example>
+    template<typename... Args>
+        size_t XlFormat(char buffer[], size_t bufferSize, const char format[], const Args&... args)
+    {
+            // (leading dummy element so that zero arguments isn't a zero sized array)
+        const Internal::FormatArg argArray[] = { Internal::FormatArg(), Internal::MakeFormatArg(args)... };
+        return Internal::FormatImpl(buffer, bufferSize, format, &argArray[1], sizeof...(Args));
+    }
+
+    template<size_t Count, typename... Args>
+        size_t XlFormat(char (&buffer)[Count], const char format[], const Args&... args)
+    {
+        return XlFormat(buffer, Count, format, args...);
+    }
+
+        /// <summary>Appends formatted text to a StringMeld</summary>
+    template<int Count, typename... Args>
+        const StringMeld<Count, char>& XlFormat(const StringMeld<Count, char>& meld, const char format[], const Args&... args)
+    {
+        char temp[Count];
+        auto length = XlFormat(temp, Count, format, args...);
+        meld._stream.rdbuf()->sputn(temp, length);
+        return meld;
+    }
+
+        /// <summary>Writes the shortest decimal string that converts back to the same value</summary>
+        /// Returns the number of characters written (not including the terminator)
+    inline size_t XlFloatToString(char buffer[], size_t bufferSize, double value) { return Internal::WriteShortest(buffer, bufferSize, value); }
+    inline size_t XlFloatToString(char buffer[], size_t bufferSize, float value) { return Internal::WriteShortest(buffer, bufferSize, value); }
+}
+
+using namespace Utility;
+
@@ -0,0 +1,153 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "LockFreeHashTable.h"
+#include "../PtrUtils.h"
+#include <assert.h>
+
+namespace Utility { namespace LockFree
+{
+    static const uint64 EmptyKey = 0;
+    static const uint64 ZeroKeyReplacement = 0x9e3779b97f4a7c15ull;
+
+    static uint64 AdjustKey(uint64 key)
+    {
+            //  Key 0 marks an empty slot, so we must remap it. Collisions with
+            //  the replacement value are astronomically unlikely for hash keys
+        return (key != EmptyKey) ? key : ZeroKeyReplacement;
+    }
+
+    static unsigned FirstProbe(uint64 key, unsigned capacity)
+    {
+            //  Keys are normally already hash values, but the low bits might
+            //  not be well distributed (eg, keys built by xoring shifted hashes)
+        return unsigned((key ^ (key >> 32) ^ (key >> 17)) & uint64(capacity-1));
+    }
+
+    bool        HashTable64::TryGet(uint64 key, uint64& value) const
+    {
+        key = AdjustKey(key);
+        auto* a = (const SlotArray*)Interlocked::LoadPointer((void* volatile const*)&_current);
+        if (!a) return false;
+
+        auto mask = a->_capacity-1;
+        for (unsigned c=0, i=FirstProbe(key, a->_capacity); c<a->_capacity; ++c, i=(i+1)&mask) {
+            auto& slot = a->_slots[i];
+            auto slotKey = uint64(Interlocked::Load64(&slot._key));
+            if (slotKey == key) {
+                    //  the writer always writes the value before the key, so if we
+                    //  see the key, the value is valid
+                value = uint64(Interlocked::Load64(&slot._value));
+                return true;
+            }
+            if (slotKey == EmptyKey) return false;
+        }
+        return false;
+    }
+
+    void        HashTable64::Set(uint64 key, uint64 value)
+    {
+        key = AdjustKey(key);
+
+            //  Look for an existing entry first. Only the writer thread
+            //  can change _current, so it's stable within this function
+        auto* a = _current;
+        if (a) {
+            auto mask = a->_capacity-1;
+            for (unsigned c=0, i=FirstProbe(key, a->_capacity); c<a->_capacity; ++c, i=(i+1)&mask) {
+                auto& slot = a->_slots[i];
+                if (uint64(slot._key) == key) {
+                    Interlocked::Exchange64(&slot._value, Interlocked::Value64(value));
+                    return;
+                }
+                if (uint64(slot._key) == EmptyKey) break;
+            }
+        }
+
+            //  Keep the load factor under 1/2, so probe sequences stay short
+            //  and there's always an empty slot to terminate a search.
+        if (!a || (_count+1)*2 > a->_capacity) {
+            auto newArray = CreateArray(a ? (a->_capacity*2) : 16);
+            auto newMask = newArray->_capacity-1;
+            if (a) {
+                for (unsigned c=0; c<a->_capacity; ++c) {
+                    auto slotKey = uint64(a->_slots[c]._key);
+                    if (slotKey == EmptyKey) continue;
+                    auto i = FirstProbe(slotKey, newArray->_capacity);
+                    while (uint64(newArray->_slots[i]._key) != EmptyKey) i = (i+1)&newMask;
+                    newArray->_slots[i]._key = a->_slots[c]._key;
+                    newArray->_slots[i]._value = a->_slots[c]._value;
+                }
+            }
+
+                //  Publish the new array. Readers still working on the old array
+                //  will finish safely, because we never free it while the table
+                //  is alive.
+            a = newArray.get();
+            _arrays.push_back(std::move(newArray));
+            Interlocked::ExchangePointer((void* volatile*)&_current, a);
+        }
+
+        auto mask = a->_capacity-1;
+        auto i = FirstProbe(key, a->_capacity);
+        while (uint64(a->_slots[i]._key) != EmptyKey) i = (i+1)&mask;
+
+            //  Value first, then key. The interlocked exchange ensures a reader
+            //  can never see the key without the value.
+        Interlocked::Exchange64(&a->_slots[i]._value, Interlocked::Value64(value));
+        Interlocked::Exchange64(&a->_slots[i]._key, Interlocked::Value64(key));
+        ++_count;
+    }
+
+    auto HashTable64::CreateArray(unsigned capacity) -> std::unique_ptr<SlotArray>
+    {
+        assert(capacity && (capacity & (capacity-1)) == 0);
+        auto result = std::make_unique<SlotArray>();
+        result->_capacity = capacity;
+        result->_slots = std::unique_ptr<Slot[]>(new Slot[capacity]);
+        for (unsigned c=0; c<capacity; ++c) {
+            result->_slots[c]._key = Interlocked::Value64(EmptyKey);
+            result->_slots[c]._value = 0;
+        }
+        return std::move(result);
+    }
+
+    HashTable64::HashTable64(unsigned initialCapacity)
+    {
+        _current = nullptr;
+        _count = 0;
+
+        if (initialCapacity) {
+            unsigned capacity = 16;
+            while (capacity < initialCapacity) capacity <<= 1;
+
+            auto newArray = CreateArray(capacity);
+            _current = newArray.get();
+            _arrays.push_back(std::move(newArray));
+        }
+    }
+
+    HashTable64::HashTable64(HashTable64&& moveFrom)
+    : _arrays(std::move(moveFrom._arrays))
+    {
+        _current = moveFrom._current;
+        _count = moveFrom._count;
+        moveFrom._current = nullptr;
+        moveFrom._count = 0;
+    }
+
+    HashTable64& HashTable64::operator=(HashTable64&& moveFrom)
+    {
+        _arrays = std::move(moveFrom._arrays);
+        _current = moveFrom._current;
+        _count = moveFrom._count;
+        moveFrom._current = nullptr;
+        moveFrom._count = 0;
+        return *this;
+    }
+
+    HashTable64::~HashTable64() {}
+}}
@@ -0,0 +1,74 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "ThreadingUtils.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <memory>
+
+namespace Utility { namespace LockFree
+{
+    /// <summary>Hash table of 64 bit keys to 64 bit values with wait-free lookups</summary>
+    /// Intended for caches that are read very frequently from many threads, but
+    /// written rarely (eg, shader variation lookups). TryGet() never takes a lock
+    /// and never loops for longer than a bounded probe sequence, so it can run
+    /// at any time on any thread -- even concurrently with a writer.
+    ///
+    /// But there must only be a single writer at a time! Callers must serialise
+    /// calls to Set() (and the move operators) externally. Normally the client
+    /// already has a lock for the slow path (the path that creates the values),
+    /// so this just falls within that lock.
+    ///
+    /// This is an open addressing table with linear probing. When the table grows,
+    /// a new slot array is allocated and published atomically; older arrays are
+    /// retained (but never written to again) until the table is destroyed, so a
+    /// reader that started on an old array can always complete safely. A reader
+    /// may miss an entry that is being inserted at the same time -- it should treat
+    /// that as a normal miss, and take the slow path.
+    ///
+    /// Entries can't be removed (but the value for an existing key can be replaced).
+    /// The key value 0 is reserved internally; keys that happen to be 0 are remapped
+    /// so clients don't have to care.
+    class HashTable64
+    {
+    public:
+        bool        TryGet(uint64 key, uint64& value) const;
+        void        Set(uint64 key, uint64 value);
+        size_t      Size() const { return _count; }
+
+        HashTable64(unsigned initialCapacity = 64);
+        HashTable64(HashTable64&& moveFrom);
+        HashTable64& operator=(HashTable64&& moveFrom);
+        ~HashTable64();
+    private:
+        class Slot
+        {
+        public:
+            Interlocked::Value64    _key;
+            Interlocked::Value64    _value;
+        };
+
+        class SlotArray
+        {
+        public:
+            std::unique_ptr<Slot[]>     _slots;
+            unsigned                    _capacity;      // always a power of 2
+        };
+
+        SlotArray* volatile                         _current;
+        std::vector<std::unique_ptr<SlotArray>>     _arrays;    // (includes retired arrays)
+        size_t                                      _count;
+
+        static std::unique_ptr<SlotArray> CreateArray(unsigned capacity);
+
+        HashTable64(const HashTable64&);
+        HashTable64& operator=(const HashTable64&);
+    };
+}}
+
+using namespace Utility;
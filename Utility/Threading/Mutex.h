@@ -24,7 +24,7 @@
     {
         typedef tthread::fast_mutex Mutex;
         typedef tthread::recursive_mutex RecursiveMutex;    // \todo -- haven't checked if this mutex is properly recursive
-        typedef tthread::fast_mutex ReadWriteMutex;         // read/write mutex not provided by tinythread. Maybe implement with AcquireSRWLockShared? Possibly part of C++14?
+        class ReadWriteMutex;                               // read/write mutex not provided by tinythread (see ReadWriteMutex.h)
     }}
     using namespace Utility;
 
@@ -35,7 +35,7 @@
     #endif
 
     #define ScopedLock(x)       tthread::lock_guard<::Utility::Threading::Mutex> _autoLockA(x)
-    #define ScopedReadLock(x)   tthread::lock_guard<::Utility::Threading::ReadWriteMutex> _autoLockB(x)
+    #define ScopedReadLock(x)   ::Utility::Threading::SharedLock _autoLockB(x)
     #define ScopedModifyLock(x) tthread::lock_guard<::Utility::Threading::ReadWriteMutex> _autoLockC(x)
 
 #endif
@@ -52,13 +52,13 @@
     {
         typedef std::mutex Mutex;
         typedef std::recursive_mutex RecursiveMutex;
-        typedef std::mutex ReadWriteMutex;      // C++11 doesn't have a read/write lock (coming in C++14, apparently)
+        class ReadWriteMutex;                   // C++11 doesn't have a read/write lock (see ReadWriteMutex.h)
     }}
     using namespace Utility;
 
     #define ScopedLock(x)            std::unique_lock<std::mutex> _autoLockA(x)
-    #define ScopedReadLock(x)        std::unique_lock<std::mutex> _autoLockB(x)
-    #define ScopedModifyLock(x)      std::unique_lock<std::mutex> _autoLockC(x)
+    #define ScopedReadLock(x)        ::Utility::Threading::SharedLock _autoLockB(x)
+    #define ScopedModifyLock(x)      std::unique_lock<::Utility::Threading::ReadWriteMutex> _autoLockC(x)
 
 #endif
 
@@ -102,3 +102,8 @@
     #undef _STITCH
 
 #endif
+
+///////////////////////////////////////////////////////////////////////////////
+#if (THREAD_LIBRARY == THREAD_LIBRARY_TINYTHREAD) || (THREAD_LIBRARY == THREAD_LIBRARY_STDCPP)
+    #include "ReadWriteMutex.h"
+#endif
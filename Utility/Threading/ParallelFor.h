@@ -0,0 +1,73 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "ThreadingUtils.h"
+#include "../../Core/Exceptions.h"
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+
+namespace Utility { namespace Threading
+{
+    /// <summary>Calls fn(job) for every job in [0, jobCount), spread across threads</summary>
+    /// Each thread pulls the next job index from a shared counter, so jobs of uneven
+    /// cost are balanced across the threads. The calling thread also does work, and
+    /// the function returns after every job has finished.
+    ///
+    /// Jobs are started in increasing order, but may finish in any order. Callers that
+    /// need deterministic output should write each job's result into its own slot,
+    /// and merge the results in job order afterwards.
+    ///
+    /// A threadCount of zero means std::thread::hardware_concurrency(). No more
+    /// threads than jobs are used, and with a single thread (or a single job) everything
+    /// runs on the calling thread.
+    ///
+    /// If a job throws, no further jobs are started, and the first exception is
+    /// rethrown on the calling thread once all threads have stopped.
+    template<typename Fn>
+        void ParallelFor(unsigned threadCount, unsigned jobCount, const Fn& fn)
+    {
+        if (!threadCount) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+
+        Interlocked::Value nextJob = 0;
+        Interlocked::Value failed = 0;
+        std::exception_ptr firstError;
+        auto worker = [&]() {
+            for (;;) {
+                auto job = unsigned(Interlocked::Increment(&nextJob));
+                if (job >= jobCount || Interlocked::Load(&failed)) break;
+                TRY {
+                    fn(job);
+                } CATCH (...) {
+                    if (Interlocked::CompareExchange(&failed, 1, 0) == 0) {
+                        firstError = std::current_exception();
+                    }
+                    break;
+                } CATCH_END
+            }
+        };
+
+        auto count = std::max(1u, std::min(threadCount, jobCount));
+        std::vector<std::thread> threads;
+        threads.reserve(count-1);
+        for (unsigned c=1; c<count; ++c) {
+            threads.push_back(std::thread(worker));
+        }
+        worker();
+        for (auto& t:threads) t.join();
+
+        if (firstError) {
+            std::rethrow_exception(firstError);
+        }
+    }
+}}
+
+using namespace Utility;
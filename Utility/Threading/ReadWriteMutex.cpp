@@ -0,0 +1,122 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "ReadWriteMutex.h"
+
+#if COMPILER_ACTIVE == COMPILER_TYPE_MSVC
+    #define RWMUTEX_THREAD_LOCAL    __declspec(thread)
+#else
+    #define RWMUTEX_THREAD_LOCAL    __thread
+#endif
+
+namespace Utility { namespace Threading
+{
+        // The stripe for the current thread (plus one, so zero means "not assigned yet").
+        // Shared by all ReadWriteMutex objects, so threads only need to be assigned once.
+    static RWMUTEX_THREAD_LOCAL unsigned s_readerStripe = 0;
+    static Interlocked::Value s_nextReaderStripe = 0;
+
+    unsigned ReadWriteMutex::GetReaderStripe()
+    {
+        auto stripe = s_readerStripe;
+        if (!stripe) {
+            stripe = (unsigned(Interlocked::Increment(&s_nextReaderStripe)) % StripeCount) + 1;
+            s_readerStripe = stripe;
+        }
+        return stripe - 1;
+    }
+
+    void ReadWriteMutex::lock_shared()
+    {
+        auto* count = &_readers[GetReaderStripe()]._count;
+        for (;;) {
+                //  Increment is a full barrier, so a writer that sets _writerActive
+                //  after this point will see our count
+            Interlocked::Increment(count);
+            if (!Interlocked::Load(&_writerActive)) {
+                return;
+            }
+
+                //  A writer is waiting or active. Back out (so the writer doesn't
+                //  wait for us), and wait for it to finish by taking the writer mutex.
+            Interlocked::Decrement(count);
+            _writerLock.lock();
+            _writerLock.unlock();
+        }
+    }
+
+    bool ReadWriteMutex::try_lock_shared()
+    {
+        auto* count = &_readers[GetReaderStripe()]._count;
+        Interlocked::Increment(count);
+        if (!Interlocked::Load(&_writerActive)) {
+            return true;
+        }
+        Interlocked::Decrement(count);
+        return false;
+    }
+
+    void ReadWriteMutex::unlock_shared()
+    {
+        Interlocked::Decrement(&_readers[GetReaderStripe()]._count);
+    }
+
+    void ReadWriteMutex::lock()
+    {
+        _writerLock.lock();
+        Interlocked::Exchange(&_writerActive, 1);
+        WaitForReaders();
+    }
+
+    bool ReadWriteMutex::try_lock()
+    {
+        if (!_writerLock.try_lock()) {
+            return false;
+        }
+
+        Interlocked::Exchange(&_writerActive, 1);
+        for (unsigned c=0; c<StripeCount; ++c) {
+            if (Interlocked::Load(&_readers[c]._count)) {
+                Interlocked::Exchange(&_writerActive, 0);
+                _writerLock.unlock();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void ReadWriteMutex::unlock()
+    {
+        Interlocked::Exchange(&_writerActive, 0);
+        _writerLock.unlock();
+    }
+
+    void ReadWriteMutex::WaitForReaders()
+    {
+            //  New readers will back out now that _writerActive is set, so
+            //  each stripe only has to reach zero once
+        for (unsigned c=0; c<StripeCount; ++c) {
+            unsigned spinCount = 0;
+            while (Interlocked::Load(&_readers[c]._count)) {
+                if (++spinCount < 64) {
+                    Pause();
+                } else {
+                    YieldTimeSlice();
+                }
+            }
+        }
+    }
+
+    ReadWriteMutex::ReadWriteMutex()
+    {
+        for (unsigned c=0; c<StripeCount; ++c) {
+            _readers[c]._count = 0;
+        }
+        _writerActive = 0;
+    }
+
+    ReadWriteMutex::~ReadWriteMutex() {}
+}}
@@ -0,0 +1,85 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "Mutex.h"
+#include "ThreadingUtils.h"
+
+namespace Utility { namespace Threading
+{
+    /// <summary>Reader/writer lock for data that is read often and changed rarely</summary>
+    /// Any number of threads can hold the lock for reading at the same time, and a writer
+    /// gets exclusive access. Intended for tables and caches that are looked up from many
+    /// threads, but only occasionally modified.
+    ///
+    /// The reader count is split into stripes, each on its own cache line. Each thread
+    /// is given a stripe (round robin) the first time it takes a read lock, so readers
+    /// on different threads normally touch different cache lines. With a single shared
+    /// count, that cache line would move between cores on every lock and unlock, and
+    /// readers would slow each other down even though they never block.
+    ///
+    /// Writers take priority. Once a writer is waiting, new readers wait for it to
+    /// finish, so a steady stream of readers can't starve writers. Writers are serialised
+    /// by a normal mutex, and readers waiting for a writer block on that same mutex
+    /// (they don't spin). A writer spins (and then yields) while existing readers drain,
+    /// so read locks should only be held for short periods.
+    ///
+    /// The lock isn't recursive. A thread holding a read lock must not lock again
+    /// (for reading or writing) -- that deadlocks if a writer is waiting.
+    ///
+    /// Method names follow std::shared_timed_mutex. So std::unique_lock works for
+    /// writing, and SharedLock is provided for reading. Normally used through the
+    /// ScopedReadLock and ScopedModifyLock macros.
+    class ReadWriteMutex
+    {
+    public:
+        void lock();
+        bool try_lock();
+        void unlock();
+
+        void lock_shared();
+        bool try_lock_shared();
+        void unlock_shared();
+
+        ReadWriteMutex();
+        ~ReadWriteMutex();
+
+        static const unsigned StripeCount = 16;
+    private:
+        class Stripe
+        {
+        public:
+            Interlocked::Value  _count;
+            uint8               _padding[64 - sizeof(Interlocked::Value)];
+        };
+
+        Stripe                      _readers[StripeCount];
+        Interlocked::Value          _writerActive;
+        Mutex                       _writerLock;
+
+        void WaitForReaders();
+        static unsigned GetReaderStripe();
+
+        ReadWriteMutex(const ReadWriteMutex&);
+        ReadWriteMutex& operator=(const ReadWriteMutex&);
+    };
+
+        /// <summary>Holds a read lock on a ReadWriteMutex for the lifetime of the object</summary>
+    class SharedLock
+    {
+    public:
+        explicit SharedLock(ReadWriteMutex& mutex) : _mutex(&mutex) { _mutex->lock_shared(); }
+        ~SharedLock() { _mutex->unlock_shared(); }
+    private:
+        ReadWriteMutex* _mutex;
+
+        SharedLock(const SharedLock&);
+        SharedLock& operator=(const SharedLock&);
+    };
+}}
+
+using namespace Utility;
@@ -9,6 +9,12 @@
 #include "StringFormat.h"
 #include <stdlib.h>
 #include <malloc.h>
+#include <algorithm>
+
+#if (COMPILER_ACTIVE == COMPILER_TYPE_MSVC) || defined(__SSE2__)
+    #define UTF_SSE2
+    #include <emmintrin.h>
+#endif
 
 namespace Utility
 {
@@ -28,11 +34,6 @@ static const ucs4 HALF_MASK = 0x000003FFUL;
 #define UNI_SUR_LOW_START   (ucs4)0xDC00
 #define UNI_SUR_LOW_END     (ucs4)0xDFFF
 
-enum ucs_conv_rule {
-    UCR_STRICT = 0,
-    UCR_LENIENT
-};
-
 static inline int octal_digit(utf8 c)
 {
     return (c >= '0' && c <= '7');
@@ -80,418 +81,535 @@ int utf8_step(const char* utf8_str)
     return utf8_bytes[static_cast<unsigned char>(*utf8_str)];
 }
 
-static bool IsValid(const utf8* src, size_t len) 
-{
-    utf8 a;
-    const utf8* srcptr = src + len;
-    switch (len) {
-    default: return false;
-    // everything else falls through when "true"... 
-    case 4: if ((a = (*--srcptr)) < 0x80 || a > 0xBF) return false;
-    case 3: if ((a = (*--srcptr)) < 0x80 || a > 0xBF) return false;
-    case 2: if ((a = (*--srcptr)) > 0xBF) return false;
+#pragma warning(disable:4127)       // warning C4127: conditional expression is constant
 
-    switch (*src) {
-        case 0xE0: if (a < 0xA0) return false; 
-            break;
-        case 0xED: if ((a < 0x80) || (a > 0x9F)) return false; 
-            break;
-        case 0xF0: if (a < 0x90) return false; 
-            break;
-        case 0xF4: if (a > 0x8F) return false; 
-            break;
-        default:   if (a < 0x80) return false;
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //  Bulk conversion
+    //
+    //  Text is mostly ASCII (or, for UTF-16 and UTF-32, mostly in the BMP). So each
+    //  conversion first copies as many "simple" units as possible, 16 bytes at a time
+    //  with SSE2, and then handles a single complex code point with the scalar code.
+    //  The simple copies also stop at a null, because all of the conversions end there.
+
+#if defined(UTF_SSE2)
+
+        // bit i is set if byte i isn't in [1, 0x7f]
+    static inline unsigned NonASCIIMask8(__m128i v)
+    {
+        return (unsigned)_mm_movemask_epi8(_mm_or_si128(v, _mm_cmpeq_epi8(v, _mm_setzero_si128())));
     }
 
-    case 1: if (*src >= 0x80 && *src < 0xC2) return false;
+        // non zero if any unit isn't in [1, 0x7f]
+    static inline unsigned NonASCIIMask16(__m128i v)
+    {
+        __m128i outside = _mm_or_si128(
+            _mm_adds_epu16(v, _mm_set1_epi16(0x7f80)),      // (sets the top bit for values >= 0x80)
+            _mm_cmpeq_epi16(v, _mm_setzero_si128()));
+        return (unsigned)_mm_movemask_epi8(outside) & 0xaaaa;   // (top bit of each unit only)
     }
-    if (*src > 0xF4) return false;
-    return true;
+
+    static inline unsigned NonASCIIMask32(__m128i v)
+    {
+        __m128i outside = _mm_or_si128(
+            _mm_cmpgt_epi32(v, _mm_set1_epi32(0x7f)),
+            _mm_cmplt_epi32(v, _mm_set1_epi32(1)));         // (zero, and values >= 0x80000000)
+        return (unsigned)_mm_movemask_epi8(outside);
+    }
+
+#endif
+
+    // Each of the following copies units from the start of "src" until it finds one that needs
+    // the scalar path (or until "count" units). Returns the number of units copied.
+
+static size_t CopyASCII(const utf8* src, size_t count, ucs2* dst)
+{
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        for (; (c+16) <= count; c+=16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&src[c]);
+            if (NonASCIIMask8(v)) break;
+            _mm_storeu_si128((__m128i*)&dst[c],   _mm_unpacklo_epi8(v, _mm_setzero_si128()));
+            _mm_storeu_si128((__m128i*)&dst[c+8], _mm_unpackhi_epi8(v, _mm_setzero_si128()));
+        }
+    #endif
+    for (; c<count && src[c] && src[c] < 0x80; ++c) dst[c] = src[c];
+    return c;
 }
 
-#pragma warning(disable:4127)       // warning C4127: conditional expression is constant
+static size_t CopyASCII(const utf8* src, size_t count, ucs4* dst)
+{
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; (c+16) <= count; c+=16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&src[c]);
+            if (NonASCIIMask8(v)) break;
+            __m128i lo = _mm_unpacklo_epi8(v, zero), hi = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_si128((__m128i*)&dst[c],    _mm_unpacklo_epi16(lo, zero));
+            _mm_storeu_si128((__m128i*)&dst[c+4],  _mm_unpackhi_epi16(lo, zero));
+            _mm_storeu_si128((__m128i*)&dst[c+8],  _mm_unpacklo_epi16(hi, zero));
+            _mm_storeu_si128((__m128i*)&dst[c+12], _mm_unpackhi_epi16(hi, zero));
+        }
+    #endif
+    for (; c<count && src[c] && src[c] < 0x80; ++c) dst[c] = src[c];
+    return c;
+}
 
-bool IsValid(const utf8* s, const utf8* se) 
+static size_t CopyASCII(const ucs2* src, size_t count, utf8* dst)
 {
-    size_t len;
-    if (s == se) {
-        return true;
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        for (; (c+16) <= count; c+=16) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)&src[c]);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)&src[c+8]);
+            if (NonASCIIMask16(v0) | NonASCIIMask16(v1)) break;
+            _mm_storeu_si128((__m128i*)&dst[c], _mm_packus_epi16(v0, v1));
+        }
+    #endif
+    for (; c<count && src[c] && src[c] < 0x80; ++c) dst[c] = utf8(src[c]);
+    return c;
+}
+
+static size_t CopyASCII(const ucs4* src, size_t count, utf8* dst)
+{
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        for (; (c+16) <= count; c+=16) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)&src[c]);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)&src[c+4]);
+            __m128i v2 = _mm_loadu_si128((const __m128i*)&src[c+8]);
+            __m128i v3 = _mm_loadu_si128((const __m128i*)&src[c+12]);
+            if (NonASCIIMask32(v0) | NonASCIIMask32(v1) | NonASCIIMask32(v2) | NonASCIIMask32(v3)) break;
+            _mm_storeu_si128((__m128i*)&dst[c], _mm_packus_epi16(_mm_packs_epi32(v0, v1), _mm_packs_epi32(v2, v3)));
+        }
+    #endif
+    for (; c<count && src[c] && src[c] < 0x80; ++c) dst[c] = utf8(src[c]);
+    return c;
+}
+
+    // UTF-16 <-> UTF-32 can copy anything in the BMP other than surrogates
+
+static size_t CopyBMP(const ucs2* src, size_t count, ucs4* dst)
+{
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; (c+8) <= count; c+=8) {
+            __m128i v = _mm_loadu_si128((const __m128i*)&src[c]);
+            __m128i complex = _mm_or_si128(
+                _mm_cmpeq_epi16(_mm_and_si128(v, _mm_set1_epi16(short(0xf800))), _mm_set1_epi16(short(0xd800))),
+                _mm_cmpeq_epi16(v, zero));
+            if (_mm_movemask_epi8(complex)) break;
+            _mm_storeu_si128((__m128i*)&dst[c],   _mm_unpacklo_epi16(v, zero));
+            _mm_storeu_si128((__m128i*)&dst[c+4], _mm_unpackhi_epi16(v, zero));
+        }
+    #endif
+    for (; c<count && src[c] && (src[c] & 0xf800) != 0xd800; ++c) dst[c] = src[c];
+    return c;
+}
+
+static size_t CopyBMP(const ucs4* src, size_t count, ucs2* dst)
+{
+    size_t c = 0;
+    #if defined(UTF_SSE2)
+        for (; (c+8) <= count; c+=8) {
+            __m128i v0 = _mm_loadu_si128((const __m128i*)&src[c]);
+            __m128i v1 = _mm_loadu_si128((const __m128i*)&src[c+4]);
+            __m128i complex0 = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpgt_epi32(v0, _mm_set1_epi32(0xffff)), _mm_cmplt_epi32(v0, _mm_set1_epi32(1))),
+                _mm_cmpeq_epi32(_mm_and_si128(v0, _mm_set1_epi32(0xf800)), _mm_set1_epi32(0xd800)));
+            __m128i complex1 = _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpgt_epi32(v1, _mm_set1_epi32(0xffff)), _mm_cmplt_epi32(v1, _mm_set1_epi32(1))),
+                _mm_cmpeq_epi32(_mm_and_si128(v1, _mm_set1_epi32(0xf800)), _mm_set1_epi32(0xd800)));
+            if (_mm_movemask_epi8(_mm_or_si128(complex0, complex1))) break;
+                // (no unsigned saturating pack in SSE2, so sign extend the low 16 bits first)
+            v0 = _mm_srai_epi32(_mm_slli_epi32(v0, 16), 16);
+            v1 = _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16);
+            _mm_storeu_si128((__m128i*)&dst[c], _mm_packs_epi32(v0, v1));
+        }
+    #endif
+    for (; c<count && src[c] && src[c] <= 0xffff && (src[c] & 0xf800) != 0xd800; ++c) dst[c] = ucs2(src[c]);
+    return c;
+}
+
+    // Decodes a single code point, with the validation rules from table 3-7 of the
+    // Unicode standard (no overlong forms, surrogates or values above 0x10FFFF).
+    // Returns the number of bytes used. For an ill-formed sequence, returns minus the
+    // length of the "maximal subpart" (the part that should become a single replacement
+    // character), and sets "truncated" if the sequence was only cut off by the end of the input.
+static inline int DecodeUTF8(const utf8* s, const utf8* se, ucs4& ch, bool& truncated)
+{
+    utf8 b0 = s[0];
+    if (b0 < 0x80) { ch = b0; return 1; }
+
+        // common 2 & 3 byte forms, where any continuation byte is allowed
+    if (b0 >= 0xC2 && b0 <= 0xDF && (s+1) < se && (s[1] & 0xC0) == 0x80) {
+        ch = (ucs4(b0 & 0x1F) << 6) | (s[1] & 0x3F);
+        return 2;
     }
-    while (true) {
-        len = _trailing_bytes[*s]+1;
-        if (s+len > se) {
-            return false;
-        }
-        if (!IsValid(s, len)) {
-            return false;
-        }
-        s += len;
-        if (s >= se) {
-            return true;
-        }
+    if (b0 >= 0xE1 && b0 <= 0xEC && (s+2) < se && (s[1] & 0xC0) == 0x80 && (s[2] & 0xC0) == 0x80) {
+        ch = (ucs4(b0 & 0x0F) << 12) | (ucs4(s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+        return 3;
     }
+
+    unsigned trailing;
+    ucs4 c;
+    utf8 lo = 0x80, hi = 0xBF;
+    if (b0 >= 0xC2 && b0 <= 0xDF) {
+        trailing = 1; c = b0 & 0x1F;
+    } else if (b0 >= 0xE0 && b0 <= 0xEF) {
+        trailing = 2; c = b0 & 0x0F;
+        if (b0 == 0xE0) lo = 0xA0;          // (overlong)
+        else if (b0 == 0xED) hi = 0x9F;     // (surrogates)
+    } else if (b0 >= 0xF0 && b0 <= 0xF4) {
+        trailing = 3; c = b0 & 0x07;
+        if (b0 == 0xF0) lo = 0x90;          // (overlong)
+        else if (b0 == 0xF4) hi = 0x8F;     // (above 0x10FFFF)
+    } else {
+        return -1;
+    }
+
+    for (unsigned i=1; i<=trailing; ++i) {
+        if ((s+i) >= se) { truncated = true; return -int(i); }
+        utf8 b = s[i];
+        if (b < lo || b > hi) return -int(i);
+        lo = 0x80; hi = 0xBF;
+        c = (c << 6) | (b & 0x3F);
+    }
+
+    ch = c;
+    return int(trailing + 1);
 }
 
-int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl)
+    // "ch" must be a valid code point. "dst" needs space for 4 bytes
+static inline unsigned EncodeUTF8(ucs4 ch, utf8* dst)
 {
-    ucs4 ch;
-    int nb;
+    if (ch < 0x80) {
+        dst[0] = utf8(ch);
+        return 1;
+    }
+    if (ch < 0x800) {
+        dst[0] = utf8((ch >> 6) | 0xC0);
+        dst[1] = utf8((ch & 0x3F) | 0x80);
+        return 2;
+    }
+    if (ch < 0x10000) {
+        dst[0] = utf8((ch >> 12) | 0xE0);
+        dst[1] = utf8(((ch >> 6) & 0x3F) | 0x80);
+        dst[2] = utf8((ch & 0x3F) | 0x80);
+        return 3;
+    }
+    dst[0] = utf8((ch >> 18) | 0xF0);
+    dst[1] = utf8(((ch >> 12) & 0x3F) | 0x80);
+    dst[2] = utf8(((ch >> 6) & 0x3F) | 0x80);
+    dst[3] = utf8((ch & 0x3F) | 0x80);
+    return 4;
+}
 
-    const utf8* s = src;
-    const utf8* se = src + sl;
-    const ucs4* de = dst + dl;
-    ucs4* d = dst;
+    // Reads a code point from UTF-16 (src[0] must not be zero). Returns the number of units
+    // used, or minus the number of units in an ill-formed sequence (always 1)
+static inline int DecodeUTF16(const ucs2* s, const ucs2* se, ucs4& ch, bool& truncated)
+{
+    ucs4 c = s[0];
+    if (c >= UNI_SUR_HIGH_START && c <= UNI_SUR_HIGH_END) {
+        if ((s+1) >= se) { truncated = true; return -1; }
+        ucs4 c2 = s[1];
+        if (c2 < UNI_SUR_LOW_START || c2 > UNI_SUR_LOW_END) return -1;
+        ch = ((c - UNI_SUR_HIGH_START) << HALF_SHIFT) + (c2 - UNI_SUR_LOW_START) + HALF_BASE;
+        return 2;
+    }
+    if (c >= UNI_SUR_LOW_START && c <= UNI_SUR_LOW_END) return -1;
+    ch = c;
+    return 1;
+}
 
-    ucs_conv_error err = UCE_OK;
+static inline bool IsValidCodePoint(ucs4 ch)
+{
+    return ch <= UTF_MAX_LEGAL_UTF32 && (ch < UNI_SUR_HIGH_START || ch > UNI_SUR_LOW_END);
+}
 
-    while (s < se) {
-        nb = _trailing_bytes[*src];
-        if (s + nb >= se) {
-            err = UCE_SRC_EXHAUSTED;
-            break;
-        }
+size_t utf8_validate(const utf8* s, size_t len)
+{
+    const utf8* i = s;
+    const utf8* e = s + len;
+    for (;;) {
+        #if defined(UTF_SSE2)
+            while ((i+16) <= e && !_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)i))) i += 16;
+        #endif
+        while (i < e && *i < 0x80) ++i;
+        if (i >= e) return len;
+
+        ucs4 ch; bool truncated = false;
+        int l = DecodeUTF8(i, e, ch, truncated);
+        if (l < 0) return size_t(i - s);
+        i += l;
+    }
+}
 
-        if (!IsValid(s, nb + 1)) {
-            err =  UCE_ILLEGAL;
-            break;
-        }
+    // The conversions stay on the scalar path while the text isn't simple, and go back to
+    // the block copies as soon as it is again.
 
-        ch = 0;
-        switch (nb) {
-        case 3: ch += *src++; ch <<= 6;
-        case 2: ch += *src++; ch <<= 6;
-        case 1: ch += *src++; ch <<= 6;
-        case 0: ch += *src++;
-        }
+int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl, ucs_conv_rule rule)
+{
+    if (!dl) return UCE_DST_EXHAUSTED;
 
-        ch -= _offsets_magic[nb];
+    const utf8* s = src;
+    const utf8* se = src + sl;
+    ucs4* d = dst;
+    const ucs4* de = dst + dl - 1;          // (keep space for the terminator)
+    int err = UCE_OK;
 
-        if (d >= de) {
-            s -= (nb + 1);
-            err = UCE_DST_EXHAUSTED;
-            break;
+    while (s < se) {
+        if (*s < 0x80) {
+            if (!*s) break;
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            size_t copied = CopyASCII(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
         }
 
-        if (ch == 0) {
-            break;
+        ucs4 ch = 0; bool truncated = false;
+        int len = DecodeUTF8(s, se, ch, truncated);
+        if (len < 0) {
+            if (rule == UCR_STRICT) { err = truncated ? UCE_SRC_EXHAUSTED : UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
+            len = -len;
         }
+
+        if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
         *d++ = ch;
+        s += len;
     }
 
     *d = '\0';
-
-    if (err != UCE_OK) {
-        return err;
-    }
-
-    return (int)(d - dst);
+    return (err != UCE_OK) ? err : int(d - dst);
 }
 
-int ucs2_2_utf8(const ucs2* src, size_t sl, utf8* dst, size_t dl)
+int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl, ucs_conv_rule rule)
 {
-    ucs4 ch;
-    size_t i = 0;
-    const utf8* dend = dst + dl;
+    if (!dl) return UCE_DST_EXHAUSTED;
 
-    while (i < sl) {
-        ch = src[i];
-        if (ch == 0) {
-            break;
-        }
-        if (ch < 0x80) {
-            if (dst >= dend) {
-                return UCE_DST_EXHAUSTED;
-            }
-            *dst++ = (utf8)ch;
-        }
-        else if (ch < 0x800) {
-            if (dst >= dend - 1) {
-                return UCE_DST_EXHAUSTED;
-            }
-            *dst++ = utf8((ch >> 6) | 0xC0);
-            *dst++ = utf8((ch & 0x3F) | 0x80);
+    const utf8* s = src;
+    const utf8* se = src + sl;
+    ucs2* d = dst;
+    const ucs2* de = dst + dl - 1;          // (keep space for the terminator)
+    int err = UCE_OK;
+
+    while (s < se) {
+        if (*s < 0x80) {
+            if (!*s) break;
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            size_t copied = CopyASCII(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
         }
-        else if (ch < 0x10000) {
-            if (dst >= dend - 2) {
-                return UCE_DST_EXHAUSTED;
-            }
-            *dst++ = utf8((ch>>12) | 0xE0);
-            *dst++ = utf8(((ch>>6) & 0x3F) | 0x80);
-            *dst++ = utf8((ch & 0x3F) | 0x80);
+
+        ucs4 ch = 0; bool truncated = false;
+        int len = DecodeUTF8(s, se, ch, truncated);
+        if (len < 0) {
+            if (rule == UCR_STRICT) { err = truncated ? UCE_SRC_EXHAUSTED : UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
+            len = -len;
         }
-        else if (ch < 0x110000) {
-            if (dst >= dend - 3) {
-                return UCE_DST_EXHAUSTED;
-            }
-            *dst++ = utf8((ch>>18) | 0xF0);
-            *dst++ = utf8(((ch>>12) & 0x3F) | 0x80);
-            *dst++ = utf8(((ch>>6) & 0x3F) | 0x80);
-            *dst++ = utf8((ch & 0x3F) | 0x80);
+
+        if (ch <= UTF_MAX_BMP) {
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            *d++ = ucs2(ch);
+        } else {
+            if ((d+1) >= de) { err = UCE_DST_EXHAUSTED; break; }
+            ch -= HALF_BASE;
+            *d++ = ucs2((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
+            *d++ = ucs2((ch & HALF_MASK) + UNI_SUR_LOW_START);
         }
-        i++;
+        s += len;
     }
 
-    if (dst < dend) {
-        *dst = '\0';
-    }
-    return (int)i;
+    *d = '\0';
+    return (err != UCE_OK) ? err : int(d - dst);
 }
 
-int ucs4_2_utf8(const ucs4* src, size_t sl, utf8* dst, size_t dl)
+int ucs2_2_utf8(const ucs2* src, size_t sl, utf8* dst, size_t dl, ucs_conv_rule rule)
 {
-    ucs4 ch;
-    size_t i = 0;
-    const utf8* dend = dst + dl;
-
-    while (i < sl) {
-        ch = src[i];
+    const ucs2* s = src;
+    const ucs2* se = src + sl;
+    utf8* d = dst;
+    const utf8* de = dst + dl;
+    int err = UCE_OK;
 
-        if (ch < 0x80) {
-            if (dst >= dend) {
-                return UCE_DST_EXHAUSTED;
-            }
-            if (ch == 0) {
-                break;
-            }
-            *dst++ = utf8(ch);
-        }
-        else if (ch >= 0x80  && ch < 0x800) {
-            if (dst >= dend - 1) {
-                return UCE_DST_EXHAUSTED;
-            }
-            *dst++ = utf8((ch >> 6)   | 0xC0);
-            *dst++ = utf8((ch & 0x3F) | 0x80);
-        }
-        else if (ch >= 0x800 && ch < 0xFFFF) {
-            if (dst >= dend - 2) {
-                return UCE_DST_EXHAUSTED;
+    while (s < se) {
+        if (*s < 0x80) {
+            if (!*s) break;
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+                // (isolated ASCII characters, like spaces in CJK text, skip the block copy)
+            if ((s+1) == se || s[1] >= 0x80) {
+                *d++ = utf8(*s++);
+                continue;
             }
-            *dst++ = utf8(((ch >> 12)       ) | 0xE0);
-            *dst++ = utf8(((ch >> 6 ) & 0x3F) | 0x80);
-            *dst++ = utf8(((ch      ) & 0x3F) | 0x80);
+            size_t copied = CopyASCII(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
+        }
+
+        ucs4 ch = *s;
+        if (ch < 0x800) {
+            if ((de - d) < 2) { err = UCE_DST_EXHAUSTED; break; }
+            d[0] = utf8((ch >> 6) | 0xC0);
+            d[1] = utf8((ch & 0x3F) | 0x80);
+            d += 2; ++s;
+            continue;
+        }
+        if (ch < UNI_SUR_HIGH_START || ch > UNI_SUR_LOW_END) {
+            if ((de - d) < 3) { err = UCE_DST_EXHAUSTED; break; }
+            d[0] = utf8((ch >> 12) | 0xE0);
+            d[1] = utf8(((ch >> 6) & 0x3F) | 0x80);
+            d[2] = utf8((ch & 0x3F) | 0x80);
+            d += 3; ++s;
+            continue;
+        }
+
+        bool truncated = false;
+        int len = DecodeUTF16(s, se, ch, truncated);
+        if (len < 0) {
+            if (rule == UCR_STRICT) { err = truncated ? UCE_SRC_EXHAUSTED : UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
+            len = -len;
+        }
+
+        if ((de - d) >= 4) {
+            d += EncodeUTF8(ch, d);
+        } else {
+            utf8 encoded[4];
+            auto encodedLength = EncodeUTF8(ch, encoded);
+            if (size_t(de - d) < encodedLength) { err = UCE_DST_EXHAUSTED; break; }
+            for (unsigned c=0; c<encodedLength; ++c) *d++ = encoded[c];
         }
-        i++;
+        s += len;
     }
 
-    if (dst < dend) {
-        *dst = '\0';
+    if (d < de) {
+        *d = '\0';
     }
-    return (int)i;
+    return (err != UCE_OK) ? err : int(s - src);
 }
 
-int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl)
+int ucs4_2_utf8(const ucs4* src, size_t sl, utf8* dst, size_t dl, ucs_conv_rule rule)
 {
-    const utf8* s = src;
-    const utf8* se = src + sl;
-    ucs2* d = dst;
-    const ucs2* de = dst + dl;
-
-    ucs_conv_rule flags = UCR_STRICT;
-    ucs_conv_error err = UCE_OK;
+    const ucs4* s = src;
+    const ucs4* se = src + sl;
+    utf8* d = dst;
+    const utf8* de = dst + dl;
+    int err = UCE_OK;
 
     while (s < se) {
-        ucs4 ch = 0;
-        utf8 nb = _trailing_bytes[*s];
-        if (s + nb >= se) {
-            err = UCE_SRC_EXHAUSTED;
-            break;
-        }
-
-        if (!IsValid(s, nb + 1)) {
-            err =  UCE_ILLEGAL;
-            break;
+        if (*s < 0x80) {
+            if (!*s) break;
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            size_t copied = CopyASCII(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
         }
 
-        switch (nb) {
-            case 5: ch += *s++; ch <<= 6;
-            case 4: ch += *s++; ch <<= 6;
-            case 3: ch += *s++; ch <<= 6;
-            case 2: ch += *s++; ch <<= 6;
-            case 1: ch += *s++; ch <<= 6;
-            case 0: ch += *s++;
+        ucs4 ch = *s;
+        if (!IsValidCodePoint(ch)) {
+            if (rule == UCR_STRICT) { err = UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
         }
-        ch -= _offsets_magic[nb];
 
-        if (d >= de) {
-            s -= (nb + 1); // Back up source pointer!
-            err = UCE_DST_EXHAUSTED;
-            break;
-        }
-
-        if (ch <= UTF_MAX_BMP) { // Target is a character <= 0xFFFF
-            // utf-16 surrogate values are illegal in utf-32
-            if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_LOW_END) {
-                if (flags == UCR_STRICT) {
-                    s -= (nb+1); // return to the illegal value itself
-                    err = UCE_ILLEGAL;
-                    break;
-                } else {
-                    *d++ = UTF_REPLACEMENT_CHAR;
-                }
-            } else {
-                if (ch == 0) {
-                    break;
-                }
-                *d++ = (ucs2)ch;
-            }
-        } else if (ch > UTF_MAX_UTF16) {
-            if (flags == UCR_STRICT) {
-                err = UCE_ILLEGAL;
-                s -= (nb+1); // return to the start
-                break; // Bail out; shouldn't continue
-            } else {
-                *d++ = UTF_REPLACEMENT_CHAR;
-            }
+        if ((de - d) >= 4) {
+            d += EncodeUTF8(ch, d);
         } else {
-            // target is a character in range 0xFFFF - 0x10FFFF.
-            if (d + 1 >= de) {
-                s -= (nb+1); // Back up source pointer! 
-                //result = targetExhausted; break;
-                break;
-            }
-            ch -= HALF_BASE;
-            *d++ = (ucs2)((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
-            *d++ = (ucs2)((ch & HALF_MASK) + UNI_SUR_LOW_START);
+            utf8 encoded[4];
+            auto encodedLength = EncodeUTF8(ch, encoded);
+            if (size_t(de - d) < encodedLength) { err = UCE_DST_EXHAUSTED; break; }
+            for (unsigned c=0; c<encodedLength; ++c) *d++ = encoded[c];
         }
+        ++s;
     }
 
-    *d = '\0';
-    if (err != UCE_OK) {
-        return err;
+    if (d < de) {
+        *d = '\0';
     }
-    
-    return (int) (d - dst);
+    return (err != UCE_OK) ? err : int(s - src);
 }
 
-int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl)
+int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl, ucs_conv_rule rule)
 {
-    const ucs4* s = src;
-    ucs2* d = dst;
+    if (!dl) return UCE_DST_EXHAUSTED;
 
+    const ucs4* s = src;
     const ucs4* se = src + sl;
-    const ucs2* de = dst + dl;
-
-    ucs_conv_rule flags = UCR_STRICT;
-    ucs_conv_error err = UCE_OK;
+    ucs2* d = dst;
+    const ucs2* de = dst + dl - 1;          // (keep space for the terminator)
+    int err = UCE_OK;
 
     while (s < se) {
-        ucs4 ch;
-        if (d >= de) {
-            // target exhausted
-            break;
+        ucs4 ch = *s;
+        if (!ch) break;
+        if (ch <= UTF_MAX_BMP && (ch < UNI_SUR_HIGH_START || ch > UNI_SUR_LOW_END)) {
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            size_t copied = CopyBMP(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
         }
-        ch = *s++;
-        if (ch <= UTF_MAX_BMP) { // Target is a character <= 0xFFFF 
-            // utf-16 surrogate values are illegal in utf-32; 0xffff or 0xfffe are both reserved values
-            if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_LOW_END) {
-                if (flags == UCR_STRICT) {
-                    --s; // return to the illegal value itself
-                    err = UCE_ILLEGAL;
-                    break;
-                } else {
-                    *d++ = UTF_REPLACEMENT_CHAR;
-                }
-            } else {
-                if (ch == 0) {
-                    break;
-                }
-                *d++ = (ucs2)ch;
-            }
-        } else if (ch > UTF_MAX_LEGAL_UTF32) {
-            if (flags == UCR_STRICT) {
-                err = UCE_ILLEGAL;
-                break;
-            } else {
-                *d++ = UTF_REPLACEMENT_CHAR;
-            }
+
+        if (!IsValidCodePoint(ch)) {
+            if (rule == UCR_STRICT) { err = UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
+        }
+
+        if (ch <= UTF_MAX_BMP) {
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            *d++ = ucs2(ch);
         } else {
-            // target is a character in range 0xFFFF - 0x10FFFF.
-            if (d + 1 >= de) {
-                --s;
-                err = UCE_DST_EXHAUSTED;
-                break;
-            }
+            if ((d+1) >= de) { err = UCE_DST_EXHAUSTED; break; }
             ch -= HALF_BASE;
-            *d++ = (ucs2)((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
-            *d++ = (ucs2)((ch & HALF_MASK) + UNI_SUR_LOW_START);
+            *d++ = ucs2((ch >> HALF_SHIFT) + UNI_SUR_HIGH_START);
+            *d++ = ucs2((ch & HALF_MASK) + UNI_SUR_LOW_START);
         }
+        ++s;
     }
 
     *d = '\0';
-
-    if (err != UCE_OK) {
-        return err;
-    }
-
-    return (int)(d - dst);
+    return (err != UCE_OK) ? err : int(d - dst);
 }
 
-int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl)
+int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl, ucs_conv_rule rule)
 {
-    const ucs2* s = src;
-    ucs4* d = dst;
+    if (!dl) return UCE_DST_EXHAUSTED;
 
+    const ucs2* s = src;
     const ucs2* se = src + sl;
-    const ucs4* de = dst + dl;
-
-    ucs4 ch, ch2;
-
-    ucs_conv_rule flags = UCR_STRICT;
-    ucs_conv_error err = UCE_OK;
+    ucs4* d = dst;
+    const ucs4* de = dst + dl - 1;          // (keep space for the terminator)
+    int err = UCE_OK;
 
     while (s < se) {
-        const ucs2* os = s; //  In case we have to back up because of target overflow.
-        ch = *s++;
-        // If we have a surrogate pair, convert to UTF32 first.
-        if (ch >= UNI_SUR_HIGH_START && ch <= UNI_SUR_HIGH_END) {
-            // If the 16 bits following the high surrogate are in the source buffer...
-            if (s < se) {
-                ch2 = *s;
-                // If it's a low surrogate, convert to UTF32. 
-                if (ch2 >= UNI_SUR_LOW_START && ch2 <= UNI_SUR_LOW_END) {
-                    ch = ((ch - UNI_SUR_HIGH_START) << HALF_SHIFT)
-                        + (ch2 - UNI_SUR_LOW_START) + HALF_BASE;
-                    ++s;
-                } else {
-                    if (flags == UCR_STRICT) { // it's an unpaired high surrogate
-                        --s;
-                        err = UCE_ILLEGAL;
-                        break;
-                    } /*else {
-                        *d++ = UNI_REPLACEMENT_CHAR;
-                    }*/
-                }
-            } else { // We don't have the 16 bits following the high surrogate.
-                --s;
-                err = UCE_SRC_EXHAUSTED;
-                break;
-            }
-        } else if (flags == UCR_STRICT) {
-            // utf-16 surrogate values are illegal in utf-32 
-            if (ch >= UNI_SUR_LOW_START && ch <= UNI_SUR_LOW_END) {
-                --s;
-                err = UCE_ILLEGAL;
-                break;
-            }
+        ucs4 ch = *s;
+        if (!ch) break;
+        if (ch < UNI_SUR_HIGH_START || ch > UNI_SUR_LOW_END) {
+            if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
+            size_t copied = CopyBMP(s, std::min(size_t(se - s), size_t(de - d)), d);
+            s += copied; d += copied;
+            continue;
         }
 
-        if (d >= de) {
-            s = os;
-            err = UCE_DST_EXHAUSTED;
-            break;
-        }
-        if (ch == 0) {
-            break;
+        bool truncated = false;
+        int len = DecodeUTF16(s, se, ch, truncated);
+        if (len < 0) {
+            if (rule == UCR_STRICT) { err = truncated ? UCE_SRC_EXHAUSTED : UCE_ILLEGAL; break; }
+            ch = UTF_REPLACEMENT_CHAR;
+            len = -len;
         }
+
+        if (d >= de) { err = UCE_DST_EXHAUSTED; break; }
         *d++ = ch;
+        s += len;
     }
 
     *d = '\0';
-    if (err != UCE_OK) {
-        return err;
-    }
-
-    return (int)(d - dst);
+    return (err != UCE_OK) ? err : int(d - dst);
 }
 
 int ucs2_2_utf8(ucs2 ch, utf8* dst)
@@ -57,17 +57,31 @@ namespace Utility
         UCE_OK = 0,
         UCE_SRC_EXHAUSTED = -1,
         UCE_DST_EXHAUSTED = -2,
-        UCE_ILLEGAL = -2
+        UCE_ILLEGAL = -3
     };
 
-    // convert UTF-8 data to ucs4
-    // return value := >= 0 if valid or 
-    XL_UTILITY_API int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl);
-    XL_UTILITY_API int ucs4_2_utf8(const ucs4* src, size_t sl, utf8* dst, size_t dl);
-    XL_UTILITY_API int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl);
-    XL_UTILITY_API int ucs2_2_utf8(const ucs2* src, size_t sl, utf8* dst, size_t dl);
-    XL_UTILITY_API int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl);
-    XL_UTILITY_API int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl);
+    // UCR_STRICT := stop with UCE_ILLEGAL at the first ill-formed sequence
+    // UCR_LENIENT := replace ill-formed sequences with UTF_REPLACEMENT_CHAR
+    enum ucs_conv_rule {
+        UCR_STRICT = 0,
+        UCR_LENIENT
+    };
+
+    // bulk conversion. Conversion stops at the end of the source, or at a null.
+    // to utf8 := returns the number of source characters used, or an error. Fills up to
+    //      dl bytes, and adds a terminator if there's space left
+    // to ucs2/ucs4 := returns the number of characters written, or an error. The output
+    //      is always null terminated (so at most dl-1 characters are written)
+    // Output written before an error is kept (and terminated).
+    XL_UTILITY_API int utf8_2_ucs4(const utf8* src, size_t sl, ucs4* dst, size_t dl, ucs_conv_rule rule = UCR_STRICT);
+    XL_UTILITY_API int ucs4_2_utf8(const ucs4* src, size_t sl, utf8* dst, size_t dl, ucs_conv_rule rule = UCR_LENIENT);
+    XL_UTILITY_API int utf8_2_ucs2(const utf8* src, size_t sl, ucs2* dst, size_t dl, ucs_conv_rule rule = UCR_STRICT);
+    XL_UTILITY_API int ucs2_2_utf8(const ucs2* src, size_t sl, utf8* dst, size_t dl, ucs_conv_rule rule = UCR_LENIENT);
+    XL_UTILITY_API int ucs4_2_ucs2(const ucs4* src, size_t sl, ucs2* dst, size_t dl, ucs_conv_rule rule = UCR_STRICT);
+    XL_UTILITY_API int ucs2_2_ucs4(const ucs2* src, size_t sl, ucs4* dst, size_t dl, ucs_conv_rule rule = UCR_STRICT);
+
+    // returns the length of the longest prefix that is well-formed utf8 (so len if it's all valid)
+    XL_UTILITY_API size_t utf8_validate(const utf8* s, size_t len);
 
     // aliases
     #define utf8_2_utf32    utf8_2_ucs4
@@ -222,6 +222,7 @@ void XlChDir(const ucs2 path[])                          { SetCurrentDirectoryW(
 
 void XlDeleteFile(const utf8 path[]) { auto result = ::DeleteFileA((char*)path); assert(result); (void)result; }
 void XlDeleteFile(const ucs2 path[]) { auto result = ::DeleteFileW((wchar_t*)path); assert(result); (void)result; }
+bool XlMoveFile(const utf8 src[], const utf8 dst[]) { return ::MoveFileExA((const char*)src, (const char*)dst, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE; }
 
 #if 0
 
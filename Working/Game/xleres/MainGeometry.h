@@ -48,7 +48,8 @@ struct VSInput //////////////////////////////////////////////////////
     #if GEO_HAS_TANGENT_FRAME==1
         float4 tangent : TANGENT;
         float3 bitangent : BITANGENT;
-        #if TANGENT_PROCESS_IN_PS==1
+            // (the instance transform isn't available in the pixel shader)
+        #if TANGENT_PROCESS_IN_PS==1 && GEO_INSTANCED_TRANSFORMS!=1
             #if !defined(OUTPUT_LOCAL_TANGENT_FRAME)
                 #define OUTPUT_LOCAL_TANGENT_FRAME 1
             #endif
@@ -78,7 +79,7 @@ struct VSInput //////////////////////////////////////////////////////
         #define OUTPUT_BLEND_TEXCOORD 1
     #endif
 
-    #if GEO_HAS_INSTANCE_ID==1
+    #if GEO_HAS_INSTANCE_ID==1 || GEO_INSTANCED_TRANSFORMS==1
         // float4 instanceOffset : INSTANCE_OFFSET;
         uint instanceId : SV_InstanceID;
     #endif
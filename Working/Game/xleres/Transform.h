@@ -19,11 +19,37 @@ cbuffer GlobalTransform : register(b0)
 
 cbuffer LocalTransform : register(b1)
 {
-	row_major float3x4 LocalToWorld;
+	#if GEO_INSTANCED_TRANSFORMS!=1
+		row_major float3x4 LocalToWorld;
+	#else
+		row_major float3x4 LocalToWorldUnused;
+	#endif
 	float3 LocalSpaceView;
 	float3 LocalNegativeLightDirection;
 }
 
+#if GEO_INSTANCED_TRANSFORMS==1
+		//	When the model renderer batches many copies of the same draw call
+		//	together, the local to world transforms come from a per-instance
+		//	buffer instead of the constant buffer. The vertex shader must call
+		//	LoadInstanceTransform() before using LocalToWorld.
+	struct InstanceTransform
+	{
+		float4 row0;
+		float4 row1;
+		float4 row2;
+	};
+
+	StructuredBuffer<InstanceTransform> InstanceTransforms : register(t14);
+	static float3x4 LocalToWorld;
+
+	void LoadInstanceTransform(uint instanceId)
+	{
+		InstanceTransform t = InstanceTransforms[instanceId];
+		LocalToWorld = float3x4(t.row0, t.row1, t.row2);
+	}
+#endif
+
 cbuffer GlobalState : register(b4)
 {
 	float3 NegativeDominantLightDirection;